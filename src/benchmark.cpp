@@ -0,0 +1,521 @@
+#include "benchmark.h"
+#include <algorithm>
+#include <fstream>
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static int32_t find_option(const std::vector<std::string>& options, const std::string& value)
+{
+    for (uint32_t i = 0; i < options.size(); i++)
+    {
+        if (options[i] == value)
+            return i;
+    }
+
+    try
+    {
+        int32_t idx = std::stoi(value);
+
+        if (idx >= 0 && uint32_t(idx) < options.size())
+            return idx;
+    }
+    catch (...)
+    {
+    }
+
+    return -1;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static float mean(const std::vector<float>& milliseconds)
+{
+    float    sum   = 0.0f;
+    uint32_t count = 0;
+
+    for (float value : milliseconds)
+    {
+        if (value >= 0.0f)
+        {
+            sum += value;
+            count++;
+        }
+    }
+
+    return count > 0 ? sum / float(count) : -1.0f;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static float percentile(const std::vector<float>& sorted, float p)
+{
+    if (sorted.size() == 0)
+        return 0.0f;
+
+    // Linear interpolation between the closest ranks.
+    const float    rank  = p * float(sorted.size() - 1);
+    const uint32_t lower = static_cast<uint32_t>(floor(rank));
+    const uint32_t upper = std::min(lower + 1, static_cast<uint32_t>(sorted.size() - 1));
+
+    return sorted[lower] + (sorted[upper] - sorted[lower]) * (rank - float(lower));
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Writes the number of frames, mean, min, max and percentiles of the frames a timing was collected in.
+static void write_statistics(std::ofstream& json, const std::vector<float>& milliseconds, const std::string& indent)
+{
+    std::vector<float> sorted;
+
+    for (float value : milliseconds)
+    {
+        if (value >= 0.0f)
+            sorted.push_back(value);
+    }
+
+    std::sort(sorted.begin(), sorted.end());
+
+    float sum = 0.0f;
+
+    for (float value : sorted)
+        sum += value;
+
+    json << indent << "\"frames\": " << sorted.size() << ",\n";
+    json << indent << "\"mean\": " << (sorted.size() > 0 ? sum / float(sorted.size()) : 0.0f) << ",\n";
+    json << indent << "\"min\": " << (sorted.size() > 0 ? sorted.front() : 0.0f) << ",\n";
+    json << indent << "\"p50\": " << percentile(sorted, 0.5f) << ",\n";
+    json << indent << "\"p90\": " << percentile(sorted, 0.9f) << ",\n";
+    json << indent << "\"p95\": " << percentile(sorted, 0.95f) << ",\n";
+    json << indent << "\"p99\": " << percentile(sorted, 0.99f) << ",\n";
+    json << indent << "\"max\": " << (sorted.size() > 0 ? sorted.back() : 0.0f) << "\n";
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+Benchmark::Benchmark(int argc, const char* argv[])
+{
+    parse(argc, argv);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+Benchmark::~Benchmark()
+{
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void Benchmark::parse(int argc, const char* argv[])
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string arg   = argv[i];
+        const bool        value = i + 1 < argc;
+
+        if (arg == "--benchmark")
+            m_enabled = true;
+        else if (arg == "--scene" && value)
+        {
+            int32_t idx = find_option(constants::scene_types, argv[++i]);
+
+            if (idx == -1)
+                DW_LOG_ERROR("Unknown benchmark scene, using " + constants::scene_types[m_scene_type]);
+            else
+                m_scene_type = (SceneType)idx;
+        }
+        else if (arg == "--scale" && value)
+        {
+            int32_t idx = find_option(constants::ray_trace_scales, argv[++i]);
+
+            if (idx == -1)
+                DW_LOG_ERROR("Unknown benchmark ray trace scale, keeping the default of each effect");
+            else
+            {
+                m_scale           = (RayTraceScale)idx;
+                m_overrides_scale = true;
+            }
+        }
+        else if (arg == "--render-scale" && value)
+        {
+            int32_t idx = find_option(constants::render_scales, argv[++i]);
+
+            if (idx == -1)
+                DW_LOG_ERROR("Unknown render scale, rendering at " + constants::render_scales[m_render_scale]);
+            else
+                m_render_scale = (RenderScale)idx;
+        }
+        else if (arg == "--precision" && value)
+        {
+            int32_t idx = find_option(constants::render_target_precisions, argv[++i]);
+
+            if (idx == -1)
+                DW_LOG_ERROR("Unknown render target precision, using " + constants::render_target_precisions[m_precision]);
+            else
+                m_precision = (RenderTargetPrecision)idx;
+        }
+        else if (arg == "--reference")
+            m_reference = true;
+        else if (arg == "--spp" && value)
+            m_reference_spp = std::max(1, atoi(argv[++i]));
+        else if (arg == "--spp-per-dispatch" && value)
+            m_spp_per_dispatch = std::max(1, atoi(argv[++i]));
+        else if (arg == "--tile-size" && value)
+            m_tile_size = std::max(8, atoi(argv[++i]));
+        else if (arg == "--tiles-per-frame" && value)
+            m_tiles_per_frame = std::max(1, atoi(argv[++i]));
+        else if (arg == "--convergence" && value)
+            m_convergence_threshold = std::max(0.0f, float(atof(argv[++i])));
+        else if (arg == "--warmup" && value)
+            m_warmup_frames = std::max(0, atoi(argv[++i]));
+        else if (arg == "--frames" && value)
+            m_measured_frames = std::max(1, atoi(argv[++i]));
+        else if (arg == "--output" && value)
+            m_output_path = argv[++i];
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool Benchmark::update(GPUTimer* gpu_timer, GPUCounters* gpu_counters)
+{
+    const int32_t frame = gpu_timer->results_frame();
+
+    if (frame == m_last_frame)
+        return false;
+
+    m_last_frame = frame;
+
+    if (frame < m_start_frame + m_warmup_frames)
+        return false;
+
+    // Passes only show up in the frames they ran in, the columns of frames in which a pass was culled are left empty.
+    for (const auto& result : gpu_timer->results())
+    {
+        auto it = std::find_if(m_passes.begin(), m_passes.end(), [&result](const Pass& pass) { return pass.name == result.name; });
+
+        if (it == m_passes.end())
+        {
+            m_passes.push_back({ result.name, std::vector<float>(m_num_collected, -1.0f) });
+            it = m_passes.end() - 1;
+        }
+
+        it->milliseconds.resize(m_num_collected, -1.0f);
+        it->milliseconds.push_back(result.milliseconds);
+    }
+
+    // Both are read back from the same frame in flight, the counters only line up with the timings if they were enabled for it.
+    if (gpu_counters)
+    {
+        const bool valid = gpu_counters->results_frame() == frame;
+
+        for (const auto& result : gpu_counters->results())
+        {
+            auto it = std::find_if(m_counters.begin(), m_counters.end(), [&result](const Counter& counter) { return counter.name == result.name; });
+
+            if (it == m_counters.end())
+            {
+                m_counters.push_back({ result.name, result.timer, std::vector<int64_t>(m_num_collected, -1) });
+                it = m_counters.end() - 1;
+            }
+
+            it->values.resize(m_num_collected, -1);
+            it->values.push_back(valid ? int64_t(result.value) : -1);
+        }
+    }
+
+    m_frame_milliseconds.push_back(gpu_timer->frame_milliseconds());
+
+    m_num_collected++;
+
+    for (auto& pass : m_passes)
+        pass.milliseconds.resize(m_num_collected, -1.0f);
+
+    for (auto& counter : m_counters)
+        counter.values.resize(m_num_collected, -1);
+
+    return m_num_collected >= m_measured_frames;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool Benchmark::write_results(uint32_t width, uint32_t height, MemoryTracker* memory_tracker)
+{
+    std::ofstream csv(m_output_path + ".csv");
+
+    if (!csv.is_open())
+    {
+        DW_LOG_ERROR("Failed to open benchmark output: " + m_output_path + ".csv");
+        return false;
+    }
+
+    csv << "frame,frame_ms";
+
+    for (const auto& pass : m_passes)
+        csv << "," << pass.name;
+
+    for (const auto& counter : m_counters)
+        csv << "," << counter.name;
+
+    csv << "\n";
+
+    for (uint32_t i = 0; i < m_num_collected; i++)
+    {
+        csv << i << "," << m_frame_milliseconds[i];
+
+        for (const auto& pass : m_passes)
+        {
+            csv << ",";
+
+            if (pass.milliseconds[i] >= 0.0f)
+                csv << pass.milliseconds[i];
+        }
+
+        for (const auto& counter : m_counters)
+        {
+            csv << ",";
+
+            if (counter.values[i] >= 0)
+                csv << counter.values[i];
+        }
+
+        csv << "\n";
+    }
+
+    std::ofstream json(m_output_path + ".json");
+
+    if (!json.is_open())
+    {
+        DW_LOG_ERROR("Failed to open benchmark output: " + m_output_path + ".json");
+        return false;
+    }
+
+    json << "{\n";
+    json << "    \"scene\": \"" << constants::scene_types[m_scene_type] << "\",\n";
+    json << "    \"ray_trace_scale\": \"" << (m_overrides_scale ? constants::ray_trace_scales[m_scale] : "Default") << "\",\n";
+    json << "    \"render_scale\": \"" << constants::render_scales[m_render_scale] << "\",\n";
+    json << "    \"precision\": \"" << constants::render_target_precisions[m_precision] << "\",\n";
+    json << "    \"width\": " << width << ",\n";
+    json << "    \"height\": " << height << ",\n";
+    json << "    \"warmup_frames\": " << m_warmup_frames << ",\n";
+    json << "    \"measured_frames\": " << m_num_collected << ",\n";
+
+    write_memory(json, memory_tracker);
+    write_counters(json);
+
+    json << "    \"frame_time\": {\n";
+    write_statistics(json, m_frame_milliseconds, "        ");
+    json << "    },\n";
+
+    json << "    \"passes\": [\n";
+
+    for (uint32_t i = 0; i < m_passes.size(); i++)
+    {
+        json << "        {\n";
+        json << "            \"name\": \"" << m_passes[i].name << "\",\n";
+        write_statistics(json, m_passes[i].milliseconds, "            ");
+        json << "        }" << (i < m_passes.size() - 1 ? "," : "") << "\n";
+    }
+
+    json << "    ]\n";
+    json << "}\n";
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void Benchmark::begin_measurement(int32_t frame)
+{
+    m_frame_milliseconds.clear();
+    m_passes.clear();
+    m_counters.clear();
+    m_num_collected = 0;
+    m_start_frame   = frame;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void Benchmark::add_reference_result(uint32_t camera, uint32_t spp, bool converged, float reference_psnr, float psnr, float flip)
+{
+    ReferenceResult result = { camera, spp, converged, reference_psnr, psnr, flip, mean(m_frame_milliseconds), {} };
+
+    // Cameras do not necessarily run the same passes, every result gets a column for each pass seen so far.
+    for (const auto& pass : m_passes)
+    {
+        if (std::find(m_pass_names.begin(), m_pass_names.end(), pass.name) == m_pass_names.end())
+            m_pass_names.push_back(pass.name);
+    }
+
+    for (const auto& name : m_pass_names)
+    {
+        auto it = std::find_if(m_passes.begin(), m_passes.end(), [&name](const Pass& pass) { return pass.name == name; });
+
+        result.pass_milliseconds.push_back(it != m_passes.end() ? mean(it->milliseconds) : -1.0f);
+    }
+
+    m_reference_results.push_back(result);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool Benchmark::write_reference_results(uint32_t width, uint32_t height, MemoryTracker* memory_tracker)
+{
+    std::ofstream csv(m_output_path + ".csv");
+
+    if (!csv.is_open())
+    {
+        DW_LOG_ERROR("Failed to open benchmark output: " + m_output_path + ".csv");
+        return false;
+    }
+
+    csv << "camera,spp,converged,reference_psnr,psnr,flip,frame_ms";
+
+    for (const auto& name : m_pass_names)
+        csv << "," << name;
+
+    csv << "\n";
+
+    for (const auto& result : m_reference_results)
+    {
+        csv << result.camera << "," << result.spp << "," << (result.converged ? 1 : 0) << "," << result.reference_psnr << "," << result.psnr << "," << result.flip << "," << result.frame_milliseconds;
+
+        for (uint32_t i = 0; i < m_pass_names.size(); i++)
+        {
+            csv << ",";
+
+            if (i < result.pass_milliseconds.size() && result.pass_milliseconds[i] >= 0.0f)
+                csv << result.pass_milliseconds[i];
+        }
+
+        csv << "\n";
+    }
+
+    std::ofstream json(m_output_path + ".json");
+
+    if (!json.is_open())
+    {
+        DW_LOG_ERROR("Failed to open benchmark output: " + m_output_path + ".json");
+        return false;
+    }
+
+    json << "{\n";
+    json << "    \"scene\": \"" << constants::scene_types[m_scene_type] << "\",\n";
+    json << "    \"ray_trace_scale\": \"" << (m_overrides_scale ? constants::ray_trace_scales[m_scale] : "Default") << "\",\n";
+    json << "    \"render_scale\": \"" << constants::render_scales[m_render_scale] << "\",\n";
+    json << "    \"precision\": \"" << constants::render_target_precisions[m_precision] << "\",\n";
+    json << "    \"width\": " << width << ",\n";
+    json << "    \"height\": " << height << ",\n";
+    json << "    \"target_spp\": " << m_reference_spp << ",\n";
+    json << "    \"convergence_threshold\": " << m_convergence_threshold << ",\n";
+    json << "    \"measured_frames\": " << m_measured_frames << ",\n";
+
+    write_memory(json, memory_tracker);
+
+    json << "    \"cameras\": [\n";
+
+    for (uint32_t i = 0; i < m_reference_results.size(); i++)
+    {
+        const ReferenceResult& result = m_reference_results[i];
+
+        json << "        {\n";
+        json << "            \"camera\": " << result.camera << ",\n";
+        json << "            \"spp\": " << result.spp << ",\n";
+        json << "            \"converged\": " << (result.converged ? "true" : "false") << ",\n";
+        json << "            \"reference_psnr\": " << result.reference_psnr << ",\n";
+        json << "            \"psnr\": " << result.psnr << ",\n";
+        json << "            \"flip\": " << result.flip << ",\n";
+        json << "            \"frame_ms\": " << result.frame_milliseconds << ",\n";
+        json << "            \"passes\": [\n";
+
+        std::vector<uint32_t> ran;
+
+        for (uint32_t j = 0; j < result.pass_milliseconds.size(); j++)
+        {
+            if (result.pass_milliseconds[j] >= 0.0f)
+                ran.push_back(j);
+        }
+
+        for (uint32_t j = 0; j < ran.size(); j++)
+            json << "                { \"name\": \"" << m_pass_names[ran[j]] << "\", \"mean\": " << result.pass_milliseconds[ran[j]] << " }" << (j < ran.size() - 1 ? "," : "") << "\n";
+
+        json << "            ]\n";
+        json << "        }" << (i < m_reference_results.size() - 1 ? "," : "") << "\n";
+    }
+
+    json << "    ]\n";
+    json << "}\n";
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void Benchmark::write_memory(std::ofstream& json, MemoryTracker* memory_tracker)
+{
+    std::vector<MemoryTracker::Result> results = memory_tracker->results();
+
+    VkDeviceSize usage  = 0;
+    VkDeviceSize budget = 0;
+
+    memory_tracker->device_local_usage(usage, budget);
+
+    json << "    \"device_local_mb\": " << MemoryTracker::megabytes(usage) << ",\n";
+    json << "    \"memory\": [\n";
+
+    for (uint32_t i = 0; i < results.size(); i++)
+        json << "        { \"name\": \"" << results[i].name << "\", \"mb\": " << MemoryTracker::megabytes(results[i].bytes) << ", \"images\": " << results[i].num_images << " }" << (i < results.size() - 1 ? "," : "") << "\n";
+
+    json << "    ],\n";
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void Benchmark::write_counters(std::ofstream& json)
+{
+    json << "    \"counters\": [\n";
+
+    for (uint32_t i = 0; i < m_counters.size(); i++)
+    {
+        const Counter& counter = m_counters[i];
+
+        auto timer = std::find_if(m_passes.begin(), m_passes.end(), [&counter](const Pass& pass) { return pass.name == counter.timer; });
+
+        uint32_t frames   = 0;
+        double   sum      = 0.0;
+        int64_t  min      = 0;
+        int64_t  max      = 0;
+        uint32_t ns_count = 0;
+        double   ns_sum   = 0.0;
+
+        for (uint32_t j = 0; j < counter.values.size(); j++)
+        {
+            const int64_t value = counter.values[j];
+
+            if (value < 0)
+                continue;
+
+            min = frames == 0 ? value : std::min(min, value);
+            max = frames == 0 ? value : std::max(max, value);
+            sum += double(value);
+            frames++;
+
+            // Averaged per frame, the time of a pass does not scale with the work across frames that ran very little of it.
+            if (timer != m_passes.end() && value > 0 && timer->milliseconds[j] >= 0.0f)
+            {
+                ns_sum += double(timer->milliseconds[j]) * 1000000.0 / double(value);
+                ns_count++;
+            }
+        }
+
+        json << "        { \"name\": \"" << counter.name << "\", \"frames\": " << frames << ", \"mean\": " << (frames > 0 ? sum / double(frames) : 0.0) << ", \"min\": " << min << ", \"max\": " << max;
+
+        if (ns_count > 0)
+            json << ", \"timer\": \"" << counter.timer << "\", \"ns_per_unit\": " << ns_sum / double(ns_count);
+
+        json << " }" << (i < m_counters.size() - 1 ? "," : "") << "\n";
+    }
+
+    json << "    ],\n";
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
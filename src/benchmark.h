@@ -0,0 +1,113 @@
+#pragma once
+
+#include "common.h"
+#include "gpu_timer.h"
+#include "gpu_counters.h"
+#include <fstream>
+
+// Camera time step, in milliseconds, used instead of the wall clock delta while benchmarking.
+#define BENCHMARK_FIXED_DELTA (1000.0 / 60.0)
+
+// Headless benchmark driven from the command line:
+//
+//   HybridRendering --benchmark [--scene <index|name>] [--scale <index|name>] [--render-scale <index|name>] [--precision <index|name>] [--warmup <frames>] [--frames <frames>] [--output <path>]
+//
+// --render-scale is also read without --benchmark, it is the only way to pick the internal resolution since the render targets
+// are not recreated at runtime.
+//
+// The camera follows the animated path of the scene with a fixed time step so that every run renders the same frames. After
+// the warm-up frames the frame time and per-pass GPU timings of the measured frames are collected, then written to <path>.csv
+// (one row per frame) and <path>.json (mean, min, max and percentiles of the frame and of every pass). The frame time is the
+// span of the whole frame on the GPU, see GPUTimer, so it is not the sum of the passes when async compute overlaps them. The GPU counters of the same frames, see GPUCounters, are
+// written next to the timings, in the JSON with the mean GPU time per counted ray or tile of the pass that did the work. The JSON
+// also holds the render target memory of every effect, see MemoryTracker, which --precision trades against quality.
+//
+//   HybridRendering --benchmark --reference [--spp <samples>] [--spp-per-dispatch <samples>] [--tile-size <pixels>] [--tiles-per-frame <tiles>] [--convergence <dB>] ...
+//
+// Visits the fixed cameras of the scene instead. For every camera the hybrid renderer is timed like above, then the path
+// tracer accumulates a reference in tiles until it has --spp samples per pixel, or until the noise left in it is estimated to
+// be below --convergence dB. PSNR and FLIP of the hybrid image against the reference are written next to the mean GPU time of
+// every pass, one row per camera.
+class Benchmark
+{
+public:
+    Benchmark(int argc, const char* argv[]);
+    ~Benchmark();
+
+    // Consumes the most recent results of the timer and the counters, returns true once every measured frame has been collected.
+    bool update(GPUTimer* gpu_timer, GPUCounters* gpu_counters = nullptr);
+    bool write_results(uint32_t width, uint32_t height, MemoryTracker* memory_tracker);
+
+    // Drops the collected timings, the warm-up starts over at the given frame.
+    void begin_measurement(int32_t frame);
+    void add_reference_result(uint32_t camera, uint32_t spp, bool converged, float reference_psnr, float psnr, float flip);
+    bool write_reference_results(uint32_t width, uint32_t height, MemoryTracker* memory_tracker);
+
+    inline bool                  enabled() { return m_enabled; }
+    inline SceneType             scene_type() { return m_scene_type; }
+    inline bool                  overrides_scale() { return m_overrides_scale; }
+    inline RayTraceScale         scale() { return m_scale; }
+    inline RenderScale           render_scale() { return m_render_scale; }
+    inline RenderTargetPrecision precision() { return m_precision; }
+    inline bool                  reference() { return m_reference; }
+    inline uint32_t              reference_spp() { return m_reference_spp; }
+    inline uint32_t              spp_per_dispatch() { return m_spp_per_dispatch; }
+    inline uint32_t              tile_size() { return m_tile_size; }
+    inline uint32_t              tiles_per_frame() { return m_tiles_per_frame; }
+    inline float                 convergence_threshold() { return m_convergence_threshold; }
+
+private:
+    struct Pass
+    {
+        std::string        name;
+        std::vector<float> milliseconds;
+    };
+
+    struct Counter
+    {
+        std::string          name;
+        std::string          timer;
+        std::vector<int64_t> values; // Negative in frames the counters were not read back for
+    };
+
+    struct ReferenceResult
+    {
+        uint32_t           camera;
+        uint32_t           spp;
+        bool               converged;
+        float              reference_psnr;
+        float              psnr;
+        float              flip;
+        float              frame_milliseconds;
+        std::vector<float> pass_milliseconds; // Mean of every pass in m_pass_names, negative if it did not run
+    };
+
+    void parse(int argc, const char* argv[]);
+    void write_memory(std::ofstream& json, MemoryTracker* memory_tracker);
+    void write_counters(std::ofstream& json);
+
+private:
+    bool                         m_enabled               = false;
+    bool                         m_overrides_scale       = false;
+    bool                         m_reference             = false;
+    SceneType                    m_scene_type            = SCENE_TYPE_SPONZA;
+    RayTraceScale                m_scale                 = RAY_TRACE_SCALE_HALF_RES;
+    RenderScale                  m_render_scale          = RENDER_SCALE_NATIVE;
+    RenderTargetPrecision        m_precision             = RENDER_TARGET_PRECISION_FULL;
+    int32_t                      m_warmup_frames         = 100;
+    int32_t                      m_measured_frames       = 500;
+    int32_t                      m_start_frame           = 0;
+    int32_t                      m_last_frame            = -1;
+    uint32_t                     m_num_collected         = 0;
+    uint32_t                     m_reference_spp         = 1024;
+    uint32_t                     m_spp_per_dispatch      = 4;
+    uint32_t                     m_tile_size             = 256;
+    uint32_t                     m_tiles_per_frame       = 4;
+    float                        m_convergence_threshold = 0.0f;
+    std::string                  m_output_path           = "benchmark";
+    std::vector<float>           m_frame_milliseconds;
+    std::vector<Pass>            m_passes;
+    std::vector<Counter>         m_counters;
+    std::vector<std::string>     m_pass_names;
+    std::vector<ReferenceResult> m_reference_results;
+};
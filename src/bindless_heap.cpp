@@ -0,0 +1,264 @@
+#include "bindless_heap.h"
+#include <macros.h>
+#include <imgui.h>
+#include <stdexcept>
+#include <cassert>
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+BindlessHeap::BindlessHeap(dw::vk::Backend::Ptr backend) :
+    m_backend(backend)
+{
+    // Slots that were never registered or have been released are left unwritten, which requires the bindings to be partially
+    // bound.
+    VkPhysicalDeviceVulkan12Features vulkan_12_features;
+    DW_ZERO_MEMORY(vulkan_12_features);
+
+    vulkan_12_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+
+    VkPhysicalDeviceFeatures2 features;
+    DW_ZERO_MEMORY(features);
+
+    features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features.pNext = &vulkan_12_features;
+
+    vkGetPhysicalDeviceFeatures2(backend->physical_device(), &features);
+
+    if (!vulkan_12_features.descriptorBindingPartiallyBound)
+        throw std::runtime_error("(Vulkan) Bindless heap requires descriptorBindingPartiallyBound, which this device does not support.");
+
+    m_sampled.type    = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    m_sampled.binding = 0;
+    m_sampled.slots.resize(BINDLESS_MAX_SAMPLED_IMAGES);
+
+    m_storage.type    = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    m_storage.binding = 1;
+    m_storage.slots.resize(BINDLESS_MAX_STORAGE_IMAGES);
+
+    VkDescriptorBindingFlags binding_flags[] = {
+        VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT,
+        VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT
+    };
+
+    VkDescriptorSetLayoutBindingFlagsCreateInfo binding_flags_info;
+    DW_ZERO_MEMORY(binding_flags_info);
+
+    binding_flags_info.sType         = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+    binding_flags_info.bindingCount  = 2;
+    binding_flags_info.pBindingFlags = &binding_flags[0];
+
+    dw::vk::DescriptorSetLayout::Desc desc;
+
+    desc.set_next_ptr(&binding_flags_info);
+    desc.add_binding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, BINDLESS_MAX_SAMPLED_IMAGES, VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT);
+    desc.add_binding(1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, BINDLESS_MAX_STORAGE_IMAGES, VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_COMPUTE_BIT);
+
+    m_ds_layout = dw::vk::DescriptorSetLayout::create(backend, desc);
+    m_ds_layout->set_name("Bindless DS Layout");
+
+    // The sets are far larger than anything else that is allocated, so they get a pool of their own rather than taking up
+    // the shared one.
+    VkDescriptorPoolSize pool_sizes[] = {
+        { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, BINDLESS_MAX_SAMPLED_IMAGES * dw::vk::Backend::kMaxFramesInFlight },
+        { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, BINDLESS_MAX_STORAGE_IMAGES * dw::vk::Backend::kMaxFramesInFlight }
+    };
+
+    VkDescriptorPoolCreateInfo pool_info;
+    DW_ZERO_MEMORY(pool_info);
+
+    pool_info.sType         = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    pool_info.maxSets       = dw::vk::Backend::kMaxFramesInFlight;
+    pool_info.poolSizeCount = 2;
+    pool_info.pPoolSizes    = &pool_sizes[0];
+
+    if (vkCreateDescriptorPool(backend->device(), &pool_info, nullptr, &m_pool) != VK_SUCCESS)
+        throw std::runtime_error("(Vulkan) Failed to create bindless descriptor pool.");
+
+    VkDescriptorSetLayout layouts[dw::vk::Backend::kMaxFramesInFlight];
+
+    for (int i = 0; i < dw::vk::Backend::kMaxFramesInFlight; i++)
+        layouts[i] = m_ds_layout->handle();
+
+    VkDescriptorSetAllocateInfo alloc_info;
+    DW_ZERO_MEMORY(alloc_info);
+
+    alloc_info.sType              = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    alloc_info.descriptorPool     = m_pool;
+    alloc_info.descriptorSetCount = dw::vk::Backend::kMaxFramesInFlight;
+    alloc_info.pSetLayouts        = &layouts[0];
+
+    if (vkAllocateDescriptorSets(backend->device(), &alloc_info, &m_ds[0]) != VK_SUCCESS)
+        throw std::runtime_error("(Vulkan) Failed to allocate bindless descriptor sets.");
+
+    // Slots are handed out from the front so that the indices in use stay low.
+    for (int32_t i = BINDLESS_MAX_SAMPLED_IMAGES - 1; i >= 0; i--)
+        m_sampled.free_list.push_back(i);
+
+    for (int32_t i = BINDLESS_MAX_STORAGE_IMAGES - 1; i >= 0; i--)
+        m_storage.free_list.push_back(i);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+BindlessHeap::~BindlessHeap()
+{
+    auto backend = m_backend.lock();
+
+    vkDestroyDescriptorPool(backend->device(), m_pool, nullptr);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void BindlessHeap::begin_frame()
+{
+    auto backend = m_backend.lock();
+
+    m_current_frame++;
+    m_frame_idx = backend->current_frame_idx();
+
+    flush(m_sampled);
+    flush(m_storage);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+uint32_t BindlessHeap::register_sampled_image(dw::vk::ImageView::Ptr view, dw::vk::Sampler::Ptr sampler)
+{
+    return allocate(m_sampled, view, sampler);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+uint32_t BindlessHeap::register_storage_image(dw::vk::ImageView::Ptr view)
+{
+    return allocate(m_storage, view, nullptr);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void BindlessHeap::release_sampled_image(uint32_t idx)
+{
+    release(m_sampled, idx);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void BindlessHeap::release_storage_image(uint32_t idx)
+{
+    release(m_storage, idx);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void BindlessHeap::begin_recording()
+{
+    m_recording = true;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void BindlessHeap::end_recording()
+{
+    m_recording = false;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void BindlessHeap::gui()
+{
+    ImGui::Text("Bindless: %u/%u sampled images, %u/%u storage images", m_sampled.num_used, BINDLESS_MAX_SAMPLED_IMAGES, m_storage.num_used, BINDLESS_MAX_STORAGE_IMAGES);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+uint32_t BindlessHeap::allocate(Table& table, dw::vk::ImageView::Ptr view, dw::vk::Sampler::Ptr sampler)
+{
+    assert(!m_recording);
+
+    if (table.free_list.empty())
+        throw std::runtime_error("(Vulkan) Bindless heap is full.");
+
+    const uint32_t idx = table.free_list.back();
+    table.free_list.pop_back();
+    table.num_used++;
+
+    table.slots[idx].view    = view;
+    table.slots[idx].sampler = sampler;
+
+    write(table, idx, m_ds[m_frame_idx]);
+
+    for (int i = 0; i < dw::vk::Backend::kMaxFramesInFlight; i++)
+    {
+        if (i != static_cast<int>(m_frame_idx))
+            table.dirty[i].push_back(idx);
+    }
+
+    return idx;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void BindlessHeap::release(Table& table, uint32_t idx)
+{
+    assert(!m_recording);
+
+    if (idx == BINDLESS_INVALID_INDEX)
+        return;
+
+    // The view is kept alive along with the slot, frames that are still in flight may index it.
+    table.retired.push_back({ idx, m_current_frame });
+    table.num_used--;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void BindlessHeap::write(Table& table, uint32_t idx, VkDescriptorSet ds)
+{
+    auto backend = m_backend.lock();
+
+    VkDescriptorImageInfo image_info;
+
+    image_info.sampler     = table.slots[idx].sampler ? table.slots[idx].sampler->handle() : VK_NULL_HANDLE;
+    image_info.imageView   = table.slots[idx].view->handle();
+    image_info.imageLayout = table.type == VK_DESCRIPTOR_TYPE_STORAGE_IMAGE ? VK_IMAGE_LAYOUT_GENERAL : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+    VkWriteDescriptorSet write_data;
+    DW_ZERO_MEMORY(write_data);
+
+    write_data.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write_data.descriptorCount = 1;
+    write_data.descriptorType  = table.type;
+    write_data.pImageInfo      = &image_info;
+    write_data.dstBinding      = table.binding;
+    write_data.dstArrayElement = idx;
+    write_data.dstSet          = ds;
+
+    vkUpdateDescriptorSets(backend->device(), 1, &write_data, 0, nullptr);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void BindlessHeap::flush(Table& table)
+{
+    // Every frame that could have indexed a retired slot has finished once kMaxFramesInFlight frames have begun since.
+    while (!table.retired.empty() && m_current_frame - table.retired.front().frame >= dw::vk::Backend::kMaxFramesInFlight)
+    {
+        const uint32_t idx = table.retired.front().idx;
+
+        table.slots[idx].view.reset();
+        table.slots[idx].sampler.reset();
+        table.free_list.push_back(idx);
+        table.retired.pop_front();
+    }
+
+    // Slots registered while another frame was being recorded. A slot that has been freed since is left as it is.
+    for (uint32_t idx : table.dirty[m_frame_idx])
+    {
+        if (table.slots[idx].view)
+            write(table, idx, m_ds[m_frame_idx]);
+    }
+
+    table.dirty[m_frame_idx].clear();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
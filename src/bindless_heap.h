@@ -0,0 +1,78 @@
+#pragma once
+
+#include <vk.h>
+#include <deque>
+
+// Must match bindless.glsl.
+#define BINDLESS_MAX_SAMPLED_IMAGES 4096
+#define BINDLESS_MAX_STORAGE_IMAGES 1024
+#define BINDLESS_INVALID_INDEX 0xFFFFFFFF
+
+// A single descriptor set holding an array of every sampled image and an array of every storage image, so that passes select
+// their resources with indices passed through push constants instead of binding sets of their own. Images are registered once
+// when they are created and released when they are retired, after which their slot is only reused once the frames that could
+// still index it have finished. The heap is not update-after-bind, so there is a copy of the set per frame in flight: a
+// registration is written into the copy of the current frame right away, since that frame has not bound it yet, and into the
+// other copies when their frame comes around. Images must be registered and released on the main thread before the frame's jobs
+// are recorded: the write into the current copy is only safe while no command buffer of that frame has bound it yet, and the heap
+// is not locked. begin_recording() and end_recording() bracket the recording so that this is asserted.
+class BindlessHeap
+{
+public:
+    BindlessHeap(dw::vk::Backend::Ptr backend);
+    ~BindlessHeap();
+
+    void     begin_frame();
+    uint32_t register_sampled_image(dw::vk::ImageView::Ptr view, dw::vk::Sampler::Ptr sampler);
+    uint32_t register_storage_image(dw::vk::ImageView::Ptr view);
+    void     release_sampled_image(uint32_t idx);
+    void     release_storage_image(uint32_t idx);
+    void     begin_recording();
+    void     end_recording();
+    void     gui();
+
+    inline dw::vk::DescriptorSetLayout::Ptr ds_layout() { return m_ds_layout; }
+    inline VkDescriptorSet                  ds() { return m_ds[m_frame_idx]; }
+    inline uint32_t                         num_sampled_images() { return m_sampled.num_used; }
+    inline uint32_t                         num_storage_images() { return m_storage.num_used; }
+
+private:
+    struct Slot
+    {
+        dw::vk::ImageView::Ptr view;
+        dw::vk::Sampler::Ptr   sampler;
+    };
+
+    struct RetiredSlot
+    {
+        uint32_t idx;
+        uint64_t frame;
+    };
+
+    struct Table
+    {
+        VkDescriptorType        type;
+        uint32_t                binding;
+        uint32_t                num_used = 0;
+        std::vector<Slot>       slots;
+        std::vector<uint32_t>   free_list;
+        std::deque<RetiredSlot> retired;
+        std::vector<uint32_t>   dirty[dw::vk::Backend::kMaxFramesInFlight];
+    };
+
+    uint32_t allocate(Table& table, dw::vk::ImageView::Ptr view, dw::vk::Sampler::Ptr sampler);
+    void     release(Table& table, uint32_t idx);
+    void     write(Table& table, uint32_t idx, VkDescriptorSet ds);
+    void     flush(Table& table);
+
+private:
+    std::weak_ptr<dw::vk::Backend>   m_backend;
+    dw::vk::DescriptorSetLayout::Ptr m_ds_layout;
+    VkDescriptorPool                 m_pool = VK_NULL_HANDLE;
+    VkDescriptorSet                  m_ds[dw::vk::Backend::kMaxFramesInFlight];
+    uint32_t                         m_frame_idx     = 0;
+    uint64_t                         m_current_frame = 0;
+    Table                            m_sampled;
+    Table                            m_storage;
+    bool                             m_recording = false;
+};
@@ -1,4 +1,7 @@
 #include "blue_noise.h"
+#include "utilities.h"
+#include <macros.h>
+#include <stb_image.h>
 
 // -----------------------------------------------------------------------------------------------------------------------------------
 
@@ -22,12 +25,51 @@ static const char* kSCRAMBLING_RANKING_TEXTURES[] = {
 
 BlueNoise::BlueNoise(dw::vk::Backend::Ptr backend)
 {
-    m_sobol_image      = dw::vk::Image::create_from_file(backend, kSOBOL_TEXTURE);
+    struct DecodedImage
+    {
+        const char* path;
+        int         width;
+        int         height;
+        stbi_uc*    pixels;
+    };
+
+    std::vector<DecodedImage> decoded_images = { { kSOBOL_TEXTURE, 0, 0, nullptr } };
+
+    for (int i = 0; i < 9; i++)
+        decoded_images.push_back({ kSCRAMBLING_RANKING_TEXTURES[i], 0, 0, nullptr });
+
+    // Decoding the PNGs dominates the cost, so it runs on worker threads and only the uploads are left on this one.
+    parallel_for(decoded_images.size(), [&](uint32_t i) {
+        int num_channels = 0;
+        decoded_images[i].pixels = stbi_load(decoded_images[i].path, &decoded_images[i].width, &decoded_images[i].height, &num_channels, 4);
+    });
+
+    for (auto& decoded_image : decoded_images)
+    {
+        if (!decoded_image.pixels)
+        {
+            for (auto& other : decoded_images)
+                stbi_image_free(other.pixels);
+
+            DW_LOG_ERROR("Failed to load texture: " + std::string(decoded_image.path));
+            throw std::runtime_error("Failed to load texture: " + std::string(decoded_image.path));
+        }
+    }
+
+    std::vector<dw::vk::Image::Ptr> images;
+
+    for (auto& decoded_image : decoded_images)
+    {
+        images.push_back(dw::vk::Image::create(backend, VK_IMAGE_TYPE_2D, decoded_image.width, decoded_image.height, 1, 1, 1, VK_FORMAT_R8G8B8A8_UNORM, VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, VK_SAMPLE_COUNT_1_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, decoded_image.width * decoded_image.height * 4, decoded_image.pixels));
+        stbi_image_free(decoded_image.pixels);
+    }
+
+    m_sobol_image      = images[0];
     m_sobol_image_view = dw::vk::ImageView::create(backend, m_sobol_image, VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT);
 
     for (int i = 0; i < 9; i++)
     {
-        m_scrambling_ranking_image[i]      = dw::vk::Image::create_from_file(backend, kSCRAMBLING_RANKING_TEXTURES[i]);
+        m_scrambling_ranking_image[i]      = images[i + 1];
         m_scrambling_ranking_image_view[i] = dw::vk::ImageView::create(backend, m_scrambling_ranking_image[i], VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT);
     }
 }
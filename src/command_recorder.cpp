@@ -0,0 +1,261 @@
+#include "command_recorder.h"
+#include "utilities.h"
+#include <macros.h>
+#include <imgui.h>
+#include <cassert>
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static const uint32_t NUM_QUEUE_TYPES = 2;
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+CommandRecorder::CommandRecorder(std::weak_ptr<dw::vk::Backend> backend, uint32_t num_workers) :
+    m_backend(backend), m_next_job(0)
+{
+    auto vk_backend = m_backend.lock();
+
+    num_workers = std::min(num_workers, uint32_t(COMMAND_RECORDER_MAX_WORKERS));
+
+    const uint32_t queue_family_indices[] = {
+        static_cast<uint32_t>(vk_backend->queue_infos().graphics_queue_index),
+        static_cast<uint32_t>(vk_backend->queue_infos().compute_queue_index)
+    };
+
+    for (int i = 0; i < dw::vk::Backend::kMaxFramesInFlight; i++)
+    {
+        m_pools[i].resize((num_workers + 1) * NUM_QUEUE_TYPES);
+
+        for (uint32_t j = 0; j < m_pools[i].size(); j++)
+            m_pools[i][j].pool = dw::vk::CommandPool::create(vk_backend, queue_family_indices[j % NUM_QUEUE_TYPES]);
+    }
+
+    for (uint32_t i = 0; i < num_workers; i++)
+        m_workers.push_back(std::thread(&CommandRecorder::worker_loop, this, i + 1));
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+CommandRecorder::~CommandRecorder()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_shutdown = true;
+    }
+
+    m_wake_condition.notify_all();
+
+    for (auto& worker : m_workers)
+        worker.join();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void CommandRecorder::begin_frame()
+{
+    auto backend = m_backend.lock();
+
+    m_frame_idx = backend->current_frame_idx();
+
+    m_jobs.clear();
+    m_parallel_jobs.clear();
+
+    m_last_job        = -1;
+    m_next_submission = 0;
+
+    // The fence of this frame index has been waited on, so none of the command buffers allocated from its pools are pending.
+    for (auto& pool : m_pools[m_frame_idx])
+    {
+        if (pool.num_used > 0)
+            vkResetCommandPool(backend->device(), pool.pool->handle(), 0);
+
+        pool.num_used = 0;
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+uint32_t CommandRecorder::add(QueueType queue_type, RecordFunction function, bool main_thread)
+{
+    assert(m_last_job == -1 && "No job can be added after the last one");
+
+    m_jobs.push_back({ queue_type, function, main_thread, nullptr });
+
+    return static_cast<uint32_t>(m_jobs.size() - 1);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+uint32_t CommandRecorder::add_last(QueueType queue_type, RecordFunction function)
+{
+    // Recorded on the calling thread like any other main thread job, what makes it last is only its place in the submission.
+    const uint32_t idx = add(queue_type, function, true);
+
+    m_last_job = static_cast<int32_t>(idx);
+
+    return idx;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void CommandRecorder::record()
+{
+    if (!m_multithreaded || m_workers.empty())
+    {
+        for (auto& job : m_jobs)
+            run_job(job, 0);
+
+        return;
+    }
+
+    m_parallel_jobs.clear();
+
+    for (uint32_t i = 0; i < m_jobs.size(); i++)
+    {
+        if (!m_jobs[i].main_thread)
+            m_parallel_jobs.push_back(i);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        m_next_job     = 0;
+        m_busy_workers = static_cast<uint32_t>(m_workers.size());
+        m_generation++;
+    }
+
+    m_wake_condition.notify_all();
+
+    // Jobs that touch state owned by the main thread, such as the GUI, are recorded while the workers pick up the rest.
+    for (auto& job : m_jobs)
+    {
+        if (job.main_thread)
+            run_job(job, 0);
+    }
+
+    execute_jobs(0);
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done_condition.wait(lock, [this]() { return m_busy_workers == 0; });
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+std::vector<dw::vk::CommandBuffer::Ptr> CommandRecorder::command_buffers(uint32_t first, uint32_t count)
+{
+    // Requesting the command buffers is taken as submitting them, which makes the order in which jobs are added the order in
+    // which the GPU executes them.
+    assert(first >= m_next_submission && "Command buffers have to be requested in the order their jobs were added");
+
+    m_next_submission = first + count;
+
+    std::vector<dw::vk::CommandBuffer::Ptr> cmd_bufs;
+
+    for (uint32_t i = first; i < first + count; i++)
+        cmd_bufs.push_back(m_jobs[i].cmd_buf);
+
+    return cmd_bufs;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Records into a command buffer of the calling thread right away, for commands that depend on what the jobs recorded, such as the
+// other half of a queue family ownership transfer. Only valid once record() has returned, since it uses the pools of thread 0.
+// The command buffer is not part of the job order and is submitted by the caller.
+dw::vk::CommandBuffer::Ptr CommandRecorder::record_now(QueueType queue_type, RecordFunction function)
+{
+    return record_command_buffer(0, queue_type, function);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void CommandRecorder::gui()
+{
+    ImGui::Checkbox("Multithreaded Recording", &m_multithreaded);
+    ImGui::Text("Recording: %u command buffers on %u worker threads", num_jobs(), m_multithreaded ? num_workers() : 0);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void CommandRecorder::worker_loop(uint32_t thread_idx)
+{
+    // The framework profiler is not thread safe, passes recorded here are only covered by the GPU timer.
+    ScopedSample::disable_on_current_thread();
+
+    uint64_t generation = 0;
+
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wake_condition.wait(lock, [this, generation]() { return m_shutdown || m_generation != generation; });
+
+            if (m_shutdown)
+                return;
+
+            generation = m_generation;
+        }
+
+        execute_jobs(thread_idx);
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_busy_workers--;
+        }
+
+        m_done_condition.notify_one();
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void CommandRecorder::execute_jobs(uint32_t thread_idx)
+{
+    uint32_t idx;
+
+    while ((idx = m_next_job++) < m_parallel_jobs.size())
+        run_job(m_jobs[m_parallel_jobs[idx]], thread_idx);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void CommandRecorder::run_job(Job& job, uint32_t thread_idx)
+{
+    job.cmd_buf = record_command_buffer(thread_idx, job.queue_type, job.function);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+dw::vk::CommandBuffer::Ptr CommandRecorder::record_command_buffer(uint32_t thread_idx, QueueType queue_type, RecordFunction& function)
+{
+    dw::vk::CommandBuffer::Ptr cmd_buf = allocate(thread_idx, queue_type);
+
+    VkCommandBufferBeginInfo begin_info;
+    DW_ZERO_MEMORY(begin_info);
+
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    vkBeginCommandBuffer(cmd_buf->handle(), &begin_info);
+
+    function(cmd_buf);
+
+    vkEndCommandBuffer(cmd_buf->handle());
+
+    return cmd_buf;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+dw::vk::CommandBuffer::Ptr CommandRecorder::allocate(uint32_t thread_idx, QueueType queue_type)
+{
+    ThreadPool& pool = m_pools[m_frame_idx][thread_idx * NUM_QUEUE_TYPES + queue_type];
+
+    // Command buffers are kept across frames and recycled along with their pool.
+    if (pool.num_used == pool.cmd_bufs.size())
+        pool.cmd_bufs.push_back(dw::vk::CommandBuffer::create(m_backend.lock(), pool.pool));
+
+    return pool.cmd_bufs[pool.num_used++];
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "common.h"
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#define COMMAND_RECORDER_MAX_WORKERS 4
+
+// Records the passes of a frame into one primary command buffer each, spread over a fixed set of worker threads. Every thread
+// owns a command pool per queue and frame in flight, so threads never share a pool and a pool is only reset once the GPU is
+// done with the frame that last used it. The command buffers are returned in the order their jobs were added, which is the
+// order they have to be submitted in: barriers recorded by a job only synchronize with the work submitted before it. A job that
+// has to come after all others on the GPU, such as one that reads back what the frame accumulated, is added with add_last.
+class CommandRecorder
+{
+public:
+    using RecordFunction = std::function<void(dw::vk::CommandBuffer::Ptr)>;
+
+public:
+    CommandRecorder(std::weak_ptr<dw::vk::Backend> backend, uint32_t num_workers);
+    ~CommandRecorder();
+
+    void                                    begin_frame();
+    uint32_t                                add(QueueType queue_type, RecordFunction function, bool main_thread = false);
+    uint32_t                                add_last(QueueType queue_type, RecordFunction function);
+    void                                    record();
+    std::vector<dw::vk::CommandBuffer::Ptr> command_buffers(uint32_t first, uint32_t count);
+    dw::vk::CommandBuffer::Ptr              record_now(QueueType queue_type, RecordFunction function);
+    void                                    gui();
+
+    inline uint32_t num_jobs() { return static_cast<uint32_t>(m_jobs.size()); }
+    inline uint32_t num_workers() { return static_cast<uint32_t>(m_workers.size()); }
+    inline bool     multithreaded() { return m_multithreaded; }
+    inline void     set_multithreaded(bool value) { m_multithreaded = value; }
+
+private:
+    struct Job
+    {
+        QueueType                  queue_type;
+        RecordFunction             function;
+        bool                       main_thread;
+        dw::vk::CommandBuffer::Ptr cmd_buf;
+    };
+
+    struct ThreadPool
+    {
+        dw::vk::CommandPool::Ptr                pool;
+        std::vector<dw::vk::CommandBuffer::Ptr> cmd_bufs;
+        uint32_t                                num_used = 0;
+    };
+
+    void                       worker_loop(uint32_t thread_idx);
+    void                       execute_jobs(uint32_t thread_idx);
+    void                       run_job(Job& job, uint32_t thread_idx);
+    dw::vk::CommandBuffer::Ptr record_command_buffer(uint32_t thread_idx, QueueType queue_type, RecordFunction& function);
+    dw::vk::CommandBuffer::Ptr allocate(uint32_t thread_idx, QueueType queue_type);
+
+private:
+    std::weak_ptr<dw::vk::Backend> m_backend;
+    bool                           m_multithreaded = true;
+    uint32_t                       m_frame_idx     = 0;
+    std::vector<Job>               m_jobs;
+    std::vector<uint32_t>          m_parallel_jobs;
+    int32_t                        m_last_job        = -1;
+    uint32_t                       m_next_submission = 0;
+    std::atomic<uint32_t>          m_next_job;
+    std::vector<std::thread>       m_workers;
+    std::mutex                     m_mutex;
+    std::condition_variable        m_wake_condition;
+    std::condition_variable        m_done_condition;
+    uint64_t                       m_generation   = 0;
+    uint32_t                       m_busy_workers = 0;
+    bool                           m_shutdown     = false;
+
+    // Indexed by [frame in flight][thread][queue], the calling thread is always thread 0.
+    std::vector<ThreadPool> m_pools[dw::vk::Backend::kMaxFramesInFlight];
+};
@@ -1,6 +1,10 @@
 #include "common.h"
+#include "render_graph.h"
 #include <logger.h>
+#include <imgui.h>
+#include <algorithm>
 #include <stdexcept>
+#include <sys/stat.h>
 #include <gtc/matrix_transform.hpp>
 #include <equirectangular_to_cubemap.h>
 
@@ -13,8 +17,13 @@ const std::vector<std::string>            environment_types             = { "Non
 const std::vector<std::string>            visualization_types           = { "Final", "Shadows", "Ambient Occlusion", "Reflections", "Global Illumination", "Ground Truth" };
 const std::vector<std::string>            scene_types                   = { "Shadows Test", "Reflections Test", "Global Illumination Test", "Pica Pica", "Sponza" };
 const std::vector<std::string>            ray_trace_scales              = { "Full-Res", "Half-Res", "Quarter-Res" };
+const std::vector<std::string>            render_scales                 = { "Native", "Quality", "Balanced", "Performance" };
+const std::vector<std::string>            render_target_precisions      = { "Full", "Low Memory" };
+const std::vector<float>                  render_scale_factors          = { 1.0f, 0.77f, 0.67f, 0.5f };
 const std::vector<std::string>            light_types                   = { "Directional", "Point", "Spot" };
 const std::vector<std::string>            camera_types                  = { "Free", "Animated", "Fixed" };
+const std::vector<std::string>            queue_types                   = { "Graphics", "Async Compute" };
+const std::vector<std::string>            ray_trace_backends            = { "Ray Tracing Pipeline", "Ray Query" };
 const std::vector<std::vector<glm::vec3>> fixed_camera_position_vectors = {
     { glm::vec3(-22.061460f, 16.624475f, 23.893597f),
       glm::vec3(-0.337131f, 15.421529f, 39.524925f),
@@ -299,10 +308,104 @@ const std::vector<float> animated_camera_speeds = {
 
 // -----------------------------------------------------------------------------------------------------------------------------------
 
-CommonResources::CommonResources(dw::vk::Backend::Ptr backend)
+static thread_local bool g_samples_disabled = false;
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+ScopedSample::ScopedSample(const std::string& name, dw::vk::CommandBuffer::Ptr cmd_buf) :
+    m_name(name), m_cmd_buf(cmd_buf), m_enabled(!g_samples_disabled)
+{
+    if (m_enabled)
+        dw::profiler::begin_sample(m_name, m_cmd_buf);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+ScopedSample::~ScopedSample()
+{
+    if (m_enabled)
+        dw::profiler::end_sample(m_name, m_cmd_buf);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void ScopedSample::disable_on_current_thread()
+{
+    g_samples_disabled = true;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+RayTraceBackendTimings::RayTraceBackendTimings(const std::string& timer_name) :
+    m_timer_name(timer_name)
+{
+    for (uint32_t i = 0; i < kNumFrames; i++)
+    {
+        m_frames[i]   = -1;
+        m_backends[i] = RAY_TRACE_BACKEND_PIPELINE;
+    }
+
+    for (int i = 0; i < RAY_TRACE_BACKEND_COUNT; i++)
+        m_milliseconds[i] = -1.0f;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void RayTraceBackendTimings::update(GPUTimer* timer, RayTraceBackend backend, int32_t frame)
 {
+    // The results were read back when this frame began, one slot more than there are frames in flight keeps the frame they
+    // belong to from being overwritten before then.
+    const int32_t results_frame = timer->results_frame();
+
+    if (results_frame >= 0 && m_frames[results_frame % kNumFrames] == results_frame)
+    {
+        for (const auto& result : timer->results())
+        {
+            if (result.name == m_timer_name)
+            {
+                m_milliseconds[m_backends[results_frame % kNumFrames]] = result.milliseconds;
+                break;
+            }
+        }
+    }
+
+    m_frames[frame % kNumFrames]   = timer->enabled() ? frame : -1;
+    m_backends[frame % kNumFrames] = backend;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void RayTraceBackendTimings::gui()
+{
+    for (int i = 0; i < RAY_TRACE_BACKEND_COUNT; i++)
+    {
+        if (m_milliseconds[i] < 0.0f)
+            ImGui::Text("%s: -", constants::ray_trace_backends[i].c_str());
+        else
+            ImGui::Text("%s: %.3f ms", constants::ray_trace_backends[i].c_str(), m_milliseconds[i]);
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+CommonResources::CommonResources(dw::vk::Backend::Ptr backend, SceneType initial_scene_type, RenderScale initial_render_scale)
+{
+    // Fixed for the lifetime of the effects, every render target below the swap chain is sized from it.
+    render_scale  = initial_render_scale;
+    render_width  = std::max(1u, static_cast<uint32_t>(float(backend->swap_chain_extents().width) * constants::render_scale_factors[render_scale] + 0.5f));
+    render_height = std::max(1u, static_cast<uint32_t>(float(backend->swap_chain_extents().height) * constants::render_scale_factors[render_scale] + 0.5f));
+
+    pipeline_cache = std::unique_ptr<PipelineCache>(new PipelineCache(backend));
+    bindless_heap  = std::unique_ptr<BindlessHeap>(new BindlessHeap(backend));
+
     create_uniform_buffer(backend);
-    load_mesh(backend);
+
+    scenes.resize(SCENE_TYPE_COUNT);
+    tlas_dirty.resize(SCENE_TYPE_COUNT, true);
+
+    // Only the scene that is shown first is loaded up front, the others are loaded the first time they are selected.
+    current_scene_type = initial_scene_type;
+    load_scene(backend, current_scene_type);
 
     brdf_preintegrate_lut = std::unique_ptr<dw::BRDFIntegrateLUT>(new dw::BRDFIntegrateLUT(backend));
     blue_noise            = std::unique_ptr<BlueNoise>(new BlueNoise(backend));
@@ -312,6 +415,17 @@ CommonResources::CommonResources(dw::vk::Backend::Ptr backend)
     create_descriptor_sets(backend);
     write_descriptor_sets(backend);
 
+    blue_noise_sobol_idx = bindless_heap->register_sampled_image(blue_noise->m_sobol_image_view, backend->nearest_sampler());
+
+    for (int i = 0; i < 9; i++)
+        blue_noise_scrambling_ranking_idx[i] = bindless_heap->register_sampled_image(blue_noise->m_scrambling_ranking_image_view[i], backend->nearest_sampler());
+
+    transient_image_pool = std::unique_ptr<TransientImagePool>(new TransientImagePool(backend, this));
+    gpu_timer            = std::unique_ptr<GPUTimer>(new GPUTimer(backend));
+    gpu_counters         = std::unique_ptr<GPUCounters>(new GPUCounters(backend));
+    memory_tracker       = std::unique_ptr<MemoryTracker>(new MemoryTracker(backend));
+    deletion_queue       = std::unique_ptr<DeletionQueue>(new DeletionQueue());
+
     demo_players.resize(SCENE_TYPE_COUNT);
 
     for (int i = 0; i < SCENE_TYPE_COUNT; i++)
@@ -337,48 +451,18 @@ void CommonResources::create_uniform_buffer(dw::vk::Backend::Ptr backend)
 
 // -----------------------------------------------------------------------------------------------------------------------------------
 
-void CommonResources::load_mesh(dw::vk::Backend::Ptr backend)
+void CommonResources::load_scene(dw::vk::Backend::Ptr backend, SceneType scene_type)
 {
-    scenes.reserve(SCENE_TYPE_COUNT);
+    if (is_scene_loaded(scene_type))
+        return;
 
-    {
-        std::vector<dw::RayTracedScene::Instance> instances;
-
-        dw::Mesh::Ptr pillar = dw::Mesh::load(backend, "meshes/pillar.gltf");
-
-        if (!pillar)
-        {
-            DW_LOG_ERROR("Failed to load mesh");
-            throw std::runtime_error("Failed to load mesh");
-        }
+    std::vector<dw::RayTracedScene::Instance> instances;
 
-        pillar->initialize_for_ray_tracing(backend);
-
-        meshes.push_back(pillar);
-
-        dw::Mesh::Ptr bunny = dw::Mesh::load(backend, "meshes/bunny.gltf");
-
-        if (!bunny)
-        {
-            DW_LOG_ERROR("Failed to load mesh");
-            throw std::runtime_error("Failed to load mesh");
-        }
-
-        bunny->initialize_for_ray_tracing(backend);
-
-        meshes.push_back(bunny);
-
-        dw::Mesh::Ptr ground = dw::Mesh::load(backend, "meshes/ground.gltf");
-
-        if (!ground)
-        {
-            DW_LOG_ERROR("Failed to load mesh");
-            throw std::runtime_error("Failed to load mesh");
-        }
-
-        ground->initialize_for_ray_tracing(backend);
-
-        meshes.push_back(ground);
+    if (scene_type == SCENE_TYPE_SHADOWS_TEST)
+    {
+        dw::Mesh::Ptr pillar = load_mesh(backend, "meshes/pillar.gltf");
+        dw::Mesh::Ptr bunny  = load_mesh(backend, "meshes/bunny.gltf");
+        dw::Mesh::Ptr ground = load_mesh(backend, "meshes/ground.gltf");
 
         float segment_length = (ground->max_extents().z - ground->min_extents().z) / (NUM_PILLARS + 1);
 
@@ -428,109 +512,95 @@ void CommonResources::load_mesh(dw::vk::Backend::Ptr backend)
         bunny_instance.transform = T * R * S;
 
         instances.push_back(bunny_instance);
-
-        scenes.push_back(dw::RayTracedScene::create(backend, instances));
     }
-
+    else if (scene_type == SCENE_TYPE_REFLECTIONS_TEST)
     {
-        std::vector<dw::RayTracedScene::Instance> instances;
-
-        dw::Mesh::Ptr reflections_test = dw::Mesh::load(backend, "meshes/reflections_test.gltf");
-
-        if (!reflections_test)
-        {
-            DW_LOG_ERROR("Failed to load mesh");
-            throw std::runtime_error("Failed to load mesh");
-        }
-
-        reflections_test->initialize_for_ray_tracing(backend);
-
-        meshes.push_back(reflections_test);
-
         dw::RayTracedScene::Instance reflections_test_instance;
 
-        reflections_test_instance.mesh      = reflections_test;
+        reflections_test_instance.mesh      = load_mesh(backend, "meshes/reflections_test.gltf");
         reflections_test_instance.transform = glm::mat4(1.0f);
 
         instances.push_back(reflections_test_instance);
-
-        scenes.push_back(dw::RayTracedScene::create(backend, instances));
     }
-
+    else if (scene_type == SCENE_TYPE_GLOBAL_ILLUMINATION_TEST)
     {
-        std::vector<dw::RayTracedScene::Instance> instances;
-
-        dw::Mesh::Ptr gi_test = dw::Mesh::load(backend, "meshes/global_illumination_test.gltf");
-
-        if (!gi_test)
-        {
-            DW_LOG_ERROR("Failed to load mesh");
-            throw std::runtime_error("Failed to load mesh");
-        }
-
-        gi_test->initialize_for_ray_tracing(backend);
-
-        meshes.push_back(gi_test);
-
         dw::RayTracedScene::Instance gi_test_instance;
 
-        gi_test_instance.mesh      = gi_test;
+        gi_test_instance.mesh      = load_mesh(backend, "meshes/global_illumination_test.gltf");
         gi_test_instance.transform = glm::mat4(1.0f);
 
         instances.push_back(gi_test_instance);
-
-        scenes.push_back(dw::RayTracedScene::create(backend, instances));
     }
+    else if (scene_type == SCENE_TYPE_PICA_PICA)
+    {
+        dw::RayTracedScene::Instance pica_pica_instance;
 
+        pica_pica_instance.mesh      = load_mesh(backend, "meshes/scene.gltf");
+        pica_pica_instance.transform = glm::scale(glm::mat4(1.0f), glm::vec3(1.0f));
+
+        instances.push_back(pica_pica_instance);
+    }
+    else if (scene_type == SCENE_TYPE_SPONZA)
     {
-        std::vector<dw::RayTracedScene::Instance> instances;
+        dw::RayTracedScene::Instance sponza_instance;
 
-        dw::Mesh::Ptr pica_pica = dw::Mesh::load(backend, "meshes/scene.gltf");
+        sponza_instance.mesh      = load_mesh(backend, "meshes/sponza.obj");
+        sponza_instance.transform = glm::scale(glm::mat4(1.0f), glm::vec3(0.3f));
 
-        if (!pica_pica)
-        {
-            DW_LOG_ERROR("Failed to load mesh");
-            throw std::runtime_error("Failed to load mesh");
-        }
+        instances.push_back(sponza_instance);
+    }
 
-        pica_pica->initialize_for_ray_tracing(backend);
+    scenes[scene_type]     = dw::RayTracedScene::create(backend, instances);
+    tlas_dirty[scene_type] = true;
+}
 
-        meshes.push_back(pica_pica);
+// -----------------------------------------------------------------------------------------------------------------------------------
 
-        dw::RayTracedScene::Instance pica_pica_instance;
+static bool last_write_time(const std::string& path, time_t& time)
+{
+    struct stat info;
 
-        pica_pica_instance.mesh      = pica_pica;
-        pica_pica_instance.transform = glm::scale(glm::mat4(1.0f), glm::vec3(1.0f));
+    if (stat(path.c_str(), &info) != 0)
+        return false;
 
-        instances.push_back(pica_pica_instance);
+    time = info.st_mtime;
 
-        scenes.push_back(dw::RayTracedScene::create(backend, instances));
-    }
+    return true;
+}
 
-    {
-        std::vector<dw::RayTracedScene::Instance> instances;
+// -----------------------------------------------------------------------------------------------------------------------------------
 
-        dw::Mesh::Ptr sponza = dw::Mesh::load(backend, "meshes/sponza.obj");
+dw::Mesh::Ptr CommonResources::load_mesh(dw::vk::Backend::Ptr backend, const std::string& path)
+{
+    // The copy written by the HybridRendering_Scenes target holds the same scene without the cost of parsing the source format.
+    // It is only used while it is at least as new as the source, an edited mesh is loaded as is until the target is rebuilt.
+    std::string cooked_path = path.substr(0, path.find_last_of('.')) + ".assbin";
+    std::string load_path   = path;
 
-        if (!sponza)
-        {
-            DW_LOG_ERROR("Failed to load mesh");
-            throw std::runtime_error("Failed to load mesh");
-        }
+    time_t cooked_time = 0;
+    time_t source_time = 0;
 
-        sponza->initialize_for_ray_tracing(backend);
+    if (last_write_time(cooked_path, cooked_time))
+    {
+        if (!last_write_time(path, source_time) || cooked_time >= source_time)
+            load_path = cooked_path;
+        else
+            DW_LOG_INFO("Cooked mesh is older than its source, loading " + path + " instead.");
+    }
 
-        meshes.push_back(sponza);
+    dw::Mesh::Ptr mesh = dw::Mesh::load(backend, load_path);
 
-        dw::RayTracedScene::Instance sponza_instance;
+    if (!mesh)
+    {
+        DW_LOG_ERROR("Failed to load mesh: " + path);
+        throw std::runtime_error("Failed to load mesh: " + path);
+    }
 
-        sponza_instance.mesh      = sponza;
-        sponza_instance.transform = glm::scale(glm::mat4(1.0f), glm::vec3(0.3f));
+    mesh->initialize_for_ray_tracing(backend);
 
-        instances.push_back(sponza_instance);
+    meshes.push_back(mesh);
 
-        scenes.push_back(dw::RayTracedScene::create(backend, instances));
-    }
+    return mesh;
 }
 
 // -----------------------------------------------------------------------------------------------------------------------------------
@@ -539,10 +609,14 @@ void CommonResources::create_environment_resources(dw::vk::Backend::Ptr backend)
 {
     // Create procedural sky
     {
-        sky_environment                         = std::unique_ptr<SkyEnvironment>(new SkyEnvironment());
-        sky_environment->hosek_wilkie_sky_model = std::unique_ptr<dw::HosekWilkieSkyModel>(new dw::HosekWilkieSkyModel(backend));
-        sky_environment->cubemap_sh_projection  = std::unique_ptr<dw::CubemapSHProjection>(new dw::CubemapSHProjection(backend, sky_environment->hosek_wilkie_sky_model->image()));
-        sky_environment->cubemap_prefilter      = std::unique_ptr<dw::CubemapPrefiler>(new dw::CubemapPrefiler(backend, sky_environment->hosek_wilkie_sky_model->image()));
+        sky_environment = std::unique_ptr<SkyEnvironment>(new SkyEnvironment());
+
+        for (int i = 0; i < 2; i++)
+        {
+            sky_environment->hosek_wilkie_sky_model[i] = std::unique_ptr<dw::HosekWilkieSkyModel>(new dw::HosekWilkieSkyModel(backend));
+            sky_environment->cubemap_sh_projection[i]  = std::unique_ptr<dw::CubemapSHProjection>(new dw::CubemapSHProjection(backend, sky_environment->hosek_wilkie_sky_model[i]->image()));
+            sky_environment->cubemap_prefilter[i]      = std::unique_ptr<dw::CubemapPrefiler>(new dw::CubemapPrefiler(backend, sky_environment->hosek_wilkie_sky_model[i]->image()));
+        }
     }
 
     // Create blank SH image
@@ -651,10 +725,10 @@ void CommonResources::create_descriptor_set_layouts(dw::vk::Backend::Ptr backend
     {
         dw::vk::DescriptorSetLayout::Desc desc;
 
-        desc.add_binding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_MISS_BIT_KHR);
-        desc.add_binding(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_MISS_BIT_KHR);
-        desc.add_binding(2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_MISS_BIT_KHR);
-        desc.add_binding(3, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_MISS_BIT_KHR);
+        desc.add_binding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_MISS_BIT_KHR);
+        desc.add_binding(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_MISS_BIT_KHR);
+        desc.add_binding(2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_MISS_BIT_KHR);
+        desc.add_binding(3, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_MISS_BIT_KHR);
 
         skybox_ds_layout = dw::vk::DescriptorSetLayout::create(backend, desc);
         skybox_ds_layout->set_name("Skybox DS Layout");
@@ -684,9 +758,24 @@ void CommonResources::create_descriptor_set_layouts(dw::vk::Backend::Ptr backend
         desc.add_binding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_FRAGMENT_BIT);
         desc.add_binding(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_FRAGMENT_BIT);
         desc.add_binding(2, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1, VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT);
+        desc.add_binding(3, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT);
 
         ddgi_read_ds_layout = dw::vk::DescriptorSetLayout::create(backend, desc);
     }
+
+    // Local lights, see ManyLights. The reservoirs are only read by deferred shading.
+    {
+        dw::vk::DescriptorSetLayout::Desc desc;
+
+        desc.add_binding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1, VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_FRAGMENT_BIT);
+        desc.add_binding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1, VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_FRAGMENT_BIT);
+        desc.add_binding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_FRAGMENT_BIT);
+        desc.add_binding(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_FRAGMENT_BIT);
+        desc.add_binding(4, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT);
+
+        lights_ds_layout = dw::vk::DescriptorSetLayout::create(backend, desc);
+        lights_ds_layout->set_name("Lights DS Layout");
+    }
 }
 
 // -----------------------------------------------------------------------------------------------------------------------------------
@@ -703,7 +792,15 @@ void CommonResources::create_descriptor_sets(dw::vk::Backend::Ptr backend)
     skybox_ds.resize(num_environment_map_images);
 
     for (int i = 0; i < num_environment_map_images; i++)
-        skybox_ds[i] = backend->allocate_descriptor_set(skybox_ds_layout);
+    {
+        if (i != ENVIRONMENT_TYPE_PROCEDURAL_SKY)
+            skybox_ds[i] = backend->allocate_descriptor_set(skybox_ds_layout);
+    }
+
+    for (int i = 0; i < 2; i++)
+        sky_environment->ds[i] = backend->allocate_descriptor_set(skybox_ds_layout);
+
+    skybox_ds[ENVIRONMENT_TYPE_PROCEDURAL_SKY] = sky_environment->ds[sky_environment->front];
 }
 
 // -----------------------------------------------------------------------------------------------------------------------------------
@@ -742,74 +839,82 @@ void CommonResources::write_descriptor_sets(dw::vk::Backend::Ptr backend)
 
     for (int i = 0; i < num_environment_map_images; i++)
     {
-        VkDescriptorImageInfo image_info[4];
+        // Both buffers of the procedural sky are written up front, swapping them is then only a matter of binding the other set.
+        const int num_sets = i == ENVIRONMENT_TYPE_PROCEDURAL_SKY ? 2 : 1;
 
-        image_info[0].sampler = backend->bilinear_sampler()->handle();
-        if (i == ENVIRONMENT_TYPE_NONE)
-            image_info[0].imageView = blank_cubemap_image_view->handle();
-        else if (i == ENVIRONMENT_TYPE_PROCEDURAL_SKY)
-            image_info[0].imageView = sky_environment->hosek_wilkie_sky_model->image_view()->handle();
-        else
-            image_info[0].imageView = hdr_environments[i - 2]->image_view->handle();
-        image_info[0].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-
-        image_info[1].sampler = backend->trilinear_sampler()->handle();
-        if (i == ENVIRONMENT_TYPE_NONE)
-            image_info[1].imageView = blank_sh_image_view->handle();
-        else if (i == ENVIRONMENT_TYPE_PROCEDURAL_SKY)
-            image_info[1].imageView = sky_environment->cubemap_sh_projection->image_view()->handle();
-        else
-            image_info[1].imageView = hdr_environments[i - 2]->cubemap_sh_projection->image_view()->handle();
-        image_info[1].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-
-        image_info[2].sampler = backend->trilinear_sampler()->handle();
-        if (i == ENVIRONMENT_TYPE_NONE)
-            image_info[2].imageView = blank_cubemap_image_view->handle();
-        else if (i == ENVIRONMENT_TYPE_PROCEDURAL_SKY)
-            image_info[2].imageView = sky_environment->cubemap_prefilter->image_view()->handle();
-        else
-            image_info[2].imageView = hdr_environments[i - 2]->cubemap_prefilter->image_view()->handle();
-        image_info[2].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-
-        image_info[3].sampler     = backend->bilinear_sampler()->handle();
-        image_info[3].imageView   = brdf_preintegrate_lut->image_view()->handle();
-        image_info[3].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-
-        VkWriteDescriptorSet write_data[4];
-        DW_ZERO_MEMORY(write_data[0]);
-        DW_ZERO_MEMORY(write_data[1]);
-        DW_ZERO_MEMORY(write_data[2]);
-        DW_ZERO_MEMORY(write_data[3]);
-
-        write_data[0].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        write_data[0].descriptorCount = 1;
-        write_data[0].descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        write_data[0].pImageInfo      = &image_info[0];
-        write_data[0].dstBinding      = 0;
-        write_data[0].dstSet          = skybox_ds[i]->handle();
-
-        write_data[1].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        write_data[1].descriptorCount = 1;
-        write_data[1].descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        write_data[1].pImageInfo      = &image_info[1];
-        write_data[1].dstBinding      = 1;
-        write_data[1].dstSet          = skybox_ds[i]->handle();
-
-        write_data[2].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        write_data[2].descriptorCount = 1;
-        write_data[2].descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        write_data[2].pImageInfo      = &image_info[2];
-        write_data[2].dstBinding      = 2;
-        write_data[2].dstSet          = skybox_ds[i]->handle();
-
-        write_data[3].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        write_data[3].descriptorCount = 1;
-        write_data[3].descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        write_data[3].pImageInfo      = &image_info[3];
-        write_data[3].dstBinding      = 3;
-        write_data[3].dstSet          = skybox_ds[i]->handle();
-
-        vkUpdateDescriptorSets(backend->device(), 4, &write_data[0], 0, nullptr);
+        for (int j = 0; j < num_sets; j++)
+        {
+            VkDescriptorSet ds = i == ENVIRONMENT_TYPE_PROCEDURAL_SKY ? sky_environment->ds[j]->handle() : skybox_ds[i]->handle();
+
+            VkDescriptorImageInfo image_info[4];
+
+            image_info[0].sampler = backend->bilinear_sampler()->handle();
+            if (i == ENVIRONMENT_TYPE_NONE)
+                image_info[0].imageView = blank_cubemap_image_view->handle();
+            else if (i == ENVIRONMENT_TYPE_PROCEDURAL_SKY)
+                image_info[0].imageView = sky_environment->hosek_wilkie_sky_model[j]->image_view()->handle();
+            else
+                image_info[0].imageView = hdr_environments[i - 2]->image_view->handle();
+            image_info[0].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+            image_info[1].sampler = backend->trilinear_sampler()->handle();
+            if (i == ENVIRONMENT_TYPE_NONE)
+                image_info[1].imageView = blank_sh_image_view->handle();
+            else if (i == ENVIRONMENT_TYPE_PROCEDURAL_SKY)
+                image_info[1].imageView = sky_environment->cubemap_sh_projection[j]->image_view()->handle();
+            else
+                image_info[1].imageView = hdr_environments[i - 2]->cubemap_sh_projection->image_view()->handle();
+            image_info[1].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+            image_info[2].sampler = backend->trilinear_sampler()->handle();
+            if (i == ENVIRONMENT_TYPE_NONE)
+                image_info[2].imageView = blank_cubemap_image_view->handle();
+            else if (i == ENVIRONMENT_TYPE_PROCEDURAL_SKY)
+                image_info[2].imageView = sky_environment->cubemap_prefilter[j]->image_view()->handle();
+            else
+                image_info[2].imageView = hdr_environments[i - 2]->cubemap_prefilter->image_view()->handle();
+            image_info[2].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+            image_info[3].sampler     = backend->bilinear_sampler()->handle();
+            image_info[3].imageView   = brdf_preintegrate_lut->image_view()->handle();
+            image_info[3].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+            VkWriteDescriptorSet write_data[4];
+            DW_ZERO_MEMORY(write_data[0]);
+            DW_ZERO_MEMORY(write_data[1]);
+            DW_ZERO_MEMORY(write_data[2]);
+            DW_ZERO_MEMORY(write_data[3]);
+
+            write_data[0].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            write_data[0].descriptorCount = 1;
+            write_data[0].descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            write_data[0].pImageInfo      = &image_info[0];
+            write_data[0].dstBinding      = 0;
+            write_data[0].dstSet          = ds;
+
+            write_data[1].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            write_data[1].descriptorCount = 1;
+            write_data[1].descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            write_data[1].pImageInfo      = &image_info[1];
+            write_data[1].dstBinding      = 1;
+            write_data[1].dstSet          = ds;
+
+            write_data[2].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            write_data[2].descriptorCount = 1;
+            write_data[2].descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            write_data[2].pImageInfo      = &image_info[2];
+            write_data[2].dstBinding      = 2;
+            write_data[2].dstSet          = ds;
+
+            write_data[3].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            write_data[3].descriptorCount = 1;
+            write_data[3].descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            write_data[3].pImageInfo      = &image_info[3];
+            write_data[3].dstBinding      = 3;
+            write_data[3].dstSet          = ds;
+
+            vkUpdateDescriptorSets(backend->device(), 4, &write_data[0], 0, nullptr);
+        }
     }
 
     current_skybox_ds = skybox_ds[current_environment_type];
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <macros.h>
+#include <profiler.h>
 #include <material.h>
 #include <mesh.h>
 #include <vk.h>
@@ -13,6 +14,12 @@
 #include <cubemap_prefilter.h>
 #include <stdexcept>
 #include "blue_noise.h"
+#include "gpu_timer.h"
+#include "gpu_counters.h"
+#include "deletion_queue.h"
+#include "pipeline_cache.h"
+#include "bindless_heap.h"
+#include "memory_tracker.h"
 
 #define EPSILON 0.0001f
 #define NUM_PILLARS 6
@@ -21,6 +28,26 @@
 #define CAMERA_SPEED_MULTIPLIER 0.1f
 
 class SVGFDenoiser;
+class TransientImagePool;
+
+// The framework profiler keeps a single stack of samples, so samples are only taken on threads that have not opted out. The
+// workers of the CommandRecorder opt out, the passes they record are still covered by the GPU timer.
+#undef DW_SCOPED_SAMPLE
+#define DW_SCOPED_SAMPLE(name, cmd_buf) ScopedSample GPU_TIMER_CONCAT(scoped_sample_, __LINE__)(name, cmd_buf)
+
+class ScopedSample
+{
+public:
+    ScopedSample(const std::string& name, dw::vk::CommandBuffer::Ptr cmd_buf);
+    ~ScopedSample();
+
+    static void disable_on_current_thread();
+
+private:
+    std::string                m_name;
+    dw::vk::CommandBuffer::Ptr m_cmd_buf;
+    bool                       m_enabled;
+};
 
 namespace constants
 {
@@ -29,8 +56,13 @@ extern const std::vector<std::string>            environment_types;
 extern const std::vector<std::string>            visualization_types;
 extern const std::vector<std::string>            scene_types;
 extern const std::vector<std::string>            ray_trace_scales;
+extern const std::vector<std::string>            render_scales;
+extern const std::vector<std::string>            render_target_precisions;
+extern const std::vector<float>                  render_scale_factors;
 extern const std::vector<std::string>            light_types;
 extern const std::vector<std::string>            camera_types;
+extern const std::vector<std::string>            queue_types;
+extern const std::vector<std::string>            ray_trace_backends;
 extern const std::vector<std::vector<glm::vec3>> fixed_camera_position_vectors;
 extern const std::vector<std::vector<glm::vec3>> fixed_camera_forward_vectors;
 extern const std::vector<std::vector<glm::vec3>> fixed_camera_right_vectors;
@@ -43,6 +75,24 @@ enum RayTraceScale
     RAY_TRACE_SCALE_QUARTER_RES
 };
 
+// Storage formats of the render targets of an effect. The low memory tier packs the signals whose range and precision allow it,
+// falling back to the full formats on devices that cannot use the packed ones as storage images.
+enum RenderTargetPrecision
+{
+    RENDER_TARGET_PRECISION_FULL,
+    RENDER_TARGET_PRECISION_LOW_MEMORY
+};
+
+// Fraction of the swap chain resolution that the G-Buffer, deferred shading and ray traced effects render at. Anything below
+// native is upscaled back to the swap chain resolution by TemporalAA.
+enum RenderScale
+{
+    RENDER_SCALE_NATIVE,
+    RENDER_SCALE_QUALITY,
+    RENDER_SCALE_BALANCED,
+    RENDER_SCALE_PERFORMANCE
+};
+
 enum EnvironmentType
 {
     ENVIRONMENT_TYPE_NONE,
@@ -78,6 +128,21 @@ enum CameraType
     CAMERA_TYPE_FIXED
 };
 
+enum QueueType
+{
+    QUEUE_TYPE_GRAPHICS,
+    QUEUE_TYPE_ASYNC_COMPUTE
+};
+
+// How the reflections and the DDGI probes trace their rays. The ray query backend traces inline from compute shaders and shades
+// the hits once traversal is done, which also lets these passes run on the async compute queue.
+enum RayTraceBackend
+{
+    RAY_TRACE_BACKEND_PIPELINE,
+    RAY_TRACE_BACKEND_RAY_QUERY,
+    RAY_TRACE_BACKEND_COUNT
+};
+
 enum VisualizationType
 {
     VISUALIZATION_TYPE_FINAL,
@@ -88,11 +153,27 @@ enum VisualizationType
     VISUALIZATION_TYPE_GROUND_TRUTH
 };
 
+enum SkyUpdateStage
+{
+    SKY_UPDATE_STAGE_IDLE,
+    SKY_UPDATE_STAGE_SKY_MODEL,
+    SKY_UPDATE_STAGE_SH_PROJECTION,
+    SKY_UPDATE_STAGE_PREFILTER
+};
+
+// The procedural sky is double buffered so that it can be regenerated one stage per frame into the back buffer while shading
+// keeps using the last complete set in the front buffer.
 struct SkyEnvironment
 {
-    std::unique_ptr<dw::CubemapSHProjection> cubemap_sh_projection;
-    std::unique_ptr<dw::CubemapPrefiler>     cubemap_prefilter;
-    std::unique_ptr<dw::HosekWilkieSkyModel> hosek_wilkie_sky_model;
+    std::unique_ptr<dw::CubemapSHProjection> cubemap_sh_projection[2];
+    std::unique_ptr<dw::CubemapPrefiler>     cubemap_prefilter[2];
+    std::unique_ptr<dw::HosekWilkieSkyModel> hosek_wilkie_sky_model[2];
+    dw::vk::DescriptorSet::Ptr               ds[2];
+    glm::vec3                                direction[2];
+    SkyUpdateStage                           update_stage      = SKY_UPDATE_STAGE_IDLE;
+    uint32_t                                 front             = 0;
+    uint32_t                                 frames_since_swap = 0;
+    bool                                     valid             = false;
 };
 
 struct HDREnvironment
@@ -155,6 +236,11 @@ struct Light
     {
         data3.z = value;
     }
+
+    inline void set_light_range(float value)
+    {
+        data2.w = value;
+    }
 };
 
 // Uniform buffer data structure.
@@ -178,6 +264,31 @@ struct UBO
     Light light;
 };
 
+// GPU time of a timed pass split by the backend that traced it. Timer results come back kMaxFramesInFlight frames after they
+// were recorded, so the backend of every recent frame is remembered until then.
+class RayTraceBackendTimings
+{
+public:
+    RayTraceBackendTimings(const std::string& timer_name);
+
+    // Called when the pass is recorded, before the timer scope of the pass is opened.
+    void update(GPUTimer* timer, RayTraceBackend backend, int32_t frame);
+
+    // Lists the last time measured with every backend.
+    void gui();
+
+    // Negative until a frame traced with the backend has been timed.
+    inline float milliseconds(RayTraceBackend backend) { return m_milliseconds[backend]; }
+
+private:
+    static const uint32_t kNumFrames = dw::vk::Backend::kMaxFramesInFlight + 1;
+
+    std::string     m_timer_name;
+    int32_t         m_frames[kNumFrames];
+    RayTraceBackend m_backends[kNumFrames];
+    float           m_milliseconds[RAY_TRACE_BACKEND_COUNT];
+};
+
 struct CommonResources
 {
     SceneType                                    current_scene_type         = SCENE_TYPE_SHADOWS_TEST;
@@ -185,6 +296,9 @@ struct CommonResources
     EnvironmentType                              current_environment_type   = ENVIRONMENT_TYPE_PROCEDURAL_SKY;
     bool                                         first_frame                = true;
     bool                                         ping_pong                  = false;
+    RenderScale                                  render_scale               = RENDER_SCALE_NATIVE;
+    uint32_t                                     render_width               = 0;
+    uint32_t                                     render_height              = 0;
     int32_t                                      num_frames                 = 0;
     size_t                                       ubo_size                   = 0;
     glm::vec4                                    z_buffer_params;
@@ -198,10 +312,14 @@ struct CommonResources
     glm::mat4                                    prev_view_projection;
     std::vector<std::unique_ptr<dw::DemoPlayer>> demo_players;
 
-    // Assets.
+    // Assets. Scenes that have not been selected yet are null, see load_scene().
     std::vector<dw::Mesh::Ptr>           meshes;
     std::vector<dw::RayTracedScene::Ptr> scenes;
 
+    // Set for scenes whose TLAS has to be built before the scene is next traced. Instances are only placed when a scene is
+    // created, so this is only set then.
+    std::vector<bool> tlas_dirty;
+
     // Common
     dw::vk::DescriptorSet::Ptr                   per_frame_ds;
     dw::vk::DescriptorSet::Ptr                   blue_noise_ds[9];
@@ -215,6 +333,7 @@ struct CommonResources
     dw::vk::Buffer::Ptr                          bnd_ranking_tile_buffer;
     std::unique_ptr<BlueNoise>                   blue_noise;
     dw::vk::DescriptorSetLayout::Ptr             ddgi_read_ds_layout;
+    dw::vk::DescriptorSetLayout::Ptr             lights_ds_layout;
     dw::vk::DescriptorSetLayout::Ptr             skybox_ds_layout;
     std::vector<dw::vk::DescriptorSet::Ptr>      skybox_ds;
     dw::vk::DescriptorSet::Ptr                   current_skybox_ds;
@@ -225,18 +344,34 @@ struct CommonResources
     std::unique_ptr<SkyEnvironment>              sky_environment;
     std::vector<std::shared_ptr<HDREnvironment>> hdr_environments;
     std::unique_ptr<dw::BRDFIntegrateLUT>        brdf_preintegrate_lut;
+    std::unique_ptr<TransientImagePool>          transient_image_pool;
+    std::unique_ptr<GPUTimer>                    gpu_timer;
+    std::unique_ptr<GPUCounters>                 gpu_counters;
+    std::unique_ptr<DeletionQueue>               deletion_queue;
+    std::unique_ptr<PipelineCache>               pipeline_cache;
+    std::unique_ptr<BindlessHeap>                bindless_heap;
+    std::unique_ptr<MemoryTracker>               memory_tracker;
 
-    CommonResources(dw::vk::Backend::Ptr backend);
+    // Bindless indices of the blue noise textures, which line up with blue_noise_ds.
+    uint32_t blue_noise_sobol_idx;
+    uint32_t blue_noise_scrambling_ranking_idx[9];
+
+    CommonResources(dw::vk::Backend::Ptr backend, SceneType initial_scene_type = SCENE_TYPE_SHADOWS_TEST, RenderScale initial_render_scale = RENDER_SCALE_NATIVE);
     ~CommonResources();
 
     void write_descriptor_sets(dw::vk::Backend::Ptr backend);
 
+    // Loads the meshes of a scene and builds its BLASes, does nothing if the scene is already resident.
+    void load_scene(dw::vk::Backend::Ptr backend, SceneType scene_type);
+
+    inline bool                    is_scene_loaded(SceneType scene_type) { return scenes[scene_type] != nullptr; }
     inline dw::RayTracedScene::Ptr current_scene() { return scenes[current_scene_type]; }
+    inline bool                    upscaling() { return render_scale != RENDER_SCALE_NATIVE; }
 
 private:
-    void create_uniform_buffer(dw::vk::Backend::Ptr backend);
-    void load_mesh(dw::vk::Backend::Ptr backend);
-    void create_environment_resources(dw::vk::Backend::Ptr backend);
-    void create_descriptor_set_layouts(dw::vk::Backend::Ptr backend);
-    void create_descriptor_sets(dw::vk::Backend::Ptr backend);
+    void          create_uniform_buffer(dw::vk::Backend::Ptr backend);
+    dw::Mesh::Ptr load_mesh(dw::vk::Backend::Ptr backend, const std::string& path);
+    void          create_environment_resources(dw::vk::Backend::Ptr backend);
+    void          create_descriptor_set_layouts(dw::vk::Backend::Ptr backend);
+    void          create_descriptor_sets(dw::vk::Backend::Ptr backend);
 };
\ No newline at end of file
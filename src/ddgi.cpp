@@ -1,10 +1,12 @@
 #include "ddgi.h"
 #include "utilities.h"
 #include "g_buffer.h"
+#include "many_lights.h"
 #include <stdexcept>
 #include <logger.h>
 #include <profiler.h>
 #include <imgui.h>
+#include <algorithm>
 #include <macros.h>
 #include <gtc/quaternion.hpp>
 #define _USE_MATH_DEFINES
@@ -14,10 +16,12 @@
 
 struct DDGIUniforms
 {
-    glm::vec3  grid_start_position;
-    glm::vec3  grid_step;
+    glm::vec3  grid_start_position[DDGI_MAX_CASCADES];
+    glm::vec3  grid_step[DDGI_MAX_CASCADES];
+    glm::ivec3 scroll_offset[DDGI_MAX_CASCADES];
+    float      max_distance[DDGI_MAX_CASCADES];
     glm::ivec3 probe_counts;
-    float      max_distance;
+    int        num_cascades;
     float      depth_sharpness;
     float      hysteresis;
     float      normal_bias;
@@ -30,6 +34,42 @@ struct DDGIUniforms
     int        depth_texture_height;
     int        rays_per_probe;
     int        visibility_test;
+    int        probe_update_offset;
+    int        probe_update_count;
+};
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Specialization constant ids of gi_ray_trace.rchit, gi_ray_trace.rgen and gi_ray_trace.comp, which are also the bits of a ray trace
+// permutation key.
+enum GIRayTraceConstant
+{
+    GI_RAY_TRACE_CONSTANT_INFINITE_BOUNCES,
+    GI_RAY_TRACE_CONSTANT_VISIBILITY_TEST,
+    GI_RAY_TRACE_CONSTANT_LOW_MEMORY,
+    GI_RAY_TRACE_CONSTANT_COUNT
+};
+
+// Specialization constant ids of gi_irradiance_probe_update.comp and gi_depth_probe_update.comp.
+enum ProbeUpdateConstant
+{
+    PROBE_UPDATE_CONSTANT_LOW_MEMORY,
+    PROBE_UPDATE_CONSTANT_COUNT
+};
+
+// Specialization constant ids of gi_probe_classification.comp.
+enum ProbeClassificationConstant
+{
+    PROBE_CLASSIFICATION_CONSTANT_LOW_MEMORY,
+    PROBE_CLASSIFICATION_CONSTANT_COUNT
+};
+
+// Specialization constant ids of gi_sample_probe_grid.comp.
+enum SampleProbeGridConstant
+{
+    SAMPLE_PROBE_GRID_CONSTANT_VISIBILITY_TEST,
+    SAMPLE_PROBE_GRID_CONSTANT_LOW_MEMORY,
+    SAMPLE_PROBE_GRID_CONSTANT_COUNT
 };
 
 // -----------------------------------------------------------------------------------------------------------------------------------
@@ -38,15 +78,34 @@ struct RayTracePushConstants
 {
     glm::mat4 random_orientation;
     uint32_t  num_frames;
-    uint32_t  infinite_bounces;
     float     gi_intensity;
+    uint32_t  ray_binning;
+    uint32_t  ray_order_offset;
 };
 
 // -----------------------------------------------------------------------------------------------------------------------------------
 
 struct ProbeUpdatePushConstants
 {
-    uint32_t first_frame;
+    glm::mat4 random_orientation;
+    uint32_t  first_frame;
+};
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+struct ProbeScrollPushConstants
+{
+    glm::ivec4 scroll_delta[DDGI_MAX_CASCADES];
+};
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+struct ProbeClassificationPushConstants
+{
+    uint32_t relocation;
+    uint32_t classification;
+    float    backface_threshold;
+    float    min_frontface_distance;
 };
 
 // -----------------------------------------------------------------------------------------------------------------------------------
@@ -59,23 +118,32 @@ struct SampleProbeGridPushConstants
 
 // -----------------------------------------------------------------------------------------------------------------------------------
 
-DDGI::DDGI(std::weak_ptr<dw::vk::Backend> backend, CommonResources* common_resources, GBuffer* g_buffer, RayTraceScale scale) :
-    m_backend(backend), m_common_resources(common_resources), m_g_buffer(g_buffer), m_scale(scale)
+// Must match spherical_fibonacci() in gi_common.glsl.
+static glm::vec3 spherical_fibonacci(float i, float n)
 {
-    auto vk_backend = m_backend.lock();
+    const float PHI = sqrt(5.0f) * 0.5f + 0.5f;
+
+    float phi       = 2.0f * float(M_PI) * glm::fract(i * (PHI - 1.0f));
+    float cos_theta = 1.0f - (2.0f * i + 1.0f) * (1.0f / n);
+    float sin_theta = sqrt(glm::clamp(1.0f - cos_theta * cos_theta, 0.0f, 1.0f));
+
+    return glm::vec3(cos(phi) * sin_theta, sin(phi) * sin_theta, cos_theta);
+}
 
-    float scale_divisor = powf(2.0f, float(scale));
+// -----------------------------------------------------------------------------------------------------------------------------------
 
-    m_width  = vk_backend->swap_chain_extents().width / scale_divisor;
-    m_height = vk_backend->swap_chain_extents().height / scale_divisor;
+DDGI::DDGI(std::weak_ptr<dw::vk::Backend> backend, CommonResources* common_resources, GBuffer* g_buffer, RayTraceScale scale) :
+    m_backend(backend), m_common_resources(common_resources), m_g_buffer(g_buffer), m_scale(scale)
+{
+    m_graph = std::unique_ptr<RenderGraph>(new RenderGraph(m_backend, m_common_resources->transient_image_pool.get()));
 
-    m_g_buffer_mip = static_cast<uint32_t>(scale);
+    update_resolution();
 
     m_random_generator       = std::mt19937(m_random_device());
     m_random_distribution_zo = std::uniform_real_distribution<float>(0.0f, 1.0f);
     m_random_distribution_no = std::uniform_real_distribution<float>(-1.0f, 1.0f);
 
-    create_descriptor_sets();
+    create_descriptor_set_layouts();
     create_pipelines();
 }
 
@@ -87,7 +155,7 @@ DDGI::~DDGI()
 
 // -----------------------------------------------------------------------------------------------------------------------------------
 
-void DDGI::render(dw::vk::CommandBuffer::Ptr cmd_buf)
+void DDGI::render(dw::vk::CommandBuffer::Ptr cmd_buf, ManyLights* many_lights)
 {
     DW_SCOPED_SAMPLE("DDGI", cmd_buf);
 
@@ -95,10 +163,13 @@ void DDGI::render(dw::vk::CommandBuffer::Ptr cmd_buf)
     if (m_last_scene_id != m_common_resources->current_scene()->id())
         initialize_probe_grid();
 
+    update_cascades();
     update_properties_ubo();
-    ray_trace(cmd_buf);
-    probe_update(cmd_buf);
-    sample_probe_grid(cmd_buf);
+    setup_render_graph(many_lights);
+
+    m_graph->execute(cmd_buf);
+
+    m_ray_trace.probe_update_offset = (m_ray_trace.probe_update_offset + m_ray_trace.probe_update_count) % num_probes();
 
     m_first_frame = false;
     m_ping_pong   = !m_ping_pong;
@@ -109,19 +180,71 @@ void DDGI::render(dw::vk::CommandBuffer::Ptr cmd_buf)
 void DDGI::gui()
 {
     ImGui::Text("Grid Size: [%i, %i, %i]", m_probe_grid.probe_counts.x, m_probe_grid.probe_counts.y, m_probe_grid.probe_counts.z);
-    ImGui::Text("Probe Count: %i", m_probe_grid.probe_counts.x * m_probe_grid.probe_counts.y * m_probe_grid.probe_counts.z);
+    ImGui::Text("Cascades: %u", m_probe_grid.num_cascades);
+    ImGui::Text("Probe Count: %u", num_probes());
+    ImGui::Text("Probes Updated Per Frame: %u", m_ray_trace.probe_update_count);
+    m_timings.gui();
     ImGui::Checkbox("Visibility Test", &m_probe_grid.visibility_test);
     ImGui::Checkbox("Infinite Bounces", &m_ray_trace.infinite_bounces);
+    ImGui::Checkbox("Ray Binning", &m_ray_trace.ray_binning);
+
+    if (ImGui::Checkbox("Probe Relocation", &m_probe_classification.relocation))
+        restart_accumulation();
+    if (ImGui::Checkbox("Probe Classification", &m_probe_classification.classification))
+        restart_accumulation();
 
     if (ImGui::InputInt("Rays Per Probe", &m_ray_trace.rays_per_probe))
+    {
+        // Leave at least as many rays for shading as there are fixed rays for classification.
+        m_ray_trace.rays_per_probe = std::max(m_ray_trace.rays_per_probe, DDGI_NUM_FIXED_RAYS * 2);
         recreate_probe_grid_resources();
+    }
+
+    ImGui::InputInt("Ray Budget", &m_ray_trace.ray_budget);
     if (ImGui::InputFloat("Probe Distance", &m_probe_grid.probe_distance))
         initialize_probe_grid();
+    if (ImGui::SliderInt("Max Cascades", &m_probe_grid.max_cascades, 1, DDGI_MAX_CASCADES))
+        initialize_probe_grid();
+    if (ImGui::InputInt3("Max Probe Counts", &m_probe_grid.max_probe_counts.x))
+    {
+        m_probe_grid.max_probe_counts = glm::max(m_probe_grid.max_probe_counts, glm::ivec3(2));
+        initialize_probe_grid();
+    }
     ImGui::InputFloat("Hysteresis", &m_probe_update.hysteresis);
     ImGui::SliderFloat("Infinite Bounce Intensity", &m_ray_trace.infinite_bounce_intensity, 0.0f, 10.0f);
     ImGui::SliderFloat("GI Intensity", &m_sample_probe_grid.gi_intensity, 0.0f, 10.0f);
     ImGui::SliderFloat("Normal Bias", &m_probe_update.normal_bias, 0.0f, 10.0f);
     ImGui::InputFloat("Depth Sharpness", &m_probe_update.depth_sharpness);
+    ImGui::Text("Render Graph: %u passes, %u barriers", m_graph->num_passes(), m_graph->num_barriers());
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void DDGI::set_scale(RayTraceScale scale)
+{
+    if (scale == m_scale)
+        return;
+
+    m_scale = scale;
+
+    update_resolution();
+
+    // The probe grid resources are created on the first render of a scene, until then there is nothing to resize.
+    if (m_last_scene_id != UINT32_MAX)
+        recreate_probe_grid_resources();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void DDGI::set_precision(RenderTargetPrecision precision)
+{
+    if (precision == m_precision)
+        return;
+
+    m_precision = precision;
+
+    if (m_last_scene_id != UINT32_MAX)
+        recreate_probe_grid_resources();
 }
 
 // -----------------------------------------------------------------------------------------------------------------------------------
@@ -159,9 +282,24 @@ void DDGI::initialize_probe_grid()
 
     // Compute the number of probes along each axis.
     // Add 2 more probes to fully cover scene.
-    m_probe_grid.probe_counts        = glm::ivec3(scene_length / m_probe_grid.probe_distance) + glm::ivec3(2);
-    m_probe_grid.grid_start_position = min_extents;
-    m_probe_update.max_distance      = m_probe_grid.probe_distance * 1.5f;
+    // Larger scenes are limited to a camera centered volume, which the coarser cascades extend.
+    m_probe_grid.probe_counts      = glm::min(glm::ivec3(scene_length / m_probe_grid.probe_distance) + glm::ivec3(2), m_probe_grid.max_probe_counts);
+    m_probe_grid.scene_min_extents = min_extents;
+    m_probe_grid.scene_max_extents = max_extents;
+    m_probe_update.max_distance    = m_probe_grid.probe_distance * 1.5f;
+
+    // Every cascade doubles the probe distance of the previous one. Add cascades until the coarsest one covers the whole scene.
+    m_probe_grid.num_cascades = 1;
+
+    while (m_probe_grid.num_cascades < (uint32_t)m_probe_grid.max_cascades)
+    {
+        glm::vec3 coverage = glm::vec3(m_probe_grid.probe_counts - glm::ivec3(1)) * m_probe_grid.probe_distance * float(1 << (m_probe_grid.num_cascades - 1));
+
+        if (glm::all(glm::greaterThanEqual(coverage, scene_length)))
+            break;
+
+        m_probe_grid.num_cascades++;
+    }
 
     // Assign current scene ID
     m_last_scene_id = m_common_resources->current_scene()->id();
@@ -171,21 +309,44 @@ void DDGI::initialize_probe_grid()
 
 // -----------------------------------------------------------------------------------------------------------------------------------
 
+void DDGI::update_resolution()
+{
+    float scale_divisor = powf(2.0f, float(m_scale));
+
+    m_width  = m_common_resources->render_width / scale_divisor;
+    m_height = m_common_resources->render_height / scale_divisor;
+
+    m_g_buffer_mip = static_cast<uint32_t>(m_scale);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
 void DDGI::create_images()
 {
     auto backend = m_backend.lock();
 
-    uint32_t total_probes = m_probe_grid.probe_counts.x * m_probe_grid.probe_counts.y * m_probe_grid.probe_counts.z;
+    uint32_t total_probes = num_probes();
+
+    // The low memory tier keeps only the hit distance of each ray, see gi_common.glsl, and packs the radiance and the sampled
+    // irradiance. The irradiance probes stay RGBA16F, they accumulate with a hysteresis close to 1 which the 5-6 bit mantissas of
+    // R11G11B10F can not resolve.
+    const bool low_memory = m_precision == RENDER_TARGET_PRECISION_LOW_MEMORY;
+
+    m_ray_trace.low_memory         = low_memory && is_storage_image_format_supported(backend, VK_FORMAT_B10G11R11_UFLOAT_PACK32) && is_storage_image_format_supported(backend, VK_FORMAT_R16_SFLOAT);
+    m_sample_probe_grid.low_memory = low_memory && is_storage_image_format_supported(backend, VK_FORMAT_B10G11R11_UFLOAT_PACK32);
+
+    if (low_memory && !m_ray_trace.low_memory)
+        DW_LOG_INFO("DDGI: Packed ray trace formats are not supported as storage images, using full precision.");
 
     // Ray Trace
     {
-        m_ray_trace.radiance_image = dw::vk::Image::create(backend, VK_IMAGE_TYPE_2D, m_ray_trace.rays_per_probe, total_probes, 1, 1, 1, VK_FORMAT_R16G16B16A16_SFLOAT, VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_SAMPLE_COUNT_1_BIT);
+        m_ray_trace.radiance_image = dw::vk::Image::create(backend, VK_IMAGE_TYPE_2D, m_ray_trace.rays_per_probe, total_probes, 1, 1, 1, m_ray_trace.low_memory ? VK_FORMAT_B10G11R11_UFLOAT_PACK32 : VK_FORMAT_R16G16B16A16_SFLOAT, VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_SAMPLE_COUNT_1_BIT);
         m_ray_trace.radiance_image->set_name("DDGI Ray Trace Radiance");
 
         m_ray_trace.radiance_view = dw::vk::ImageView::create(backend, m_ray_trace.radiance_image, VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT);
         m_ray_trace.radiance_view->set_name("DDGI Ray Trace Radiance");
 
-        m_ray_trace.direction_depth_image = dw::vk::Image::create(backend, VK_IMAGE_TYPE_2D, m_ray_trace.rays_per_probe, total_probes, 1, 1, 1, VK_FORMAT_R16G16B16A16_SFLOAT, VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_SAMPLE_COUNT_1_BIT);
+        m_ray_trace.direction_depth_image = dw::vk::Image::create(backend, VK_IMAGE_TYPE_2D, m_ray_trace.rays_per_probe, total_probes, 1, 1, 1, m_ray_trace.low_memory ? VK_FORMAT_R16_SFLOAT : VK_FORMAT_R16G16B16A16_SFLOAT, VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_SAMPLE_COUNT_1_BIT);
         m_ray_trace.direction_depth_image->set_name("DDGI Ray Trace Direction Depth");
 
         m_ray_trace.direction_depth_view = dw::vk::ImageView::create(backend, m_ray_trace.direction_depth_image, VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT);
@@ -194,12 +355,15 @@ void DDGI::create_images()
 
     // Probe Grid
     {
+        // Cascades are stacked on top of each other.
+        const int num_rows = m_probe_grid.probe_counts.z * m_probe_grid.num_cascades;
+
         // 1-pixel of padding surrounding each probe, 1-pixel padding surrounding entire texture for alignment.
         const int irradiance_width  = (m_probe_grid.irradiance_oct_size + 2) * m_probe_grid.probe_counts.x * m_probe_grid.probe_counts.y + 2;
-        const int irradiance_height = (m_probe_grid.irradiance_oct_size + 2) * m_probe_grid.probe_counts.z + 2;
+        const int irradiance_height = (m_probe_grid.irradiance_oct_size + 2) * num_rows + 2;
 
         const int depth_width  = (m_probe_grid.depth_oct_size + 2) * m_probe_grid.probe_counts.x * m_probe_grid.probe_counts.y + 2;
-        const int depth_height = (m_probe_grid.depth_oct_size + 2) * m_probe_grid.probe_counts.z + 2;
+        const int depth_height = (m_probe_grid.depth_oct_size + 2) * num_rows + 2;
 
         for (int i = 0; i < 2; i++)
         {
@@ -217,14 +381,25 @@ void DDGI::create_images()
         }
     }
 
+    // Probe Data
+    {
+        m_probe_grid.data_image = dw::vk::Image::create(backend, VK_IMAGE_TYPE_2D, m_probe_grid.probe_counts.x * m_probe_grid.probe_counts.y, m_probe_grid.probe_counts.z * m_probe_grid.num_cascades, 1, 1, 1, VK_FORMAT_R16G16B16A16_SFLOAT, VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, VK_SAMPLE_COUNT_1_BIT);
+        m_probe_grid.data_image->set_name("DDGI Probe Data");
+
+        m_probe_grid.data_view = dw::vk::ImageView::create(backend, m_probe_grid.data_image, VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT);
+        m_probe_grid.data_view->set_name("DDGI Probe Data");
+    }
+
     // Sample Probe Grid
     {
-        m_sample_probe_grid.image = dw::vk::Image::create(backend, VK_IMAGE_TYPE_2D, m_width, m_height, 1, 1, 1, VK_FORMAT_R16G16B16A16_SFLOAT, VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT, VK_SAMPLE_COUNT_1_BIT);
+        m_sample_probe_grid.image = dw::vk::Image::create(backend, VK_IMAGE_TYPE_2D, m_width, m_height, 1, 1, 1, m_sample_probe_grid.low_memory ? VK_FORMAT_B10G11R11_UFLOAT_PACK32 : VK_FORMAT_R16G16B16A16_SFLOAT, VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT, VK_SAMPLE_COUNT_1_BIT);
         m_sample_probe_grid.image->set_name("DDGI Sample Probe Grid");
 
         m_sample_probe_grid.image_view = dw::vk::ImageView::create(backend, m_sample_probe_grid.image, VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT);
         m_sample_probe_grid.image_view->set_name("DDGI Sample Probe Grid");
     }
+
+    m_common_resources->memory_tracker->track("DDGI", { m_ray_trace.radiance_image, m_ray_trace.direction_depth_image, m_probe_grid.irradiance_image[0], m_probe_grid.irradiance_image[1], m_probe_grid.depth_image[0], m_probe_grid.depth_image[1], m_probe_grid.data_image, m_sample_probe_grid.image });
 }
 
 // -----------------------------------------------------------------------------------------------------------------------------------
@@ -235,11 +410,13 @@ void DDGI::create_buffers()
 
     m_probe_grid.properties_ubo_size = backend->aligned_dynamic_ubo_size(sizeof(DDGIUniforms));
     m_probe_grid.properties_ubo      = dw::vk::Buffer::create(backend, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, m_probe_grid.properties_ubo_size * dw::vk::Backend::kMaxFramesInFlight, VMA_MEMORY_USAGE_CPU_TO_GPU, VMA_ALLOCATION_CREATE_MAPPED_BIT);
+
+    m_ray_trace.ray_order_buffer = dw::vk::Buffer::create(backend, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sizeof(uint32_t) * m_ray_trace.rays_per_probe * dw::vk::Backend::kMaxFramesInFlight, VMA_MEMORY_USAGE_CPU_TO_GPU, VMA_ALLOCATION_CREATE_MAPPED_BIT);
 }
 
 // -----------------------------------------------------------------------------------------------------------------------------------
 
-void DDGI::create_descriptor_sets()
+void DDGI::create_descriptor_set_layouts()
 {
     auto backend = m_backend.lock();
 
@@ -249,6 +426,7 @@ void DDGI::create_descriptor_sets()
 
         desc.add_binding(0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_FRAGMENT_BIT);
         desc.add_binding(1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_FRAGMENT_BIT);
+        desc.add_binding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_COMPUTE_BIT);
 
         m_ray_trace.write_ds_layout = dw::vk::DescriptorSetLayout::create(backend, desc);
     }
@@ -262,11 +440,6 @@ void DDGI::create_descriptor_sets()
         m_ray_trace.read_ds_layout = dw::vk::DescriptorSetLayout::create(backend, desc);
     }
 
-    {
-        m_ray_trace.write_ds = backend->allocate_descriptor_set(m_ray_trace.write_ds_layout);
-        m_ray_trace.read_ds  = backend->allocate_descriptor_set(m_ray_trace.read_ds_layout);
-    }
-
     // Probe Grid
     {
         dw::vk::DescriptorSetLayout::Desc desc;
@@ -276,13 +449,33 @@ void DDGI::create_descriptor_sets()
 
         m_probe_grid.write_ds_layout = dw::vk::DescriptorSetLayout::create(backend, desc);
     }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void DDGI::create_descriptor_sets()
+{
+    auto backend = m_backend.lock();
+
+    // Ray Trace
+    {
+        m_ray_trace.write_ds = backend->allocate_descriptor_set(m_ray_trace.write_ds_layout);
+        m_ray_trace.read_ds  = backend->allocate_descriptor_set(m_ray_trace.read_ds_layout);
+    }
 
+    // Probe Grid
     for (int i = 0; i < 2; i++)
     {
         m_probe_grid.write_ds[i] = backend->allocate_descriptor_set(m_probe_grid.write_ds_layout);
         m_probe_grid.read_ds[i]  = backend->allocate_descriptor_set(m_common_resources->ddgi_read_ds_layout);
     }
 
+    // Probe Data
+    {
+        m_probe_grid.data_write_ds = backend->allocate_descriptor_set(m_common_resources->storage_image_ds_layout);
+        m_probe_grid.data_write_ds->set_name("DDGI Probe Data");
+    }
+
     // Sample Probe Grid
     {
         m_sample_probe_grid.write_ds = backend->allocate_descriptor_set(m_common_resources->storage_image_ds_layout);
@@ -350,6 +543,23 @@ void DDGI::write_descriptor_sets()
             write_datas.push_back(write_data);
         }
 
+        VkDescriptorBufferInfo buffer_info;
+
+        buffer_info.range  = m_ray_trace.ray_order_buffer->size();
+        buffer_info.offset = 0;
+        buffer_info.buffer = m_ray_trace.ray_order_buffer->handle();
+
+        DW_ZERO_MEMORY(write_data);
+
+        write_data.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write_data.descriptorCount = 1;
+        write_data.descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        write_data.pBufferInfo     = &buffer_info;
+        write_data.dstBinding      = 2;
+        write_data.dstSet          = m_ray_trace.write_ds->handle();
+
+        write_datas.push_back(write_data);
+
         vkUpdateDescriptorSets(backend->device(), write_datas.size(), write_datas.data(), 0, nullptr);
     }
 
@@ -470,8 +680,8 @@ void DDGI::write_descriptor_sets()
         std::vector<VkWriteDescriptorSet>   write_datas;
         VkWriteDescriptorSet                write_data;
 
-        image_infos.reserve(2);
-        write_datas.reserve(3);
+        image_infos.reserve(3);
+        write_datas.reserve(4);
 
         {
             VkDescriptorImageInfo sampler_image_info;
@@ -536,9 +746,52 @@ void DDGI::write_descriptor_sets()
             write_datas.push_back(write_data);
         }
 
+        {
+            VkDescriptorImageInfo sampler_image_info;
+
+            sampler_image_info.sampler     = backend->nearest_sampler()->handle();
+            sampler_image_info.imageView   = m_probe_grid.data_view->handle();
+            sampler_image_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+            image_infos.push_back(sampler_image_info);
+
+            DW_ZERO_MEMORY(write_data);
+
+            write_data.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            write_data.descriptorCount = 1;
+            write_data.descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            write_data.pImageInfo      = &image_infos.back();
+            write_data.dstBinding      = 3;
+            write_data.dstSet          = m_probe_grid.read_ds[i]->handle();
+
+            write_datas.push_back(write_data);
+        }
+
         vkUpdateDescriptorSets(backend->device(), write_datas.size(), write_datas.data(), 0, nullptr);
     }
 
+    // Probe Data write
+    {
+        VkDescriptorImageInfo storage_image_info;
+
+        storage_image_info.sampler     = VK_NULL_HANDLE;
+        storage_image_info.imageView   = m_probe_grid.data_view->handle();
+        storage_image_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+        VkWriteDescriptorSet write_data;
+
+        DW_ZERO_MEMORY(write_data);
+
+        write_data.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write_data.descriptorCount = 1;
+        write_data.descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        write_data.pImageInfo      = &storage_image_info;
+        write_data.dstBinding      = 0;
+        write_data.dstSet          = m_probe_grid.data_write_ds->handle();
+
+        vkUpdateDescriptorSets(backend->device(), 1, &write_data, 0, nullptr);
+    }
+
     // Sample Probe Grid write
     {
         VkDescriptorImageInfo storage_image_info;
@@ -590,29 +843,10 @@ void DDGI::create_pipelines()
 {
     auto vk_backend = m_backend.lock();
 
+    std::vector<PipelineCache::ComputePipelineDesc> compute_pipelines;
+
     // Ray Trace
     {
-        // ---------------------------------------------------------------------------
-        // Create shader modules
-        // ---------------------------------------------------------------------------
-
-        dw::vk::ShaderModule::Ptr rgen  = dw::vk::ShaderModule::create_from_file(vk_backend, "shaders/gi_ray_trace.rgen.spv");
-        dw::vk::ShaderModule::Ptr rchit = dw::vk::ShaderModule::create_from_file(vk_backend, "shaders/gi_ray_trace.rchit.spv");
-        dw::vk::ShaderModule::Ptr rmiss = dw::vk::ShaderModule::create_from_file(vk_backend, "shaders/gi_ray_trace.rmiss.spv");
-
-        dw::vk::ShaderBindingTable::Desc sbt_desc;
-
-        sbt_desc.add_ray_gen_group(rgen, "main");
-        sbt_desc.add_hit_group(rchit, "main");
-        sbt_desc.add_miss_group(rmiss, "main");
-
-        m_ray_trace.sbt = dw::vk::ShaderBindingTable::create(vk_backend, sbt_desc);
-
-        dw::vk::RayTracingPipeline::Desc desc;
-
-        desc.set_max_pipeline_ray_recursion_depth(1);
-        desc.set_shader_binding_table(m_ray_trace.sbt);
-
         // ---------------------------------------------------------------------------
         // Create pipeline layout
         // ---------------------------------------------------------------------------
@@ -624,13 +858,74 @@ void DDGI::create_pipelines()
         pl_desc.add_descriptor_set_layout(m_common_resources->per_frame_ds_layout);
         pl_desc.add_descriptor_set_layout(m_common_resources->skybox_ds_layout);
         pl_desc.add_descriptor_set_layout(m_common_resources->ddgi_read_ds_layout);
+        pl_desc.add_descriptor_set_layout(m_common_resources->lights_ds_layout);
+        pl_desc.add_descriptor_set_layout(m_common_resources->gpu_counters->ds_layout());
         pl_desc.add_push_constant_range(VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR, 0, sizeof(RayTracePushConstants));
 
         m_ray_trace.pipeline_layout = dw::vk::PipelineLayout::create(vk_backend, pl_desc);
 
-        desc.set_pipeline_layout(m_ray_trace.pipeline_layout);
+        // ---------------------------------------------------------------------------
+        // Create pipeline permutations
+        // ---------------------------------------------------------------------------
+
+        m_ray_trace.permutations = std::unique_ptr<RayTracingPipelinePermutations>(new RayTracingPipelinePermutations(GI_RAY_TRACE_CONSTANT_COUNT, [this](const VkSpecializationInfo* specialization_info) {
+            auto vk_backend = m_backend.lock();
+
+            dw::vk::ShaderModule::Ptr rgen  = dw::vk::ShaderModule::create_from_file(vk_backend, "shaders/gi_ray_trace.rgen.spv");
+            dw::vk::ShaderModule::Ptr rchit = dw::vk::ShaderModule::create_from_file(vk_backend, "shaders/gi_ray_trace.rchit.spv");
+            dw::vk::ShaderModule::Ptr rmiss = dw::vk::ShaderModule::create_from_file(vk_backend, "shaders/gi_ray_trace.rmiss.spv");
+
+            dw::vk::ShaderBindingTable::Desc sbt_desc;
+
+            sbt_desc.add_ray_gen_group(rgen, "main");
+            sbt_desc.add_hit_group(rchit, "main");
+            sbt_desc.add_miss_group(rmiss, "main");
+
+            // The bounce toggles are read by the closest hit shader and the precision by the ray generation shader, unused ids are
+            // ignored by a stage.
+            sbt_desc.ray_gen_stages[0].pSpecializationInfo = specialization_info;
+            sbt_desc.hit_stages[0].pSpecializationInfo     = specialization_info;
+
+            RayTracingPermutation permutation;
+
+            permutation.sbt = dw::vk::ShaderBindingTable::create(vk_backend, sbt_desc);
+
+            dw::vk::RayTracingPipeline::Desc desc;
+
+            desc.set_max_pipeline_ray_recursion_depth(1);
+            desc.set_shader_binding_table(permutation.sbt);
+            desc.set_pipeline_layout(m_ray_trace.pipeline_layout);
+
+            permutation.pipeline = dw::vk::RayTracingPipeline::create(vk_backend, desc);
 
-        m_ray_trace.pipeline = dw::vk::RayTracingPipeline::create(vk_backend, desc);
+            return permutation;
+        }));
+
+        // ---------------------------------------------------------------------------
+        // Create ray query pipeline layout and permutations
+        // ---------------------------------------------------------------------------
+
+        dw::vk::PipelineLayout::Desc rq_pl_desc;
+
+        rq_pl_desc.add_descriptor_set_layout(m_common_resources->current_scene()->descriptor_set_layout());
+        rq_pl_desc.add_descriptor_set_layout(m_ray_trace.write_ds_layout);
+        rq_pl_desc.add_descriptor_set_layout(m_common_resources->per_frame_ds_layout);
+        rq_pl_desc.add_descriptor_set_layout(m_common_resources->skybox_ds_layout);
+        rq_pl_desc.add_descriptor_set_layout(m_common_resources->ddgi_read_ds_layout);
+        rq_pl_desc.add_descriptor_set_layout(m_common_resources->lights_ds_layout);
+        rq_pl_desc.add_descriptor_set_layout(m_common_resources->gpu_counters->ds_layout());
+        rq_pl_desc.add_push_constant_range(VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(RayTracePushConstants));
+
+        m_ray_trace.ray_query_pipeline_layout = dw::vk::PipelineLayout::create(vk_backend, rq_pl_desc);
+        m_ray_trace.ray_query_pipeline_layout->set_name("DDGI Ray Query Pipeline Layout");
+
+        m_ray_trace.ray_query_permutations = std::unique_ptr<ComputePipelinePermutations>(new ComputePipelinePermutations(GI_RAY_TRACE_CONSTANT_COUNT, [this](const VkSpecializationInfo* specialization_info) {
+            CachedComputePipeline::Ptr pipeline;
+
+            m_common_resources->pipeline_cache->create_compute_pipelines({ { "shaders/gi_ray_trace.comp.spv", m_ray_trace.ray_query_pipeline_layout, &pipeline, specialization_info } });
+
+            return pipeline;
+        }));
     }
 
     // Probe Update
@@ -646,10 +941,6 @@ void DDGI::create_pipelines()
         m_probe_update.pipeline_layout = dw::vk::PipelineLayout::create(vk_backend, desc);
         m_probe_update.pipeline_layout->set_name("Probe Update Pipeline Layout");
 
-        dw::vk::ComputePipeline::Desc comp_desc;
-
-        comp_desc.set_pipeline_layout(m_probe_update.pipeline_layout);
-
         std::string shaders[] = {
             "shaders/gi_irradiance_probe_update.comp.spv",
             "shaders/gi_depth_probe_update.comp.spv"
@@ -657,11 +948,15 @@ void DDGI::create_pipelines()
 
         for (int i = 0; i < 2; i++)
         {
-            dw::vk::ShaderModule::Ptr module = dw::vk::ShaderModule::create_from_file(vk_backend, shaders[i]);
+            const std::string shader = shaders[i];
 
-            comp_desc.set_shader_stage(module, "main");
+            m_probe_update.permutations[i] = std::unique_ptr<ComputePipelinePermutations>(new ComputePipelinePermutations(PROBE_UPDATE_CONSTANT_COUNT, [this, shader](const VkSpecializationInfo* specialization_info) {
+                CachedComputePipeline::Ptr pipeline;
 
-            m_probe_update.pipeline[i] = dw::vk::ComputePipeline::create(vk_backend, comp_desc);
+                m_common_resources->pipeline_cache->create_compute_pipelines({ { shader, m_probe_update.pipeline_layout, &pipeline, specialization_info } });
+
+                return pipeline;
+            }));
         }
     }
 
@@ -674,10 +969,6 @@ void DDGI::create_pipelines()
         m_border_update.pipeline_layout = dw::vk::PipelineLayout::create(vk_backend, desc);
         m_border_update.pipeline_layout->set_name("Border Update Pipeline Layout");
 
-        dw::vk::ComputePipeline::Desc comp_desc;
-
-        comp_desc.set_pipeline_layout(m_border_update.pipeline_layout);
-
         std::string shaders[] = {
             "shaders/gi_irradiance_border_update.comp.spv",
             "shaders/gi_depth_border_update.comp.spv"
@@ -685,12 +976,45 @@ void DDGI::create_pipelines()
 
         for (int i = 0; i < 2; i++)
         {
-            dw::vk::ShaderModule::Ptr module = dw::vk::ShaderModule::create_from_file(vk_backend, shaders[i]);
+            compute_pipelines.push_back({ shaders[i], m_border_update.pipeline_layout, &m_border_update.pipeline[i] });
+        }
+    }
+
+    // Probe Scroll
+    {
+        dw::vk::PipelineLayout::Desc desc;
+
+        desc.add_descriptor_set_layout(m_common_resources->storage_image_ds_layout);
+        desc.add_descriptor_set_layout(m_common_resources->ddgi_read_ds_layout);
 
-            comp_desc.set_shader_stage(module, "main");
+        desc.add_push_constant_range(VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ProbeScrollPushConstants));
 
-            m_border_update.pipeline[i] = dw::vk::ComputePipeline::create(vk_backend, comp_desc);
-        }
+        m_probe_scroll.pipeline_layout = dw::vk::PipelineLayout::create(vk_backend, desc);
+        m_probe_scroll.pipeline_layout->set_name("Probe Scroll Pipeline Layout");
+
+        compute_pipelines.push_back({ "shaders/gi_probe_scroll.comp.spv", m_probe_scroll.pipeline_layout, &m_probe_scroll.pipeline });
+    }
+
+    // Probe Classification
+    {
+        dw::vk::PipelineLayout::Desc desc;
+
+        desc.add_descriptor_set_layout(m_common_resources->storage_image_ds_layout);
+        desc.add_descriptor_set_layout(m_common_resources->ddgi_read_ds_layout);
+        desc.add_descriptor_set_layout(m_ray_trace.read_ds_layout);
+
+        desc.add_push_constant_range(VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ProbeClassificationPushConstants));
+
+        m_probe_classification.pipeline_layout = dw::vk::PipelineLayout::create(vk_backend, desc);
+        m_probe_classification.pipeline_layout->set_name("Probe Classification Pipeline Layout");
+
+        m_probe_classification.permutations = std::unique_ptr<ComputePipelinePermutations>(new ComputePipelinePermutations(PROBE_CLASSIFICATION_CONSTANT_COUNT, [this](const VkSpecializationInfo* specialization_info) {
+            CachedComputePipeline::Ptr pipeline;
+
+            m_common_resources->pipeline_cache->create_compute_pipelines({ { "shaders/gi_probe_classification.comp.spv", m_probe_classification.pipeline_layout, &pipeline, specialization_info } });
+
+            return pipeline;
+        }));
     }
 
     // Sample Probe Grid Update
@@ -707,31 +1031,102 @@ void DDGI::create_pipelines()
         m_sample_probe_grid.pipeline_layout = dw::vk::PipelineLayout::create(vk_backend, desc);
         m_sample_probe_grid.pipeline_layout->set_name("Sample Probe Grid Pipeline Layout");
 
-        dw::vk::ComputePipeline::Desc comp_desc;
+        m_sample_probe_grid.permutations = std::unique_ptr<ComputePipelinePermutations>(new ComputePipelinePermutations(SAMPLE_PROBE_GRID_CONSTANT_COUNT, [this](const VkSpecializationInfo* specialization_info) {
+            CachedComputePipeline::Ptr pipeline;
+
+            m_common_resources->pipeline_cache->create_compute_pipelines({ { "shaders/gi_sample_probe_grid.comp.spv", m_sample_probe_grid.pipeline_layout, &pipeline, specialization_info } });
 
-        comp_desc.set_pipeline_layout(m_sample_probe_grid.pipeline_layout);
+            return pipeline;
+        }));
+    }
+
+    m_common_resources->pipeline_cache->create_compute_pipelines(compute_pipelines);
+}
 
-        dw::vk::ShaderModule::Ptr module = dw::vk::ShaderModule::create_from_file(vk_backend, "shaders/gi_sample_probe_grid.comp.spv");
+// -----------------------------------------------------------------------------------------------------------------------------------
 
-        comp_desc.set_shader_stage(module, "main");
+void DDGI::retire_resources()
+{
+    DeletionQueue* deletion_queue = m_common_resources->deletion_queue.get();
+
+    deletion_queue->push({ m_ray_trace.radiance_image,
+                           m_ray_trace.radiance_view,
+                           m_ray_trace.direction_depth_image,
+                           m_ray_trace.direction_depth_view,
+                           m_ray_trace.write_ds,
+                           m_ray_trace.read_ds,
+                           m_probe_grid.data_image,
+                           m_probe_grid.data_view,
+                           m_probe_grid.data_write_ds,
+                           m_probe_grid.properties_ubo,
+                           m_ray_trace.ray_order_buffer });
 
-        m_sample_probe_grid.pipeline = dw::vk::ComputePipeline::create(vk_backend, comp_desc);
+    for (int i = 0; i < 2; i++)
+    {
+        deletion_queue->push({ m_probe_grid.irradiance_image[i],
+                               m_probe_grid.irradiance_view[i],
+                               m_probe_grid.depth_image[i],
+                               m_probe_grid.depth_view[i],
+                               m_probe_grid.write_ds[i],
+                               m_probe_grid.read_ds[i] });
     }
+
+    deletion_queue->push({ m_sample_probe_grid.image, m_sample_probe_grid.image_view, m_sample_probe_grid.write_ds, m_sample_probe_grid.read_ds });
 }
 
 // -----------------------------------------------------------------------------------------------------------------------------------
 
 void DDGI::recreate_probe_grid_resources()
 {
-    auto backend = m_backend.lock();
-
-    backend->wait_idle();
+    // Frames in flight may still reference the old resources, so new descriptor sets are allocated rather than rewriting the
+    // current ones.
+    retire_resources();
 
     m_first_frame = true;
 
     create_images();
     create_buffers();
+    create_descriptor_sets();
     write_descriptor_sets();
+
+    m_graph->clear_resource_states();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void DDGI::update_cascades()
+{
+    const glm::ivec3 probe_counts = m_probe_grid.probe_counts;
+
+    for (uint32_t i = 0; i < m_probe_grid.num_cascades; i++)
+    {
+        const float probe_distance = m_probe_grid.probe_distance * float(1 << i);
+
+        // Center the cascade on the camera, snapped to its own grid so that the probes stay fixed in world space as it scrolls.
+        glm::ivec3 origin = glm::ivec3(glm::floor(m_common_resources->position / probe_distance)) - (probe_counts - glm::ivec3(1)) / 2;
+
+        // Keep the cascade inside the scene where it fits. A cascade larger than the scene stays in place, which is what the
+        // single scene sized grid did.
+        glm::ivec3 min_origin = glm::ivec3(glm::floor(m_probe_grid.scene_min_extents / probe_distance));
+        glm::ivec3 max_origin = glm::ivec3(glm::ceil(m_probe_grid.scene_max_extents / probe_distance)) - (probe_counts - glm::ivec3(1));
+
+        origin = glm::clamp(origin, min_origin, glm::max(min_origin, max_origin));
+
+        if (m_first_frame)
+        {
+            m_probe_grid.scroll_offset[i] = glm::ivec3(0);
+            m_probe_grid.scroll_delta[i]  = glm::ivec3(0);
+        }
+        else
+        {
+            m_probe_grid.scroll_delta[i] = origin - m_probe_grid.cascade_origin[i];
+
+            // Keep the offset within [0, probe_counts), the shaders rely on it being positive.
+            m_probe_grid.scroll_offset[i] = ((m_probe_grid.scroll_offset[i] + m_probe_grid.scroll_delta[i]) % probe_counts + probe_counts) % probe_counts;
+        }
+
+        m_probe_grid.cascade_origin[i] = origin;
+    }
 }
 
 // -----------------------------------------------------------------------------------------------------------------------------------
@@ -740,12 +1135,32 @@ void DDGI::update_properties_ubo()
 {
     auto backend = m_backend.lock();
 
+    uint32_t num_total_probes = num_probes();
+
+    // Trace as many probes as the ray budget allows, starting where the previous frame left off. Every probe is traced on the
+    // first frame so that the whole grid starts out classified and lit.
+    if (m_first_frame)
+    {
+        m_ray_trace.probe_update_offset = 0;
+        m_ray_trace.probe_update_count  = num_total_probes;
+    }
+    else
+        m_ray_trace.probe_update_count = std::min(num_total_probes, (uint32_t)std::max(1, m_ray_trace.ray_budget / m_ray_trace.rays_per_probe));
+
     DDGIUniforms ubo;
 
-    ubo.grid_start_position          = m_probe_grid.grid_start_position;
-    ubo.grid_step                    = glm::vec3(m_probe_grid.probe_distance);
+    for (uint32_t i = 0; i < m_probe_grid.num_cascades; i++)
+    {
+        const float probe_distance = m_probe_grid.probe_distance * float(1 << i);
+
+        ubo.grid_start_position[i] = glm::vec3(m_probe_grid.cascade_origin[i]) * probe_distance;
+        ubo.grid_step[i]           = glm::vec3(probe_distance);
+        ubo.scroll_offset[i]       = m_probe_grid.scroll_offset[i];
+        ubo.max_distance[i]        = m_probe_update.max_distance * float(1 << i);
+    }
+
     ubo.probe_counts                 = m_probe_grid.probe_counts;
-    ubo.max_distance                 = m_probe_update.max_distance;
+    ubo.num_cascades                 = m_probe_grid.num_cascades;
     ubo.depth_sharpness              = m_probe_update.depth_sharpness;
     ubo.hysteresis                   = m_probe_update.hysteresis;
     ubo.normal_bias                  = m_probe_update.normal_bias;
@@ -758,6 +1173,8 @@ void DDGI::update_properties_ubo()
     ubo.depth_texture_height         = m_probe_grid.depth_image[0]->height();
     ubo.rays_per_probe               = m_ray_trace.rays_per_probe;
     ubo.visibility_test              = (int32_t)m_probe_grid.visibility_test;
+    ubo.probe_update_offset          = m_ray_trace.probe_update_offset;
+    ubo.probe_update_count           = m_ray_trace.probe_update_count;
 
     uint8_t* ptr = (uint8_t*)m_probe_grid.properties_ubo->mapped_ptr();
     memcpy(ptr + m_probe_grid.properties_ubo_size * backend->current_frame_idx(), &ubo, sizeof(DDGIUniforms));
@@ -765,131 +1182,239 @@ void DDGI::update_properties_ubo()
 
 // -----------------------------------------------------------------------------------------------------------------------------------
 
-void DDGI::ray_trace(dw::vk::CommandBuffer::Ptr cmd_buf)
+void DDGI::setup_render_graph(ManyLights* many_lights)
 {
-    DW_SCOPED_SAMPLE("Ray Trace", cmd_buf);
+    const uint32_t             read_idx    = static_cast<uint32_t>(!m_ping_pong);
+    const uint32_t             write_idx   = static_cast<uint32_t>(m_ping_pong);
+    const VkPipelineStageFlags trace_stage = m_backend_type == RAY_TRACE_BACKEND_RAY_QUERY ? VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT : VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR;
 
-    auto backend = m_backend.lock();
+    m_graph->begin(m_queue_type);
 
-    VkImageSubresourceRange subresource_range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+    m_graph_resources.radiance          = m_graph->import_image(m_ray_trace.radiance_image);
+    m_graph_resources.direction_depth   = m_graph->import_image(m_ray_trace.direction_depth_image);
+    m_graph_resources.probe_data        = m_graph->import_image(m_probe_grid.data_image);
+    m_graph_resources.sample_probe_grid = m_graph->import_image(m_sample_probe_grid.image);
 
-    uint32_t read_idx = static_cast<uint32_t>(!m_ping_pong);
+    for (int i = 0; i < 2; i++)
+    {
+        m_graph_resources.irradiance[i] = m_graph->import_image(m_probe_grid.irradiance_image[i]);
+        m_graph_resources.depth[i]      = m_graph->import_image(m_probe_grid.depth_image[i]);
+    }
 
+    // The probe data is sampled in the general layout, since the passes that write it also read it, so it is declared as a
+    // storage read wherever it is only sampled.
     if (m_first_frame)
     {
-        dw::vk::utilities::set_image_layout(
-            cmd_buf->handle(),
-            m_probe_grid.irradiance_image[read_idx]->handle(),
-            VK_IMAGE_LAYOUT_UNDEFINED,
-            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-            subresource_range);
-
-        dw::vk::utilities::set_image_layout(
-            cmd_buf->handle(),
-            m_probe_grid.depth_image[read_idx]->handle(),
-            VK_IMAGE_LAYOUT_UNDEFINED,
-            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-            subresource_range);
+        // Start out with every probe active and at its grid position.
+        m_graph->add_pass("Clear Probe Data", nullptr)
+            .clear(m_graph_resources.probe_data, glm::vec4(0.0f), RESOURCE_USAGE_STORAGE_READ, trace_stage);
     }
-
+    else
     {
-        std::vector<VkImageMemoryBarrier> image_barriers = {
-            image_memory_barrier(m_ray_trace.radiance_image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, subresource_range, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT),
-            image_memory_barrier(m_ray_trace.direction_depth_image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, subresource_range, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT)
-        };
+        bool scrolled = false;
+
+        for (uint32_t i = 0; i < m_probe_grid.num_cascades; i++)
+            scrolled |= m_probe_grid.scroll_delta[i] != glm::ivec3(0);
 
-        pipeline_barrier(cmd_buf, {}, image_barriers, {}, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR);
+        if (scrolled)
+        {
+            m_graph->add_pass("Probe Scroll", [this](dw::vk::CommandBuffer::Ptr cmd_buf) { probe_scroll(cmd_buf); })
+                .write(m_graph_resources.probe_data);
+        }
     }
 
-    vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, m_ray_trace.pipeline->handle());
+    m_graph->add_pass("Ray Trace", [this, many_lights](dw::vk::CommandBuffer::Ptr cmd_buf) { ray_trace(cmd_buf, many_lights); })
+        .read(m_graph_resources.irradiance[read_idx], RESOURCE_USAGE_SAMPLED, trace_stage)
+        .read(m_graph_resources.depth[read_idx], RESOURCE_USAGE_SAMPLED, trace_stage)
+        .read(m_graph_resources.probe_data, RESOURCE_USAGE_STORAGE_READ, trace_stage)
+        .write(m_graph_resources.radiance, RESOURCE_USAGE_STORAGE_WRITE, trace_stage)
+        .write(m_graph_resources.direction_depth, RESOURCE_USAGE_STORAGE_WRITE, trace_stage);
+
+    // The irradiance and depth probes are independent of each other, so each pair of passes shares a barrier.
+    m_graph->add_pass("Irradiance Probe Update", [this](dw::vk::CommandBuffer::Ptr cmd_buf) { probe_update(cmd_buf, true); })
+        .read(m_graph_resources.irradiance[read_idx])
+        .read(m_graph_resources.probe_data, RESOURCE_USAGE_STORAGE_READ)
+        .read(m_graph_resources.radiance)
+        .read(m_graph_resources.direction_depth)
+        .write(m_graph_resources.irradiance[write_idx]);
+
+    m_graph->add_pass("Depth Probe Update", [this](dw::vk::CommandBuffer::Ptr cmd_buf) { probe_update(cmd_buf, false); })
+        .read(m_graph_resources.depth[read_idx])
+        .read(m_graph_resources.probe_data, RESOURCE_USAGE_STORAGE_READ)
+        .read(m_graph_resources.direction_depth)
+        .write(m_graph_resources.depth[write_idx]);
+
+    m_graph->add_pass("Irradiance Border Update", [this](dw::vk::CommandBuffer::Ptr cmd_buf) { border_update(cmd_buf, true); })
+        .write(m_graph_resources.irradiance[write_idx], RESOURCE_USAGE_STORAGE_READ_WRITE);
+
+    m_graph->add_pass("Depth Border Update", [this](dw::vk::CommandBuffer::Ptr cmd_buf) { border_update(cmd_buf, false); })
+        .write(m_graph_resources.depth[write_idx], RESOURCE_USAGE_STORAGE_READ_WRITE);
+
+    m_graph->add_pass("Probe Classification", [this](dw::vk::CommandBuffer::Ptr cmd_buf) { probe_classification(cmd_buf); })
+        .read(m_graph_resources.direction_depth)
+        .write(m_graph_resources.probe_data, RESOURCE_USAGE_STORAGE_READ_WRITE);
+
+    m_graph->add_pass("Sample Probe Grid", [this](dw::vk::CommandBuffer::Ptr cmd_buf) { sample_probe_grid(cmd_buf); })
+        .read(m_graph_resources.irradiance[write_idx])
+        .read(m_graph_resources.depth[write_idx])
+        .read(m_graph_resources.probe_data, RESOURCE_USAGE_STORAGE_READ)
+        .write(m_graph_resources.sample_probe_grid);
+
+    // The probe grid is read by the shading passes, the probe visualization and the reflections, the sampled irradiance by the
+    // deferred shading only. On the async compute queue the hand-off to the other stages happens through a semaphore.
+    const VkPipelineStageFlags probe_grid_stages = VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+
+    m_graph->export_image(m_graph_resources.irradiance[write_idx], probe_grid_stages);
+    m_graph->export_image(m_graph_resources.depth[write_idx], probe_grid_stages);
+    m_graph->export_image(m_graph_resources.probe_data, probe_grid_stages, RESOURCE_USAGE_STORAGE_READ);
+    m_graph->export_image(m_graph_resources.sample_probe_grid, m_queue_type == QUEUE_TYPE_GRAPHICS ? VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT : VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+}
 
-    RayTracePushConstants push_constants;
+// -----------------------------------------------------------------------------------------------------------------------------------
 
-    push_constants.random_orientation = glm::mat4_cast(glm::angleAxis(m_random_distribution_zo(m_random_generator) * (float(M_PI) * 2.0f), glm::normalize(glm::vec3(m_random_distribution_no(m_random_generator), m_random_distribution_no(m_random_generator), m_random_distribution_no(m_random_generator)))));
-    push_constants.num_frames         = m_common_resources->num_frames;
-    push_constants.infinite_bounces   = m_ray_trace.infinite_bounces && !m_first_frame ? 1u : 0u;
-    push_constants.gi_intensity       = m_ray_trace.infinite_bounce_intensity;
+void DDGI::probe_scroll(dw::vk::CommandBuffer::Ptr cmd_buf)
+{
+    DW_SCOPED_SAMPLE("Probe Scroll", cmd_buf);
+    GPU_SCOPED_TIMER("DDGI Probe Scroll", cmd_buf, m_common_resources->gpu_timer.get());
 
-    vkCmdPushConstants(cmd_buf->handle(), m_ray_trace.pipeline_layout->handle(), VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR, 0, sizeof(push_constants), &push_constants);
+    auto backend = m_backend.lock();
 
-    const uint32_t dynamic_offsets[] = {
-        m_common_resources->ubo_size * backend->current_frame_idx(),
-        m_probe_grid.properties_ubo_size * backend->current_frame_idx()
-    };
+    vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_probe_scroll.pipeline->handle());
+
+    ProbeScrollPushConstants push_constants;
+
+    for (uint32_t i = 0; i < DDGI_MAX_CASCADES; i++)
+        push_constants.scroll_delta[i] = i < m_probe_grid.num_cascades ? glm::ivec4(m_probe_grid.scroll_delta[i], 0) : glm::ivec4(0);
+
+    vkCmdPushConstants(cmd_buf->handle(), m_probe_scroll.pipeline_layout->handle(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_constants), &push_constants);
 
     VkDescriptorSet descriptor_sets[] = {
-        m_common_resources->current_scene()->descriptor_set()->handle(),
-        m_ray_trace.write_ds->handle(),
-        m_common_resources->per_frame_ds->handle(),
-        m_common_resources->current_skybox_ds->handle(),
-        m_probe_grid.read_ds[static_cast<uint32_t>(!m_ping_pong)]->handle(),
+        m_probe_grid.data_write_ds->handle(),
+        m_probe_grid.read_ds[static_cast<uint32_t>(!m_ping_pong)]->handle()
+    };
+
+    const uint32_t dynamic_offsets[] = {
+        m_probe_grid.properties_ubo_size * backend->current_frame_idx()
     };
 
-    vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, m_ray_trace.pipeline_layout->handle(), 0, 5, descriptor_sets, 2, dynamic_offsets);
+    vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_probe_scroll.pipeline_layout->handle(), 0, 2, descriptor_sets, 1, dynamic_offsets);
 
-    auto& rt_pipeline_props = backend->ray_tracing_pipeline_properties();
+    const int NUM_THREADS_X = 32;
 
-    VkDeviceSize group_size   = dw::vk::utilities::aligned_size(rt_pipeline_props.shaderGroupHandleSize, rt_pipeline_props.shaderGroupBaseAlignment);
-    VkDeviceSize group_stride = group_size;
+    vkCmdDispatch(cmd_buf->handle(), static_cast<uint32_t>(ceil(float(num_probes()) / float(NUM_THREADS_X))), 1, 1);
+}
 
-    const VkStridedDeviceAddressRegionKHR raygen_sbt   = { m_ray_trace.pipeline->shader_binding_table_buffer()->device_address(), group_stride, group_size };
-    const VkStridedDeviceAddressRegionKHR miss_sbt     = { m_ray_trace.pipeline->shader_binding_table_buffer()->device_address() + m_ray_trace.sbt->miss_group_offset(), group_stride, group_size };
-    const VkStridedDeviceAddressRegionKHR hit_sbt      = { m_ray_trace.pipeline->shader_binding_table_buffer()->device_address() + m_ray_trace.sbt->hit_group_offset(), group_stride, group_size };
-    const VkStridedDeviceAddressRegionKHR callable_sbt = { 0, 0, 0 };
+// -----------------------------------------------------------------------------------------------------------------------------------
 
-    uint32_t num_total_probes = m_probe_grid.probe_counts.x * m_probe_grid.probe_counts.y * m_probe_grid.probe_counts.z;
+void DDGI::update_ray_order(const glm::mat3& random_orientation)
+{
+    auto backend = m_backend.lock();
 
-    vkCmdTraceRaysKHR(cmd_buf->handle(), &raygen_sbt, &miss_sbt, &hit_sbt, &callable_sbt, m_ray_trace.rays_per_probe, num_total_probes, 1);
+    // Every probe traces the same set of directions from a single origin, so one ordering serves the whole grid. Sorting the
+    // directions by octant keeps the rays that run side by side in a warp pointing the same way. The fixed rays stay in front
+    // so that inactive probes can still skip all of the others at once.
+    uint32_t* ray_order = (uint32_t*)m_ray_trace.ray_order_buffer->mapped_ptr() + m_ray_trace.rays_per_probe * backend->current_frame_idx();
+    uint32_t  idx       = 0;
 
+    for (int range = 0; range < 2; range++)
     {
-        std::vector<VkImageMemoryBarrier> image_barriers = {
-            image_memory_barrier(m_ray_trace.radiance_image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, subresource_range, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT),
-            image_memory_barrier(m_ray_trace.direction_depth_image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, subresource_range, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT)
-        };
+        const int first = range == 0 ? 0 : DDGI_NUM_FIXED_RAYS;
+        const int last  = range == 0 ? DDGI_NUM_FIXED_RAYS : m_ray_trace.rays_per_probe;
+
+        for (uint32_t octant = 0; octant < 8; octant++)
+        {
+            for (int ray_id = first; ray_id < last; ray_id++)
+            {
+                glm::vec3 direction = range == 0 ? spherical_fibonacci(float(ray_id), float(DDGI_NUM_FIXED_RAYS)) : random_orientation * spherical_fibonacci(float(ray_id - DDGI_NUM_FIXED_RAYS), float(m_ray_trace.rays_per_probe - DDGI_NUM_FIXED_RAYS));
 
-        pipeline_barrier(cmd_buf, {}, image_barriers, {}, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+                if ((uint32_t(direction.x >= 0.0f) | (uint32_t(direction.y >= 0.0f) << 1) | (uint32_t(direction.z >= 0.0f) << 2)) == octant)
+                    ray_order[idx++] = ray_id;
+            }
+        }
     }
 }
 
 // -----------------------------------------------------------------------------------------------------------------------------------
 
-void DDGI::probe_update(dw::vk::CommandBuffer::Ptr cmd_buf)
+void DDGI::ray_trace(dw::vk::CommandBuffer::Ptr cmd_buf, ManyLights* many_lights)
 {
-    DW_SCOPED_SAMPLE("Probe Update", cmd_buf);
+    m_timings.update(m_common_resources->gpu_timer.get(), m_backend_type, m_common_resources->num_frames);
 
-    VkImageSubresourceRange subresource_range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+    DW_SCOPED_SAMPLE("Ray Trace", cmd_buf);
+    GPU_SCOPED_TIMER("DDGI Ray Trace", cmd_buf, m_common_resources->gpu_timer.get());
 
-    uint32_t write_idx = static_cast<uint32_t>(m_ping_pong);
+    auto backend = m_backend.lock();
 
-    {
-        std::vector<VkImageMemoryBarrier> image_barriers = {
-            image_memory_barrier(m_probe_grid.irradiance_image[write_idx], VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, subresource_range, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT),
-            image_memory_barrier(m_probe_grid.depth_image[write_idx], VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, subresource_range, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT)
-        };
+    const bool ray_query = m_backend_type == RAY_TRACE_BACKEND_RAY_QUERY;
 
-        pipeline_barrier(cmd_buf, {}, image_barriers, {}, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
-    }
+    const PermutationKey key = permutation_bit(GI_RAY_TRACE_CONSTANT_INFINITE_BOUNCES, m_ray_trace.infinite_bounces && !m_first_frame) |
+                               permutation_bit(GI_RAY_TRACE_CONSTANT_VISIBILITY_TEST, m_probe_grid.visibility_test) |
+                               permutation_bit(GI_RAY_TRACE_CONSTANT_LOW_MEMORY, m_ray_trace.low_memory);
+
+    RayTracePushConstants push_constants;
 
-    probe_update(cmd_buf, true);
-    probe_update(cmd_buf, false);
+    // Kept for the probe update, which recomputes the ray directions in the low memory tier.
+    m_ray_trace.random_orientation = glm::mat4_cast(glm::angleAxis(m_random_distribution_zo(m_random_generator) * (float(M_PI) * 2.0f), glm::normalize(glm::vec3(m_random_distribution_no(m_random_generator), m_random_distribution_no(m_random_generator), m_random_distribution_no(m_random_generator)))));
+    push_constants.random_orientation = m_ray_trace.random_orientation;
+    push_constants.num_frames         = m_common_resources->num_frames;
+    push_constants.gi_intensity       = m_ray_trace.infinite_bounce_intensity;
+    push_constants.ray_binning        = m_ray_trace.ray_binning ? 1u : 0u;
+    push_constants.ray_order_offset   = m_ray_trace.rays_per_probe * backend->current_frame_idx();
 
+    if (m_ray_trace.ray_binning)
+        update_ray_order(glm::mat3(push_constants.random_orientation));
+
+    const uint32_t dynamic_offsets[] = {
+        m_common_resources->ubo_size * backend->current_frame_idx(),
+        m_probe_grid.properties_ubo_size * backend->current_frame_idx(),
+        many_lights->current_ubo_offset(),
+        many_lights->current_lights_offset()
+    };
+
+    VkDescriptorSet descriptor_sets[] = {
+        m_common_resources->current_scene()->descriptor_set()->handle(),
+        m_ray_trace.write_ds->handle(),
+        m_common_resources->per_frame_ds->handle(),
+        m_common_resources->current_skybox_ds->handle(),
+        m_probe_grid.read_ds[static_cast<uint32_t>(!m_ping_pong)]->handle(),
+        many_lights->ds()->handle(),
+        m_common_resources->gpu_counters->current_ds()->handle()
+    };
+
+    if (ray_query)
     {
-        std::vector<VkMemoryBarrier> memory_barriers = {
-            memory_barrier(VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT)
-        };
+        vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_ray_trace.ray_query_permutations->get(key)->handle());
 
-        pipeline_barrier(cmd_buf, memory_barriers, {}, {}, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
-    }
+        vkCmdPushConstants(cmd_buf->handle(), m_ray_trace.ray_query_pipeline_layout->handle(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_constants), &push_constants);
+
+        vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_ray_trace.ray_query_pipeline_layout->handle(), 0, 7, descriptor_sets, 4, dynamic_offsets);
 
-    border_update(cmd_buf);
+        // One workgroup per range of rays of a probe, so that the probe is fetched once per workgroup.
+        const int NUM_THREADS_X = 64;
 
+        vkCmdDispatch(cmd_buf->handle(), static_cast<uint32_t>(ceil(float(m_ray_trace.rays_per_probe) / float(NUM_THREADS_X))), m_ray_trace.probe_update_count, 1);
+    }
+    else
     {
-        std::vector<VkImageMemoryBarrier> image_barriers = {
-            image_memory_barrier(m_probe_grid.irradiance_image[write_idx], VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, subresource_range, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT),
-            image_memory_barrier(m_probe_grid.depth_image[write_idx], VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, subresource_range, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT)
-        };
+        RayTracingPermutation permutation = m_ray_trace.permutations->get(key);
+
+        vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, permutation.pipeline->handle());
+
+        vkCmdPushConstants(cmd_buf->handle(), m_ray_trace.pipeline_layout->handle(), VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR, 0, sizeof(push_constants), &push_constants);
+
+        vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, m_ray_trace.pipeline_layout->handle(), 0, 7, descriptor_sets, 4, dynamic_offsets);
+
+        auto& rt_pipeline_props = backend->ray_tracing_pipeline_properties();
 
-        pipeline_barrier(cmd_buf, {}, image_barriers, {}, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+        VkDeviceSize group_size   = dw::vk::utilities::aligned_size(rt_pipeline_props.shaderGroupHandleSize, rt_pipeline_props.shaderGroupBaseAlignment);
+        VkDeviceSize group_stride = group_size;
+
+        const VkStridedDeviceAddressRegionKHR raygen_sbt   = { permutation.pipeline->shader_binding_table_buffer()->device_address(), group_stride, group_size };
+        const VkStridedDeviceAddressRegionKHR miss_sbt     = { permutation.pipeline->shader_binding_table_buffer()->device_address() + permutation.sbt->miss_group_offset(), group_stride, group_size };
+        const VkStridedDeviceAddressRegionKHR hit_sbt      = { permutation.pipeline->shader_binding_table_buffer()->device_address() + permutation.sbt->hit_group_offset(), group_stride, group_size };
+        const VkStridedDeviceAddressRegionKHR callable_sbt = { 0, 0, 0 };
+
+        vkCmdTraceRaysKHR(cmd_buf->handle(), &raygen_sbt, &miss_sbt, &hit_sbt, &callable_sbt, m_ray_trace.rays_per_probe, m_ray_trace.probe_update_count, 1);
     }
 }
 
@@ -897,20 +1422,19 @@ void DDGI::probe_update(dw::vk::CommandBuffer::Ptr cmd_buf)
 
 void DDGI::probe_update(dw::vk::CommandBuffer::Ptr cmd_buf, bool is_irradiance)
 {
-    DW_SCOPED_SAMPLE(is_irradiance ? "Irradiance" : "Depth", cmd_buf);
+    DW_SCOPED_SAMPLE(is_irradiance ? "Irradiance Probe Update" : "Depth Probe Update", cmd_buf);
+    GPU_SCOPED_TIMER("DDGI Probe Update", cmd_buf, m_common_resources->gpu_timer.get());
 
     auto backend = m_backend.lock();
 
-    VkPipeline pipeline = m_probe_update.pipeline[1]->handle();
-
-    if (is_irradiance)
-        pipeline = m_probe_update.pipeline[0]->handle();
+    const PermutationKey key = permutation_bit(PROBE_UPDATE_CONSTANT_LOW_MEMORY, m_ray_trace.low_memory);
 
-    vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+    vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_probe_update.permutations[is_irradiance ? 0 : 1]->get(key)->handle());
 
     ProbeUpdatePushConstants push_constants;
 
-    push_constants.first_frame = (uint32_t)m_first_frame;
+    push_constants.random_orientation = m_ray_trace.random_orientation;
+    push_constants.first_frame        = (uint32_t)m_first_frame;
 
     vkCmdPushConstants(cmd_buf->handle(), m_probe_update.pipeline_layout->handle(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_constants), &push_constants);
 
@@ -930,26 +1454,17 @@ void DDGI::probe_update(dw::vk::CommandBuffer::Ptr cmd_buf, bool is_irradiance)
     vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_probe_update.pipeline_layout->handle(), 0, 3, descriptor_sets, 1, dynamic_offsets);
 
     const uint32_t dispatch_x = static_cast<uint32_t>(m_probe_grid.probe_counts.x * m_probe_grid.probe_counts.y);
-    const uint32_t dispatch_y = static_cast<uint32_t>(m_probe_grid.probe_counts.z);
+    const uint32_t dispatch_y = static_cast<uint32_t>(m_probe_grid.probe_counts.z * m_probe_grid.num_cascades);
 
     vkCmdDispatch(cmd_buf->handle(), dispatch_x, dispatch_y, 1);
 }
 
 // -----------------------------------------------------------------------------------------------------------------------------------
 
-void DDGI::border_update(dw::vk::CommandBuffer::Ptr cmd_buf)
-{
-    DW_SCOPED_SAMPLE("Border Update", cmd_buf);
-
-    border_update(cmd_buf, true);
-    border_update(cmd_buf, false);
-}
-
-// -----------------------------------------------------------------------------------------------------------------------------------
-
 void DDGI::border_update(dw::vk::CommandBuffer::Ptr cmd_buf, bool is_irradiance)
 {
-    DW_SCOPED_SAMPLE(is_irradiance ? "Irradiance" : "Depth", cmd_buf);
+    DW_SCOPED_SAMPLE(is_irradiance ? "Irradiance Border Update" : "Depth Border Update", cmd_buf);
+    GPU_SCOPED_TIMER("DDGI Border Update", cmd_buf, m_common_resources->gpu_timer.get());
 
     auto backend = m_backend.lock();
 
@@ -969,30 +1484,63 @@ void DDGI::border_update(dw::vk::CommandBuffer::Ptr cmd_buf, bool is_irradiance)
     vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_border_update.pipeline_layout->handle(), 0, 1, descriptor_sets, 0, nullptr);
 
     const uint32_t dispatch_x = static_cast<uint32_t>(m_probe_grid.probe_counts.x * m_probe_grid.probe_counts.y);
-    const uint32_t dispatch_y = static_cast<uint32_t>(m_probe_grid.probe_counts.z);
+    const uint32_t dispatch_y = static_cast<uint32_t>(m_probe_grid.probe_counts.z * m_probe_grid.num_cascades);
 
     vkCmdDispatch(cmd_buf->handle(), dispatch_x, dispatch_y, 1);
 }
 
 // -----------------------------------------------------------------------------------------------------------------------------------
 
-void DDGI::sample_probe_grid(dw::vk::CommandBuffer::Ptr cmd_buf)
+void DDGI::probe_classification(dw::vk::CommandBuffer::Ptr cmd_buf)
 {
-    DW_SCOPED_SAMPLE("Sample Probe Grid", cmd_buf);
+    DW_SCOPED_SAMPLE("Probe Classification", cmd_buf);
+    GPU_SCOPED_TIMER("DDGI Probe Classification", cmd_buf, m_common_resources->gpu_timer.get());
 
     auto backend = m_backend.lock();
 
-    VkImageSubresourceRange subresource_range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+    const PermutationKey key = permutation_bit(PROBE_CLASSIFICATION_CONSTANT_LOW_MEMORY, m_ray_trace.low_memory);
 
-    {
-        std::vector<VkImageMemoryBarrier> image_barriers = {
-            image_memory_barrier(m_sample_probe_grid.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, subresource_range, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT)
-        };
+    vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_probe_classification.permutations->get(key)->handle());
 
-        pipeline_barrier(cmd_buf, {}, image_barriers, {}, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
-    }
+    ProbeClassificationPushConstants push_constants;
+
+    push_constants.relocation             = (uint32_t)m_probe_classification.relocation;
+    push_constants.classification         = (uint32_t)m_probe_classification.classification;
+    push_constants.backface_threshold     = m_probe_classification.backface_threshold;
+    push_constants.min_frontface_distance = m_probe_classification.min_frontface_distance;
+
+    vkCmdPushConstants(cmd_buf->handle(), m_probe_classification.pipeline_layout->handle(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_constants), &push_constants);
+
+    VkDescriptorSet descriptor_sets[] = {
+        m_probe_grid.data_write_ds->handle(),
+        m_probe_grid.read_ds[static_cast<uint32_t>(m_ping_pong)]->handle(),
+        m_ray_trace.read_ds->handle()
+    };
 
-    vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_sample_probe_grid.pipeline->handle());
+    const uint32_t dynamic_offsets[] = {
+        m_probe_grid.properties_ubo_size * backend->current_frame_idx()
+    };
+
+    vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_probe_classification.pipeline_layout->handle(), 0, 3, descriptor_sets, 1, dynamic_offsets);
+
+    const int NUM_THREADS_X = 32;
+
+    vkCmdDispatch(cmd_buf->handle(), static_cast<uint32_t>(ceil(float(m_ray_trace.probe_update_count) / float(NUM_THREADS_X))), 1, 1);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void DDGI::sample_probe_grid(dw::vk::CommandBuffer::Ptr cmd_buf)
+{
+    DW_SCOPED_SAMPLE("Sample Probe Grid", cmd_buf);
+    GPU_SCOPED_TIMER("DDGI Sample Probe Grid", cmd_buf, m_common_resources->gpu_timer.get());
+
+    auto backend = m_backend.lock();
+
+    const PermutationKey key = permutation_bit(SAMPLE_PROBE_GRID_CONSTANT_VISIBILITY_TEST, m_probe_grid.visibility_test) |
+                               permutation_bit(SAMPLE_PROBE_GRID_CONSTANT_LOW_MEMORY, m_sample_probe_grid.low_memory);
+
+    vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_sample_probe_grid.permutations->get(key)->handle());
 
     SampleProbeGridPushConstants push_constants;
 
@@ -1019,14 +1567,6 @@ void DDGI::sample_probe_grid(dw::vk::CommandBuffer::Ptr cmd_buf)
     const int NUM_THREADS_Y = 32;
 
     vkCmdDispatch(cmd_buf->handle(), static_cast<uint32_t>(ceil(float(m_sample_probe_grid.image->width()) / float(NUM_THREADS_X))), static_cast<uint32_t>(ceil(float(m_sample_probe_grid.image->height()) / float(NUM_THREADS_Y))), 1);
-
-    {
-        std::vector<VkImageMemoryBarrier> image_barriers = {
-            image_memory_barrier(m_sample_probe_grid.image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, subresource_range, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT)
-        };
-
-        pipeline_barrier(cmd_buf, {}, image_barriers, {}, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
-    }
 }
 
 // -----------------------------------------------------------------------------------------------------------------------------------
\ No newline at end of file
@@ -1,10 +1,19 @@
 #pragma once
 
 #include "common.h"
+#include "pipeline_permutations.h"
+#include "render_graph.h"
 
 #include <random>
 
+// Must match the number of fixed rays in gi_common.glsl. They are traced first for every probe, and are the only rays traced
+// for inactive probes.
+#define DDGI_NUM_FIXED_RAYS 32
+// Must match gi_common.glsl.
+#define DDGI_MAX_CASCADES 4
+
 class GBuffer;
+class ManyLights;
 
 class DDGI
 {
@@ -12,59 +21,84 @@ public:
     DDGI(std::weak_ptr<dw::vk::Backend> backend, CommonResources* common_resources, GBuffer* g_buffer, RayTraceScale scale = RAY_TRACE_SCALE_FULL_RES);
     ~DDGI();
 
-    void                       render(dw::vk::CommandBuffer::Ptr cmd_buf);
+    void                       render(dw::vk::CommandBuffer::Ptr cmd_buf, ManyLights* many_lights);
     void                       gui();
+    void                       set_scale(RayTraceScale scale);
+    void                       set_precision(RenderTargetPrecision precision);
     dw::vk::DescriptorSet::Ptr output_ds();
     dw::vk::DescriptorSet::Ptr current_read_ds();
     uint32_t                   current_ubo_offset();
 
-    inline uint32_t      width() { return m_width; }
-    inline uint32_t      height() { return m_height; }
-    inline RayTraceScale scale() { return m_scale; }
-    inline glm::ivec3    probe_counts() { return m_probe_grid.probe_counts; }
-    inline float         normal_bias() { return m_probe_update.normal_bias; }
-    inline float         probe_distance() { return m_probe_grid.probe_distance; }
-    inline float         infinite_bounce_intensity() { return m_ray_trace.infinite_bounce_intensity; }
-    inline float         gi_intensity() { return m_sample_probe_grid.gi_intensity; }
-    inline void          set_normal_bias(float value) { m_probe_update.normal_bias = value; }
-    inline void          set_probe_distance(float value) { m_probe_grid.probe_distance = value; }
-    inline void          set_infinite_bounce_intensity(float value) { m_ray_trace.infinite_bounce_intensity = value; }
-    inline void          set_gi_intensity(float value) { m_sample_probe_grid.gi_intensity = value; }
-    inline void          restart_accumulation() { m_first_frame = true; }
+    inline uint32_t              width() { return m_width; }
+    inline uint32_t              height() { return m_height; }
+    inline RayTraceScale         scale() { return m_scale; }
+    inline RenderTargetPrecision precision() { return m_precision; }
+    inline glm::ivec3            probe_counts() { return m_probe_grid.probe_counts; }
+    inline uint32_t              num_cascades() { return m_probe_grid.num_cascades; }
+    inline uint32_t              num_probes() { return m_probe_grid.probe_counts.x * m_probe_grid.probe_counts.y * m_probe_grid.probe_counts.z * m_probe_grid.num_cascades; }
+    inline float                 normal_bias() { return m_probe_update.normal_bias; }
+    inline float                 probe_distance() { return m_probe_grid.probe_distance; }
+    inline float                 infinite_bounce_intensity() { return m_ray_trace.infinite_bounce_intensity; }
+    inline float                 gi_intensity() { return m_sample_probe_grid.gi_intensity; }
+    inline bool                  visibility_test() { return m_probe_grid.visibility_test; }
+    inline RayTraceBackend       ray_trace_backend() { return m_backend_type; }
+    inline QueueType             queue_type() { return m_queue_type; }
+    inline void                  set_queue_type(QueueType queue_type) { m_queue_type = queue_type; }
+    inline RenderGraph*          render_graph() { return m_graph.get(); }
+    inline void                  set_ray_trace_backend(RayTraceBackend backend) { m_backend_type = backend; }
+    inline void                  set_normal_bias(float value) { m_probe_update.normal_bias = value; }
+    inline void                  set_probe_distance(float value) { m_probe_grid.probe_distance = value; }
+    inline void                  set_infinite_bounce_intensity(float value) { m_ray_trace.infinite_bounce_intensity = value; }
+    inline void                  set_gi_intensity(float value) { m_sample_probe_grid.gi_intensity = value; }
+    inline void                  restart_accumulation() { m_first_frame = true; }
 
 private:
     void initialize_probe_grid();
+    void update_resolution();
     void create_images();
     void create_buffers();
+    void create_descriptor_set_layouts();
     void create_descriptor_sets();
     void write_descriptor_sets();
     void create_pipelines();
+    void retire_resources();
     void recreate_probe_grid_resources();
+    void update_cascades();
     void update_properties_ubo();
-    void ray_trace(dw::vk::CommandBuffer::Ptr cmd_buf);
-    void probe_update(dw::vk::CommandBuffer::Ptr cmd_buf);
+    void setup_render_graph(ManyLights* many_lights);
+    void probe_scroll(dw::vk::CommandBuffer::Ptr cmd_buf);
+    void update_ray_order(const glm::mat3& random_orientation);
+    void ray_trace(dw::vk::CommandBuffer::Ptr cmd_buf, ManyLights* many_lights);
     void probe_update(dw::vk::CommandBuffer::Ptr cmd_buf, bool is_irradiance);
-    void border_update(dw::vk::CommandBuffer::Ptr cmd_buf);
     void border_update(dw::vk::CommandBuffer::Ptr cmd_buf, bool is_irradiance);
+    void probe_classification(dw::vk::CommandBuffer::Ptr cmd_buf);
     void sample_probe_grid(dw::vk::CommandBuffer::Ptr cmd_buf);
 
 private:
     struct RayTrace
     {
-        bool                             infinite_bounces          = true;
-        float                            infinite_bounce_intensity = 1.7f;
-        int32_t                          rays_per_probe            = 256;
-        dw::vk::DescriptorSet::Ptr       write_ds;
-        dw::vk::DescriptorSet::Ptr       read_ds;
-        dw::vk::DescriptorSetLayout::Ptr write_ds_layout;
-        dw::vk::DescriptorSetLayout::Ptr read_ds_layout;
-        dw::vk::RayTracingPipeline::Ptr  pipeline;
-        dw::vk::PipelineLayout::Ptr      pipeline_layout;
-        dw::vk::Image::Ptr               radiance_image;
-        dw::vk::Image::Ptr               direction_depth_image;
-        dw::vk::ImageView::Ptr           radiance_view;
-        dw::vk::ImageView::Ptr           direction_depth_view;
-        dw::vk::ShaderBindingTable::Ptr  sbt;
+        bool                                            infinite_bounces          = true;
+        bool                                            ray_binning               = false;
+        bool                                            low_memory                = false;
+        float                                           infinite_bounce_intensity = 1.7f;
+        int32_t                                         rays_per_probe            = 256;
+        int32_t                                         ray_budget                = 256 * 2048;
+        uint32_t                                        probe_update_offset       = 0;
+        uint32_t                                        probe_update_count        = 0;
+        glm::mat4                                       random_orientation        = glm::mat4(1.0f);
+        dw::vk::DescriptorSet::Ptr                      write_ds;
+        dw::vk::DescriptorSet::Ptr                      read_ds;
+        dw::vk::DescriptorSetLayout::Ptr                write_ds_layout;
+        dw::vk::DescriptorSetLayout::Ptr                read_ds_layout;
+        dw::vk::PipelineLayout::Ptr                     pipeline_layout;
+        dw::vk::PipelineLayout::Ptr                     ray_query_pipeline_layout;
+        dw::vk::Image::Ptr                              radiance_image;
+        dw::vk::Image::Ptr                              direction_depth_image;
+        dw::vk::ImageView::Ptr                          radiance_view;
+        dw::vk::ImageView::Ptr                          direction_depth_view;
+        dw::vk::Buffer::Ptr                             ray_order_buffer; // Rays of a probe sorted by direction octant, one list per frame in flight
+        std::unique_ptr<RayTracingPipelinePermutations> permutations;
+        std::unique_ptr<ComputePipelinePermutations>    ray_query_permutations;
     };
 
     struct ProbeGrid
@@ -74,8 +108,15 @@ private:
         float                            recursive_energy_preservation = 0.85f;
         uint32_t                         irradiance_oct_size           = 8;
         uint32_t                         depth_oct_size                = 16;
-        glm::vec3                        grid_start_position;
+        int32_t                          max_cascades                  = DDGI_MAX_CASCADES;
+        glm::ivec3                       max_probe_counts              = glm::ivec3(24, 12, 24);
+        uint32_t                         num_cascades                  = 1;
+        glm::vec3                        scene_min_extents;
+        glm::vec3                        scene_max_extents;
         glm::ivec3                       probe_counts;
+        glm::ivec3                       cascade_origin[DDGI_MAX_CASCADES];
+        glm::ivec3                       scroll_offset[DDGI_MAX_CASCADES];
+        glm::ivec3                       scroll_delta[DDGI_MAX_CASCADES];
         dw::vk::DescriptorSet::Ptr       write_ds[2];
         dw::vk::DescriptorSet::Ptr       read_ds[2];
         dw::vk::DescriptorSetLayout::Ptr write_ds_layout;
@@ -83,35 +124,65 @@ private:
         dw::vk::Image::Ptr               depth_image[2];
         dw::vk::ImageView::Ptr           irradiance_view[2];
         dw::vk::ImageView::Ptr           depth_view[2];
+        dw::vk::Image::Ptr               data_image;
+        dw::vk::ImageView::Ptr           data_view;
+        dw::vk::DescriptorSet::Ptr       data_write_ds;
         dw::vk::Buffer::Ptr              properties_ubo;
         size_t                           properties_ubo_size;
     };
 
     struct ProbeUpdate
     {
-        float                        hysteresis      = 0.98f;
-        float                        depth_sharpness = 50.0f;
-        float                        max_distance    = 4.0f;
-        float                        normal_bias     = 0.25f;
-        dw::vk::ComputePipeline::Ptr pipeline[2];
-        dw::vk::PipelineLayout::Ptr  pipeline_layout;
+        float                                        hysteresis      = 0.98f;
+        float                                        depth_sharpness = 50.0f;
+        float                                        max_distance    = 4.0f;
+        float                                        normal_bias     = 0.25f;
+        std::unique_ptr<ComputePipelinePermutations> permutations[2];
+        dw::vk::PipelineLayout::Ptr                  pipeline_layout;
     };
 
     struct SampleProbeGrid
     {
-        float                        gi_intensity = 1.0f;
-        dw::vk::Image::Ptr           image;
-        dw::vk::ImageView::Ptr       image_view;
-        dw::vk::ComputePipeline::Ptr pipeline;
-        dw::vk::PipelineLayout::Ptr  pipeline_layout;
-        dw::vk::DescriptorSet::Ptr   write_ds;
-        dw::vk::DescriptorSet::Ptr   read_ds;
+        float                                        gi_intensity = 1.0f;
+        bool                                         low_memory   = false;
+        dw::vk::Image::Ptr                           image;
+        dw::vk::ImageView::Ptr                       image_view;
+        dw::vk::PipelineLayout::Ptr                  pipeline_layout;
+        dw::vk::DescriptorSet::Ptr                   write_ds;
+        dw::vk::DescriptorSet::Ptr                   read_ds;
+        std::unique_ptr<ComputePipelinePermutations> permutations;
     };
 
     struct BorderUpdate
     {
-        dw::vk::ComputePipeline::Ptr pipeline[2];
-        dw::vk::PipelineLayout::Ptr  pipeline_layout;
+        CachedComputePipeline::Ptr  pipeline[2];
+        dw::vk::PipelineLayout::Ptr pipeline_layout;
+    };
+
+    struct ProbeScroll
+    {
+        CachedComputePipeline::Ptr  pipeline;
+        dw::vk::PipelineLayout::Ptr pipeline_layout;
+    };
+
+    struct ProbeClassification
+    {
+        bool                                         relocation             = true;
+        bool                                         classification         = true;
+        float                                        backface_threshold     = 0.25f;
+        float                                        min_frontface_distance = 0.2f;
+        std::unique_ptr<ComputePipelinePermutations> permutations;
+        dw::vk::PipelineLayout::Ptr                  pipeline_layout;
+    };
+
+    struct GraphResources
+    {
+        RenderGraph::ImageHandle radiance;
+        RenderGraph::ImageHandle direction_depth;
+        RenderGraph::ImageHandle irradiance[2];
+        RenderGraph::ImageHandle depth[2];
+        RenderGraph::ImageHandle probe_data;
+        RenderGraph::ImageHandle sample_probe_grid;
     };
 
     uint32_t                              m_last_scene_id = UINT32_MAX;
@@ -119,6 +190,10 @@ private:
     CommonResources*                      m_common_resources;
     GBuffer*                              m_g_buffer;
     RayTraceScale                         m_scale;
+    RayTraceBackend                       m_backend_type = RAY_TRACE_BACKEND_PIPELINE;
+    QueueType                             m_queue_type   = QUEUE_TYPE_GRAPHICS;
+    RayTraceBackendTimings                m_timings      = RayTraceBackendTimings("DDGI Ray Trace");
+    RenderTargetPrecision                 m_precision = RENDER_TARGET_PRECISION_FULL;
     uint32_t                              m_g_buffer_mip = 0;
     uint32_t                              m_width;
     uint32_t                              m_height;
@@ -132,5 +207,9 @@ private:
     ProbeGrid                             m_probe_grid;
     ProbeUpdate                           m_probe_update;
     BorderUpdate                          m_border_update;
+    ProbeScroll                           m_probe_scroll;
+    ProbeClassification                   m_probe_classification;
     SampleProbeGrid                       m_sample_probe_grid;
+    std::unique_ptr<RenderGraph>          m_graph;
+    GraphResources                        m_graph_resources;
 };
\ No newline at end of file
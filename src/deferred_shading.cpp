@@ -4,6 +4,7 @@
 #include "ray_traced_reflections.h"
 #include "g_buffer.h"
 #include "ddgi.h"
+#include "many_lights.h"
 #include "utilities.h"
 #include <profiler.h>
 #include <macros.h>
@@ -12,12 +13,15 @@
 
 // -----------------------------------------------------------------------------------------------------------------------------------
 
-struct ShadingPushConstants
+// Specialization constant ids of deferred.frag, which are also the bits of a shading permutation key.
+enum ShadingConstant
 {
-    int shadows     = 1;
-    int ao          = 1;
-    int reflections = 1;
-    int gi          = 1;
+    SHADING_CONSTANT_RAY_TRACED_SHADOWS,
+    SHADING_CONSTANT_RAY_TRACED_AO,
+    SHADING_CONSTANT_RAY_TRACED_REFLECTIONS,
+    SHADING_CONSTANT_DDGI,
+    SHADING_CONSTANT_LOCAL_LIGHTS,
+    SHADING_CONSTANT_COUNT
 };
 
 // -----------------------------------------------------------------------------------------------------------------------------------
@@ -62,11 +66,13 @@ void DeferredShading::render(dw::vk::CommandBuffer::Ptr cmd_buf,
                              RayTracedAO*               ao,
                              RayTracedShadows*          shadows,
                              RayTracedReflections*      reflections,
-                             DDGI*                      ddgi)
+                             DDGI*                      ddgi,
+                             ManyLights*                many_lights)
 {
     DW_SCOPED_SAMPLE("Deferred Shading", cmd_buf);
+    GPU_SCOPED_TIMER("Deferred Shading", cmd_buf, m_common_resources->gpu_timer.get());
 
-    render_shading(cmd_buf, ao, shadows, reflections, ddgi);
+    render_shading(cmd_buf, ao, shadows, reflections, ddgi, many_lights);
     render_skybox(cmd_buf, ddgi);
 }
 
@@ -266,8 +272,8 @@ void DeferredShading::create_images()
 {
     auto vk_backend = m_backend.lock();
 
-    m_width  = vk_backend->swap_chain_extents().width;
-    m_height = vk_backend->swap_chain_extents().height;
+    m_width  = m_common_resources->render_width;
+    m_height = m_common_resources->render_height;
 
     // Shading
     {
@@ -483,10 +489,128 @@ void DeferredShading::create_pipeline()
         desc.add_descriptor_set_layout(m_common_resources->combined_sampler_ds_layout);
         desc.add_descriptor_set_layout(m_common_resources->per_frame_ds_layout);
         desc.add_descriptor_set_layout(m_common_resources->skybox_ds_layout);
-        desc.add_push_constant_range(VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(ShadingPushConstants));
+        desc.add_descriptor_set_layout(m_common_resources->lights_ds_layout);
 
         m_shading.pipeline_layout = dw::vk::PipelineLayout::create(vk_backend, desc);
-        m_shading.pipeline        = dw::vk::GraphicsPipeline::create_for_post_process(vk_backend, "shaders/triangle.vert.spv", "shaders/deferred.frag.spv", m_shading.pipeline_layout, m_shading.rp);
+
+        dw::vk::ShaderModule::Ptr vs = dw::vk::ShaderModule::create_from_file(vk_backend, "shaders/triangle.vert.spv");
+        dw::vk::ShaderModule::Ptr fs = dw::vk::ShaderModule::create_from_file(vk_backend, "shaders/deferred.frag.spv");
+
+        std::weak_ptr<dw::vk::Backend> backend = m_backend;
+
+        m_shading.permutations = std::unique_ptr<GraphicsPipelinePermutations>(new GraphicsPipelinePermutations(SHADING_CONSTANT_COUNT, [this, backend, vs, fs](const VkSpecializationInfo* specialization_info) {
+            auto vk_backend = backend.lock();
+
+            dw::vk::GraphicsPipeline::Desc pso_desc;
+
+            pso_desc.add_shader_stage(VK_SHADER_STAGE_VERTEX_BIT, vs, "main")
+                .add_shader_stage(VK_SHADER_STAGE_FRAGMENT_BIT, fs, "main");
+
+            // The framework does not take specialization info, it is set on the fragment stage once it has been added.
+            pso_desc.shader_stages[1].pSpecializationInfo = specialization_info;
+
+            // ---------------------------------------------------------------------------
+            // Create vertex input state
+            // ---------------------------------------------------------------------------
+
+            dw::vk::VertexInputStateDesc vertex_input_state_desc;
+
+            pso_desc.set_vertex_input_state(vertex_input_state_desc);
+
+            // ---------------------------------------------------------------------------
+            // Create pipeline input assembly state
+            // ---------------------------------------------------------------------------
+
+            dw::vk::InputAssemblyStateDesc input_assembly_state_desc;
+
+            input_assembly_state_desc.set_primitive_restart_enable(false)
+                .set_topology(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
+
+            pso_desc.set_input_assembly_state(input_assembly_state_desc);
+
+            // ---------------------------------------------------------------------------
+            // Create viewport state
+            // ---------------------------------------------------------------------------
+
+            dw::vk::ViewportStateDesc vp_desc;
+
+            vp_desc.add_viewport(0.0f, 0.0f, m_width, m_height, 0.0f, 1.0f)
+                .add_scissor(0, 0, m_width, m_height);
+
+            pso_desc.set_viewport_state(vp_desc);
+
+            // ---------------------------------------------------------------------------
+            // Create rasterization state
+            // ---------------------------------------------------------------------------
+
+            dw::vk::RasterizationStateDesc rs_state;
+
+            rs_state.set_depth_clamp(VK_FALSE)
+                .set_rasterizer_discard_enable(VK_FALSE)
+                .set_polygon_mode(VK_POLYGON_MODE_FILL)
+                .set_line_width(1.0f)
+                .set_cull_mode(VK_CULL_MODE_NONE)
+                .set_front_face(VK_FRONT_FACE_COUNTER_CLOCKWISE)
+                .set_depth_bias(VK_FALSE);
+
+            pso_desc.set_rasterization_state(rs_state);
+
+            // ---------------------------------------------------------------------------
+            // Create multisample state
+            // ---------------------------------------------------------------------------
+
+            dw::vk::MultisampleStateDesc ms_state;
+
+            ms_state.set_sample_shading_enable(VK_FALSE)
+                .set_rasterization_samples(VK_SAMPLE_COUNT_1_BIT);
+
+            pso_desc.set_multisample_state(ms_state);
+
+            // ---------------------------------------------------------------------------
+            // Create depth stencil state
+            // ---------------------------------------------------------------------------
+
+            dw::vk::DepthStencilStateDesc ds_state;
+
+            ds_state.set_depth_test_enable(VK_FALSE)
+                .set_depth_write_enable(VK_FALSE)
+                .set_depth_compare_op(VK_COMPARE_OP_ALWAYS)
+                .set_depth_bounds_test_enable(VK_FALSE)
+                .set_stencil_test_enable(VK_FALSE);
+
+            pso_desc.set_depth_stencil_state(ds_state);
+
+            // ---------------------------------------------------------------------------
+            // Create color blend state
+            // ---------------------------------------------------------------------------
+
+            dw::vk::ColorBlendAttachmentStateDesc blend_att_desc;
+
+            blend_att_desc.set_color_write_mask(VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT)
+                .set_blend_enable(VK_FALSE);
+
+            dw::vk::ColorBlendStateDesc blend_state;
+
+            blend_state.set_logic_op_enable(VK_FALSE)
+                .set_logic_op(VK_LOGIC_OP_COPY)
+                .set_blend_constants(0.0f, 0.0f, 0.0f, 0.0f)
+                .add_attachment(blend_att_desc);
+
+            pso_desc.set_color_blend_state(blend_state);
+
+            // ---------------------------------------------------------------------------
+            // Create pipeline
+            // ---------------------------------------------------------------------------
+
+            pso_desc.set_pipeline_layout(m_shading.pipeline_layout);
+
+            pso_desc.add_dynamic_state(VK_DYNAMIC_STATE_VIEWPORT)
+                .add_dynamic_state(VK_DYNAMIC_STATE_SCISSOR);
+
+            pso_desc.set_render_pass(m_shading.rp);
+
+            return dw::vk::GraphicsPipeline::create(vk_backend, pso_desc);
+        }));
     }
 
     // Skybox
@@ -664,8 +788,8 @@ void DeferredShading::create_pipeline()
 
         dw::vk::ViewportStateDesc vp_desc;
 
-        vp_desc.add_viewport(0.0f, 0.0f, vk_backend->swap_chain_extents().width, vk_backend->swap_chain_extents().height, 0.0f, 1.0f)
-            .add_scissor(0, 0, vk_backend->swap_chain_extents().width, vk_backend->swap_chain_extents().height);
+        vp_desc.add_viewport(0.0f, 0.0f, m_common_resources->render_width, m_common_resources->render_height, 0.0f, 1.0f)
+            .add_scissor(0, 0, m_common_resources->render_width, m_common_resources->render_height);
 
         pso_desc.set_viewport_state(vp_desc);
 
@@ -765,7 +889,8 @@ void DeferredShading::render_shading(dw::vk::CommandBuffer::Ptr cmd_buf,
                                      RayTracedAO*               ao,
                                      RayTracedShadows*          shadows,
                                      RayTracedReflections*      reflections,
-                                     DDGI*                      ddgi)
+                                     DDGI*                      ddgi,
+                                     ManyLights*                many_lights)
 {
     DW_SCOPED_SAMPLE("Opaque", cmd_buf);
 
@@ -809,18 +934,19 @@ void DeferredShading::render_shading(dw::vk::CommandBuffer::Ptr cmd_buf,
 
     vkCmdSetScissor(cmd_buf->handle(), 0, 1, &scissor_rect);
 
-    vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_GRAPHICS, m_shading.pipeline->handle());
-
-    ShadingPushConstants push_constants;
+    const PermutationKey key = permutation_bit(SHADING_CONSTANT_RAY_TRACED_SHADOWS, m_shading.use_ray_traced_shadows) |
+                               permutation_bit(SHADING_CONSTANT_RAY_TRACED_AO, m_shading.use_ray_traced_ao) |
+                               permutation_bit(SHADING_CONSTANT_RAY_TRACED_REFLECTIONS, m_shading.use_ray_traced_reflections) |
+                               permutation_bit(SHADING_CONSTANT_DDGI, m_shading.use_ddgi) |
+                               permutation_bit(SHADING_CONSTANT_LOCAL_LIGHTS, m_shading.use_local_lights && many_lights->num_lights() > 0);
 
-    push_constants.shadows     = (float)m_shading.use_ray_traced_shadows;
-    push_constants.ao          = (float)m_shading.use_ray_traced_ao;
-    push_constants.reflections = (float)m_shading.use_ray_traced_reflections;
-    push_constants.gi          = (float)m_shading.use_ddgi;
+    vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_GRAPHICS, m_shading.permutations->get(key)->handle());
 
-    vkCmdPushConstants(cmd_buf->handle(), m_shading.pipeline_layout->handle(), VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(push_constants), &push_constants);
-
-    const uint32_t dynamic_offset = m_common_resources->ubo_size * vk_backend->current_frame_idx();
+    const uint32_t dynamic_offsets[] = {
+        m_common_resources->ubo_size * vk_backend->current_frame_idx(),
+        many_lights->current_ubo_offset(),
+        many_lights->current_lights_offset()
+    };
 
     VkDescriptorSet descriptor_sets[] = {
         m_g_buffer->output_ds()->handle(),
@@ -829,10 +955,11 @@ void DeferredShading::render_shading(dw::vk::CommandBuffer::Ptr cmd_buf,
         reflections->output_ds()->handle(),
         ddgi->output_ds()->handle(),
         m_common_resources->per_frame_ds->handle(),
-        m_common_resources->current_skybox_ds->handle()
+        m_common_resources->current_skybox_ds->handle(),
+        many_lights->ds()->handle()
     };
 
-    vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_GRAPHICS, m_shading.pipeline_layout->handle(), 0, 7, descriptor_sets, 1, &dynamic_offset);
+    vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_GRAPHICS, m_shading.pipeline_layout->handle(), 0, 8, descriptor_sets, 3, dynamic_offsets);
 
     vkCmdDraw(cmd_buf->handle(), 3, 1, 0, 0);
 
@@ -950,7 +1077,7 @@ void DeferredShading::render_probes(dw::vk::CommandBuffer::Ptr cmd_buf, DDGI* dd
 
         vkCmdPushConstants(cmd_buf->handle(), m_visualize_probe_grid.pipeline_layout->handle(), VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(push_constants), &push_constants);
 
-        uint32_t probe_count = ddgi->probe_counts().x * ddgi->probe_counts().y * ddgi->probe_counts().z;
+        uint32_t probe_count = ddgi->num_probes();
 
         // Issue draw call.
         vkCmdDrawIndexed(cmd_buf->handle(), submesh.index_count, probe_count, submesh.base_index, submesh.base_vertex, 0);
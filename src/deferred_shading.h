@@ -5,6 +5,7 @@
 #include <cubemap_sh_projection.h>
 #include <cubemap_prefilter.h>
 #include <mesh.h>
+#include "pipeline_permutations.h"
 
 struct CommonResources;
 class GBuffer;
@@ -12,6 +13,7 @@ class RayTracedAO;
 class RayTracedShadows;
 class RayTracedReflections;
 class DDGI;
+class ManyLights;
 
 class DeferredShading
 {
@@ -23,7 +25,8 @@ public:
                 RayTracedAO*               ao,
                 RayTracedShadows*          shadows,
                 RayTracedReflections*      reflections,
-                DDGI*                      ddhgi);
+                DDGI*                      ddhgi,
+                ManyLights*                many_lights);
 
     dw::vk::DescriptorSet::Ptr output_ds();
     dw::vk::Image::Ptr         output_image();
@@ -32,12 +35,14 @@ public:
     inline bool  use_ray_traced_shadows() { return m_shading.use_ray_traced_shadows; }
     inline bool  use_ray_traced_reflections() { return m_shading.use_ray_traced_reflections; }
     inline bool  use_ddgi() { return m_shading.use_ddgi; }
+    inline bool  use_local_lights() { return m_shading.use_local_lights; }
     inline bool  visualize_probe_grid() { return m_visualize_probe_grid.enabled; }
     inline float probe_visualization_scale() { return m_visualize_probe_grid.scale; }
     inline void  set_use_ray_traced_ao(bool value) { m_shading.use_ray_traced_ao = value; }
     inline void  set_use_ray_traced_shadows(bool value) { m_shading.use_ray_traced_shadows = value; }
     inline void  set_use_ray_traced_reflections(bool value) { m_shading.use_ray_traced_reflections = value; }
     inline void  set_use_ddgi(bool value) { m_shading.use_ddgi = value; }
+    inline void  set_use_local_lights(bool value) { m_shading.use_local_lights = value; }
     inline void  set_visualize_probe_grid(bool value) { m_visualize_probe_grid.enabled = value; }
     inline void  set_probe_visualization_scale(float value) { m_visualize_probe_grid.scale = value; }
 
@@ -54,7 +59,8 @@ private:
                         RayTracedAO*               ao,
                         RayTracedShadows*          shadows,
                         RayTracedReflections*      reflections,
-                        DDGI*                      ddgi);
+                        DDGI*                      ddgi,
+                        ManyLights*                many_lights);
     void render_skybox(dw::vk::CommandBuffer::Ptr cmd_buf, DDGI* ddgi);
     void render_probes(dw::vk::CommandBuffer::Ptr cmd_buf, DDGI* ddgi);
 
@@ -76,17 +82,18 @@ private:
 
     struct Shading
     {
-        bool                          use_ray_traced_ao          = true;
-        bool                          use_ray_traced_shadows     = true;
-        bool                          use_ray_traced_reflections = true;
-        bool                          use_ddgi                   = true;
-        dw::vk::RenderPass::Ptr       rp;
-        dw::vk::Framebuffer::Ptr      fbo;
-        dw::vk::Image::Ptr            image;
-        dw::vk::ImageView::Ptr        view;
-        dw::vk::GraphicsPipeline::Ptr pipeline;
-        dw::vk::PipelineLayout::Ptr   pipeline_layout;
-        dw::vk::DescriptorSet::Ptr    read_ds;
+        bool                                          use_ray_traced_ao          = true;
+        bool                                          use_ray_traced_shadows     = true;
+        bool                                          use_ray_traced_reflections = true;
+        bool                                          use_ddgi                   = true;
+        bool                                          use_local_lights           = true;
+        dw::vk::RenderPass::Ptr                       rp;
+        dw::vk::Framebuffer::Ptr                      fbo;
+        dw::vk::Image::Ptr                            image;
+        dw::vk::ImageView::Ptr                        view;
+        std::unique_ptr<GraphicsPipelinePermutations> permutations;
+        dw::vk::PipelineLayout::Ptr                   pipeline_layout;
+        dw::vk::DescriptorSet::Ptr                    read_ds;
     };
 
     struct Skybox
@@ -0,0 +1,42 @@
+#include "deletion_queue.h"
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+DeletionQueue::DeletionQueue()
+{
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+DeletionQueue::~DeletionQueue()
+{
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void DeletionQueue::push(std::initializer_list<std::shared_ptr<void>> objects)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    for (const auto& object : objects)
+    {
+        if (object)
+            m_entries.push_back({ object, m_current_frame });
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void DeletionQueue::begin_frame()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_current_frame++;
+
+    // An object pushed while recording frame N was last used by frame N - 1, whose fence has been waited on by the time frame
+    // N - 1 + kMaxFramesInFlight begins.
+    while (m_entries.size() > 0 && (m_current_frame - m_entries.front().frame) >= dw::vk::Backend::kMaxFramesInFlight)
+        m_entries.pop_front();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
\ No newline at end of file
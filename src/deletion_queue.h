@@ -0,0 +1,31 @@
+#pragma once
+
+#include <vk.h>
+#include <deque>
+#include <mutex>
+
+// Keeps GPU objects alive until every frame that could still reference them has finished executing. Resources that are
+// replaced while frames are in flight are pushed here instead of being released in place, which avoids idling the device. Jobs
+// recorded on worker threads may push at the same time.
+class DeletionQueue
+{
+public:
+    DeletionQueue();
+    ~DeletionQueue();
+
+    void push(std::initializer_list<std::shared_ptr<void>> objects);
+    void begin_frame();
+
+    inline size_t size() { return m_entries.size(); }
+
+private:
+    struct Entry
+    {
+        std::shared_ptr<void> object;
+        uint64_t              frame;
+    };
+
+    std::deque<Entry> m_entries;
+    uint64_t          m_current_frame = 0;
+    std::mutex        m_mutex;
+};
@@ -0,0 +1,138 @@
+#include "dynamic_resolution.h"
+#include <imgui.h>
+#include <algorithm>
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Names of the outermost GPU timer scope of each effect.
+static const char* kEffectTimerNames[] = {
+    "Shadows",
+    "Ambient Occlusion",
+    "Reflections"
+};
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+DynamicResolution::DynamicResolution()
+{
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+DynamicResolution::~DynamicResolution()
+{
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool DynamicResolution::update(GPUTimer* gpu_timer, RayTraceScale scales[DYNAMIC_RESOLUTION_EFFECT_COUNT])
+{
+    const int32_t frame = gpu_timer->results_frame();
+
+    if (!m_enabled || frame < 0 || frame == m_last_frame)
+        return false;
+
+    m_last_frame = frame;
+
+    if (m_smoothed_milliseconds == 0.0f)
+        m_smoothed_milliseconds = gpu_timer->frame_milliseconds();
+    else
+        m_smoothed_milliseconds = glm::mix(m_smoothed_milliseconds, gpu_timer->frame_milliseconds(), m_smoothing);
+
+    if (m_cooldown > 0)
+    {
+        m_cooldown--;
+        return false;
+    }
+
+    int32_t selected              = -1;
+    float   selected_milliseconds = 0.0f;
+
+    if (m_smoothed_milliseconds > m_target_milliseconds)
+    {
+        // Lower the effect that costs the most, it gives back the most time.
+        for (int32_t i = 0; i < DYNAMIC_RESOLUTION_EFFECT_COUNT; i++)
+        {
+            const float milliseconds = effect_milliseconds(gpu_timer, (DynamicResolutionEffect)i);
+
+            if (scales[i] < m_min_scale && milliseconds > selected_milliseconds)
+            {
+                selected              = i;
+                selected_milliseconds = milliseconds;
+            }
+        }
+
+        if (selected == -1)
+            return false;
+
+        scales[selected] = (RayTraceScale)(scales[selected] + 1);
+
+        // A tier down shades a quarter of the pixels, assume the saving until the new timings arrive.
+        m_smoothed_milliseconds -= selected_milliseconds * 0.75f;
+    }
+    else
+    {
+        // Raise the effect that costs the least, it is the most likely to fit.
+        for (int32_t i = 0; i < DYNAMIC_RESOLUTION_EFFECT_COUNT; i++)
+        {
+            const float milliseconds = effect_milliseconds(gpu_timer, (DynamicResolutionEffect)i);
+
+            if (scales[i] > m_max_scale && milliseconds >= 0.0f && (selected == -1 || milliseconds < selected_milliseconds))
+            {
+                selected              = i;
+                selected_milliseconds = milliseconds;
+            }
+        }
+
+        if (selected == -1)
+            return false;
+
+        const float predicted_increase = selected_milliseconds * 3.0f;
+
+        if (m_smoothed_milliseconds + predicted_increase > m_target_milliseconds * m_headroom)
+            return false;
+
+        scales[selected] = (RayTraceScale)(scales[selected] - 1);
+
+        m_smoothed_milliseconds += predicted_increase;
+    }
+
+    m_cooldown = DYNAMIC_RESOLUTION_COOLDOWN_FRAMES;
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void DynamicResolution::gui()
+{
+    ImGui::SliderFloat("Target (ms)", &m_target_milliseconds, 4.0f, 50.0f);
+    ImGui::SliderFloat("Headroom", &m_headroom, 0.5f, 1.0f);
+
+    int32_t min_scale = m_min_scale;
+    int32_t max_scale = m_max_scale;
+
+    if (ImGui::SliderInt("Lowest Scale", &min_scale, RAY_TRACE_SCALE_FULL_RES, RAY_TRACE_SCALE_QUARTER_RES, constants::ray_trace_scales[min_scale].c_str()))
+        m_min_scale = (RayTraceScale)std::max(min_scale, max_scale);
+
+    if (ImGui::SliderInt("Highest Scale", &max_scale, RAY_TRACE_SCALE_FULL_RES, RAY_TRACE_SCALE_QUARTER_RES, constants::ray_trace_scales[max_scale].c_str()))
+        m_max_scale = (RayTraceScale)std::min(max_scale, min_scale);
+
+    ImGui::Text("GPU Frame: %.3f ms", m_smoothed_milliseconds);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+float DynamicResolution::effect_milliseconds(GPUTimer* gpu_timer, DynamicResolutionEffect effect)
+{
+    for (const auto& result : gpu_timer->results())
+    {
+        if (result.name == kEffectTimerNames[effect])
+            return result.milliseconds;
+    }
+
+    // The effect was culled in the measured frame.
+    return -1.0f;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
\ No newline at end of file
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "common.h"
+#include "gpu_timer.h"
+
+// Frames to wait after changing a scale before judging the new timings, which covers the timer latency and lets the effect
+// settle before it is considered again.
+#define DYNAMIC_RESOLUTION_COOLDOWN_FRAMES 30
+
+enum DynamicResolutionEffect
+{
+    DYNAMIC_RESOLUTION_EFFECT_SHADOWS,
+    DYNAMIC_RESOLUTION_EFFECT_AO,
+    DYNAMIC_RESOLUTION_EFFECT_REFLECTIONS,
+    DYNAMIC_RESOLUTION_EFFECT_COUNT
+};
+
+// Steps the ray trace scale of the effects through the RayTraceScale tiers to keep the GPU frame time under a target. When
+// over budget the most expensive effect that can still be lowered drops a tier. When there is enough headroom for the cost of a
+// tier up, which is predicted from the pixel count quadrupling, the cheapest effect that can be raised goes up a tier. Only one
+// effect changes per cooldown period so that the timings always reflect the latest change.
+class DynamicResolution
+{
+public:
+    DynamicResolution();
+    ~DynamicResolution();
+
+    // Consumes the most recent results of the timer and updates the scales in place, returns true if any of them changed.
+    bool update(GPUTimer* gpu_timer, RayTraceScale scales[DYNAMIC_RESOLUTION_EFFECT_COUNT]);
+    void gui();
+
+    inline bool  enabled() { return m_enabled; }
+    inline void  set_enabled(bool value) { m_enabled = value; }
+    inline float target_milliseconds() { return m_target_milliseconds; }
+    inline void  set_target_milliseconds(float value) { m_target_milliseconds = value; }
+    inline float smoothed_milliseconds() { return m_smoothed_milliseconds; }
+
+private:
+    float effect_milliseconds(GPUTimer* gpu_timer, DynamicResolutionEffect effect);
+
+private:
+    bool          m_enabled               = false;
+    float         m_target_milliseconds   = 16.6f;
+    float         m_headroom              = 0.9f;
+    float         m_smoothing             = 0.1f;
+    float         m_smoothed_milliseconds = 0.0f;
+    int32_t       m_last_frame            = -1;
+    int32_t       m_cooldown              = 0;
+    RayTraceScale m_min_scale             = RAY_TRACE_SCALE_QUARTER_RES;
+    RayTraceScale m_max_scale             = RAY_TRACE_SCALE_FULL_RES;
+};
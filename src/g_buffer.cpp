@@ -1,20 +1,63 @@
 #include "g_buffer.h"
 #include "common.h"
+#include "render_graph.h"
 #include "utilities.h"
 #include <profiler.h>
 #include <macros.h>
 #include <imgui.h>
+#include <unordered_map>
 
 #define GBUFFER_MIP_LEVELS 9
+#define DOWNSAMPLE_TILE_MIP_LEVEL 6
+#define DOWNSAMPLE_TILE_SIZE (1 << DOWNSAMPLE_TILE_MIP_LEVEL)
+#define HIZ_MIP_LEVELS (GBUFFER_MIP_LEVELS - 1)
+#define CULL_NUM_THREADS_X 64
+
+// Keep in sync with the G-Buffer layouts in shaders/common.glsl.
+#define GBUFFER_1_FORMAT VK_FORMAT_R8G8B8A8_UNORM
+#if defined(GBUFFER_COMPACT)
+#define GBUFFER_2_FORMAT VK_FORMAT_A2B10G10R10_UNORM_PACK32
+#else
+#define GBUFFER_2_FORMAT VK_FORMAT_R16G16B16A16_SFLOAT
+#endif
+#define GBUFFER_3_FORMAT VK_FORMAT_R16G16B16A16_SFLOAT
 
 // -----------------------------------------------------------------------------------------------------------------------------------
 
 struct GBufferPushConstants
+{
+    float roughness_multiplier;
+};
+
+struct DrawData
 {
     glm::mat4 model;
-    uint32_t  material_index;
-    uint32_t  mesh_id;
-    float     roughness_multiplier;
+    glm::vec4 min_extents;
+    glm::vec4 max_extents;
+    uint32_t  material_idx;
+    uint32_t  index_count;
+    uint32_t  base_index;
+    int32_t   base_vertex;
+    uint32_t  group;
+    uint32_t  group_first_draw;
+    uint32_t  padding[2];
+};
+
+struct CullPushConstants
+{
+    uint32_t num_draws;
+    uint32_t frustum_culling;
+    uint32_t occlusion_culling;
+    int32_t  num_hiz_mips;
+    uint32_t second_phase;
+};
+
+struct DownsamplePushConstants
+{
+    glm::ivec2 size;
+    int32_t    num_mips;
+    int32_t    num_work_groups;
+    int32_t    hiz_only;
 };
 
 // -----------------------------------------------------------------------------------------------------------------------------------
@@ -22,7 +65,35 @@ struct GBufferPushConstants
 GBuffer::GBuffer(std::weak_ptr<dw::vk::Backend> backend, CommonResources* common_resources, uint32_t input_width, uint32_t input_height) :
     m_backend(backend), m_common_resources(common_resources), m_input_width(input_width), m_input_height(input_height)
 {
+    m_scene_draws.resize(SCENE_TYPE_COUNT);
+
+    // The GPU driven path draws with vkCmdDrawIndexedIndirectCount and finds the draw data of every draw through its first
+    // instance.
+    {
+        auto vk_backend = m_backend.lock();
+
+        VkPhysicalDeviceVulkan12Features vulkan_12_features;
+        DW_ZERO_MEMORY(vulkan_12_features);
+
+        vulkan_12_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+
+        VkPhysicalDeviceFeatures2 features;
+        DW_ZERO_MEMORY(features);
+
+        features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features.pNext = &vulkan_12_features;
+
+        vkGetPhysicalDeviceFeatures2(vk_backend->physical_device(), &features);
+
+        m_cull.supported  = vulkan_12_features.drawIndirectCount && features.features.drawIndirectFirstInstance;
+        m_cull.gpu_driven = m_cull.supported;
+
+        if (!m_cull.supported)
+            DW_LOG_INFO("drawIndirectCount or drawIndirectFirstInstance is not supported, the G-Buffer falls back to CPU driven draws.");
+    }
+
     create_images();
+    create_buffers();
     create_descriptor_set_layouts();
     create_descriptor_sets();
     write_descriptor_sets();
@@ -39,9 +110,20 @@ GBuffer::~GBuffer()
 
 // -----------------------------------------------------------------------------------------------------------------------------------
 
+void GBuffer::prepare()
+{
+    // Scenes are loaded on demand, so their draws are only built the first time they are rendered. This allocates descriptor
+    // sets, which is why it happens on the main thread ahead of recording.
+    if (!m_scene_draws[m_common_resources->current_scene_type].ds)
+        create_scene_draws(m_common_resources->current_scene_type);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
 void GBuffer::render(dw::vk::CommandBuffer::Ptr cmd_buf)
 {
     DW_SCOPED_SAMPLE("G-Buffer", cmd_buf);
+    GPU_SCOPED_TIMER("G-Buffer", cmd_buf, m_common_resources->gpu_timer.get());
 
     // Transition history G-Buffer to shader read only during the first frame
     if (m_common_resources->first_frame)
@@ -69,7 +151,25 @@ void GBuffer::render(dw::vk::CommandBuffer::Ptr cmd_buf)
             VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
             subresource_range);
 
+        dw::vk::utilities::set_image_layout(
+            cmd_buf->handle(),
+            m_depth_mips[!m_common_resources->ping_pong]->handle(),
+            VK_IMAGE_LAYOUT_UNDEFINED,
+            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+            subresource_range);
+
+        // Culling samples the Hi-Z before it is first written, occlusion culling is skipped for that frame.
+        subresource_range.levelCount = HIZ_MIP_LEVELS;
+
+        dw::vk::utilities::set_image_layout(
+            cmd_buf->handle(),
+            m_hiz->handle(),
+            VK_IMAGE_LAYOUT_UNDEFINED,
+            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+            subresource_range);
+
         subresource_range.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+        subresource_range.levelCount = 1;
 
         dw::vk::utilities::set_image_layout(
             cmd_buf->handle(),
@@ -77,8 +177,51 @@ void GBuffer::render(dw::vk::CommandBuffer::Ptr cmd_buf)
             VK_IMAGE_LAYOUT_UNDEFINED,
             VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
             subresource_range);
+
+        // The downsample pass expects its work group counter to start at zero.
+        vkCmdFillBuffer(cmd_buf->handle(), m_downsample.scratch_buffer->handle(), 0, VK_WHOLE_SIZE, 0);
+
+        std::vector<VkBufferMemoryBarrier> buffer_barriers = {
+            buffer_memory_barrier(m_downsample.scratch_buffer, 0, VK_WHOLE_SIZE, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT)
+        };
+
+        pipeline_barrier(cmd_buf, {}, {}, buffer_barriers, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
     }
 
+    // Only the draws that were visible last frame are drawn first, the rest are retested against the Hi-Z of those and drawn in a
+    // second pass. The previous Hi-Z belongs to the same scene on any but the first frame after a switch, otherwise there is
+    // nothing to test against and everything is drawn in the first pass.
+    bool second_phase = false;
+
+    if (m_cull.gpu_driven)
+    {
+        const bool hiz_valid = !m_common_resources->first_frame && m_cull.last_scene_type == (int32_t)m_common_resources->current_scene_type;
+
+        m_cull.last_scene_type = m_common_resources->current_scene_type;
+
+        second_phase = m_cull.occlusion_culling && hiz_valid;
+
+        cull(cmd_buf, second_phase, false);
+    }
+
+    geometry_pass(cmd_buf, false);
+
+    if (second_phase)
+    {
+        downsample_gbuffer(cmd_buf, true);
+        cull(cmd_buf, true, true);
+        geometry_pass(cmd_buf, true);
+    }
+
+    downsample_gbuffer(cmd_buf, false);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void GBuffer::geometry_pass(dw::vk::CommandBuffer::Ptr cmd_buf, bool second_phase)
+{
+    DW_SCOPED_SAMPLE(second_phase ? "Second Phase" : "First Phase", cmd_buf);
+
     VkClearValue clear_values[4];
 
     clear_values[0].color.float32[0] = 0.0f;
@@ -100,7 +243,7 @@ void GBuffer::render(dw::vk::CommandBuffer::Ptr cmd_buf)
 
     VkRenderPassBeginInfo info    = {};
     info.sType                    = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-    info.renderPass               = m_rp->handle();
+    info.renderPass               = second_phase ? m_second_phase_rp->handle() : m_rp->handle();
     info.framebuffer              = m_fbo[m_common_resources->ping_pong]->handle();
     info.renderArea.extent.width  = m_input_width;
     info.renderArea.extent.height = m_input_height;
@@ -129,100 +272,290 @@ void GBuffer::render(dw::vk::CommandBuffer::Ptr cmd_buf)
 
     vkCmdSetScissor(cmd_buf->handle(), 0, 1, &scissor_rect);
 
-    vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipeline->handle());
+    draw(cmd_buf);
 
-    auto           vk_backend     = m_backend.lock();
-    const uint32_t dynamic_offset = m_common_resources->ubo_size * vk_backend->current_frame_idx();
+    vkCmdEndRenderPass(cmd_buf->handle());
+}
 
-    VkDescriptorSet descriptor_sets[] = {
-        m_common_resources->current_scene()->descriptor_set()->handle(),
-        m_common_resources->per_frame_ds->handle()
-    };
+// -----------------------------------------------------------------------------------------------------------------------------------
 
-    vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipeline_layout->handle(), 0, 2, descriptor_sets, 1, &dynamic_offset);
+void GBuffer::gui()
+{
+    if (m_cull.supported)
+        ImGui::Checkbox("GPU Driven", &m_cull.gpu_driven);
 
-    uint32_t mesh_id = 0;
+    if (m_cull.gpu_driven)
+    {
+        ImGui::Checkbox("Frustum Culling", &m_cull.frustum_culling);
+        ImGui::Checkbox("Occlusion Culling", &m_cull.occlusion_culling);
+    }
+}
 
-    const auto& instances = m_common_resources->current_scene()->instances();
+// -----------------------------------------------------------------------------------------------------------------------------------
 
-    for (uint32_t instance_idx = 0; instance_idx < instances.size(); instance_idx++)
-    {
-        const auto& instance = instances[instance_idx];
+dw::vk::DescriptorSetLayout::Ptr GBuffer::ds_layout()
+{
+    return m_ds_layout;
+}
 
-        if (!instance.mesh.expired())
-        {
-            const auto& mesh      = instance.mesh.lock();
-            const auto& submeshes = mesh->sub_meshes();
+// -----------------------------------------------------------------------------------------------------------------------------------
 
-            VkDeviceSize offset = 0;
-            vkCmdBindVertexBuffers(cmd_buf->handle(), 0, 1, &mesh->vertex_buffer()->handle(), &offset);
-            vkCmdBindIndexBuffer(cmd_buf->handle(), mesh->index_buffer()->handle(), 0, VK_INDEX_TYPE_UINT32);
+dw::vk::DescriptorSet::Ptr GBuffer::output_ds()
+{
+    return m_ds[static_cast<uint32_t>(m_common_resources->ping_pong)];
+}
 
-            for (uint32_t submesh_idx = 0; submesh_idx < submeshes.size(); submesh_idx++)
-            {
-                auto& submesh = submeshes[submesh_idx];
-                auto& mat     = mesh->material(submesh.mat_idx);
+// -----------------------------------------------------------------------------------------------------------------------------------
 
-                GBufferPushConstants push_constants;
+dw::vk::DescriptorSet::Ptr GBuffer::history_ds()
+{
+    return m_ds[static_cast<uint32_t>(!m_common_resources->ping_pong)];
+}
 
-                push_constants.model                = instance.transform;
-                push_constants.material_index       = m_common_resources->current_scene()->material_index(mat->id());
-                push_constants.mesh_id              = mesh_id;
-                push_constants.roughness_multiplier = m_common_resources->roughness_multiplier;
+// -----------------------------------------------------------------------------------------------------------------------------------
 
-                vkCmdPushConstants(cmd_buf->handle(), m_pipeline_layout->handle(), VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(GBufferPushConstants), &push_constants);
+glm::uvec4 GBuffer::output_bindless_indices()
+{
+    return m_bindless_indices[static_cast<uint32_t>(m_common_resources->ping_pong)];
+}
 
-                // Issue draw call.
-                vkCmdDrawIndexed(cmd_buf->handle(), submesh.index_count, 1, submesh.base_index, submesh.base_vertex, 0);
+// -----------------------------------------------------------------------------------------------------------------------------------
 
-                mesh_id++;
-            }
-        }
-    }
+glm::uvec4 GBuffer::history_bindless_indices()
+{
+    return m_bindless_indices[static_cast<uint32_t>(!m_common_resources->ping_pong)];
+}
 
-    vkCmdEndRenderPass(cmd_buf->handle());
+// -----------------------------------------------------------------------------------------------------------------------------------
 
-    downsample_gbuffer(cmd_buf);
+dw::vk::DescriptorSet::Ptr GBuffer::hiz_ds()
+{
+    return m_cull.hiz_ds;
 }
 
 // -----------------------------------------------------------------------------------------------------------------------------------
 
-dw::vk::DescriptorSetLayout::Ptr GBuffer::ds_layout()
+// The targets of both frames and the Hi-Z are sampled by the passes on the async compute queue, and all of them are in the shader
+// read layout once render() has been recorded.
+void GBuffer::add_queue_transfer_resources(QueueTransfer& transfer)
 {
-    return m_ds_layout;
+    for (uint32_t i = 0; i < 2; i++)
+    {
+        transfer.add_image(m_image_1[i], VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+        transfer.add_image(m_image_2[i], VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+        transfer.add_image(m_image_3[i], VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+        transfer.add_image(m_depth_mips[i], VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    }
+
+    transfer.add_image(m_hiz, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
 }
 
 // -----------------------------------------------------------------------------------------------------------------------------------
 
-dw::vk::DescriptorSet::Ptr GBuffer::output_ds()
+dw::vk::ImageView::Ptr GBuffer::depth_fbo_image_view(uint32_t idx)
 {
-    return m_ds[static_cast<uint32_t>(m_common_resources->ping_pong)];
+    return m_depth_fbo_view[idx];
 }
 
 // -----------------------------------------------------------------------------------------------------------------------------------
 
-dw::vk::DescriptorSet::Ptr GBuffer::history_ds()
+void GBuffer::cull(dw::vk::CommandBuffer::Ptr cmd_buf, bool occlusion_culling, bool second_phase)
 {
-    return m_ds[static_cast<uint32_t>(!m_common_resources->ping_pong)];
+    DW_SCOPED_SAMPLE(second_phase ? "Second Phase Cull" : "Cull", cmd_buf);
+
+    auto              vk_backend = m_backend.lock();
+    const SceneDraws& draws      = m_scene_draws[m_common_resources->current_scene_type];
+
+    // The previous draws may still be reading the arguments, and the previous second phase the draws to retest.
+    {
+        std::vector<VkMemoryBarrier> memory_barriers = {
+            memory_barrier(VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT)
+        };
+
+        pipeline_barrier(cmd_buf, memory_barriers, {}, {}, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+    }
+
+    vkCmdFillBuffer(cmd_buf->handle(), draws.draw_count_buffer->handle(), 0, VK_WHOLE_SIZE, 0);
+
+    std::vector<VkBufferMemoryBarrier> buffer_barriers = {
+        buffer_memory_barrier(draws.draw_count_buffer, 0, VK_WHOLE_SIZE, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT)
+    };
+
+    // The first phase starts the retest list empty, with a dispatch of zero work groups.
+    if (!second_phase)
+    {
+        const uint32_t retest_args[] = { 0, 1, 1, 0 };
+
+        vkCmdUpdateBuffer(cmd_buf->handle(), draws.retest_buffer->handle(), 0, sizeof(retest_args), retest_args);
+
+        buffer_barriers.push_back(buffer_memory_barrier(draws.retest_buffer, 0, sizeof(retest_args), VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT));
+    }
+
+    pipeline_barrier(cmd_buf, {}, {}, buffer_barriers, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+    CullPushConstants push_constants;
+
+    push_constants.num_draws         = draws.num_draws;
+    push_constants.frustum_culling   = (uint32_t)m_cull.frustum_culling;
+    push_constants.occlusion_culling = (uint32_t)occlusion_culling;
+    push_constants.num_hiz_mips      = HIZ_MIP_LEVELS;
+    push_constants.second_phase      = (uint32_t)second_phase;
+
+    const uint32_t dynamic_offset = m_common_resources->ubo_size * vk_backend->current_frame_idx();
+
+    VkDescriptorSet descriptor_sets[] = {
+        draws.ds->handle(),
+        m_common_resources->per_frame_ds->handle(),
+        m_cull.hiz_ds->handle()
+    };
+
+    vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_cull.pipeline->handle());
+
+    vkCmdPushConstants(cmd_buf->handle(), m_cull.pipeline_layout->handle(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_constants), &push_constants);
+
+    vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_cull.pipeline_layout->handle(), 0, 3, descriptor_sets, 1, &dynamic_offset);
+
+    // The second phase is sized by the number of draws that the first one left to retest.
+    if (second_phase)
+        vkCmdDispatchIndirect(cmd_buf->handle(), draws.retest_buffer->handle(), 0);
+    else
+        vkCmdDispatch(cmd_buf->handle(), static_cast<uint32_t>(ceil(float(draws.num_draws) / float(CULL_NUM_THREADS_X))), 1, 1);
+
+    {
+        std::vector<VkMemoryBarrier> memory_barriers = {
+            memory_barrier(VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT)
+        };
+
+        pipeline_barrier(cmd_buf, memory_barriers, {}, {}, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+    }
 }
 
 // -----------------------------------------------------------------------------------------------------------------------------------
 
-dw::vk::ImageView::Ptr GBuffer::depth_fbo_image_view(uint32_t idx)
+void GBuffer::draw(dw::vk::CommandBuffer::Ptr cmd_buf)
 {
-    return m_depth_fbo_view[idx];
+    vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipeline->handle());
+
+    auto              vk_backend     = m_backend.lock();
+    const uint32_t    dynamic_offset = m_common_resources->ubo_size * vk_backend->current_frame_idx();
+    const SceneDraws& draws          = m_scene_draws[m_common_resources->current_scene_type];
+
+    VkDescriptorSet descriptor_sets[] = {
+        m_common_resources->current_scene()->descriptor_set()->handle(),
+        m_common_resources->per_frame_ds->handle(),
+        draws.ds->handle()
+    };
+
+    vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipeline_layout->handle(), 0, 3, descriptor_sets, 1, &dynamic_offset);
+
+    GBufferPushConstants push_constants;
+
+    push_constants.roughness_multiplier = m_common_resources->roughness_multiplier;
+
+    vkCmdPushConstants(cmd_buf->handle(), m_pipeline_layout->handle(), VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(GBufferPushConstants), &push_constants);
+
+    for (uint32_t group_idx = 0; group_idx < draws.groups.size(); group_idx++)
+    {
+        const auto& group = draws.groups[group_idx];
+
+        if (group.mesh.expired())
+            continue;
+
+        const auto& mesh = group.mesh.lock();
+
+        VkDeviceSize offset = 0;
+        vkCmdBindVertexBuffers(cmd_buf->handle(), 0, 1, &mesh->vertex_buffer()->handle(), &offset);
+        vkCmdBindIndexBuffer(cmd_buf->handle(), mesh->index_buffer()->handle(), 0, VK_INDEX_TYPE_UINT32);
+
+        if (m_cull.gpu_driven)
+        {
+            vkCmdDrawIndexedIndirectCount(cmd_buf->handle(),
+                                          draws.draw_args_buffer->handle(),
+                                          sizeof(VkDrawIndexedIndirectCommand) * group.first_draw,
+                                          draws.draw_count_buffer->handle(),
+                                          sizeof(uint32_t) * group_idx,
+                                          group.num_draws,
+                                          sizeof(VkDrawIndexedIndirectCommand));
+        }
+        else
+        {
+            for (uint32_t i = group.first_draw; i < group.first_draw + group.num_draws; i++)
+            {
+                const VkDrawIndexedIndirectCommand& command = draws.commands[i];
+
+                vkCmdDrawIndexed(cmd_buf->handle(), command.indexCount, command.instanceCount, command.firstIndex, command.vertexOffset, command.firstInstance);
+            }
+        }
+    }
 }
 
 // -----------------------------------------------------------------------------------------------------------------------------------
 
-void GBuffer::downsample_gbuffer(dw::vk::CommandBuffer::Ptr cmd_buf)
+void GBuffer::downsample_gbuffer(dw::vk::CommandBuffer::Ptr cmd_buf, bool hiz_only)
 {
-    DW_SCOPED_SAMPLE("Downsample", cmd_buf);
+    DW_SCOPED_SAMPLE(hiz_only ? "Hi-Z" : "Downsample", cmd_buf);
 
-    m_image_1[static_cast<uint32_t>(m_common_resources->ping_pong)]->generate_mipmaps(cmd_buf, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_ASPECT_COLOR_BIT, VK_FILTER_NEAREST);
-    m_image_2[static_cast<uint32_t>(m_common_resources->ping_pong)]->generate_mipmaps(cmd_buf, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_ASPECT_COLOR_BIT, VK_FILTER_NEAREST);
-    m_image_3[static_cast<uint32_t>(m_common_resources->ping_pong)]->generate_mipmaps(cmd_buf, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_ASPECT_COLOR_BIT, VK_FILTER_NEAREST);
-    m_depth[static_cast<uint32_t>(m_common_resources->ping_pong)]->generate_mipmaps(cmd_buf, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_ASPECT_DEPTH_BIT, VK_FILTER_NEAREST);
+    const uint32_t idx = static_cast<uint32_t>(m_common_resources->ping_pong);
+
+    VkImageSubresourceRange color_subresource_range = { VK_IMAGE_ASPECT_COLOR_BIT, 1, GBUFFER_MIP_LEVELS - 1, 0, 1 };
+    VkImageSubresourceRange depth_subresource_range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, GBUFFER_MIP_LEVELS, 0, 1 };
+    VkImageSubresourceRange hiz_subresource_range   = { VK_IMAGE_ASPECT_COLOR_BIT, 0, HIZ_MIP_LEVELS, 0, 1 };
+
+    // The render pass leaves the first mip of every target ready to be sampled, the rest of the chain is overwritten.
+    {
+        std::vector<VkImageMemoryBarrier> image_barriers = {
+            image_memory_barrier(m_hiz, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, hiz_subresource_range, 0, VK_ACCESS_SHADER_WRITE_BIT)
+        };
+
+        if (!hiz_only)
+        {
+            image_barriers.push_back(image_memory_barrier(m_image_1[idx], VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, color_subresource_range, 0, VK_ACCESS_SHADER_WRITE_BIT));
+            image_barriers.push_back(image_memory_barrier(m_image_2[idx], VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, color_subresource_range, 0, VK_ACCESS_SHADER_WRITE_BIT));
+            image_barriers.push_back(image_memory_barrier(m_image_3[idx], VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, color_subresource_range, 0, VK_ACCESS_SHADER_WRITE_BIT));
+            image_barriers.push_back(image_memory_barrier(m_depth_mips[idx], VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, depth_subresource_range, 0, VK_ACCESS_SHADER_WRITE_BIT));
+        }
+
+        // The scratch buffer was last written by the previous frame's dispatch.
+        std::vector<VkMemoryBarrier> memory_barriers = {
+            memory_barrier(VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT)
+        };
+
+        pipeline_barrier(cmd_buf, memory_barriers, image_barriers, {}, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+    }
+
+    const uint32_t num_work_groups_x = static_cast<uint32_t>(ceil(float(m_input_width) / float(DOWNSAMPLE_TILE_SIZE)));
+    const uint32_t num_work_groups_y = static_cast<uint32_t>(ceil(float(m_input_height) / float(DOWNSAMPLE_TILE_SIZE)));
+
+    DownsamplePushConstants push_constants;
+
+    push_constants.size            = glm::ivec2(m_input_width, m_input_height);
+    push_constants.num_mips        = GBUFFER_MIP_LEVELS;
+    push_constants.num_work_groups = num_work_groups_x * num_work_groups_y;
+    push_constants.hiz_only        = (int32_t)hiz_only;
+
+    vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_downsample.pipeline->handle());
+
+    vkCmdPushConstants(cmd_buf->handle(), m_downsample.pipeline_layout->handle(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_constants), &push_constants);
+
+    vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_downsample.pipeline_layout->handle(), 0, 1, &m_downsample.ds[idx]->handle(), 0, nullptr);
+
+    vkCmdDispatch(cmd_buf->handle(), num_work_groups_x, num_work_groups_y, 1);
+
+    {
+        std::vector<VkImageMemoryBarrier> image_barriers = {
+            image_memory_barrier(m_hiz, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, hiz_subresource_range, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT)
+        };
+
+        if (!hiz_only)
+        {
+            image_barriers.push_back(image_memory_barrier(m_image_1[idx], VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, color_subresource_range, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT));
+            image_barriers.push_back(image_memory_barrier(m_image_2[idx], VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, color_subresource_range, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT));
+            image_barriers.push_back(image_memory_barrier(m_image_3[idx], VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, color_subresource_range, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT));
+            image_barriers.push_back(image_memory_barrier(m_depth_mips[idx], VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, depth_subresource_range, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT));
+        }
+
+        pipeline_barrier(cmd_buf, {}, image_barriers, {}, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR);
+    }
 }
 
 // -----------------------------------------------------------------------------------------------------------------------------------
@@ -233,18 +566,22 @@ void GBuffer::create_images()
 
     for (int i = 0; i < 2; i++)
     {
-        m_image_1[i] = dw::vk::Image::create(vk_backend, VK_IMAGE_TYPE_2D, m_input_width, m_input_height, 1, GBUFFER_MIP_LEVELS, 1, VK_FORMAT_R8G8B8A8_UNORM, VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, VK_SAMPLE_COUNT_1_BIT);
+        m_image_1[i] = dw::vk::Image::create(vk_backend, VK_IMAGE_TYPE_2D, m_input_width, m_input_height, 1, GBUFFER_MIP_LEVELS, 1, GBUFFER_1_FORMAT, VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, VK_SAMPLE_COUNT_1_BIT);
         m_image_1[i]->set_name("G-Buffer 1 Image " + std::to_string(i));
 
-        m_image_2[i] = dw::vk::Image::create(vk_backend, VK_IMAGE_TYPE_2D, m_input_width, m_input_height, 1, GBUFFER_MIP_LEVELS, 1, VK_FORMAT_R16G16B16A16_SFLOAT, VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, VK_SAMPLE_COUNT_1_BIT);
+        m_image_2[i] = dw::vk::Image::create(vk_backend, VK_IMAGE_TYPE_2D, m_input_width, m_input_height, 1, GBUFFER_MIP_LEVELS, 1, GBUFFER_2_FORMAT, VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, VK_SAMPLE_COUNT_1_BIT);
         m_image_2[i]->set_name("G-Buffer 2 Image " + std::to_string(i));
 
-        m_image_3[i] = dw::vk::Image::create(vk_backend, VK_IMAGE_TYPE_2D, m_input_width, m_input_height, 1, GBUFFER_MIP_LEVELS, 1, VK_FORMAT_R16G16B16A16_SFLOAT, VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, VK_SAMPLE_COUNT_1_BIT);
+        m_image_3[i] = dw::vk::Image::create(vk_backend, VK_IMAGE_TYPE_2D, m_input_width, m_input_height, 1, GBUFFER_MIP_LEVELS, 1, GBUFFER_3_FORMAT, VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, VK_SAMPLE_COUNT_1_BIT);
         m_image_3[i]->set_name("G-Buffer 3 Image " + std::to_string(i));
 
-        m_depth[i] = dw::vk::Image::create(vk_backend, VK_IMAGE_TYPE_2D, m_input_width, m_input_height, 1, GBUFFER_MIP_LEVELS, 1, vk_backend->swap_chain_depth_format(), VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, VK_SAMPLE_COUNT_1_BIT);
+        m_depth[i] = dw::vk::Image::create(vk_backend, VK_IMAGE_TYPE_2D, m_input_width, m_input_height, 1, 1, 1, vk_backend->swap_chain_depth_format(), VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_SAMPLE_COUNT_1_BIT);
         m_depth[i]->set_name("G-Buffer Depth Image " + std::to_string(i));
 
+        // Depth formats can't be written from a compute shader, so the mip chain lives in a separate image.
+        m_depth_mips[i] = dw::vk::Image::create(vk_backend, VK_IMAGE_TYPE_2D, m_input_width, m_input_height, 1, GBUFFER_MIP_LEVELS, 1, VK_FORMAT_R32_SFLOAT, VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_SAMPLE_COUNT_1_BIT);
+        m_depth_mips[i]->set_name("G-Buffer Depth Mips Image " + std::to_string(i));
+
         m_image_1_view[i] = dw::vk::ImageView::create(vk_backend, m_image_1[i], VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT, 0, GBUFFER_MIP_LEVELS);
         m_image_1_view[i]->set_name("G-Buffer 1 Image View " + std::to_string(i));
 
@@ -254,8 +591,8 @@ void GBuffer::create_images()
         m_image_3_view[i] = dw::vk::ImageView::create(vk_backend, m_image_3[i], VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT, 0, GBUFFER_MIP_LEVELS);
         m_image_3_view[i]->set_name("G-Buffer 3 Image View " + std::to_string(i));
 
-        m_depth_view[i] = dw::vk::ImageView::create(vk_backend, m_depth[i], VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_DEPTH_BIT, 0, GBUFFER_MIP_LEVELS);
-        m_depth_view[i]->set_name("G-Buffer Depth Image View " + std::to_string(i));
+        m_depth_mips_view[i] = dw::vk::ImageView::create(vk_backend, m_depth_mips[i], VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT, 0, GBUFFER_MIP_LEVELS);
+        m_depth_mips_view[i]->set_name("G-Buffer Depth Mips Image View " + std::to_string(i));
 
         m_image_1_fbo_view[i] = dw::vk::ImageView::create(vk_backend, m_image_1[i], VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT);
         m_image_1_fbo_view[i]->set_name("G-Buffer 1 FBO Image View " + std::to_string(i));
@@ -268,11 +605,57 @@ void GBuffer::create_images()
 
         m_depth_fbo_view[i] = dw::vk::ImageView::create(vk_backend, m_depth[i], VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_DEPTH_BIT);
         m_depth_fbo_view[i]->set_name("G-Buffer Depth FBO Image View " + std::to_string(i));
+
+        for (int mip = 0; mip < GBUFFER_MIP_LEVELS; mip++)
+        {
+            if (mip > 0)
+            {
+                m_downsample.image_1_mip_views[i].push_back(dw::vk::ImageView::create(vk_backend, m_image_1[i], VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT, mip, 1));
+                m_downsample.image_1_mip_views[i].back()->set_name("G-Buffer 1 Mip " + std::to_string(mip) + " Image View " + std::to_string(i));
+
+                m_downsample.image_2_mip_views[i].push_back(dw::vk::ImageView::create(vk_backend, m_image_2[i], VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT, mip, 1));
+                m_downsample.image_2_mip_views[i].back()->set_name("G-Buffer 2 Mip " + std::to_string(mip) + " Image View " + std::to_string(i));
+
+                m_downsample.image_3_mip_views[i].push_back(dw::vk::ImageView::create(vk_backend, m_image_3[i], VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT, mip, 1));
+                m_downsample.image_3_mip_views[i].back()->set_name("G-Buffer 3 Mip " + std::to_string(mip) + " Image View " + std::to_string(i));
+            }
+
+            m_downsample.depth_mip_views[i].push_back(dw::vk::ImageView::create(vk_backend, m_depth_mips[i], VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT, mip, 1));
+            m_downsample.depth_mip_views[i].back()->set_name("G-Buffer Depth Mip " + std::to_string(mip) + " Image View " + std::to_string(i));
+        }
+    }
+
+    m_hiz = dw::vk::Image::create(vk_backend, VK_IMAGE_TYPE_2D, std::max(m_input_width / 2, 1u), std::max(m_input_height / 2, 1u), 1, HIZ_MIP_LEVELS, 1, VK_FORMAT_R32G32_SFLOAT, VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_SAMPLE_COUNT_1_BIT);
+    m_hiz->set_name("G-Buffer Hi-Z Image");
+
+    m_hiz_view = dw::vk::ImageView::create(vk_backend, m_hiz, VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT, 0, HIZ_MIP_LEVELS);
+    m_hiz_view->set_name("G-Buffer Hi-Z Image View");
+
+    for (int mip = 0; mip < HIZ_MIP_LEVELS; mip++)
+    {
+        m_downsample.hiz_mip_views.push_back(dw::vk::ImageView::create(vk_backend, m_hiz, VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT, mip, 1));
+        m_downsample.hiz_mip_views.back()->set_name("G-Buffer Hi-Z Mip " + std::to_string(mip) + " Image View");
     }
 }
 
 // -----------------------------------------------------------------------------------------------------------------------------------
 
+void GBuffer::create_buffers()
+{
+    auto vk_backend = m_backend.lock();
+
+    // A work group counter followed by every texel from the tile mip down, which only the last work group reads back.
+    size_t num_samples = 0;
+
+    for (int mip = DOWNSAMPLE_TILE_MIP_LEVEL; mip < GBUFFER_MIP_LEVELS; mip++)
+        num_samples += std::max(m_input_width >> mip, 1u) * std::max(m_input_height >> mip, 1u);
+
+    m_downsample.scratch_buffer = dw::vk::Buffer::create(vk_backend, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, sizeof(glm::uvec4) * (1 + num_samples), VMA_MEMORY_USAGE_GPU_ONLY, 0);
+    m_downsample.scratch_buffer->set_name("G-Buffer Downsample Scratch Buffer");
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
 void GBuffer::create_descriptor_set_layouts()
 {
     dw::vk::DescriptorSetLayout::Desc desc;
@@ -285,6 +668,159 @@ void GBuffer::create_descriptor_set_layouts()
     auto vk_backend = m_backend.lock();
     m_ds_layout     = dw::vk::DescriptorSetLayout::create(vk_backend, desc);
     m_ds_layout->set_name("G-Buffer DS Layout");
+
+    // Downsample
+    {
+        dw::vk::DescriptorSetLayout::Desc downsample_desc;
+
+        downsample_desc.add_binding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+        downsample_desc.add_binding(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+        downsample_desc.add_binding(2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+        downsample_desc.add_binding(3, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+        downsample_desc.add_binding(4, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, GBUFFER_MIP_LEVELS - 1, VK_SHADER_STAGE_COMPUTE_BIT);
+        downsample_desc.add_binding(5, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, GBUFFER_MIP_LEVELS - 1, VK_SHADER_STAGE_COMPUTE_BIT);
+        downsample_desc.add_binding(6, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, GBUFFER_MIP_LEVELS - 1, VK_SHADER_STAGE_COMPUTE_BIT);
+        downsample_desc.add_binding(7, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, GBUFFER_MIP_LEVELS, VK_SHADER_STAGE_COMPUTE_BIT);
+        downsample_desc.add_binding(8, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+        downsample_desc.add_binding(9, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, HIZ_MIP_LEVELS, VK_SHADER_STAGE_COMPUTE_BIT);
+
+        m_downsample.ds_layout = dw::vk::DescriptorSetLayout::create(vk_backend, downsample_desc);
+        m_downsample.ds_layout->set_name("G-Buffer Downsample DS Layout");
+    }
+
+    // Cull
+    {
+        dw::vk::DescriptorSetLayout::Desc cull_desc;
+
+        cull_desc.add_binding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_COMPUTE_BIT);
+        cull_desc.add_binding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+        cull_desc.add_binding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+        cull_desc.add_binding(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+
+        m_cull.ds_layout = dw::vk::DescriptorSetLayout::create(vk_backend, cull_desc);
+        m_cull.ds_layout->set_name("G-Buffer Cull DS Layout");
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void GBuffer::create_scene_draws(uint32_t scene_idx)
+{
+    auto vk_backend = m_backend.lock();
+
+    auto&       scene     = m_common_resources->scenes[scene_idx];
+    SceneDraws& draws     = m_scene_draws[scene_idx];
+    const auto& instances = scene->instances();
+
+    std::unordered_map<dw::Mesh*, uint32_t> group_indices;
+
+    // Count the draws of every mesh first so that each group gets a contiguous range of the argument buffer.
+    for (const auto& instance : instances)
+    {
+        if (instance.mesh.expired())
+            continue;
+
+        const auto& mesh = instance.mesh.lock();
+
+        if (group_indices.find(mesh.get()) == group_indices.end())
+        {
+            group_indices[mesh.get()] = draws.groups.size();
+            draws.groups.push_back({ mesh, 0, 0 });
+        }
+
+        draws.groups[group_indices[mesh.get()]].num_draws += mesh->sub_meshes().size();
+    }
+
+    for (auto& group : draws.groups)
+    {
+        group.first_draw = draws.num_draws;
+        draws.num_draws += group.num_draws;
+        group.num_draws  = 0;
+    }
+
+    // Draws are stored in instance order so that the mesh IDs of the forward path are preserved.
+    std::vector<DrawData> draw_datas;
+
+    draw_datas.reserve(draws.num_draws);
+    draws.commands.resize(draws.num_draws);
+
+    for (const auto& instance : instances)
+    {
+        if (instance.mesh.expired())
+            continue;
+
+        const auto& mesh      = instance.mesh.lock();
+        const auto& submeshes = mesh->sub_meshes();
+        const auto  group_idx = group_indices[mesh.get()];
+        auto&       group     = draws.groups[group_idx];
+
+        for (const auto& submesh : submeshes)
+        {
+            DrawData draw_data;
+
+            draw_data.model            = instance.transform;
+            draw_data.min_extents      = glm::vec4(submesh.min_extents, 0.0f);
+            draw_data.max_extents      = glm::vec4(submesh.max_extents, 0.0f);
+            draw_data.material_idx     = scene->material_index(mesh->material(submesh.mat_idx)->id());
+            draw_data.index_count      = submesh.index_count;
+            draw_data.base_index       = submesh.base_index;
+            draw_data.base_vertex      = submesh.base_vertex;
+            draw_data.group            = group_idx;
+            draw_data.group_first_draw = group.first_draw;
+
+            VkDrawIndexedIndirectCommand& command = draws.commands[group.first_draw + group.num_draws++];
+
+            command.indexCount    = submesh.index_count;
+            command.instanceCount = 1;
+            command.firstIndex    = submesh.base_index;
+            command.vertexOffset  = submesh.base_vertex;
+            command.firstInstance = draw_datas.size();
+
+            draw_datas.push_back(draw_data);
+        }
+    }
+
+    const size_t num_buffer_draws = std::max(draws.num_draws, 1u);
+
+    draws.draw_data_buffer = dw::vk::Buffer::create(vk_backend, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sizeof(DrawData) * num_buffer_draws, VMA_MEMORY_USAGE_CPU_TO_GPU, VMA_ALLOCATION_CREATE_MAPPED_BIT);
+    draws.draw_data_buffer->set_name("G-Buffer Draw Data Buffer " + std::to_string(scene_idx));
+
+    if (draws.num_draws > 0)
+        memcpy(draws.draw_data_buffer->mapped_ptr(), draw_datas.data(), sizeof(DrawData) * draws.num_draws);
+
+    draws.draw_args_buffer = dw::vk::Buffer::create(vk_backend, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, sizeof(VkDrawIndexedIndirectCommand) * num_buffer_draws, VMA_MEMORY_USAGE_GPU_ONLY, 0);
+    draws.draw_args_buffer->set_name("G-Buffer Draw Args Buffer " + std::to_string(scene_idx));
+
+    draws.draw_count_buffer = dw::vk::Buffer::create(vk_backend, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, sizeof(uint32_t) * std::max(draws.groups.size(), (size_t)1), VMA_MEMORY_USAGE_GPU_ONLY, 0);
+    draws.draw_count_buffer->set_name("G-Buffer Draw Count Buffer " + std::to_string(scene_idx));
+
+    draws.retest_buffer = dw::vk::Buffer::create(vk_backend, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, sizeof(uint32_t) * (4 + num_buffer_draws), VMA_MEMORY_USAGE_GPU_ONLY, 0);
+    draws.retest_buffer->set_name("G-Buffer Retest Buffer " + std::to_string(scene_idx));
+
+    draws.ds = vk_backend->allocate_descriptor_set(m_cull.ds_layout);
+
+    dw::vk::Buffer::Ptr buffers[] = { draws.draw_data_buffer, draws.draw_args_buffer, draws.draw_count_buffer, draws.retest_buffer };
+
+    VkDescriptorBufferInfo buffer_infos[4];
+    VkWriteDescriptorSet   write_datas[4];
+
+    for (int j = 0; j < 4; j++)
+    {
+        buffer_infos[j].range  = buffers[j]->size();
+        buffer_infos[j].offset = 0;
+        buffer_infos[j].buffer = buffers[j]->handle();
+
+        DW_ZERO_MEMORY(write_datas[j]);
+
+        write_datas[j].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write_datas[j].descriptorCount = 1;
+        write_datas[j].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        write_datas[j].pBufferInfo     = &buffer_infos[j];
+        write_datas[j].dstBinding      = j;
+        write_datas[j].dstSet          = draws.ds->handle();
+    }
+
+    vkUpdateDescriptorSets(vk_backend->device(), 4, &write_datas[0], 0, nullptr);
 }
 
 // -----------------------------------------------------------------------------------------------------------------------------------
@@ -294,7 +830,12 @@ void GBuffer::create_descriptor_sets()
     auto vk_backend = m_backend.lock();
 
     for (int i = 0; i < 2; i++)
-        m_ds[i] = vk_backend->allocate_descriptor_set(m_ds_layout);
+    {
+        m_ds[i]            = vk_backend->allocate_descriptor_set(m_ds_layout);
+        m_downsample.ds[i] = vk_backend->allocate_descriptor_set(m_downsample.ds_layout);
+    }
+
+    m_cull.hiz_ds = vk_backend->allocate_descriptor_set(m_common_resources->combined_sampler_ds_layout);
 }
 
 // -----------------------------------------------------------------------------------------------------------------------------------
@@ -320,7 +861,7 @@ void GBuffer::write_descriptor_sets()
         image_info[2].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
         image_info[3].sampler     = vk_backend->nearest_sampler()->handle();
-        image_info[3].imageView   = m_depth_view[i]->handle();
+        image_info[3].imageView   = m_depth_mips_view[i]->handle();
         image_info[3].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
         VkWriteDescriptorSet write_data[4];
@@ -358,6 +899,118 @@ void GBuffer::write_descriptor_sets()
         write_data[3].dstSet          = m_ds[i]->handle();
 
         vkUpdateDescriptorSets(vk_backend->device(), 4, &write_data[0], 0, nullptr);
+
+        BindlessHeap* bindless_heap = m_common_resources->bindless_heap.get();
+
+        m_bindless_indices[i].x = bindless_heap->register_sampled_image(m_image_1_view[i], vk_backend->nearest_sampler());
+        m_bindless_indices[i].y = bindless_heap->register_sampled_image(m_image_2_view[i], vk_backend->nearest_sampler());
+        m_bindless_indices[i].z = bindless_heap->register_sampled_image(m_image_3_view[i], vk_backend->nearest_sampler());
+        m_bindless_indices[i].w = bindless_heap->register_sampled_image(m_depth_mips_view[i], vk_backend->nearest_sampler());
+    }
+
+    // Downsample
+    for (int i = 0; i < 2; i++)
+    {
+        std::vector<VkDescriptorImageInfo> image_infos;
+        std::vector<VkWriteDescriptorSet>  write_datas;
+        VkWriteDescriptorSet               write_data;
+
+        image_infos.reserve(4 + 5 * GBUFFER_MIP_LEVELS);
+        write_datas.reserve(10);
+
+        dw::vk::ImageView::Ptr input_views[] = { m_image_1_fbo_view[i], m_image_2_fbo_view[i], m_image_3_fbo_view[i], m_depth_fbo_view[i] };
+
+        for (int j = 0; j < 4; j++)
+        {
+            VkDescriptorImageInfo sampler_image_info;
+
+            sampler_image_info.sampler     = vk_backend->nearest_sampler()->handle();
+            sampler_image_info.imageView   = input_views[j]->handle();
+            sampler_image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+            image_infos.push_back(sampler_image_info);
+
+            DW_ZERO_MEMORY(write_data);
+
+            write_data.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            write_data.descriptorCount = 1;
+            write_data.descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            write_data.pImageInfo      = &image_infos.back();
+            write_data.dstBinding      = j;
+            write_data.dstSet          = m_downsample.ds[i]->handle();
+
+            write_datas.push_back(write_data);
+        }
+
+        std::vector<dw::vk::ImageView::Ptr>* mip_views[] = { &m_downsample.image_1_mip_views[i], &m_downsample.image_2_mip_views[i], &m_downsample.image_3_mip_views[i], &m_downsample.depth_mip_views[i], &m_downsample.hiz_mip_views };
+        const uint32_t                       bindings[]  = { 4, 5, 6, 7, 9 };
+
+        for (int j = 0; j < 5; j++)
+        {
+            const uint32_t first = image_infos.size();
+
+            for (auto& view : *mip_views[j])
+            {
+                VkDescriptorImageInfo storage_image_info;
+
+                storage_image_info.sampler     = VK_NULL_HANDLE;
+                storage_image_info.imageView   = view->handle();
+                storage_image_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+                image_infos.push_back(storage_image_info);
+            }
+
+            DW_ZERO_MEMORY(write_data);
+
+            write_data.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            write_data.descriptorCount = mip_views[j]->size();
+            write_data.descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+            write_data.pImageInfo      = &image_infos[first];
+            write_data.dstBinding      = bindings[j];
+            write_data.dstSet          = m_downsample.ds[i]->handle();
+
+            write_datas.push_back(write_data);
+        }
+
+        VkDescriptorBufferInfo buffer_info;
+
+        buffer_info.range  = m_downsample.scratch_buffer->size();
+        buffer_info.offset = 0;
+        buffer_info.buffer = m_downsample.scratch_buffer->handle();
+
+        DW_ZERO_MEMORY(write_data);
+
+        write_data.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write_data.descriptorCount = 1;
+        write_data.descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        write_data.pBufferInfo     = &buffer_info;
+        write_data.dstBinding      = 8;
+        write_data.dstSet          = m_downsample.ds[i]->handle();
+
+        write_datas.push_back(write_data);
+
+        vkUpdateDescriptorSets(vk_backend->device(), write_datas.size(), write_datas.data(), 0, nullptr);
+    }
+
+    // Hi-Z
+    {
+        VkDescriptorImageInfo image_info;
+
+        image_info.sampler     = vk_backend->nearest_sampler()->handle();
+        image_info.imageView   = m_hiz_view->handle();
+        image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+        VkWriteDescriptorSet write_data;
+        DW_ZERO_MEMORY(write_data);
+
+        write_data.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write_data.descriptorCount = 1;
+        write_data.descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        write_data.pImageInfo      = &image_info;
+        write_data.dstBinding      = 0;
+        write_data.dstSet          = m_cull.hiz_ds->handle();
+
+        vkUpdateDescriptorSets(vk_backend->device(), 1, &write_data, 0, nullptr);
     }
 }
 
@@ -370,34 +1023,34 @@ void GBuffer::create_render_pass()
     std::vector<VkAttachmentDescription> attachments(4);
 
     // GBuffer1 attachment
-    attachments[0].format         = VK_FORMAT_R8G8B8A8_UNORM;
+    attachments[0].format         = GBUFFER_1_FORMAT;
     attachments[0].samples        = VK_SAMPLE_COUNT_1_BIT;
     attachments[0].loadOp         = VK_ATTACHMENT_LOAD_OP_CLEAR;
     attachments[0].storeOp        = VK_ATTACHMENT_STORE_OP_STORE;
     attachments[0].stencilLoadOp  = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     attachments[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     attachments[0].initialLayout  = VK_IMAGE_LAYOUT_UNDEFINED;
-    attachments[0].finalLayout    = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    attachments[0].finalLayout    = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
     // GBuffer2 attachment
-    attachments[1].format         = VK_FORMAT_R16G16B16A16_SFLOAT;
+    attachments[1].format         = GBUFFER_2_FORMAT;
     attachments[1].samples        = VK_SAMPLE_COUNT_1_BIT;
     attachments[1].loadOp         = VK_ATTACHMENT_LOAD_OP_CLEAR;
     attachments[1].storeOp        = VK_ATTACHMENT_STORE_OP_STORE;
     attachments[1].stencilLoadOp  = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     attachments[1].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     attachments[1].initialLayout  = VK_IMAGE_LAYOUT_UNDEFINED;
-    attachments[1].finalLayout    = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    attachments[1].finalLayout    = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
     // GBuffer3 attachment
-    attachments[2].format         = VK_FORMAT_R16G16B16A16_SFLOAT;
+    attachments[2].format         = GBUFFER_3_FORMAT;
     attachments[2].samples        = VK_SAMPLE_COUNT_1_BIT;
     attachments[2].loadOp         = VK_ATTACHMENT_LOAD_OP_CLEAR;
     attachments[2].storeOp        = VK_ATTACHMENT_STORE_OP_STORE;
     attachments[2].stencilLoadOp  = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     attachments[2].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     attachments[2].initialLayout  = VK_IMAGE_LAYOUT_UNDEFINED;
-    attachments[2].finalLayout    = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    attachments[2].finalLayout    = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
     // Depth attachment
     attachments[3].format         = vk_backend->swap_chain_depth_format();
@@ -407,7 +1060,7 @@ void GBuffer::create_render_pass()
     attachments[3].stencilLoadOp  = VK_ATTACHMENT_LOAD_OP_CLEAR;
     attachments[3].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     attachments[3].initialLayout  = VK_IMAGE_LAYOUT_UNDEFINED;
-    attachments[3].finalLayout    = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    attachments[3].finalLayout    = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
     VkAttachmentReference gbuffer_references[3];
 
@@ -456,6 +1109,19 @@ void GBuffer::create_render_pass()
     dependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
 
     m_rp = dw::vk::RenderPass::create(vk_backend, attachments, subpass_description, dependencies);
+
+    // The second phase of occlusion culling draws on top of the first, which left every target ready to be sampled.
+    for (auto& attachment : attachments)
+    {
+        attachment.loadOp        = VK_ATTACHMENT_LOAD_OP_LOAD;
+        attachment.initialLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    }
+
+    attachments[3].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+
+    dependencies[0].dstAccessMask |= VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT;
+
+    m_second_phase_rp = dw::vk::RenderPass::create(vk_backend, attachments, subpass_description, dependencies);
 }
 
 // -----------------------------------------------------------------------------------------------------------------------------------
@@ -474,6 +1140,8 @@ void GBuffer::create_pipeline()
 {
     auto vk_backend = m_backend.lock();
 
+    std::vector<PipelineCache::ComputePipelineDesc> compute_pipelines;
+
     // ---------------------------------------------------------------------------
     // Create shader modules
     // ---------------------------------------------------------------------------
@@ -583,6 +1251,7 @@ void GBuffer::create_pipeline()
 
     pl_desc.add_descriptor_set_layout(m_common_resources->current_scene()->descriptor_set_layout())
         .add_descriptor_set_layout(m_common_resources->per_frame_ds_layout)
+        .add_descriptor_set_layout(m_cull.ds_layout)
         .add_push_constant_range(VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(GBufferPushConstants));
 
     m_pipeline_layout = dw::vk::PipelineLayout::create(vk_backend, pl_desc);
@@ -603,6 +1272,42 @@ void GBuffer::create_pipeline()
     pso_desc.set_render_pass(m_rp);
 
     m_pipeline = dw::vk::GraphicsPipeline::create(vk_backend, pso_desc);
+
+    // ---------------------------------------------------------------------------
+    // Create downsample pipeline
+    // ---------------------------------------------------------------------------
+
+    {
+        dw::vk::PipelineLayout::Desc desc;
+
+        desc.add_descriptor_set_layout(m_downsample.ds_layout);
+        desc.add_push_constant_range(VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(DownsamplePushConstants));
+
+        m_downsample.pipeline_layout = dw::vk::PipelineLayout::create(vk_backend, desc);
+        m_downsample.pipeline_layout->set_name("G-Buffer Downsample Pipeline Layout");
+
+        compute_pipelines.push_back({ "shaders/g_buffer_downsample.comp.spv", m_downsample.pipeline_layout, &m_downsample.pipeline });
+    }
+
+    // ---------------------------------------------------------------------------
+    // Create cull pipeline
+    // ---------------------------------------------------------------------------
+
+    {
+        dw::vk::PipelineLayout::Desc desc;
+
+        desc.add_descriptor_set_layout(m_cull.ds_layout);
+        desc.add_descriptor_set_layout(m_common_resources->per_frame_ds_layout);
+        desc.add_descriptor_set_layout(m_common_resources->combined_sampler_ds_layout);
+        desc.add_push_constant_range(VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(CullPushConstants));
+
+        m_cull.pipeline_layout = dw::vk::PipelineLayout::create(vk_backend, desc);
+        m_cull.pipeline_layout->set_name("G-Buffer Cull Pipeline Layout");
+
+        compute_pipelines.push_back({ "shaders/g_buffer_cull.comp.spv", m_cull.pipeline_layout, &m_cull.pipeline });
+    }
+
+    m_common_resources->pipeline_cache->create_compute_pipelines(compute_pipelines);
 }
 
 // -----------------------------------------------------------------------------------------------------------------------------------
\ No newline at end of file
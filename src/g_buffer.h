@@ -1,8 +1,11 @@
 #pragma once
 
 #include <vk.h>
+#include <mesh.h>
+#include "pipeline_cache.h"
 
 struct CommonResources;
+class QueueTransfer;
 
 class GBuffer
 {
@@ -10,23 +13,85 @@ public:
     GBuffer(std::weak_ptr<dw::vk::Backend> backend, CommonResources* common_resources, uint32_t input_width, uint32_t input_height);
     ~GBuffer();
 
+    void                             prepare();
     void                             render(dw::vk::CommandBuffer::Ptr cmd_buf);
+    void                             gui();
     dw::vk::DescriptorSetLayout::Ptr ds_layout();
     dw::vk::DescriptorSet::Ptr       output_ds();
     dw::vk::DescriptorSet::Ptr       history_ds();
+    dw::vk::DescriptorSet::Ptr       hiz_ds();
+    glm::uvec4                       output_bindless_indices();
+    glm::uvec4                       history_bindless_indices();
     dw::vk::ImageView::Ptr           depth_fbo_image_view(uint32_t idx);
+    void                             add_queue_transfer_resources(QueueTransfer& transfer);
 
 private:
     void create_images();
+    void create_buffers();
+    void create_scene_draws(uint32_t scene_idx);
     void create_descriptor_set_layouts();
     void create_descriptor_sets();
     void write_descriptor_sets();
     void create_render_pass();
     void create_framebuffer();
     void create_pipeline();
-    void downsample_gbuffer(dw::vk::CommandBuffer::Ptr cmd_buf);
+    void cull(dw::vk::CommandBuffer::Ptr cmd_buf, bool occlusion_culling, bool second_phase);
+    void geometry_pass(dw::vk::CommandBuffer::Ptr cmd_buf, bool second_phase);
+    void draw(dw::vk::CommandBuffer::Ptr cmd_buf);
+    void downsample_gbuffer(dw::vk::CommandBuffer::Ptr cmd_buf, bool hiz_only);
 
 private:
+    // The submeshes of every instance of a scene, uploaded once and grouped by mesh so that each group is drawn with a single
+    // vertex and index buffer bind.
+    struct SceneDraws
+    {
+        struct Group
+        {
+            std::weak_ptr<dw::Mesh> mesh;
+            uint32_t                first_draw;
+            uint32_t                num_draws;
+        };
+
+        uint32_t                                  num_draws = 0;
+        std::vector<Group>                        groups;
+        std::vector<VkDrawIndexedIndirectCommand> commands; // Every draw, in group order, for when culling is disabled
+        dw::vk::Buffer::Ptr                       draw_data_buffer;
+        dw::vk::Buffer::Ptr                       draw_args_buffer;
+        dw::vk::Buffer::Ptr                       draw_count_buffer;
+        dw::vk::Buffer::Ptr                       retest_buffer; // Dispatch args of the second culling phase, then the draws it retests
+        dw::vk::DescriptorSet::Ptr                ds;
+    };
+
+    // Two phase occlusion culling: the first phase tests against the previous frame's Hi-Z and draws what it finds visible, the
+    // Hi-Z is then rebuilt from that depth and the draws the first phase rejected are tested again and drawn if they pass.
+    struct Cull
+    {
+        bool                             supported         = true; // Needs drawIndirectCount and drawIndirectFirstInstance
+        bool                             gpu_driven        = true;
+        bool                             frustum_culling   = true;
+        bool                             occlusion_culling = true;
+        int32_t                          last_scene_type   = -1;
+        CachedComputePipeline::Ptr       pipeline;
+        dw::vk::PipelineLayout::Ptr      pipeline_layout;
+        dw::vk::DescriptorSetLayout::Ptr ds_layout;
+        dw::vk::DescriptorSet::Ptr       hiz_ds;
+    };
+
+    // Builds every mip of every target in a single dispatch, see g_buffer_downsample.comp.
+    struct Downsample
+    {
+        CachedComputePipeline::Ptr          pipeline;
+        dw::vk::PipelineLayout::Ptr         pipeline_layout;
+        dw::vk::DescriptorSetLayout::Ptr    ds_layout;
+        dw::vk::DescriptorSet::Ptr          ds[2];
+        dw::vk::Buffer::Ptr                 scratch_buffer;
+        std::vector<dw::vk::ImageView::Ptr> image_1_mip_views[2];
+        std::vector<dw::vk::ImageView::Ptr> image_2_mip_views[2];
+        std::vector<dw::vk::ImageView::Ptr> image_3_mip_views[2];
+        std::vector<dw::vk::ImageView::Ptr> depth_mip_views[2];
+        std::vector<dw::vk::ImageView::Ptr> hiz_mip_views;
+    };
+
     std::weak_ptr<dw::vk::Backend>   m_backend;
     CommonResources*                 m_common_resources;
     uint32_t                         m_input_width;
@@ -35,18 +100,26 @@ private:
     dw::vk::Image::Ptr               m_image_2[2]; // RG: Normal, BA: Motion Vector
     dw::vk::Image::Ptr               m_image_3[2]; // R: Roughness, G: Curvature, B: Mesh ID, A: Linear Z
     dw::vk::Image::Ptr               m_depth[2];
+    dw::vk::Image::Ptr               m_depth_mips[2]; // R: Depth, the mip chain of m_depth that is sampled by every pass
+    dw::vk::Image::Ptr               m_hiz; // R: Farthest Depth, G: Closest Depth, from half resolution down, read by the next frame's culling and by SSR
+    dw::vk::ImageView::Ptr           m_hiz_view;
     dw::vk::ImageView::Ptr           m_image_1_view[2];
     dw::vk::ImageView::Ptr           m_image_2_view[2];
     dw::vk::ImageView::Ptr           m_image_3_view[2];
-    dw::vk::ImageView::Ptr           m_depth_view[2];
+    dw::vk::ImageView::Ptr           m_depth_mips_view[2];
     dw::vk::ImageView::Ptr           m_image_1_fbo_view[2];
     dw::vk::ImageView::Ptr           m_image_2_fbo_view[2];
     dw::vk::ImageView::Ptr           m_image_3_fbo_view[2];
     dw::vk::ImageView::Ptr           m_depth_fbo_view[2];
     dw::vk::Framebuffer::Ptr         m_fbo[2];
     dw::vk::RenderPass::Ptr          m_rp;
+    dw::vk::RenderPass::Ptr          m_second_phase_rp; // Same as m_rp but loads the targets that the first phase drew into
     dw::vk::GraphicsPipeline::Ptr    m_pipeline;
     dw::vk::PipelineLayout::Ptr      m_pipeline_layout;
     dw::vk::DescriptorSetLayout::Ptr m_ds_layout;
     dw::vk::DescriptorSet::Ptr       m_ds[2];
+    glm::uvec4                       m_bindless_indices[2]; // Same targets as m_ds, x: image 1, y: image 2, z: image 3, w: depth
+    Downsample                       m_downsample;
+    Cull                             m_cull;
+    std::vector<SceneDraws>          m_scene_draws;
 };
\ No newline at end of file
@@ -0,0 +1,214 @@
+#include "gpu_counters.h"
+#include "render_graph.h"
+#include "utilities.h"
+#include <macros.h>
+#include <string.h>
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static const char* kCounterNames[] = {
+    "Shadow Rays",
+    "AO Rays",
+    "Reflection Rays",
+    "GI Rays",
+    "Shadow Denoise Tiles",
+    "Shadow Skipped Tiles",
+    "AO Denoise Tiles",
+    "Reflection Denoise Tiles",
+    "Reflection Copy Tiles",
+    "Reflection Trace Tiles",
+    "Reflection Reconstruct Tiles"
+};
+
+static const char* kCounterTimers[] = {
+    "Shadows Ray Trace",
+    "AO Ray Trace",
+    "Reflections Ray Trace",
+    "DDGI Ray Trace",
+    "Shadows A-Trous",
+    "",
+    "",
+    "",
+    "",
+    "",
+    ""
+};
+
+static_assert(sizeof(kCounterNames) / sizeof(kCounterNames[0]) == GPU_COUNTER_COUNT, "Every GPU counter needs a name");
+static_assert(sizeof(kCounterTimers) / sizeof(kCounterTimers[0]) == GPU_COUNTER_COUNT, "Every GPU counter needs a timer entry");
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+GPUCounters::GPUCounters(dw::vk::Backend::Ptr backend) :
+    m_backend(backend)
+{
+    const VkDeviceSize counters_size = sizeof(uint32_t) * GPU_COUNTERS_NUM_ATOMIC;
+    const VkDeviceSize readback_size = sizeof(uint32_t) * GPU_COUNTER_COUNT;
+
+    m_counter_buffer = dw::vk::Buffer::create(backend, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, counters_size * dw::vk::Backend::kMaxFramesInFlight, VMA_MEMORY_USAGE_GPU_ONLY, 0);
+    m_counter_buffer->set_name("GPU Counters");
+
+    // CPU_ONLY memory is host coherent, unlike GPU_TO_CPU which may be cached without it. The slots are read and cleared through
+    // the mapping without flushing or invalidating, and they are only a few bytes, so the uncached reads cost nothing.
+    m_readback_buffer = dw::vk::Buffer::create(backend, VK_BUFFER_USAGE_TRANSFER_DST_BIT, readback_size * dw::vk::Backend::kMaxFramesInFlight, VMA_MEMORY_USAGE_CPU_ONLY, VMA_ALLOCATION_CREATE_MAPPED_BIT);
+    m_readback_buffer->set_name("GPU Counters Readback");
+
+    memset(m_readback_buffer->mapped_ptr(), 0, readback_size * dw::vk::Backend::kMaxFramesInFlight);
+
+    dw::vk::DescriptorSetLayout::Desc desc;
+
+    desc.add_binding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_COMPUTE_BIT);
+
+    m_ds_layout = dw::vk::DescriptorSetLayout::create(backend, desc);
+    m_ds_layout->set_name("GPU Counters DS Layout");
+
+    for (int i = 0; i < dw::vk::Backend::kMaxFramesInFlight; i++)
+    {
+        m_frames[i] = -1;
+
+        m_ds[i] = backend->allocate_descriptor_set(m_ds_layout);
+
+        VkDescriptorBufferInfo buffer_info;
+
+        buffer_info.range  = counters_size;
+        buffer_info.offset = counters_size * i;
+        buffer_info.buffer = m_counter_buffer->handle();
+
+        VkWriteDescriptorSet write_data;
+        DW_ZERO_MEMORY(write_data);
+
+        write_data.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write_data.descriptorCount = 1;
+        write_data.descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        write_data.pBufferInfo     = &buffer_info;
+        write_data.dstBinding      = 0;
+        write_data.dstSet          = m_ds[i]->handle();
+
+        vkUpdateDescriptorSets(backend->device(), 1, &write_data, 0, nullptr);
+    }
+
+    for (int i = 0; i < GPU_COUNTER_COUNT; i++)
+        m_results.push_back({ kCounterNames[i], kCounterTimers[i], 0 });
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+GPUCounters::~GPUCounters()
+{
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void GPUCounters::begin_frame(dw::vk::CommandBuffer::Ptr cmd_buf, int32_t frame)
+{
+    auto backend = m_backend.lock();
+
+    m_current_frame = backend->current_frame_idx();
+
+    uint32_t* slot = (uint32_t*)m_readback_buffer->mapped_ptr() + GPU_COUNTER_COUNT * m_current_frame;
+
+    // The fence of this frame index has been waited on, so the copies recorded the last time it was used have landed. The slot
+    // is cleared for this frame from the host, which the submission makes visible to the copies recorded below.
+    if (m_frames[m_current_frame] >= 0)
+    {
+        for (int i = 0; i < GPU_COUNTER_COUNT; i++)
+            m_results[i].value = slot[i];
+
+        m_results_frame = m_frames[m_current_frame];
+    }
+
+    memset(slot, 0, sizeof(uint32_t) * GPU_COUNTER_COUNT);
+
+    m_frames[m_current_frame] = m_enabled ? frame : -1;
+
+    // The shaders add to the counters whether or not they are read back, so they are reset every frame.
+    const VkDeviceSize counters_size = sizeof(uint32_t) * GPU_COUNTERS_NUM_ATOMIC;
+
+    {
+        std::vector<VkBufferMemoryBarrier> buffer_barriers = {
+            buffer_memory_barrier(m_counter_buffer, counters_size * m_current_frame, counters_size, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_READ_BIT, VK_ACCESS_TRANSFER_WRITE_BIT)
+        };
+
+        pipeline_barrier(cmd_buf, {}, {}, buffer_barriers, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR | VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+    }
+
+    vkCmdFillBuffer(cmd_buf->handle(), m_counter_buffer->handle(), counters_size * m_current_frame, counters_size, 0);
+
+    {
+        std::vector<VkBufferMemoryBarrier> buffer_barriers = {
+            buffer_memory_barrier(m_counter_buffer, counters_size * m_current_frame, counters_size, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT)
+        };
+
+        pipeline_barrier(cmd_buf, {}, {}, buffer_barriers, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR);
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void GPUCounters::end_frame(dw::vk::CommandBuffer::Ptr cmd_buf)
+{
+    if (!m_enabled)
+        return;
+
+    const VkDeviceSize counters_size = sizeof(uint32_t) * GPU_COUNTERS_NUM_ATOMIC;
+
+    {
+        std::vector<VkBufferMemoryBarrier> buffer_barriers = {
+            buffer_memory_barrier(m_counter_buffer, counters_size * m_current_frame, counters_size, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT)
+        };
+
+        pipeline_barrier(cmd_buf, {}, {}, buffer_barriers, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, VK_PIPELINE_STAGE_TRANSFER_BIT);
+    }
+
+    VkBufferCopy region;
+
+    region.srcOffset = counters_size * m_current_frame;
+    region.dstOffset = sizeof(uint32_t) * GPU_COUNTER_COUNT * m_current_frame;
+    region.size      = counters_size;
+
+    vkCmdCopyBuffer(cmd_buf->handle(), m_counter_buffer->handle(), m_readback_buffer->handle(), 1, &region);
+
+    {
+        std::vector<VkBufferMemoryBarrier> buffer_barriers = {
+            buffer_memory_barrier(m_readback_buffer, region.dstOffset, region.size, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_HOST_READ_BIT)
+        };
+
+        pipeline_barrier(cmd_buf, {}, {}, buffer_barriers, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT);
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void GPUCounters::copy(dw::vk::CommandBuffer::Ptr cmd_buf, GPUCounterId id, dw::vk::Buffer::Ptr buffer, VkDeviceSize offset)
+{
+    if (!m_enabled)
+        return;
+
+    VkBufferCopy region;
+
+    region.srcOffset = offset;
+    region.dstOffset = sizeof(uint32_t) * (GPU_COUNTER_COUNT * m_current_frame + id);
+    region.size      = sizeof(uint32_t);
+
+    vkCmdCopyBuffer(cmd_buf->handle(), buffer->handle(), m_readback_buffer->handle(), 1, &region);
+
+    // Besides making the copy visible to the host, the source must not be reset before it has been read. Effects that do not go
+    // through the render graph only order their resets against the shader and indirect stages, which the transfer is chained to.
+    {
+        std::vector<VkBufferMemoryBarrier> buffer_barriers = {
+            buffer_memory_barrier(m_readback_buffer, region.dstOffset, region.size, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_HOST_READ_BIT)
+        };
+
+        pipeline_barrier(cmd_buf, {}, {}, buffer_barriers, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT);
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void GPUCounters::add_queue_transfer_resources(QueueTransfer& transfer)
+{
+    transfer.add_buffer(m_counter_buffer);
+    transfer.add_buffer(m_readback_buffer);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <vk.h>
+
+class QueueTransfer;
+
+// Must match gpu_counters.glsl. The first GPU_COUNTERS_NUM_ATOMIC counters are incremented by the shaders that cast the rays,
+// the others are copied from the indirect dispatch arguments the denoisers and the adaptive reflections already build on the GPU.
+enum GPUCounterId
+{
+    GPU_COUNTER_SHADOW_RAYS,
+    GPU_COUNTER_AO_RAYS,
+    GPU_COUNTER_REFLECTION_RAYS,
+    GPU_COUNTER_GI_RAYS,
+    GPU_COUNTER_SHADOW_DENOISE_TILES,
+    GPU_COUNTER_SHADOW_SKIPPED_TILES,
+    GPU_COUNTER_AO_DENOISE_TILES,
+    GPU_COUNTER_REFLECTION_DENOISE_TILES,
+    GPU_COUNTER_REFLECTION_COPY_TILES,
+    GPU_COUNTER_REFLECTION_TRACE_TILES,
+    GPU_COUNTER_REFLECTION_RECONSTRUCT_TILES,
+    GPU_COUNTER_COUNT
+};
+
+#define GPU_COUNTERS_NUM_ATOMIC 4
+
+// Counts GPU work without waiting on it. Every frame in flight owns a region of a device buffer, which the ray tracing shaders
+// add to through gpu_counters.glsl, and a slot of a persistently mapped readback buffer. Effects copy their dispatch arguments
+// into the slot once the passes consuming them have run, end_frame() copies the device region after them, and the slot is read
+// the next time the same frame index comes around, so like GPUTimer the results lag kMaxFramesInFlight frames behind. Counters
+// of effects that did not run in a frame read as 0. Only the rays launched by the ray generation and compute shaders are
+// counted, the shadow rays traced from closest hit shaders are not.
+class GPUCounters
+{
+public:
+    struct Result
+    {
+        std::string name;
+        std::string timer; // Name of the GPU timer scope that did the counted work, empty if there is none
+        uint32_t    value;
+    };
+
+public:
+    GPUCounters(dw::vk::Backend::Ptr backend);
+    ~GPUCounters();
+
+    void begin_frame(dw::vk::CommandBuffer::Ptr cmd_buf, int32_t frame);
+    void end_frame(dw::vk::CommandBuffer::Ptr cmd_buf);
+
+    // The caller makes the GPU writes to the buffer available to the transfer stage, the copy then takes care of the rest.
+    void copy(dw::vk::CommandBuffer::Ptr cmd_buf, GPUCounterId id, dw::vk::Buffer::Ptr buffer, VkDeviceSize offset = 0);
+
+    // Effects on the async compute queue add to the counters and copy into the readback slots.
+    void add_queue_transfer_resources(QueueTransfer& transfer);
+
+    inline void                             set_enabled(bool value) { m_enabled = value; }
+    inline bool                             enabled() { return m_enabled; }
+    inline const std::vector<Result>&       results() { return m_results; }
+    inline int32_t                          results_frame() { return m_results_frame; }
+    inline dw::vk::DescriptorSetLayout::Ptr ds_layout() { return m_ds_layout; }
+    inline dw::vk::DescriptorSet::Ptr       current_ds() { return m_ds[m_current_frame]; }
+
+private:
+    std::weak_ptr<dw::vk::Backend>   m_backend;
+    bool                             m_enabled       = false;
+    uint32_t                         m_current_frame = 0;
+    int32_t                          m_results_frame = -1;
+    int32_t                          m_frames[dw::vk::Backend::kMaxFramesInFlight];
+    dw::vk::Buffer::Ptr              m_counter_buffer;  // GPU_COUNTERS_NUM_ATOMIC counters per frame in flight
+    dw::vk::Buffer::Ptr              m_readback_buffer; // GPU_COUNTER_COUNT counters per frame in flight
+    dw::vk::DescriptorSetLayout::Ptr m_ds_layout;
+    dw::vk::DescriptorSet::Ptr       m_ds[dw::vk::Backend::kMaxFramesInFlight];
+    std::vector<Result>              m_results;
+};
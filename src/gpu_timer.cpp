@@ -0,0 +1,186 @@
+#include "gpu_timer.h"
+#include <macros.h>
+#include <stdexcept>
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static const uint32_t FRAME_BEGIN_QUERY = 0;
+static const uint32_t FRAME_END_QUERY   = 1;
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+GPUTimer::GPUTimer(dw::vk::Backend::Ptr backend) :
+    m_backend(backend)
+{
+    VkPhysicalDeviceProperties properties;
+
+    vkGetPhysicalDeviceProperties(backend->physical_device(), &properties);
+
+    // Timestamps are in device ticks, the period converts them to nanoseconds.
+    m_timestamp_period = properties.limits.timestampPeriod;
+
+    VkQueryPoolCreateInfo query_pool_info;
+
+    DW_ZERO_MEMORY(query_pool_info);
+
+    query_pool_info.sType      = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    query_pool_info.queryType  = VK_QUERY_TYPE_TIMESTAMP;
+    query_pool_info.queryCount = GPU_TIMER_MAX_QUERIES;
+
+    for (int i = 0; i < dw::vk::Backend::kMaxFramesInFlight; i++)
+    {
+        if (vkCreateQueryPool(backend->device(), &query_pool_info, nullptr, &m_frames[i].query_pool) != VK_SUCCESS)
+        {
+            DW_LOG_ERROR("Failed to create GPU Timer Query Pool");
+            throw std::runtime_error("Failed to create GPU Timer Query Pool");
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+GPUTimer::~GPUTimer()
+{
+    auto backend = m_backend.lock();
+
+    for (int i = 0; i < dw::vk::Backend::kMaxFramesInFlight; i++)
+        vkDestroyQueryPool(backend->device(), m_frames[i].query_pool, nullptr);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void GPUTimer::begin_frame(dw::vk::CommandBuffer::Ptr cmd_buf, int32_t frame)
+{
+    auto backend = m_backend.lock();
+
+    m_current_frame = backend->current_frame_idx();
+
+    Frame& current = m_frames[m_current_frame];
+
+    // The fence of this frame index has been waited on, so the queries recorded the last time it was used are available.
+    if (current.num_queries > 0)
+    {
+        std::vector<uint64_t> timestamps(current.num_queries);
+
+        vkGetQueryPoolResults(backend->device(), current.query_pool, 0, current.num_queries, sizeof(uint64_t) * timestamps.size(), timestamps.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+
+        m_results.clear();
+
+        if (current.frame_begun && current.frame_ended)
+            m_frame_milliseconds = float(double(timestamps[FRAME_END_QUERY] - timestamps[FRAME_BEGIN_QUERY]) * double(m_timestamp_period) / 1000000.0);
+
+        for (const auto& scope : current.scopes)
+        {
+            const float milliseconds = float(double(timestamps[scope.end_query] - timestamps[scope.start_query]) * double(m_timestamp_period) / 1000000.0);
+
+            bool found = false;
+
+            for (auto& result : m_results)
+            {
+                if (result.name == scope.name)
+                {
+                    result.milliseconds += milliseconds;
+                    found = true;
+                    break;
+                }
+            }
+
+            if (!found)
+                m_results.push_back({ scope.name, milliseconds });
+        }
+
+        m_results_frame = current.frame;
+    }
+
+    current.num_queries = 0;
+    current.frame       = frame;
+    current.frame_begun = false;
+    current.frame_ended = false;
+    current.scopes.clear();
+
+    vkCmdResetQueryPool(cmd_buf->handle(), current.query_pool, 0, GPU_TIMER_MAX_QUERIES);
+
+    if (!m_enabled)
+        return;
+
+    // This is the first command buffer submitted to the graphics queue in the frame.
+    vkCmdWriteTimestamp(cmd_buf->handle(), VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, current.query_pool, FRAME_BEGIN_QUERY);
+
+    current.num_queries = 2;
+    current.frame_begun = true;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void GPUTimer::end_frame(dw::vk::CommandBuffer::Ptr cmd_buf)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    Frame& current = m_frames[m_current_frame];
+
+    // Checked against the start rather than m_enabled, a frame that wrote one of the two timestamps has to write the other so
+    // that waiting on the results does not block forever.
+    if (!current.frame_begun)
+        return;
+
+    vkCmdWriteTimestamp(cmd_buf->handle(), VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, current.query_pool, FRAME_END_QUERY);
+
+    current.frame_ended = true;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+int32_t GPUTimer::begin(dw::vk::CommandBuffer::Ptr cmd_buf, const std::string& name)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    Frame& current = m_frames[m_current_frame];
+
+    if (!m_enabled || current.num_queries + 2 > GPU_TIMER_MAX_QUERIES)
+        return -1;
+
+    Scope scope;
+
+    scope.name        = name;
+    scope.start_query = current.num_queries++;
+    scope.end_query   = current.num_queries++;
+
+    vkCmdWriteTimestamp(cmd_buf->handle(), VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, current.query_pool, scope.start_query);
+
+    current.scopes.push_back(scope);
+
+    return static_cast<int32_t>(current.scopes.size() - 1);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void GPUTimer::end(dw::vk::CommandBuffer::Ptr cmd_buf, int32_t scope)
+{
+    if (scope < 0)
+        return;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    Frame& current = m_frames[m_current_frame];
+
+    vkCmdWriteTimestamp(cmd_buf->handle(), VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, current.query_pool, current.scopes[scope].end_query);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+ScopedGPUTimer::ScopedGPUTimer(GPUTimer* timer, dw::vk::CommandBuffer::Ptr cmd_buf, const std::string& name) :
+    m_timer(timer), m_cmd_buf(cmd_buf)
+{
+    if (m_timer)
+        m_scope = m_timer->begin(m_cmd_buf, name);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+ScopedGPUTimer::~ScopedGPUTimer()
+{
+    if (m_timer)
+        m_timer->end(m_cmd_buf, m_scope);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
\ No newline at end of file
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <vk.h>
+#include <mutex>
+
+#define GPU_TIMER_MAX_QUERIES 256
+
+#define GPU_TIMER_CONCAT_IMPL(a, b) a##b
+#define GPU_TIMER_CONCAT(a, b) GPU_TIMER_CONCAT_IMPL(a, b)
+#define GPU_SCOPED_TIMER(name, cmd_buf, timer) ScopedGPUTimer GPU_TIMER_CONCAT(gpu_timer_scope_, __LINE__)(timer, cmd_buf, name)
+
+// Measures GPU time with timestamp queries. Every frame in flight owns a query pool, which is read back the next time the same
+// frame index comes around and is therefore already complete, so results lag kMaxFramesInFlight frames behind. Scopes sharing
+// a name within a frame are accumulated, which is how the iterations of a filter are reported as a single pass. Scopes may be
+// opened by several recording threads at once. Work on the async compute queue overlaps with the graphics queue, so the frame
+// time is not a sum of scopes but the span between a timestamp written at the start of the first graphics command buffer and
+// one written at the end of the last.
+class GPUTimer
+{
+public:
+    struct Result
+    {
+        std::string name;
+        float       milliseconds;
+    };
+
+public:
+    GPUTimer(dw::vk::Backend::Ptr backend);
+    ~GPUTimer();
+
+    void    begin_frame(dw::vk::CommandBuffer::Ptr cmd_buf, int32_t frame);
+    void    end_frame(dw::vk::CommandBuffer::Ptr cmd_buf);
+    int32_t begin(dw::vk::CommandBuffer::Ptr cmd_buf, const std::string& name);
+    void    end(dw::vk::CommandBuffer::Ptr cmd_buf, int32_t scope);
+
+    inline void                       set_enabled(bool value) { m_enabled = value; }
+    inline bool                       enabled() { return m_enabled; }
+    inline const std::vector<Result>& results() { return m_results; }
+    inline int32_t                    results_frame() { return m_results_frame; }
+    inline float                      frame_milliseconds() { return m_frame_milliseconds; }
+
+private:
+    struct Scope
+    {
+        std::string name;
+        uint32_t    start_query;
+        uint32_t    end_query;
+    };
+
+    struct Frame
+    {
+        VkQueryPool        query_pool  = VK_NULL_HANDLE;
+        uint32_t           num_queries = 0;
+        int32_t            frame       = -1;
+        bool               frame_begun = false;
+        bool               frame_ended = false;
+        std::vector<Scope> scopes;
+    };
+
+    std::weak_ptr<dw::vk::Backend> m_backend;
+    bool                           m_enabled            = false;
+    float                          m_timestamp_period   = 1.0f;
+    float                          m_frame_milliseconds = 0.0f;
+    uint32_t                       m_current_frame      = 0;
+    int32_t                        m_results_frame      = -1;
+    Frame                          m_frames[dw::vk::Backend::kMaxFramesInFlight];
+    std::vector<Result>            m_results;
+    std::mutex                     m_mutex;
+};
+
+class ScopedGPUTimer
+{
+public:
+    ScopedGPUTimer(GPUTimer* timer, dw::vk::CommandBuffer::Ptr cmd_buf, const std::string& name);
+    ~ScopedGPUTimer();
+
+private:
+    GPUTimer*                  m_timer;
+    dw::vk::CommandBuffer::Ptr m_cmd_buf;
+    int32_t                    m_scope = -1;
+};
@@ -9,9 +9,11 @@
 
 struct PathTracePushConstants
 {
-    uint32_t num_frames;
-    uint32_t max_ray_bounces;
-    float    roughness_multiplier;
+    uint32_t   num_frames;
+    uint32_t   max_ray_bounces;
+    float      roughness_multiplier;
+    uint32_t   samples_per_dispatch;
+    glm::uvec2 tile_offset;
 };
 
 // -----------------------------------------------------------------------------------------------------------------------------------
@@ -44,13 +46,17 @@ void GroundTruthPathTracer::render(dw::vk::CommandBuffer::Ptr cmd_buf)
 {
     if (m_common_resources->current_visualization_type == VISUALIZATION_TYPE_GROUND_TRUTH)
     {
+        if (m_batch.active)
+        {
+            render_batch(cmd_buf);
+            return;
+        }
+
         DW_SCOPED_SAMPLE("Ground Truth Path Trace", cmd_buf);
 
         if (m_frame_idx == 0)
             m_ping_pong = false;
 
-        auto backend = m_backend.lock();
-
         const uint32_t read_idx  = static_cast<uint32_t>(m_ping_pong);
         const uint32_t write_idx = static_cast<uint32_t>(!m_ping_pong);
 
@@ -65,59 +71,151 @@ void GroundTruthPathTracer::render(dw::vk::CommandBuffer::Ptr cmd_buf)
             pipeline_barrier(cmd_buf, {}, image_barriers, {}, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR);
         }
 
-        vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, m_path_trace.pipeline->handle());
+        bind(cmd_buf, write_idx, read_idx);
+        trace_rays(cmd_buf, m_frame_idx++, 1, glm::uvec2(0), glm::uvec2(m_width, m_height));
 
-        PathTracePushConstants push_constants;
+        {
+            std::vector<VkImageMemoryBarrier> image_barriers = {
+                image_memory_barrier(m_path_trace.images[write_idx], VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, subresource_range, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT)
+            };
 
-        push_constants.num_frames           = m_frame_idx++;
-        push_constants.max_ray_bounces      = m_path_trace.max_ray_bounces;
-        push_constants.roughness_multiplier = m_common_resources->roughness_multiplier;
+            pipeline_barrier(cmd_buf, {}, image_barriers, {}, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+        }
 
-        vkCmdPushConstants(cmd_buf->handle(), m_path_trace.pipeline_layout->handle(), VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR, 0, sizeof(push_constants), &push_constants);
+        m_ping_pong = !m_ping_pong;
+    }
+}
 
-        const uint32_t dynamic_offsets[] = {
-            m_common_resources->ubo_size * backend->current_frame_idx()
-        };
+// -----------------------------------------------------------------------------------------------------------------------------------
 
-        VkDescriptorSet descriptor_sets[] = {
-            m_common_resources->current_scene()->descriptor_set()->handle(),
-            m_path_trace.write_ds[write_idx]->handle(),
-            m_path_trace.write_ds[read_idx]->handle(),
-            m_common_resources->per_frame_ds->handle(),
-            m_common_resources->current_skybox_ds->handle()
-        };
+void GroundTruthPathTracer::begin_batch(uint32_t target_spp, uint32_t spp_per_dispatch, uint32_t tile_size, uint32_t tiles_per_frame)
+{
+    m_batch.active           = true;
+    m_batch.target_spp       = target_spp;
+    m_batch.spp_per_dispatch = std::max(spp_per_dispatch, 1u);
+    m_batch.tile_size        = std::max(tile_size, 8u);
+    m_batch.tiles_per_frame  = std::max(tiles_per_frame, 1u);
+    m_batch.num_tiles_x      = (m_width + m_batch.tile_size - 1) / m_batch.tile_size;
+    m_batch.num_tiles_y      = (m_height + m_batch.tile_size - 1) / m_batch.tile_size;
+    m_batch.next_tile        = 0;
+    m_batch.num_samples      = 0;
+
+    // The batch accumulates into the first image, which is the one output_ds() refers to while the ping pong flag is clear.
+    m_ping_pong = false;
+}
 
-        vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, m_path_trace.pipeline_layout->handle(), 0, 5, descriptor_sets, 1, dynamic_offsets);
+// -----------------------------------------------------------------------------------------------------------------------------------
 
-        auto& rt_pipeline_props = backend->ray_tracing_pipeline_properties();
+void GroundTruthPathTracer::end_batch()
+{
+    m_batch.active = false;
+    m_frame_idx    = 0;
+}
 
-        VkDeviceSize group_size   = dw::vk::utilities::aligned_size(rt_pipeline_props.shaderGroupHandleSize, rt_pipeline_props.shaderGroupBaseAlignment);
-        VkDeviceSize group_stride = group_size;
+// -----------------------------------------------------------------------------------------------------------------------------------
 
-        const VkStridedDeviceAddressRegionKHR raygen_sbt   = { m_path_trace.pipeline->shader_binding_table_buffer()->device_address(), group_stride, group_size };
-        const VkStridedDeviceAddressRegionKHR miss_sbt     = { m_path_trace.pipeline->shader_binding_table_buffer()->device_address() + m_path_trace.sbt->miss_group_offset(), group_stride, group_size };
-        const VkStridedDeviceAddressRegionKHR hit_sbt      = { m_path_trace.pipeline->shader_binding_table_buffer()->device_address() + m_path_trace.sbt->hit_group_offset(), group_stride, group_size };
-        const VkStridedDeviceAddressRegionKHR callable_sbt = { 0, 0, 0 };
+void GroundTruthPathTracer::render_batch(dw::vk::CommandBuffer::Ptr cmd_buf)
+{
+    // The image stays in the read only layout it was left in by the last pass.
+    if (batch_finished())
+        return;
 
-        uint32_t rt_image_width  = m_width;
-        uint32_t rt_image_height = m_height;
+    DW_SCOPED_SAMPLE("Ground Truth Batch Path Trace", cmd_buf);
 
-        vkCmdTraceRaysKHR(cmd_buf->handle(), &raygen_sbt, &miss_sbt, &hit_sbt, &callable_sbt, rt_image_width, rt_image_height, 1);
+    VkImageSubresourceRange subresource_range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
 
-        {
-            std::vector<VkImageMemoryBarrier> image_barriers = {
-                image_memory_barrier(m_path_trace.images[write_idx], VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, subresource_range, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT)
-            };
+    const bool first_dispatch = m_batch.num_samples == 0 && m_batch.next_tile == 0;
 
-            pipeline_barrier(cmd_buf, {}, image_barriers, {}, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+    {
+        std::vector<VkImageMemoryBarrier> image_barriers = {
+            image_memory_barrier(m_path_trace.images[0], first_dispatch ? VK_IMAGE_LAYOUT_UNDEFINED : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL, subresource_range, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT)
+        };
+
+        pipeline_barrier(cmd_buf, {}, image_barriers, {}, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR);
+    }
+
+    // Samples are accumulated in place, every invocation only reads back the pixel it writes and the tiles do not overlap.
+    bind(cmd_buf, 0, 0);
+
+    for (uint32_t i = 0; i < m_batch.tiles_per_frame; i++)
+    {
+        const glm::uvec2 tile   = glm::uvec2(m_batch.next_tile % m_batch.num_tiles_x, m_batch.next_tile / m_batch.num_tiles_x);
+        const glm::uvec2 offset = tile * m_batch.tile_size;
+        const glm::uvec2 extent = glm::min(glm::uvec2(m_batch.tile_size), glm::uvec2(m_width, m_height) - offset);
+
+        trace_rays(cmd_buf, m_batch.num_samples, m_batch.spp_per_dispatch, offset, extent);
+
+        if (++m_batch.next_tile == m_batch.num_tiles_x * m_batch.num_tiles_y)
+        {
+            m_batch.next_tile = 0;
+            m_batch.num_samples += m_batch.spp_per_dispatch;
+            break;
         }
+    }
 
-        m_ping_pong = !m_ping_pong;
+    {
+        std::vector<VkImageMemoryBarrier> image_barriers = {
+            image_memory_barrier(m_path_trace.images[0], VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, subresource_range, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT)
+        };
+
+        pipeline_barrier(cmd_buf, {}, image_barriers, {}, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
     }
 }
 
 // -----------------------------------------------------------------------------------------------------------------------------------
 
+void GroundTruthPathTracer::bind(dw::vk::CommandBuffer::Ptr cmd_buf, uint32_t write_idx, uint32_t read_idx)
+{
+    auto backend = m_backend.lock();
+
+    vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, m_path_trace.pipeline->handle());
+
+    const uint32_t dynamic_offsets[] = {
+        m_common_resources->ubo_size * backend->current_frame_idx()
+    };
+
+    VkDescriptorSet descriptor_sets[] = {
+        m_common_resources->current_scene()->descriptor_set()->handle(),
+        m_path_trace.write_ds[write_idx]->handle(),
+        m_path_trace.write_ds[read_idx]->handle(),
+        m_common_resources->per_frame_ds->handle(),
+        m_common_resources->current_skybox_ds->handle()
+    };
+
+    vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, m_path_trace.pipeline_layout->handle(), 0, 5, descriptor_sets, 1, dynamic_offsets);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void GroundTruthPathTracer::trace_rays(dw::vk::CommandBuffer::Ptr cmd_buf, uint32_t num_samples, uint32_t spp, glm::uvec2 offset, glm::uvec2 extent)
+{
+    auto backend = m_backend.lock();
+
+    PathTracePushConstants push_constants;
+
+    push_constants.num_frames           = num_samples;
+    push_constants.max_ray_bounces      = m_path_trace.max_ray_bounces;
+    push_constants.roughness_multiplier = m_common_resources->roughness_multiplier;
+    push_constants.samples_per_dispatch = spp;
+    push_constants.tile_offset          = offset;
+
+    vkCmdPushConstants(cmd_buf->handle(), m_path_trace.pipeline_layout->handle(), VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR, 0, sizeof(push_constants), &push_constants);
+
+    auto& rt_pipeline_props = backend->ray_tracing_pipeline_properties();
+
+    VkDeviceSize group_size   = dw::vk::utilities::aligned_size(rt_pipeline_props.shaderGroupHandleSize, rt_pipeline_props.shaderGroupBaseAlignment);
+    VkDeviceSize group_stride = group_size;
+
+    const VkStridedDeviceAddressRegionKHR raygen_sbt   = { m_path_trace.pipeline->shader_binding_table_buffer()->device_address(), group_stride, group_size };
+    const VkStridedDeviceAddressRegionKHR miss_sbt     = { m_path_trace.pipeline->shader_binding_table_buffer()->device_address() + m_path_trace.sbt->miss_group_offset(), group_stride, group_size };
+    const VkStridedDeviceAddressRegionKHR hit_sbt      = { m_path_trace.pipeline->shader_binding_table_buffer()->device_address() + m_path_trace.sbt->hit_group_offset(), group_stride, group_size };
+    const VkStridedDeviceAddressRegionKHR callable_sbt = { 0, 0, 0 };
+
+    vkCmdTraceRaysKHR(cmd_buf->handle(), &raygen_sbt, &miss_sbt, &hit_sbt, &callable_sbt, extent.x, extent.y, 1);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
 void GroundTruthPathTracer::gui()
 {
     auto backend = m_backend.lock();
@@ -135,13 +233,20 @@ dw::vk::DescriptorSet::Ptr GroundTruthPathTracer::output_ds()
 
 // -----------------------------------------------------------------------------------------------------------------------------------
 
+dw::vk::Image::Ptr GroundTruthPathTracer::output_image()
+{
+    return m_path_trace.images[static_cast<uint32_t>(m_ping_pong)];
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
 void GroundTruthPathTracer::create_images()
 {
     auto backend = m_backend.lock();
 
     for (int i = 0; i < 2; i++)
     {
-        m_path_trace.images[i] = dw::vk::Image::create(backend, VK_IMAGE_TYPE_2D, m_width, m_height, 1, 1, 1, VK_FORMAT_R16G16B16A16_SFLOAT, VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_SAMPLE_COUNT_1_BIT);
+        m_path_trace.images[i] = dw::vk::Image::create(backend, VK_IMAGE_TYPE_2D, m_width, m_height, 1, 1, 1, VK_FORMAT_R16G16B16A16_SFLOAT, VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_SAMPLE_COUNT_1_BIT);
         m_path_trace.images[i]->set_name("Ground Truth Path Trace");
 
         m_path_trace.image_views[i] = dw::vk::ImageView::create(backend, m_path_trace.images[i], VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT);
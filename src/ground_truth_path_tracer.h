@@ -13,10 +13,24 @@ public:
     void                       render(dw::vk::CommandBuffer::Ptr cmd_buf);
     void                       gui();
     dw::vk::DescriptorSet::Ptr output_ds();
+    dw::vk::Image::Ptr         output_image();
 
-    inline void restart_accumulation() { m_frame_idx = 0; }
+    // Offline accumulation of a reference image. Every frame traces up to tiles_per_frame tiles of the image, each in a dispatch
+    // of its own with spp_per_dispatch samples per pixel, which keeps every dispatch short enough not to trip the driver
+    // watchdog. A frame ends early once a pass over the image completes, so in between frames all pixels hold the same number
+    // of samples.
+    void begin_batch(uint32_t target_spp, uint32_t spp_per_dispatch, uint32_t tile_size, uint32_t tiles_per_frame);
+    void end_batch();
+
+    inline void     restart_accumulation() { m_frame_idx = 0; }
+    inline bool     batch_active() { return m_batch.active; }
+    inline bool     batch_finished() { return m_batch.active && m_batch.num_samples >= m_batch.target_spp; }
+    inline uint32_t batch_samples() { return m_batch.num_samples; }
 
 private:
+    void render_batch(dw::vk::CommandBuffer::Ptr cmd_buf);
+    void bind(dw::vk::CommandBuffer::Ptr cmd_buf, uint32_t write_idx, uint32_t read_idx);
+    void trace_rays(dw::vk::CommandBuffer::Ptr cmd_buf, uint32_t num_samples, uint32_t spp, glm::uvec2 offset, glm::uvec2 extent);
     void create_images();
     void create_descriptor_sets();
     void write_descriptor_sets();
@@ -35,6 +49,19 @@ private:
         dw::vk::ShaderBindingTable::Ptr sbt;
     };
 
+    struct Batch
+    {
+        bool     active           = false;
+        uint32_t target_spp       = 0;
+        uint32_t spp_per_dispatch = 1;
+        uint32_t tile_size        = 256;
+        uint32_t tiles_per_frame  = 1;
+        uint32_t num_tiles_x      = 0;
+        uint32_t num_tiles_y      = 0;
+        uint32_t next_tile        = 0;
+        uint32_t num_samples      = 0;
+    };
+
     std::weak_ptr<dw::vk::Backend> m_backend;
     CommonResources*               m_common_resources;
     uint32_t                       m_width;
@@ -42,4 +69,5 @@ private:
     uint32_t                       m_frame_idx = 0;
     bool                           m_ping_pong = false;
     PathTrace                      m_path_trace;
+    Batch                          m_batch;
 };
\ No newline at end of file
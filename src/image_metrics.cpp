@@ -0,0 +1,368 @@
+#include "image_metrics.h"
+#include "utilities.h"
+#include <algorithm>
+#define _USE_MATH_DEFINES
+#include <math.h>
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Parameters of the paper.
+static const float FLIP_QC            = 0.7f;
+static const float FLIP_QF            = 0.5f;
+static const float FLIP_PC            = 0.4f;
+static const float FLIP_PT            = 0.95f;
+static const float FLIP_FEATURE_WIDTH = 0.082f;
+
+// Contrast sensitivity of the Y, Cx and Cz channels, each a sum of two Gaussians with amplitudes a and widths b.
+static const float FLIP_CSF_A1[] = { 1.0f, 1.0f, 34.1f };
+static const float FLIP_CSF_B1[] = { 0.0047f, 0.0053f, 0.04f };
+static const float FLIP_CSF_A2[] = { 0.0f, 0.0f, 13.5f };
+static const float FLIP_CSF_B2[] = { 1e-5f, 1e-5f, 0.025f };
+
+// D65 white of linear sRGB in XYZ.
+static const glm::vec3 FLIP_WHITE = glm::vec3(0.95047f, 1.0f, 1.08883f);
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static float srgb_to_linear(float c)
+{
+    return c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static glm::vec3 linear_rgb_to_xyz(glm::vec3 c)
+{
+    return glm::vec3(0.4124564f * c.r + 0.3575761f * c.g + 0.1804375f * c.b,
+                     0.2126729f * c.r + 0.7151522f * c.g + 0.0721750f * c.b,
+                     0.0193339f * c.r + 0.1191920f * c.g + 0.9503041f * c.b);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static glm::vec3 xyz_to_linear_rgb(glm::vec3 c)
+{
+    return glm::vec3(3.2404542f * c.x - 1.5371385f * c.y - 0.4985314f * c.z,
+                     -0.9692660f * c.x + 1.8760108f * c.y + 0.0415560f * c.z,
+                     0.0556434f * c.x - 0.2040259f * c.y + 1.0572252f * c.z);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static glm::vec3 xyz_to_ycxcz(glm::vec3 xyz)
+{
+    const glm::vec3 v = xyz / FLIP_WHITE;
+
+    return glm::vec3(116.0f * v.y - 16.0f, 500.0f * (v.x - v.y), 200.0f * (v.y - v.z));
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static glm::vec3 ycxcz_to_xyz(glm::vec3 ycxcz)
+{
+    const float y = (ycxcz.x + 16.0f) / 116.0f;
+
+    return glm::vec3(y + ycxcz.y / 500.0f, y, y - ycxcz.z / 200.0f) * FLIP_WHITE;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static float lab_f(float t)
+{
+    const float delta = 6.0f / 29.0f;
+
+    return t > delta * delta * delta ? cbrtf(t) : t / (3.0f * delta * delta) + 4.0f / 29.0f;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// CIELab with the Hunt effect applied, which scales the chroma down in dark regions.
+static glm::vec3 xyz_to_hunt_lab(glm::vec3 xyz)
+{
+    const glm::vec3 v = xyz / FLIP_WHITE;
+    const float     l = 116.0f * lab_f(v.y) - 16.0f;
+    const float     a = 500.0f * (lab_f(v.x) - lab_f(v.y));
+    const float     b = 200.0f * (lab_f(v.y) - lab_f(v.z));
+
+    return glm::vec3(l, 0.01f * l * a, 0.01f * l * b);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static float hyab(glm::vec3 p, glm::vec3 q)
+{
+    const glm::vec3 d = p - q;
+
+    return fabsf(d.x) + sqrtf(d.y * d.y + d.z * d.z);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Convolves the rows or the columns of a single channel image, the borders are clamped.
+static void convolve(const std::vector<float>& src, std::vector<float>& dst, uint32_t width, uint32_t height, const std::vector<float>& kernel, bool horizontal)
+{
+    const int32_t radius = static_cast<int32_t>(kernel.size() / 2);
+
+    dst.resize(src.size());
+
+    parallel_for(height, [&](uint32_t y) {
+        for (uint32_t x = 0; x < width; x++)
+        {
+            float sum = 0.0f;
+
+            for (int32_t k = -radius; k <= radius; k++)
+            {
+                const int32_t sx = horizontal ? std::min(std::max(int32_t(x) + k, 0), int32_t(width) - 1) : int32_t(x);
+                const int32_t sy = horizontal ? int32_t(y) : std::min(std::max(int32_t(y) + k, 0), int32_t(height) - 1);
+
+                sum += kernel[k + radius] * src[sy * width + sx];
+            }
+
+            dst[y * width + x] = sum;
+        }
+    });
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static void filter(const std::vector<float>& src, std::vector<float>& dst, uint32_t width, uint32_t height, const std::vector<float>& kernel_x, const std::vector<float>& kernel_y)
+{
+    std::vector<float> tmp;
+
+    convolve(src, tmp, width, height, kernel_x, true);
+    convolve(tmp, dst, width, height, kernel_y, false);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Everything FLIP needs of one image: the CSF filtered colors in Hunt adjusted Lab and the edge and point feature strengths.
+struct FlipImage
+{
+    std::vector<glm::vec3> colors;
+    std::vector<float>     edges;
+    std::vector<float>     points;
+};
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static FlipImage flip_prepare(const std::vector<glm::vec3>& image, uint32_t width, uint32_t height, float pixels_per_degree)
+{
+    const uint32_t num_pixels = width * height;
+
+    std::vector<float> channels[3];
+
+    for (int c = 0; c < 3; c++)
+        channels[c].resize(num_pixels);
+
+    for (uint32_t i = 0; i < num_pixels; i++)
+    {
+        const glm::vec3 linear = glm::vec3(srgb_to_linear(image[i].r), srgb_to_linear(image[i].g), srgb_to_linear(image[i].b));
+        const glm::vec3 ycxcz  = xyz_to_ycxcz(linear_rgb_to_xyz(linear));
+
+        for (int c = 0; c < 3; c++)
+            channels[c][i] = ycxcz[c];
+    }
+
+    // ---------------------------------------------------------------------------
+    // Color pipeline
+    // ---------------------------------------------------------------------------
+
+    // The widest Gaussian decides the extent of all the CSF kernels.
+    const int32_t csf_radius = static_cast<int32_t>(ceilf(3.0f * sqrtf(0.04f / (2.0f * float(M_PI * M_PI))) * pixels_per_degree));
+
+    std::vector<float> filtered[3];
+
+    for (int c = 0; c < 3; c++)
+    {
+        const float a[] = { FLIP_CSF_A1[c], FLIP_CSF_A2[c] };
+        const float b[] = { FLIP_CSF_B1[c], FLIP_CSF_B2[c] };
+
+        std::vector<float> kernels[2];
+        float              weights[2] = { 0.0f, 0.0f };
+
+        // Each Gaussian is separable, their weights in the sum follow from the area of the unnormalized 2D kernels.
+        for (int t = 0; t < 2; t++)
+        {
+            if (a[t] == 0.0f)
+                continue;
+
+            float sum = 0.0f;
+
+            for (int32_t x = -csf_radius; x <= csf_radius; x++)
+            {
+                const float d = float(x) / pixels_per_degree;
+                const float w = expf(-float(M_PI * M_PI) * d * d / b[t]);
+
+                kernels[t].push_back(w);
+                sum += w;
+            }
+
+            for (float& w : kernels[t])
+                w /= sum;
+
+            weights[t] = a[t] * sqrtf(float(M_PI) / b[t]) * sum * sum;
+        }
+
+        filtered[c].assign(num_pixels, 0.0f);
+
+        for (int t = 0; t < 2; t++)
+        {
+            if (weights[t] == 0.0f)
+                continue;
+
+            std::vector<float> term;
+
+            filter(channels[c], term, width, height, kernels[t], kernels[t]);
+
+            const float weight = weights[t] / (weights[0] + weights[1]);
+
+            for (uint32_t i = 0; i < num_pixels; i++)
+                filtered[c][i] += weight * term[i];
+        }
+    }
+
+    FlipImage result;
+
+    result.colors.resize(num_pixels);
+
+    for (uint32_t i = 0; i < num_pixels; i++)
+    {
+        const glm::vec3 linear = glm::clamp(xyz_to_linear_rgb(ycxcz_to_xyz(glm::vec3(filtered[0][i], filtered[1][i], filtered[2][i]))), glm::vec3(0.0f), glm::vec3(1.0f));
+
+        result.colors[i] = xyz_to_hunt_lab(linear_rgb_to_xyz(linear));
+    }
+
+    // ---------------------------------------------------------------------------
+    // Feature pipeline
+    // ---------------------------------------------------------------------------
+
+    const float   sigma          = 0.5f * FLIP_FEATURE_WIDTH * pixels_per_degree;
+    const int32_t feature_radius = static_cast<int32_t>(ceilf(3.0f * sigma));
+
+    std::vector<float> gaussian;
+    std::vector<float> first_derivative;
+    std::vector<float> second_derivative;
+
+    float gaussian_sum = 0.0f;
+    float first_sum    = 0.0f;
+    float second_pos   = 0.0f;
+    float second_neg   = 0.0f;
+
+    for (int32_t x = -feature_radius; x <= feature_radius; x++)
+    {
+        const float g  = expf(-float(x * x) / (2.0f * sigma * sigma));
+        const float d  = -float(x) * g;
+        const float dd = (float(x * x) / (sigma * sigma) - 1.0f) * g;
+
+        gaussian.push_back(g);
+        first_derivative.push_back(d);
+        second_derivative.push_back(dd);
+
+        gaussian_sum += g;
+        first_sum += std::max(d, 0.0f);
+        second_pos += std::max(dd, 0.0f);
+        second_neg += std::min(dd, 0.0f);
+    }
+
+    // The positive weights of the detectors sum to one and the negative ones to minus one.
+    for (uint32_t i = 0; i < gaussian.size(); i++)
+    {
+        gaussian[i] /= gaussian_sum;
+        first_derivative[i] /= first_sum;
+        second_derivative[i] /= second_derivative[i] > 0.0f ? second_pos : -second_neg;
+    }
+
+    // Features are detected on the normalized achromatic channel of the unfiltered image.
+    std::vector<float>& achromatic = channels[0];
+
+    for (float& y : achromatic)
+        y = (y + 16.0f) / 116.0f;
+
+    std::vector<float> edge_x, edge_y, point_x, point_y;
+
+    filter(achromatic, edge_x, width, height, first_derivative, gaussian);
+    filter(achromatic, edge_y, width, height, gaussian, first_derivative);
+    filter(achromatic, point_x, width, height, second_derivative, gaussian);
+    filter(achromatic, point_y, width, height, gaussian, second_derivative);
+
+    result.edges.resize(num_pixels);
+    result.points.resize(num_pixels);
+
+    for (uint32_t i = 0; i < num_pixels; i++)
+    {
+        result.edges[i]  = sqrtf(edge_x[i] * edge_x[i] + edge_y[i] * edge_y[i]);
+        result.points[i] = sqrtf(point_x[i] * point_x[i] + point_y[i] * point_y[i]);
+    }
+
+    return result;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+std::vector<glm::vec3> tone_map_image(const std::vector<glm::vec4>& hdr, float exposure)
+{
+    std::vector<glm::vec3> ldr(hdr.size());
+
+    for (uint32_t i = 0; i < hdr.size(); i++)
+    {
+        const glm::vec3 x = glm::vec3(hdr[i]) * exposure;
+
+        const glm::vec3 aces = glm::clamp((x * (2.51f * x + 0.03f)) / (x * (2.43f * x + 0.59f) + 0.14f), glm::vec3(0.0f), glm::vec3(1.0f));
+
+        ldr[i] = glm::pow(aces, glm::vec3(1.0f / 2.2f));
+    }
+
+    return ldr;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+float psnr(const std::vector<glm::vec3>& reference, const std::vector<glm::vec3>& test)
+{
+    double sum = 0.0;
+
+    for (uint32_t i = 0; i < reference.size(); i++)
+    {
+        const glm::vec3 d = reference[i] - test[i];
+        sum += glm::dot(d, d);
+    }
+
+    const double mse = sum / double(3 * std::max(reference.size(), size_t(1)));
+
+    return float(10.0 * log10(1.0 / std::max(mse, 1e-10)));
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+float flip(const std::vector<glm::vec3>& reference, const std::vector<glm::vec3>& test, uint32_t width, uint32_t height, float pixels_per_degree)
+{
+    const FlipImage r = flip_prepare(reference, width, height, pixels_per_degree);
+    const FlipImage t = flip_prepare(test, width, height, pixels_per_degree);
+
+    // The largest color difference is the one between green and blue.
+    const float max_color_error = powf(hyab(xyz_to_hunt_lab(linear_rgb_to_xyz(glm::vec3(0.0f, 1.0f, 0.0f))), xyz_to_hunt_lab(linear_rgb_to_xyz(glm::vec3(0.0f, 0.0f, 1.0f)))), FLIP_QC);
+
+    double sum = 0.0;
+
+    for (uint32_t i = 0; i < width * height; i++)
+    {
+        // Color differences below pc * cmax are compressed into [0, pt], the larger ones into [pt, 1].
+        const float color_error = powf(hyab(r.colors[i], t.colors[i]), FLIP_QC);
+
+        float color_difference;
+
+        if (color_error < FLIP_PC * max_color_error)
+            color_difference = (FLIP_PT / (FLIP_PC * max_color_error)) * color_error;
+        else
+            color_difference = FLIP_PT + ((color_error - FLIP_PC * max_color_error) / (max_color_error - FLIP_PC * max_color_error)) * (1.0f - FLIP_PT);
+
+        const float feature_error      = std::max(fabsf(r.edges[i] - t.edges[i]), fabsf(r.points[i] - t.points[i]));
+        const float feature_difference = powf(std::min(feature_error / sqrtf(2.0f), 1.0f), FLIP_QF);
+
+        sum += powf(std::min(color_difference, 1.0f), 1.0f - feature_difference);
+    }
+
+    return float(sum / double(std::max(width * height, 1u)));
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <glm.hpp>
+#include <vector>
+#include <stdint.h>
+
+// Pixels per degree of a 0.7 meter wide 4K monitor seen from 0.7 meters, the default viewing condition of FLIP.
+#define IMAGE_METRICS_FLIP_DEFAULT_PPD 67.0206f
+
+// Applies the exposure, ACES fit and gamma of tone_map.frag to an HDR image, the metrics below compare images as they are
+// displayed.
+extern std::vector<glm::vec3> tone_map_image(const std::vector<glm::vec4>& hdr, float exposure);
+
+// Peak signal to noise ratio in dB over all channels of two tone mapped images, capped at 100 dB for identical images.
+extern float psnr(const std::vector<glm::vec3>& reference, const std::vector<glm::vec3>& test);
+
+// Mean LDR-FLIP error (Andersson et al. 2020) of two tone mapped images, 0 for identical images and 1 at most. The CSF and
+// feature detection filters are applied separably, which is a close approximation of the reference implementation.
+extern float flip(const std::vector<glm::vec3>& reference, const std::vector<glm::vec3>& test, uint32_t width, uint32_t height, float pixels_per_degree = IMAGE_METRICS_FLIP_DEFAULT_PPD);
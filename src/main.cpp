@@ -5,6 +5,7 @@
 #include <equirectangular_to_cubemap.h>
 #include <ImGuizmo.h>
 #include <math.h>
+#include <algorithm>
 #define GLM_ENABLE_EXPERIMENTAL
 #include <gtx/matrix_decompose.hpp>
 #include <gtc/quaternion.hpp>
@@ -14,10 +15,15 @@
 #include "ray_traced_ao.h"
 #include "ray_traced_reflections.h"
 #include "ddgi.h"
+#include "many_lights.h"
 #include "ground_truth_path_tracer.h"
 #include "tone_map.h"
 #include "temporal_aa.h"
+#include "benchmark.h"
+#include "dynamic_resolution.h"
 #include "utilities.h"
+#include "command_recorder.h"
+#include "image_metrics.h"
 
 class HybridRendering : public dw::Application
 {
@@ -27,20 +33,44 @@ public:
 protected:
     bool init(int argc, const char* argv[]) override
     {
-        m_common_resources         = std::unique_ptr<CommonResources>(new CommonResources(m_vk_backend));
-        m_g_buffer                 = std::unique_ptr<GBuffer>(new GBuffer(m_vk_backend, m_common_resources.get(), m_width, m_height));
+        m_benchmark                = std::unique_ptr<Benchmark>(new Benchmark(argc, argv));
+        m_dynamic_resolution       = std::unique_ptr<DynamicResolution>(new DynamicResolution());
+        m_common_resources         = std::unique_ptr<CommonResources>(new CommonResources(m_vk_backend, m_benchmark->enabled() ? m_benchmark->scene_type() : SCENE_TYPE_SHADOWS_TEST, m_benchmark->render_scale()));
+        m_g_buffer                 = std::unique_ptr<GBuffer>(new GBuffer(m_vk_backend, m_common_resources.get(), m_common_resources->render_width, m_common_resources->render_height));
         m_ray_traced_shadows       = std::unique_ptr<RayTracedShadows>(new RayTracedShadows(m_vk_backend, m_common_resources.get(), m_g_buffer.get()));
         m_ray_traced_ao            = std::unique_ptr<RayTracedAO>(new RayTracedAO(m_vk_backend, m_common_resources.get(), m_g_buffer.get()));
         m_ray_traced_reflections   = std::unique_ptr<RayTracedReflections>(new RayTracedReflections(m_vk_backend, m_common_resources.get(), m_g_buffer.get()));
         m_ddgi                     = std::unique_ptr<DDGI>(new DDGI(m_vk_backend, m_common_resources.get(), m_g_buffer.get()));
+        m_many_lights              = std::unique_ptr<ManyLights>(new ManyLights(m_vk_backend, m_common_resources.get(), m_g_buffer.get()));
         m_ground_truth_path_tracer = std::unique_ptr<GroundTruthPathTracer>(new GroundTruthPathTracer(m_vk_backend, m_common_resources.get()));
         m_deferred_shading         = std::unique_ptr<DeferredShading>(new DeferredShading(m_vk_backend, m_common_resources.get(), m_g_buffer.get()));
         m_temporal_aa              = std::unique_ptr<TemporalAA>(new TemporalAA(m_vk_backend, m_common_resources.get(), m_g_buffer.get()));
         m_tone_map                 = std::unique_ptr<ToneMap>(new ToneMap(m_vk_backend, m_common_resources.get()));
+        m_command_recorder         = std::unique_ptr<CommandRecorder>(new CommandRecorder(m_vk_backend, std::max(std::thread::hardware_concurrency(), 2u) - 1));
+
+        for (int i = 0; i < dw::vk::Backend::kMaxFramesInFlight; i++)
+        {
+            m_g_buffer_semaphores[i] = dw::vk::Semaphore::create(m_vk_backend);
+            m_g_buffer_semaphores[i]->set_name("G-Buffer Semaphore " + std::to_string(i));
+
+            m_async_compute_semaphores[i] = dw::vk::Semaphore::create(m_vk_backend);
+            m_async_compute_semaphores[i]->set_name("Async Compute Semaphore " + std::to_string(i));
+
+            VkFenceCreateInfo fence_info;
+            DW_ZERO_MEMORY(fence_info);
+
+            fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+            fence_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+            vkCreateFence(m_vk_backend->device(), &fence_info, nullptr, &m_frame_fences[i]);
+        }
 
         create_camera();
         set_active_scene();
 
+        if (m_benchmark->enabled())
+            begin_benchmark();
+
         return true;
     }
 
@@ -48,14 +78,27 @@ protected:
 
     void update(double delta) override
     {
+        load_pending_scene();
+
+        wait_for_frame_latency();
+
         dw::vk::CommandBuffer::Ptr cmd_buf = m_vk_backend->allocate_graphics_command_buffer();
 
-        VkCommandBufferBeginInfo begin_info;
-        DW_ZERO_MEMORY(begin_info);
+        begin_command_buffer(cmd_buf);
 
-        begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        m_common_resources->gpu_timer->begin_frame(cmd_buf, m_common_resources->num_frames);
+        m_common_resources->gpu_counters->begin_frame(cmd_buf, m_common_resources->num_frames);
+        m_common_resources->deletion_queue->begin_frame();
+        m_common_resources->bindless_heap->begin_frame();
+        m_command_recorder->begin_frame();
 
-        vkBeginCommandBuffer(cmd_buf->handle(), &begin_info);
+        if (m_benchmark->enabled() && !m_benchmark->reference() && m_benchmark->update(m_common_resources->gpu_timer.get(), m_common_resources->gpu_counters.get()))
+        {
+            m_benchmark->write_results(m_width, m_height, m_common_resources->memory_tracker.get());
+            request_exit();
+        }
+
+        update_dynamic_resolution();
 
         {
             DW_SCOPED_SAMPLE("Update", cmd_buf);
@@ -71,46 +114,48 @@ protected:
             // Update uniforms.
             update_uniforms(cmd_buf);
 
-            m_common_resources->current_scene()->build_tlas(cmd_buf);
+            update_tlas(cmd_buf);
 
             update_ibl(cmd_buf);
 
-            // Render.
-            m_g_buffer->render(cmd_buf);
-            m_ray_traced_shadows->render(cmd_buf);
-            m_ray_traced_ao->render(cmd_buf);
-            m_ddgi->render(cmd_buf);
-            m_ray_traced_reflections->render(cmd_buf, m_ddgi.get());
-            m_deferred_shading->render(cmd_buf,
-                                       m_ray_traced_ao.get(),
-                                       m_ray_traced_shadows.get(),
-                                       m_ray_traced_reflections.get(),
-                                       m_ddgi.get());
-            m_ground_truth_path_tracer->render(cmd_buf);
-            m_temporal_aa->render(cmd_buf,
-                                  m_deferred_shading.get(),
-                                  m_ray_traced_ao.get(),
-                                  m_ray_traced_shadows.get(),
-                                  m_ray_traced_reflections.get(),
-                                  m_ddgi.get(),
-                                  m_ground_truth_path_tracer.get(),
-                                  m_delta_seconds);
-            m_tone_map->render(cmd_buf,
-                               m_temporal_aa.get(),
-                               m_deferred_shading.get(),
-                               m_ray_traced_ao.get(),
-                               m_ray_traced_shadows.get(),
-                               m_ray_traced_reflections.get(),
-                               m_ddgi.get(),
-                               m_ground_truth_path_tracer.get(),
-                               [this](dw::vk::CommandBuffer::Ptr cmd_buf) {
-                                   render_gui(cmd_buf);
-                               });
+            // Work out which passes actually contribute to this frame.
+            resolve_active_passes();
+
+            // Retire transient images that no pass has asked for since they were last in flight.
+            m_common_resources->transient_image_pool->begin_frame();
+
+            if (m_active_passes.g_buffer)
+                m_g_buffer->prepare();
         }
 
         vkEndCommandBuffer(cmd_buf->handle());
 
-        submit_and_present({ cmd_buf });
+        // Render.
+        if (async_compute_active())
+            submit_with_async_compute(cmd_buf);
+        else
+        {
+            add_g_buffer_job();
+            add_ray_traced_effect_jobs(QUEUE_TYPE_GRAPHICS);
+            add_composite_job();
+            add_tone_map_job();
+
+            m_common_resources->bindless_heap->begin_recording();
+            m_command_recorder->record();
+            m_common_resources->bindless_heap->end_recording();
+
+            std::vector<dw::vk::CommandBuffer::Ptr> cmd_bufs = m_command_recorder->command_buffers(0, m_command_recorder->num_jobs());
+
+            cmd_bufs.insert(cmd_bufs.begin(), cmd_buf);
+
+            submit_and_present(cmd_bufs);
+        }
+
+        signal_frame_fence();
+
+        // The outputs of the frame that was just submitted are read back before the ping pong flip.
+        if (m_benchmark->enabled() && m_benchmark->reference())
+            update_reference();
 
         m_common_resources->num_frames++;
 
@@ -124,6 +169,15 @@ protected:
 
     void shutdown() override
     {
+        for (int i = 0; i < dw::vk::Backend::kMaxFramesInFlight; i++)
+        {
+            m_g_buffer_semaphores[i].reset();
+            m_async_compute_semaphores[i].reset();
+
+            vkDestroyFence(m_vk_backend->device(), m_frame_fences[i], nullptr);
+        }
+
+        m_command_recorder.reset();
         m_tone_map.reset();
         m_temporal_aa.reset();
         m_deferred_shading.reset();
@@ -133,6 +187,7 @@ protected:
         m_ray_traced_ao.reset();
         m_ray_traced_reflections.reset();
         m_ddgi.reset();
+        m_many_lights.reset();
         m_common_resources.reset();
     }
 
@@ -158,7 +213,7 @@ protected:
                 m_mouse_look = true;
         }
 
-        if (code == GLFW_KEY_G)
+        if (code == GLFW_KEY_G && !m_benchmark->enabled())
             m_debug_gui = !m_debug_gui;
     }
 
@@ -278,10 +333,7 @@ private:
                                 const bool is_selected = (i == m_common_resources->current_scene_type);
 
                                 if (ImGui::Selectable(constants::scene_types[i].c_str(), is_selected))
-                                {
-                                    m_common_resources->current_scene_type = (SceneType)i;
-                                    set_active_scene();
-                                }
+                                    request_scene((SceneType)i);
 
                                 if (is_selected)
                                     ImGui::SetItemDefaultFocus();
@@ -515,6 +567,42 @@ private:
                         ImGui::TreePop();
                         ImGui::Separator();
                     }
+                    if (ImGui::TreeNode("Dynamic Resolution"))
+                    {
+                        bool enabled = m_dynamic_resolution->enabled();
+                        if (ImGui::Checkbox("Enabled", &enabled))
+                        {
+                            m_dynamic_resolution->set_enabled(enabled);
+
+                            // The controller is driven by the timestamps.
+                            if (enabled)
+                                m_common_resources->gpu_timer->set_enabled(true);
+                        }
+
+                        m_dynamic_resolution->gui();
+
+                        ImGui::TreePop();
+                        ImGui::Separator();
+                    }
+                    if (ImGui::TreeNode("Recording"))
+                    {
+                        m_command_recorder->gui();
+                        m_common_resources->bindless_heap->gui();
+
+                        ImGui::SliderInt("Frames In Flight", &m_frames_in_flight, 1, dw::vk::Backend::kMaxFramesInFlight);
+
+                        ImGui::TreePop();
+                        ImGui::Separator();
+                    }
+                    if (ImGui::TreeNode("G-Buffer"))
+                    {
+                        ImGui::PushID("G-Buffer");
+                        m_g_buffer->gui();
+                        ImGui::PopID();
+
+                        ImGui::TreePop();
+                        ImGui::Separator();
+                    }
                     if (ImGui::TreeNode("Ray Traced Shadows"))
                     {
                         ImGui::PushID("Ray Traced Shadows");
@@ -529,9 +617,28 @@ private:
 
                                 if (ImGui::Selectable(constants::ray_trace_scales[i].c_str(), is_selected))
                                 {
-                                    m_vk_backend->wait_idle();
-                                    m_ray_traced_shadows.reset();
-                                    m_ray_traced_shadows = std::unique_ptr<RayTracedShadows>(new RayTracedShadows(m_vk_backend, m_common_resources.get(), m_g_buffer.get(), (RayTraceScale)i));
+                                    m_ray_traced_shadows->set_scale((RayTraceScale)i);
+                                    m_recorded_passes.shadows = false;
+                                }
+
+                                if (is_selected)
+                                    ImGui::SetItemDefaultFocus();
+                            }
+                            ImGui::EndCombo();
+                        }
+
+                        RenderTargetPrecision precision = m_ray_traced_shadows->precision();
+
+                        if (ImGui::BeginCombo("Precision", constants::render_target_precisions[precision].c_str()))
+                        {
+                            for (uint32_t i = 0; i < constants::render_target_precisions.size(); i++)
+                            {
+                                const bool is_selected = (i == precision);
+
+                                if (ImGui::Selectable(constants::render_target_precisions[i].c_str(), is_selected))
+                                {
+                                    m_ray_traced_shadows->set_precision((RenderTargetPrecision)i);
+                                    m_recorded_passes.shadows = false;
                                 }
 
                                 if (is_selected)
@@ -543,6 +650,24 @@ private:
                         bool enabled = m_deferred_shading->use_ray_traced_shadows();
                         if (ImGui::Checkbox("Enabled", &enabled))
                             m_deferred_shading->set_use_ray_traced_shadows(enabled);
+
+                        QueueType queue_type = m_ray_traced_shadows->queue_type();
+
+                        if (async_compute_supported() && ImGui::BeginCombo("Queue", constants::queue_types[queue_type].c_str()))
+                        {
+                            for (uint32_t i = 0; i < constants::queue_types.size(); i++)
+                            {
+                                const bool is_selected = (i == queue_type);
+
+                                if (ImGui::Selectable(constants::queue_types[i].c_str(), is_selected))
+                                    m_ray_traced_shadows->set_queue_type((QueueType)i);
+
+                                if (is_selected)
+                                    ImGui::SetItemDefaultFocus();
+                            }
+                            ImGui::EndCombo();
+                        }
+
                         m_ray_traced_shadows->gui();
 
                         ImGui::PopID();
@@ -564,9 +689,28 @@ private:
 
                                 if (ImGui::Selectable(constants::ray_trace_scales[i].c_str(), is_selected))
                                 {
-                                    m_vk_backend->wait_idle();
-                                    m_ray_traced_reflections.reset();
-                                    m_ray_traced_reflections = std::unique_ptr<RayTracedReflections>(new RayTracedReflections(m_vk_backend, m_common_resources.get(), m_g_buffer.get(), (RayTraceScale)i));
+                                    m_ray_traced_reflections->set_scale((RayTraceScale)i);
+                                    m_recorded_passes.reflections = false;
+                                }
+
+                                if (is_selected)
+                                    ImGui::SetItemDefaultFocus();
+                            }
+                            ImGui::EndCombo();
+                        }
+
+                        RenderTargetPrecision precision = m_ray_traced_reflections->precision();
+
+                        if (ImGui::BeginCombo("Precision", constants::render_target_precisions[precision].c_str()))
+                        {
+                            for (uint32_t i = 0; i < constants::render_target_precisions.size(); i++)
+                            {
+                                const bool is_selected = (i == precision);
+
+                                if (ImGui::Selectable(constants::render_target_precisions[i].c_str(), is_selected))
+                                {
+                                    m_ray_traced_reflections->set_precision((RenderTargetPrecision)i);
+                                    m_recorded_passes.reflections = false;
                                 }
 
                                 if (is_selected)
@@ -579,6 +723,39 @@ private:
                         if (ImGui::Checkbox("Enabled", &enabled))
                             m_deferred_shading->set_use_ray_traced_reflections(enabled);
 
+                        RayTraceBackend backend_type = m_ray_traced_reflections->ray_trace_backend();
+
+                        if (ImGui::BeginCombo("Ray Trace Backend", constants::ray_trace_backends[backend_type].c_str()))
+                        {
+                            for (uint32_t i = 0; i < constants::ray_trace_backends.size(); i++)
+                            {
+                                const bool is_selected = (i == backend_type);
+
+                                if (ImGui::Selectable(constants::ray_trace_backends[i].c_str(), is_selected))
+                                    m_ray_traced_reflections->set_ray_trace_backend((RayTraceBackend)i);
+
+                                if (is_selected)
+                                    ImGui::SetItemDefaultFocus();
+                            }
+                            ImGui::EndCombo();
+                        }
+
+                        // Shared with DDGI and the local lights, which are recorded in the same job.
+                        if (async_compute_supported() && ImGui::BeginCombo("Queue", constants::queue_types[m_ray_traced_lighting_queue_type].c_str()))
+                        {
+                            for (uint32_t i = 0; i < constants::queue_types.size(); i++)
+                            {
+                                const bool is_selected = (i == m_ray_traced_lighting_queue_type);
+
+                                if (ImGui::Selectable(constants::queue_types[i].c_str(), is_selected))
+                                    m_ray_traced_lighting_queue_type = (QueueType)i;
+
+                                if (is_selected)
+                                    ImGui::SetItemDefaultFocus();
+                            }
+                            ImGui::EndCombo();
+                        }
+
                         m_ray_traced_reflections->gui();
 
                         ImGui::PopID();
@@ -600,9 +777,28 @@ private:
 
                                 if (ImGui::Selectable(constants::ray_trace_scales[i].c_str(), is_selected))
                                 {
-                                    m_vk_backend->wait_idle();
-                                    m_ray_traced_ao.reset();
-                                    m_ray_traced_ao = std::unique_ptr<RayTracedAO>(new RayTracedAO(m_vk_backend, m_common_resources.get(), m_g_buffer.get(), (RayTraceScale)i));
+                                    m_ray_traced_ao->set_scale((RayTraceScale)i);
+                                    m_recorded_passes.ao = false;
+                                }
+
+                                if (is_selected)
+                                    ImGui::SetItemDefaultFocus();
+                            }
+                            ImGui::EndCombo();
+                        }
+
+                        RenderTargetPrecision precision = m_ray_traced_ao->precision();
+
+                        if (ImGui::BeginCombo("Precision", constants::render_target_precisions[precision].c_str()))
+                        {
+                            for (uint32_t i = 0; i < constants::render_target_precisions.size(); i++)
+                            {
+                                const bool is_selected = (i == precision);
+
+                                if (ImGui::Selectable(constants::render_target_precisions[i].c_str(), is_selected))
+                                {
+                                    m_ray_traced_ao->set_precision((RenderTargetPrecision)i);
+                                    m_recorded_passes.ao = false;
                                 }
 
                                 if (is_selected)
@@ -615,6 +811,23 @@ private:
                         if (ImGui::Checkbox("Enabled", &enabled))
                             m_deferred_shading->set_use_ray_traced_ao(enabled);
 
+                        QueueType queue_type = m_ray_traced_ao->queue_type();
+
+                        if (async_compute_supported() && ImGui::BeginCombo("Queue", constants::queue_types[queue_type].c_str()))
+                        {
+                            for (uint32_t i = 0; i < constants::queue_types.size(); i++)
+                            {
+                                const bool is_selected = (i == queue_type);
+
+                                if (ImGui::Selectable(constants::queue_types[i].c_str(), is_selected))
+                                    m_ray_traced_ao->set_queue_type((QueueType)i);
+
+                                if (is_selected)
+                                    ImGui::SetItemDefaultFocus();
+                            }
+                            ImGui::EndCombo();
+                        }
+
                         m_ray_traced_ao->gui();
                         ImGui::PopID();
 
@@ -635,10 +848,28 @@ private:
 
                                 if (ImGui::Selectable(constants::ray_trace_scales[i].c_str(), is_selected))
                                 {
-                                    m_vk_backend->wait_idle();
-                                    m_ddgi.reset();
-                                    m_ddgi = std::unique_ptr<DDGI>(new DDGI(m_vk_backend, m_common_resources.get(), m_g_buffer.get(), (RayTraceScale)i));
-                                    set_active_scene();
+                                    m_ddgi->set_scale((RayTraceScale)i);
+                                    m_recorded_passes.ddgi = false;
+                                }
+
+                                if (is_selected)
+                                    ImGui::SetItemDefaultFocus();
+                            }
+                            ImGui::EndCombo();
+                        }
+
+                        RenderTargetPrecision precision = m_ddgi->precision();
+
+                        if (ImGui::BeginCombo("Precision", constants::render_target_precisions[precision].c_str()))
+                        {
+                            for (uint32_t i = 0; i < constants::render_target_precisions.size(); i++)
+                            {
+                                const bool is_selected = (i == precision);
+
+                                if (ImGui::Selectable(constants::render_target_precisions[i].c_str(), is_selected))
+                                {
+                                    m_ddgi->set_precision((RenderTargetPrecision)i);
+                                    m_recorded_passes.ddgi = false;
                                 }
 
                                 if (is_selected)
@@ -655,6 +886,39 @@ private:
                         if (ImGui::Checkbox("Visualize Probe Grid", &visualize_probe_grid))
                             m_deferred_shading->set_visualize_probe_grid(visualize_probe_grid);
 
+                        RayTraceBackend backend_type = m_ddgi->ray_trace_backend();
+
+                        if (ImGui::BeginCombo("Ray Trace Backend", constants::ray_trace_backends[backend_type].c_str()))
+                        {
+                            for (uint32_t i = 0; i < constants::ray_trace_backends.size(); i++)
+                            {
+                                const bool is_selected = (i == backend_type);
+
+                                if (ImGui::Selectable(constants::ray_trace_backends[i].c_str(), is_selected))
+                                    m_ddgi->set_ray_trace_backend((RayTraceBackend)i);
+
+                                if (is_selected)
+                                    ImGui::SetItemDefaultFocus();
+                            }
+                            ImGui::EndCombo();
+                        }
+
+                        // Shared with the reflections and the local lights, which are recorded in the same job.
+                        if (async_compute_supported() && ImGui::BeginCombo("Queue", constants::queue_types[m_ray_traced_lighting_queue_type].c_str()))
+                        {
+                            for (uint32_t i = 0; i < constants::queue_types.size(); i++)
+                            {
+                                const bool is_selected = (i == m_ray_traced_lighting_queue_type);
+
+                                if (ImGui::Selectable(constants::queue_types[i].c_str(), is_selected))
+                                    m_ray_traced_lighting_queue_type = (QueueType)i;
+
+                                if (is_selected)
+                                    ImGui::SetItemDefaultFocus();
+                            }
+                            ImGui::EndCombo();
+                        }
+
                         m_ddgi->gui();
 
                         ImGui::PopID();
@@ -662,6 +926,21 @@ private:
                         ImGui::TreePop();
                         ImGui::Separator();
                     }
+                    if (ImGui::TreeNode("Many Lights"))
+                    {
+                        ImGui::PushID("GUI_Many_Lights");
+
+                        bool enabled = m_deferred_shading->use_local_lights();
+                        if (ImGui::Checkbox("Enabled", &enabled))
+                            m_deferred_shading->set_use_local_lights(enabled);
+
+                        m_many_lights->gui();
+
+                        ImGui::PopID();
+
+                        ImGui::TreePop();
+                        ImGui::Separator();
+                    }
                     if (ImGui::TreeNode("TAA"))
                     {
                         m_temporal_aa->gui();
@@ -669,11 +948,109 @@ private:
                     }
                 }
                 if (ImGui::CollapsingHeader("Profiler", ImGuiTreeNodeFlags_DefaultOpen))
+                {
+                    bool gpu_timers = m_common_resources->gpu_timer->enabled();
+                    if (ImGui::Checkbox("GPU Timers", &gpu_timers))
+                        m_common_resources->gpu_timer->set_enabled(gpu_timers);
+
+                    if (gpu_timers)
+                    {
+                        for (const auto& result : m_common_resources->gpu_timer->results())
+                            ImGui::Text("%s: %.3f ms", result.name.c_str(), result.milliseconds);
+
+                        ImGui::Separator();
+                    }
+
+                    bool gpu_counters = m_common_resources->gpu_counters->enabled();
+                    if (ImGui::Checkbox("GPU Counters", &gpu_counters))
+                        m_common_resources->gpu_counters->set_enabled(gpu_counters);
+
+                    if (gpu_counters)
+                    {
+                        const auto& timer_results = m_common_resources->gpu_timer->results();
+
+                        const auto& counter_results = m_common_resources->gpu_counters->results();
+
+                        for (uint32_t i = 0; i < counter_results.size(); i++)
+                        {
+                            const auto& result = counter_results[i];
+
+                            auto it = std::find_if(timer_results.begin(), timer_results.end(), [&result](const GPUTimer::Result& timer) { return timer.name == result.timer; });
+
+                            if (it != timer_results.end() && result.value > 0)
+                                ImGui::Text("%s: %u (%.2f ns/%s)", result.name.c_str(), result.value, it->milliseconds * 1000000.0f / float(result.value), i < GPU_COUNTERS_NUM_ATOMIC ? "ray" : "tile");
+                            else
+                                ImGui::Text("%s: %u", result.name.c_str(), result.value);
+                        }
+
+                        ImGui::Separator();
+                    }
+
                     dw::profiler::ui();
+                }
+                if (ImGui::CollapsingHeader("Memory"))
+                {
+                    VkDeviceSize tracked = 0;
+
+                    for (const auto& result : m_common_resources->memory_tracker->results())
+                    {
+                        ImGui::Text("%s: %.1f MB (%u images)", result.name.c_str(), MemoryTracker::megabytes(result.bytes), result.num_images);
+                        tracked += result.bytes;
+                    }
+
+                    ImGui::Separator();
+
+                    VkDeviceSize usage  = 0;
+                    VkDeviceSize budget = 0;
+
+                    m_common_resources->memory_tracker->device_local_usage(usage, budget);
+
+                    ImGui::Text("Tracked: %.1f MB", MemoryTracker::megabytes(tracked));
+                    ImGui::Text("Device Local: %.1f / %.1f MB", MemoryTracker::megabytes(usage), MemoryTracker::megabytes(budget));
+                }
 
                 ImGui::End();
             }
         }
+
+        if (m_pending_scene_type != SCENE_TYPE_COUNT)
+        {
+            ImGui::SetNextWindowPos(ImVec2(m_width * 0.5f, m_height * 0.5f), ImGuiCond_Always, ImVec2(0.5f, 0.5f));
+
+            if (ImGui::Begin("Loading", nullptr, ImGuiWindowFlags_NoDecoration | ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoInputs | ImGuiWindowFlags_NoSavedSettings))
+                ImGui::Text("Loading %s...", constants::scene_types[m_pending_scene_type].c_str());
+
+            ImGui::End();
+        }
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void request_scene(SceneType scene_type)
+    {
+        if (m_common_resources->is_scene_loaded(scene_type))
+        {
+            m_common_resources->current_scene_type = scene_type;
+            set_active_scene();
+        }
+        else
+            m_pending_scene_type = scene_type;
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void load_pending_scene()
+    {
+        // The frame that requested the scene has already been presented with the loading message over the previous scene, so
+        // blocking here on the uploads and BLAS builds does not leave the window unresponsive without any feedback.
+        if (m_pending_scene_type == SCENE_TYPE_COUNT)
+            return;
+
+        m_common_resources->load_scene(m_vk_backend, m_pending_scene_type);
+        m_common_resources->current_scene_type = m_pending_scene_type;
+        m_pending_scene_type                   = SCENE_TYPE_COUNT;
+
+        set_active_scene();
     }
 
     // -----------------------------------------------------------------------------------------------------------------------------------
@@ -685,6 +1062,7 @@ private:
         ImGui::ColorEdit3("Color", &m_light_color.x);
         ImGui::InputFloat("Intensity", &m_light_intensity);
         ImGui::SliderFloat("Radius", &m_light_radius, 0.0f, 0.1f);
+        ImGui::SliderFloat("Sky Update Threshold (deg)", &m_sky_update_threshold, 0.0f, 5.0f);
 
         glm::vec3 position;
         glm::vec3 rotation;
@@ -920,20 +1298,414 @@ private:
         }
 
         m_ground_truth_path_tracer->restart_accumulation();
+        m_ray_traced_shadows->invalidate_cache();
     }
 
     // -----------------------------------------------------------------------------------------------------------------------------------
 
-    void update_uniforms(dw::vk::CommandBuffer::Ptr cmd_buf)
+    void begin_command_buffer(dw::vk::CommandBuffer::Ptr cmd_buf)
     {
-        DW_SCOPED_SAMPLE("Update Uniforms", cmd_buf);
+        VkCommandBufferBeginInfo begin_info;
+        DW_ZERO_MEMORY(begin_info);
 
-        glm::mat4 current_jitter = glm::translate(glm::mat4(1.0f), glm::vec3(m_temporal_aa->current_jitter(), 0.0f));
+        begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
 
-        m_common_resources->view                 = m_main_camera->m_view;
-        m_common_resources->projection           = m_temporal_aa->enabled() ? current_jitter * m_main_camera->m_projection : m_main_camera->m_projection;
-        m_common_resources->prev_view_projection = m_main_camera->m_prev_view_projection;
-        m_common_resources->position             = m_main_camera->m_position;
+        vkBeginCommandBuffer(cmd_buf->handle(), &begin_info);
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    bool async_compute_supported()
+    {
+        return m_vk_backend->queue_infos().compute_queue_index != -1;
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Images and buffers are created with exclusive sharing, which the framework does not let us change. When the compute queue
+    // belongs to a family of its own, every resource used on both queues has to be handed over in both directions every frame,
+    // see submit_with_async_compute().
+    bool queue_family_transfers()
+    {
+        return m_vk_backend->queue_infos().graphics_queue_index != m_vk_backend->queue_infos().compute_queue_index;
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    bool async_compute_active()
+    {
+        if (!async_compute_supported())
+            return false;
+
+        return (m_active_passes.shadows && m_ray_traced_shadows->queue_type() == QUEUE_TYPE_ASYNC_COMPUTE) || (m_active_passes.ao && m_ray_traced_ao->queue_type() == QUEUE_TYPE_ASYNC_COMPUTE) || ray_traced_lighting_async();
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // The local lights, DDGI and reflections can only leave the graphics queue once every active ray trace among them runs as
+    // inline ray queries from compute shaders.
+    bool ray_traced_lighting_async()
+    {
+        if (!async_compute_supported() || m_ray_traced_lighting_queue_type != QUEUE_TYPE_ASYNC_COMPUTE)
+            return false;
+
+        if (!m_active_passes.local_lights && !m_active_passes.ddgi && !m_active_passes.reflections)
+            return false;
+
+        if (m_active_passes.ddgi && m_ddgi->ray_trace_backend() != RAY_TRACE_BACKEND_RAY_QUERY)
+            return false;
+
+        return !m_active_passes.reflections || m_ray_traced_reflections->ray_trace_backend() == RAY_TRACE_BACKEND_RAY_QUERY;
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void update_dynamic_resolution()
+    {
+        RayTraceScale scales[DYNAMIC_RESOLUTION_EFFECT_COUNT];
+
+        scales[DYNAMIC_RESOLUTION_EFFECT_SHADOWS]     = m_ray_traced_shadows->scale();
+        scales[DYNAMIC_RESOLUTION_EFFECT_AO]          = m_ray_traced_ao->scale();
+        scales[DYNAMIC_RESOLUTION_EFFECT_REFLECTIONS] = m_ray_traced_reflections->scale();
+
+        if (!m_dynamic_resolution->update(m_common_resources->gpu_timer.get(), scales))
+            return;
+
+        // A resized effect has to record once so that its outputs are valid before they are sampled.
+        if (scales[DYNAMIC_RESOLUTION_EFFECT_SHADOWS] != m_ray_traced_shadows->scale())
+        {
+            m_ray_traced_shadows->set_scale(scales[DYNAMIC_RESOLUTION_EFFECT_SHADOWS]);
+            m_recorded_passes.shadows = false;
+        }
+
+        if (scales[DYNAMIC_RESOLUTION_EFFECT_AO] != m_ray_traced_ao->scale())
+        {
+            m_ray_traced_ao->set_scale(scales[DYNAMIC_RESOLUTION_EFFECT_AO]);
+            m_recorded_passes.ao = false;
+        }
+
+        if (scales[DYNAMIC_RESOLUTION_EFFECT_REFLECTIONS] != m_ray_traced_reflections->scale())
+        {
+            m_ray_traced_reflections->set_scale(scales[DYNAMIC_RESOLUTION_EFFECT_REFLECTIONS]);
+            m_recorded_passes.reflections = false;
+        }
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Every job records into a command buffer of its own, possibly on a worker thread, so passes that share CPU side state have to
+    // stay in the same job. The jobs are submitted in the order they are added.
+    void add_g_buffer_job()
+    {
+        if (m_active_passes.g_buffer)
+            m_command_recorder->add(QUEUE_TYPE_GRAPHICS, [this](dw::vk::CommandBuffer::Ptr cmd_buf) { m_g_buffer->render(cmd_buf); });
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void add_ray_traced_effect_jobs(QueueType queue_type)
+    {
+        if (m_active_passes.shadows && m_ray_traced_shadows->queue_type() == queue_type)
+            m_command_recorder->add(queue_type, [this](dw::vk::CommandBuffer::Ptr cmd_buf) { m_ray_traced_shadows->render(cmd_buf); });
+
+        if (m_active_passes.ao && m_ray_traced_ao->queue_type() == queue_type)
+            m_command_recorder->add(queue_type, [this](dw::vk::CommandBuffer::Ptr cmd_buf) { m_ray_traced_ao->render(cmd_buf); });
+
+        // Ray tracing pipelines can only be dispatched on the graphics queue, see ray_traced_lighting_async().
+        const QueueType lighting_queue_type = ray_traced_lighting_async() ? QUEUE_TYPE_ASYNC_COMPUTE : QUEUE_TYPE_GRAPHICS;
+
+        m_many_lights->set_queue_type(lighting_queue_type);
+        m_ddgi->set_queue_type(lighting_queue_type);
+        m_ray_traced_reflections->set_queue_type(lighting_queue_type);
+
+        if (queue_type == lighting_queue_type && (m_active_passes.local_lights || m_active_passes.ddgi || m_active_passes.reflections))
+        {
+            m_command_recorder->add(queue_type, [this](dw::vk::CommandBuffer::Ptr cmd_buf) {
+                // The probe rays sample the local lights as well, so the clusters have to be ready before DDGI.
+                if (m_active_passes.local_lights || m_active_passes.ddgi)
+                    m_many_lights->cull(cmd_buf);
+
+                if (m_active_passes.local_lights)
+                    m_many_lights->render(cmd_buf);
+
+                if (m_active_passes.ddgi)
+                    m_ddgi->render(cmd_buf, m_many_lights.get());
+
+                if (m_active_passes.reflections)
+                    m_ray_traced_reflections->render(cmd_buf, m_ddgi.get(), m_active_passes.deferred_shading ? m_deferred_shading.get() : nullptr);
+            });
+        }
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void add_composite_job()
+    {
+        m_command_recorder->add(QUEUE_TYPE_GRAPHICS, [this](dw::vk::CommandBuffer::Ptr cmd_buf) {
+            DW_SCOPED_SAMPLE("Composite", cmd_buf);
+            render_composite(cmd_buf);
+        });
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void add_tone_map_job()
+    {
+        // The GUI is recorded along with the tone map and ImGui is only ever touched from the main thread. The job also closes the
+        // frame for the GPU counters and timer, so it has to be submitted after every other job.
+        m_command_recorder->add_last(
+            QUEUE_TYPE_GRAPHICS, [this](dw::vk::CommandBuffer::Ptr cmd_buf) { render_tone_map(cmd_buf); });
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void render_composite(dw::vk::CommandBuffer::Ptr cmd_buf)
+    {
+        if (m_active_passes.deferred_shading)
+        {
+            m_deferred_shading->render(cmd_buf,
+                                       m_ray_traced_ao.get(),
+                                       m_ray_traced_shadows.get(),
+                                       m_ray_traced_reflections.get(),
+                                       m_ddgi.get(),
+                                       m_many_lights.get());
+        }
+
+        if (m_active_passes.ground_truth)
+            m_ground_truth_path_tracer->render(cmd_buf);
+
+        if (m_active_passes.temporal_aa)
+        {
+            m_temporal_aa->render(cmd_buf,
+                                  m_deferred_shading.get(),
+                                  m_ray_traced_ao.get(),
+                                  m_ray_traced_shadows.get(),
+                                  m_ray_traced_reflections.get(),
+                                  m_ddgi.get(),
+                                  m_ground_truth_path_tracer.get(),
+                                  m_delta_seconds);
+        }
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void render_tone_map(dw::vk::CommandBuffer::Ptr cmd_buf)
+    {
+        m_tone_map->render(cmd_buf,
+                           m_temporal_aa.get(),
+                           m_deferred_shading.get(),
+                           m_ray_traced_ao.get(),
+                           m_ray_traced_shadows.get(),
+                           m_ray_traced_reflections.get(),
+                           m_ddgi.get(),
+                           m_ground_truth_path_tracer.get(),
+                           [this](dw::vk::CommandBuffer::Ptr cmd_buf) {
+                               render_gui(cmd_buf);
+                           });
+
+        // Jobs are recorded concurrently, so other effects may still be recording their counter increments at this point. What
+        // makes this correct is the submission order: this job is added with add_last, which CommandRecorder asserts is submitted
+        // after every other job, and with async compute enabled the composite before it has already waited on the compute queue.
+        m_common_resources->gpu_counters->end_frame(cmd_buf);
+        m_common_resources->gpu_timer->end_frame(cmd_buf);
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // The render graphs of the effects that are recorded for the async compute queue this frame.
+    std::vector<RenderGraph*> async_render_graphs()
+    {
+        std::vector<RenderGraph*> graphs;
+
+        if (m_active_passes.shadows && m_ray_traced_shadows->queue_type() == QUEUE_TYPE_ASYNC_COMPUTE)
+            graphs.push_back(m_ray_traced_shadows->render_graph());
+
+        if (m_active_passes.ao && m_ray_traced_ao->queue_type() == QUEUE_TYPE_ASYNC_COMPUTE)
+            graphs.push_back(m_ray_traced_ao->render_graph());
+
+        if (ray_traced_lighting_async())
+        {
+            if (m_active_passes.ddgi)
+                graphs.push_back(m_ddgi->render_graph());
+
+            if (m_active_passes.reflections)
+                graphs.push_back(m_ray_traced_reflections->render_graph());
+        }
+
+        return graphs;
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void submit_with_async_compute(dw::vk::CommandBuffer::Ptr update_cmd_buf)
+    {
+        const uint32_t frame_idx = m_vk_backend->current_frame_idx();
+        const bool     transfers = queue_family_transfers();
+
+        const uint32_t first_g_buffer_job = m_command_recorder->num_jobs();
+        add_g_buffer_job();
+
+        // An exclusive resource can only be accessed by the family that owns it, so with ownership transfers the effects left on
+        // the graphics queue have to sample the G-Buffer before it is handed over. They then no longer overlap with the async work.
+        if (transfers)
+            add_ray_traced_effect_jobs(QUEUE_TYPE_GRAPHICS);
+
+        const uint32_t first_async_job = m_command_recorder->num_jobs();
+        add_ray_traced_effect_jobs(QUEUE_TYPE_ASYNC_COMPUTE);
+
+        const uint32_t first_graphics_job = m_command_recorder->num_jobs();
+        if (!transfers)
+            add_ray_traced_effect_jobs(QUEUE_TYPE_GRAPHICS);
+
+        const uint32_t composite_job = m_command_recorder->num_jobs();
+        add_composite_job();
+
+        const uint32_t tone_map_job = m_command_recorder->num_jobs();
+        add_tone_map_job();
+
+        m_common_resources->bindless_heap->begin_recording();
+        m_command_recorder->record();
+        m_common_resources->bindless_heap->end_recording();
+
+        // In between frames the graphics queue owns everything. The render graphs collect their own images and buffers, the
+        // resources the effects share with the rest of the frame are added here. Everything is handed over at the edges of the
+        // async compute submission, so effects within it can read each other's outputs.
+        dw::vk::CommandBuffer::Ptr graphics_release_cmd_buf;
+        dw::vk::CommandBuffer::Ptr compute_acquire_cmd_buf;
+        dw::vk::CommandBuffer::Ptr compute_release_cmd_buf;
+        dw::vk::CommandBuffer::Ptr graphics_acquire_cmd_buf;
+
+        if (transfers)
+        {
+            QueueTransfer             shared_resources(m_vk_backend);
+            std::vector<RenderGraph*> graphs = async_render_graphs();
+
+            if (m_active_passes.g_buffer)
+                m_g_buffer->add_queue_transfer_resources(shared_resources);
+
+            m_common_resources->gpu_counters->add_queue_transfer_resources(shared_resources);
+
+            if (ray_traced_lighting_async())
+            {
+                if (m_active_passes.local_lights || m_active_passes.ddgi)
+                    m_many_lights->add_queue_transfer_resources(shared_resources);
+
+                // The screen space reflections trace the previous frame's lighting, which does not exist yet in the first frame.
+                if (m_active_passes.reflections && m_active_passes.deferred_shading && !m_common_resources->first_frame)
+                    shared_resources.add_image(m_deferred_shading->output_image(), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+            }
+
+            graphics_release_cmd_buf = m_command_recorder->record_now(QUEUE_TYPE_GRAPHICS, [&](dw::vk::CommandBuffer::Ptr cmd_buf) {
+                shared_resources.release(cmd_buf, QUEUE_TYPE_GRAPHICS);
+
+                for (auto graph : graphs)
+                    graph->incoming_transfer().release(cmd_buf, QUEUE_TYPE_GRAPHICS);
+            });
+
+            compute_acquire_cmd_buf = m_command_recorder->record_now(QUEUE_TYPE_ASYNC_COMPUTE, [&](dw::vk::CommandBuffer::Ptr cmd_buf) {
+                shared_resources.acquire(cmd_buf, QUEUE_TYPE_ASYNC_COMPUTE);
+
+                for (auto graph : graphs)
+                    graph->incoming_transfer().acquire(cmd_buf, QUEUE_TYPE_ASYNC_COMPUTE);
+            });
+
+            compute_release_cmd_buf = m_command_recorder->record_now(QUEUE_TYPE_ASYNC_COMPUTE, [&](dw::vk::CommandBuffer::Ptr cmd_buf) {
+                shared_resources.release(cmd_buf, QUEUE_TYPE_ASYNC_COMPUTE);
+
+                for (auto graph : graphs)
+                    graph->outgoing_transfer().release(cmd_buf, QUEUE_TYPE_ASYNC_COMPUTE);
+            });
+
+            graphics_acquire_cmd_buf = m_command_recorder->record_now(QUEUE_TYPE_GRAPHICS, [&](dw::vk::CommandBuffer::Ptr cmd_buf) {
+                shared_resources.acquire(cmd_buf, QUEUE_TYPE_GRAPHICS);
+
+                for (auto graph : graphs)
+                    graph->outgoing_transfer().acquire(cmd_buf, QUEUE_TYPE_GRAPHICS);
+            });
+        }
+
+        // G-Buffer and everything recorded before it. The async effects read the G-Buffer so they wait on this submission.
+        {
+            std::vector<dw::vk::CommandBuffer::Ptr> cmd_bufs = m_command_recorder->command_buffers(first_g_buffer_job, first_async_job - first_g_buffer_job);
+
+            cmd_bufs.insert(cmd_bufs.begin(), update_cmd_buf);
+
+            if (transfers)
+                cmd_bufs.push_back(graphics_release_cmd_buf);
+
+            m_vk_backend->submit_graphics(cmd_bufs, {}, {}, { m_g_buffer_semaphores[frame_idx] });
+        }
+
+        // Ray traced effects that were moved to the async compute queue.
+        {
+            std::vector<dw::vk::CommandBuffer::Ptr> cmd_bufs = m_command_recorder->command_buffers(first_async_job, first_graphics_job - first_async_job);
+
+            if (transfers)
+            {
+                cmd_bufs.insert(cmd_bufs.begin(), compute_acquire_cmd_buf);
+                cmd_bufs.push_back(compute_release_cmd_buf);
+            }
+
+            m_vk_backend->submit_compute(cmd_bufs, { m_g_buffer_semaphores[frame_idx] }, { VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT }, { m_async_compute_semaphores[frame_idx] });
+        }
+
+        // Ray traced effects left on the graphics queue overlap with the async work.
+        if (composite_job > first_graphics_job)
+            m_vk_backend->submit_graphics(m_command_recorder->command_buffers(first_graphics_job, composite_job - first_graphics_job), {}, {}, {});
+
+        // Deferred shading and TAA consume the async outputs so they have to wait for the compute queue.
+        {
+            std::vector<dw::vk::CommandBuffer::Ptr> cmd_bufs = m_command_recorder->command_buffers(composite_job, 1);
+
+            if (transfers)
+                cmd_bufs.insert(cmd_bufs.begin(), graphics_acquire_cmd_buf);
+
+            m_vk_backend->submit_graphics(cmd_bufs, { m_async_compute_semaphores[frame_idx] }, { VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT }, {});
+        }
+
+        submit_and_present(m_command_recorder->command_buffers(tone_map_job, 1));
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void wait_for_frame_latency()
+    {
+        // The framework keeps up to kMaxFramesInFlight frames in flight on its own. Fewer are enforced by waiting for the fence that
+        // was signaled after an older frame, which trades the overlap of recording with GPU work for lower latency.
+        if (m_frames_in_flight >= dw::vk::Backend::kMaxFramesInFlight || m_common_resources->num_frames < m_frames_in_flight)
+            return;
+
+        VkFence fence = m_frame_fences[(m_common_resources->num_frames - m_frames_in_flight) % dw::vk::Backend::kMaxFramesInFlight];
+
+        vkWaitForFences(m_vk_backend->device(), 1, &fence, VK_TRUE, UINT64_MAX);
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void signal_frame_fence()
+    {
+        VkFence fence = m_frame_fences[m_common_resources->num_frames % dw::vk::Backend::kMaxFramesInFlight];
+
+        // The frame that last used this fence is kMaxFramesInFlight frames old, so the wait returns right away in practice.
+        vkWaitForFences(m_vk_backend->device(), 1, &fence, VK_TRUE, UINT64_MAX);
+        vkResetFences(m_vk_backend->device(), 1, &fence);
+
+        // An empty submission signals its fence once all the work submitted before it on the queue has completed.
+        vkQueueSubmit(m_vk_backend->graphics_queue(), 0, nullptr, fence);
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void update_uniforms(dw::vk::CommandBuffer::Ptr cmd_buf)
+    {
+        DW_SCOPED_SAMPLE("Update Uniforms", cmd_buf);
+
+        glm::mat4 current_jitter = glm::translate(glm::mat4(1.0f), glm::vec3(m_temporal_aa->current_jitter(), 0.0f));
+
+        m_common_resources->view                 = m_main_camera->m_view;
+        m_common_resources->projection           = m_temporal_aa->enabled() ? current_jitter * m_main_camera->m_projection : m_main_camera->m_projection;
+        m_common_resources->prev_view_projection = m_main_camera->m_prev_view_projection;
+        m_common_resources->position             = m_main_camera->m_position;
 
         m_light_direction = glm::normalize(glm::mat3(m_light_transform) * glm::vec3(0.0f, -1.0f, 0.0f));
         m_light_position  = glm::vec3(m_light_transform[3][0], m_light_transform[3][1], m_light_transform[3][2]);
@@ -943,9 +1715,11 @@ private:
         m_ubo_data.view_proj           = m_common_resources->projection * m_common_resources->view;
         m_ubo_data.view_proj_inverse   = glm::inverse(m_ubo_data.view_proj);
         m_ubo_data.prev_view_proj      = m_common_resources->first_frame ? m_common_resources->prev_view_projection : current_jitter * m_common_resources->prev_view_projection;
-        m_ubo_data.cam_pos             = glm::vec4(m_common_resources->position, float(m_deferred_shading->use_ray_traced_ao()));
+        m_ubo_data.cam_pos             = glm::vec4(m_common_resources->position, 0.0f);
         m_ubo_data.current_prev_jitter = glm::vec4(m_temporal_aa->current_jitter(), m_temporal_aa->prev_jitter());
 
+        const Light prev_light = m_ubo_data.light;
+
         m_ubo_data.light.set_light_radius(m_light_radius);
         m_ubo_data.light.set_light_color(m_light_color);
         m_ubo_data.light.set_light_intensity(m_light_intensity);
@@ -955,6 +1729,10 @@ private:
         m_ubo_data.light.set_light_cos_theta_inner(glm::cos(glm::radians(m_light_cone_angle_inner)));
         m_ubo_data.light.set_light_cos_theta_outer(glm::cos(glm::radians(m_light_cone_angle_outer)));
 
+        // The gizmo, the light animation and the light settings all end up in the light, so any of them invalidates cached shadows.
+        if (memcmp(&prev_light, &m_ubo_data.light, sizeof(Light)) != 0)
+            m_ray_traced_shadows->invalidate_cache();
+
         m_main_camera->m_prev_view_projection = m_ubo_data.view_proj;
 
         uint8_t* ptr = (uint8_t*)m_common_resources->ubo->mapped_ptr();
@@ -963,20 +1741,134 @@ private:
 
     // -----------------------------------------------------------------------------------------------------------------------------------
 
+    void update_tlas(dw::vk::CommandBuffer::Ptr cmd_buf)
+    {
+        // Only the camera and the light move at runtime, so a TLAS stays valid once built and is shared by every later frame.
+        if (!m_common_resources->tlas_dirty[m_common_resources->current_scene_type])
+            return;
+
+        DW_SCOPED_SAMPLE("Build TLAS", cmd_buf);
+
+        m_common_resources->current_scene()->build_tlas(cmd_buf);
+        m_common_resources->tlas_dirty[m_common_resources->current_scene_type] = false;
+
+        m_ray_traced_shadows->invalidate_cache();
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
     void update_ibl(dw::vk::CommandBuffer::Ptr cmd_buf)
     {
-        if (m_common_resources->current_environment_type == ENVIRONMENT_TYPE_PROCEDURAL_SKY)
+        if (m_common_resources->current_environment_type != ENVIRONMENT_TYPE_PROCEDURAL_SKY)
+            return;
+
+        SkyEnvironment* sky = m_common_resources->sky_environment.get();
+
+        sky->frames_since_swap++;
+
+        if (sky->update_stage == SKY_UPDATE_STAGE_IDLE)
+        {
+            const glm::vec3 direction = -m_light_direction;
+
+            // Nothing to do until the sun has moved noticeably since the front buffer was generated.
+            if (sky->valid && glm::dot(direction, sky->direction[sky->front]) >= glm::cos(glm::radians(m_sky_update_threshold)))
+                return;
+
+            // The back buffer can still be in use by the frames in flight that were recorded before it was swapped out.
+            if (sky->valid && sky->frames_since_swap <= dw::vk::Backend::kMaxFramesInFlight)
+                return;
+
+            sky->direction[1 - sky->front] = direction;
+            sky->update_stage              = SKY_UPDATE_STAGE_SKY_MODEL;
+        }
+
+        const uint32_t back = 1 - sky->front;
+
+        // There is nothing to shade with until the first set is complete, so that one is generated within a single frame.
+        const bool immediate = !sky->valid;
+
+        do
         {
-            m_common_resources->sky_environment->hosek_wilkie_sky_model->update(cmd_buf, -m_light_direction);
+            if (sky->update_stage == SKY_UPDATE_STAGE_SKY_MODEL)
+            {
+                sky->hosek_wilkie_sky_model[back]->update(cmd_buf, sky->direction[back]);
 
+                {
+                    DW_SCOPED_SAMPLE("Generate Skybox Mipmap", cmd_buf);
+                    sky->hosek_wilkie_sky_model[back]->image()->generate_mipmaps(cmd_buf);
+                }
+
+                sky->update_stage = SKY_UPDATE_STAGE_SH_PROJECTION;
+            }
+            else if (sky->update_stage == SKY_UPDATE_STAGE_SH_PROJECTION)
             {
-                DW_SCOPED_SAMPLE("Generate Skybox Mipmap", cmd_buf);
-                m_common_resources->sky_environment->hosek_wilkie_sky_model->image()->generate_mipmaps(cmd_buf);
+                sky->cubemap_sh_projection[back]->update(cmd_buf);
+                sky->update_stage = SKY_UPDATE_STAGE_PREFILTER;
             }
+            else if (sky->update_stage == SKY_UPDATE_STAGE_PREFILTER)
+            {
+                sky->cubemap_prefilter[back]->update(cmd_buf);
 
-            m_common_resources->sky_environment->cubemap_sh_projection->update(cmd_buf);
-            m_common_resources->sky_environment->cubemap_prefilter->update(cmd_buf);
-        }
+                sky->front             = back;
+                sky->valid             = true;
+                sky->frames_since_swap = 0;
+                sky->update_stage      = SKY_UPDATE_STAGE_IDLE;
+
+                m_common_resources->skybox_ds[ENVIRONMENT_TYPE_PROCEDURAL_SKY] = sky->ds[sky->front];
+                m_common_resources->current_skybox_ds                          = sky->ds[sky->front];
+            }
+        } while (immediate && sky->update_stage != SKY_UPDATE_STAGE_IDLE);
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void resolve_active_passes()
+    {
+        const VisualizationType visualization = m_common_resources->current_visualization_type;
+        const bool              final_image   = visualization == VISUALIZATION_TYPE_FINAL;
+
+        ActivePasses passes;
+
+        passes.ground_truth     = visualization == VISUALIZATION_TYPE_GROUND_TRUTH;
+        passes.g_buffer         = !passes.ground_truth;
+        passes.deferred_shading = final_image;
+        passes.temporal_aa      = !passes.ground_truth;
+        passes.shadows          = visualization == VISUALIZATION_TYPE_SHADOWS || (final_image && m_deferred_shading->use_ray_traced_shadows());
+        passes.ao               = visualization == VISUALIZATION_TYPE_AMBIENT_OCCLUSION || (final_image && m_deferred_shading->use_ray_traced_ao());
+        passes.reflections      = visualization == VISUALIZATION_TYPE_REFLECTIONS || (final_image && m_deferred_shading->use_ray_traced_reflections());
+        passes.local_lights     = final_image && m_deferred_shading->use_local_lights() && m_many_lights->num_lights() > 0;
+        passes.ddgi             = visualization == VISUALIZATION_TYPE_GLOBAL_ILLUIMINATION || (final_image && (m_deferred_shading->use_ddgi() || m_deferred_shading->visualize_probe_grid())) || (passes.reflections && m_ray_traced_reflections->samples_ddgi());
+
+        // The output descriptor sets of culled effects are still bound by the consumers, so every
+        // effect has to be recorded at least once to get its output images into a readable layout.
+        passes.shadows     = passes.shadows || !m_recorded_passes.shadows;
+        passes.ao          = passes.ao || !m_recorded_passes.ao;
+        passes.reflections = passes.reflections || !m_recorded_passes.reflections;
+        passes.ddgi        = passes.ddgi || !m_recorded_passes.ddgi;
+
+        // Temporal history of an effect that was culled is stale, so throw it away when it comes back.
+        if (passes.shadows && !m_active_passes.shadows && m_recorded_passes.shadows)
+            m_ray_traced_shadows->restart_accumulation();
+
+        if (passes.ao && !m_active_passes.ao && m_recorded_passes.ao)
+            m_ray_traced_ao->restart_accumulation();
+
+        if (passes.reflections && !m_active_passes.reflections && m_recorded_passes.reflections)
+            m_ray_traced_reflections->restart_accumulation();
+
+        if (passes.ddgi && !m_active_passes.ddgi && m_recorded_passes.ddgi)
+            m_ddgi->restart_accumulation();
+
+        // The reservoirs start out empty, so the local lights do not have to be recorded once like the other effects.
+        if (passes.local_lights && !m_active_passes.local_lights)
+            m_many_lights->restart_accumulation();
+
+        m_recorded_passes.shadows     = m_recorded_passes.shadows || passes.shadows;
+        m_recorded_passes.ao          = m_recorded_passes.ao || passes.ao;
+        m_recorded_passes.reflections = m_recorded_passes.reflections || passes.reflections;
+        m_recorded_passes.ddgi        = m_recorded_passes.ddgi || passes.ddgi;
+
+        m_active_passes = passes;
     }
 
     // -----------------------------------------------------------------------------------------------------------------------------------
@@ -1062,7 +1954,7 @@ private:
                 m_main_camera->update_from_frame(constants::fixed_camera_position_vectors[m_common_resources->current_scene_type][m_current_fixed_camera_angle], constants::fixed_camera_forward_vectors[m_common_resources->current_scene_type][m_current_fixed_camera_angle], constants::fixed_camera_right_vectors[m_common_resources->current_scene_type][m_current_fixed_camera_angle]);
         }
         else
-            m_common_resources->demo_players[m_common_resources->current_scene_type]->update(m_delta, m_main_camera.get());
+            m_common_resources->demo_players[m_common_resources->current_scene_type]->update(m_benchmark->enabled() ? BENCHMARK_FIXED_DELTA : m_delta, m_main_camera.get());
 
         m_common_resources->frame_time    = m_delta_seconds;
         m_common_resources->camera_delta  = m_main_camera->m_position - m_common_resources->prev_position;
@@ -1131,12 +2023,159 @@ private:
             m_main_camera->set_position(glm::vec3(-8.837002f, 8.267305f, 18.703117f));
         }
 
+        m_many_lights->generate_lights();
+
         reset_light();
     }
 
     // -----------------------------------------------------------------------------------------------------------------------------------
 
+    void begin_benchmark()
+    {
+        if (m_benchmark->overrides_scale())
+        {
+            m_ray_traced_shadows->set_scale(m_benchmark->scale());
+            m_ray_traced_ao->set_scale(m_benchmark->scale());
+            m_ray_traced_reflections->set_scale(m_benchmark->scale());
+        }
+
+        m_ray_traced_shadows->set_precision(m_benchmark->precision());
+        m_ray_traced_ao->set_precision(m_benchmark->precision());
+        m_ray_traced_reflections->set_precision(m_benchmark->precision());
+        m_ddgi->set_precision(m_benchmark->precision());
+
+        m_common_resources->gpu_timer->set_enabled(true);
+        m_common_resources->gpu_counters->set_enabled(true);
+
+        m_debug_gui = false;
+
+        if (m_benchmark->reference())
+        {
+            m_camera_type                = CAMERA_TYPE_FIXED;
+            m_current_fixed_camera_angle = 0;
+
+            begin_reference_camera();
+        }
+        else
+        {
+            m_camera_type = CAMERA_TYPE_ANIMATED;
+
+            m_common_resources->demo_players[m_common_resources->current_scene_type]->play();
+        }
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void begin_reference_camera()
+    {
+        m_ground_truth_path_tracer->end_batch();
+
+        m_common_resources->current_visualization_type = VISUALIZATION_TYPE_FINAL;
+        m_benchmark->begin_measurement(m_common_resources->num_frames + 1);
+
+        m_reference.path_trace = false;
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Times the hybrid renderer from the current fixed camera, then accumulates a reference for it and compares the two. Runs
+    // after the frame has been submitted, the read backs wait for it to finish.
+    void update_reference()
+    {
+        const VkExtent2D extents  = m_vk_backend->swap_chain_extents();
+        const float      exposure = m_tone_map->exposure();
+
+        if (!m_reference.path_trace)
+        {
+            if (!m_benchmark->update(m_common_resources->gpu_timer.get()))
+                return;
+
+            // The timings arrive a few frames late, the camera does not move so the frames rendered since look the same.
+            m_reference.hybrid_image = tone_map_image(read_back_image(m_vk_backend, m_temporal_aa->output_image(), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL), exposure);
+            m_reference.previous_image.clear();
+            m_reference.previous_spp = 0;
+            m_reference.checkpoint   = m_benchmark->spp_per_dispatch();
+            m_reference.noise_psnr   = 0.0f;
+            m_reference.path_trace   = true;
+
+            m_common_resources->current_visualization_type = VISUALIZATION_TYPE_GROUND_TRUTH;
+            m_ground_truth_path_tracer->begin_batch(m_benchmark->reference_spp(), m_benchmark->spp_per_dispatch(), m_benchmark->tile_size(), m_benchmark->tiles_per_frame());
+
+            return;
+        }
+
+        const uint32_t spp      = m_ground_truth_path_tracer->batch_samples();
+        const bool     finished = m_ground_truth_path_tracer->batch_finished();
+
+        // The reference is read back every time its number of samples has doubled.
+        if (spp < m_reference.checkpoint && !finished)
+            return;
+
+        std::vector<glm::vec3> reference = tone_map_image(read_back_image(m_vk_backend, m_ground_truth_path_tracer->output_image(), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL), exposure);
+
+        bool converged = false;
+
+        // The accumulations at m and n samples differ by n / m - 1 times the variance left at n samples, which gives an estimate
+        // of the noise in the reference without knowing the converged image.
+        if (!m_reference.previous_image.empty())
+        {
+            m_reference.noise_psnr = psnr(m_reference.previous_image, reference) + 10.0f * log10f(float(spp) / float(m_reference.previous_spp) - 1.0f);
+            converged              = m_benchmark->convergence_threshold() > 0.0f && m_reference.noise_psnr >= m_benchmark->convergence_threshold();
+        }
+
+        m_reference.previous_image = reference;
+        m_reference.previous_spp   = spp;
+
+        while (m_reference.checkpoint <= spp)
+            m_reference.checkpoint *= 2;
+
+        if (!finished && !converged)
+            return;
+
+        m_benchmark->add_reference_result(m_current_fixed_camera_angle,
+                                          spp,
+                                          converged,
+                                          m_reference.noise_psnr,
+                                          psnr(reference, m_reference.hybrid_image),
+                                          flip(reference, m_reference.hybrid_image, extents.width, extents.height));
+
+        DW_LOG_INFO("Reference camera " + std::to_string(m_current_fixed_camera_angle) + " done at " + std::to_string(spp) + " spp");
+
+        if (++m_current_fixed_camera_angle < constants::fixed_camera_forward_vectors[m_common_resources->current_scene_type].size())
+            begin_reference_camera();
+        else
+        {
+            m_benchmark->write_reference_results(extents.width, extents.height, m_common_resources->memory_tracker.get());
+            request_exit();
+        }
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
 private:
+    struct Reference
+    {
+        bool                   path_trace   = false;
+        uint32_t               checkpoint   = 0;
+        uint32_t               previous_spp = 0;
+        float                  noise_psnr   = 0.0f;
+        std::vector<glm::vec3> hybrid_image;
+        std::vector<glm::vec3> previous_image;
+    };
+
+    struct ActivePasses
+    {
+        bool g_buffer         = false;
+        bool shadows          = false;
+        bool ao               = false;
+        bool reflections      = false;
+        bool ddgi             = false;
+        bool local_lights     = false;
+        bool deferred_shading = false;
+        bool ground_truth     = false;
+        bool temporal_aa      = false;
+    };
+
     std::unique_ptr<CommonResources>       m_common_resources;
     std::unique_ptr<GBuffer>               m_g_buffer;
     std::unique_ptr<DeferredShading>       m_deferred_shading;
@@ -1144,9 +2183,13 @@ private:
     std::unique_ptr<RayTracedAO>           m_ray_traced_ao;
     std::unique_ptr<RayTracedReflections>  m_ray_traced_reflections;
     std::unique_ptr<DDGI>                  m_ddgi;
+    std::unique_ptr<ManyLights>            m_many_lights;
     std::unique_ptr<GroundTruthPathTracer> m_ground_truth_path_tracer;
     std::unique_ptr<TemporalAA>            m_temporal_aa;
     std::unique_ptr<ToneMap>               m_tone_map;
+    std::unique_ptr<Benchmark>             m_benchmark;
+    std::unique_ptr<DynamicResolution>     m_dynamic_resolution;
+    std::unique_ptr<CommandRecorder>       m_command_recorder;
 
     // Camera.
     CameraType                  m_camera_type                = CAMERA_TYPE_FREE;
@@ -1164,6 +2207,9 @@ private:
     bool                        m_side_to_side_motion          = false;
     bool                        m_debug_gui                    = false;
 
+    // Scene selected from the UI that is loaded at the start of the next frame, SCENE_TYPE_COUNT if there is none.
+    SceneType m_pending_scene_type = SCENE_TYPE_COUNT;
+
     // Camera orientation.
     float m_camera_x;
     float m_camera_y;
@@ -1178,12 +2224,29 @@ private:
     float               m_light_intensity           = 1.0f;
     float               m_light_cone_angle_inner    = 40.0f;
     float               m_light_cone_angle_outer    = 50.0f;
+    float               m_sky_update_threshold      = 0.25f;
     float               m_light_animation_time      = 0.0f;
     bool                m_light_animation           = false;
     LightType           m_light_type                = LIGHT_TYPE_DIRECTIONAL;
 
     // Uniforms.
     UBO m_ubo_data;
+
+    // Pass culling.
+    ActivePasses m_active_passes;
+    ActivePasses m_recorded_passes;
+
+    // Async compute.
+    dw::vk::Semaphore::Ptr m_g_buffer_semaphores[dw::vk::Backend::kMaxFramesInFlight];
+    dw::vk::Semaphore::Ptr m_async_compute_semaphores[dw::vk::Backend::kMaxFramesInFlight];
+    QueueType              m_ray_traced_lighting_queue_type = QUEUE_TYPE_GRAPHICS; // Local lights, DDGI and reflections
+
+    // Frame latency.
+    int32_t m_frames_in_flight = dw::vk::Backend::kMaxFramesInFlight;
+    VkFence m_frame_fences[dw::vk::Backend::kMaxFramesInFlight];
+
+    // Reference comparison.
+    Reference m_reference;
 };
 
 DW_DECLARE_MAIN(HybridRendering)
\ No newline at end of file
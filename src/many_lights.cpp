@@ -0,0 +1,669 @@
+#include "many_lights.h"
+#include "g_buffer.h"
+#include "render_graph.h"
+#include "utilities.h"
+#include <profiler.h>
+#include <macros.h>
+#include <imgui.h>
+#include <random>
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static const uint32_t CULL_NUM_THREADS     = 64;
+static const uint32_t RESTIR_NUM_THREADS_X = 8;
+static const uint32_t RESTIR_NUM_THREADS_Y = 8;
+static const uint32_t NUM_LIGHT_CLUSTERS   = LIGHT_CLUSTER_GRID_X * LIGHT_CLUSTER_GRID_Y * LIGHT_CLUSTER_GRID_Z;
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+struct LightClusterUniforms
+{
+    glm::mat4  view;
+    glm::mat4  view_proj;
+    glm::mat4  proj_inverse;
+    glm::vec4  cluster_params;
+    glm::uvec4 light_counts;
+};
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+struct TemporalReusePushConstants
+{
+    float    bias;
+    uint32_t num_frames;
+    uint32_t num_candidates;
+    uint32_t temporal_reuse;
+    float    max_history_length;
+};
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+struct SpatialReusePushConstants
+{
+    float    bias;
+    uint32_t num_frames;
+    uint32_t num_samples;
+    float    radius;
+};
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+ManyLights::ManyLights(std::weak_ptr<dw::vk::Backend> backend, CommonResources* common_resources, GBuffer* g_buffer) :
+    m_backend(backend), m_common_resources(common_resources), m_g_buffer(g_buffer)
+{
+    m_width  = m_common_resources->render_width;
+    m_height = m_common_resources->render_height;
+
+    create_images();
+    create_buffers();
+    create_descriptor_sets();
+    write_descriptor_sets();
+    create_pipelines();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+ManyLights::~ManyLights()
+{
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void ManyLights::cull(dw::vk::CommandBuffer::Ptr cmd_buf)
+{
+    DW_SCOPED_SAMPLE("Light Culling", cmd_buf);
+    GPU_SCOPED_TIMER("Light Culling", cmd_buf, m_common_resources->gpu_timer.get());
+
+    auto backend = m_backend.lock();
+
+    update_uniforms();
+
+    // The cluster lists of the previous frame may still be read by its shading.
+    {
+        std::vector<VkMemoryBarrier> memory_barriers = {
+            memory_barrier(VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT)
+        };
+
+        pipeline_barrier(cmd_buf, memory_barriers, {}, {}, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | shading_stages(), VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+    }
+
+    vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_cull.pipeline->handle());
+
+    const uint32_t dynamic_offsets[] = {
+        current_ubo_offset(),
+        current_lights_offset()
+    };
+
+    VkDescriptorSet descriptor_sets[] = {
+        m_cull.ds->handle()
+    };
+
+    vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_cull.pipeline_layout->handle(), 0, 1, descriptor_sets, 2, dynamic_offsets);
+
+    vkCmdDispatch(cmd_buf->handle(), NUM_LIGHT_CLUSTERS / CULL_NUM_THREADS, 1, 1);
+
+    {
+        std::vector<VkMemoryBarrier> memory_barriers = {
+            memory_barrier(VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT)
+        };
+
+        pipeline_barrier(cmd_buf, memory_barriers, {}, {}, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | shading_stages());
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void ManyLights::render(dw::vk::CommandBuffer::Ptr cmd_buf)
+{
+    DW_SCOPED_SAMPLE("Many Lights", cmd_buf);
+    GPU_SCOPED_TIMER("Many Lights", cmd_buf, m_common_resources->gpu_timer.get());
+
+    temporal_reuse(cmd_buf);
+    spatial_reuse(cmd_buf);
+
+    m_first_frame = false;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void ManyLights::gui()
+{
+    ImGui::SliderInt("Num Lights", &m_light_generator.num_lights, 0, MAX_LOCAL_LIGHTS);
+    ImGui::InputFloat("Intensity", &m_light_generator.intensity);
+    ImGui::InputFloat("Range", &m_light_generator.range);
+    ImGui::SliderFloat("Spot Fraction", &m_light_generator.spot_fraction, 0.0f, 1.0f);
+
+    if (ImGui::Button("Generate"))
+        generate_lights();
+
+    ImGui::Text("Active Lights: %u", num_lights());
+    ImGui::InputFloat("Bias", &m_bias);
+    ImGui::SliderInt("Candidates", &m_temporal_reuse.num_candidates, 1, 32);
+    ImGui::Checkbox("Temporal Reuse", &m_temporal_reuse.enabled);
+    ImGui::InputFloat("Max History Length", &m_temporal_reuse.max_history_length);
+    ImGui::Checkbox("Spatial Reuse", &m_spatial_reuse.enabled);
+    ImGui::SliderInt("Spatial Samples", &m_spatial_reuse.num_samples, 1, 8);
+    ImGui::SliderFloat("Spatial Radius", &m_spatial_reuse.radius, 1.0f, 32.0f);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void ManyLights::generate_lights()
+{
+    glm::vec3 min_extents = m_common_resources->current_scene()->min_extents();
+    glm::vec3 max_extents = m_common_resources->current_scene()->max_extents();
+
+    // Seeded so that the same settings always give the same lights, which keeps benchmark runs comparable.
+    std::mt19937                          generator(1337);
+    std::uniform_real_distribution<float> distribution(0.0f, 1.0f);
+
+    m_lights.resize(m_light_generator.num_lights);
+
+    for (auto& light : m_lights)
+    {
+        glm::vec3 position = glm::mix(min_extents, max_extents, glm::vec3(distribution(generator), distribution(generator), distribution(generator)));
+        glm::vec3 color    = glm::mix(glm::vec3(0.2f), glm::vec3(1.0f), glm::vec3(distribution(generator), distribution(generator), distribution(generator)));
+
+        light.set_light_position(position);
+        light.set_light_color(color);
+        light.set_light_intensity(m_light_generator.intensity);
+        light.set_light_range(m_light_generator.range);
+        light.set_light_radius(0.0f);
+
+        // Spot lights point straight down, the direction points towards the light like it does for the main light.
+        if (distribution(generator) < m_light_generator.spot_fraction)
+        {
+            light.set_light_type(LIGHT_TYPE_SPOT);
+            light.set_light_direction(glm::vec3(0.0f, 1.0f, 0.0f));
+            light.set_light_cos_theta_inner(glm::cos(glm::radians(20.0f)));
+            light.set_light_cos_theta_outer(glm::cos(glm::radians(40.0f)));
+        }
+        else
+        {
+            light.set_light_type(LIGHT_TYPE_POINT);
+            light.set_light_direction(glm::vec3(0.0f));
+            light.set_light_cos_theta_inner(0.0f);
+            light.set_light_cos_theta_outer(0.0f);
+        }
+    }
+
+    // The light indices stored in the history no longer refer to the same lights.
+    m_first_frame = true;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+dw::vk::DescriptorSet::Ptr ManyLights::ds()
+{
+    return m_cull.ds;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+uint32_t ManyLights::current_ubo_offset()
+{
+    auto backend = m_backend.lock();
+    return m_cull.ubo_size * backend->current_frame_idx();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+uint32_t ManyLights::current_lights_offset()
+{
+    auto backend = m_backend.lock();
+    return m_cull.lights_size * backend->current_frame_idx();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// The clusters and reservoirs written on the async compute queue, which deferred shading reads. The reservoirs stay in the general
+// layout from their creation on. The uniforms and lights are only written from the host.
+void ManyLights::add_queue_transfer_resources(QueueTransfer& transfer)
+{
+    transfer.add_buffer(m_cull.cluster_light_counts_buffer);
+    transfer.add_buffer(m_cull.cluster_light_indices_buffer);
+    transfer.add_image(m_temporal_reuse.image, VK_IMAGE_LAYOUT_GENERAL);
+    transfer.add_image(m_spatial_reuse.image, VK_IMAGE_LAYOUT_GENERAL);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void ManyLights::create_images()
+{
+    auto backend = m_backend.lock();
+
+    // Temporal Reuse
+    {
+        m_temporal_reuse.image = dw::vk::Image::create(backend, VK_IMAGE_TYPE_2D, m_width, m_height, 1, 1, 1, VK_FORMAT_R32G32B32A32_SFLOAT, VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, VK_SAMPLE_COUNT_1_BIT);
+        m_temporal_reuse.image->set_name("Many Lights Temporal Reservoirs");
+
+        m_temporal_reuse.view = dw::vk::ImageView::create(backend, m_temporal_reuse.image, VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT);
+        m_temporal_reuse.view->set_name("Many Lights Temporal Reservoirs");
+    }
+
+    // Spatial Reuse, which also holds the history of the next frame.
+    {
+        m_spatial_reuse.image = dw::vk::Image::create(backend, VK_IMAGE_TYPE_2D, m_width, m_height, 1, 1, 1, VK_FORMAT_R32G32B32A32_SFLOAT, VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, VK_SAMPLE_COUNT_1_BIT);
+        m_spatial_reuse.image->set_name("Many Lights Reservoirs");
+
+        m_spatial_reuse.view = dw::vk::ImageView::create(backend, m_spatial_reuse.image, VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT);
+        m_spatial_reuse.view->set_name("Many Lights Reservoirs");
+    }
+
+    // The reservoirs are written and sampled in the general layout. Start out with empty ones so that deferred shading can bind
+    // them before the passes have run.
+    {
+        auto cmd_buf = backend->allocate_graphics_command_buffer(true);
+
+        VkImageSubresourceRange subresource_range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+
+        {
+            std::vector<VkImageMemoryBarrier> image_barriers = {
+                image_memory_barrier(m_temporal_reuse.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, subresource_range, 0, VK_ACCESS_TRANSFER_WRITE_BIT),
+                image_memory_barrier(m_spatial_reuse.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, subresource_range, 0, VK_ACCESS_TRANSFER_WRITE_BIT)
+            };
+
+            pipeline_barrier(cmd_buf, {}, image_barriers, {}, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+        }
+
+        VkClearColorValue color;
+
+        color.float32[0] = 0.0f;
+        color.float32[1] = 0.0f;
+        color.float32[2] = 0.0f;
+        color.float32[3] = 0.0f;
+
+        vkCmdClearColorImage(cmd_buf->handle(), m_temporal_reuse.image->handle(), VK_IMAGE_LAYOUT_GENERAL, &color, 1, &subresource_range);
+        vkCmdClearColorImage(cmd_buf->handle(), m_spatial_reuse.image->handle(), VK_IMAGE_LAYOUT_GENERAL, &color, 1, &subresource_range);
+
+        vkEndCommandBuffer(cmd_buf->handle());
+
+        backend->flush_graphics({ cmd_buf });
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void ManyLights::create_buffers()
+{
+    auto backend = m_backend.lock();
+
+    // Both the uniforms and the lights are written by the CPU every frame, so there is a copy of each per frame in flight. The
+    // size of a copy of the lights is a multiple of any storage buffer offset alignment.
+    m_cull.ubo_size    = backend->aligned_dynamic_ubo_size(sizeof(LightClusterUniforms));
+    m_cull.lights_size = sizeof(Light) * MAX_LOCAL_LIGHTS;
+
+    m_cull.ubo                          = dw::vk::Buffer::create(backend, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, m_cull.ubo_size * dw::vk::Backend::kMaxFramesInFlight, VMA_MEMORY_USAGE_CPU_TO_GPU, VMA_ALLOCATION_CREATE_MAPPED_BIT);
+    m_cull.lights_buffer                = dw::vk::Buffer::create(backend, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, m_cull.lights_size * dw::vk::Backend::kMaxFramesInFlight, VMA_MEMORY_USAGE_CPU_TO_GPU, VMA_ALLOCATION_CREATE_MAPPED_BIT);
+    m_cull.cluster_light_counts_buffer  = dw::vk::Buffer::create(backend, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sizeof(uint32_t) * NUM_LIGHT_CLUSTERS, VMA_MEMORY_USAGE_GPU_ONLY, 0);
+    m_cull.cluster_light_indices_buffer = dw::vk::Buffer::create(backend, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sizeof(uint32_t) * NUM_LIGHT_CLUSTERS * MAX_LIGHTS_PER_CLUSTER, VMA_MEMORY_USAGE_GPU_ONLY, 0);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void ManyLights::create_descriptor_sets()
+{
+    auto backend = m_backend.lock();
+
+    m_cull.ds = backend->allocate_descriptor_set(m_common_resources->lights_ds_layout);
+    m_cull.ds->set_name("Lights");
+
+    m_temporal_reuse.write_ds = backend->allocate_descriptor_set(m_common_resources->storage_image_ds_layout);
+    m_temporal_reuse.write_ds->set_name("Many Lights Temporal Reuse Write");
+
+    m_temporal_reuse.read_ds = backend->allocate_descriptor_set(m_common_resources->combined_sampler_ds_layout);
+    m_temporal_reuse.read_ds->set_name("Many Lights Temporal Reuse Read");
+
+    m_spatial_reuse.write_ds = backend->allocate_descriptor_set(m_common_resources->storage_image_ds_layout);
+    m_spatial_reuse.write_ds->set_name("Many Lights Spatial Reuse Write");
+
+    m_spatial_reuse.read_ds = backend->allocate_descriptor_set(m_common_resources->combined_sampler_ds_layout);
+    m_spatial_reuse.read_ds->set_name("Many Lights Spatial Reuse Read");
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void ManyLights::write_descriptor_sets()
+{
+    auto backend = m_backend.lock();
+
+    // Lights
+    {
+        std::vector<VkDescriptorBufferInfo> buffer_infos;
+        std::vector<VkDescriptorImageInfo>  image_infos;
+        std::vector<VkWriteDescriptorSet>   write_datas;
+        VkWriteDescriptorSet                write_data;
+
+        buffer_infos.reserve(4);
+        image_infos.reserve(1);
+        write_datas.reserve(5);
+
+        const dw::vk::Buffer::Ptr buffers[]          = { m_cull.ubo, m_cull.lights_buffer, m_cull.cluster_light_counts_buffer, m_cull.cluster_light_indices_buffer };
+        const VkDeviceSize        ranges[]           = { sizeof(LightClusterUniforms), m_cull.lights_size, m_cull.cluster_light_counts_buffer->size(), m_cull.cluster_light_indices_buffer->size() };
+        const VkDescriptorType    descriptor_types[] = { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER };
+
+        for (int i = 0; i < 4; i++)
+        {
+            VkDescriptorBufferInfo buffer_info;
+
+            buffer_info.range  = ranges[i];
+            buffer_info.offset = 0;
+            buffer_info.buffer = buffers[i]->handle();
+
+            buffer_infos.push_back(buffer_info);
+
+            DW_ZERO_MEMORY(write_data);
+
+            write_data.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            write_data.descriptorCount = 1;
+            write_data.descriptorType  = descriptor_types[i];
+            write_data.pBufferInfo     = &buffer_infos.back();
+            write_data.dstBinding      = i;
+            write_data.dstSet          = m_cull.ds->handle();
+
+            write_datas.push_back(write_data);
+        }
+
+        {
+            VkDescriptorImageInfo sampler_image_info;
+
+            sampler_image_info.sampler     = backend->nearest_sampler()->handle();
+            sampler_image_info.imageView   = m_spatial_reuse.view->handle();
+            sampler_image_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+            image_infos.push_back(sampler_image_info);
+
+            DW_ZERO_MEMORY(write_data);
+
+            write_data.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            write_data.descriptorCount = 1;
+            write_data.descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            write_data.pImageInfo      = &image_infos.back();
+            write_data.dstBinding      = 4;
+            write_data.dstSet          = m_cull.ds->handle();
+
+            write_datas.push_back(write_data);
+        }
+
+        vkUpdateDescriptorSets(backend->device(), write_datas.size(), write_datas.data(), 0, nullptr);
+    }
+
+    // Reservoirs
+    {
+        const dw::vk::ImageView::Ptr     views[]     = { m_temporal_reuse.view, m_spatial_reuse.view };
+        const dw::vk::DescriptorSet::Ptr write_dss[] = { m_temporal_reuse.write_ds, m_spatial_reuse.write_ds };
+        const dw::vk::DescriptorSet::Ptr read_dss[]  = { m_temporal_reuse.read_ds, m_spatial_reuse.read_ds };
+
+        for (int i = 0; i < 2; i++)
+        {
+            std::vector<VkDescriptorImageInfo> image_infos;
+            std::vector<VkWriteDescriptorSet>  write_datas;
+            VkWriteDescriptorSet               write_data;
+
+            image_infos.reserve(2);
+            write_datas.reserve(2);
+
+            {
+                VkDescriptorImageInfo storage_image_info;
+
+                storage_image_info.sampler     = VK_NULL_HANDLE;
+                storage_image_info.imageView   = views[i]->handle();
+                storage_image_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+                image_infos.push_back(storage_image_info);
+
+                DW_ZERO_MEMORY(write_data);
+
+                write_data.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                write_data.descriptorCount = 1;
+                write_data.descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+                write_data.pImageInfo      = &image_infos.back();
+                write_data.dstBinding      = 0;
+                write_data.dstSet          = write_dss[i]->handle();
+
+                write_datas.push_back(write_data);
+            }
+
+            {
+                VkDescriptorImageInfo sampler_image_info;
+
+                sampler_image_info.sampler     = backend->nearest_sampler()->handle();
+                sampler_image_info.imageView   = views[i]->handle();
+                sampler_image_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+                image_infos.push_back(sampler_image_info);
+
+                DW_ZERO_MEMORY(write_data);
+
+                write_data.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                write_data.descriptorCount = 1;
+                write_data.descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+                write_data.pImageInfo      = &image_infos.back();
+                write_data.dstBinding      = 0;
+                write_data.dstSet          = read_dss[i]->handle();
+
+                write_datas.push_back(write_data);
+            }
+
+            vkUpdateDescriptorSets(backend->device(), write_datas.size(), write_datas.data(), 0, nullptr);
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void ManyLights::create_pipelines()
+{
+    auto backend = m_backend.lock();
+
+    std::vector<PipelineCache::ComputePipelineDesc> compute_pipelines;
+
+    // Cull
+    {
+        dw::vk::PipelineLayout::Desc desc;
+
+        desc.add_descriptor_set_layout(m_common_resources->lights_ds_layout);
+
+        m_cull.pipeline_layout = dw::vk::PipelineLayout::create(backend, desc);
+        m_cull.pipeline_layout->set_name("Light Cull Pipeline Layout");
+
+        compute_pipelines.push_back({ "shaders/lights_cull.comp.spv", m_cull.pipeline_layout, &m_cull.pipeline });
+    }
+
+    // Temporal Reuse
+    {
+        dw::vk::PipelineLayout::Desc desc;
+
+        desc.add_descriptor_set_layout(m_common_resources->current_scene()->descriptor_set_layout());
+        desc.add_descriptor_set_layout(m_common_resources->storage_image_ds_layout);
+        desc.add_descriptor_set_layout(m_common_resources->combined_sampler_ds_layout);
+        desc.add_descriptor_set_layout(m_g_buffer->ds_layout());
+        desc.add_descriptor_set_layout(m_g_buffer->ds_layout());
+        desc.add_descriptor_set_layout(m_common_resources->per_frame_ds_layout);
+        desc.add_descriptor_set_layout(m_common_resources->lights_ds_layout);
+
+        desc.add_push_constant_range(VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(TemporalReusePushConstants));
+
+        m_temporal_reuse.pipeline_layout = dw::vk::PipelineLayout::create(backend, desc);
+        m_temporal_reuse.pipeline_layout->set_name("Light Temporal Reuse Pipeline Layout");
+
+        compute_pipelines.push_back({ "shaders/lights_restir_temporal.comp.spv", m_temporal_reuse.pipeline_layout, &m_temporal_reuse.pipeline });
+    }
+
+    // Spatial Reuse
+    {
+        dw::vk::PipelineLayout::Desc desc;
+
+        desc.add_descriptor_set_layout(m_common_resources->current_scene()->descriptor_set_layout());
+        desc.add_descriptor_set_layout(m_common_resources->storage_image_ds_layout);
+        desc.add_descriptor_set_layout(m_common_resources->combined_sampler_ds_layout);
+        desc.add_descriptor_set_layout(m_g_buffer->ds_layout());
+        desc.add_descriptor_set_layout(m_common_resources->per_frame_ds_layout);
+        desc.add_descriptor_set_layout(m_common_resources->lights_ds_layout);
+
+        desc.add_push_constant_range(VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(SpatialReusePushConstants));
+
+        m_spatial_reuse.pipeline_layout = dw::vk::PipelineLayout::create(backend, desc);
+        m_spatial_reuse.pipeline_layout->set_name("Light Spatial Reuse Pipeline Layout");
+
+        compute_pipelines.push_back({ "shaders/lights_restir_spatial.comp.spv", m_spatial_reuse.pipeline_layout, &m_spatial_reuse.pipeline });
+    }
+
+    m_common_resources->pipeline_cache->create_compute_pipelines(compute_pipelines);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void ManyLights::update_uniforms()
+{
+    auto backend = m_backend.lock();
+
+    LightClusterUniforms uniforms;
+
+    uniforms.view           = m_common_resources->view;
+    uniforms.view_proj      = m_common_resources->projection * m_common_resources->view;
+    uniforms.proj_inverse   = glm::inverse(m_common_resources->projection);
+    uniforms.cluster_params = glm::vec4(CAMERA_NEAR_PLANE, CAMERA_FAR_PLANE, float(LIGHT_CLUSTER_GRID_Z) / logf(CAMERA_FAR_PLANE / CAMERA_NEAR_PLANE), 0.0f);
+    uniforms.light_counts   = glm::uvec4(num_lights(), 0, 0, 0);
+
+    uint8_t* ptr = (uint8_t*)m_cull.ubo->mapped_ptr();
+    memcpy(ptr + current_ubo_offset(), &uniforms, sizeof(LightClusterUniforms));
+
+    if (!m_lights.empty())
+    {
+        ptr = (uint8_t*)m_cull.lights_buffer->mapped_ptr();
+        memcpy(ptr + current_lights_offset(), m_lights.data(), sizeof(Light) * m_lights.size());
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void ManyLights::temporal_reuse(dw::vk::CommandBuffer::Ptr cmd_buf)
+{
+    DW_SCOPED_SAMPLE("Temporal Reuse", cmd_buf);
+
+    auto backend = m_backend.lock();
+
+    VkImageSubresourceRange subresource_range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+
+    // The temporal reservoirs of the previous frame may still be read by its spatial reuse.
+    {
+        std::vector<VkImageMemoryBarrier> image_barriers = {
+            image_memory_barrier(m_temporal_reuse.image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL, subresource_range, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT)
+        };
+
+        pipeline_barrier(cmd_buf, {}, image_barriers, {}, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+    }
+
+    vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_temporal_reuse.pipeline->handle());
+
+    TemporalReusePushConstants push_constants;
+
+    push_constants.bias               = m_bias;
+    push_constants.num_frames         = m_common_resources->num_frames;
+    push_constants.num_candidates     = m_temporal_reuse.num_candidates;
+    push_constants.temporal_reuse     = m_temporal_reuse.enabled && !m_first_frame ? 1u : 0u;
+    push_constants.max_history_length = m_temporal_reuse.max_history_length;
+
+    vkCmdPushConstants(cmd_buf->handle(), m_temporal_reuse.pipeline_layout->handle(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_constants), &push_constants);
+
+    const uint32_t dynamic_offsets[] = {
+        m_common_resources->ubo_size * backend->current_frame_idx(),
+        current_ubo_offset(),
+        current_lights_offset()
+    };
+
+    VkDescriptorSet descriptor_sets[] = {
+        m_common_resources->current_scene()->descriptor_set()->handle(),
+        m_temporal_reuse.write_ds->handle(),
+        m_spatial_reuse.read_ds->handle(),
+        m_g_buffer->output_ds()->handle(),
+        m_g_buffer->history_ds()->handle(),
+        m_common_resources->per_frame_ds->handle(),
+        m_cull.ds->handle()
+    };
+
+    vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_temporal_reuse.pipeline_layout->handle(), 0, 7, descriptor_sets, 3, dynamic_offsets);
+
+    const uint32_t NUM_THREADS_X = RESTIR_NUM_THREADS_X;
+    const uint32_t NUM_THREADS_Y = RESTIR_NUM_THREADS_Y;
+
+    vkCmdDispatch(cmd_buf->handle(), static_cast<uint32_t>(ceil(float(m_width) / float(NUM_THREADS_X))), static_cast<uint32_t>(ceil(float(m_height) / float(NUM_THREADS_Y))), 1);
+
+    // The final reservoirs of the previous frame were just read as the history and are written next, and the temporal
+    // reservoirs are read by the spatial reuse.
+    {
+        std::vector<VkImageMemoryBarrier> image_barriers = {
+            image_memory_barrier(m_temporal_reuse.image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL, subresource_range, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT),
+            image_memory_barrier(m_spatial_reuse.image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL, subresource_range, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT)
+        };
+
+        pipeline_barrier(cmd_buf, {}, image_barriers, {}, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | shading_stages(), VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void ManyLights::spatial_reuse(dw::vk::CommandBuffer::Ptr cmd_buf)
+{
+    DW_SCOPED_SAMPLE("Spatial Reuse", cmd_buf);
+
+    auto backend = m_backend.lock();
+
+    VkImageSubresourceRange subresource_range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+
+    vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_spatial_reuse.pipeline->handle());
+
+    SpatialReusePushConstants push_constants;
+
+    push_constants.bias        = m_bias;
+    push_constants.num_frames  = m_common_resources->num_frames;
+    push_constants.num_samples = m_spatial_reuse.enabled ? m_spatial_reuse.num_samples : 0;
+    push_constants.radius      = m_spatial_reuse.radius;
+
+    vkCmdPushConstants(cmd_buf->handle(), m_spatial_reuse.pipeline_layout->handle(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_constants), &push_constants);
+
+    const uint32_t dynamic_offsets[] = {
+        m_common_resources->ubo_size * backend->current_frame_idx(),
+        current_ubo_offset(),
+        current_lights_offset()
+    };
+
+    VkDescriptorSet descriptor_sets[] = {
+        m_common_resources->current_scene()->descriptor_set()->handle(),
+        m_spatial_reuse.write_ds->handle(),
+        m_temporal_reuse.read_ds->handle(),
+        m_g_buffer->output_ds()->handle(),
+        m_common_resources->per_frame_ds->handle(),
+        m_cull.ds->handle()
+    };
+
+    vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_spatial_reuse.pipeline_layout->handle(), 0, 6, descriptor_sets, 3, dynamic_offsets);
+
+    const uint32_t NUM_THREADS_X = RESTIR_NUM_THREADS_X;
+    const uint32_t NUM_THREADS_Y = RESTIR_NUM_THREADS_Y;
+
+    vkCmdDispatch(cmd_buf->handle(), static_cast<uint32_t>(ceil(float(m_width) / float(NUM_THREADS_X))), static_cast<uint32_t>(ceil(float(m_height) / float(NUM_THREADS_Y))), 1);
+
+    {
+        std::vector<VkImageMemoryBarrier> image_barriers = {
+            image_memory_barrier(m_spatial_reuse.image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL, subresource_range, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT)
+        };
+
+        pipeline_barrier(cmd_buf, {}, image_barriers, {}, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | shading_stages());
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// The stages outside of compute that read the light lists and reservoirs. Those passes are on the graphics queue, so when the
+// lighting is recorded for the async compute queue they are ordered through the semaphores between the queues instead.
+VkPipelineStageFlags ManyLights::shading_stages()
+{
+    if (m_queue_type == QUEUE_TYPE_ASYNC_COMPUTE)
+        return 0;
+
+    return VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
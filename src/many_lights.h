@@ -0,0 +1,111 @@
+#pragma once
+
+#include "common.h"
+
+// Must match lights_common.glsl.
+#define LIGHT_CLUSTER_GRID_X 16
+#define LIGHT_CLUSTER_GRID_Y 8
+#define LIGHT_CLUSTER_GRID_Z 24
+#define MAX_LIGHTS_PER_CLUSTER 64
+#define MAX_LOCAL_LIGHTS 1024
+
+class GBuffer;
+class QueueTransfer;
+
+// Point and spot lights on top of the main light. They are culled into clusters of the view frustum every frame, and each pixel
+// resamples the lights of its cluster into one light that is traced for visibility (ReSTIR), reusing the picks of the previous
+// frame and of its neighbours. The main light keeps its own denoised shadows.
+class ManyLights
+{
+public:
+    ManyLights(std::weak_ptr<dw::vk::Backend> backend, CommonResources* common_resources, GBuffer* g_buffer);
+    ~ManyLights();
+
+    void                       cull(dw::vk::CommandBuffer::Ptr cmd_buf);
+    void                       render(dw::vk::CommandBuffer::Ptr cmd_buf);
+    void                       gui();
+    void                       generate_lights();
+    dw::vk::DescriptorSet::Ptr ds();
+    uint32_t                   current_ubo_offset();
+    uint32_t                   current_lights_offset();
+    void                       add_queue_transfer_resources(QueueTransfer& transfer);
+
+    inline uint32_t  num_lights() { return static_cast<uint32_t>(m_lights.size()); }
+    inline void      restart_accumulation() { m_first_frame = true; }
+    inline QueueType queue_type() { return m_queue_type; }
+    inline void      set_queue_type(QueueType queue_type) { m_queue_type = queue_type; }
+
+private:
+    void create_images();
+    void create_buffers();
+    void create_descriptor_sets();
+    void write_descriptor_sets();
+    void create_pipelines();
+    void update_uniforms();
+    void temporal_reuse(dw::vk::CommandBuffer::Ptr cmd_buf);
+    void spatial_reuse(dw::vk::CommandBuffer::Ptr cmd_buf);
+
+    VkPipelineStageFlags shading_stages();
+
+private:
+    struct LightGenerator
+    {
+        int32_t num_lights    = 0;
+        float   intensity     = 20.0f;
+        float   range         = 10.0f;
+        float   spot_fraction = 0.25f;
+    };
+
+    struct Cull
+    {
+        size_t                      ubo_size;
+        size_t                      lights_size;
+        CachedComputePipeline::Ptr  pipeline;
+        dw::vk::PipelineLayout::Ptr pipeline_layout;
+        dw::vk::Buffer::Ptr         ubo;
+        dw::vk::Buffer::Ptr         lights_buffer;
+        dw::vk::Buffer::Ptr         cluster_light_counts_buffer;
+        dw::vk::Buffer::Ptr         cluster_light_indices_buffer;
+        dw::vk::DescriptorSet::Ptr  ds;
+    };
+
+    struct TemporalReuse
+    {
+        bool                        enabled            = true;
+        int32_t                     num_candidates     = 8;
+        float                       max_history_length = 20.0f;
+        CachedComputePipeline::Ptr  pipeline;
+        dw::vk::PipelineLayout::Ptr pipeline_layout;
+        dw::vk::Image::Ptr          image;
+        dw::vk::ImageView::Ptr      view;
+        dw::vk::DescriptorSet::Ptr  write_ds;
+        dw::vk::DescriptorSet::Ptr  read_ds;
+    };
+
+    struct SpatialReuse
+    {
+        bool                        enabled     = true;
+        int32_t                     num_samples = 4;
+        float                       radius      = 16.0f;
+        CachedComputePipeline::Ptr  pipeline;
+        dw::vk::PipelineLayout::Ptr pipeline_layout;
+        dw::vk::Image::Ptr          image;
+        dw::vk::ImageView::Ptr      view;
+        dw::vk::DescriptorSet::Ptr  write_ds;
+        dw::vk::DescriptorSet::Ptr  read_ds;
+    };
+
+    std::weak_ptr<dw::vk::Backend> m_backend;
+    CommonResources*               m_common_resources;
+    GBuffer*                       m_g_buffer;
+    uint32_t                       m_width;
+    uint32_t                       m_height;
+    float                          m_bias        = 0.1f;
+    bool                           m_first_frame = true;
+    QueueType                      m_queue_type  = QUEUE_TYPE_GRAPHICS;
+    std::vector<Light>             m_lights;
+    LightGenerator                 m_light_generator;
+    Cull                           m_cull;
+    TemporalReuse                  m_temporal_reuse;
+    SpatialReuse                   m_spatial_reuse;
+};
@@ -0,0 +1,93 @@
+#include "memory_tracker.h"
+#include <vk_mem_alloc.h>
+#include <algorithm>
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+MemoryTracker::MemoryTracker(dw::vk::Backend::Ptr backend) :
+    m_backend(backend)
+{
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+MemoryTracker::~MemoryTracker()
+{
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void MemoryTracker::track(const std::string& name, const std::vector<dw::vk::Image::Ptr>& images)
+{
+    auto backend = m_backend.lock();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    for (const auto& image : images)
+    {
+        if (!image)
+            continue;
+
+        VkMemoryRequirements requirements;
+
+        vkGetImageMemoryRequirements(backend->device(), image->handle(), &requirements);
+
+        m_entries.push_back({ name, image, requirements.size });
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+std::vector<MemoryTracker::Result> MemoryTracker::results()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_entries.erase(std::remove_if(m_entries.begin(), m_entries.end(), [](const Entry& entry) { return entry.image.expired(); }), m_entries.end());
+
+    // In the order the effects first tracked an image, which is the order they were created in.
+    std::vector<Result> results;
+
+    for (const auto& entry : m_entries)
+    {
+        auto it = std::find_if(results.begin(), results.end(), [&entry](const Result& result) { return result.name == entry.name; });
+
+        if (it == results.end())
+            results.push_back({ entry.name, entry.bytes, 1 });
+        else
+        {
+            it->bytes += entry.bytes;
+            it->num_images++;
+        }
+    }
+
+    return results;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void MemoryTracker::device_local_usage(VkDeviceSize& usage, VkDeviceSize& budget)
+{
+    auto backend = m_backend.lock();
+
+    const VkPhysicalDeviceMemoryProperties* memory_properties = nullptr;
+
+    vmaGetMemoryProperties(backend->allocator(), &memory_properties);
+
+    VmaBudget budgets[VK_MAX_MEMORY_HEAPS];
+
+    vmaGetBudget(backend->allocator(), &budgets[0]);
+
+    usage  = 0;
+    budget = 0;
+
+    for (uint32_t i = 0; i < memory_properties->memoryHeapCount; i++)
+    {
+        if (memory_properties->memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)
+        {
+            usage += budgets[i].usage;
+            budget += budgets[i].budget;
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
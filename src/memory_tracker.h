@@ -0,0 +1,42 @@
+#pragma once
+
+#include <vk.h>
+#include <mutex>
+
+// Device memory of the render targets of each effect. Images are tracked under the name of the effect that created them and are
+// only weakly referenced, so images replaced by a resize drop out of the totals once the deletion queue has destroyed them. The
+// size of an image is its memory requirement, which includes the padding and alignment of the driver. The device local totals
+// come from the VMA budget and cover every allocation, tracked or not. Images may be created on the recording threads, see
+// TransientImagePool, so tracking is serialized.
+class MemoryTracker
+{
+public:
+    struct Result
+    {
+        std::string  name;
+        VkDeviceSize bytes;
+        uint32_t     num_images;
+    };
+
+public:
+    MemoryTracker(dw::vk::Backend::Ptr backend);
+    ~MemoryTracker();
+
+    void                track(const std::string& name, const std::vector<dw::vk::Image::Ptr>& images);
+    std::vector<Result> results();
+    void                device_local_usage(VkDeviceSize& usage, VkDeviceSize& budget);
+
+    static inline float megabytes(VkDeviceSize bytes) { return float(double(bytes) / (1024.0 * 1024.0)); }
+
+private:
+    struct Entry
+    {
+        std::string                  name;
+        std::weak_ptr<dw::vk::Image> image;
+        VkDeviceSize                 bytes;
+    };
+
+    std::weak_ptr<dw::vk::Backend> m_backend;
+    std::vector<Entry>             m_entries;
+    std::mutex                     m_mutex;
+};
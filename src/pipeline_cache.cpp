@@ -0,0 +1,202 @@
+#include "pipeline_cache.h"
+#include "utilities.h"
+#include <macros.h>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#define PIPELINE_CACHE_MAGIC 0x43505248 // 'HRPC'
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+CachedComputePipeline::CachedComputePipeline(dw::vk::Backend::Ptr backend, VkPipeline pipeline) :
+    m_backend(backend), m_vk_pipeline(pipeline)
+{
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+CachedComputePipeline::~CachedComputePipeline()
+{
+    auto backend = m_backend.lock();
+
+    vkDestroyPipeline(backend->device(), m_vk_pipeline, nullptr);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+PipelineCache::PipelineCache(dw::vk::Backend::Ptr backend, const std::string& path) :
+    m_backend(backend), m_path(path)
+{
+    vkGetPhysicalDeviceProperties(backend->physical_device(), &m_properties);
+
+    std::vector<char> data;
+
+    VkPipelineCacheCreateInfo info;
+    DW_ZERO_MEMORY(info);
+
+    info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+
+    if (load(data))
+    {
+        info.initialDataSize = data.size();
+        info.pInitialData    = data.data();
+    }
+
+    if (vkCreatePipelineCache(backend->device(), &info, nullptr, &m_vk_pipeline_cache) != VK_SUCCESS)
+    {
+        // The driver may still reject data that passed the header check, start over with an empty cache.
+        info.initialDataSize = 0;
+        info.pInitialData    = nullptr;
+
+        if (vkCreatePipelineCache(backend->device(), &info, nullptr, &m_vk_pipeline_cache) != VK_SUCCESS)
+        {
+            DW_LOG_ERROR("Failed to create Pipeline Cache");
+            throw std::runtime_error("Failed to create Pipeline Cache");
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+PipelineCache::~PipelineCache()
+{
+    auto backend = m_backend.lock();
+
+    save();
+
+    vkDestroyPipelineCache(backend->device(), m_vk_pipeline_cache, nullptr);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void PipelineCache::create_compute_pipelines(const std::vector<ComputePipelineDesc>& descs)
+{
+    auto backend = m_backend.lock();
+
+    // Loading the modules is cheap compared to compiling the pipelines, so it stays on the calling thread.
+    std::vector<dw::vk::ShaderModule::Ptr> modules(descs.size());
+    std::vector<VkPipeline>                pipelines(descs.size(), VK_NULL_HANDLE);
+
+    for (size_t i = 0; i < descs.size(); i++)
+        modules[i] = dw::vk::ShaderModule::create_from_file(backend, descs[i].shader_path);
+
+    parallel_for(descs.size(), [&](uint32_t desc_idx) {
+        pipelines[desc_idx] = create_compute_pipeline(modules[desc_idx]->handle(), descs[desc_idx].pipeline_layout->handle(), descs[desc_idx].specialization_info);
+    });
+
+    for (size_t i = 0; i < descs.size(); i++)
+    {
+        if (pipelines[i] == VK_NULL_HANDLE)
+        {
+            DW_LOG_ERROR("Failed to create Compute Pipeline: " + descs[i].shader_path);
+            throw std::runtime_error("Failed to create Compute Pipeline: " + descs[i].shader_path);
+        }
+
+        *descs[i].pipeline = std::make_shared<CachedComputePipeline>(backend, pipelines[i]);
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void PipelineCache::save()
+{
+    auto backend = m_backend.lock();
+
+    size_t size = 0;
+
+    if (vkGetPipelineCacheData(backend->device(), m_vk_pipeline_cache, &size, nullptr) != VK_SUCCESS || size == 0)
+        return;
+
+    std::vector<char> data(size);
+
+    if (vkGetPipelineCacheData(backend->device(), m_vk_pipeline_cache, &size, data.data()) != VK_SUCCESS)
+        return;
+
+    std::ofstream file(m_path, std::ios::binary);
+
+    if (!file.is_open())
+    {
+        DW_LOG_ERROR("Failed to open Pipeline Cache for writing: " + m_path);
+        return;
+    }
+
+    FileHeader header;
+
+    fill_header(header);
+
+    header.data_size = size;
+
+    file.write((const char*)&header, sizeof(FileHeader));
+    file.write(data.data(), size);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void PipelineCache::fill_header(FileHeader& header)
+{
+    header.magic          = PIPELINE_CACHE_MAGIC;
+    header.vendor_id      = m_properties.vendorID;
+    header.device_id      = m_properties.deviceID;
+    header.driver_version = m_properties.driverVersion;
+    header.data_size      = 0;
+
+    memcpy(header.uuid, m_properties.pipelineCacheUUID, VK_UUID_SIZE);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool PipelineCache::load(std::vector<char>& data)
+{
+    std::ifstream file(m_path, std::ios::binary);
+
+    // There is no cache on the first run.
+    if (!file.is_open())
+        return false;
+
+    FileHeader header;
+    FileHeader expected;
+
+    fill_header(expected);
+
+    if (!file.read((char*)&header, sizeof(FileHeader)))
+        return false;
+
+    // The cache was written by another GPU or driver, which would ignore it at best.
+    if (header.magic != expected.magic || header.vendor_id != expected.vendor_id || header.device_id != expected.device_id || header.driver_version != expected.driver_version || memcmp(header.uuid, expected.uuid, VK_UUID_SIZE) != 0)
+        return false;
+
+    data.resize(header.data_size);
+
+    if (!file.read(data.data(), header.data_size))
+        return false;
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+VkPipeline PipelineCache::create_compute_pipeline(VkShaderModule shader_module, VkPipelineLayout pipeline_layout, const VkSpecializationInfo* specialization_info)
+{
+    auto backend = m_backend.lock();
+
+    VkComputePipelineCreateInfo info;
+    DW_ZERO_MEMORY(info);
+
+    info.sType                     = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    info.stage.sType               = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    info.stage.stage               = VK_SHADER_STAGE_COMPUTE_BIT;
+    info.stage.module              = shader_module;
+    info.stage.pName               = "main";
+    info.stage.pSpecializationInfo = specialization_info;
+    info.layout                    = pipeline_layout;
+
+    VkPipeline pipeline = VK_NULL_HANDLE;
+
+    if (vkCreateComputePipelines(backend->device(), m_vk_pipeline_cache, 1, &info, nullptr, &pipeline) != VK_SUCCESS)
+        return VK_NULL_HANDLE;
+
+    return pipeline;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
\ No newline at end of file
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <vk.h>
+
+#define PIPELINE_CACHE_PATH "pipeline_cache.bin"
+
+// A compute pipeline compiled through the PipelineCache, used in place of dw::vk::ComputePipeline which always compiles
+// without a cache.
+class CachedComputePipeline
+{
+public:
+    using Ptr = std::shared_ptr<CachedComputePipeline>;
+
+    CachedComputePipeline(dw::vk::Backend::Ptr backend, VkPipeline pipeline);
+    ~CachedComputePipeline();
+
+    inline VkPipeline handle() { return m_vk_pipeline; }
+
+private:
+    std::weak_ptr<dw::vk::Backend> m_backend;
+    VkPipeline                     m_vk_pipeline = VK_NULL_HANDLE;
+};
+
+// Owns the VkPipelineCache shared by every pipeline of the application. The cache is seeded from disk at startup and written
+// back on destruction, prefixed with the vendor, device, driver version and pipeline cache UUID of the device that produced
+// it so that a file left behind by another GPU or driver is discarded instead of being handed to the driver. Compute
+// pipelines are compiled on a pool of worker threads, the cache is internally synchronized so they can all share it.
+class PipelineCache
+{
+public:
+    struct ComputePipelineDesc
+    {
+        std::string                 shader_path;
+        dw::vk::PipelineLayout::Ptr pipeline_layout;
+        CachedComputePipeline::Ptr* pipeline;
+        const VkSpecializationInfo* specialization_info = nullptr;
+    };
+
+public:
+    PipelineCache(dw::vk::Backend::Ptr backend, const std::string& path = PIPELINE_CACHE_PATH);
+    ~PipelineCache();
+
+    // Compiles every pipeline concurrently and blocks until all of them are written to their destination.
+    void create_compute_pipelines(const std::vector<ComputePipelineDesc>& descs);
+    void save();
+
+    inline VkPipelineCache handle() { return m_vk_pipeline_cache; }
+
+private:
+    struct FileHeader
+    {
+        uint32_t magic;
+        uint32_t vendor_id;
+        uint32_t device_id;
+        uint32_t driver_version;
+        uint8_t  uuid[VK_UUID_SIZE];
+        uint64_t data_size;
+    };
+
+    void       fill_header(FileHeader& header);
+    bool       load(std::vector<char>& data);
+    VkPipeline create_compute_pipeline(VkShaderModule shader_module, VkPipelineLayout pipeline_layout, const VkSpecializationInfo* specialization_info);
+
+private:
+    std::weak_ptr<dw::vk::Backend> m_backend;
+    std::string                    m_path;
+    VkPhysicalDeviceProperties     m_properties;
+    VkPipelineCache                m_vk_pipeline_cache = VK_NULL_HANDLE;
+};
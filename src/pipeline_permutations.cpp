@@ -0,0 +1,29 @@
+#include "pipeline_permutations.h"
+#include <macros.h>
+#include <stdexcept>
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+PermutationSpecialization::PermutationSpecialization(PermutationKey key, uint32_t num_constants)
+{
+    if (num_constants > PIPELINE_PERMUTATIONS_MAX_CONSTANTS)
+        throw std::runtime_error("(Vulkan) Too many specialization constants for a pipeline permutation.");
+
+    for (uint32_t i = 0; i < num_constants; i++)
+    {
+        m_data[i] = (key & (1u << i)) ? VK_TRUE : VK_FALSE;
+
+        m_entries[i].constantID = i;
+        m_entries[i].offset     = i * sizeof(VkBool32);
+        m_entries[i].size       = sizeof(VkBool32);
+    }
+
+    DW_ZERO_MEMORY(m_info);
+
+    m_info.mapEntryCount = num_constants;
+    m_info.pMapEntries   = &m_entries[0];
+    m_info.dataSize      = num_constants * sizeof(VkBool32);
+    m_info.pData         = &m_data[0];
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
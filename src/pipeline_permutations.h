@@ -0,0 +1,92 @@
+#pragma once
+
+#include <vk.h>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+#include "pipeline_cache.h"
+
+#define PIPELINE_PERMUTATIONS_MAX_CONSTANTS 8
+
+// Values of the boolean specialization constants of a permutation, bit i holds the constant with constant_id i.
+using PermutationKey = uint32_t;
+
+inline PermutationKey permutation_bit(uint32_t constant_id, bool value) { return value ? (1u << constant_id) : 0u; }
+
+// The VkSpecializationInfo for the constants of a key. The map entries point into the object, so it stays where it was created
+// for as long as the pipeline is being created.
+class PermutationSpecialization
+{
+public:
+    PermutationSpecialization(PermutationKey key, uint32_t num_constants);
+    PermutationSpecialization(const PermutationSpecialization&) = delete;
+    PermutationSpecialization& operator=(const PermutationSpecialization&) = delete;
+
+    inline const VkSpecializationInfo* info() const { return &m_info; }
+
+private:
+    VkSpecializationInfo     m_info;
+    VkSpecializationMapEntry m_entries[PIPELINE_PERMUTATIONS_MAX_CONSTANTS];
+    VkBool32                 m_data[PIPELINE_PERMUTATIONS_MAX_CONSTANTS];
+};
+
+// The ray tracing pipeline of a permutation along with the table it was created from, the stages of the table carry the
+// specialization constants.
+struct RayTracingPermutation
+{
+    dw::vk::RayTracingPipeline::Ptr pipeline;
+    dw::vk::ShaderBindingTable::Ptr sbt;
+};
+
+// Variants of one pipeline that only differ in the values of their boolean specialization constants, so that feature toggles
+// are compiled into the shader instead of being branched on at runtime. A variant is created the first time its key is
+// requested and kept from then on, which also keeps it alive for the frames in flight that were recorded with it. Passes are
+// recorded on the worker threads of the CommandRecorder, so lookups are serialized.
+template <typename T>
+class PipelinePermutations
+{
+public:
+    using CreateFunction = std::function<T(const VkSpecializationInfo*)>;
+
+public:
+    PipelinePermutations(uint32_t num_constants, CreateFunction create_function) :
+        m_num_constants(num_constants), m_create_function(create_function)
+    {
+    }
+
+    T get(PermutationKey key)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        auto it = m_permutations.find(key);
+
+        if (it != m_permutations.end())
+            return it->second;
+
+        PermutationSpecialization specialization(key, m_num_constants);
+
+        T permutation = m_create_function(specialization.info());
+
+        m_permutations[key] = permutation;
+
+        return permutation;
+    }
+
+    inline uint32_t num_permutations()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return static_cast<uint32_t>(m_permutations.size());
+    }
+
+private:
+    uint32_t                              m_num_constants;
+    CreateFunction                        m_create_function;
+    std::mutex                            m_mutex;
+    std::unordered_map<PermutationKey, T> m_permutations;
+};
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+using GraphicsPipelinePermutations   = PipelinePermutations<dw::vk::GraphicsPipeline::Ptr>;
+using ComputePipelinePermutations    = PipelinePermutations<CachedComputePipeline::Ptr>;
+using RayTracingPipelinePermutations = PipelinePermutations<RayTracingPermutation>;
@@ -1,5 +1,6 @@
 #include "ray_traced_ao.h"
 #include "g_buffer.h"
+#include "svgf_denoiser.h"
 #include "utilities.h"
 #include <profiler.h>
 #include <macros.h>
@@ -15,38 +16,51 @@ static const uint32_t TEMPORAL_ACCUMULATION_NUM_THREADS_Y = 8;
 
 // -----------------------------------------------------------------------------------------------------------------------------------
 
-struct RayTracePushConstants
+// Specialization constant ids of ao_upsample.comp.
+enum AOUpsampleConstant
 {
-    uint32_t num_frames;
-    float    ray_length;
-    float    bias;
-    int32_t  g_buffer_mip;
+    AO_UPSAMPLE_CONSTANT_LOW_MEMORY,
+    AO_UPSAMPLE_CONSTANT_COUNT
 };
 
 // -----------------------------------------------------------------------------------------------------------------------------------
 
-struct TemporalReprojectionPushConstants
+struct RayTracePushConstants
 {
-    float   alpha;
-    int32_t g_buffer_mip;
+    glm::uvec4 g_buffer;
+    uint32_t   num_frames;
+    float      ray_length;
+    float      bias;
+    int32_t    g_buffer_mip;
+    uint32_t   sobol_idx;
+    uint32_t   scrambling_ranking_idx;
+    uint32_t   output_idx;
 };
 
 // -----------------------------------------------------------------------------------------------------------------------------------
 
-struct BilateralBlurPushConstants
+struct TemporalReprojectionPushConstants
 {
-    glm::vec4  z_buffer_params;
-    glm::ivec2 direction;
-    int32_t    radius;
+    glm::uvec4 g_buffer;
+    glm::uvec4 prev_g_buffer;
+    float      alpha;
     int32_t    g_buffer_mip;
+    uint32_t   input_idx;
+    uint32_t   prev_output_idx;
+    uint32_t   prev_history_length_idx;
+    uint32_t   output_idx;
+    uint32_t   history_length_idx;
 };
 
 // -----------------------------------------------------------------------------------------------------------------------------------
 
 struct UpsamplePushConstants
 {
-    int32_t g_buffer_mip;
-    float   power;
+    glm::uvec4 g_buffer;
+    int32_t    g_buffer_mip;
+    float      power;
+    uint32_t   input_idx;
+    uint32_t   output_idx;
 };
 
 // -----------------------------------------------------------------------------------------------------------------------------------
@@ -54,7 +68,7 @@ struct UpsamplePushConstants
 const RayTracedAO::OutputType RayTracedAO::kOutputTypeEnums[] = {
     RayTracedAO::OUTPUT_RAY_TRACE,
     RayTracedAO::OUTPUT_TEMPORAL_ACCUMULATION,
-    RayTracedAO::OUTPUT_BILATERAL_BLUR,
+    RayTracedAO::OUTPUT_ATROUS,
     RayTracedAO::OUTPUT_UPSAMPLE
 };
 
@@ -63,7 +77,7 @@ const RayTracedAO::OutputType RayTracedAO::kOutputTypeEnums[] = {
 const std::string RayTracedAO::kOutputTypeNames[] = {
     "Ray Trace",
     "Temporal Accumulation",
-    "Bilateral Blur",
+    "A-Trous",
     "Upsample"
 };
 
@@ -72,17 +86,12 @@ const std::string RayTracedAO::kOutputTypeNames[] = {
 RayTracedAO::RayTracedAO(std::weak_ptr<dw::vk::Backend> backend, CommonResources* common_resources, GBuffer* g_buffer, RayTraceScale scale) :
     m_backend(backend), m_common_resources(common_resources), m_g_buffer(g_buffer), m_scale(scale)
 {
-    auto vk_backend = m_backend.lock();
-
-    float scale_divisor = powf(2.0f, float(scale));
-
-    m_width  = vk_backend->swap_chain_extents().width / scale_divisor;
-    m_height = vk_backend->swap_chain_extents().height / scale_divisor;
-
-    m_g_buffer_mip = static_cast<uint32_t>(scale);
+    m_graph = std::unique_ptr<RenderGraph>(new RenderGraph(m_backend, m_common_resources->transient_image_pool.get()));
 
+    update_resolution();
     create_images();
     create_buffers();
+    create_descriptor_set_layouts();
     create_descriptor_sets();
     write_descriptor_sets();
     create_pipeline();
@@ -99,17 +108,11 @@ RayTracedAO::~RayTracedAO()
 void RayTracedAO::render(dw::vk::CommandBuffer::Ptr cmd_buf)
 {
     DW_SCOPED_SAMPLE("Ambient Occlusion", cmd_buf);
+    GPU_SCOPED_TIMER("Ambient Occlusion", cmd_buf, m_common_resources->gpu_timer.get());
 
-    clear_images(cmd_buf);
-    ray_trace(cmd_buf);
-
-    if (m_denoise)
-    {
-        denoise(cmd_buf);
+    setup_render_graph();
 
-        if (m_scale != RAY_TRACE_SCALE_FULL_RES)
-            upsample(cmd_buf);
-    }
+    m_graph->execute(cmd_buf);
 }
 
 // -----------------------------------------------------------------------------------------------------------------------------------
@@ -121,7 +124,51 @@ void RayTracedAO::gui()
     ImGui::SliderFloat("Power", &m_upsample.power, 1.0f, 5.0f);
     ImGui::InputFloat("Bias", &m_ray_trace.bias);
     ImGui::SliderFloat("Temporal Alpha", &m_temporal_accumulation.alpha, 0.0f, 0.5f);
-    ImGui::SliderInt("Blur Radius", &m_bilateral_blur.blur_radius, 1, 10);
+    m_a_trous.denoiser->gui();
+    ImGui::Text("Render Graph: %u passes, %u barriers, %u transients", m_graph->num_passes(), m_graph->num_barriers(), m_graph->num_physical_transients());
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void RayTracedAO::set_scale(RayTraceScale scale)
+{
+    if (scale == m_scale)
+        return;
+
+    retire_resources();
+
+    m_scale = scale;
+
+    update_resolution();
+    create_images();
+    create_buffers();
+    create_descriptor_sets();
+    write_descriptor_sets();
+
+    m_graph->clear_resource_states();
+
+    m_first_frame = true;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void RayTracedAO::set_precision(RenderTargetPrecision precision)
+{
+    if (precision == m_precision)
+        return;
+
+    retire_resources();
+
+    m_precision = precision;
+
+    create_images();
+    create_buffers();
+    create_descriptor_sets();
+    write_descriptor_sets();
+
+    m_graph->clear_resource_states();
+
+    m_first_frame = true;
 }
 
 // -----------------------------------------------------------------------------------------------------------------------------------
@@ -134,12 +181,12 @@ dw::vk::DescriptorSet::Ptr RayTracedAO::output_ds()
             return m_ray_trace.read_ds;
         else if (m_current_output == OUTPUT_TEMPORAL_ACCUMULATION)
             return m_temporal_accumulation.output_read_ds[m_common_resources->ping_pong];
-        else if (m_current_output == OUTPUT_BILATERAL_BLUR)
-            return m_bilateral_blur.read_ds[1];
+        else if (m_current_output == OUTPUT_ATROUS)
+            return m_a_trous.read_ds;
         else
         {
             if (m_scale == RAY_TRACE_SCALE_FULL_RES)
-                return m_bilateral_blur.read_ds[1];
+                return m_a_trous.read_ds;
             else
                 return m_upsample.read_ds;
         }
@@ -150,6 +197,18 @@ dw::vk::DescriptorSet::Ptr RayTracedAO::output_ds()
 
 // -----------------------------------------------------------------------------------------------------------------------------------
 
+void RayTracedAO::update_resolution()
+{
+    float scale_divisor = powf(2.0f, float(m_scale));
+
+    m_width  = m_common_resources->render_width / scale_divisor;
+    m_height = m_common_resources->render_height / scale_divisor;
+
+    m_g_buffer_mip = static_cast<uint32_t>(m_scale);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
 void RayTracedAO::create_images()
 {
     auto backend = m_backend.lock();
@@ -166,7 +225,7 @@ void RayTracedAO::create_images()
     // Temporal Reprojection
     for (int i = 0; i < 2; i++)
     {
-        m_temporal_accumulation.color_image[i] = dw::vk::Image::create(backend, VK_IMAGE_TYPE_2D, m_width, m_height, 1, 1, 1, VK_FORMAT_R16_SFLOAT, VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, VK_SAMPLE_COUNT_1_BIT);
+        m_temporal_accumulation.color_image[i] = dw::vk::Image::create(backend, VK_IMAGE_TYPE_2D, m_width, m_height, 1, 1, 1, VK_FORMAT_R16G16_SFLOAT, VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, VK_SAMPLE_COUNT_1_BIT);
         m_temporal_accumulation.color_image[i]->set_name("AO Denoise Reprojection " + std::to_string(i));
 
         m_temporal_accumulation.color_view[i] = dw::vk::ImageView::create(backend, m_temporal_accumulation.color_image[i], VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT, 0, 1);
@@ -179,26 +238,37 @@ void RayTracedAO::create_images()
         m_temporal_accumulation.history_length_view[i]->set_name("AO Denoise Reprojection History " + std::to_string(i));
     }
 
-    // Bilateral Blur
-    for (int i = 0; i < 2; i++)
+    // A-Trous Filter, the intermediate passes are render graph transients.
     {
-        m_bilateral_blur.image[i] = dw::vk::Image::create(backend, VK_IMAGE_TYPE_2D, m_width, m_height, 1, 1, 1, VK_FORMAT_R16_SFLOAT, VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT, VK_SAMPLE_COUNT_1_BIT);
-        m_bilateral_blur.image[i]->set_name("AO Denoise Blur " + std::to_string(i));
+        m_a_trous.image = dw::vk::Image::create(backend, VK_IMAGE_TYPE_2D, m_width, m_height, 1, 1, 1, VK_FORMAT_R16G16_SFLOAT, VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT, VK_SAMPLE_COUNT_1_BIT);
+        m_a_trous.image->set_name("AO A-Trous Filter");
 
-        m_bilateral_blur.image_view[i] = dw::vk::ImageView::create(backend, m_bilateral_blur.image[i], VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT);
-        m_bilateral_blur.image_view[i]->set_name("AO Denoise Blur " + std::to_string(i));
+        m_a_trous.view = dw::vk::ImageView::create(backend, m_a_trous.image, VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT);
+        m_a_trous.view->set_name("AO A-Trous Filter");
     }
 
-    // Upsample
+    // Upsample, the final AO is in [0, 1] so the low memory tier stores it as R8. The denoiser inputs keep 16 bits for their
+    // variance.
     {
-        auto vk_backend = m_backend.lock();
+        m_upsample.low_memory = m_precision == RENDER_TARGET_PRECISION_LOW_MEMORY && is_storage_image_format_supported(backend, VK_FORMAT_R8_UNORM);
+
+        if (m_precision == RENDER_TARGET_PRECISION_LOW_MEMORY && !m_upsample.low_memory)
+            DW_LOG_INFO("R8 storage images are not supported, AO falls back to full precision.");
 
-        m_upsample.image = dw::vk::Image::create(backend, VK_IMAGE_TYPE_2D, vk_backend->swap_chain_extents().width, vk_backend->swap_chain_extents().height, 1, 1, 1, VK_FORMAT_R16_SFLOAT, VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT, VK_SAMPLE_COUNT_1_BIT);
+        m_upsample.image = dw::vk::Image::create(backend, VK_IMAGE_TYPE_2D, m_common_resources->render_width, m_common_resources->render_height, 1, 1, 1, m_upsample.low_memory ? VK_FORMAT_R8_UNORM : VK_FORMAT_R16_SFLOAT, VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT, VK_SAMPLE_COUNT_1_BIT);
         m_upsample.image->set_name("AO Upsample");
 
         m_upsample.image_view = dw::vk::ImageView::create(backend, m_upsample.image, VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT);
         m_upsample.image_view->set_name("AO Upsample");
     }
+
+    m_common_resources->memory_tracker->track("AO", { m_ray_trace.image,
+                                                      m_temporal_accumulation.color_image[0],
+                                                      m_temporal_accumulation.color_image[1],
+                                                      m_temporal_accumulation.history_length_image[0],
+                                                      m_temporal_accumulation.history_length_image[1],
+                                                      m_a_trous.image,
+                                                      m_upsample.image });
 }
 
 // -----------------------------------------------------------------------------------------------------------------------------------
@@ -208,7 +278,24 @@ void RayTracedAO::create_buffers()
     auto backend = m_backend.lock();
 
     m_temporal_accumulation.denoise_tile_coords_buffer   = dw::vk::Buffer::create(backend, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sizeof(glm::ivec2) * static_cast<uint32_t>(ceil(float(m_width) / float(TEMPORAL_ACCUMULATION_NUM_THREADS_X))) * static_cast<uint32_t>(ceil(float(m_height) / float(TEMPORAL_ACCUMULATION_NUM_THREADS_Y))), VMA_MEMORY_USAGE_GPU_ONLY, 0);
-    m_temporal_accumulation.denoise_dispatch_args_buffer = dw::vk::Buffer::create(backend, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, sizeof(int32_t) * 3, VMA_MEMORY_USAGE_GPU_ONLY, 0);
+    m_temporal_accumulation.denoise_dispatch_args_buffer = dw::vk::Buffer::create(backend, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, sizeof(int32_t) * 3, VMA_MEMORY_USAGE_GPU_ONLY, 0);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void RayTracedAO::create_descriptor_set_layouts()
+{
+    auto backend = m_backend.lock();
+
+    // Indirect Buffer
+    {
+        dw::vk::DescriptorSetLayout::Desc desc;
+
+        desc.add_binding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+        desc.add_binding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+
+        m_temporal_accumulation.indirect_buffer_ds_layout = dw::vk::DescriptorSetLayout::create(backend, desc);
+    }
 }
 
 // -----------------------------------------------------------------------------------------------------------------------------------
@@ -219,9 +306,6 @@ void RayTracedAO::create_descriptor_sets()
 
     // Ray Trace
     {
-        m_ray_trace.write_ds = backend->allocate_descriptor_set(m_common_resources->storage_image_ds_layout);
-        m_ray_trace.write_ds->set_name("AO Ray Trace Write");
-
         m_ray_trace.read_ds = backend->allocate_descriptor_set(m_common_resources->combined_sampler_ds_layout);
         m_ray_trace.read_ds->set_name("AO Ray Trace Read");
 
@@ -230,70 +314,29 @@ void RayTracedAO::create_descriptor_sets()
     }
 
     // Temporal Reprojection
+    for (int i = 0; i < 2; i++)
     {
-        {
-            dw::vk::DescriptorSetLayout::Desc desc;
-
-            desc.add_binding(0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT);
-            desc.add_binding(1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT);
-
-            m_temporal_accumulation.write_ds_layout = dw::vk::DescriptorSetLayout::create(backend, desc);
-            m_temporal_accumulation.write_ds_layout->set_name("AO Reprojection Write DS Layout");
-        }
-
-        {
-            dw::vk::DescriptorSetLayout::Desc desc;
-
-            desc.add_binding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
-            desc.add_binding(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
-
-            m_temporal_accumulation.read_ds_layout = dw::vk::DescriptorSetLayout::create(backend, desc);
-            m_temporal_accumulation.read_ds_layout->set_name("AO Reprojection Read DS Layout");
-        }
-
-        for (int i = 0; i < 2; i++)
-        {
-            m_temporal_accumulation.write_ds[i] = backend->allocate_descriptor_set(m_temporal_accumulation.write_ds_layout);
-            m_temporal_accumulation.write_ds[i]->set_name("AO Reprojection Write " + std::to_string(i));
-
-            m_temporal_accumulation.read_ds[i] = backend->allocate_descriptor_set(m_temporal_accumulation.read_ds_layout);
-            m_temporal_accumulation.read_ds[i]->set_name("AO Reprojection Read " + std::to_string(i));
-
-            m_temporal_accumulation.output_read_ds[i] = backend->allocate_descriptor_set(m_common_resources->combined_sampler_ds_layout);
-            m_temporal_accumulation.output_read_ds[i]->set_name("AO Reprojection Output Read " + std::to_string(i));
-        }
+        m_temporal_accumulation.output_read_ds[i] = backend->allocate_descriptor_set(m_common_resources->combined_sampler_ds_layout);
+        m_temporal_accumulation.output_read_ds[i]->set_name("AO Reprojection Output Read " + std::to_string(i));
     }
 
     // Indirect Buffer
     {
-        dw::vk::DescriptorSetLayout::Desc desc;
-
-        desc.add_binding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
-        desc.add_binding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
-
-        m_temporal_accumulation.indirect_buffer_ds_layout = dw::vk::DescriptorSetLayout::create(backend, desc);
-
         m_temporal_accumulation.indirect_buffer_ds = backend->allocate_descriptor_set(m_temporal_accumulation.indirect_buffer_ds_layout);
         m_temporal_accumulation.indirect_buffer_ds->set_name("Temporal Accumulation Indirect Buffer");
     }
 
-    // Bilateral Blur
+    // A-Trous Filter
     {
-        for (int i = 0; i < 2; i++)
-        {
-            m_bilateral_blur.write_ds[i] = backend->allocate_descriptor_set(m_common_resources->storage_image_ds_layout);
-            m_bilateral_blur.write_ds[i]->set_name("AO Blur Write " + std::to_string(i));
+        m_a_trous.write_ds = backend->allocate_descriptor_set(m_common_resources->storage_image_ds_layout);
+        m_a_trous.write_ds->set_name("AO A-Trous Write");
 
-            m_bilateral_blur.read_ds[i] = backend->allocate_descriptor_set(m_common_resources->combined_sampler_ds_layout);
-            m_bilateral_blur.read_ds[i]->set_name("AO Blur Read " + std::to_string(i));
-        }
+        m_a_trous.read_ds = backend->allocate_descriptor_set(m_common_resources->combined_sampler_ds_layout);
+        m_a_trous.read_ds->set_name("AO A-Trous Read");
     }
 
     // Upsample
     {
-        m_upsample.write_ds = backend->allocate_descriptor_set(m_common_resources->storage_image_ds_layout);
-        m_upsample.write_ds->set_name("AO Upsample Write");
-
         m_upsample.read_ds = backend->allocate_descriptor_set(m_common_resources->combined_sampler_ds_layout);
         m_upsample.read_ds->set_name("AO Upsample Read");
     }
@@ -306,36 +349,6 @@ void RayTracedAO::write_descriptor_sets()
     auto backend = m_backend.lock();
 
     // Ray Trace
-    {
-        std::vector<VkDescriptorImageInfo> image_infos;
-        std::vector<VkWriteDescriptorSet>  write_datas;
-        VkWriteDescriptorSet               write_data;
-
-        image_infos.reserve(1);
-        write_datas.reserve(1);
-
-        VkDescriptorImageInfo storage_image_info;
-
-        storage_image_info.sampler     = VK_NULL_HANDLE;
-        storage_image_info.imageView   = m_ray_trace.view->handle();
-        storage_image_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
-
-        image_infos.push_back(storage_image_info);
-
-        DW_ZERO_MEMORY(write_data);
-
-        write_data.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        write_data.descriptorCount = 1;
-        write_data.descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
-        write_data.pImageInfo      = &image_infos.back();
-        write_data.dstBinding      = 0;
-        write_data.dstSet          = m_ray_trace.write_ds->handle();
-
-        write_datas.push_back(write_data);
-
-        vkUpdateDescriptorSets(backend->device(), write_datas.size(), write_datas.data(), 0, nullptr);
-    }
-
     {
         std::vector<VkDescriptorImageInfo> image_infos;
         std::vector<VkWriteDescriptorSet>  write_datas;
@@ -399,118 +412,6 @@ void RayTracedAO::write_descriptor_sets()
     }
 
     // Temporal Reprojection
-    {
-        std::vector<VkDescriptorImageInfo> image_infos;
-        std::vector<VkWriteDescriptorSet>  write_datas;
-        VkWriteDescriptorSet               write_data;
-
-        image_infos.reserve(4);
-        write_datas.reserve(4);
-
-        for (int i = 0; i < 2; i++)
-        {
-            {
-                VkDescriptorImageInfo storage_image_info;
-
-                storage_image_info.sampler     = VK_NULL_HANDLE;
-                storage_image_info.imageView   = m_temporal_accumulation.color_view[i]->handle();
-                storage_image_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
-
-                image_infos.push_back(storage_image_info);
-
-                DW_ZERO_MEMORY(write_data);
-
-                write_data.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-                write_data.descriptorCount = 1;
-                write_data.descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
-                write_data.pImageInfo      = &image_infos.back();
-                write_data.dstBinding      = 0;
-                write_data.dstSet          = m_temporal_accumulation.write_ds[i]->handle();
-
-                write_datas.push_back(write_data);
-            }
-
-            {
-                VkDescriptorImageInfo storage_image_info;
-
-                storage_image_info.sampler     = VK_NULL_HANDLE;
-                storage_image_info.imageView   = m_temporal_accumulation.history_length_view[i]->handle();
-                storage_image_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
-
-                image_infos.push_back(storage_image_info);
-
-                DW_ZERO_MEMORY(write_data);
-
-                write_data.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-                write_data.descriptorCount = 1;
-                write_data.descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
-                write_data.pImageInfo      = &image_infos.back();
-                write_data.dstBinding      = 1;
-                write_data.dstSet          = m_temporal_accumulation.write_ds[i]->handle();
-
-                write_datas.push_back(write_data);
-            }
-        }
-
-        vkUpdateDescriptorSets(backend->device(), write_datas.size(), write_datas.data(), 0, nullptr);
-    }
-
-    {
-        std::vector<VkDescriptorImageInfo> image_infos;
-        std::vector<VkWriteDescriptorSet>  write_datas;
-        VkWriteDescriptorSet               write_data;
-
-        image_infos.reserve(4);
-        write_datas.reserve(4);
-
-        for (int i = 0; i < 2; i++)
-        {
-            {
-                VkDescriptorImageInfo sampler_image_info;
-
-                sampler_image_info.sampler     = backend->nearest_sampler()->handle();
-                sampler_image_info.imageView   = m_temporal_accumulation.color_view[i]->handle();
-                sampler_image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-
-                image_infos.push_back(sampler_image_info);
-
-                DW_ZERO_MEMORY(write_data);
-
-                write_data.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-                write_data.descriptorCount = 1;
-                write_data.descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-                write_data.pImageInfo      = &image_infos.back();
-                write_data.dstBinding      = 0;
-                write_data.dstSet          = m_temporal_accumulation.read_ds[i]->handle();
-
-                write_datas.push_back(write_data);
-            }
-
-            {
-                VkDescriptorImageInfo sampler_image_info;
-
-                sampler_image_info.sampler     = backend->nearest_sampler()->handle();
-                sampler_image_info.imageView   = m_temporal_accumulation.history_length_view[i]->handle();
-                sampler_image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-
-                image_infos.push_back(sampler_image_info);
-
-                DW_ZERO_MEMORY(write_data);
-
-                write_data.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-                write_data.descriptorCount = 1;
-                write_data.descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-                write_data.pImageInfo      = &image_infos.back();
-                write_data.dstBinding      = 1;
-                write_data.dstSet          = m_temporal_accumulation.read_ds[i]->handle();
-
-                write_datas.push_back(write_data);
-            }
-        }
-
-        vkUpdateDescriptorSets(backend->device(), write_datas.size(), write_datas.data(), 0, nullptr);
-    }
-
     {
         std::vector<VkDescriptorImageInfo> image_infos;
         std::vector<VkWriteDescriptorSet>  write_datas;
@@ -600,65 +501,37 @@ void RayTracedAO::write_descriptor_sets()
         vkUpdateDescriptorSets(backend->device(), write_datas.size(), write_datas.data(), 0, nullptr);
     }
 
-    // Bilateral Blur
+    // A-Trous Filter
     {
-        for (int i = 0; i < 2; i++)
+        // write
         {
-            // write
-            {
-                VkDescriptorImageInfo storage_image_info;
-
-                storage_image_info.sampler     = VK_NULL_HANDLE;
-                storage_image_info.imageView   = m_bilateral_blur.image_view[i]->handle();
-                storage_image_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
-
-                VkWriteDescriptorSet write_data;
-
-                DW_ZERO_MEMORY(write_data);
-
-                write_data.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-                write_data.descriptorCount = 1;
-                write_data.descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
-                write_data.pImageInfo      = &storage_image_info;
-                write_data.dstBinding      = 0;
-                write_data.dstSet          = m_bilateral_blur.write_ds[i]->handle();
-
-                vkUpdateDescriptorSets(backend->device(), 1, &write_data, 0, nullptr);
-            }
-
-            // read
-            {
-                VkDescriptorImageInfo sampler_image_info;
+            VkDescriptorImageInfo storage_image_info;
 
-                sampler_image_info.sampler     = backend->nearest_sampler()->handle();
-                sampler_image_info.imageView   = m_bilateral_blur.image_view[i]->handle();
-                sampler_image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+            storage_image_info.sampler     = VK_NULL_HANDLE;
+            storage_image_info.imageView   = m_a_trous.view->handle();
+            storage_image_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
 
-                VkWriteDescriptorSet write_data;
+            VkWriteDescriptorSet write_data;
 
-                DW_ZERO_MEMORY(write_data);
+            DW_ZERO_MEMORY(write_data);
 
-                write_data.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-                write_data.descriptorCount = 1;
-                write_data.descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-                write_data.pImageInfo      = &sampler_image_info;
-                write_data.dstBinding      = 0;
-                write_data.dstSet          = m_bilateral_blur.read_ds[i]->handle();
+            write_data.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            write_data.descriptorCount = 1;
+            write_data.descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+            write_data.pImageInfo      = &storage_image_info;
+            write_data.dstBinding      = 0;
+            write_data.dstSet          = m_a_trous.write_ds->handle();
 
-                vkUpdateDescriptorSets(backend->device(), 1, &write_data, 0, nullptr);
-            }
+            vkUpdateDescriptorSets(backend->device(), 1, &write_data, 0, nullptr);
         }
-    }
 
-    // Upsample
-    {
-        // write
+        // read
         {
-            VkDescriptorImageInfo storage_image_info;
+            VkDescriptorImageInfo sampler_image_info;
 
-            storage_image_info.sampler     = VK_NULL_HANDLE;
-            storage_image_info.imageView   = m_upsample.image_view->handle();
-            storage_image_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+            sampler_image_info.sampler     = backend->nearest_sampler()->handle();
+            sampler_image_info.imageView   = m_a_trous.view->handle();
+            sampler_image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
             VkWriteDescriptorSet write_data;
 
@@ -666,14 +539,17 @@ void RayTracedAO::write_descriptor_sets()
 
             write_data.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
             write_data.descriptorCount = 1;
-            write_data.descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
-            write_data.pImageInfo      = &storage_image_info;
+            write_data.descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            write_data.pImageInfo      = &sampler_image_info;
             write_data.dstBinding      = 0;
-            write_data.dstSet          = m_upsample.write_ds->handle();
+            write_data.dstSet          = m_a_trous.read_ds->handle();
 
             vkUpdateDescriptorSets(backend->device(), 1, &write_data, 0, nullptr);
         }
+    }
 
+    // Upsample
+    {
         // read
         {
             VkDescriptorImageInfo sampler_image_info;
@@ -696,6 +572,25 @@ void RayTracedAO::write_descriptor_sets()
             vkUpdateDescriptorSets(backend->device(), 1, &write_data, 0, nullptr);
         }
     }
+
+    // Bindless, for the passes that index their images instead of binding sets.
+    {
+        BindlessHeap* bindless_heap = m_common_resources->bindless_heap.get();
+
+        m_ray_trace.write_idx = bindless_heap->register_storage_image(m_ray_trace.view);
+        m_ray_trace.read_idx  = bindless_heap->register_sampled_image(m_ray_trace.view, backend->nearest_sampler());
+
+        for (int i = 0; i < 2; i++)
+        {
+            m_temporal_accumulation.color_write_idx[i]          = bindless_heap->register_storage_image(m_temporal_accumulation.color_view[i]);
+            m_temporal_accumulation.color_read_idx[i]           = bindless_heap->register_sampled_image(m_temporal_accumulation.color_view[i], backend->nearest_sampler());
+            m_temporal_accumulation.history_length_write_idx[i] = bindless_heap->register_storage_image(m_temporal_accumulation.history_length_view[i]);
+            m_temporal_accumulation.history_length_read_idx[i]  = bindless_heap->register_sampled_image(m_temporal_accumulation.history_length_view[i], backend->nearest_sampler());
+        }
+
+        m_a_trous.read_idx   = bindless_heap->register_sampled_image(m_a_trous.view, backend->nearest_sampler());
+        m_upsample.write_idx = bindless_heap->register_storage_image(m_upsample.image_view);
+    }
 }
 
 // -----------------------------------------------------------------------------------------------------------------------------------
@@ -704,29 +599,23 @@ void RayTracedAO::create_pipeline()
 {
     auto backend = m_backend.lock();
 
+    std::vector<PipelineCache::ComputePipelineDesc> compute_pipelines;
+
     // Ray Trace
     {
-        dw::vk::ShaderModule::Ptr shader_module = dw::vk::ShaderModule::create_from_file(backend, "shaders/ao_ray_trace.comp.spv");
-
         dw::vk::PipelineLayout::Desc pl_desc;
 
         pl_desc.add_descriptor_set_layout(m_common_resources->current_scene()->descriptor_set_layout());
-        pl_desc.add_descriptor_set_layout(m_common_resources->storage_image_ds_layout);
+        pl_desc.add_descriptor_set_layout(m_common_resources->bindless_heap->ds_layout());
         pl_desc.add_descriptor_set_layout(m_common_resources->per_frame_ds_layout);
-        pl_desc.add_descriptor_set_layout(m_g_buffer->ds_layout());
-        pl_desc.add_descriptor_set_layout(m_common_resources->blue_noise_ds_layout);
+        pl_desc.add_descriptor_set_layout(m_common_resources->gpu_counters->ds_layout());
 
         pl_desc.add_push_constant_range(VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(RayTracePushConstants));
 
         m_ray_trace.pipeline_layout = dw::vk::PipelineLayout::create(backend, pl_desc);
         m_ray_trace.pipeline_layout->set_name("AO Ray Trace Pipeline Layout");
 
-        dw::vk::ComputePipeline::Desc desc;
-
-        desc.set_shader_stage(shader_module, "main");
-        desc.set_pipeline_layout(m_ray_trace.pipeline_layout);
-
-        m_ray_trace.pipeline = dw::vk::ComputePipeline::create(backend, desc);
+        compute_pipelines.push_back({ "shaders/ao_ray_trace.comp.spv", m_ray_trace.pipeline_layout, &m_ray_trace.pipeline });
     }
 
     // Reset Args
@@ -738,26 +627,14 @@ void RayTracedAO::create_pipeline()
         m_reset_args.pipeline_layout = dw::vk::PipelineLayout::create(backend, desc);
         m_reset_args.pipeline_layout->set_name("Reset Args Pipeline Layout");
 
-        dw::vk::ShaderModule::Ptr module = dw::vk::ShaderModule::create_from_file(backend, "shaders/ao_denoise_reset_args.comp.spv");
-
-        dw::vk::ComputePipeline::Desc comp_desc;
-
-        comp_desc.set_pipeline_layout(m_reset_args.pipeline_layout);
-        comp_desc.set_shader_stage(module, "main");
-
-        m_reset_args.pipeline = dw::vk::ComputePipeline::create(backend, comp_desc);
+        compute_pipelines.push_back({ "shaders/ao_denoise_reset_args.comp.spv", m_reset_args.pipeline_layout, &m_reset_args.pipeline });
     }
 
     // Temporal Reprojection
     {
         dw::vk::PipelineLayout::Desc desc;
 
-        desc.add_descriptor_set_layout(m_temporal_accumulation.write_ds_layout);
-        desc.add_descriptor_set_layout(m_g_buffer->ds_layout());
-        desc.add_descriptor_set_layout(m_g_buffer->ds_layout());
-        desc.add_descriptor_set_layout(m_common_resources->combined_sampler_ds_layout);
-        desc.add_descriptor_set_layout(m_common_resources->combined_sampler_ds_layout);
-        desc.add_descriptor_set_layout(m_temporal_accumulation.read_ds_layout);
+        desc.add_descriptor_set_layout(m_common_resources->bindless_heap->ds_layout());
         desc.add_descriptor_set_layout(m_common_resources->per_frame_ds_layout);
         desc.add_descriptor_set_layout(m_temporal_accumulation.indirect_buffer_ds_layout);
 
@@ -766,113 +643,178 @@ void RayTracedAO::create_pipeline()
         m_temporal_accumulation.pipeline_layout = dw::vk::PipelineLayout::create(backend, desc);
         m_temporal_accumulation.pipeline_layout->set_name("AO Reprojection Pipeline Layout");
 
-        dw::vk::ShaderModule::Ptr module = dw::vk::ShaderModule::create_from_file(backend, "shaders/ao_denoise_reprojection.comp.spv");
+        compute_pipelines.push_back({ "shaders/ao_denoise_reprojection.comp.spv", m_temporal_accumulation.pipeline_layout, &m_temporal_accumulation.pipeline });
+    }
+
+    // A-Trous Filter
+    m_a_trous.denoiser = std::unique_ptr<SVGFDenoiser>(new SVGFDenoiser(m_backend, m_common_resources, m_g_buffer, SVGFDenoiser::SIGNAL_TYPE_AO, m_temporal_accumulation.indirect_buffer_ds_layout));
 
-        dw::vk::ComputePipeline::Desc comp_desc;
+    // Upsample
+    {
+        dw::vk::PipelineLayout::Desc desc;
 
-        comp_desc.set_pipeline_layout(m_temporal_accumulation.pipeline_layout);
-        comp_desc.set_shader_stage(module, "main");
+        desc.add_descriptor_set_layout(m_common_resources->bindless_heap->ds_layout());
 
-        m_temporal_accumulation.pipeline = dw::vk::ComputePipeline::create(backend, comp_desc);
+        desc.add_push_constant_range(VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(UpsamplePushConstants));
+
+        m_upsample.layout = dw::vk::PipelineLayout::create(backend, desc);
+        m_upsample.layout->set_name("AO Upsample Pipeline Layout");
+
+        m_upsample.permutations = std::unique_ptr<ComputePipelinePermutations>(new ComputePipelinePermutations(AO_UPSAMPLE_CONSTANT_COUNT, [this](const VkSpecializationInfo* specialization_info) {
+            CachedComputePipeline::Ptr pipeline;
+
+            m_common_resources->pipeline_cache->create_compute_pipelines({ { "shaders/ao_upsample.comp.spv", m_upsample.layout, &pipeline, specialization_info } });
+
+            return pipeline;
+        }));
     }
 
-    // Bilateral Blur
+    m_common_resources->pipeline_cache->create_compute_pipelines(compute_pipelines);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void RayTracedAO::retire_resources()
+{
+    DeletionQueue* deletion_queue = m_common_resources->deletion_queue.get();
+    BindlessHeap*  bindless_heap  = m_common_resources->bindless_heap.get();
+
+    deletion_queue->push({ m_ray_trace.image, m_ray_trace.view, m_ray_trace.read_ds, m_ray_trace.bilinear_read_ds });
+
+    bindless_heap->release_storage_image(m_ray_trace.write_idx);
+    bindless_heap->release_sampled_image(m_ray_trace.read_idx);
+
+    deletion_queue->push({ m_temporal_accumulation.denoise_tile_coords_buffer,
+                           m_temporal_accumulation.denoise_dispatch_args_buffer,
+                           m_temporal_accumulation.indirect_buffer_ds });
+
+    for (int i = 0; i < 2; i++)
     {
-        dw::vk::PipelineLayout::Desc desc;
+        deletion_queue->push({ m_temporal_accumulation.color_image[i],
+                               m_temporal_accumulation.color_view[i],
+                               m_temporal_accumulation.history_length_image[i],
+                               m_temporal_accumulation.history_length_view[i],
+                               m_temporal_accumulation.output_read_ds[i] });
+
+        bindless_heap->release_storage_image(m_temporal_accumulation.color_write_idx[i]);
+        bindless_heap->release_sampled_image(m_temporal_accumulation.color_read_idx[i]);
+        bindless_heap->release_storage_image(m_temporal_accumulation.history_length_write_idx[i]);
+        bindless_heap->release_sampled_image(m_temporal_accumulation.history_length_read_idx[i]);
+    }
 
-        desc.add_descriptor_set_layout(m_common_resources->storage_image_ds_layout);
-        desc.add_descriptor_set_layout(m_common_resources->combined_sampler_ds_layout);
-        desc.add_descriptor_set_layout(m_temporal_accumulation.read_ds_layout);
-        desc.add_descriptor_set_layout(m_g_buffer->ds_layout());
-        desc.add_descriptor_set_layout(m_temporal_accumulation.indirect_buffer_ds_layout);
+    deletion_queue->push({ m_a_trous.image, m_a_trous.view, m_a_trous.read_ds, m_a_trous.write_ds });
+    deletion_queue->push({ m_upsample.image, m_upsample.image_view, m_upsample.read_ds });
 
-        desc.add_push_constant_range(VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(BilateralBlurPushConstants));
+    bindless_heap->release_sampled_image(m_a_trous.read_idx);
+    bindless_heap->release_storage_image(m_upsample.write_idx);
+}
 
-        m_bilateral_blur.layout = dw::vk::PipelineLayout::create(backend, desc);
-        m_bilateral_blur.layout->set_name("AO Blur Pipeline Layout");
+// -----------------------------------------------------------------------------------------------------------------------------------
 
-        dw::vk::ShaderModule::Ptr module = dw::vk::ShaderModule::create_from_file(backend, "shaders/ao_denoise_bilateral_blur.comp.spv");
+void RayTracedAO::setup_render_graph()
+{
+    const bool ping_pong = m_common_resources->ping_pong;
 
-        dw::vk::ComputePipeline::Desc comp_desc;
+    m_graph->begin(m_queue_type);
 
-        comp_desc.set_pipeline_layout(m_bilateral_blur.layout);
-        comp_desc.set_shader_stage(module, "main");
+    m_graph_resources.ray_trace = m_graph->import_image(m_ray_trace.image);
 
-        m_bilateral_blur.pipeline = dw::vk::ComputePipeline::create(backend, comp_desc);
+    for (int i = 0; i < 2; i++)
+    {
+        m_graph_resources.color[i]          = m_graph->import_image(m_temporal_accumulation.color_image[i]);
+        m_graph_resources.history_length[i] = m_graph->import_image(m_temporal_accumulation.history_length_image[i]);
     }
 
-    // Upsample
+    m_graph_resources.a_trous_output = m_graph->import_image(m_a_trous.image);
+    m_graph_resources.upsample       = m_graph->import_image(m_upsample.image);
+    m_graph_resources.tile_coords    = m_graph->import_buffer(m_temporal_accumulation.denoise_tile_coords_buffer);
+    m_graph_resources.dispatch_args  = m_graph->import_buffer(m_temporal_accumulation.denoise_dispatch_args_buffer);
+
+    if (m_first_frame)
     {
-        dw::vk::PipelineLayout::Desc desc;
+        m_graph->add_pass("Clear History", nullptr)
+            .clear(m_graph_resources.color[!ping_pong], glm::vec4(0.0f), RESOURCE_USAGE_SAMPLED)
+            .clear(m_graph_resources.history_length[!ping_pong], glm::vec4(0.0f), RESOURCE_USAGE_SAMPLED);
 
-        desc.add_descriptor_set_layout(m_common_resources->storage_image_ds_layout);
-        desc.add_descriptor_set_layout(m_common_resources->combined_sampler_ds_layout);
-        desc.add_descriptor_set_layout(m_g_buffer->ds_layout());
+        m_first_frame = false;
+    }
 
-        desc.add_push_constant_range(VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(UpsamplePushConstants));
+    m_graph->add_pass("Ray Trace", [this](dw::vk::CommandBuffer::Ptr cmd_buf) { ray_trace(cmd_buf); })
+        .write(m_graph_resources.ray_trace);
 
-        m_upsample.layout = dw::vk::PipelineLayout::create(backend, desc);
-        m_upsample.layout->set_name("AO Upsample Pipeline Layout");
+    if (m_denoise)
+    {
+        m_graph->add_pass("Reset Args", [this](dw::vk::CommandBuffer::Ptr cmd_buf) { reset_args(cmd_buf); })
+            .write_buffer(m_graph_resources.tile_coords)
+            .write_buffer(m_graph_resources.dispatch_args);
+
+        m_graph->add_pass("Temporal Accumulation", [this](dw::vk::CommandBuffer::Ptr cmd_buf) { temporal_accumulation(cmd_buf); })
+            .read(m_graph_resources.ray_trace)
+            .read(m_graph_resources.color[!ping_pong])
+            .read(m_graph_resources.history_length[!ping_pong])
+            .write(m_graph_resources.color[ping_pong])
+            .write(m_graph_resources.history_length[ping_pong])
+            .write_buffer(m_graph_resources.tile_coords)
+            .write_buffer(m_graph_resources.dispatch_args, RESOURCE_USAGE_STORAGE_READ_WRITE);
+
+        // Only the tiles with occlusion are filtered, every other texel is cleared to no occlusion and no variance. Passes
+        // alternate between the output image and transients so that the last one lands in the output.
+        RenderGraph::ImageHandle input      = m_graph_resources.color[ping_pong];
+        const uint32_t           num_passes = m_a_trous.denoiser->num_passes();
+
+        for (uint32_t i = 0; i < num_passes; i++)
+        {
+            RenderGraph::ImageHandle output = m_graph_resources.a_trous_output;
+
+            if ((num_passes - 1 - i) % 2 == 1)
+                output = m_graph->create_image({ "AO A-Trous Filter", VK_FORMAT_R16G16_SFLOAT, m_width, m_height, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT });
 
-        dw::vk::ShaderModule::Ptr module = dw::vk::ShaderModule::create_from_file(backend, "shaders/ao_upsample.comp.spv");
+            m_graph->add_pass("A-Trous Filter " + std::to_string(i), [this, i, input, output](dw::vk::CommandBuffer::Ptr cmd_buf) { a_trous_filter(cmd_buf, i, input, output); })
+                .read(input)
+                .read_buffer(m_graph_resources.tile_coords)
+                .read_buffer(m_graph_resources.dispatch_args, RESOURCE_USAGE_INDIRECT_ARGUMENTS)
+                .clear(output, glm::vec4(1.0f, 0.0f, 0.0f, 0.0f));
 
-        dw::vk::ComputePipeline::Desc comp_desc;
+            input = output;
+        }
 
-        comp_desc.set_pipeline_layout(m_upsample.layout);
-        comp_desc.set_shader_stage(module, "main");
+        if (m_scale != RAY_TRACE_SCALE_FULL_RES)
+        {
+            m_graph->add_pass("Upsample", [this](dw::vk::CommandBuffer::Ptr cmd_buf) { upsample(cmd_buf); })
+                .read(m_graph_resources.a_trous_output)
+                .write(m_graph_resources.upsample);
+        }
 
-        m_upsample.pipeline = dw::vk::ComputePipeline::create(backend, comp_desc);
+        m_graph->add_pass("Counters", [this](dw::vk::CommandBuffer::Ptr cmd_buf) { copy_counters(cmd_buf); })
+            .read_buffer(m_graph_resources.dispatch_args, RESOURCE_USAGE_TRANSFER_SRC);
     }
+
+    // On the async compute queue the hand-off to the fragment stage happens through a semaphore.
+    m_graph->export_image(output_image(), m_queue_type == QUEUE_TYPE_GRAPHICS ? VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT : VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
 }
 
 // -----------------------------------------------------------------------------------------------------------------------------------
 
-void RayTracedAO::clear_images(dw::vk::CommandBuffer::Ptr cmd_buf)
+RenderGraph::ImageHandle RayTracedAO::output_image()
 {
-    if (m_first_frame)
+    if (m_denoise)
     {
-        VkImageSubresourceRange subresource_range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
-
-        VkClearColorValue color;
-
-        color.float32[0] = 0.0f;
-        color.float32[1] = 0.0f;
-        color.float32[2] = 0.0f;
-        color.float32[3] = 0.0f;
-
-        dw::vk::utilities::set_image_layout(
-            cmd_buf->handle(),
-            m_temporal_accumulation.history_length_image[!m_common_resources->ping_pong]->handle(),
-            VK_IMAGE_LAYOUT_UNDEFINED,
-            VK_IMAGE_LAYOUT_GENERAL,
-            subresource_range);
-
-        dw::vk::utilities::set_image_layout(
-            cmd_buf->handle(),
-            m_temporal_accumulation.color_image[!m_common_resources->ping_pong]->handle(),
-            VK_IMAGE_LAYOUT_UNDEFINED,
-            VK_IMAGE_LAYOUT_GENERAL,
-            subresource_range);
-
-        vkCmdClearColorImage(cmd_buf->handle(), m_temporal_accumulation.history_length_image[!m_common_resources->ping_pong]->handle(), VK_IMAGE_LAYOUT_GENERAL, &color, 1, &subresource_range);
-        vkCmdClearColorImage(cmd_buf->handle(), m_temporal_accumulation.color_image[!m_common_resources->ping_pong]->handle(), VK_IMAGE_LAYOUT_GENERAL, &color, 1, &subresource_range);
-
-        dw::vk::utilities::set_image_layout(
-            cmd_buf->handle(),
-            m_temporal_accumulation.history_length_image[!m_common_resources->ping_pong]->handle(),
-            VK_IMAGE_LAYOUT_GENERAL,
-            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-            subresource_range);
-
-        dw::vk::utilities::set_image_layout(
-            cmd_buf->handle(),
-            m_temporal_accumulation.color_image[!m_common_resources->ping_pong]->handle(),
-            VK_IMAGE_LAYOUT_GENERAL,
-            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-            subresource_range);
-
-        m_first_frame = false;
+        if (m_current_output == OUTPUT_RAY_TRACE)
+            return m_graph_resources.ray_trace;
+        else if (m_current_output == OUTPUT_TEMPORAL_ACCUMULATION)
+            return m_graph_resources.color[m_common_resources->ping_pong];
+        else if (m_current_output == OUTPUT_ATROUS)
+            return m_graph_resources.a_trous_output;
+        else
+        {
+            if (m_scale == RAY_TRACE_SCALE_FULL_RES)
+                return m_graph_resources.a_trous_output;
+            else
+                return m_graph_resources.upsample;
+        }
     }
+    else
+        return m_graph_resources.ray_trace;
 }
 
 // -----------------------------------------------------------------------------------------------------------------------------------
@@ -880,29 +822,22 @@ void RayTracedAO::clear_images(dw::vk::CommandBuffer::Ptr cmd_buf)
 void RayTracedAO::ray_trace(dw::vk::CommandBuffer::Ptr cmd_buf)
 {
     DW_SCOPED_SAMPLE("Ray Trace", cmd_buf);
+    GPU_SCOPED_TIMER("AO Ray Trace", cmd_buf, m_common_resources->gpu_timer.get());
 
     auto backend = m_backend.lock();
 
-    VkImageSubresourceRange subresource_range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
-
-    std::vector<VkMemoryBarrier> memory_barriers = {
-        memory_barrier(VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT)
-    };
-
-    std::vector<VkImageMemoryBarrier> image_barriers = {
-        image_memory_barrier(m_ray_trace.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, subresource_range, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT)
-    };
-
-    pipeline_barrier(cmd_buf, memory_barriers, image_barriers, {}, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
-
     vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_ray_trace.pipeline->handle());
 
     RayTracePushConstants push_constants;
 
-    push_constants.num_frames   = m_common_resources->num_frames;
-    push_constants.ray_length   = m_ray_trace.ray_length;
-    push_constants.bias         = m_ray_trace.bias;
-    push_constants.g_buffer_mip = m_g_buffer_mip;
+    push_constants.g_buffer               = m_g_buffer->output_bindless_indices();
+    push_constants.num_frames             = m_common_resources->num_frames;
+    push_constants.ray_length             = m_ray_trace.ray_length;
+    push_constants.bias                   = m_ray_trace.bias;
+    push_constants.g_buffer_mip           = m_g_buffer_mip;
+    push_constants.sobol_idx              = m_common_resources->blue_noise_sobol_idx;
+    push_constants.scrambling_ranking_idx = m_common_resources->blue_noise_scrambling_ranking_idx[BLUE_NOISE_1SPP];
+    push_constants.output_idx             = m_ray_trace.write_idx;
 
     vkCmdPushConstants(cmd_buf->handle(), m_ray_trace.pipeline_layout->handle(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_constants), &push_constants);
 
@@ -910,33 +845,14 @@ void RayTracedAO::ray_trace(dw::vk::CommandBuffer::Ptr cmd_buf)
 
     VkDescriptorSet descriptor_sets[] = {
         m_common_resources->current_scene()->descriptor_set()->handle(),
-        m_ray_trace.write_ds->handle(),
+        m_common_resources->bindless_heap->ds(),
         m_common_resources->per_frame_ds->handle(),
-        m_g_buffer->output_ds()->handle(),
-        m_common_resources->blue_noise_ds[BLUE_NOISE_1SPP]->handle()
+        m_common_resources->gpu_counters->current_ds()->handle()
     };
 
-    vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_ray_trace.pipeline_layout->handle(), 0, 5, descriptor_sets, 1, &dynamic_offset);
+    vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_ray_trace.pipeline_layout->handle(), 0, 4, descriptor_sets, 1, &dynamic_offset);
 
     vkCmdDispatch(cmd_buf->handle(), static_cast<uint32_t>(ceil(float(m_width) / float(RAY_TRACE_NUM_THREADS_X))), static_cast<uint32_t>(ceil(float(m_height) / float(RAY_TRACE_NUM_THREADS_Y))), 1);
-
-    dw::vk::utilities::set_image_layout(
-        cmd_buf->handle(),
-        m_ray_trace.image->handle(),
-        VK_IMAGE_LAYOUT_GENERAL,
-        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-        subresource_range);
-}
-
-// -----------------------------------------------------------------------------------------------------------------------------------
-
-void RayTracedAO::denoise(dw::vk::CommandBuffer::Ptr cmd_buf)
-{
-    DW_SCOPED_SAMPLE("Denoise", cmd_buf);
-
-    reset_args(cmd_buf);
-    temporal_accumulation(cmd_buf);
-    bilateral_blur(cmd_buf);
 }
 
 // -----------------------------------------------------------------------------------------------------------------------------------
@@ -945,43 +861,28 @@ void RayTracedAO::upsample(dw::vk::CommandBuffer::Ptr cmd_buf)
 {
     DW_SCOPED_SAMPLE("Upsample", cmd_buf);
 
-    VkImageSubresourceRange subresource_range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+    const PermutationKey key = permutation_bit(AO_UPSAMPLE_CONSTANT_LOW_MEMORY, m_upsample.low_memory);
 
-    dw::vk::utilities::set_image_layout(
-        cmd_buf->handle(),
-        m_upsample.image->handle(),
-        VK_IMAGE_LAYOUT_UNDEFINED,
-        VK_IMAGE_LAYOUT_GENERAL,
-        subresource_range);
-
-    vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_upsample.pipeline->handle());
+    vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_upsample.permutations->get(key)->handle());
 
     UpsamplePushConstants push_constants;
 
+    push_constants.g_buffer     = m_g_buffer->output_bindless_indices();
     push_constants.g_buffer_mip = m_g_buffer_mip;
     push_constants.power        = m_upsample.power;
+    push_constants.input_idx    = m_a_trous.read_idx;
+    push_constants.output_idx   = m_upsample.write_idx;
 
     vkCmdPushConstants(cmd_buf->handle(), m_upsample.layout->handle(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_constants), &push_constants);
 
-    VkDescriptorSet descriptor_sets[] = {
-        m_upsample.write_ds->handle(),
-        m_bilateral_blur.read_ds[1]->handle(),
-        m_g_buffer->output_ds()->handle()
-    };
+    VkDescriptorSet ds = m_common_resources->bindless_heap->ds();
 
-    vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_upsample.layout->handle(), 0, 3, descriptor_sets, 0, nullptr);
+    vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_upsample.layout->handle(), 0, 1, &ds, 0, nullptr);
 
     const int NUM_THREADS_X = 8;
     const int NUM_THREADS_Y = 8;
 
     vkCmdDispatch(cmd_buf->handle(), static_cast<uint32_t>(ceil(float(m_upsample.image->width()) / float(NUM_THREADS_X))), static_cast<uint32_t>(ceil(float(m_upsample.image->height()) / float(NUM_THREADS_Y))), 1);
-
-    dw::vk::utilities::set_image_layout(
-        cmd_buf->handle(),
-        m_upsample.image->handle(),
-        VK_IMAGE_LAYOUT_GENERAL,
-        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-        subresource_range);
 }
 
 // -----------------------------------------------------------------------------------------------------------------------------------
@@ -990,15 +891,6 @@ void RayTracedAO::reset_args(dw::vk::CommandBuffer::Ptr cmd_buf)
 {
     DW_SCOPED_SAMPLE("Reset Args", cmd_buf);
 
-    {
-        std::vector<VkBufferMemoryBarrier> buffer_barriers = {
-            buffer_memory_barrier(m_temporal_accumulation.denoise_tile_coords_buffer, 0, VK_WHOLE_SIZE, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT),
-            buffer_memory_barrier(m_temporal_accumulation.denoise_dispatch_args_buffer, 0, VK_WHOLE_SIZE, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT)
-        };
-
-        pipeline_barrier(cmd_buf, {}, {}, buffer_barriers, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
-    }
-
     vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_reset_args.pipeline->handle());
 
     VkDescriptorSet descriptor_sets[] = {
@@ -1018,188 +910,59 @@ void RayTracedAO::temporal_accumulation(dw::vk::CommandBuffer::Ptr cmd_buf)
 
     auto backend = m_backend.lock();
 
-    VkImageSubresourceRange subresource_range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
-
-    {
-        std::vector<VkImageMemoryBarrier> image_barriers = {
-            image_memory_barrier(m_temporal_accumulation.color_image[m_common_resources->ping_pong], VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, subresource_range, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT),
-            image_memory_barrier(m_temporal_accumulation.history_length_image[m_common_resources->ping_pong], VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, subresource_range, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT)
-        };
-
-        std::vector<VkBufferMemoryBarrier> buffer_barriers = {
-            buffer_memory_barrier(m_temporal_accumulation.denoise_tile_coords_buffer, 0, VK_WHOLE_SIZE, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_WRITE_BIT),
-            buffer_memory_barrier(m_temporal_accumulation.denoise_dispatch_args_buffer, 0, VK_WHOLE_SIZE, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_WRITE_BIT)
-        };
-
-        pipeline_barrier(cmd_buf, {}, image_barriers, buffer_barriers, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
-    }
-
     vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_temporal_accumulation.pipeline->handle());
 
+    const bool ping_pong = m_common_resources->ping_pong;
+
     TemporalReprojectionPushConstants push_constants;
 
-    push_constants.alpha        = m_temporal_accumulation.alpha;
-    push_constants.g_buffer_mip = m_g_buffer_mip;
+    push_constants.g_buffer                = m_g_buffer->output_bindless_indices();
+    push_constants.prev_g_buffer           = m_g_buffer->history_bindless_indices();
+    push_constants.alpha                   = m_temporal_accumulation.alpha;
+    push_constants.g_buffer_mip            = m_g_buffer_mip;
+    push_constants.input_idx               = m_ray_trace.read_idx;
+    push_constants.prev_output_idx         = m_temporal_accumulation.color_read_idx[!ping_pong];
+    push_constants.prev_history_length_idx = m_temporal_accumulation.history_length_read_idx[!ping_pong];
+    push_constants.output_idx              = m_temporal_accumulation.color_write_idx[ping_pong];
+    push_constants.history_length_idx      = m_temporal_accumulation.history_length_write_idx[ping_pong];
 
     vkCmdPushConstants(cmd_buf->handle(), m_temporal_accumulation.pipeline_layout->handle(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_constants), &push_constants);
 
     VkDescriptorSet descriptor_sets[] = {
-        m_temporal_accumulation.write_ds[m_common_resources->ping_pong]->handle(),
-        m_g_buffer->output_ds()->handle(),
-        m_g_buffer->history_ds()->handle(),
-        m_ray_trace.read_ds->handle(),
-        m_temporal_accumulation.output_read_ds[!m_common_resources->ping_pong]->handle(),
-        m_temporal_accumulation.read_ds[!m_common_resources->ping_pong]->handle(),
+        m_common_resources->bindless_heap->ds(),
         m_common_resources->per_frame_ds->handle(),
         m_temporal_accumulation.indirect_buffer_ds->handle()
     };
 
     const uint32_t dynamic_offset = m_common_resources->ubo_size * backend->current_frame_idx();
 
-    vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_temporal_accumulation.pipeline_layout->handle(), 0, 8, descriptor_sets, 1, &dynamic_offset);
+    vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_temporal_accumulation.pipeline_layout->handle(), 0, 3, descriptor_sets, 1, &dynamic_offset);
 
     vkCmdDispatch(cmd_buf->handle(), static_cast<uint32_t>(ceil(float(m_width) / float(TEMPORAL_ACCUMULATION_NUM_THREADS_X))), static_cast<uint32_t>(ceil(float(m_height) / float(TEMPORAL_ACCUMULATION_NUM_THREADS_Y))), 1);
-
-    {
-        std::vector<VkImageMemoryBarrier> image_barriers = {
-            image_memory_barrier(m_temporal_accumulation.color_image[m_common_resources->ping_pong], VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, subresource_range, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT),
-            image_memory_barrier(m_temporal_accumulation.history_length_image[m_common_resources->ping_pong], VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, subresource_range, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT)
-        };
-
-        std::vector<VkBufferMemoryBarrier> buffer_barriers = {
-            buffer_memory_barrier(m_temporal_accumulation.denoise_tile_coords_buffer, 0, VK_WHOLE_SIZE, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT),
-            buffer_memory_barrier(m_temporal_accumulation.denoise_dispatch_args_buffer, 0, VK_WHOLE_SIZE, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT)
-        };
-
-        pipeline_barrier(cmd_buf, {}, image_barriers, buffer_barriers, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT);
-    }
 }
 
 // -----------------------------------------------------------------------------------------------------------------------------------
 
-void RayTracedAO::bilateral_blur(dw::vk::CommandBuffer::Ptr cmd_buf)
+void RayTracedAO::a_trous_filter(dw::vk::CommandBuffer::Ptr cmd_buf, uint32_t pass, RenderGraph::ImageHandle input, RenderGraph::ImageHandle output)
 {
-    DW_SCOPED_SAMPLE("Bilateral Blur", cmd_buf);
-
-    VkImageSubresourceRange subresource_range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
-
-    // Vertical
-    {
-        DW_SCOPED_SAMPLE("Vertical", cmd_buf);
-
-        dw::vk::utilities::set_image_layout(
-            cmd_buf->handle(),
-            m_bilateral_blur.image[0]->handle(),
-            VK_IMAGE_LAYOUT_UNDEFINED,
-            VK_IMAGE_LAYOUT_GENERAL,
-            subresource_range);
-
-        {
-            VkClearColorValue color;
-
-            color.float32[0] = 1.0f;
-            color.float32[1] = 1.0f;
-            color.float32[2] = 1.0f;
-            color.float32[3] = 1.0f;
-
-            vkCmdClearColorImage(cmd_buf->handle(), m_bilateral_blur.image[0]->handle(), VK_IMAGE_LAYOUT_GENERAL, &color, 1, &subresource_range);
-
-            std::vector<VkImageMemoryBarrier> image_barriers = {
-                image_memory_barrier(m_bilateral_blur.image[0], VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL, subresource_range, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_WRITE_BIT)
-            };
-
-            pipeline_barrier(cmd_buf, {}, image_barriers, {}, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
-        }
-
-        vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_bilateral_blur.pipeline->handle());
-
-        BilateralBlurPushConstants push_constants;
-
-        push_constants.z_buffer_params = m_common_resources->z_buffer_params;
-        push_constants.direction       = glm::ivec2(1, 0);
-        push_constants.radius          = m_bilateral_blur.blur_radius;
-        push_constants.g_buffer_mip    = m_g_buffer_mip;
+    DW_SCOPED_SAMPLE("A-Trous Filter " + std::to_string(pass), cmd_buf);
 
-        vkCmdPushConstants(cmd_buf->handle(), m_bilateral_blur.layout->handle(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_constants), &push_constants);
+    dw::vk::DescriptorSet::Ptr write_ds = output == m_graph_resources.a_trous_output ? m_a_trous.write_ds : m_graph->write_ds(output);
+    dw::vk::DescriptorSet::Ptr read_ds;
 
-        VkDescriptorSet descriptor_sets[] = {
-            m_bilateral_blur.write_ds[0]->handle(),
-            m_temporal_accumulation.output_read_ds[m_common_resources->ping_pong]->handle(),
-            m_temporal_accumulation.read_ds[m_common_resources->ping_pong]->handle(),
-            m_g_buffer->output_ds()->handle(),
-            m_temporal_accumulation.indirect_buffer_ds->handle()
-        };
-
-        vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_bilateral_blur.layout->handle(), 0, 5, descriptor_sets, 0, nullptr);
-
-        vkCmdDispatchIndirect(cmd_buf->handle(), m_temporal_accumulation.denoise_dispatch_args_buffer->handle(), 0);
-
-        dw::vk::utilities::set_image_layout(
-            cmd_buf->handle(),
-            m_bilateral_blur.image[0]->handle(),
-            VK_IMAGE_LAYOUT_GENERAL,
-            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-            subresource_range);
-    }
-
-    // Horizontal
-    {
-        DW_SCOPED_SAMPLE("Horizontal", cmd_buf);
-
-        dw::vk::utilities::set_image_layout(
-            cmd_buf->handle(),
-            m_bilateral_blur.image[1]->handle(),
-            VK_IMAGE_LAYOUT_UNDEFINED,
-            VK_IMAGE_LAYOUT_GENERAL,
-            subresource_range);
-
-        {
-            VkClearColorValue color;
-
-            color.float32[0] = 1.0f;
-            color.float32[1] = 1.0f;
-            color.float32[2] = 1.0f;
-            color.float32[3] = 1.0f;
-
-            vkCmdClearColorImage(cmd_buf->handle(), m_bilateral_blur.image[1]->handle(), VK_IMAGE_LAYOUT_GENERAL, &color, 1, &subresource_range);
-
-            std::vector<VkImageMemoryBarrier> image_barriers = {
-                image_memory_barrier(m_bilateral_blur.image[1], VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL, subresource_range, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_WRITE_BIT)
-            };
-
-            pipeline_barrier(cmd_buf, {}, image_barriers, {}, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
-        }
-
-        vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_bilateral_blur.pipeline->handle());
-
-        BilateralBlurPushConstants push_constants;
-
-        push_constants.z_buffer_params = m_common_resources->z_buffer_params;
-        push_constants.direction       = glm::ivec2(0, 1);
-        push_constants.radius          = m_bilateral_blur.blur_radius;
-        push_constants.g_buffer_mip    = m_g_buffer_mip;
-
-        vkCmdPushConstants(cmd_buf->handle(), m_bilateral_blur.layout->handle(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_constants), &push_constants);
-
-        VkDescriptorSet descriptor_sets[] = {
-            m_bilateral_blur.write_ds[1]->handle(),
-            m_bilateral_blur.read_ds[0]->handle(),
-            m_temporal_accumulation.read_ds[m_common_resources->ping_pong]->handle(),
-            m_g_buffer->output_ds()->handle(),
-            m_temporal_accumulation.indirect_buffer_ds->handle()
-        };
+    if (input == m_graph_resources.color[m_common_resources->ping_pong])
+        read_ds = m_temporal_accumulation.output_read_ds[m_common_resources->ping_pong];
+    else
+        read_ds = m_graph->read_ds(input);
 
-        vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_bilateral_blur.layout->handle(), 0, 5, descriptor_sets, 0, nullptr);
+    m_a_trous.denoiser->filter(cmd_buf, pass, write_ds, read_ds, m_temporal_accumulation.indirect_buffer_ds, m_temporal_accumulation.denoise_dispatch_args_buffer, m_g_buffer_mip);
+}
 
-        vkCmdDispatchIndirect(cmd_buf->handle(), m_temporal_accumulation.denoise_dispatch_args_buffer->handle(), 0);
+// -----------------------------------------------------------------------------------------------------------------------------------
 
-        dw::vk::utilities::set_image_layout(
-            cmd_buf->handle(),
-            m_bilateral_blur.image[1]->handle(),
-            VK_IMAGE_LAYOUT_GENERAL,
-            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-            subresource_range);
-    }
+void RayTracedAO::copy_counters(dw::vk::CommandBuffer::Ptr cmd_buf)
+{
+    m_common_resources->gpu_counters->copy(cmd_buf, GPU_COUNTER_AO_DENOISE_TILES, m_temporal_accumulation.denoise_dispatch_args_buffer);
 }
 
-// -----------------------------------------------------------------------------------------------------------------------------------
\ No newline at end of file
+// -----------------------------------------------------------------------------------------------------------------------------------
@@ -1,6 +1,8 @@
 #pragma once
 
 #include "common.h"
+#include "render_graph.h"
+#include "pipeline_permutations.h"
 
 class GBuffer;
 
@@ -11,7 +13,7 @@ public:
     {
         OUTPUT_RAY_TRACE,
         OUTPUT_TEMPORAL_ACCUMULATION,
-        OUTPUT_BILATERAL_BLUR,
+        OUTPUT_ATROUS,
         OUTPUT_UPSAMPLE
     };
 
@@ -25,46 +27,58 @@ public:
 
     void                       render(dw::vk::CommandBuffer::Ptr cmd_buf);
     void                       gui();
+    void                       set_scale(RayTraceScale scale);
+    void                       set_precision(RenderTargetPrecision precision);
     dw::vk::DescriptorSet::Ptr output_ds();
 
-    inline uint32_t      width() { return m_width; }
-    inline uint32_t      height() { return m_height; }
-    inline RayTraceScale scale() { return m_scale; }
-    inline OutputType    current_output() { return m_current_output; }
-    inline void          set_current_output(OutputType current_output) { m_current_output = current_output; }
+    inline uint32_t              width() { return m_width; }
+    inline uint32_t              height() { return m_height; }
+    inline RayTraceScale         scale() { return m_scale; }
+    inline RenderTargetPrecision precision() { return m_precision; }
+    inline OutputType            current_output() { return m_current_output; }
+    inline QueueType             queue_type() { return m_queue_type; }
+    inline void                  set_queue_type(QueueType queue_type) { m_queue_type = queue_type; }
+    inline RenderGraph*          render_graph() { return m_graph.get(); }
+    inline void                  set_current_output(OutputType current_output) { m_current_output = current_output; }
+    inline void                  restart_accumulation() { m_first_frame = true; }
 
 private:
-    void create_images();
-    void create_buffers();
-    void create_descriptor_sets();
-    void write_descriptor_sets();
-    void create_pipeline();
-    void clear_images(dw::vk::CommandBuffer::Ptr cmd_buf);
-    void ray_trace(dw::vk::CommandBuffer::Ptr cmd_buf);
-    void denoise(dw::vk::CommandBuffer::Ptr cmd_buf);
-    void upsample(dw::vk::CommandBuffer::Ptr cmd_buf);
-    void reset_args(dw::vk::CommandBuffer::Ptr cmd_buf);
-    void temporal_accumulation(dw::vk::CommandBuffer::Ptr cmd_buf);
-    void bilateral_blur(dw::vk::CommandBuffer::Ptr cmd_buf);
+    void                     update_resolution();
+    void                     create_images();
+    void                     create_buffers();
+    void                     create_descriptor_set_layouts();
+    void                     create_descriptor_sets();
+    void                     write_descriptor_sets();
+    void                     create_pipeline();
+    void                     retire_resources();
+    void                     setup_render_graph();
+    RenderGraph::ImageHandle output_image();
+    void                     ray_trace(dw::vk::CommandBuffer::Ptr cmd_buf);
+    void                     upsample(dw::vk::CommandBuffer::Ptr cmd_buf);
+    void                     reset_args(dw::vk::CommandBuffer::Ptr cmd_buf);
+    void                     temporal_accumulation(dw::vk::CommandBuffer::Ptr cmd_buf);
+    void                     a_trous_filter(dw::vk::CommandBuffer::Ptr cmd_buf, uint32_t pass, RenderGraph::ImageHandle input, RenderGraph::ImageHandle output);
+    void                     copy_counters(dw::vk::CommandBuffer::Ptr cmd_buf);
 
 private:
     struct RayTrace
     {
-        float                        ray_length = 7.0f;
-        float                        bias       = 0.3f;
-        dw::vk::ComputePipeline::Ptr pipeline;
-        dw::vk::PipelineLayout::Ptr  pipeline_layout;
-        dw::vk::Image::Ptr           image;
-        dw::vk::ImageView::Ptr       view;
-        dw::vk::DescriptorSet::Ptr   write_ds;
-        dw::vk::DescriptorSet::Ptr   read_ds;
-        dw::vk::DescriptorSet::Ptr   bilinear_read_ds;
+        float                       ray_length = 7.0f;
+        float                       bias       = 0.3f;
+        CachedComputePipeline::Ptr  pipeline;
+        dw::vk::PipelineLayout::Ptr pipeline_layout;
+        dw::vk::Image::Ptr          image;
+        dw::vk::ImageView::Ptr      view;
+        dw::vk::DescriptorSet::Ptr  read_ds;
+        dw::vk::DescriptorSet::Ptr  bilinear_read_ds;
+        uint32_t                    write_idx = BINDLESS_INVALID_INDEX;
+        uint32_t                    read_idx  = BINDLESS_INVALID_INDEX;
     };
 
     struct ResetArgs
     {
-        dw::vk::PipelineLayout::Ptr  pipeline_layout;
-        dw::vk::ComputePipeline::Ptr pipeline;
+        dw::vk::PipelineLayout::Ptr pipeline_layout;
+        CachedComputePipeline::Ptr  pipeline;
     };
 
     struct TemporalAccumulation
@@ -72,49 +86,62 @@ private:
         float                            alpha = 0.01f;
         dw::vk::Buffer::Ptr              denoise_tile_coords_buffer;
         dw::vk::Buffer::Ptr              denoise_dispatch_args_buffer;
-        dw::vk::ComputePipeline::Ptr     pipeline;
+        CachedComputePipeline::Ptr       pipeline;
         dw::vk::PipelineLayout::Ptr      pipeline_layout;
-        dw::vk::DescriptorSetLayout::Ptr read_ds_layout;
-        dw::vk::DescriptorSetLayout::Ptr write_ds_layout;
         dw::vk::DescriptorSetLayout::Ptr indirect_buffer_ds_layout;
         dw::vk::Image::Ptr               color_image[2];
         dw::vk::ImageView::Ptr           color_view[2];
         dw::vk::Image::Ptr               history_length_image[2];
         dw::vk::ImageView::Ptr           history_length_view[2];
-        dw::vk::DescriptorSet::Ptr       write_ds[2];
-        dw::vk::DescriptorSet::Ptr       read_ds[2];
         dw::vk::DescriptorSet::Ptr       output_read_ds[2];
         dw::vk::DescriptorSet::Ptr       indirect_buffer_ds;
+        uint32_t                         color_write_idx[2];
+        uint32_t                         color_read_idx[2];
+        uint32_t                         history_length_write_idx[2];
+        uint32_t                         history_length_read_idx[2];
     };
 
-    struct BilateralBlur
+    struct ATrous
     {
-        int32_t                      blur_radius = 4;
-        dw::vk::PipelineLayout::Ptr  layout;
-        dw::vk::ComputePipeline::Ptr pipeline;
-        dw::vk::Image::Ptr           image[2];
-        dw::vk::ImageView::Ptr       image_view[2];
-        dw::vk::DescriptorSet::Ptr   read_ds[2];
-        dw::vk::DescriptorSet::Ptr   write_ds[2];
+        std::unique_ptr<SVGFDenoiser> denoiser;
+        dw::vk::Image::Ptr            image;
+        dw::vk::ImageView::Ptr        view;
+        dw::vk::DescriptorSet::Ptr    read_ds;
+        dw::vk::DescriptorSet::Ptr    write_ds;
+        uint32_t                      read_idx = BINDLESS_INVALID_INDEX;
     };
 
     struct Upsample
     {
-        float                        power = 1.2f;
-        dw::vk::PipelineLayout::Ptr  layout;
-        dw::vk::ComputePipeline::Ptr pipeline;
-        dw::vk::Image::Ptr           image;
-        dw::vk::ImageView::Ptr       image_view;
-        dw::vk::DescriptorSet::Ptr   read_ds;
-        dw::vk::DescriptorSet::Ptr   write_ds;
+        float                                        power      = 1.2f;
+        bool                                         low_memory = false;
+        dw::vk::PipelineLayout::Ptr                  layout;
+        std::unique_ptr<ComputePipelinePermutations> permutations;
+        dw::vk::Image::Ptr                           image;
+        dw::vk::ImageView::Ptr                       image_view;
+        dw::vk::DescriptorSet::Ptr                   read_ds;
+        uint32_t                                     write_idx = BINDLESS_INVALID_INDEX;
+    };
+
+    struct GraphResources
+    {
+        RenderGraph::ImageHandle  ray_trace;
+        RenderGraph::ImageHandle  color[2];
+        RenderGraph::ImageHandle  history_length[2];
+        RenderGraph::ImageHandle  a_trous_output;
+        RenderGraph::ImageHandle  upsample;
+        RenderGraph::BufferHandle tile_coords;
+        RenderGraph::BufferHandle dispatch_args;
     };
 
     std::weak_ptr<dw::vk::Backend> m_backend;
     CommonResources*               m_common_resources;
     GBuffer*                       m_g_buffer;
     RayTraceScale                  m_scale;
+    RenderTargetPrecision          m_precision      = RENDER_TARGET_PRECISION_FULL;
     uint32_t                       m_g_buffer_mip   = 0;
     OutputType                     m_current_output = OUTPUT_UPSAMPLE;
+    QueueType                      m_queue_type     = QUEUE_TYPE_GRAPHICS;
     uint32_t                       m_width;
     uint32_t                       m_height;
     bool                           m_denoise     = true;
@@ -122,6 +149,8 @@ private:
     RayTrace                       m_ray_trace;
     ResetArgs                      m_reset_args;
     TemporalAccumulation           m_temporal_accumulation;
-    BilateralBlur                  m_bilateral_blur;
+    ATrous                         m_a_trous;
     Upsample                       m_upsample;
+    std::unique_ptr<RenderGraph>   m_graph;
+    GraphResources                 m_graph_resources;
 };
\ No newline at end of file
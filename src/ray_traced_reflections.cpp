@@ -1,6 +1,8 @@
 #include "ray_traced_reflections.h"
 #include "g_buffer.h"
 #include "ddgi.h"
+#include "deferred_shading.h"
+#include "svgf_denoiser.h"
 #include "utilities.h"
 #include <profiler.h>
 #include <macros.h>
@@ -10,52 +12,127 @@
 
 static const uint32_t TEMPORAL_ACCUMULATION_NUM_THREADS_X = 8;
 static const uint32_t TEMPORAL_ACCUMULATION_NUM_THREADS_Y = 8;
+static const uint32_t SCREEN_SPACE_NUM_THREADS_X          = 8;
+static const uint32_t SCREEN_SPACE_NUM_THREADS_Y          = 8;
+static const uint32_t ADAPTIVE_RAYS_TILE_SIZE             = 8;
+static const uint32_t RAY_BINNING_REGION_SIZE             = 64; // Must match REFLECTIONS_RAY_BIN_REGION_SIZE
+static const uint32_t RAY_BINNING_DIRECTIONS              = 9;
+static const uint32_t RAY_QUERY_NUM_THREADS_X             = 8;
+static const uint32_t RAY_QUERY_NUM_THREADS_Y             = 8;
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Specialization constant ids of reflections_ray_trace.rchit and reflections_ray_trace.comp, which are also the bits of a ray
+// trace permutation key.
+enum ReflectionsConstant
+{
+    REFLECTIONS_CONSTANT_SAMPLE_GI,
+    REFLECTIONS_CONSTANT_DDGI_VISIBILITY_TEST,
+    REFLECTIONS_CONSTANT_COUNT
+};
+
+// Specialization constant ids of reflections_upsample.comp.
+enum ReflectionsUpsampleConstant
+{
+    REFLECTIONS_UPSAMPLE_CONSTANT_LOW_MEMORY,
+    REFLECTIONS_UPSAMPLE_CONSTANT_COUNT
+};
 
 // -----------------------------------------------------------------------------------------------------------------------------------
 
 struct RayTracePushConstants
 {
-    float    bias;
+    glm::uvec4 g_buffer;
+    float      bias;
+    float      trim;
+    uint32_t   num_frames;
+    int32_t    g_buffer_mip;
+    int32_t    approximate_with_ddgi;
+    float      gi_intensity;
+    float      rough_ddgi_intensity;
+    float      ibl_indirect_specular_intensity;
+    int32_t    ray_list;
+    uint32_t   sobol_idx;
+    uint32_t   scrambling_ranking_idx;
+    uint32_t   output_idx;
+};
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+struct ScreenSpacePushConstants
+{
     float    trim;
     uint32_t num_frames;
     int32_t  g_buffer_mip;
-    int32_t  sample_gi;
     int32_t  approximate_with_ddgi;
-    float    gi_intensity;
-    float    rough_ddgi_intensity;
-    float    ibl_indirect_specular_intensity;
+    int32_t  max_iterations;
+    float    thickness;
+    float    max_distance;
+    int32_t  screen_space;
+    int32_t  tile_list;
+    int32_t  ray_binning;
 };
 
 // -----------------------------------------------------------------------------------------------------------------------------------
 
-struct TemporalAccumulationPushConstants
+struct BinRaysScanPushConstants
+{
+    uint32_t num_bins;
+};
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+struct ClassifyTilesPushConstants
+{
+    glm::uvec4 g_buffer;
+    uint32_t   num_frames;
+    int32_t    g_buffer_mip;
+    float      quarter_rate_roughness;
+    float      converged_variance;
+    float      converged_history_length;
+    uint32_t   converged_refresh_interval;
+    uint32_t   output_idx;
+    uint32_t   history_output_idx;
+    uint32_t   history_moments_idx;
+};
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+struct ReconstructPushConstants
 {
-    glm::vec3 camera_delta;
-    float     frame_time;
-    float     alpha;
-    float     moments_alpha;
-    int32_t   g_buffer_mip;
-    int       approximate_with_ddgi;
+    glm::uvec4 g_buffer;
+    uint32_t   num_frames;
+    int32_t    g_buffer_mip;
+    uint32_t   output_idx;
 };
 
 // -----------------------------------------------------------------------------------------------------------------------------------
 
-struct ATrousFilterPushConstants
+struct TemporalAccumulationPushConstants
 {
-    int     radius;
-    int     step_size;
-    float   phi_color;
-    float   phi_normal;
-    float   sigma_depth;
-    int32_t g_buffer_mip;
-    int32_t approximate_with_ddgi;
+    glm::uvec4 g_buffer;
+    glm::uvec4 prev_g_buffer;
+    glm::vec3  camera_delta;
+    float      frame_time;
+    float      alpha;
+    float      moments_alpha;
+    int32_t    g_buffer_mip;
+    int        approximate_with_ddgi;
+    uint32_t   input_idx;
+    uint32_t   history_output_idx;
+    uint32_t   history_moments_idx;
+    uint32_t   output_idx;
+    uint32_t   moments_idx;
 };
 
 // -----------------------------------------------------------------------------------------------------------------------------------
 
 struct UpsamplePushConstants
 {
-    int32_t g_buffer_mip;
+    glm::uvec4 g_buffer;
+    int32_t    g_buffer_mip;
+    uint32_t   input_idx;
+    uint32_t   output_idx;
 };
 
 // -----------------------------------------------------------------------------------------------------------------------------------
@@ -81,17 +158,12 @@ const std::string RayTracedReflections::kOutputTypeNames[] = {
 RayTracedReflections::RayTracedReflections(std::weak_ptr<dw::vk::Backend> backend, CommonResources* common_resources, GBuffer* g_buffer, RayTraceScale scale) :
     m_backend(backend), m_common_resources(common_resources), m_g_buffer(g_buffer), m_scale(scale)
 {
-    auto vk_backend = m_backend.lock();
-
-    float scale_divisor = powf(2.0f, float(scale));
-
-    m_width  = vk_backend->swap_chain_extents().width / scale_divisor;
-    m_height = vk_backend->swap_chain_extents().height / scale_divisor;
-
-    m_g_buffer_mip = static_cast<uint32_t>(scale);
+    m_graph = std::unique_ptr<RenderGraph>(new RenderGraph(m_backend, m_common_resources->transient_image_pool.get()));
 
+    update_resolution();
     create_images();
     create_buffers();
+    create_descriptor_set_layouts();
     create_descriptor_sets();
     write_descriptor_sets();
     create_pipelines();
@@ -105,28 +177,34 @@ RayTracedReflections::~RayTracedReflections()
 
 // -----------------------------------------------------------------------------------------------------------------------------------
 
-void RayTracedReflections::render(dw::vk::CommandBuffer::Ptr cmd_buf, DDGI* ddgi)
+void RayTracedReflections::render(dw::vk::CommandBuffer::Ptr cmd_buf, DDGI* ddgi, DeferredShading* deferred_shading)
 {
     DW_SCOPED_SAMPLE("Ray Traced Reflections", cmd_buf);
+    GPU_SCOPED_TIMER("Reflections", cmd_buf, m_common_resources->gpu_timer.get());
 
-    clear_images(cmd_buf);
-    ray_trace(cmd_buf, ddgi);
+    auto backend = m_backend.lock();
 
-    if (m_denoise)
-    {
-        reset_args(cmd_buf);
-        temporal_accumulation(cmd_buf);
-        a_trous_filter(cmd_buf);
+    // The slot of this frame in flight was last written kMaxFramesInFlight frames ago, the GPU is already done with it.
+    const uint32_t* ray_list_args = (const uint32_t*)m_screen_space.readback_buffer->mapped_ptr() + 4 * backend->current_frame_idx();
 
-        if (m_scale != RAY_TRACE_SCALE_FULL_RES)
-            upsample(cmd_buf);
-    }
+    m_screen_space.num_rays = ray_list_args[0];
+    m_screen_space.num_hits = ray_list_args[3];
+
+    // Hits are shaded with the previous lit image, which does not exist until the first frame has been shaded. The ray
+    // allocation is driven by the temporal variance, so it also needs a history to start from.
+    bool ray_list = (m_screen_space.enabled || m_adaptive_rays.enabled || m_ray_binning.enabled) && deferred_shading && !m_first_frame;
+    bool adaptive = ray_list && m_adaptive_rays.enabled && m_denoise;
+
+    setup_render_graph(ddgi, deferred_shading, ray_list, adaptive);
+
+    m_graph->execute(cmd_buf);
 }
 
 // -----------------------------------------------------------------------------------------------------------------------------------
 
 void RayTracedReflections::gui()
 {
+    m_timings.gui();
     ImGui::Checkbox("Denoise", &m_denoise);
     ImGui::Checkbox("Blur as Temporal Input", &m_temporal_accumulation.blur_as_input);
     ImGui::Checkbox("Sample GI", &m_ray_trace.sample_gi);
@@ -138,11 +216,71 @@ void RayTracedReflections::gui()
     ImGui::SliderFloat("IBL Indirect Specular Intensity", &m_ray_trace.ibl_indirect_specular_intensity, 0.0f, 1.0f);
     ImGui::InputFloat("Bias", &m_ray_trace.bias);
     ImGui::SliderFloat("Lobe Trim", &m_ray_trace.trim, 0.0f, 1.0f);
+    ImGui::Checkbox("Screen Space First", &m_screen_space.enabled);
+    if (m_screen_space.enabled)
+    {
+        ImGui::SliderInt("SSR Max Iterations", &m_screen_space.max_iterations, 1, 256);
+        ImGui::SliderFloat("SSR Thickness", &m_screen_space.thickness, 0.01f, 5.0f);
+        ImGui::InputFloat("SSR Max Distance", &m_screen_space.max_distance);
+    }
+    ImGui::Checkbox("Adaptive Ray Allocation", &m_adaptive_rays.enabled);
+    if (m_adaptive_rays.enabled)
+    {
+        ImGui::SliderFloat("Quarter Rate Roughness", &m_adaptive_rays.quarter_rate_roughness, 0.0f, 1.0f);
+        ImGui::InputFloat("Converged Variance", &m_adaptive_rays.converged_variance, 0.0f, 0.0f, "%.6f");
+        ImGui::SliderFloat("Converged History Length", &m_adaptive_rays.converged_history_length, 1.0f, 32.0f);
+        ImGui::SliderInt("Converged Refresh Interval", &m_adaptive_rays.converged_refresh_interval, 1, 16);
+    }
+    ImGui::Checkbox("Ray Binning", &m_ray_binning.enabled);
+    if (m_screen_space.enabled || m_adaptive_rays.enabled || m_ray_binning.enabled)
+        ImGui::Text("SSR Hits: %u, Ray Traced: %u", m_screen_space.num_hits, m_screen_space.num_rays);
     ImGui::InputFloat("Alpha", &m_temporal_accumulation.alpha);
     ImGui::InputFloat("Alpha Moments", &m_temporal_accumulation.moments_alpha);
-    ImGui::InputFloat("Phi Color", &m_a_trous.phi_color);
-    ImGui::InputFloat("Phi Normal", &m_a_trous.phi_normal);
-    ImGui::InputFloat("Sigma Depth", &m_a_trous.sigma_depth);
+    m_a_trous.denoiser->gui();
+    ImGui::Text("Render Graph: %u passes, %u barriers, %u transients", m_graph->num_passes(), m_graph->num_barriers(), m_graph->num_physical_transients());
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void RayTracedReflections::set_scale(RayTraceScale scale)
+{
+    if (scale == m_scale)
+        return;
+
+    retire_resources();
+
+    m_scale = scale;
+
+    update_resolution();
+    create_images();
+    create_buffers();
+    create_descriptor_sets();
+    write_descriptor_sets();
+
+    m_graph->clear_resource_states();
+
+    m_first_frame = true;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void RayTracedReflections::set_precision(RenderTargetPrecision precision)
+{
+    if (precision == m_precision)
+        return;
+
+    retire_resources();
+
+    m_precision = precision;
+
+    create_images();
+    create_buffers();
+    create_descriptor_sets();
+    write_descriptor_sets();
+
+    m_graph->clear_resource_states();
+
+    m_first_frame = true;
 }
 
 // -----------------------------------------------------------------------------------------------------------------------------------
@@ -156,11 +294,11 @@ dw::vk::DescriptorSet::Ptr RayTracedReflections::output_ds()
         else if (m_current_output == OUTPUT_TEMPORAL_ACCUMULATION)
             return m_temporal_accumulation.output_only_read_ds[m_common_resources->ping_pong];
         else if (m_current_output == OUTPUT_ATROUS)
-            return m_a_trous.read_ds[m_a_trous.read_idx];
+            return m_a_trous.read_ds;
         else
         {
             if (m_scale == RAY_TRACE_SCALE_FULL_RES)
-                return m_a_trous.read_ds[m_a_trous.read_idx];
+                return m_a_trous.read_ds;
             else
                 return m_upsample.read_ds;
         }
@@ -171,6 +309,18 @@ dw::vk::DescriptorSet::Ptr RayTracedReflections::output_ds()
 
 // -----------------------------------------------------------------------------------------------------------------------------------
 
+void RayTracedReflections::update_resolution()
+{
+    float scale_divisor = powf(2.0f, float(m_scale));
+
+    m_width  = m_common_resources->render_width / scale_divisor;
+    m_height = m_common_resources->render_height / scale_divisor;
+
+    m_g_buffer_mip = static_cast<uint32_t>(m_scale);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
 void RayTracedReflections::create_images()
 {
     auto backend = m_backend.lock();
@@ -208,26 +358,38 @@ void RayTracedReflections::create_images()
         m_temporal_accumulation.prev_view->set_name("Reflections Previous Reprojection");
     }
 
-    // A-Trous Filter
-    for (int i = 0; i < 2; i++)
+    // A-Trous Filter, the ping-pong partner of the output is a render graph transient.
     {
-        m_a_trous.image[i] = dw::vk::Image::create(backend, VK_IMAGE_TYPE_2D, m_width, m_height, 1, 1, 1, VK_FORMAT_R16G16B16A16_SFLOAT, VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_SAMPLE_COUNT_1_BIT);
-        m_a_trous.image[i]->set_name("A-Trous Filter " + std::to_string(i));
+        m_a_trous.image = dw::vk::Image::create(backend, VK_IMAGE_TYPE_2D, m_width, m_height, 1, 1, 1, VK_FORMAT_R16G16B16A16_SFLOAT, VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_SAMPLE_COUNT_1_BIT);
+        m_a_trous.image->set_name("Reflections A-Trous Filter");
 
-        m_a_trous.view[i] = dw::vk::ImageView::create(backend, m_a_trous.image[i], VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT);
-        m_a_trous.view[i]->set_name("A-Trous Filter View " + std::to_string(i));
+        m_a_trous.view = dw::vk::ImageView::create(backend, m_a_trous.image, VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT);
+        m_a_trous.view->set_name("Reflections A-Trous Filter View");
     }
 
-    // Upsample
+    // Upsample, only its color is read by the deferred shading so the low memory tier packs it. The history and A-Trous images
+    // keep their alpha, it holds the ray length and the variance, and the moments hold the history length in their third channel.
     {
-        auto vk_backend = m_backend.lock();
+        m_upsample.low_memory = m_precision == RENDER_TARGET_PRECISION_LOW_MEMORY && is_storage_image_format_supported(backend, VK_FORMAT_B10G11R11_UFLOAT_PACK32);
 
-        m_upsample.image = dw::vk::Image::create(backend, VK_IMAGE_TYPE_2D, vk_backend->swap_chain_extents().width, vk_backend->swap_chain_extents().height, 1, 1, 1, VK_FORMAT_R16G16B16A16_SFLOAT, VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT, VK_SAMPLE_COUNT_1_BIT);
+        if (m_precision == RENDER_TARGET_PRECISION_LOW_MEMORY && !m_upsample.low_memory)
+            DW_LOG_INFO("R11G11B10F storage images are not supported, Reflections fall back to full precision.");
+
+        m_upsample.image = dw::vk::Image::create(backend, VK_IMAGE_TYPE_2D, m_common_resources->render_width, m_common_resources->render_height, 1, 1, 1, m_upsample.low_memory ? VK_FORMAT_B10G11R11_UFLOAT_PACK32 : VK_FORMAT_R16G16B16A16_SFLOAT, VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT, VK_SAMPLE_COUNT_1_BIT);
         m_upsample.image->set_name("Reflections Upsample");
 
         m_upsample.image_view = dw::vk::ImageView::create(backend, m_upsample.image, VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT);
         m_upsample.image_view->set_name("Reflections Upsample");
     }
+
+    m_common_resources->memory_tracker->track("Reflections", { m_ray_trace.image,
+                                                               m_temporal_accumulation.current_output_image[0],
+                                                               m_temporal_accumulation.current_output_image[1],
+                                                               m_temporal_accumulation.current_moments_image[0],
+                                                               m_temporal_accumulation.current_moments_image[1],
+                                                               m_temporal_accumulation.prev_image,
+                                                               m_a_trous.image,
+                                                               m_upsample.image });
 }
 
 // -----------------------------------------------------------------------------------------------------------------------------------
@@ -237,78 +399,127 @@ void RayTracedReflections::create_buffers()
     auto backend = m_backend.lock();
 
     m_temporal_accumulation.denoise_tile_coords_buffer   = dw::vk::Buffer::create(backend, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sizeof(glm::ivec2) * static_cast<uint32_t>(ceil(float(m_width) / float(TEMPORAL_ACCUMULATION_NUM_THREADS_X))) * static_cast<uint32_t>(ceil(float(m_height) / float(TEMPORAL_ACCUMULATION_NUM_THREADS_Y))), VMA_MEMORY_USAGE_GPU_ONLY, 0);
-    m_temporal_accumulation.denoise_dispatch_args_buffer = dw::vk::Buffer::create(backend, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, sizeof(int32_t) * 3, VMA_MEMORY_USAGE_GPU_ONLY, 0);
+    m_temporal_accumulation.denoise_dispatch_args_buffer = dw::vk::Buffer::create(backend, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, sizeof(int32_t) * 3, VMA_MEMORY_USAGE_GPU_ONLY, 0);
 
     m_temporal_accumulation.copy_tile_coords_buffer   = dw::vk::Buffer::create(backend, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sizeof(glm::ivec2) * static_cast<uint32_t>(ceil(float(m_width) / float(TEMPORAL_ACCUMULATION_NUM_THREADS_X))) * static_cast<uint32_t>(ceil(float(m_height) / float(TEMPORAL_ACCUMULATION_NUM_THREADS_Y))), VMA_MEMORY_USAGE_GPU_ONLY, 0);
-    m_temporal_accumulation.copy_dispatch_args_buffer = dw::vk::Buffer::create(backend, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, sizeof(int32_t) * 3, VMA_MEMORY_USAGE_GPU_ONLY, 0);
+    m_temporal_accumulation.copy_dispatch_args_buffer = dw::vk::Buffer::create(backend, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, sizeof(int32_t) * 3, VMA_MEMORY_USAGE_GPU_ONLY, 0);
+
+    // Args are { width, height, depth } of vkCmdTraceRaysIndirectKHR followed by the number of screen space hits, then the
+    // { x, y, z } of the vkCmdDispatchIndirect of the ray query backend. Only the first four are read back, into host coherent
+    // memory so that the mapping can be read without invalidating it.
+    m_screen_space.ray_list_args_buffer   = dw::vk::Buffer::create(backend, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, sizeof(glm::uvec4) * 2, VMA_MEMORY_USAGE_GPU_ONLY, 0);
+    m_screen_space.ray_list_coords_buffer = dw::vk::Buffer::create(backend, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sizeof(uint32_t) * m_width * m_height, VMA_MEMORY_USAGE_GPU_ONLY, 0);
+    m_screen_space.readback_buffer        = dw::vk::Buffer::create(backend, VK_BUFFER_USAGE_TRANSFER_DST_BIT, sizeof(glm::uvec4) * dw::vk::Backend::kMaxFramesInFlight, VMA_MEMORY_USAGE_CPU_ONLY, VMA_ALLOCATION_CREATE_MAPPED_BIT);
+
+    memset(m_screen_space.readback_buffer->mapped_ptr(), 0, sizeof(glm::uvec4) * dw::vk::Backend::kMaxFramesInFlight);
+
+    m_ray_binning.num_bins = static_cast<uint32_t>(ceil(float(m_width) / float(RAY_BINNING_REGION_SIZE))) * static_cast<uint32_t>(ceil(float(m_height) / float(RAY_BINNING_REGION_SIZE))) * RAY_BINNING_DIRECTIONS;
+
+    m_ray_binning.unsorted_coords_buffer       = dw::vk::Buffer::create(backend, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sizeof(uint32_t) * m_width * m_height, VMA_MEMORY_USAGE_GPU_ONLY, 0);
+    m_ray_binning.bins_buffer                  = dw::vk::Buffer::create(backend, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sizeof(uint32_t) * m_width * m_height, VMA_MEMORY_USAGE_GPU_ONLY, 0);
+    m_ray_binning.bin_counts_buffer            = dw::vk::Buffer::create(backend, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, sizeof(uint32_t) * m_ray_binning.num_bins, VMA_MEMORY_USAGE_GPU_ONLY, 0);
+    m_ray_binning.scatter_dispatch_args_buffer = dw::vk::Buffer::create(backend, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, sizeof(int32_t) * 3, VMA_MEMORY_USAGE_GPU_ONLY, 0);
+
+    const uint32_t num_tiles = static_cast<uint32_t>(ceil(float(m_width) / float(ADAPTIVE_RAYS_TILE_SIZE))) * static_cast<uint32_t>(ceil(float(m_height) / float(ADAPTIVE_RAYS_TILE_SIZE)));
+
+    m_adaptive_rays.trace_tile_coords_buffer         = dw::vk::Buffer::create(backend, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sizeof(glm::uvec2) * num_tiles, VMA_MEMORY_USAGE_GPU_ONLY, 0);
+    m_adaptive_rays.trace_dispatch_args_buffer       = dw::vk::Buffer::create(backend, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, sizeof(int32_t) * 3, VMA_MEMORY_USAGE_GPU_ONLY, 0);
+    m_adaptive_rays.reconstruct_tile_coords_buffer   = dw::vk::Buffer::create(backend, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sizeof(glm::ivec2) * num_tiles, VMA_MEMORY_USAGE_GPU_ONLY, 0);
+    m_adaptive_rays.reconstruct_dispatch_args_buffer = dw::vk::Buffer::create(backend, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, sizeof(int32_t) * 3, VMA_MEMORY_USAGE_GPU_ONLY, 0);
 }
 
 // -----------------------------------------------------------------------------------------------------------------------------------
 
-void RayTracedReflections::create_descriptor_sets()
+void RayTracedReflections::create_descriptor_set_layouts()
 {
     auto backend = m_backend.lock();
 
-    // Ray Trace
+    // Indirect Buffer
     {
-        m_ray_trace.write_ds = backend->allocate_descriptor_set(m_common_resources->storage_image_ds_layout);
-        m_ray_trace.read_ds  = backend->allocate_descriptor_set(m_common_resources->combined_sampler_ds_layout);
+        dw::vk::DescriptorSetLayout::Desc desc;
+
+        desc.add_binding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+        desc.add_binding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+        desc.add_binding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+        desc.add_binding(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+
+        m_temporal_accumulation.indirect_buffer_ds_layout = dw::vk::DescriptorSetLayout::create(backend, desc);
     }
 
-    // Reprojection
+    // Ray List
     {
         dw::vk::DescriptorSetLayout::Desc desc;
 
-        desc.add_binding(0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT);
-        desc.add_binding(1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+        desc.add_binding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_RAYGEN_BIT_KHR);
+        desc.add_binding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_RAYGEN_BIT_KHR);
+        desc.add_binding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+        desc.add_binding(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+        desc.add_binding(4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+        desc.add_binding(5, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
 
-        m_temporal_accumulation.write_ds_layout = dw::vk::DescriptorSetLayout::create(backend, desc);
+        m_screen_space.ray_list_ds_layout = dw::vk::DescriptorSetLayout::create(backend, desc);
     }
 
+    // Tile List
     {
         dw::vk::DescriptorSetLayout::Desc desc;
 
-        desc.add_binding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
-        desc.add_binding(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+        desc.add_binding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+        desc.add_binding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+        desc.add_binding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+        desc.add_binding(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
 
-        m_temporal_accumulation.read_ds_layout = dw::vk::DescriptorSetLayout::create(backend, desc);
+        m_adaptive_rays.tile_list_ds_layout = dw::vk::DescriptorSetLayout::create(backend, desc);
     }
+}
 
-    for (int i = 0; i < 2; i++)
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void RayTracedReflections::create_descriptor_sets()
+{
+    auto backend = m_backend.lock();
+
+    // Ray Trace
     {
-        m_temporal_accumulation.current_write_ds[i]    = backend->allocate_descriptor_set(m_temporal_accumulation.write_ds_layout);
-        m_temporal_accumulation.current_read_ds[i]     = backend->allocate_descriptor_set(m_temporal_accumulation.read_ds_layout);
-        m_temporal_accumulation.prev_read_ds[i]        = backend->allocate_descriptor_set(m_temporal_accumulation.read_ds_layout);
-        m_temporal_accumulation.output_only_read_ds[i] = backend->allocate_descriptor_set(m_common_resources->combined_sampler_ds_layout);
+        m_ray_trace.write_ds = backend->allocate_descriptor_set(m_common_resources->storage_image_ds_layout);
+        m_ray_trace.read_ds  = backend->allocate_descriptor_set(m_common_resources->combined_sampler_ds_layout);
     }
 
-    // Indirect Buffer
+    // Ray List
     {
-        dw::vk::DescriptorSetLayout::Desc desc;
+        m_screen_space.ray_list_ds = backend->allocate_descriptor_set(m_screen_space.ray_list_ds_layout);
+        m_screen_space.ray_list_ds->set_name("Reflections Ray List");
+    }
 
-        desc.add_binding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
-        desc.add_binding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
-        desc.add_binding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
-        desc.add_binding(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+    // Tile List
+    {
+        m_adaptive_rays.tile_list_ds = backend->allocate_descriptor_set(m_adaptive_rays.tile_list_ds_layout);
+        m_adaptive_rays.tile_list_ds->set_name("Reflections Adaptive Tile List");
+    }
 
-        m_temporal_accumulation.indirect_buffer_ds_layout = dw::vk::DescriptorSetLayout::create(backend, desc);
+    // Reprojection
+    for (int i = 0; i < 2; i++)
+    {
+        m_temporal_accumulation.output_only_read_ds[i] = backend->allocate_descriptor_set(m_common_resources->combined_sampler_ds_layout);
+    }
 
+    // Indirect Buffer
+    {
         m_temporal_accumulation.indirect_buffer_ds = backend->allocate_descriptor_set(m_temporal_accumulation.indirect_buffer_ds_layout);
         m_temporal_accumulation.indirect_buffer_ds->set_name("Temporal Accumulation Indirect Buffer");
     }
 
     // A-Trous
-    for (int i = 0; i < 2; i++)
     {
-        m_a_trous.read_ds[i]  = backend->allocate_descriptor_set(m_common_resources->combined_sampler_ds_layout);
-        m_a_trous.write_ds[i] = backend->allocate_descriptor_set(m_common_resources->storage_image_ds_layout);
+        m_a_trous.read_ds = backend->allocate_descriptor_set(m_common_resources->combined_sampler_ds_layout);
+        m_a_trous.read_ds->set_name("Reflections A-Trous Read");
+
+        m_a_trous.write_ds = backend->allocate_descriptor_set(m_common_resources->storage_image_ds_layout);
+        m_a_trous.write_ds->set_name("Reflections A-Trous Write");
     }
 
     // Upsample
     {
-        m_upsample.write_ds = backend->allocate_descriptor_set(m_common_resources->storage_image_ds_layout);
-        m_upsample.write_ds->set_name("Reflections Upsample Write");
-
         m_upsample.read_ds = backend->allocate_descriptor_set(m_common_resources->combined_sampler_ds_layout);
         m_upsample.read_ds->set_name("Reflections Upsample Read");
     }
@@ -414,109 +625,95 @@ void RayTracedReflections::write_descriptor_sets()
         vkUpdateDescriptorSets(backend->device(), write_datas.size(), write_datas.data(), 0, nullptr);
     }
 
-    // Reprojection Current Write
-    for (int i = 0; i < 2; i++)
+    // Indirect Buffer
     {
-        std::vector<VkDescriptorImageInfo> image_infos;
-        std::vector<VkWriteDescriptorSet>  write_datas;
-        VkWriteDescriptorSet               write_data;
+        std::vector<VkDescriptorBufferInfo> buffer_infos;
+        std::vector<VkWriteDescriptorSet>   write_datas;
+        VkWriteDescriptorSet                write_data;
 
-        image_infos.reserve(2);
-        write_datas.reserve(2);
+        buffer_infos.reserve(4);
+        write_datas.reserve(4);
 
         {
-            VkDescriptorImageInfo storage_image_info;
+            VkDescriptorBufferInfo buffer_info;
 
-            storage_image_info.sampler     = VK_NULL_HANDLE;
-            storage_image_info.imageView   = m_temporal_accumulation.current_output_view[i]->handle();
-            storage_image_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+            buffer_info.range  = m_temporal_accumulation.denoise_tile_coords_buffer->size();
+            buffer_info.offset = 0;
+            buffer_info.buffer = m_temporal_accumulation.denoise_tile_coords_buffer->handle();
 
-            image_infos.push_back(storage_image_info);
+            buffer_infos.push_back(buffer_info);
 
             DW_ZERO_MEMORY(write_data);
 
             write_data.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
             write_data.descriptorCount = 1;
-            write_data.descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
-            write_data.pImageInfo      = &image_infos.back();
+            write_data.descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            write_data.pBufferInfo     = &buffer_infos.back();
             write_data.dstBinding      = 0;
-            write_data.dstSet          = m_temporal_accumulation.current_write_ds[i]->handle();
+            write_data.dstSet          = m_temporal_accumulation.indirect_buffer_ds->handle();
 
             write_datas.push_back(write_data);
         }
 
         {
-            VkDescriptorImageInfo storage_image_info;
+            VkDescriptorBufferInfo buffer_info;
 
-            storage_image_info.sampler     = VK_NULL_HANDLE;
-            storage_image_info.imageView   = m_temporal_accumulation.current_moments_view[i]->handle();
-            storage_image_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+            buffer_info.range  = m_temporal_accumulation.denoise_dispatch_args_buffer->size();
+            buffer_info.offset = 0;
+            buffer_info.buffer = m_temporal_accumulation.denoise_dispatch_args_buffer->handle();
 
-            image_infos.push_back(storage_image_info);
+            buffer_infos.push_back(buffer_info);
 
             DW_ZERO_MEMORY(write_data);
 
             write_data.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
             write_data.descriptorCount = 1;
-            write_data.descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
-            write_data.pImageInfo      = &image_infos.back();
+            write_data.descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            write_data.pBufferInfo     = &buffer_infos.back();
             write_data.dstBinding      = 1;
-            write_data.dstSet          = m_temporal_accumulation.current_write_ds[i]->handle();
+            write_data.dstSet          = m_temporal_accumulation.indirect_buffer_ds->handle();
 
             write_datas.push_back(write_data);
         }
 
-        vkUpdateDescriptorSets(backend->device(), write_datas.size(), write_datas.data(), 0, nullptr);
-    }
-
-    // Reprojection Current Read
-    for (int i = 0; i < 2; i++)
-    {
-        std::vector<VkDescriptorImageInfo> image_infos;
-        std::vector<VkWriteDescriptorSet>  write_datas;
-        VkWriteDescriptorSet               write_data;
-
-        image_infos.reserve(2);
-        write_datas.reserve(2);
-
         {
-            VkDescriptorImageInfo sampler_image_info;
+            VkDescriptorBufferInfo buffer_info;
 
-            sampler_image_info.sampler     = backend->nearest_sampler()->handle();
-            sampler_image_info.imageView   = m_temporal_accumulation.current_output_view[i]->handle();
-            sampler_image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+            buffer_info.range  = m_temporal_accumulation.copy_tile_coords_buffer->size();
+            buffer_info.offset = 0;
+            buffer_info.buffer = m_temporal_accumulation.copy_tile_coords_buffer->handle();
 
-            image_infos.push_back(sampler_image_info);
+            buffer_infos.push_back(buffer_info);
 
             DW_ZERO_MEMORY(write_data);
 
             write_data.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
             write_data.descriptorCount = 1;
-            write_data.descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-            write_data.pImageInfo      = &image_infos.back();
-            write_data.dstBinding      = 0;
-            write_data.dstSet          = m_temporal_accumulation.current_read_ds[i]->handle();
+            write_data.descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            write_data.pBufferInfo     = &buffer_infos.back();
+            write_data.dstBinding      = 2;
+            write_data.dstSet          = m_temporal_accumulation.indirect_buffer_ds->handle();
 
             write_datas.push_back(write_data);
         }
 
         {
-            VkDescriptorImageInfo sampler_image_info;
+            VkDescriptorBufferInfo buffer_info;
 
-            sampler_image_info.sampler     = backend->nearest_sampler()->handle();
-            sampler_image_info.imageView   = m_temporal_accumulation.current_moments_view[i]->handle();
-            sampler_image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+            buffer_info.range  = m_temporal_accumulation.copy_dispatch_args_buffer->size();
+            buffer_info.offset = 0;
+            buffer_info.buffer = m_temporal_accumulation.copy_dispatch_args_buffer->handle();
 
-            image_infos.push_back(sampler_image_info);
+            buffer_infos.push_back(buffer_info);
 
             DW_ZERO_MEMORY(write_data);
 
             write_data.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
             write_data.descriptorCount = 1;
-            write_data.descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-            write_data.pImageInfo      = &image_infos.back();
-            write_data.dstBinding      = 1;
-            write_data.dstSet          = m_temporal_accumulation.current_read_ds[i]->handle();
+            write_data.descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            write_data.pBufferInfo     = &buffer_infos.back();
+            write_data.dstBinding      = 3;
+            write_data.dstSet          = m_temporal_accumulation.indirect_buffer_ds->handle();
 
             write_datas.push_back(write_data);
         }
@@ -524,54 +721,42 @@ void RayTracedReflections::write_descriptor_sets()
         vkUpdateDescriptorSets(backend->device(), write_datas.size(), write_datas.data(), 0, nullptr);
     }
 
-    // Reprojection Prev Read
-    for (int i = 0; i < 2; i++)
+    // Ray List
     {
-        std::vector<VkDescriptorImageInfo> image_infos;
-        std::vector<VkWriteDescriptorSet>  write_datas;
-        VkWriteDescriptorSet               write_data;
-
-        image_infos.reserve(2);
-        write_datas.reserve(2);
-
-        {
-            VkDescriptorImageInfo sampler_image_info;
-
-            sampler_image_info.sampler     = backend->nearest_sampler()->handle();
-            sampler_image_info.imageView   = m_temporal_accumulation.prev_view->handle();
-            sampler_image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-
-            image_infos.push_back(sampler_image_info);
-
-            DW_ZERO_MEMORY(write_data);
+        std::vector<VkDescriptorBufferInfo> buffer_infos;
+        std::vector<VkWriteDescriptorSet>   write_datas;
+        VkWriteDescriptorSet                write_data;
 
-            write_data.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            write_data.descriptorCount = 1;
-            write_data.descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-            write_data.pImageInfo      = &image_infos.back();
-            write_data.dstBinding      = 0;
-            write_data.dstSet          = m_temporal_accumulation.prev_read_ds[i]->handle();
+        buffer_infos.reserve(6);
+        write_datas.reserve(6);
 
-            write_datas.push_back(write_data);
-        }
+        dw::vk::Buffer::Ptr buffers[] = {
+            m_screen_space.ray_list_args_buffer,
+            m_screen_space.ray_list_coords_buffer,
+            m_ray_binning.unsorted_coords_buffer,
+            m_ray_binning.bins_buffer,
+            m_ray_binning.bin_counts_buffer,
+            m_ray_binning.scatter_dispatch_args_buffer
+        };
 
+        for (int i = 0; i < 6; i++)
         {
-            VkDescriptorImageInfo sampler_image_info;
+            VkDescriptorBufferInfo buffer_info;
 
-            sampler_image_info.sampler     = backend->nearest_sampler()->handle();
-            sampler_image_info.imageView   = m_temporal_accumulation.current_moments_view[i]->handle();
-            sampler_image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+            buffer_info.range  = buffers[i]->size();
+            buffer_info.offset = 0;
+            buffer_info.buffer = buffers[i]->handle();
 
-            image_infos.push_back(sampler_image_info);
+            buffer_infos.push_back(buffer_info);
 
             DW_ZERO_MEMORY(write_data);
 
             write_data.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
             write_data.descriptorCount = 1;
-            write_data.descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-            write_data.pImageInfo      = &image_infos.back();
-            write_data.dstBinding      = 1;
-            write_data.dstSet          = m_temporal_accumulation.prev_read_ds[i]->handle();
+            write_data.descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            write_data.pBufferInfo     = &buffer_infos.back();
+            write_data.dstBinding      = i;
+            write_data.dstSet          = m_screen_space.ray_list_ds->handle();
 
             write_datas.push_back(write_data);
         }
@@ -579,7 +764,7 @@ void RayTracedReflections::write_descriptor_sets()
         vkUpdateDescriptorSets(backend->device(), write_datas.size(), write_datas.data(), 0, nullptr);
     }
 
-    // Indirect Buffer
+    // Tile List
     {
         std::vector<VkDescriptorBufferInfo> buffer_infos;
         std::vector<VkWriteDescriptorSet>   write_datas;
@@ -588,75 +773,20 @@ void RayTracedReflections::write_descriptor_sets()
         buffer_infos.reserve(4);
         write_datas.reserve(4);
 
-        {
-            VkDescriptorBufferInfo buffer_info;
-
-            buffer_info.range  = m_temporal_accumulation.denoise_tile_coords_buffer->size();
-            buffer_info.offset = 0;
-            buffer_info.buffer = m_temporal_accumulation.denoise_tile_coords_buffer->handle();
-
-            buffer_infos.push_back(buffer_info);
-
-            DW_ZERO_MEMORY(write_data);
-
-            write_data.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            write_data.descriptorCount = 1;
-            write_data.descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-            write_data.pBufferInfo     = &buffer_infos.back();
-            write_data.dstBinding      = 0;
-            write_data.dstSet          = m_temporal_accumulation.indirect_buffer_ds->handle();
-
-            write_datas.push_back(write_data);
-        }
-
-        {
-            VkDescriptorBufferInfo buffer_info;
-
-            buffer_info.range  = m_temporal_accumulation.denoise_dispatch_args_buffer->size();
-            buffer_info.offset = 0;
-            buffer_info.buffer = m_temporal_accumulation.denoise_dispatch_args_buffer->handle();
-
-            buffer_infos.push_back(buffer_info);
-
-            DW_ZERO_MEMORY(write_data);
-
-            write_data.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            write_data.descriptorCount = 1;
-            write_data.descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-            write_data.pBufferInfo     = &buffer_infos.back();
-            write_data.dstBinding      = 1;
-            write_data.dstSet          = m_temporal_accumulation.indirect_buffer_ds->handle();
-
-            write_datas.push_back(write_data);
-        }
-
-        {
-            VkDescriptorBufferInfo buffer_info;
-
-            buffer_info.range  = m_temporal_accumulation.copy_tile_coords_buffer->size();
-            buffer_info.offset = 0;
-            buffer_info.buffer = m_temporal_accumulation.copy_tile_coords_buffer->handle();
-
-            buffer_infos.push_back(buffer_info);
-
-            DW_ZERO_MEMORY(write_data);
-
-            write_data.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            write_data.descriptorCount = 1;
-            write_data.descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-            write_data.pBufferInfo     = &buffer_infos.back();
-            write_data.dstBinding      = 2;
-            write_data.dstSet          = m_temporal_accumulation.indirect_buffer_ds->handle();
-
-            write_datas.push_back(write_data);
-        }
+        dw::vk::Buffer::Ptr buffers[] = {
+            m_adaptive_rays.trace_tile_coords_buffer,
+            m_adaptive_rays.trace_dispatch_args_buffer,
+            m_adaptive_rays.reconstruct_tile_coords_buffer,
+            m_adaptive_rays.reconstruct_dispatch_args_buffer
+        };
 
+        for (int i = 0; i < 4; i++)
         {
             VkDescriptorBufferInfo buffer_info;
 
-            buffer_info.range  = m_temporal_accumulation.copy_dispatch_args_buffer->size();
+            buffer_info.range  = buffers[i]->size();
             buffer_info.offset = 0;
-            buffer_info.buffer = m_temporal_accumulation.copy_dispatch_args_buffer->handle();
+            buffer_info.buffer = buffers[i]->handle();
 
             buffer_infos.push_back(buffer_info);
 
@@ -666,8 +796,8 @@ void RayTracedReflections::write_descriptor_sets()
             write_data.descriptorCount = 1;
             write_data.descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
             write_data.pBufferInfo     = &buffer_infos.back();
-            write_data.dstBinding      = 3;
-            write_data.dstSet          = m_temporal_accumulation.indirect_buffer_ds->handle();
+            write_data.dstBinding      = i;
+            write_data.dstSet          = m_adaptive_rays.tile_list_ds->handle();
 
             write_datas.push_back(write_data);
         }
@@ -681,15 +811,14 @@ void RayTracedReflections::write_descriptor_sets()
         std::vector<VkWriteDescriptorSet>  write_datas;
         VkWriteDescriptorSet               write_data;
 
-        image_infos.reserve(2);
-        write_datas.reserve(2);
+        image_infos.reserve(1);
+        write_datas.reserve(1);
 
-        for (int i = 0; i < 2; i++)
         {
             VkDescriptorImageInfo storage_image_info;
 
             storage_image_info.sampler     = VK_NULL_HANDLE;
-            storage_image_info.imageView   = m_a_trous.view[i]->handle();
+            storage_image_info.imageView   = m_a_trous.view->handle();
             storage_image_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
 
             image_infos.push_back(storage_image_info);
@@ -701,7 +830,7 @@ void RayTracedReflections::write_descriptor_sets()
             write_data.descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
             write_data.pImageInfo      = &image_infos.back();
             write_data.dstBinding      = 0;
-            write_data.dstSet          = m_a_trous.write_ds[i]->handle();
+            write_data.dstSet          = m_a_trous.write_ds->handle();
 
             write_datas.push_back(write_data);
         }
@@ -714,15 +843,14 @@ void RayTracedReflections::write_descriptor_sets()
         std::vector<VkWriteDescriptorSet>  write_datas;
         VkWriteDescriptorSet               write_data;
 
-        image_infos.reserve(2);
-        write_datas.reserve(2);
+        image_infos.reserve(1);
+        write_datas.reserve(1);
 
-        for (int i = 0; i < 2; i++)
         {
             VkDescriptorImageInfo sampler_image_info;
 
             sampler_image_info.sampler     = backend->nearest_sampler()->handle();
-            sampler_image_info.imageView   = m_a_trous.view[i]->handle();
+            sampler_image_info.imageView   = m_a_trous.view->handle();
             sampler_image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
             image_infos.push_back(sampler_image_info);
@@ -734,7 +862,7 @@ void RayTracedReflections::write_descriptor_sets()
             write_data.descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
             write_data.pImageInfo      = &image_infos.back();
             write_data.dstBinding      = 0;
-            write_data.dstSet          = m_a_trous.read_ds[i]->handle();
+            write_data.dstSet          = m_a_trous.read_ds->handle();
 
             write_datas.push_back(write_data);
         }
@@ -742,51 +870,47 @@ void RayTracedReflections::write_descriptor_sets()
         vkUpdateDescriptorSets(backend->device(), write_datas.size(), write_datas.data(), 0, nullptr);
     }
 
-    // Upsample
+    // Upsample read
     {
-        // write
-        {
-            VkDescriptorImageInfo storage_image_info;
-
-            storage_image_info.sampler     = VK_NULL_HANDLE;
-            storage_image_info.imageView   = m_upsample.image_view->handle();
-            storage_image_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+        VkDescriptorImageInfo sampler_image_info;
 
-            VkWriteDescriptorSet write_data;
+        sampler_image_info.sampler     = backend->nearest_sampler()->handle();
+        sampler_image_info.imageView   = m_upsample.image_view->handle();
+        sampler_image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
-            DW_ZERO_MEMORY(write_data);
+        VkWriteDescriptorSet write_data;
 
-            write_data.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            write_data.descriptorCount = 1;
-            write_data.descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
-            write_data.pImageInfo      = &storage_image_info;
-            write_data.dstBinding      = 0;
-            write_data.dstSet          = m_upsample.write_ds->handle();
+        DW_ZERO_MEMORY(write_data);
 
-            vkUpdateDescriptorSets(backend->device(), 1, &write_data, 0, nullptr);
-        }
+        write_data.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write_data.descriptorCount = 1;
+        write_data.descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        write_data.pImageInfo      = &sampler_image_info;
+        write_data.dstBinding      = 0;
+        write_data.dstSet          = m_upsample.read_ds->handle();
 
-        // read
-        {
-            VkDescriptorImageInfo sampler_image_info;
+        vkUpdateDescriptorSets(backend->device(), 1, &write_data, 0, nullptr);
+    }
 
-            sampler_image_info.sampler     = backend->nearest_sampler()->handle();
-            sampler_image_info.imageView   = m_upsample.image_view->handle();
-            sampler_image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    // Bindless, for the passes that index their images instead of binding sets.
+    {
+        BindlessHeap* bindless_heap = m_common_resources->bindless_heap.get();
 
-            VkWriteDescriptorSet write_data;
+        m_ray_trace.write_idx = bindless_heap->register_storage_image(m_ray_trace.view);
+        m_ray_trace.read_idx  = bindless_heap->register_sampled_image(m_ray_trace.view, backend->nearest_sampler());
 
-            DW_ZERO_MEMORY(write_data);
+        for (int i = 0; i < 2; i++)
+        {
+            m_temporal_accumulation.current_output_write_idx[i]  = bindless_heap->register_storage_image(m_temporal_accumulation.current_output_view[i]);
+            m_temporal_accumulation.current_output_read_idx[i]   = bindless_heap->register_sampled_image(m_temporal_accumulation.current_output_view[i], backend->nearest_sampler());
+            m_temporal_accumulation.current_moments_write_idx[i] = bindless_heap->register_storage_image(m_temporal_accumulation.current_moments_view[i]);
+            m_temporal_accumulation.current_moments_read_idx[i]  = bindless_heap->register_sampled_image(m_temporal_accumulation.current_moments_view[i], backend->nearest_sampler());
+        }
 
-            write_data.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            write_data.descriptorCount = 1;
-            write_data.descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-            write_data.pImageInfo      = &sampler_image_info;
-            write_data.dstBinding      = 0;
-            write_data.dstSet          = m_upsample.read_ds->handle();
+        m_temporal_accumulation.prev_read_idx = bindless_heap->register_sampled_image(m_temporal_accumulation.prev_view, backend->nearest_sampler());
 
-            vkUpdateDescriptorSets(backend->device(), 1, &write_data, 0, nullptr);
-        }
+        m_a_trous.read_idx   = bindless_heap->register_sampled_image(m_a_trous.view, backend->nearest_sampler());
+        m_upsample.write_idx = bindless_heap->register_storage_image(m_upsample.image_view);
     }
 }
 
@@ -796,266 +920,723 @@ void RayTracedReflections::create_pipelines()
 {
     auto backend = m_backend.lock();
 
+    std::vector<PipelineCache::ComputePipelineDesc> compute_pipelines;
+
     // Ray Trace
     {
         // ---------------------------------------------------------------------------
-        // Create shader modules
+        // Create pipeline layout
+        // ---------------------------------------------------------------------------
+
+        dw::vk::PipelineLayout::Desc pl_desc;
+
+        pl_desc.add_descriptor_set_layout(m_common_resources->current_scene()->descriptor_set_layout());
+        pl_desc.add_descriptor_set_layout(m_common_resources->bindless_heap->ds_layout());
+        pl_desc.add_descriptor_set_layout(m_common_resources->per_frame_ds_layout);
+        pl_desc.add_descriptor_set_layout(m_common_resources->skybox_ds_layout);
+        pl_desc.add_descriptor_set_layout(m_common_resources->ddgi_read_ds_layout);
+        pl_desc.add_descriptor_set_layout(m_screen_space.ray_list_ds_layout);
+        pl_desc.add_descriptor_set_layout(m_common_resources->gpu_counters->ds_layout());
+        pl_desc.add_push_constant_range(VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR, 0, sizeof(RayTracePushConstants));
+
+        m_ray_trace.pipeline_layout = dw::vk::PipelineLayout::create(backend, pl_desc);
+
+        // ---------------------------------------------------------------------------
+        // Create pipeline permutations
         // ---------------------------------------------------------------------------
 
-        dw::vk::ShaderModule::Ptr rgen  = dw::vk::ShaderModule::create_from_file(backend, "shaders/reflections_ray_trace.rgen.spv");
-        dw::vk::ShaderModule::Ptr rchit = dw::vk::ShaderModule::create_from_file(backend, "shaders/reflections_ray_trace.rchit.spv");
-        dw::vk::ShaderModule::Ptr rmiss = dw::vk::ShaderModule::create_from_file(backend, "shaders/reflections_ray_trace.rmiss.spv");
+        m_ray_trace.permutations = std::unique_ptr<RayTracingPipelinePermutations>(new RayTracingPipelinePermutations(REFLECTIONS_CONSTANT_COUNT, [this](const VkSpecializationInfo* specialization_info) {
+            auto backend = m_backend.lock();
+
+            dw::vk::ShaderModule::Ptr rgen  = dw::vk::ShaderModule::create_from_file(backend, "shaders/reflections_ray_trace.rgen.spv");
+            dw::vk::ShaderModule::Ptr rchit = dw::vk::ShaderModule::create_from_file(backend, "shaders/reflections_ray_trace.rchit.spv");
+            dw::vk::ShaderModule::Ptr rmiss = dw::vk::ShaderModule::create_from_file(backend, "shaders/reflections_ray_trace.rmiss.spv");
+
+            dw::vk::ShaderBindingTable::Desc sbt_desc;
+
+            sbt_desc.add_ray_gen_group(rgen, "main");
+            sbt_desc.add_hit_group(rchit, "main");
+            sbt_desc.add_miss_group(rmiss, "main");
+
+            // Only the closest hit shader samples the GI.
+            sbt_desc.hit_stages[0].pSpecializationInfo = specialization_info;
+
+            RayTracingPermutation permutation;
 
-        dw::vk::ShaderBindingTable::Desc sbt_desc;
+            permutation.sbt = dw::vk::ShaderBindingTable::create(backend, sbt_desc);
 
-        sbt_desc.add_ray_gen_group(rgen, "main");
-        sbt_desc.add_hit_group(rchit, "main");
-        sbt_desc.add_miss_group(rmiss, "main");
+            dw::vk::RayTracingPipeline::Desc desc;
 
-        m_ray_trace.sbt = dw::vk::ShaderBindingTable::create(backend, sbt_desc);
+            desc.set_max_pipeline_ray_recursion_depth(1);
+            desc.set_shader_binding_table(permutation.sbt);
+            desc.set_pipeline_layout(m_ray_trace.pipeline_layout);
 
-        dw::vk::RayTracingPipeline::Desc desc;
+            permutation.pipeline = dw::vk::RayTracingPipeline::create(backend, desc);
 
-        desc.set_max_pipeline_ray_recursion_depth(1);
-        desc.set_shader_binding_table(m_ray_trace.sbt);
+            return permutation;
+        }));
 
         // ---------------------------------------------------------------------------
-        // Create pipeline layout
+        // Create ray query pipeline layout and permutations
         // ---------------------------------------------------------------------------
 
-        dw::vk::PipelineLayout::Desc pl_desc;
+        dw::vk::PipelineLayout::Desc rq_pl_desc;
 
-        pl_desc.add_descriptor_set_layout(m_common_resources->current_scene()->descriptor_set_layout());
-        pl_desc.add_descriptor_set_layout(m_common_resources->storage_image_ds_layout);
-        pl_desc.add_descriptor_set_layout(m_common_resources->per_frame_ds_layout);
-        pl_desc.add_descriptor_set_layout(m_g_buffer->ds_layout());
-        pl_desc.add_descriptor_set_layout(m_common_resources->skybox_ds_layout);
-        pl_desc.add_descriptor_set_layout(m_common_resources->blue_noise_ds_layout);
-        pl_desc.add_descriptor_set_layout(m_common_resources->ddgi_read_ds_layout);
-        pl_desc.add_push_constant_range(VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR, 0, sizeof(RayTracePushConstants));
+        rq_pl_desc.add_descriptor_set_layout(m_common_resources->current_scene()->descriptor_set_layout());
+        rq_pl_desc.add_descriptor_set_layout(m_common_resources->bindless_heap->ds_layout());
+        rq_pl_desc.add_descriptor_set_layout(m_common_resources->per_frame_ds_layout);
+        rq_pl_desc.add_descriptor_set_layout(m_common_resources->skybox_ds_layout);
+        rq_pl_desc.add_descriptor_set_layout(m_common_resources->ddgi_read_ds_layout);
+        rq_pl_desc.add_descriptor_set_layout(m_screen_space.ray_list_ds_layout);
+        rq_pl_desc.add_descriptor_set_layout(m_common_resources->gpu_counters->ds_layout());
+        rq_pl_desc.add_push_constant_range(VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(RayTracePushConstants));
 
-        m_ray_trace.pipeline_layout = dw::vk::PipelineLayout::create(backend, pl_desc);
+        m_ray_trace.ray_query_pipeline_layout = dw::vk::PipelineLayout::create(backend, rq_pl_desc);
+        m_ray_trace.ray_query_pipeline_layout->set_name("Reflections Ray Query Pipeline Layout");
 
-        desc.set_pipeline_layout(m_ray_trace.pipeline_layout);
+        m_ray_trace.ray_query_permutations = std::unique_ptr<ComputePipelinePermutations>(new ComputePipelinePermutations(REFLECTIONS_CONSTANT_COUNT, [this](const VkSpecializationInfo* specialization_info) {
+            CachedComputePipeline::Ptr pipeline;
 
-        m_ray_trace.pipeline = dw::vk::RayTracingPipeline::create(backend, desc);
+            m_common_resources->pipeline_cache->create_compute_pipelines({ { "shaders/reflections_ray_trace.comp.spv", m_ray_trace.ray_query_pipeline_layout, &pipeline, specialization_info } });
+
+            return pipeline;
+        }));
     }
 
-    // Reset Args
+    // Classify Tiles
     {
         dw::vk::PipelineLayout::Desc desc;
 
-        desc.add_descriptor_set_layout(m_temporal_accumulation.indirect_buffer_ds_layout);
+        desc.add_descriptor_set_layout(m_common_resources->bindless_heap->ds_layout());
+        desc.add_descriptor_set_layout(m_adaptive_rays.tile_list_ds_layout);
 
-        m_reset_args.pipeline_layout = dw::vk::PipelineLayout::create(backend, desc);
-        m_reset_args.pipeline_layout->set_name("Reset Args Pipeline Layout");
+        desc.add_push_constant_range(VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ClassifyTilesPushConstants));
 
-        dw::vk::ShaderModule::Ptr module = dw::vk::ShaderModule::create_from_file(backend, "shaders/reflections_denoise_reset_args.comp.spv");
+        m_adaptive_rays.classify_pipeline_layout = dw::vk::PipelineLayout::create(backend, desc);
+        m_adaptive_rays.classify_pipeline_layout->set_name("Reflections Classify Tiles Pipeline Layout");
 
-        dw::vk::ComputePipeline::Desc comp_desc;
+        compute_pipelines.push_back({ "shaders/reflections_classify_tiles.comp.spv", m_adaptive_rays.classify_pipeline_layout, &m_adaptive_rays.classify_pipeline });
+    }
 
-        comp_desc.set_pipeline_layout(m_reset_args.pipeline_layout);
-        comp_desc.set_shader_stage(module, "main");
+    // Reconstruct
+    {
+        dw::vk::PipelineLayout::Desc desc;
 
-        m_reset_args.pipeline = dw::vk::ComputePipeline::create(backend, comp_desc);
+        desc.add_descriptor_set_layout(m_common_resources->bindless_heap->ds_layout());
+        desc.add_descriptor_set_layout(m_adaptive_rays.tile_list_ds_layout);
+
+        desc.add_push_constant_range(VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ReconstructPushConstants));
+
+        m_adaptive_rays.reconstruct_pipeline_layout = dw::vk::PipelineLayout::create(backend, desc);
+        m_adaptive_rays.reconstruct_pipeline_layout->set_name("Reflections Reconstruct Pipeline Layout");
+
+        compute_pipelines.push_back({ "shaders/reflections_reconstruct.comp.spv", m_adaptive_rays.reconstruct_pipeline_layout, &m_adaptive_rays.reconstruct_pipeline });
     }
 
-    // Reprojection
+    // Screen Space
     {
         dw::vk::PipelineLayout::Desc desc;
 
-        desc.add_descriptor_set_layout(m_temporal_accumulation.write_ds_layout);
-        desc.add_descriptor_set_layout(m_g_buffer->ds_layout());
+        desc.add_descriptor_set_layout(m_common_resources->storage_image_ds_layout);
         desc.add_descriptor_set_layout(m_g_buffer->ds_layout());
-        desc.add_descriptor_set_layout(m_common_resources->combined_sampler_ds_layout);
-        desc.add_descriptor_set_layout(m_temporal_accumulation.read_ds_layout);
         desc.add_descriptor_set_layout(m_common_resources->per_frame_ds_layout);
-        desc.add_descriptor_set_layout(m_temporal_accumulation.indirect_buffer_ds_layout);
+        desc.add_descriptor_set_layout(m_common_resources->combined_sampler_ds_layout);
+        desc.add_descriptor_set_layout(m_common_resources->combined_sampler_ds_layout);
+        desc.add_descriptor_set_layout(m_common_resources->blue_noise_ds_layout);
+        desc.add_descriptor_set_layout(m_screen_space.ray_list_ds_layout);
+        desc.add_descriptor_set_layout(m_adaptive_rays.tile_list_ds_layout);
 
-        desc.add_push_constant_range(VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(TemporalAccumulationPushConstants));
+        desc.add_push_constant_range(VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ScreenSpacePushConstants));
 
-        m_temporal_accumulation.pipeline_layout = dw::vk::PipelineLayout::create(backend, desc);
-        m_temporal_accumulation.pipeline_layout->set_name("Reprojection Pipeline Layout");
+        m_screen_space.pipeline_layout = dw::vk::PipelineLayout::create(backend, desc);
+        m_screen_space.pipeline_layout->set_name("Reflections Screen Space Pipeline Layout");
 
-        dw::vk::ShaderModule::Ptr module = dw::vk::ShaderModule::create_from_file(backend, "shaders/reflections_denoise_reprojection.comp.spv");
+        compute_pipelines.push_back({ "shaders/reflections_ssr.comp.spv", m_screen_space.pipeline_layout, &m_screen_space.pipeline });
+    }
 
-        dw::vk::ComputePipeline::Desc comp_desc;
+    // Ray Binning
+    {
+        dw::vk::PipelineLayout::Desc desc;
+
+        desc.add_descriptor_set_layout(m_screen_space.ray_list_ds_layout);
 
-        comp_desc.set_pipeline_layout(m_temporal_accumulation.pipeline_layout);
-        comp_desc.set_shader_stage(module, "main");
+        desc.add_push_constant_range(VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(BinRaysScanPushConstants));
 
-        m_temporal_accumulation.pipeline = dw::vk::ComputePipeline::create(backend, comp_desc);
+        m_ray_binning.scan_pipeline_layout = dw::vk::PipelineLayout::create(backend, desc);
+        m_ray_binning.scan_pipeline_layout->set_name("Reflections Bin Rays Scan Pipeline Layout");
+
+        compute_pipelines.push_back({ "shaders/reflections_bin_rays_scan.comp.spv", m_ray_binning.scan_pipeline_layout, &m_ray_binning.scan_pipeline });
     }
 
-    // Copy Tiles
     {
         dw::vk::PipelineLayout::Desc desc;
 
-        desc.add_descriptor_set_layout(m_common_resources->storage_image_ds_layout);
-        desc.add_descriptor_set_layout(m_common_resources->combined_sampler_ds_layout);
-        desc.add_descriptor_set_layout(m_temporal_accumulation.indirect_buffer_ds_layout);
+        desc.add_descriptor_set_layout(m_screen_space.ray_list_ds_layout);
 
-        m_copy_tiles.pipeline_layout = dw::vk::PipelineLayout::create(backend, desc);
-        m_copy_tiles.pipeline_layout->set_name("Copy Tiles Pipeline Layout");
+        m_ray_binning.scatter_pipeline_layout = dw::vk::PipelineLayout::create(backend, desc);
+        m_ray_binning.scatter_pipeline_layout->set_name("Reflections Bin Rays Scatter Pipeline Layout");
 
-        dw::vk::ShaderModule::Ptr module = dw::vk::ShaderModule::create_from_file(backend, "shaders/reflections_denoise_copy_tiles.comp.spv");
+        compute_pipelines.push_back({ "shaders/reflections_bin_rays_scatter.comp.spv", m_ray_binning.scatter_pipeline_layout, &m_ray_binning.scatter_pipeline });
+    }
 
-        dw::vk::ComputePipeline::Desc comp_desc;
+    // Reset Args
+    {
+        dw::vk::PipelineLayout::Desc desc;
 
-        comp_desc.set_pipeline_layout(m_copy_tiles.pipeline_layout);
-        comp_desc.set_shader_stage(module, "main");
+        desc.add_descriptor_set_layout(m_temporal_accumulation.indirect_buffer_ds_layout);
 
-        m_copy_tiles.pipeline = dw::vk::ComputePipeline::create(backend, comp_desc);
+        m_reset_args.pipeline_layout = dw::vk::PipelineLayout::create(backend, desc);
+        m_reset_args.pipeline_layout->set_name("Reset Args Pipeline Layout");
+
+        compute_pipelines.push_back({ "shaders/reflections_denoise_reset_args.comp.spv", m_reset_args.pipeline_layout, &m_reset_args.pipeline });
     }
 
-    // A-Trous Filter
+    // Reprojection
     {
         dw::vk::PipelineLayout::Desc desc;
 
-        desc.add_descriptor_set_layout(m_common_resources->storage_image_ds_layout);
-        desc.add_descriptor_set_layout(m_common_resources->combined_sampler_ds_layout);
-        desc.add_descriptor_set_layout(m_g_buffer->ds_layout());
+        desc.add_descriptor_set_layout(m_common_resources->bindless_heap->ds_layout());
+        desc.add_descriptor_set_layout(m_common_resources->per_frame_ds_layout);
         desc.add_descriptor_set_layout(m_temporal_accumulation.indirect_buffer_ds_layout);
 
-        desc.add_push_constant_range(VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ATrousFilterPushConstants));
+        desc.add_push_constant_range(VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(TemporalAccumulationPushConstants));
 
-        m_a_trous.pipeline_layout = dw::vk::PipelineLayout::create(backend, desc);
-        m_a_trous.pipeline_layout->set_name("A-Trous Pipeline Layout");
+        m_temporal_accumulation.pipeline_layout = dw::vk::PipelineLayout::create(backend, desc);
+        m_temporal_accumulation.pipeline_layout->set_name("Reprojection Pipeline Layout");
 
-        dw::vk::ShaderModule::Ptr module = dw::vk::ShaderModule::create_from_file(backend, "shaders/reflections_denoise_atrous.comp.spv");
+        compute_pipelines.push_back({ "shaders/reflections_denoise_reprojection.comp.spv", m_temporal_accumulation.pipeline_layout, &m_temporal_accumulation.pipeline });
+    }
 
-        dw::vk::ComputePipeline::Desc comp_desc;
+    // Copy Tiles
+    {
+        dw::vk::PipelineLayout::Desc desc;
 
-        comp_desc.set_pipeline_layout(m_a_trous.pipeline_layout);
-        comp_desc.set_shader_stage(module, "main");
+        desc.add_descriptor_set_layout(m_common_resources->storage_image_ds_layout);
+        desc.add_descriptor_set_layout(m_common_resources->combined_sampler_ds_layout);
+        desc.add_descriptor_set_layout(m_temporal_accumulation.indirect_buffer_ds_layout);
 
-        m_a_trous.pipeline = dw::vk::ComputePipeline::create(backend, comp_desc);
+        m_copy_tiles.pipeline_layout = dw::vk::PipelineLayout::create(backend, desc);
+        m_copy_tiles.pipeline_layout->set_name("Copy Tiles Pipeline Layout");
+
+        compute_pipelines.push_back({ "shaders/reflections_denoise_copy_tiles.comp.spv", m_copy_tiles.pipeline_layout, &m_copy_tiles.pipeline });
     }
 
+    // A-Trous Filter
+    m_a_trous.denoiser = std::unique_ptr<SVGFDenoiser>(new SVGFDenoiser(m_backend, m_common_resources, m_g_buffer, SVGFDenoiser::SIGNAL_TYPE_RADIANCE, m_temporal_accumulation.indirect_buffer_ds_layout));
+
     // Upsample
     {
         dw::vk::PipelineLayout::Desc desc;
 
-        desc.add_descriptor_set_layout(m_common_resources->storage_image_ds_layout);
-        desc.add_descriptor_set_layout(m_common_resources->combined_sampler_ds_layout);
-        desc.add_descriptor_set_layout(m_g_buffer->ds_layout());
+        desc.add_descriptor_set_layout(m_common_resources->bindless_heap->ds_layout());
 
         desc.add_push_constant_range(VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(UpsamplePushConstants));
 
         m_upsample.layout = dw::vk::PipelineLayout::create(backend, desc);
         m_upsample.layout->set_name("Reflections Upsample Pipeline Layout");
 
-        dw::vk::ShaderModule::Ptr module = dw::vk::ShaderModule::create_from_file(backend, "shaders/reflections_upsample.comp.spv");
+        m_upsample.permutations = std::unique_ptr<ComputePipelinePermutations>(new ComputePipelinePermutations(REFLECTIONS_UPSAMPLE_CONSTANT_COUNT, [this](const VkSpecializationInfo* specialization_info) {
+            CachedComputePipeline::Ptr pipeline;
+
+            m_common_resources->pipeline_cache->create_compute_pipelines({ { "shaders/reflections_upsample.comp.spv", m_upsample.layout, &pipeline, specialization_info } });
+
+            return pipeline;
+        }));
+    }
+
+    m_common_resources->pipeline_cache->create_compute_pipelines(compute_pipelines);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void RayTracedReflections::retire_resources()
+{
+    DeletionQueue* deletion_queue = m_common_resources->deletion_queue.get();
+    BindlessHeap*  bindless_heap  = m_common_resources->bindless_heap.get();
+
+    deletion_queue->push({ m_ray_trace.image, m_ray_trace.view, m_ray_trace.write_ds, m_ray_trace.read_ds });
+
+    bindless_heap->release_storage_image(m_ray_trace.write_idx);
+    bindless_heap->release_sampled_image(m_ray_trace.read_idx);
 
-        dw::vk::ComputePipeline::Desc comp_desc;
+    deletion_queue->push({ m_screen_space.ray_list_args_buffer, m_screen_space.ray_list_coords_buffer, m_screen_space.readback_buffer, m_screen_space.ray_list_ds });
 
-        comp_desc.set_pipeline_layout(m_upsample.layout);
-        comp_desc.set_shader_stage(module, "main");
+    deletion_queue->push({ m_ray_binning.unsorted_coords_buffer, m_ray_binning.bins_buffer, m_ray_binning.bin_counts_buffer, m_ray_binning.scatter_dispatch_args_buffer });
 
-        m_upsample.pipeline = dw::vk::ComputePipeline::create(backend, comp_desc);
+    deletion_queue->push({ m_adaptive_rays.trace_tile_coords_buffer,
+                           m_adaptive_rays.trace_dispatch_args_buffer,
+                           m_adaptive_rays.reconstruct_tile_coords_buffer,
+                           m_adaptive_rays.reconstruct_dispatch_args_buffer,
+                           m_adaptive_rays.tile_list_ds });
+
+    deletion_queue->push({ m_temporal_accumulation.denoise_tile_coords_buffer,
+                           m_temporal_accumulation.denoise_dispatch_args_buffer,
+                           m_temporal_accumulation.copy_tile_coords_buffer,
+                           m_temporal_accumulation.copy_dispatch_args_buffer,
+                           m_temporal_accumulation.prev_image,
+                           m_temporal_accumulation.prev_view,
+                           m_temporal_accumulation.indirect_buffer_ds });
+
+    bindless_heap->release_sampled_image(m_temporal_accumulation.prev_read_idx);
+
+    for (int i = 0; i < 2; i++)
+    {
+        deletion_queue->push({ m_temporal_accumulation.current_output_image[i],
+                               m_temporal_accumulation.current_output_view[i],
+                               m_temporal_accumulation.current_moments_image[i],
+                               m_temporal_accumulation.current_moments_view[i],
+                               m_temporal_accumulation.output_only_read_ds[i] });
+
+        bindless_heap->release_storage_image(m_temporal_accumulation.current_output_write_idx[i]);
+        bindless_heap->release_sampled_image(m_temporal_accumulation.current_output_read_idx[i]);
+        bindless_heap->release_storage_image(m_temporal_accumulation.current_moments_write_idx[i]);
+        bindless_heap->release_sampled_image(m_temporal_accumulation.current_moments_read_idx[i]);
     }
+
+    deletion_queue->push({ m_a_trous.image, m_a_trous.view, m_a_trous.read_ds, m_a_trous.write_ds });
+
+    bindless_heap->release_sampled_image(m_a_trous.read_idx);
+
+    deletion_queue->push({ m_upsample.image, m_upsample.image_view, m_upsample.read_ds });
+
+    bindless_heap->release_storage_image(m_upsample.write_idx);
 }
 
 // -----------------------------------------------------------------------------------------------------------------------------------
 
-void RayTracedReflections::clear_images(dw::vk::CommandBuffer::Ptr cmd_buf)
+void RayTracedReflections::setup_render_graph(DDGI* ddgi, DeferredShading* deferred_shading, bool ray_list, bool adaptive)
 {
+    const bool                 ping_pong = m_common_resources->ping_pong;
+    const VkPipelineStageFlags rt_stages = m_backend_type == RAY_TRACE_BACKEND_RAY_QUERY ? VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT : VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR;
+
+    m_graph->begin(m_queue_type);
+
+    m_graph_resources.ray_trace   = m_graph->import_image(m_ray_trace.image);
+    m_graph_resources.prev_output = m_graph->import_image(m_temporal_accumulation.prev_image);
+
+    for (int i = 0; i < 2; i++)
+    {
+        m_graph_resources.current_output[i]  = m_graph->import_image(m_temporal_accumulation.current_output_image[i]);
+        m_graph_resources.current_moments[i] = m_graph->import_image(m_temporal_accumulation.current_moments_image[i]);
+    }
+
+    m_graph_resources.a_trous_output          = m_graph->import_image(m_a_trous.image);
+    m_graph_resources.upsample                = m_graph->import_image(m_upsample.image);
+    m_graph_resources.ray_list_args           = m_graph->import_buffer(m_screen_space.ray_list_args_buffer);
+    m_graph_resources.ray_list_coords         = m_graph->import_buffer(m_screen_space.ray_list_coords_buffer);
+    m_graph_resources.ray_list_readback       = m_graph->import_buffer(m_screen_space.readback_buffer);
+    m_graph_resources.unsorted_coords         = m_graph->import_buffer(m_ray_binning.unsorted_coords_buffer);
+    m_graph_resources.bins                    = m_graph->import_buffer(m_ray_binning.bins_buffer);
+    m_graph_resources.bin_counts              = m_graph->import_buffer(m_ray_binning.bin_counts_buffer);
+    m_graph_resources.scatter_dispatch        = m_graph->import_buffer(m_ray_binning.scatter_dispatch_args_buffer);
+    m_graph_resources.trace_tile_coords       = m_graph->import_buffer(m_adaptive_rays.trace_tile_coords_buffer);
+    m_graph_resources.trace_dispatch          = m_graph->import_buffer(m_adaptive_rays.trace_dispatch_args_buffer);
+    m_graph_resources.reconstruct_tile_coords = m_graph->import_buffer(m_adaptive_rays.reconstruct_tile_coords_buffer);
+    m_graph_resources.reconstruct_dispatch    = m_graph->import_buffer(m_adaptive_rays.reconstruct_dispatch_args_buffer);
+    m_graph_resources.denoise_tile_coords     = m_graph->import_buffer(m_temporal_accumulation.denoise_tile_coords_buffer);
+    m_graph_resources.denoise_dispatch        = m_graph->import_buffer(m_temporal_accumulation.denoise_dispatch_args_buffer);
+    m_graph_resources.copy_tile_coords        = m_graph->import_buffer(m_temporal_accumulation.copy_tile_coords_buffer);
+    m_graph_resources.copy_dispatch           = m_graph->import_buffer(m_temporal_accumulation.copy_dispatch_args_buffer);
+
+    // The history read by the tile classification and the reprojection of this frame.
+    const RenderGraph::ImageHandle history = m_temporal_accumulation.blur_as_input ? m_graph_resources.prev_output : m_graph_resources.current_output[!ping_pong];
+
     if (m_first_frame)
     {
-        VkImageSubresourceRange subresource_range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
-
-        VkClearColorValue color;
-
-        color.float32[0] = 0.0f;
-        color.float32[1] = 0.0f;
-        color.float32[2] = 0.0f;
-        color.float32[3] = 0.0f;
-
-        dw::vk::utilities::set_image_layout(
-            cmd_buf->handle(),
-            m_temporal_accumulation.prev_image->handle(),
-            VK_IMAGE_LAYOUT_UNDEFINED,
-            VK_IMAGE_LAYOUT_GENERAL,
-            subresource_range);
-
-        dw::vk::utilities::set_image_layout(
-            cmd_buf->handle(),
-            m_temporal_accumulation.current_output_image[!m_common_resources->ping_pong]->handle(),
-            VK_IMAGE_LAYOUT_UNDEFINED,
-            VK_IMAGE_LAYOUT_GENERAL,
-            subresource_range);
-
-        dw::vk::utilities::set_image_layout(
-            cmd_buf->handle(),
-            m_temporal_accumulation.current_moments_image[!m_common_resources->ping_pong]->handle(),
-            VK_IMAGE_LAYOUT_UNDEFINED,
-            VK_IMAGE_LAYOUT_GENERAL,
-            subresource_range);
-
-        vkCmdClearColorImage(cmd_buf->handle(), m_temporal_accumulation.prev_image->handle(), VK_IMAGE_LAYOUT_GENERAL, &color, 1, &subresource_range);
-        vkCmdClearColorImage(cmd_buf->handle(), m_temporal_accumulation.current_output_image[!m_common_resources->ping_pong]->handle(), VK_IMAGE_LAYOUT_GENERAL, &color, 1, &subresource_range);
-        vkCmdClearColorImage(cmd_buf->handle(), m_temporal_accumulation.current_moments_image[!m_common_resources->ping_pong]->handle(), VK_IMAGE_LAYOUT_GENERAL, &color, 1, &subresource_range);
-
-        dw::vk::utilities::set_image_layout(
-            cmd_buf->handle(),
-            m_temporal_accumulation.prev_image->handle(),
-            VK_IMAGE_LAYOUT_GENERAL,
-            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-            subresource_range);
-
-        dw::vk::utilities::set_image_layout(
-            cmd_buf->handle(),
-            m_temporal_accumulation.current_output_image[!m_common_resources->ping_pong]->handle(),
-            VK_IMAGE_LAYOUT_GENERAL,
-            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-            subresource_range);
-
-        dw::vk::utilities::set_image_layout(
-            cmd_buf->handle(),
-            m_temporal_accumulation.current_moments_image[!m_common_resources->ping_pong]->handle(),
-            VK_IMAGE_LAYOUT_GENERAL,
-            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-            subresource_range);
+        m_graph->add_pass("Clear History", nullptr)
+            .clear(m_graph_resources.prev_output, glm::vec4(0.0f), RESOURCE_USAGE_SAMPLED)
+            .clear(m_graph_resources.current_output[!ping_pong], glm::vec4(0.0f), RESOURCE_USAGE_SAMPLED)
+            .clear(m_graph_resources.current_moments[!ping_pong], glm::vec4(0.0f), RESOURCE_USAGE_SAMPLED);
 
         m_first_frame = false;
     }
+
+    if (ray_list)
+    {
+        {
+            auto pass = m_graph->add_pass("Reset Ray List", [this](dw::vk::CommandBuffer::Ptr cmd_buf) { reset_ray_list(cmd_buf); });
+
+            pass.write_buffer(m_graph_resources.ray_list_args, RESOURCE_USAGE_TRANSFER_DST)
+                .write_buffer(m_graph_resources.trace_dispatch, RESOURCE_USAGE_TRANSFER_DST)
+                .write_buffer(m_graph_resources.reconstruct_dispatch, RESOURCE_USAGE_TRANSFER_DST);
+
+            if (m_ray_binning.enabled)
+                pass.write_buffer(m_graph_resources.bin_counts, RESOURCE_USAGE_TRANSFER_DST);
+        }
+
+        if (adaptive)
+        {
+            m_graph->add_pass("Classify Tiles", [this](dw::vk::CommandBuffer::Ptr cmd_buf) { classify_tiles(cmd_buf); })
+                .read(history)
+                .read(m_graph_resources.current_moments[!ping_pong])
+                .write(m_graph_resources.ray_trace)
+                .write_buffer(m_graph_resources.trace_tile_coords)
+                .write_buffer(m_graph_resources.trace_dispatch, RESOURCE_USAGE_STORAGE_READ_WRITE)
+                .write_buffer(m_graph_resources.reconstruct_tile_coords)
+                .write_buffer(m_graph_resources.reconstruct_dispatch, RESOURCE_USAGE_STORAGE_READ_WRITE);
+        }
+
+        {
+            auto pass = m_graph->add_pass("Screen Space Trace", [this, deferred_shading, adaptive](dw::vk::CommandBuffer::Ptr cmd_buf) { screen_space_trace(cmd_buf, deferred_shading, adaptive); });
+
+            pass.write(m_graph_resources.ray_trace)
+                .write_buffer(m_graph_resources.ray_list_args, RESOURCE_USAGE_STORAGE_READ_WRITE)
+                .write_buffer(m_graph_resources.ray_list_coords);
+
+            if (adaptive)
+            {
+                pass.read_buffer(m_graph_resources.trace_tile_coords)
+                    .read_buffer(m_graph_resources.trace_dispatch, RESOURCE_USAGE_INDIRECT_ARGUMENTS);
+            }
+
+            if (m_ray_binning.enabled)
+            {
+                pass.write_buffer(m_graph_resources.unsorted_coords)
+                    .write_buffer(m_graph_resources.bins)
+                    .write_buffer(m_graph_resources.bin_counts, RESOURCE_USAGE_STORAGE_READ_WRITE);
+            }
+        }
+
+        m_graph->add_pass("Ray List Readback", [this](dw::vk::CommandBuffer::Ptr cmd_buf) { read_back_ray_list(cmd_buf); })
+            .read_buffer(m_graph_resources.ray_list_args, RESOURCE_USAGE_TRANSFER_SRC)
+            .write_buffer(m_graph_resources.ray_list_readback, RESOURCE_USAGE_TRANSFER_DST);
+
+        if (m_ray_binning.enabled)
+        {
+            m_graph->add_pass("Scan Ray Bins", [this](dw::vk::CommandBuffer::Ptr cmd_buf) { scan_ray_bins(cmd_buf); })
+                .read_buffer(m_graph_resources.ray_list_args)
+                .write_buffer(m_graph_resources.bin_counts, RESOURCE_USAGE_STORAGE_READ_WRITE)
+                .write_buffer(m_graph_resources.scatter_dispatch);
+
+            m_graph->add_pass("Scatter Ray Bins", [this](dw::vk::CommandBuffer::Ptr cmd_buf) { scatter_ray_bins(cmd_buf); })
+                .read_buffer(m_graph_resources.ray_list_args)
+                .read_buffer(m_graph_resources.unsorted_coords)
+                .read_buffer(m_graph_resources.bins)
+                .read_buffer(m_graph_resources.scatter_dispatch, RESOURCE_USAGE_INDIRECT_ARGUMENTS)
+                .write_buffer(m_graph_resources.bin_counts, RESOURCE_USAGE_STORAGE_READ_WRITE)
+                .write_buffer(m_graph_resources.ray_list_coords);
+        }
+    }
+
+    {
+        auto pass = m_graph->add_pass("Ray Trace", [this, ddgi, ray_list](dw::vk::CommandBuffer::Ptr cmd_buf) { ray_trace(cmd_buf, ddgi, ray_list); });
+
+        pass.write(m_graph_resources.ray_trace, RESOURCE_USAGE_STORAGE_READ_WRITE, rt_stages);
+
+        // The screen space pass sizes the launch of the ray list as it appends to it.
+        if (ray_list)
+        {
+            pass.read_buffer(m_graph_resources.ray_list_args, RESOURCE_USAGE_INDIRECT_ARGUMENTS)
+                .read_buffer(m_graph_resources.ray_list_args, RESOURCE_USAGE_STORAGE_READ, rt_stages)
+                .read_buffer(m_graph_resources.ray_list_coords, RESOURCE_USAGE_STORAGE_READ, rt_stages);
+        }
+    }
+
+    if (adaptive)
+    {
+        m_graph->add_pass("Reconstruct", [this](dw::vk::CommandBuffer::Ptr cmd_buf) { reconstruct(cmd_buf); })
+            .write(m_graph_resources.ray_trace, RESOURCE_USAGE_STORAGE_READ_WRITE)
+            .read_buffer(m_graph_resources.reconstruct_tile_coords)
+            .read_buffer(m_graph_resources.reconstruct_dispatch, RESOURCE_USAGE_INDIRECT_ARGUMENTS);
+    }
+
+    if (m_denoise)
+    {
+        m_graph->add_pass("Reset Args", [this](dw::vk::CommandBuffer::Ptr cmd_buf) { reset_args(cmd_buf); })
+            .write_buffer(m_graph_resources.denoise_tile_coords)
+            .write_buffer(m_graph_resources.denoise_dispatch)
+            .write_buffer(m_graph_resources.copy_tile_coords)
+            .write_buffer(m_graph_resources.copy_dispatch);
+
+        m_graph->add_pass("Temporal Accumulation", [this](dw::vk::CommandBuffer::Ptr cmd_buf) { temporal_accumulation(cmd_buf); })
+            .read(m_graph_resources.ray_trace)
+            .read(history)
+            .read(m_graph_resources.current_moments[!ping_pong])
+            .write(m_graph_resources.current_output[ping_pong])
+            .write(m_graph_resources.current_moments[ping_pong])
+            .write_buffer(m_graph_resources.denoise_tile_coords)
+            .write_buffer(m_graph_resources.denoise_dispatch, RESOURCE_USAGE_STORAGE_READ_WRITE)
+            .write_buffer(m_graph_resources.copy_tile_coords)
+            .write_buffer(m_graph_resources.copy_dispatch, RESOURCE_USAGE_STORAGE_READ_WRITE);
+
+        // Passes alternate between the output image and transients so that the last one lands in the output. Every other pass
+        // gets a transient of its own, their lifetimes never overlap so the graph backs all of them with a single pooled image.
+        RenderGraph::ImageHandle input      = m_graph_resources.current_output[ping_pong];
+        const uint32_t           num_passes = m_a_trous.denoiser->num_passes();
+
+        for (uint32_t i = 0; i < num_passes; i++)
+        {
+            RenderGraph::ImageHandle output = m_graph_resources.a_trous_output;
+
+            if ((num_passes - 1 - i) % 2 == 1)
+                output = m_graph->create_image({ "Reflections A-Trous Filter", VK_FORMAT_R16G16B16A16_SFLOAT, m_width, m_height, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT });
+
+            // The copied and the filtered tiles cover the whole image, so the previous contents of the output are discarded.
+            m_graph->add_pass("A-Trous Filter " + std::to_string(i), [this, i, input, output](dw::vk::CommandBuffer::Ptr cmd_buf) { a_trous_filter(cmd_buf, i, input, output); })
+                .read(input)
+                .read_buffer(m_graph_resources.denoise_tile_coords)
+                .read_buffer(m_graph_resources.denoise_dispatch, RESOURCE_USAGE_INDIRECT_ARGUMENTS)
+                .read_buffer(m_graph_resources.copy_tile_coords)
+                .read_buffer(m_graph_resources.copy_dispatch, RESOURCE_USAGE_INDIRECT_ARGUMENTS)
+                .write(output);
+
+            if (m_a_trous.denoiser->is_feedback_pass(i) && m_temporal_accumulation.blur_as_input)
+            {
+                m_graph->add_pass("Copy Feedback", [this, output](dw::vk::CommandBuffer::Ptr cmd_buf) { copy_feedback(cmd_buf, output); })
+                    .read(output, RESOURCE_USAGE_TRANSFER_SRC)
+                    .write(m_graph_resources.prev_output, RESOURCE_USAGE_TRANSFER_DST);
+            }
+
+            input = output;
+        }
+
+        if (m_scale != RAY_TRACE_SCALE_FULL_RES)
+        {
+            m_graph->add_pass("Upsample", [this](dw::vk::CommandBuffer::Ptr cmd_buf) { upsample(cmd_buf); })
+                .read(m_graph_resources.a_trous_output)
+                .write(m_graph_resources.upsample);
+        }
+
+        {
+            auto pass = m_graph->add_pass("Counters", [this, adaptive](dw::vk::CommandBuffer::Ptr cmd_buf) { copy_counters(cmd_buf, adaptive); });
+
+            pass.read_buffer(m_graph_resources.denoise_dispatch, RESOURCE_USAGE_TRANSFER_SRC)
+                .read_buffer(m_graph_resources.copy_dispatch, RESOURCE_USAGE_TRANSFER_SRC);
+
+            if (adaptive)
+            {
+                pass.read_buffer(m_graph_resources.trace_dispatch, RESOURCE_USAGE_TRANSFER_SRC)
+                    .read_buffer(m_graph_resources.reconstruct_dispatch, RESOURCE_USAGE_TRANSFER_SRC);
+            }
+        }
+    }
+
+    // On the async compute queue the hand-off to the fragment stage happens through a semaphore.
+    m_graph->export_image(output_image(), m_queue_type == QUEUE_TYPE_GRAPHICS ? VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT : VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
 }
 
 // -----------------------------------------------------------------------------------------------------------------------------------
 
-void RayTracedReflections::ray_trace(dw::vk::CommandBuffer::Ptr cmd_buf, DDGI* ddgi)
+RenderGraph::ImageHandle RayTracedReflections::output_image()
 {
-    DW_SCOPED_SAMPLE("Ray Trace", cmd_buf);
+    if (m_denoise)
+    {
+        if (m_current_output == OUTPUT_RAY_TRACE)
+            return m_graph_resources.ray_trace;
+        else if (m_current_output == OUTPUT_TEMPORAL_ACCUMULATION)
+            return m_graph_resources.current_output[m_common_resources->ping_pong];
+        else if (m_current_output == OUTPUT_ATROUS)
+            return m_graph_resources.a_trous_output;
+        else
+        {
+            if (m_scale == RAY_TRACE_SCALE_FULL_RES)
+                return m_graph_resources.a_trous_output;
+            else
+                return m_graph_resources.upsample;
+        }
+    }
+    else
+        return m_graph_resources.ray_trace;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void RayTracedReflections::reset_ray_list(dw::vk::CommandBuffer::Ptr cmd_buf)
+{
+    DW_SCOPED_SAMPLE("Reset Ray List", cmd_buf);
+
+    const uint32_t args[]          = { 0, 1, 1, 0, 0, 1, 1, 0 };
+    const uint32_t dispatch_args[] = { 0, 1, 1 };
+
+    vkCmdUpdateBuffer(cmd_buf->handle(), m_screen_space.ray_list_args_buffer->handle(), 0, sizeof(args), args);
+    vkCmdUpdateBuffer(cmd_buf->handle(), m_adaptive_rays.trace_dispatch_args_buffer->handle(), 0, sizeof(dispatch_args), dispatch_args);
+    vkCmdUpdateBuffer(cmd_buf->handle(), m_adaptive_rays.reconstruct_dispatch_args_buffer->handle(), 0, sizeof(dispatch_args), dispatch_args);
+
+    if (m_ray_binning.enabled)
+        vkCmdFillBuffer(cmd_buf->handle(), m_ray_binning.bin_counts_buffer->handle(), 0, VK_WHOLE_SIZE, 0);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void RayTracedReflections::classify_tiles(dw::vk::CommandBuffer::Ptr cmd_buf)
+{
+    DW_SCOPED_SAMPLE("Classify Tiles", cmd_buf);
+
+    vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_adaptive_rays.classify_pipeline->handle());
+
+    const bool ping_pong = m_common_resources->ping_pong;
+
+    ClassifyTilesPushConstants push_constants;
+
+    push_constants.g_buffer                   = m_g_buffer->output_bindless_indices();
+    push_constants.num_frames                 = m_common_resources->num_frames;
+    push_constants.g_buffer_mip               = m_g_buffer_mip;
+    push_constants.quarter_rate_roughness     = m_adaptive_rays.quarter_rate_roughness;
+    push_constants.converged_variance         = m_adaptive_rays.converged_variance;
+    push_constants.converged_history_length   = m_adaptive_rays.converged_history_length;
+    push_constants.converged_refresh_interval = static_cast<uint32_t>(glm::max(m_adaptive_rays.converged_refresh_interval, 1));
+    push_constants.output_idx                 = m_ray_trace.write_idx;
+
+    // Same history that the reprojection pass of this frame is going to read.
+    push_constants.history_output_idx  = m_temporal_accumulation.blur_as_input ? m_temporal_accumulation.prev_read_idx : m_temporal_accumulation.current_output_read_idx[!ping_pong];
+    push_constants.history_moments_idx = m_temporal_accumulation.current_moments_read_idx[!ping_pong];
 
+    vkCmdPushConstants(cmd_buf->handle(), m_adaptive_rays.classify_pipeline_layout->handle(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_constants), &push_constants);
+
+    VkDescriptorSet descriptor_sets[] = {
+        m_common_resources->bindless_heap->ds()->handle(),
+        m_adaptive_rays.tile_list_ds->handle()
+    };
+
+    vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_adaptive_rays.classify_pipeline_layout->handle(), 0, 2, descriptor_sets, 0, nullptr);
+
+    vkCmdDispatch(cmd_buf->handle(), static_cast<uint32_t>(ceil(float(m_width) / float(ADAPTIVE_RAYS_TILE_SIZE))), static_cast<uint32_t>(ceil(float(m_height) / float(ADAPTIVE_RAYS_TILE_SIZE))), 1);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void RayTracedReflections::screen_space_trace(dw::vk::CommandBuffer::Ptr cmd_buf, DeferredShading* deferred_shading, bool adaptive)
+{
+    DW_SCOPED_SAMPLE("Screen Space Trace", cmd_buf);
+
+    auto backend = m_backend.lock();
+
+    vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_screen_space.pipeline->handle());
+
+    ScreenSpacePushConstants push_constants;
+
+    push_constants.trim                  = m_ray_trace.trim;
+    push_constants.num_frames            = m_common_resources->num_frames;
+    push_constants.g_buffer_mip          = m_g_buffer_mip;
+    push_constants.approximate_with_ddgi = m_ray_trace.approximate_with_ddgi ? 1 : 0;
+    push_constants.max_iterations        = m_screen_space.max_iterations;
+    push_constants.thickness             = m_screen_space.thickness;
+    push_constants.max_distance          = m_screen_space.max_distance;
+    push_constants.screen_space          = m_screen_space.enabled ? 1 : 0;
+    push_constants.tile_list             = adaptive ? 1 : 0;
+    push_constants.ray_binning           = m_ray_binning.enabled ? 1 : 0;
+
+    vkCmdPushConstants(cmd_buf->handle(), m_screen_space.pipeline_layout->handle(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_constants), &push_constants);
+
+    const uint32_t dynamic_offset = m_common_resources->ubo_size * backend->current_frame_idx();
+
+    VkDescriptorSet descriptor_sets[] = {
+        m_ray_trace.write_ds->handle(),
+        m_g_buffer->output_ds()->handle(),
+        m_common_resources->per_frame_ds->handle(),
+        m_g_buffer->hiz_ds()->handle(),
+        deferred_shading->output_ds()->handle(),
+        m_common_resources->blue_noise_ds[BLUE_NOISE_1SPP]->handle(),
+        m_screen_space.ray_list_ds->handle(),
+        m_adaptive_rays.tile_list_ds->handle()
+    };
+
+    vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_screen_space.pipeline_layout->handle(), 0, 8, descriptor_sets, 1, &dynamic_offset);
+
+    // Only the tiles that were not skipped by the classification are visited, one group per tile.
+    if (adaptive)
+        vkCmdDispatchIndirect(cmd_buf->handle(), m_adaptive_rays.trace_dispatch_args_buffer->handle(), 0);
+    else
+        vkCmdDispatch(cmd_buf->handle(), static_cast<uint32_t>(ceil(float(m_width) / float(SCREEN_SPACE_NUM_THREADS_X))), static_cast<uint32_t>(ceil(float(m_height) / float(SCREEN_SPACE_NUM_THREADS_Y))), 1);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void RayTracedReflections::read_back_ray_list(dw::vk::CommandBuffer::Ptr cmd_buf)
+{
     auto backend = m_backend.lock();
 
-    VkImageSubresourceRange subresource_range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+    VkBufferCopy region;
+
+    region.srcOffset = 0;
+    region.dstOffset = sizeof(glm::uvec4) * backend->current_frame_idx();
+    region.size      = sizeof(glm::uvec4);
+
+    vkCmdCopyBuffer(cmd_buf->handle(), m_screen_space.ray_list_args_buffer->handle(), m_screen_space.readback_buffer->handle(), 1, &region);
+
+    // The render graph does not track host accesses, the counters are read once the fence of this frame has been waited on.
+    std::vector<VkBufferMemoryBarrier> buffer_barriers = {
+        buffer_memory_barrier(m_screen_space.readback_buffer, region.dstOffset, region.size, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_HOST_READ_BIT)
+    };
+
+    pipeline_barrier(cmd_buf, {}, {}, buffer_barriers, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void RayTracedReflections::scan_ray_bins(dw::vk::CommandBuffer::Ptr cmd_buf)
+{
+    DW_SCOPED_SAMPLE("Scan Ray Bins", cmd_buf);
+    GPU_SCOPED_TIMER("Reflections Ray Binning", cmd_buf, m_common_resources->gpu_timer.get());
+
+    // Turn the number of rays per bin into the offset of every bin in the sorted ray list.
+    vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_ray_binning.scan_pipeline->handle());
 
-    std::vector<VkMemoryBarrier> memory_barriers = {
-        memory_barrier(VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT)
+    BinRaysScanPushConstants push_constants;
+
+    push_constants.num_bins = m_ray_binning.num_bins;
+
+    vkCmdPushConstants(cmd_buf->handle(), m_ray_binning.scan_pipeline_layout->handle(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_constants), &push_constants);
+
+    VkDescriptorSet descriptor_sets[] = {
+        m_screen_space.ray_list_ds->handle()
     };
 
-    std::vector<VkImageMemoryBarrier> image_barriers = {
-        image_memory_barrier(m_ray_trace.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, subresource_range, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT)
+    vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_ray_binning.scan_pipeline_layout->handle(), 0, 1, descriptor_sets, 0, nullptr);
+
+    vkCmdDispatch(cmd_buf->handle(), 1, 1, 1);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void RayTracedReflections::scatter_ray_bins(dw::vk::CommandBuffer::Ptr cmd_buf)
+{
+    DW_SCOPED_SAMPLE("Scatter Ray Bins", cmd_buf);
+    GPU_SCOPED_TIMER("Reflections Ray Binning", cmd_buf, m_common_resources->gpu_timer.get());
+
+    // Scatter the rays into the ray list in bin order.
+    vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_ray_binning.scatter_pipeline->handle());
+
+    VkDescriptorSet descriptor_sets[] = {
+        m_screen_space.ray_list_ds->handle()
     };
 
-    pipeline_barrier(cmd_buf, memory_barriers, image_barriers, {}, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR);
+    vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_ray_binning.scatter_pipeline_layout->handle(), 0, 1, descriptor_sets, 0, nullptr);
 
-    vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, m_ray_trace.pipeline->handle());
+    vkCmdDispatchIndirect(cmd_buf->handle(), m_ray_binning.scatter_dispatch_args_buffer->handle(), 0);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void RayTracedReflections::ray_trace(dw::vk::CommandBuffer::Ptr cmd_buf, DDGI* ddgi, bool ray_list)
+{
+    m_timings.update(m_common_resources->gpu_timer.get(), m_backend_type, m_common_resources->num_frames);
+
+    DW_SCOPED_SAMPLE("Ray Trace", cmd_buf);
+    GPU_SCOPED_TIMER("Reflections Ray Trace", cmd_buf, m_common_resources->gpu_timer.get());
+
+    auto backend = m_backend.lock();
+
+    const bool ray_query = m_backend_type == RAY_TRACE_BACKEND_RAY_QUERY;
+
+    const PermutationKey key = permutation_bit(REFLECTIONS_CONSTANT_SAMPLE_GI, m_ray_trace.sample_gi && !m_first_frame) |
+                               permutation_bit(REFLECTIONS_CONSTANT_DDGI_VISIBILITY_TEST, ddgi->visibility_test());
 
     RayTracePushConstants push_constants;
 
+    push_constants.g_buffer                        = m_g_buffer->output_bindless_indices();
     push_constants.bias                            = m_ray_trace.bias;
     push_constants.trim                            = m_ray_trace.trim;
     push_constants.num_frames                      = m_common_resources->num_frames;
     push_constants.g_buffer_mip                    = m_g_buffer_mip;
-    push_constants.sample_gi                       = m_ray_trace.sample_gi && !m_first_frame ? 1 : 0;
     push_constants.approximate_with_ddgi           = m_ray_trace.approximate_with_ddgi && !m_first_frame ? 1 : 0;
     push_constants.gi_intensity                    = m_ray_trace.gi_intensity;
     push_constants.rough_ddgi_intensity            = m_ray_trace.rough_ddgi_intensity;
     push_constants.ibl_indirect_specular_intensity = m_ray_trace.ibl_indirect_specular_intensity;
-
-    vkCmdPushConstants(cmd_buf->handle(), m_ray_trace.pipeline_layout->handle(), VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR, 0, sizeof(push_constants), &push_constants);
+    push_constants.ray_list                        = ray_list ? 1 : 0;
+    push_constants.sobol_idx                       = m_common_resources->blue_noise_sobol_idx;
+    push_constants.scrambling_ranking_idx          = m_common_resources->blue_noise_scrambling_ranking_idx[BLUE_NOISE_1SPP];
+    push_constants.output_idx                      = m_ray_trace.write_idx;
 
     const uint32_t dynamic_offsets[] = {
         m_common_resources->ubo_size * backend->current_frame_idx(),
@@ -1064,14 +1645,37 @@ void RayTracedReflections::ray_trace(dw::vk::CommandBuffer::Ptr cmd_buf, DDGI* d
 
     VkDescriptorSet descriptor_sets[] = {
         m_common_resources->current_scene()->descriptor_set()->handle(),
-        m_ray_trace.write_ds->handle(),
+        m_common_resources->bindless_heap->ds()->handle(),
         m_common_resources->per_frame_ds->handle(),
-        m_g_buffer->output_ds()->handle(),
         m_common_resources->current_skybox_ds->handle(),
-        m_common_resources->blue_noise_ds[BLUE_NOISE_1SPP]->handle(),
-        ddgi->current_read_ds()->handle()
+        ddgi->current_read_ds()->handle(),
+        m_screen_space.ray_list_ds->handle(),
+        m_common_resources->gpu_counters->current_ds()->handle()
     };
 
+    if (ray_query)
+    {
+        vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_ray_trace.ray_query_permutations->get(key)->handle());
+
+        vkCmdPushConstants(cmd_buf->handle(), m_ray_trace.ray_query_pipeline_layout->handle(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_constants), &push_constants);
+
+        vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_ray_trace.ray_query_pipeline_layout->handle(), 0, 7, descriptor_sets, 2, dynamic_offsets);
+
+        // The screen space pass sizes the dispatch of the ray list as it appends to it.
+        if (ray_list)
+            vkCmdDispatchIndirect(cmd_buf->handle(), m_screen_space.ray_list_args_buffer->handle(), sizeof(glm::uvec4));
+        else
+            vkCmdDispatch(cmd_buf->handle(), static_cast<uint32_t>(ceil(float(m_width) / float(RAY_QUERY_NUM_THREADS_X))), static_cast<uint32_t>(ceil(float(m_height) / float(RAY_QUERY_NUM_THREADS_Y))), 1);
+
+        return;
+    }
+
+    RayTracingPermutation permutation = m_ray_trace.permutations->get(key);
+
+    vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, permutation.pipeline->handle());
+
+    vkCmdPushConstants(cmd_buf->handle(), m_ray_trace.pipeline_layout->handle(), VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR, 0, sizeof(push_constants), &push_constants);
+
     vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, m_ray_trace.pipeline_layout->handle(), 0, 7, descriptor_sets, 2, dynamic_offsets);
 
     auto& rt_pipeline_props = backend->ray_tracing_pipeline_properties();
@@ -1079,22 +1683,47 @@ void RayTracedReflections::ray_trace(dw::vk::CommandBuffer::Ptr cmd_buf, DDGI* d
     VkDeviceSize group_size   = dw::vk::utilities::aligned_size(rt_pipeline_props.shaderGroupHandleSize, rt_pipeline_props.shaderGroupBaseAlignment);
     VkDeviceSize group_stride = group_size;
 
-    const VkStridedDeviceAddressRegionKHR raygen_sbt   = { m_ray_trace.pipeline->shader_binding_table_buffer()->device_address(), group_stride, group_size };
-    const VkStridedDeviceAddressRegionKHR miss_sbt     = { m_ray_trace.pipeline->shader_binding_table_buffer()->device_address() + m_ray_trace.sbt->miss_group_offset(), group_stride, group_size };
-    const VkStridedDeviceAddressRegionKHR hit_sbt      = { m_ray_trace.pipeline->shader_binding_table_buffer()->device_address() + m_ray_trace.sbt->hit_group_offset(), group_stride, group_size };
+    const VkStridedDeviceAddressRegionKHR raygen_sbt   = { permutation.pipeline->shader_binding_table_buffer()->device_address(), group_stride, group_size };
+    const VkStridedDeviceAddressRegionKHR miss_sbt     = { permutation.pipeline->shader_binding_table_buffer()->device_address() + permutation.sbt->miss_group_offset(), group_stride, group_size };
+    const VkStridedDeviceAddressRegionKHR hit_sbt      = { permutation.pipeline->shader_binding_table_buffer()->device_address() + permutation.sbt->hit_group_offset(), group_stride, group_size };
     const VkStridedDeviceAddressRegionKHR callable_sbt = { 0, 0, 0 };
 
-    uint32_t rt_image_width  = m_width;
-    uint32_t rt_image_height = m_height;
+    if (ray_list)
+        vkCmdTraceRaysIndirectKHR(cmd_buf->handle(), &raygen_sbt, &miss_sbt, &hit_sbt, &callable_sbt, m_screen_space.ray_list_args_buffer->device_address());
+    else
+    {
+        uint32_t rt_image_width  = m_width;
+        uint32_t rt_image_height = m_height;
+
+        vkCmdTraceRaysKHR(cmd_buf->handle(), &raygen_sbt, &miss_sbt, &hit_sbt, &callable_sbt, rt_image_width, rt_image_height, 1);
+    }
+}
 
-    vkCmdTraceRaysKHR(cmd_buf->handle(), &raygen_sbt, &miss_sbt, &hit_sbt, &callable_sbt, rt_image_width, rt_image_height, 1);
+// -----------------------------------------------------------------------------------------------------------------------------------
 
-    dw::vk::utilities::set_image_layout(
-        cmd_buf->handle(),
-        m_ray_trace.image->handle(),
-        VK_IMAGE_LAYOUT_GENERAL,
-        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-        subresource_range);
+void RayTracedReflections::reconstruct(dw::vk::CommandBuffer::Ptr cmd_buf)
+{
+    DW_SCOPED_SAMPLE("Reconstruct", cmd_buf);
+
+    vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_adaptive_rays.reconstruct_pipeline->handle());
+
+    ReconstructPushConstants push_constants;
+
+    push_constants.g_buffer     = m_g_buffer->output_bindless_indices();
+    push_constants.num_frames   = m_common_resources->num_frames;
+    push_constants.g_buffer_mip = m_g_buffer_mip;
+    push_constants.output_idx   = m_ray_trace.write_idx;
+
+    vkCmdPushConstants(cmd_buf->handle(), m_adaptive_rays.reconstruct_pipeline_layout->handle(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_constants), &push_constants);
+
+    VkDescriptorSet descriptor_sets[] = {
+        m_common_resources->bindless_heap->ds()->handle(),
+        m_adaptive_rays.tile_list_ds->handle()
+    };
+
+    vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_adaptive_rays.reconstruct_pipeline_layout->handle(), 0, 2, descriptor_sets, 0, nullptr);
+
+    vkCmdDispatchIndirect(cmd_buf->handle(), m_adaptive_rays.reconstruct_dispatch_args_buffer->handle(), 0);
 }
 
 // -----------------------------------------------------------------------------------------------------------------------------------
@@ -1103,17 +1732,6 @@ void RayTracedReflections::reset_args(dw::vk::CommandBuffer::Ptr cmd_buf)
 {
     DW_SCOPED_SAMPLE("Reset Args", cmd_buf);
 
-    {
-        std::vector<VkBufferMemoryBarrier> buffer_barriers = {
-            buffer_memory_barrier(m_temporal_accumulation.denoise_tile_coords_buffer, 0, VK_WHOLE_SIZE, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT),
-            buffer_memory_barrier(m_temporal_accumulation.denoise_dispatch_args_buffer, 0, VK_WHOLE_SIZE, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT),
-            buffer_memory_barrier(m_temporal_accumulation.copy_tile_coords_buffer, 0, VK_WHOLE_SIZE, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT),
-            buffer_memory_barrier(m_temporal_accumulation.copy_dispatch_args_buffer, 0, VK_WHOLE_SIZE, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT)
-        };
-
-        pipeline_barrier(cmd_buf, {}, {}, buffer_barriers, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
-    }
-
     vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_reset_args.pipeline->handle());
 
     VkDescriptorSet descriptor_sets[] = {
@@ -1133,232 +1751,109 @@ void RayTracedReflections::temporal_accumulation(dw::vk::CommandBuffer::Ptr cmd_
 
     auto backend = m_backend.lock();
 
-    VkImageSubresourceRange subresource_range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
-
-    {
-        std::vector<VkMemoryBarrier> memory_barriers = {
-            memory_barrier(VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT)
-        };
-
-        std::vector<VkImageMemoryBarrier> image_barriers = {
-            image_memory_barrier(m_temporal_accumulation.current_output_image[m_common_resources->ping_pong], VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, subresource_range, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT),
-            image_memory_barrier(m_temporal_accumulation.current_moments_image[m_common_resources->ping_pong], VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, subresource_range, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT)
-        };
-
-        std::vector<VkBufferMemoryBarrier> buffer_barriers = {
-            buffer_memory_barrier(m_temporal_accumulation.denoise_tile_coords_buffer, 0, VK_WHOLE_SIZE, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_WRITE_BIT),
-            buffer_memory_barrier(m_temporal_accumulation.denoise_dispatch_args_buffer, 0, VK_WHOLE_SIZE, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_WRITE_BIT),
-            buffer_memory_barrier(m_temporal_accumulation.copy_tile_coords_buffer, 0, VK_WHOLE_SIZE, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_WRITE_BIT),
-            buffer_memory_barrier(m_temporal_accumulation.copy_dispatch_args_buffer, 0, VK_WHOLE_SIZE, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_WRITE_BIT)
-        };
-
-        pipeline_barrier(cmd_buf, memory_barriers, image_barriers, buffer_barriers, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
-    }
-
     vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_temporal_accumulation.pipeline->handle());
 
+    const bool ping_pong = m_common_resources->ping_pong;
+
     TemporalAccumulationPushConstants push_constants;
 
+    push_constants.g_buffer              = m_g_buffer->output_bindless_indices();
+    push_constants.prev_g_buffer         = m_g_buffer->history_bindless_indices();
     push_constants.camera_delta          = m_common_resources->camera_delta;
     push_constants.frame_time            = m_common_resources->frame_time;
     push_constants.alpha                 = m_temporal_accumulation.alpha;
     push_constants.moments_alpha         = m_temporal_accumulation.moments_alpha;
     push_constants.g_buffer_mip          = m_g_buffer_mip;
     push_constants.approximate_with_ddgi = m_ray_trace.approximate_with_ddgi && !m_first_frame ? 1 : 0;
+    push_constants.input_idx             = m_ray_trace.read_idx;
+    push_constants.history_output_idx    = m_temporal_accumulation.blur_as_input ? m_temporal_accumulation.prev_read_idx : m_temporal_accumulation.current_output_read_idx[!ping_pong];
+    push_constants.history_moments_idx   = m_temporal_accumulation.current_moments_read_idx[!ping_pong];
+    push_constants.output_idx            = m_temporal_accumulation.current_output_write_idx[ping_pong];
+    push_constants.moments_idx           = m_temporal_accumulation.current_moments_write_idx[ping_pong];
 
     vkCmdPushConstants(cmd_buf->handle(), m_temporal_accumulation.pipeline_layout->handle(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_constants), &push_constants);
 
     const uint32_t dynamic_offset = m_common_resources->ubo_size * backend->current_frame_idx();
 
     VkDescriptorSet descriptor_sets[] = {
-        m_temporal_accumulation.current_write_ds[m_common_resources->ping_pong]->handle(),
-        m_g_buffer->output_ds()->handle(),
-        m_g_buffer->history_ds()->handle(),
-        m_ray_trace.read_ds->handle(),
-        m_temporal_accumulation.blur_as_input ? m_temporal_accumulation.prev_read_ds[!m_common_resources->ping_pong]->handle() : m_temporal_accumulation.current_read_ds[!m_common_resources->ping_pong]->handle(),
+        m_common_resources->bindless_heap->ds()->handle(),
         m_common_resources->per_frame_ds->handle(),
         m_temporal_accumulation.indirect_buffer_ds->handle()
     };
 
-    vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_temporal_accumulation.pipeline_layout->handle(), 0, 7, descriptor_sets, 1, &dynamic_offset);
+    vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_temporal_accumulation.pipeline_layout->handle(), 0, 3, descriptor_sets, 1, &dynamic_offset);
 
     vkCmdDispatch(cmd_buf->handle(), static_cast<uint32_t>(ceil(float(m_width) / float(TEMPORAL_ACCUMULATION_NUM_THREADS_X))), static_cast<uint32_t>(ceil(float(m_height) / float(TEMPORAL_ACCUMULATION_NUM_THREADS_Y))), 1);
-
-    {
-        std::vector<VkMemoryBarrier> memory_barriers = {
-            memory_barrier(VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT)
-        };
-
-        std::vector<VkImageMemoryBarrier> image_barriers = {
-            image_memory_barrier(m_temporal_accumulation.current_output_image[m_common_resources->ping_pong], VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, subresource_range, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT),
-            image_memory_barrier(m_temporal_accumulation.current_moments_image[m_common_resources->ping_pong], VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, subresource_range, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT)
-        };
-
-        std::vector<VkBufferMemoryBarrier> buffer_barriers = {
-            buffer_memory_barrier(m_temporal_accumulation.denoise_tile_coords_buffer, 0, VK_WHOLE_SIZE, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT),
-            buffer_memory_barrier(m_temporal_accumulation.denoise_dispatch_args_buffer, 0, VK_WHOLE_SIZE, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT),
-            buffer_memory_barrier(m_temporal_accumulation.copy_tile_coords_buffer, 0, VK_WHOLE_SIZE, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT),
-            buffer_memory_barrier(m_temporal_accumulation.copy_dispatch_args_buffer, 0, VK_WHOLE_SIZE, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT)
-        };
-
-        pipeline_barrier(cmd_buf, memory_barriers, image_barriers, buffer_barriers, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT);
-    }
 }
 
 // -----------------------------------------------------------------------------------------------------------------------------------
 
-void RayTracedReflections::a_trous_filter(dw::vk::CommandBuffer::Ptr cmd_buf)
+void RayTracedReflections::a_trous_filter(dw::vk::CommandBuffer::Ptr cmd_buf, uint32_t pass, RenderGraph::ImageHandle input, RenderGraph::ImageHandle output)
 {
-    DW_SCOPED_SAMPLE("A-Trous Filter", cmd_buf);
+    DW_SCOPED_SAMPLE("A-Trous Filter " + std::to_string(pass), cmd_buf);
 
-    VkImageSubresourceRange subresource_range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+    dw::vk::DescriptorSet::Ptr write_ds = output == m_graph_resources.a_trous_output ? m_a_trous.write_ds : m_graph->write_ds(output);
+    dw::vk::DescriptorSet::Ptr read_ds;
 
-    bool    ping_pong = false;
-    int32_t read_idx  = 0;
-    int32_t write_idx = 1;
+    if (input == m_graph_resources.current_output[m_common_resources->ping_pong])
+        read_ds = m_temporal_accumulation.output_only_read_ds[m_common_resources->ping_pong];
+    else if (input == m_graph_resources.a_trous_output)
+        read_ds = m_a_trous.read_ds;
+    else
+        read_ds = m_graph->read_ds(input);
 
-    for (int i = 0; i < m_a_trous.filter_iterations; i++)
+    // Copy the required tiles
     {
-        read_idx  = (int32_t)ping_pong;
-        write_idx = (int32_t)!ping_pong;
-
-        if (i == 0)
-        {
-            std::vector<VkMemoryBarrier> memory_barriers = {
-                memory_barrier(VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT)
-            };
-
-            std::vector<VkImageMemoryBarrier> image_barriers = {
-                image_memory_barrier(m_a_trous.image[write_idx], VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, subresource_range, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT)
-            };
-
-            pipeline_barrier(cmd_buf, memory_barriers, image_barriers, {}, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
-        }
-        else
-        {
-            std::vector<VkMemoryBarrier> memory_barriers = {
-                memory_barrier(VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT)
-            };
-
-            std::vector<VkImageMemoryBarrier> image_barriers = {
-                image_memory_barrier(m_a_trous.image[read_idx], VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, subresource_range, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT),
-                image_memory_barrier(m_a_trous.image[write_idx], VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, subresource_range, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT)
-            };
-
-            pipeline_barrier(cmd_buf, memory_barriers, image_barriers, {}, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
-        }
-
-        // Copy the required tiles
-        {
-            DW_SCOPED_SAMPLE("Copy Tiles", cmd_buf);
-
-            vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_copy_tiles.pipeline->handle());
-
-            VkDescriptorSet descriptor_sets[] = {
-                m_a_trous.write_ds[write_idx]->handle(),
-                i == 0 ? m_temporal_accumulation.output_only_read_ds[m_common_resources->ping_pong]->handle() : m_a_trous.read_ds[read_idx]->handle(),
-                m_temporal_accumulation.indirect_buffer_ds->handle()
-            };
-
-            vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_copy_tiles.pipeline_layout->handle(), 0, 3, descriptor_sets, 0, nullptr);
-
-            vkCmdDispatchIndirect(cmd_buf->handle(), m_temporal_accumulation.copy_dispatch_args_buffer->handle(), 0);
-        }
-
-        // A-Trous Filter
-        {
-            DW_SCOPED_SAMPLE("Iteration " + std::to_string(i), cmd_buf);
-
-            vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_a_trous.pipeline->handle());
-
-            ATrousFilterPushConstants push_constants;
-
-            push_constants.radius                = m_a_trous.radius;
-            push_constants.step_size             = 1 << i;
-            push_constants.phi_color             = m_a_trous.phi_color;
-            push_constants.phi_normal            = m_a_trous.phi_normal;
-            push_constants.g_buffer_mip          = m_g_buffer_mip;
-            push_constants.sigma_depth           = m_a_trous.sigma_depth;
-            push_constants.approximate_with_ddgi = m_ray_trace.approximate_with_ddgi && !m_first_frame ? 1 : 0;
+        DW_SCOPED_SAMPLE("Copy Tiles", cmd_buf);
 
-            vkCmdPushConstants(cmd_buf->handle(), m_a_trous.pipeline_layout->handle(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_constants), &push_constants);
+        vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_copy_tiles.pipeline->handle());
 
-            VkDescriptorSet descriptor_sets[] = {
-                m_a_trous.write_ds[write_idx]->handle(),
-                i == 0 ? m_temporal_accumulation.output_only_read_ds[m_common_resources->ping_pong]->handle() : m_a_trous.read_ds[read_idx]->handle(),
-                m_g_buffer->output_ds()->handle(),
-                m_temporal_accumulation.indirect_buffer_ds->handle()
-            };
-
-            vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_a_trous.pipeline_layout->handle(), 0, 4, descriptor_sets, 0, nullptr);
-
-            vkCmdDispatchIndirect(cmd_buf->handle(), m_temporal_accumulation.denoise_dispatch_args_buffer->handle(), 0);
-        }
+        VkDescriptorSet descriptor_sets[] = {
+            write_ds->handle(),
+            read_ds->handle(),
+            m_temporal_accumulation.indirect_buffer_ds->handle()
+        };
 
-        ping_pong = !ping_pong;
+        vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_copy_tiles.pipeline_layout->handle(), 0, 3, descriptor_sets, 0, nullptr);
 
-        if (m_a_trous.feedback_iteration == i && m_temporal_accumulation.blur_as_input)
-        {
-            dw::vk::utilities::set_image_layout(
-                cmd_buf->handle(),
-                m_a_trous.image[write_idx]->handle(),
-                VK_IMAGE_LAYOUT_GENERAL,
-                VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-                subresource_range);
-
-            dw::vk::utilities::set_image_layout(
-                cmd_buf->handle(),
-                m_temporal_accumulation.prev_image->handle(),
-                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                subresource_range);
-
-            VkImageCopy image_copy_region {};
-            image_copy_region.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-            image_copy_region.srcSubresource.layerCount = 1;
-            image_copy_region.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-            image_copy_region.dstSubresource.layerCount = 1;
-            image_copy_region.extent.width              = m_width;
-            image_copy_region.extent.height             = m_height;
-            image_copy_region.extent.depth              = 1;
-
-            // Issue the copy command
-            vkCmdCopyImage(
-                cmd_buf->handle(),
-                m_a_trous.image[write_idx]->handle(),
-                VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-                m_temporal_accumulation.prev_image->handle(),
-                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                1,
-                &image_copy_region);
-
-            dw::vk::utilities::set_image_layout(
-                cmd_buf->handle(),
-                m_a_trous.image[write_idx]->handle(),
-                VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-                VK_IMAGE_LAYOUT_GENERAL,
-                subresource_range);
-
-            dw::vk::utilities::set_image_layout(
-                cmd_buf->handle(),
-                m_temporal_accumulation.prev_image->handle(),
-                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-                subresource_range);
-        }
+        vkCmdDispatchIndirect(cmd_buf->handle(), m_temporal_accumulation.copy_dispatch_args_buffer->handle(), 0);
     }
 
-    m_a_trous.read_idx = write_idx;
-
-    std::vector<VkMemoryBarrier> memory_barriers = {
-        memory_barrier(VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT)
-    };
+    // A-Trous Filter
+    m_a_trous.denoiser->filter(cmd_buf,
+                               pass,
+                               write_ds,
+                               read_ds,
+                               m_temporal_accumulation.indirect_buffer_ds,
+                               m_temporal_accumulation.denoise_dispatch_args_buffer,
+                               m_g_buffer_mip,
+                               m_ray_trace.approximate_with_ddgi && !m_first_frame ? SVGFDenoiser::FLAG_APPROXIMATE_WITH_DDGI : 0);
+}
 
-    std::vector<VkImageMemoryBarrier> image_barriers = {
-        image_memory_barrier(m_a_trous.image[write_idx], VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, subresource_range, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT)
-    };
+// -----------------------------------------------------------------------------------------------------------------------------------
 
-    pipeline_barrier(cmd_buf, memory_barriers, image_barriers, {}, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+void RayTracedReflections::copy_feedback(dw::vk::CommandBuffer::Ptr cmd_buf, RenderGraph::ImageHandle source)
+{
+    DW_SCOPED_SAMPLE("Copy Feedback", cmd_buf);
+
+    VkImageCopy image_copy_region {};
+    image_copy_region.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    image_copy_region.srcSubresource.layerCount = 1;
+    image_copy_region.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    image_copy_region.dstSubresource.layerCount = 1;
+    image_copy_region.extent.width              = m_width;
+    image_copy_region.extent.height             = m_height;
+    image_copy_region.extent.depth              = 1;
+
+    // Issue the copy command
+    vkCmdCopyImage(
+        cmd_buf->handle(),
+        m_graph->image(source)->handle(),
+        VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+        m_temporal_accumulation.prev_image->handle(),
+        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        1,
+        &image_copy_region);
 }
 
 // -----------------------------------------------------------------------------------------------------------------------------------
@@ -1367,42 +1862,47 @@ void RayTracedReflections::upsample(dw::vk::CommandBuffer::Ptr cmd_buf)
 {
     DW_SCOPED_SAMPLE("Upsample", cmd_buf);
 
-    VkImageSubresourceRange subresource_range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
-
-    dw::vk::utilities::set_image_layout(
-        cmd_buf->handle(),
-        m_upsample.image->handle(),
-        VK_IMAGE_LAYOUT_UNDEFINED,
-        VK_IMAGE_LAYOUT_GENERAL,
-        subresource_range);
+    const PermutationKey key = permutation_bit(REFLECTIONS_UPSAMPLE_CONSTANT_LOW_MEMORY, m_upsample.low_memory);
 
-    vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_upsample.pipeline->handle());
+    vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_upsample.permutations->get(key)->handle());
 
     UpsamplePushConstants push_constants;
 
+    push_constants.g_buffer     = m_g_buffer->output_bindless_indices();
     push_constants.g_buffer_mip = m_g_buffer_mip;
+    push_constants.input_idx    = m_a_trous.read_idx;
+    push_constants.output_idx   = m_upsample.write_idx;
 
     vkCmdPushConstants(cmd_buf->handle(), m_upsample.layout->handle(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_constants), &push_constants);
 
     VkDescriptorSet descriptor_sets[] = {
-        m_upsample.write_ds->handle(),
-        m_a_trous.read_ds[m_a_trous.read_idx]->handle(),
-        m_g_buffer->output_ds()->handle()
+        m_common_resources->bindless_heap->ds()->handle()
     };
 
-    vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_upsample.layout->handle(), 0, 3, descriptor_sets, 0, nullptr);
+    vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_upsample.layout->handle(), 0, 1, descriptor_sets, 0, nullptr);
 
     const uint32_t NUM_THREADS_X = 8;
     const uint32_t NUM_THREADS_Y = 8;
 
     vkCmdDispatch(cmd_buf->handle(), static_cast<uint32_t>(ceil(float(m_upsample.image->width()) / float(NUM_THREADS_X))), static_cast<uint32_t>(ceil(float(m_upsample.image->height()) / float(NUM_THREADS_Y))), 1);
+}
 
-    dw::vk::utilities::set_image_layout(
-        cmd_buf->handle(),
-        m_upsample.image->handle(),
-        VK_IMAGE_LAYOUT_GENERAL,
-        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-        subresource_range);
+// -----------------------------------------------------------------------------------------------------------------------------------
+void RayTracedReflections::copy_counters(dw::vk::CommandBuffer::Ptr cmd_buf, bool adaptive)
+{
+    GPUCounters* gpu_counters = m_common_resources->gpu_counters.get();
+
+    if (!gpu_counters->enabled())
+        return;
+
+    gpu_counters->copy(cmd_buf, GPU_COUNTER_REFLECTION_DENOISE_TILES, m_temporal_accumulation.denoise_dispatch_args_buffer);
+    gpu_counters->copy(cmd_buf, GPU_COUNTER_REFLECTION_COPY_TILES, m_temporal_accumulation.copy_dispatch_args_buffer);
+
+    if (adaptive)
+    {
+        gpu_counters->copy(cmd_buf, GPU_COUNTER_REFLECTION_TRACE_TILES, m_adaptive_rays.trace_dispatch_args_buffer);
+        gpu_counters->copy(cmd_buf, GPU_COUNTER_REFLECTION_RECONSTRUCT_TILES, m_adaptive_rays.reconstruct_dispatch_args_buffer);
+    }
 }
 
-// -----------------------------------------------------------------------------------------------------------------------------------
\ No newline at end of file
+// -----------------------------------------------------------------------------------------------------------------------------------
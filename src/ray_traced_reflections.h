@@ -1,9 +1,12 @@
 #pragma once
 
 #include "common.h"
+#include "render_graph.h"
+#include "pipeline_permutations.h"
 
 class GBuffer;
 class DDGI;
+class DeferredShading;
 
 class RayTracedReflections
 {
@@ -24,52 +27,134 @@ public:
     RayTracedReflections(std::weak_ptr<dw::vk::Backend> backend, CommonResources* common_resources, GBuffer* g_buffer, RayTraceScale scale = RAY_TRACE_SCALE_HALF_RES);
     ~RayTracedReflections();
 
-    void                       render(dw::vk::CommandBuffer::Ptr cmd_buf, DDGI* ddgi);
+    void                       render(dw::vk::CommandBuffer::Ptr cmd_buf, DDGI* ddgi, DeferredShading* deferred_shading);
     void                       gui();
+    void                       set_scale(RayTraceScale scale);
+    void                       set_precision(RenderTargetPrecision precision);
     dw::vk::DescriptorSet::Ptr output_ds();
 
     inline uint32_t                         width() { return m_width; }
     inline uint32_t                         height() { return m_height; }
     inline RayTraceScale                    scale() { return m_scale; }
+    inline RenderTargetPrecision            precision() { return m_precision; }
     inline RayTracedReflections::OutputType current_output() { return m_current_output; }
     inline void                             set_current_output(RayTracedReflections::OutputType output_type) { m_current_output = output_type; }
+    inline bool                             samples_ddgi() { return m_ray_trace.sample_gi || m_ray_trace.approximate_with_ddgi; }
+    inline RayTraceBackend                  ray_trace_backend() { return m_backend_type; }
+    inline void                             set_ray_trace_backend(RayTraceBackend backend) { m_backend_type = backend; }
+    inline QueueType                        queue_type() { return m_queue_type; }
+    inline void                             set_queue_type(QueueType queue_type) { m_queue_type = queue_type; }
+    inline RenderGraph*                     render_graph() { return m_graph.get(); }
+    inline void                             restart_accumulation() { m_first_frame = true; }
 
 private:
+    void update_resolution();
     void create_images();
     void create_buffers();
+    void create_descriptor_set_layouts();
     void create_descriptor_sets();
     void write_descriptor_sets();
     void create_pipelines();
-    void clear_images(dw::vk::CommandBuffer::Ptr cmd_buf);
-    void ray_trace(dw::vk::CommandBuffer::Ptr cmd_buf, DDGI* ddgi);
-    void reset_args(dw::vk::CommandBuffer::Ptr cmd_buf);
-    void temporal_accumulation(dw::vk::CommandBuffer::Ptr cmd_buf);
-    void a_trous_filter(dw::vk::CommandBuffer::Ptr cmd_buf);
-    void upsample(dw::vk::CommandBuffer::Ptr cmd_buf);
+    void                     retire_resources();
+    void                     setup_render_graph(DDGI* ddgi, DeferredShading* deferred_shading, bool ray_list, bool adaptive);
+    RenderGraph::ImageHandle output_image();
+    void                     reset_ray_list(dw::vk::CommandBuffer::Ptr cmd_buf);
+    void                     classify_tiles(dw::vk::CommandBuffer::Ptr cmd_buf);
+    void                     screen_space_trace(dw::vk::CommandBuffer::Ptr cmd_buf, DeferredShading* deferred_shading, bool adaptive);
+    void                     read_back_ray_list(dw::vk::CommandBuffer::Ptr cmd_buf);
+    void                     scan_ray_bins(dw::vk::CommandBuffer::Ptr cmd_buf);
+    void                     scatter_ray_bins(dw::vk::CommandBuffer::Ptr cmd_buf);
+    void                     ray_trace(dw::vk::CommandBuffer::Ptr cmd_buf, DDGI* ddgi, bool ray_list);
+    void                     reconstruct(dw::vk::CommandBuffer::Ptr cmd_buf);
+    void                     reset_args(dw::vk::CommandBuffer::Ptr cmd_buf);
+    void                     temporal_accumulation(dw::vk::CommandBuffer::Ptr cmd_buf);
+    void                     a_trous_filter(dw::vk::CommandBuffer::Ptr cmd_buf, uint32_t pass, RenderGraph::ImageHandle input, RenderGraph::ImageHandle output);
+    void                     copy_feedback(dw::vk::CommandBuffer::Ptr cmd_buf, RenderGraph::ImageHandle source);
+    void                     upsample(dw::vk::CommandBuffer::Ptr cmd_buf);
+    void                     copy_counters(dw::vk::CommandBuffer::Ptr cmd_buf, bool adaptive);
 
 private:
     struct RayTrace
     {
-        bool                            sample_gi                       = true;
-        bool                            approximate_with_ddgi           = true;
-        float                           gi_intensity                    = 0.5f;
-        float                           rough_ddgi_intensity            = 0.5f;
-        float                           ibl_indirect_specular_intensity = 0.05f;
-        float                           bias                            = 0.5f;
-        float                           trim                            = 0.8f;
-        dw::vk::DescriptorSet::Ptr      write_ds;
-        dw::vk::DescriptorSet::Ptr      read_ds;
-        dw::vk::RayTracingPipeline::Ptr pipeline;
-        dw::vk::PipelineLayout::Ptr     pipeline_layout;
-        dw::vk::Image::Ptr              image;
-        dw::vk::ImageView::Ptr          view;
-        dw::vk::ShaderBindingTable::Ptr sbt;
+        bool                                            sample_gi                       = true;
+        bool                                            approximate_with_ddgi           = true;
+        float                                           gi_intensity                    = 0.5f;
+        float                                           rough_ddgi_intensity            = 0.5f;
+        float                                           ibl_indirect_specular_intensity = 0.05f;
+        float                                           bias                            = 0.5f;
+        float                                           trim                            = 0.8f;
+        dw::vk::DescriptorSet::Ptr                      write_ds;
+        dw::vk::DescriptorSet::Ptr                      read_ds;
+        dw::vk::PipelineLayout::Ptr                     pipeline_layout;
+        dw::vk::PipelineLayout::Ptr                     ray_query_pipeline_layout;
+        dw::vk::Image::Ptr                              image;
+        dw::vk::ImageView::Ptr                          view;
+        std::unique_ptr<RayTracingPipelinePermutations> permutations;
+        std::unique_ptr<ComputePipelinePermutations>    ray_query_permutations;
+        uint32_t                                        write_idx = BINDLESS_INVALID_INDEX;
+        uint32_t                                        read_idx  = BINDLESS_INVALID_INDEX;
+    };
+
+    // Marches the reflected rays through the Hi-Z first and shades hits with the previous frame's lit image, only the pixels
+    // it could not resolve are written to the ray list and traced.
+    struct ScreenSpace
+    {
+        bool                             enabled        = true;
+        int32_t                          max_iterations = 64;
+        float                            thickness      = 0.5f;
+        float                            max_distance   = 50.0f;
+        uint32_t                         num_hits       = 0;
+        uint32_t                         num_rays       = 0;
+        CachedComputePipeline::Ptr       pipeline;
+        dw::vk::PipelineLayout::Ptr      pipeline_layout;
+        dw::vk::DescriptorSetLayout::Ptr ray_list_ds_layout;
+        dw::vk::DescriptorSet::Ptr       ray_list_ds;
+        dw::vk::Buffer::Ptr              ray_list_args_buffer;
+        dw::vk::Buffer::Ptr              ray_list_coords_buffer;
+        dw::vk::Buffer::Ptr              readback_buffer; // One copy of the ray list args per frame in flight
+    };
+
+    // Spends rays where the history needs them: tiles of mirror-like surfaces are traced at full rate, rough tiles with one ray
+    // per 2x2 quad that is then reconstructed, and tiles whose history has converged are skipped for the frame.
+    struct AdaptiveRays
+    {
+        bool                             enabled                    = true;
+        float                            quarter_rate_roughness     = 0.4f;
+        float                            converged_variance         = 0.0005f;
+        float                            converged_history_length   = 16.0f;
+        int32_t                          converged_refresh_interval = 4;
+        CachedComputePipeline::Ptr       classify_pipeline;
+        dw::vk::PipelineLayout::Ptr      classify_pipeline_layout;
+        CachedComputePipeline::Ptr       reconstruct_pipeline;
+        dw::vk::PipelineLayout::Ptr      reconstruct_pipeline_layout;
+        dw::vk::DescriptorSetLayout::Ptr tile_list_ds_layout;
+        dw::vk::DescriptorSet::Ptr       tile_list_ds;
+        dw::vk::Buffer::Ptr              trace_tile_coords_buffer;
+        dw::vk::Buffer::Ptr              trace_dispatch_args_buffer;
+        dw::vk::Buffer::Ptr              reconstruct_tile_coords_buffer;
+        dw::vk::Buffer::Ptr              reconstruct_dispatch_args_buffer;
+    };
+
+    // Sorts the ray list by screen region and direction octant before it is traced, so that neighbouring rays are more likely
+    // to visit the same BVH nodes and materials.
+    struct RayBinning
+    {
+        bool                        enabled  = false;
+        uint32_t                    num_bins = 0;
+        CachedComputePipeline::Ptr  scan_pipeline;
+        dw::vk::PipelineLayout::Ptr scan_pipeline_layout;
+        CachedComputePipeline::Ptr  scatter_pipeline;
+        dw::vk::PipelineLayout::Ptr scatter_pipeline_layout;
+        dw::vk::Buffer::Ptr         unsorted_coords_buffer;
+        dw::vk::Buffer::Ptr         bins_buffer;
+        dw::vk::Buffer::Ptr         bin_counts_buffer;
+        dw::vk::Buffer::Ptr         scatter_dispatch_args_buffer;
     };
 
     struct ResetArgs
     {
-        dw::vk::PipelineLayout::Ptr  pipeline_layout;
-        dw::vk::ComputePipeline::Ptr pipeline;
+        dw::vk::PipelineLayout::Ptr pipeline_layout;
+        CachedComputePipeline::Ptr  pipeline;
     };
 
     struct TemporalAccumulation
@@ -81,10 +166,8 @@ private:
         dw::vk::Buffer::Ptr              denoise_dispatch_args_buffer;
         dw::vk::Buffer::Ptr              copy_tile_coords_buffer;
         dw::vk::Buffer::Ptr              copy_dispatch_args_buffer;
-        dw::vk::ComputePipeline::Ptr     pipeline;
+        CachedComputePipeline::Ptr       pipeline;
         dw::vk::PipelineLayout::Ptr      pipeline_layout;
-        dw::vk::DescriptorSetLayout::Ptr write_ds_layout;
-        dw::vk::DescriptorSetLayout::Ptr read_ds_layout;
         dw::vk::DescriptorSetLayout::Ptr indirect_buffer_ds_layout;
         dw::vk::Image::Ptr               current_output_image[2];
         dw::vk::Image::Ptr               current_moments_image[2];
@@ -92,44 +175,65 @@ private:
         dw::vk::ImageView::Ptr           current_output_view[2];
         dw::vk::ImageView::Ptr           current_moments_view[2];
         dw::vk::ImageView::Ptr           prev_view;
-        dw::vk::DescriptorSet::Ptr       current_write_ds[2];
-        dw::vk::DescriptorSet::Ptr       current_read_ds[2];
         dw::vk::DescriptorSet::Ptr       output_only_read_ds[2];
-        dw::vk::DescriptorSet::Ptr       prev_read_ds[2];
         dw::vk::DescriptorSet::Ptr       indirect_buffer_ds;
+        uint32_t                         current_output_write_idx[2];
+        uint32_t                         current_output_read_idx[2];
+        uint32_t                         current_moments_write_idx[2];
+        uint32_t                         current_moments_read_idx[2];
+        uint32_t                         prev_read_idx = BINDLESS_INVALID_INDEX;
     };
 
     struct CopyTiles
     {
-        dw::vk::PipelineLayout::Ptr  pipeline_layout;
-        dw::vk::ComputePipeline::Ptr pipeline;
+        dw::vk::PipelineLayout::Ptr pipeline_layout;
+        CachedComputePipeline::Ptr  pipeline;
     };
 
     struct ATrous
     {
-        float                        phi_color          = 10.0f;
-        float                        phi_normal         = 32.0f;
-        float                        sigma_depth        = 1.0f;
-        int32_t                      radius             = 1;
-        int32_t                      filter_iterations  = 4;
-        int32_t                      feedback_iteration = 1;
-        int32_t                      read_idx           = 0;
-        dw::vk::ComputePipeline::Ptr pipeline;
-        dw::vk::PipelineLayout::Ptr  pipeline_layout;
-        dw::vk::Image::Ptr           image[2];
-        dw::vk::ImageView::Ptr       view[2];
-        dw::vk::DescriptorSet::Ptr   read_ds[2];
-        dw::vk::DescriptorSet::Ptr   write_ds[2];
+        std::unique_ptr<SVGFDenoiser> denoiser;
+        dw::vk::Image::Ptr            image;
+        dw::vk::ImageView::Ptr        view;
+        dw::vk::DescriptorSet::Ptr    read_ds;
+        dw::vk::DescriptorSet::Ptr    write_ds;
+        uint32_t                      read_idx = BINDLESS_INVALID_INDEX;
     };
 
     struct Upsample
     {
-        dw::vk::PipelineLayout::Ptr  layout;
-        dw::vk::ComputePipeline::Ptr pipeline;
-        dw::vk::Image::Ptr           image;
-        dw::vk::ImageView::Ptr       image_view;
-        dw::vk::DescriptorSet::Ptr   read_ds;
-        dw::vk::DescriptorSet::Ptr   write_ds;
+        bool                                         low_memory = false;
+        dw::vk::PipelineLayout::Ptr                  layout;
+        std::unique_ptr<ComputePipelinePermutations> permutations;
+        dw::vk::Image::Ptr                           image;
+        dw::vk::ImageView::Ptr                       image_view;
+        dw::vk::DescriptorSet::Ptr                   read_ds;
+        uint32_t                                     write_idx = BINDLESS_INVALID_INDEX;
+    };
+
+    struct GraphResources
+    {
+        RenderGraph::ImageHandle  ray_trace;
+        RenderGraph::ImageHandle  current_output[2];
+        RenderGraph::ImageHandle  current_moments[2];
+        RenderGraph::ImageHandle  prev_output;
+        RenderGraph::ImageHandle  a_trous_output;
+        RenderGraph::ImageHandle  upsample;
+        RenderGraph::BufferHandle ray_list_args;
+        RenderGraph::BufferHandle ray_list_coords;
+        RenderGraph::BufferHandle ray_list_readback;
+        RenderGraph::BufferHandle unsorted_coords;
+        RenderGraph::BufferHandle bins;
+        RenderGraph::BufferHandle bin_counts;
+        RenderGraph::BufferHandle scatter_dispatch;
+        RenderGraph::BufferHandle trace_tile_coords;
+        RenderGraph::BufferHandle trace_dispatch;
+        RenderGraph::BufferHandle reconstruct_tile_coords;
+        RenderGraph::BufferHandle reconstruct_dispatch;
+        RenderGraph::BufferHandle denoise_tile_coords;
+        RenderGraph::BufferHandle denoise_dispatch;
+        RenderGraph::BufferHandle copy_tile_coords;
+        RenderGraph::BufferHandle copy_dispatch;
     };
 
     std::weak_ptr<dw::vk::Backend> m_backend;
@@ -137,15 +241,24 @@ private:
     GBuffer*                       m_g_buffer;
     OutputType                     m_current_output = OUTPUT_UPSAMPLE;
     RayTraceScale                  m_scale;
+    QueueType                      m_queue_type   = QUEUE_TYPE_GRAPHICS;
+    RayTraceBackend                m_backend_type = RAY_TRACE_BACKEND_PIPELINE;
+    RayTraceBackendTimings         m_timings      = RayTraceBackendTimings("Reflections Ray Trace");
+    RenderTargetPrecision          m_precision    = RENDER_TARGET_PRECISION_FULL;
     uint32_t                       m_g_buffer_mip = 0;
     uint32_t                       m_width;
     uint32_t                       m_height;
     bool                           m_denoise     = true;
     bool                           m_first_frame = true;
     RayTrace                       m_ray_trace;
+    ScreenSpace                    m_screen_space;
+    AdaptiveRays                   m_adaptive_rays;
+    RayBinning                     m_ray_binning;
     ResetArgs                      m_reset_args;
     TemporalAccumulation           m_temporal_accumulation;
     CopyTiles                      m_copy_tiles;
     ATrous                         m_a_trous;
     Upsample                       m_upsample;
+    std::unique_ptr<RenderGraph>   m_graph;
+    GraphResources                 m_graph_resources;
 };
\ No newline at end of file
@@ -1,5 +1,6 @@
 #include "ray_traced_shadows.h"
 #include "g_buffer.h"
+#include "svgf_denoiser.h"
 #include "utilities.h"
 #include <profiler.h>
 #include <macros.h>
@@ -15,40 +16,56 @@ static const uint32_t TEMPORAL_ACCUMULATION_NUM_THREADS_Y = 8;
 
 // -----------------------------------------------------------------------------------------------------------------------------------
 
-struct RayTracePushConstants
+// Specialization constant ids of shadows_upsample.comp.
+enum ShadowsUpsampleConstant
 {
-    float    bias;
-    uint32_t num_frames;
-    int32_t  g_buffer_mip;
+    SHADOWS_UPSAMPLE_CONSTANT_LOW_MEMORY,
+    SHADOWS_UPSAMPLE_CONSTANT_COUNT
 };
 
 // -----------------------------------------------------------------------------------------------------------------------------------
 
-struct TemporalAccumulationPushConstants
+struct RayTracePushConstants
 {
-    float   alpha;
-    float   moments_alpha;
-    int32_t g_buffer_mip;
+    glm::uvec4 g_buffer;
+    glm::uvec4 prev_g_buffer;
+    float      bias;
+    uint32_t   num_frames;
+    int32_t    g_buffer_mip;
+    uint32_t   use_cache;
+    float      refresh_fraction;
+    float      confident_run_length;
+    uint32_t   sobol_idx;
+    uint32_t   scrambling_ranking_idx;
+    uint32_t   history_cache_idx;
+    uint32_t   cache_idx;
+    uint32_t   output_idx;
 };
 
 // -----------------------------------------------------------------------------------------------------------------------------------
 
-struct ATrousFilterPushConstants
+struct TemporalAccumulationPushConstants
 {
-    int     radius;
-    int     step_size;
-    float   phi_visibility;
-    float   phi_normal;
-    float   sigma_depth;
-    int32_t g_buffer_mip;
-    float   power;
+    glm::uvec4 g_buffer;
+    glm::uvec4 prev_g_buffer;
+    float      alpha;
+    float      moments_alpha;
+    int32_t    g_buffer_mip;
+    uint32_t   input_idx;
+    uint32_t   history_output_idx;
+    uint32_t   history_moments_idx;
+    uint32_t   output_idx;
+    uint32_t   moments_idx;
 };
 
 // -----------------------------------------------------------------------------------------------------------------------------------
 
 struct UpsamplePushConstants
 {
-    int32_t g_buffer_mip;
+    glm::uvec4 g_buffer;
+    int32_t    g_buffer_mip;
+    uint32_t   input_idx;
+    uint32_t   output_idx;
 };
 
 // -----------------------------------------------------------------------------------------------------------------------------------
@@ -74,17 +91,12 @@ const std::string RayTracedShadows::kOutputTypeNames[] = {
 RayTracedShadows::RayTracedShadows(std::weak_ptr<dw::vk::Backend> backend, CommonResources* common_resources, GBuffer* g_buffer, RayTraceScale scale) :
     m_backend(backend), m_common_resources(common_resources), m_g_buffer(g_buffer), m_scale(scale)
 {
-    auto vk_backend = m_backend.lock();
-
-    float scale_divisor = powf(2.0f, float(scale));
-
-    m_width  = vk_backend->swap_chain_extents().width / scale_divisor;
-    m_height = vk_backend->swap_chain_extents().height / scale_divisor;
-
-    m_g_buffer_mip = static_cast<uint32_t>(scale);
+    m_graph = std::unique_ptr<RenderGraph>(new RenderGraph(m_backend, m_common_resources->transient_image_pool.get()));
 
+    update_resolution();
     create_images();
     create_buffers();
+    create_descriptor_set_layouts();
     create_descriptor_sets();
     write_descriptor_sets();
     create_pipelines();
@@ -101,19 +113,11 @@ RayTracedShadows::~RayTracedShadows()
 void RayTracedShadows::render(dw::vk::CommandBuffer::Ptr cmd_buf)
 {
     DW_SCOPED_SAMPLE("Ray Traced Shadows", cmd_buf);
+    GPU_SCOPED_TIMER("Shadows", cmd_buf, m_common_resources->gpu_timer.get());
 
-    clear_images(cmd_buf);
-    ray_trace(cmd_buf);
-
-    if (m_denoise)
-    {
-        reset_args(cmd_buf);
-        temporal_accumulation(cmd_buf);
-        a_trous_filter(cmd_buf);
+    setup_render_graph();
 
-        if (m_scale != RAY_TRACE_SCALE_FULL_RES)
-            upsample(cmd_buf);
-    }
+    m_graph->execute(cmd_buf);
 }
 
 // -----------------------------------------------------------------------------------------------------------------------------------
@@ -122,13 +126,62 @@ void RayTracedShadows::gui()
 {
     ImGui::Checkbox("Denoise", &m_denoise);
     ImGui::InputFloat("Bias", &m_ray_trace.bias);
+    ImGui::Checkbox("Cache", &m_cache.enabled);
+
+    if (m_cache.enabled)
+    {
+        ImGui::SliderFloat("Cache Refresh Fraction", &m_cache.refresh_fraction, 0.0f, 1.0f);
+        ImGui::SliderInt("Cache Confident Run Length", &m_cache.confident_run_length, 1, 64);
+    }
+
     ImGui::InputFloat("Alpha", &m_temporal_accumulation.alpha);
     ImGui::InputFloat("Alpha Moments", &m_temporal_accumulation.moments_alpha);
-    ImGui::InputFloat("Phi Visibility", &m_a_trous.phi_visibility);
-    ImGui::InputFloat("Phi Normal", &m_a_trous.phi_normal);
-    ImGui::InputFloat("Sigma Depth", &m_a_trous.sigma_depth);
-    ImGui::SliderInt("Filter Iterations", &m_a_trous.filter_iterations, 1, 5);
-    ImGui::SliderFloat("Power", &m_a_trous.power, 1.0f, 50.0f);
+    m_a_trous.denoiser->gui();
+    ImGui::Text("Render Graph: %u passes, %u barriers, %u transients", m_graph->num_passes(), m_graph->num_barriers(), m_graph->num_physical_transients());
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void RayTracedShadows::set_scale(RayTraceScale scale)
+{
+    if (scale == m_scale)
+        return;
+
+    // Pipelines and layouts do not depend on the resolution, so only the images and the sets that point at them are replaced.
+    retire_resources();
+
+    m_scale = scale;
+
+    update_resolution();
+    create_images();
+    create_buffers();
+    create_descriptor_sets();
+    write_descriptor_sets();
+
+    m_graph->clear_resource_states();
+
+    restart_accumulation();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void RayTracedShadows::set_precision(RenderTargetPrecision precision)
+{
+    if (precision == m_precision)
+        return;
+
+    retire_resources();
+
+    m_precision = precision;
+
+    create_images();
+    create_buffers();
+    create_descriptor_sets();
+    write_descriptor_sets();
+
+    m_graph->clear_resource_states();
+
+    restart_accumulation();
 }
 
 // -----------------------------------------------------------------------------------------------------------------------------------
@@ -142,11 +195,11 @@ dw::vk::DescriptorSet::Ptr RayTracedShadows::output_ds()
         else if (m_current_output == OUTPUT_TEMPORAL_ACCUMULATION)
             return m_temporal_accumulation.output_only_read_ds;
         else if (m_current_output == OUTPUT_ATROUS)
-            return m_a_trous.read_ds[m_a_trous.read_idx];
+            return m_a_trous.read_ds;
         else
         {
             if (m_scale == RAY_TRACE_SCALE_FULL_RES)
-                return m_a_trous.read_ds[m_a_trous.read_idx];
+                return m_a_trous.read_ds;
             else
                 return m_upsample.read_ds;
         }
@@ -157,6 +210,27 @@ dw::vk::DescriptorSet::Ptr RayTracedShadows::output_ds()
 
 // -----------------------------------------------------------------------------------------------------------------------------------
 
+void RayTracedShadows::restart_accumulation()
+{
+    // The cache is temporal history too and goes stale along with the accumulated shadows.
+    m_first_frame = true;
+    m_cache.valid = false;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void RayTracedShadows::update_resolution()
+{
+    float scale_divisor = powf(2.0f, float(m_scale));
+
+    m_width  = m_common_resources->render_width / scale_divisor;
+    m_height = m_common_resources->render_height / scale_divisor;
+
+    m_g_buffer_mip = static_cast<uint32_t>(m_scale);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
 void RayTracedShadows::create_images()
 {
     auto backend = m_backend.lock();
@@ -170,6 +244,16 @@ void RayTracedShadows::create_images()
         m_ray_trace.view->set_name("Shadows Ray Trace");
     }
 
+    // Cache
+    for (int i = 0; i < 2; i++)
+    {
+        m_cache.image[i] = dw::vk::Image::create(backend, VK_IMAGE_TYPE_2D, m_width, m_height, 1, 1, 1, VK_FORMAT_R16G16_SFLOAT, VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT, VK_SAMPLE_COUNT_1_BIT);
+        m_cache.image[i]->set_name("Shadows Cache " + std::to_string(i));
+
+        m_cache.view[i] = dw::vk::ImageView::create(backend, m_cache.image[i], VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT);
+        m_cache.view[i]->set_name("Shadows Cache " + std::to_string(i));
+    }
+
     // Reprojection
     {
         m_temporal_accumulation.current_output_image = dw::vk::Image::create(backend, VK_IMAGE_TYPE_2D, m_width, m_height, 1, 1, 1, VK_FORMAT_R16G16_SFLOAT, VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT, VK_SAMPLE_COUNT_1_BIT);
@@ -194,26 +278,39 @@ void RayTracedShadows::create_images()
         m_temporal_accumulation.prev_view->set_name("Shadows Previous Reprojection");
     }
 
-    // A-Trous Filter
-    for (int i = 0; i < 2; i++)
+    // A-Trous Filter, the ping-pong partner of the output is a render graph transient.
     {
-        m_a_trous.image[i] = dw::vk::Image::create(backend, VK_IMAGE_TYPE_2D, m_width, m_height, 1, 1, 1, VK_FORMAT_R16G16_SFLOAT, VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_SAMPLE_COUNT_1_BIT);
-        m_a_trous.image[i]->set_name("A-Trous Filter " + std::to_string(i));
+        m_a_trous.image = dw::vk::Image::create(backend, VK_IMAGE_TYPE_2D, m_width, m_height, 1, 1, 1, VK_FORMAT_R16G16_SFLOAT, VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_SAMPLE_COUNT_1_BIT);
+        m_a_trous.image->set_name("A-Trous Filter");
 
-        m_a_trous.view[i] = dw::vk::ImageView::create(backend, m_a_trous.image[i], VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT);
-        m_a_trous.view[i]->set_name("A-Trous Filter View " + std::to_string(i));
+        m_a_trous.view = dw::vk::ImageView::create(backend, m_a_trous.image, VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT);
+        m_a_trous.view->set_name("A-Trous Filter View");
     }
 
-    // Upsample
+    // Upsample, the final visibility is in [0, 1] so the low memory tier stores it as R8. The denoiser inputs keep 16 bits, their
+    // variance and moments do not survive 8 bits, and the moments hold the history length in their third channel.
     {
-        auto vk_backend = m_backend.lock();
+        m_upsample.low_memory = m_precision == RENDER_TARGET_PRECISION_LOW_MEMORY && is_storage_image_format_supported(backend, VK_FORMAT_R8_UNORM);
 
-        m_upsample.image = dw::vk::Image::create(backend, VK_IMAGE_TYPE_2D, vk_backend->swap_chain_extents().width, vk_backend->swap_chain_extents().height, 1, 1, 1, VK_FORMAT_R16_SFLOAT, VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT, VK_SAMPLE_COUNT_1_BIT);
+        if (m_precision == RENDER_TARGET_PRECISION_LOW_MEMORY && !m_upsample.low_memory)
+            DW_LOG_INFO("R8 storage images are not supported, Shadows fall back to full precision.");
+
+        m_upsample.image = dw::vk::Image::create(backend, VK_IMAGE_TYPE_2D, m_common_resources->render_width, m_common_resources->render_height, 1, 1, 1, m_upsample.low_memory ? VK_FORMAT_R8_UNORM : VK_FORMAT_R16_SFLOAT, VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT, VK_SAMPLE_COUNT_1_BIT);
         m_upsample.image->set_name("Shadows Upsample");
 
         m_upsample.image_view = dw::vk::ImageView::create(backend, m_upsample.image, VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT);
         m_upsample.image_view->set_name("Shadows Upsample");
     }
+
+    m_common_resources->memory_tracker->track("Shadows", { m_ray_trace.image,
+                                                           m_cache.image[0],
+                                                           m_cache.image[1],
+                                                           m_temporal_accumulation.current_output_image,
+                                                           m_temporal_accumulation.current_moments_image[0],
+                                                           m_temporal_accumulation.current_moments_image[1],
+                                                           m_temporal_accumulation.prev_image,
+                                                           m_a_trous.image,
+                                                           m_upsample.image });
 }
 
 // -----------------------------------------------------------------------------------------------------------------------------------
@@ -223,91 +320,64 @@ void RayTracedShadows::create_buffers()
     auto backend = m_backend.lock();
 
     m_temporal_accumulation.denoise_tile_coords_buffer   = dw::vk::Buffer::create(backend, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sizeof(glm::ivec2) * static_cast<uint32_t>(ceil(float(m_width) / float(TEMPORAL_ACCUMULATION_NUM_THREADS_X))) * static_cast<uint32_t>(ceil(float(m_height) / float(TEMPORAL_ACCUMULATION_NUM_THREADS_Y))), VMA_MEMORY_USAGE_GPU_ONLY, 0);
-    m_temporal_accumulation.denoise_dispatch_args_buffer = dw::vk::Buffer::create(backend, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, sizeof(int32_t) * 3, VMA_MEMORY_USAGE_GPU_ONLY, 0);
+    m_temporal_accumulation.denoise_dispatch_args_buffer = dw::vk::Buffer::create(backend, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, sizeof(int32_t) * 3, VMA_MEMORY_USAGE_GPU_ONLY, 0);
 
     m_temporal_accumulation.shadow_tile_coords_buffer   = dw::vk::Buffer::create(backend, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sizeof(glm::ivec2) * static_cast<uint32_t>(ceil(float(m_width) / float(TEMPORAL_ACCUMULATION_NUM_THREADS_X))) * static_cast<uint32_t>(ceil(float(m_height) / float(TEMPORAL_ACCUMULATION_NUM_THREADS_Y))), VMA_MEMORY_USAGE_GPU_ONLY, 0);
-    m_temporal_accumulation.shadow_dispatch_args_buffer = dw::vk::Buffer::create(backend, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, sizeof(int32_t) * 3, VMA_MEMORY_USAGE_GPU_ONLY, 0);
+    m_temporal_accumulation.shadow_dispatch_args_buffer = dw::vk::Buffer::create(backend, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, sizeof(int32_t) * 3, VMA_MEMORY_USAGE_GPU_ONLY, 0);
 }
 
 // -----------------------------------------------------------------------------------------------------------------------------------
 
-void RayTracedShadows::create_descriptor_sets()
+void RayTracedShadows::create_descriptor_set_layouts()
 {
     auto backend = m_backend.lock();
 
-    // Ray Trace
-    {
-        m_ray_trace.write_ds = backend->allocate_descriptor_set(m_common_resources->storage_image_ds_layout);
-        m_ray_trace.write_ds->set_name("Shadows Ray Trace Write");
-
-        m_ray_trace.read_ds = backend->allocate_descriptor_set(m_common_resources->combined_sampler_ds_layout);
-        m_ray_trace.read_ds->set_name("Shadows Ray Trace Read");
-    }
-
-    // Reprojection
+    // Indirect Buffer
     {
         dw::vk::DescriptorSetLayout::Desc desc;
 
-        desc.add_binding(0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT);
-        desc.add_binding(1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+        desc.add_binding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+        desc.add_binding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+        desc.add_binding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+        desc.add_binding(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
 
-        m_temporal_accumulation.write_ds_layout = dw::vk::DescriptorSetLayout::create(backend, desc);
+        m_temporal_accumulation.indirect_buffer_ds_layout = dw::vk::DescriptorSetLayout::create(backend, desc);
     }
+}
 
-    {
-        dw::vk::DescriptorSetLayout::Desc desc;
-
-        desc.add_binding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
-        desc.add_binding(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+// -----------------------------------------------------------------------------------------------------------------------------------
 
-        m_temporal_accumulation.read_ds_layout = dw::vk::DescriptorSetLayout::create(backend, desc);
-    }
+void RayTracedShadows::create_descriptor_sets()
+{
+    auto backend = m_backend.lock();
 
-    for (int i = 0; i < 2; i++)
+    // Ray Trace
     {
-        m_temporal_accumulation.current_write_ds[i] = backend->allocate_descriptor_set(m_temporal_accumulation.write_ds_layout);
-        m_temporal_accumulation.current_write_ds[i]->set_name("Temporal Accumulation Write " + std::to_string(i));
-
-        m_temporal_accumulation.current_read_ds[i] = backend->allocate_descriptor_set(m_temporal_accumulation.read_ds_layout);
-        m_temporal_accumulation.current_read_ds[i]->set_name("Temporal Accumulation Read " + std::to_string(i));
-
-        m_temporal_accumulation.prev_read_ds[i] = backend->allocate_descriptor_set(m_temporal_accumulation.read_ds_layout);
-        m_temporal_accumulation.prev_read_ds[i]->set_name("Temporal Accumulation Prev Read " + std::to_string(i));
+        m_ray_trace.read_ds = backend->allocate_descriptor_set(m_common_resources->combined_sampler_ds_layout);
+        m_ray_trace.read_ds->set_name("Shadows Ray Trace Read");
     }
 
+    // Reprojection
     m_temporal_accumulation.output_only_read_ds = backend->allocate_descriptor_set(m_common_resources->combined_sampler_ds_layout);
     m_temporal_accumulation.output_only_read_ds->set_name("Temporal Accumulation Output Only Read");
 
     // Indirect Buffer
     {
-        dw::vk::DescriptorSetLayout::Desc desc;
-
-        desc.add_binding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
-        desc.add_binding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
-        desc.add_binding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
-        desc.add_binding(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
-
-        m_temporal_accumulation.indirect_buffer_ds_layout = dw::vk::DescriptorSetLayout::create(backend, desc);
-
         m_temporal_accumulation.indirect_buffer_ds = backend->allocate_descriptor_set(m_temporal_accumulation.indirect_buffer_ds_layout);
         m_temporal_accumulation.indirect_buffer_ds->set_name("Temporal Accumulation Indirect Buffer");
     }
 
     // A-Trous
-    for (int i = 0; i < 2; i++)
     {
-        m_a_trous.read_ds[i] = backend->allocate_descriptor_set(m_common_resources->combined_sampler_ds_layout);
-        m_a_trous.read_ds[i]->set_name("A-Trous Read " + std::to_string(i));
+        m_a_trous.read_ds = backend->allocate_descriptor_set(m_common_resources->combined_sampler_ds_layout);
+        m_a_trous.read_ds->set_name("A-Trous Read");
 
-        m_a_trous.write_ds[i] = backend->allocate_descriptor_set(m_common_resources->storage_image_ds_layout);
-        m_a_trous.write_ds[i]->set_name("A-Trous Write " + std::to_string(i));
+        m_a_trous.write_ds = backend->allocate_descriptor_set(m_common_resources->storage_image_ds_layout);
+        m_a_trous.write_ds->set_name("A-Trous Write");
     }
 
     // Upsample
     {
-        m_upsample.write_ds = backend->allocate_descriptor_set(m_common_resources->storage_image_ds_layout);
-        m_upsample.write_ds->set_name("Shadows Upsample Write");
-
         m_upsample.read_ds = backend->allocate_descriptor_set(m_common_resources->combined_sampler_ds_layout);
         m_upsample.read_ds->set_name("Shadows Upsample Read");
     }
@@ -319,37 +389,6 @@ void RayTracedShadows::write_descriptor_sets()
 {
     auto backend = m_backend.lock();
 
-    // Ray Trace Write
-    {
-        std::vector<VkDescriptorImageInfo> image_infos;
-        std::vector<VkWriteDescriptorSet>  write_datas;
-        VkWriteDescriptorSet               write_data;
-
-        image_infos.reserve(1);
-        write_datas.reserve(1);
-
-        VkDescriptorImageInfo storage_image_info;
-
-        storage_image_info.sampler     = VK_NULL_HANDLE;
-        storage_image_info.imageView   = m_ray_trace.view->handle();
-        storage_image_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
-
-        image_infos.push_back(storage_image_info);
-
-        DW_ZERO_MEMORY(write_data);
-
-        write_data.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        write_data.descriptorCount = 1;
-        write_data.descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
-        write_data.pImageInfo      = &image_infos.back();
-        write_data.dstBinding      = 0;
-        write_data.dstSet          = m_ray_trace.write_ds->handle();
-
-        write_datas.push_back(write_data);
-
-        vkUpdateDescriptorSets(backend->device(), write_datas.size(), write_datas.data(), 0, nullptr);
-    }
-
     // Ray Trace Read
     {
         std::vector<VkDescriptorImageInfo> image_infos;
@@ -412,171 +451,6 @@ void RayTracedShadows::write_descriptor_sets()
         vkUpdateDescriptorSets(backend->device(), write_datas.size(), write_datas.data(), 0, nullptr);
     }
 
-    // Reprojection Current Write
-    for (int i = 0; i < 2; i++)
-    {
-        std::vector<VkDescriptorImageInfo> image_infos;
-        std::vector<VkWriteDescriptorSet>  write_datas;
-        VkWriteDescriptorSet               write_data;
-
-        image_infos.reserve(2);
-        write_datas.reserve(2);
-
-        {
-            VkDescriptorImageInfo storage_image_info;
-
-            storage_image_info.sampler     = VK_NULL_HANDLE;
-            storage_image_info.imageView   = m_temporal_accumulation.current_output_view->handle();
-            storage_image_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
-
-            image_infos.push_back(storage_image_info);
-
-            DW_ZERO_MEMORY(write_data);
-
-            write_data.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            write_data.descriptorCount = 1;
-            write_data.descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
-            write_data.pImageInfo      = &image_infos.back();
-            write_data.dstBinding      = 0;
-            write_data.dstSet          = m_temporal_accumulation.current_write_ds[i]->handle();
-
-            write_datas.push_back(write_data);
-        }
-
-        {
-            VkDescriptorImageInfo storage_image_info;
-
-            storage_image_info.sampler     = VK_NULL_HANDLE;
-            storage_image_info.imageView   = m_temporal_accumulation.current_moments_view[i]->handle();
-            storage_image_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
-
-            image_infos.push_back(storage_image_info);
-
-            DW_ZERO_MEMORY(write_data);
-
-            write_data.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            write_data.descriptorCount = 1;
-            write_data.descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
-            write_data.pImageInfo      = &image_infos.back();
-            write_data.dstBinding      = 1;
-            write_data.dstSet          = m_temporal_accumulation.current_write_ds[i]->handle();
-
-            write_datas.push_back(write_data);
-        }
-
-        vkUpdateDescriptorSets(backend->device(), write_datas.size(), write_datas.data(), 0, nullptr);
-    }
-
-    // Reprojection Current Read
-    for (int i = 0; i < 2; i++)
-    {
-        std::vector<VkDescriptorImageInfo> image_infos;
-        std::vector<VkWriteDescriptorSet>  write_datas;
-        VkWriteDescriptorSet               write_data;
-
-        image_infos.reserve(2);
-        write_datas.reserve(2);
-
-        {
-            VkDescriptorImageInfo sampler_image_info;
-
-            sampler_image_info.sampler     = backend->nearest_sampler()->handle();
-            sampler_image_info.imageView   = m_temporal_accumulation.current_output_view->handle();
-            sampler_image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-
-            image_infos.push_back(sampler_image_info);
-
-            DW_ZERO_MEMORY(write_data);
-
-            write_data.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            write_data.descriptorCount = 1;
-            write_data.descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-            write_data.pImageInfo      = &image_infos.back();
-            write_data.dstBinding      = 0;
-            write_data.dstSet          = m_temporal_accumulation.current_read_ds[i]->handle();
-
-            write_datas.push_back(write_data);
-        }
-
-        {
-            VkDescriptorImageInfo sampler_image_info;
-
-            sampler_image_info.sampler     = backend->nearest_sampler()->handle();
-            sampler_image_info.imageView   = m_temporal_accumulation.current_moments_view[i]->handle();
-            sampler_image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-
-            image_infos.push_back(sampler_image_info);
-
-            DW_ZERO_MEMORY(write_data);
-
-            write_data.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            write_data.descriptorCount = 1;
-            write_data.descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-            write_data.pImageInfo      = &image_infos.back();
-            write_data.dstBinding      = 1;
-            write_data.dstSet          = m_temporal_accumulation.current_read_ds[i]->handle();
-
-            write_datas.push_back(write_data);
-        }
-
-        vkUpdateDescriptorSets(backend->device(), write_datas.size(), write_datas.data(), 0, nullptr);
-    }
-
-    // Reprojection Prev Read
-    for (int i = 0; i < 2; i++)
-    {
-        std::vector<VkDescriptorImageInfo> image_infos;
-        std::vector<VkWriteDescriptorSet>  write_datas;
-        VkWriteDescriptorSet               write_data;
-
-        image_infos.reserve(2);
-        write_datas.reserve(2);
-
-        {
-            VkDescriptorImageInfo sampler_image_info;
-
-            sampler_image_info.sampler     = backend->nearest_sampler()->handle();
-            sampler_image_info.imageView   = m_temporal_accumulation.prev_view->handle();
-            sampler_image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-
-            image_infos.push_back(sampler_image_info);
-
-            DW_ZERO_MEMORY(write_data);
-
-            write_data.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            write_data.descriptorCount = 1;
-            write_data.descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-            write_data.pImageInfo      = &image_infos.back();
-            write_data.dstBinding      = 0;
-            write_data.dstSet          = m_temporal_accumulation.prev_read_ds[i]->handle();
-
-            write_datas.push_back(write_data);
-        }
-
-        {
-            VkDescriptorImageInfo sampler_image_info;
-
-            sampler_image_info.sampler     = backend->nearest_sampler()->handle();
-            sampler_image_info.imageView   = m_temporal_accumulation.current_moments_view[i]->handle();
-            sampler_image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-
-            image_infos.push_back(sampler_image_info);
-
-            DW_ZERO_MEMORY(write_data);
-
-            write_data.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            write_data.descriptorCount = 1;
-            write_data.descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-            write_data.pImageInfo      = &image_infos.back();
-            write_data.dstBinding      = 1;
-            write_data.dstSet          = m_temporal_accumulation.prev_read_ds[i]->handle();
-
-            write_datas.push_back(write_data);
-        }
-
-        vkUpdateDescriptorSets(backend->device(), write_datas.size(), write_datas.data(), 0, nullptr);
-    }
-
     // Indirect Buffer
     {
         std::vector<VkDescriptorBufferInfo> buffer_infos;
@@ -673,98 +547,55 @@ void RayTracedShadows::write_descriptor_sets()
         vkUpdateDescriptorSets(backend->device(), write_datas.size(), write_datas.data(), 0, nullptr);
     }
 
-    // A-Trous write
+    // A-Trous
     {
-        std::vector<VkDescriptorImageInfo> image_infos;
-        std::vector<VkWriteDescriptorSet>  write_datas;
-        VkWriteDescriptorSet               write_data;
-
-        image_infos.reserve(2);
-        write_datas.reserve(2);
-
-        for (int i = 0; i < 2; i++)
+        // write
         {
             VkDescriptorImageInfo storage_image_info;
 
             storage_image_info.sampler     = VK_NULL_HANDLE;
-            storage_image_info.imageView   = m_a_trous.view[i]->handle();
+            storage_image_info.imageView   = m_a_trous.view->handle();
             storage_image_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
 
-            image_infos.push_back(storage_image_info);
+            VkWriteDescriptorSet write_data;
 
             DW_ZERO_MEMORY(write_data);
 
             write_data.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
             write_data.descriptorCount = 1;
             write_data.descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
-            write_data.pImageInfo      = &image_infos.back();
+            write_data.pImageInfo      = &storage_image_info;
             write_data.dstBinding      = 0;
-            write_data.dstSet          = m_a_trous.write_ds[i]->handle();
+            write_data.dstSet          = m_a_trous.write_ds->handle();
 
-            write_datas.push_back(write_data);
+            vkUpdateDescriptorSets(backend->device(), 1, &write_data, 0, nullptr);
         }
 
-        vkUpdateDescriptorSets(backend->device(), write_datas.size(), write_datas.data(), 0, nullptr);
-    }
-
-    // A-Trous read
-    {
-        std::vector<VkDescriptorImageInfo> image_infos;
-        std::vector<VkWriteDescriptorSet>  write_datas;
-        VkWriteDescriptorSet               write_data;
-
-        image_infos.reserve(2);
-        write_datas.reserve(2);
-
-        for (int i = 0; i < 2; i++)
+        // read
         {
             VkDescriptorImageInfo sampler_image_info;
 
             sampler_image_info.sampler     = backend->nearest_sampler()->handle();
-            sampler_image_info.imageView   = m_a_trous.view[i]->handle();
+            sampler_image_info.imageView   = m_a_trous.view->handle();
             sampler_image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
-            image_infos.push_back(sampler_image_info);
+            VkWriteDescriptorSet write_data;
 
             DW_ZERO_MEMORY(write_data);
 
             write_data.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
             write_data.descriptorCount = 1;
             write_data.descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-            write_data.pImageInfo      = &image_infos.back();
+            write_data.pImageInfo      = &sampler_image_info;
             write_data.dstBinding      = 0;
-            write_data.dstSet          = m_a_trous.read_ds[i]->handle();
+            write_data.dstSet          = m_a_trous.read_ds->handle();
 
-            write_datas.push_back(write_data);
+            vkUpdateDescriptorSets(backend->device(), 1, &write_data, 0, nullptr);
         }
-
-        vkUpdateDescriptorSets(backend->device(), write_datas.size(), write_datas.data(), 0, nullptr);
     }
 
     // Upsample
     {
-        // write
-        {
-            VkDescriptorImageInfo storage_image_info;
-
-            storage_image_info.sampler     = VK_NULL_HANDLE;
-            storage_image_info.imageView   = m_upsample.image_view->handle();
-            storage_image_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
-
-            VkWriteDescriptorSet write_data;
-
-            DW_ZERO_MEMORY(write_data);
-
-            write_data.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            write_data.descriptorCount = 1;
-            write_data.descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
-            write_data.pImageInfo      = &storage_image_info;
-            write_data.dstBinding      = 0;
-            write_data.dstSet          = m_upsample.write_ds->handle();
-
-            vkUpdateDescriptorSets(backend->device(), 1, &write_data, 0, nullptr);
-        }
-
         // read
         {
             VkDescriptorImageInfo sampler_image_info;
@@ -787,6 +618,29 @@ void RayTracedShadows::write_descriptor_sets()
             vkUpdateDescriptorSets(backend->device(), 1, &write_data, 0, nullptr);
         }
     }
+
+    // Bindless, for the passes that index their images instead of binding sets.
+    {
+        BindlessHeap* bindless_heap = m_common_resources->bindless_heap.get();
+
+        m_ray_trace.write_idx = bindless_heap->register_storage_image(m_ray_trace.view);
+        m_ray_trace.read_idx  = bindless_heap->register_sampled_image(m_ray_trace.view, backend->nearest_sampler());
+
+        for (int i = 0; i < 2; i++)
+        {
+            m_cache.write_idx[i] = bindless_heap->register_storage_image(m_cache.view[i]);
+            m_cache.read_idx[i]  = bindless_heap->register_sampled_image(m_cache.view[i], backend->nearest_sampler());
+
+            m_temporal_accumulation.current_moments_write_idx[i] = bindless_heap->register_storage_image(m_temporal_accumulation.current_moments_view[i]);
+            m_temporal_accumulation.current_moments_read_idx[i]  = bindless_heap->register_sampled_image(m_temporal_accumulation.current_moments_view[i], backend->nearest_sampler());
+        }
+
+        m_temporal_accumulation.current_output_write_idx = bindless_heap->register_storage_image(m_temporal_accumulation.current_output_view);
+        m_temporal_accumulation.prev_read_idx            = bindless_heap->register_sampled_image(m_temporal_accumulation.prev_view, backend->nearest_sampler());
+
+        m_a_trous.read_idx   = bindless_heap->register_sampled_image(m_a_trous.view, backend->nearest_sampler());
+        m_upsample.write_idx = bindless_heap->register_storage_image(m_upsample.image_view);
+    }
 }
 
 // -----------------------------------------------------------------------------------------------------------------------------------
@@ -795,29 +649,23 @@ void RayTracedShadows::create_pipelines()
 {
     auto backend = m_backend.lock();
 
+    std::vector<PipelineCache::ComputePipelineDesc> compute_pipelines;
+
     // Ray Trace
     {
-        dw::vk::ShaderModule::Ptr shader_module = dw::vk::ShaderModule::create_from_file(backend, "shaders/shadows_ray_trace.comp.spv");
-
         dw::vk::PipelineLayout::Desc pl_desc;
 
         pl_desc.add_descriptor_set_layout(m_common_resources->current_scene()->descriptor_set_layout());
-        pl_desc.add_descriptor_set_layout(m_common_resources->storage_image_ds_layout);
+        pl_desc.add_descriptor_set_layout(m_common_resources->bindless_heap->ds_layout());
         pl_desc.add_descriptor_set_layout(m_common_resources->per_frame_ds_layout);
-        pl_desc.add_descriptor_set_layout(m_g_buffer->ds_layout());
-        pl_desc.add_descriptor_set_layout(m_common_resources->blue_noise_ds_layout);
+        pl_desc.add_descriptor_set_layout(m_common_resources->gpu_counters->ds_layout());
 
         pl_desc.add_push_constant_range(VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(RayTracePushConstants));
 
         m_ray_trace.pipeline_layout = dw::vk::PipelineLayout::create(backend, pl_desc);
         m_ray_trace.pipeline_layout->set_name("Ray Trace Pipeline Layout");
 
-        dw::vk::ComputePipeline::Desc desc;
-
-        desc.set_shader_stage(shader_module, "main");
-        desc.set_pipeline_layout(m_ray_trace.pipeline_layout);
-
-        m_ray_trace.pipeline = dw::vk::ComputePipeline::create(backend, desc);
+        compute_pipelines.push_back({ "shaders/shadows_ray_trace.comp.spv", m_ray_trace.pipeline_layout, &m_ray_trace.pipeline });
     }
 
     // Reset Args
@@ -829,25 +677,14 @@ void RayTracedShadows::create_pipelines()
         m_reset_args.pipeline_layout = dw::vk::PipelineLayout::create(backend, desc);
         m_reset_args.pipeline_layout->set_name("Reset Args Pipeline Layout");
 
-        dw::vk::ShaderModule::Ptr module = dw::vk::ShaderModule::create_from_file(backend, "shaders/shadows_denoise_reset_args.comp.spv");
-
-        dw::vk::ComputePipeline::Desc comp_desc;
-
-        comp_desc.set_pipeline_layout(m_reset_args.pipeline_layout);
-        comp_desc.set_shader_stage(module, "main");
-
-        m_reset_args.pipeline = dw::vk::ComputePipeline::create(backend, comp_desc);
+        compute_pipelines.push_back({ "shaders/shadows_denoise_reset_args.comp.spv", m_reset_args.pipeline_layout, &m_reset_args.pipeline });
     }
 
     // Reprojection
     {
         dw::vk::PipelineLayout::Desc desc;
 
-        desc.add_descriptor_set_layout(m_temporal_accumulation.write_ds_layout);
-        desc.add_descriptor_set_layout(m_g_buffer->ds_layout());
-        desc.add_descriptor_set_layout(m_g_buffer->ds_layout());
-        desc.add_descriptor_set_layout(m_common_resources->combined_sampler_ds_layout);
-        desc.add_descriptor_set_layout(m_temporal_accumulation.read_ds_layout);
+        desc.add_descriptor_set_layout(m_common_resources->bindless_heap->ds_layout());
         desc.add_descriptor_set_layout(m_common_resources->per_frame_ds_layout);
         desc.add_descriptor_set_layout(m_temporal_accumulation.indirect_buffer_ds_layout);
 
@@ -856,14 +693,7 @@ void RayTracedShadows::create_pipelines()
         m_temporal_accumulation.pipeline_layout = dw::vk::PipelineLayout::create(backend, desc);
         m_temporal_accumulation.pipeline_layout->set_name("Reprojection Pipeline Layout");
 
-        dw::vk::ShaderModule::Ptr module = dw::vk::ShaderModule::create_from_file(backend, "shaders/shadows_denoise_reprojection.comp.spv");
-
-        dw::vk::ComputePipeline::Desc comp_desc;
-
-        comp_desc.set_pipeline_layout(m_temporal_accumulation.pipeline_layout);
-        comp_desc.set_shader_stage(module, "main");
-
-        m_temporal_accumulation.pipeline = dw::vk::ComputePipeline::create(backend, comp_desc);
+        compute_pipelines.push_back({ "shaders/shadows_denoise_reprojection.comp.spv", m_temporal_accumulation.pipeline_layout, &m_temporal_accumulation.pipeline });
     }
 
     // Copy Shadow Tiles
@@ -872,116 +702,216 @@ void RayTracedShadows::create_pipelines()
 
         desc.add_descriptor_set_layout(m_common_resources->storage_image_ds_layout);
         desc.add_descriptor_set_layout(m_temporal_accumulation.indirect_buffer_ds_layout);
+        desc.add_descriptor_set_layout(m_common_resources->combined_sampler_ds_layout);
 
         m_copy_shadow_tiles.pipeline_layout = dw::vk::PipelineLayout::create(backend, desc);
         m_copy_shadow_tiles.pipeline_layout->set_name("Copy Shadow Tiles Pipeline Layout");
 
-        dw::vk::ShaderModule::Ptr module = dw::vk::ShaderModule::create_from_file(backend, "shaders/shadows_denoise_copy_shadow_tiles.comp.spv");
-
-        dw::vk::ComputePipeline::Desc comp_desc;
-
-        comp_desc.set_pipeline_layout(m_copy_shadow_tiles.pipeline_layout);
-        comp_desc.set_shader_stage(module, "main");
-
-        m_copy_shadow_tiles.pipeline = dw::vk::ComputePipeline::create(backend, comp_desc);
+        compute_pipelines.push_back({ "shaders/shadows_denoise_copy_shadow_tiles.comp.spv", m_copy_shadow_tiles.pipeline_layout, &m_copy_shadow_tiles.pipeline });
     }
 
     // A-Trous Filter
+    m_a_trous.denoiser = std::unique_ptr<SVGFDenoiser>(new SVGFDenoiser(m_backend, m_common_resources, m_g_buffer, SVGFDenoiser::SIGNAL_TYPE_VISIBILITY, m_temporal_accumulation.indirect_buffer_ds_layout));
+
+    // Upsample
     {
         dw::vk::PipelineLayout::Desc desc;
 
-        desc.add_descriptor_set_layout(m_common_resources->storage_image_ds_layout);
-        desc.add_descriptor_set_layout(m_common_resources->combined_sampler_ds_layout);
-        desc.add_descriptor_set_layout(m_g_buffer->ds_layout());
-        desc.add_descriptor_set_layout(m_temporal_accumulation.indirect_buffer_ds_layout);
-
-        desc.add_push_constant_range(VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ATrousFilterPushConstants));
+        desc.add_descriptor_set_layout(m_common_resources->bindless_heap->ds_layout());
 
-        m_a_trous.pipeline_layout = dw::vk::PipelineLayout::create(backend, desc);
-        m_a_trous.pipeline_layout->set_name("A-Trous Pipeline Layout");
+        desc.add_push_constant_range(VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(UpsamplePushConstants));
 
-        dw::vk::ShaderModule::Ptr module = dw::vk::ShaderModule::create_from_file(backend, "shaders/shadows_denoise_atrous.comp.spv");
+        m_upsample.layout = dw::vk::PipelineLayout::create(backend, desc);
+        m_upsample.layout->set_name("Shadows Upsample Pipeline Layout");
 
-        dw::vk::ComputePipeline::Desc comp_desc;
+        m_upsample.permutations = std::unique_ptr<ComputePipelinePermutations>(new ComputePipelinePermutations(SHADOWS_UPSAMPLE_CONSTANT_COUNT, [this](const VkSpecializationInfo* specialization_info) {
+            CachedComputePipeline::Ptr pipeline;
 
-        comp_desc.set_pipeline_layout(m_a_trous.pipeline_layout);
-        comp_desc.set_shader_stage(module, "main");
+            m_common_resources->pipeline_cache->create_compute_pipelines({ { "shaders/shadows_upsample.comp.spv", m_upsample.layout, &pipeline, specialization_info } });
 
-        m_a_trous.pipeline = dw::vk::ComputePipeline::create(backend, comp_desc);
+            return pipeline;
+        }));
     }
 
-    // Upsample
-    {
-        dw::vk::PipelineLayout::Desc desc;
+    m_common_resources->pipeline_cache->create_compute_pipelines(compute_pipelines);
+}
 
-        desc.add_descriptor_set_layout(m_common_resources->storage_image_ds_layout);
-        desc.add_descriptor_set_layout(m_common_resources->combined_sampler_ds_layout);
-        desc.add_descriptor_set_layout(m_g_buffer->ds_layout());
+// -----------------------------------------------------------------------------------------------------------------------------------
 
-        desc.add_push_constant_range(VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(UpsamplePushConstants));
+void RayTracedShadows::retire_resources()
+{
+    DeletionQueue* deletion_queue = m_common_resources->deletion_queue.get();
+    BindlessHeap*  bindless_heap  = m_common_resources->bindless_heap.get();
 
-        m_upsample.layout = dw::vk::PipelineLayout::create(backend, desc);
-        m_upsample.layout->set_name("Shadows Upsample Pipeline Layout");
+    deletion_queue->push({ m_ray_trace.image, m_ray_trace.view, m_ray_trace.read_ds });
 
-        dw::vk::ShaderModule::Ptr module = dw::vk::ShaderModule::create_from_file(backend, "shaders/shadows_upsample.comp.spv");
+    bindless_heap->release_storage_image(m_ray_trace.write_idx);
+    bindless_heap->release_sampled_image(m_ray_trace.read_idx);
 
-        dw::vk::ComputePipeline::Desc comp_desc;
+    for (int i = 0; i < 2; i++)
+    {
+        deletion_queue->push({ m_cache.image[i], m_cache.view[i] });
+
+        bindless_heap->release_storage_image(m_cache.write_idx[i]);
+        bindless_heap->release_sampled_image(m_cache.read_idx[i]);
+    }
 
-        comp_desc.set_pipeline_layout(m_upsample.layout);
-        comp_desc.set_shader_stage(module, "main");
+    deletion_queue->push({ m_temporal_accumulation.denoise_tile_coords_buffer,
+                           m_temporal_accumulation.denoise_dispatch_args_buffer,
+                           m_temporal_accumulation.shadow_tile_coords_buffer,
+                           m_temporal_accumulation.shadow_dispatch_args_buffer,
+                           m_temporal_accumulation.current_output_image,
+                           m_temporal_accumulation.current_output_view,
+                           m_temporal_accumulation.prev_image,
+                           m_temporal_accumulation.prev_view,
+                           m_temporal_accumulation.output_only_read_ds,
+                           m_temporal_accumulation.indirect_buffer_ds });
 
-        m_upsample.pipeline = dw::vk::ComputePipeline::create(backend, comp_desc);
+    bindless_heap->release_storage_image(m_temporal_accumulation.current_output_write_idx);
+    bindless_heap->release_sampled_image(m_temporal_accumulation.prev_read_idx);
+
+    for (int i = 0; i < 2; i++)
+    {
+        deletion_queue->push({ m_temporal_accumulation.current_moments_image[i], m_temporal_accumulation.current_moments_view[i] });
+
+        bindless_heap->release_storage_image(m_temporal_accumulation.current_moments_write_idx[i]);
+        bindless_heap->release_sampled_image(m_temporal_accumulation.current_moments_read_idx[i]);
     }
+
+    deletion_queue->push({ m_a_trous.image, m_a_trous.view, m_a_trous.read_ds, m_a_trous.write_ds });
+    deletion_queue->push({ m_upsample.image, m_upsample.image_view, m_upsample.read_ds });
+
+    bindless_heap->release_sampled_image(m_a_trous.read_idx);
+    bindless_heap->release_storage_image(m_upsample.write_idx);
 }
 
 // -----------------------------------------------------------------------------------------------------------------------------------
 
-void RayTracedShadows::clear_images(dw::vk::CommandBuffer::Ptr cmd_buf)
+void RayTracedShadows::setup_render_graph()
 {
+    const bool ping_pong = m_common_resources->ping_pong;
+
+    m_graph->begin(m_queue_type);
+
+    m_graph_resources.ray_trace      = m_graph->import_image(m_ray_trace.image);
+    m_graph_resources.current_output = m_graph->import_image(m_temporal_accumulation.current_output_image);
+    m_graph_resources.prev_output    = m_graph->import_image(m_temporal_accumulation.prev_image);
+
+    for (int i = 0; i < 2; i++)
+    {
+        m_graph_resources.cache[i]           = m_graph->import_image(m_cache.image[i]);
+        m_graph_resources.current_moments[i] = m_graph->import_image(m_temporal_accumulation.current_moments_image[i]);
+    }
+
+    m_graph_resources.a_trous_output      = m_graph->import_image(m_a_trous.image);
+    m_graph_resources.upsample            = m_graph->import_image(m_upsample.image);
+    m_graph_resources.denoise_tile_coords = m_graph->import_buffer(m_temporal_accumulation.denoise_tile_coords_buffer);
+    m_graph_resources.denoise_dispatch    = m_graph->import_buffer(m_temporal_accumulation.denoise_dispatch_args_buffer);
+    m_graph_resources.shadow_tile_coords  = m_graph->import_buffer(m_temporal_accumulation.shadow_tile_coords_buffer);
+    m_graph_resources.shadow_dispatch     = m_graph->import_buffer(m_temporal_accumulation.shadow_dispatch_args_buffer);
+
     if (m_first_frame)
     {
-        VkImageSubresourceRange subresource_range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
-
-        VkClearColorValue color;
-
-        color.float32[0] = 0.0f;
-        color.float32[1] = 0.0f;
-        color.float32[2] = 0.0f;
-        color.float32[3] = 0.0f;
-
-        dw::vk::utilities::set_image_layout(
-            cmd_buf->handle(),
-            m_temporal_accumulation.prev_image->handle(),
-            VK_IMAGE_LAYOUT_UNDEFINED,
-            VK_IMAGE_LAYOUT_GENERAL,
-            subresource_range);
-
-        dw::vk::utilities::set_image_layout(
-            cmd_buf->handle(),
-            m_temporal_accumulation.current_moments_image[!m_common_resources->ping_pong]->handle(),
-            VK_IMAGE_LAYOUT_UNDEFINED,
-            VK_IMAGE_LAYOUT_GENERAL,
-            subresource_range);
-
-        vkCmdClearColorImage(cmd_buf->handle(), m_temporal_accumulation.prev_image->handle(), VK_IMAGE_LAYOUT_GENERAL, &color, 1, &subresource_range);
-        vkCmdClearColorImage(cmd_buf->handle(), m_temporal_accumulation.current_moments_image[!m_common_resources->ping_pong]->handle(), VK_IMAGE_LAYOUT_GENERAL, &color, 1, &subresource_range);
-
-        dw::vk::utilities::set_image_layout(
-            cmd_buf->handle(),
-            m_temporal_accumulation.prev_image->handle(),
-            VK_IMAGE_LAYOUT_GENERAL,
-            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-            subresource_range);
-
-        dw::vk::utilities::set_image_layout(
-            cmd_buf->handle(),
-            m_temporal_accumulation.current_moments_image[!m_common_resources->ping_pong]->handle(),
-            VK_IMAGE_LAYOUT_GENERAL,
-            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-            subresource_range);
+        m_graph->add_pass("Clear History", nullptr)
+            .clear(m_graph_resources.prev_output, glm::vec4(0.0f), RESOURCE_USAGE_SAMPLED)
+            .clear(m_graph_resources.current_moments[!ping_pong], glm::vec4(0.0f), RESOURCE_USAGE_SAMPLED)
+            .clear(m_graph_resources.cache[!ping_pong], glm::vec4(0.0f), RESOURCE_USAGE_SAMPLED);
 
         m_first_frame = false;
     }
+
+    m_graph->add_pass("Ray Trace", [this](dw::vk::CommandBuffer::Ptr cmd_buf) { ray_trace(cmd_buf); })
+        .read(m_graph_resources.cache[!ping_pong])
+        .write(m_graph_resources.cache[ping_pong])
+        .write(m_graph_resources.ray_trace);
+
+    if (m_denoise)
+    {
+        m_graph->add_pass("Reset Args", [this](dw::vk::CommandBuffer::Ptr cmd_buf) { reset_args(cmd_buf); })
+            .write_buffer(m_graph_resources.denoise_tile_coords)
+            .write_buffer(m_graph_resources.denoise_dispatch)
+            .write_buffer(m_graph_resources.shadow_tile_coords)
+            .write_buffer(m_graph_resources.shadow_dispatch);
+
+        m_graph->add_pass("Temporal Accumulation", [this](dw::vk::CommandBuffer::Ptr cmd_buf) { temporal_accumulation(cmd_buf); })
+            .read(m_graph_resources.ray_trace)
+            .read(m_graph_resources.prev_output)
+            .read(m_graph_resources.current_moments[!ping_pong])
+            .write(m_graph_resources.current_output)
+            .write(m_graph_resources.current_moments[ping_pong])
+            .write_buffer(m_graph_resources.denoise_tile_coords)
+            .write_buffer(m_graph_resources.denoise_dispatch, RESOURCE_USAGE_STORAGE_READ_WRITE)
+            .write_buffer(m_graph_resources.shadow_tile_coords)
+            .write_buffer(m_graph_resources.shadow_dispatch, RESOURCE_USAGE_STORAGE_READ_WRITE);
+
+        // Passes alternate between the output image and transients so that the last one lands in the output. Every other pass
+        // gets a transient of its own, their lifetimes never overlap so the graph backs all of them with a single pooled image.
+        RenderGraph::ImageHandle input      = m_graph_resources.current_output;
+        const uint32_t           num_passes = m_a_trous.denoiser->num_passes();
+
+        for (uint32_t i = 0; i < num_passes; i++)
+        {
+            RenderGraph::ImageHandle output = m_graph_resources.a_trous_output;
+
+            if ((num_passes - 1 - i) % 2 == 1)
+                output = m_graph->create_image({ "A-Trous Filter", VK_FORMAT_R16G16_SFLOAT, m_width, m_height, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT });
+
+            m_graph->add_pass("A-Trous Filter " + std::to_string(i), [this, i, input, output](dw::vk::CommandBuffer::Ptr cmd_buf) { a_trous_filter(cmd_buf, i, input, output); })
+                .read(input)
+                .read_buffer(m_graph_resources.denoise_tile_coords)
+                .read_buffer(m_graph_resources.denoise_dispatch, RESOURCE_USAGE_INDIRECT_ARGUMENTS)
+                .read_buffer(m_graph_resources.shadow_tile_coords)
+                .read_buffer(m_graph_resources.shadow_dispatch, RESOURCE_USAGE_INDIRECT_ARGUMENTS)
+                .clear(output, glm::vec4(1.0f));
+
+            if (m_a_trous.denoiser->is_feedback_pass(i))
+            {
+                m_graph->add_pass("Copy Feedback", [this, output](dw::vk::CommandBuffer::Ptr cmd_buf) { copy_feedback(cmd_buf, output); })
+                    .read(output, RESOURCE_USAGE_TRANSFER_SRC)
+                    .write(m_graph_resources.prev_output, RESOURCE_USAGE_TRANSFER_DST);
+            }
+
+            input = output;
+        }
+
+        if (m_scale != RAY_TRACE_SCALE_FULL_RES)
+        {
+            m_graph->add_pass("Upsample", [this](dw::vk::CommandBuffer::Ptr cmd_buf) { upsample(cmd_buf); })
+                .read(m_graph_resources.a_trous_output)
+                .write(m_graph_resources.upsample);
+        }
+
+        m_graph->add_pass("Counters", [this](dw::vk::CommandBuffer::Ptr cmd_buf) { copy_counters(cmd_buf); })
+            .read_buffer(m_graph_resources.denoise_dispatch, RESOURCE_USAGE_TRANSFER_SRC)
+            .read_buffer(m_graph_resources.shadow_dispatch, RESOURCE_USAGE_TRANSFER_SRC);
+    }
+
+    // On the async compute queue the hand-off to the fragment stage happens through a semaphore.
+    m_graph->export_image(output_image(), m_queue_type == QUEUE_TYPE_GRAPHICS ? VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT : VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+RenderGraph::ImageHandle RayTracedShadows::output_image()
+{
+    if (m_denoise)
+    {
+        if (m_current_output == OUTPUT_RAY_TRACE)
+            return m_graph_resources.ray_trace;
+        else if (m_current_output == OUTPUT_TEMPORAL_ACCUMULATION)
+            return m_graph_resources.current_output;
+        else if (m_current_output == OUTPUT_ATROUS)
+            return m_graph_resources.a_trous_output;
+        else
+        {
+            if (m_scale == RAY_TRACE_SCALE_FULL_RES)
+                return m_graph_resources.a_trous_output;
+            else
+                return m_graph_resources.upsample;
+        }
+    }
+    else
+        return m_graph_resources.ray_trace;
 }
 
 // -----------------------------------------------------------------------------------------------------------------------------------
@@ -989,28 +919,33 @@ void RayTracedShadows::clear_images(dw::vk::CommandBuffer::Ptr cmd_buf)
 void RayTracedShadows::ray_trace(dw::vk::CommandBuffer::Ptr cmd_buf)
 {
     DW_SCOPED_SAMPLE("Ray Trace", cmd_buf);
+    GPU_SCOPED_TIMER("Shadows Ray Trace", cmd_buf, m_common_resources->gpu_timer.get());
 
     auto backend = m_backend.lock();
 
-    VkImageSubresourceRange subresource_range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
-
-    std::vector<VkMemoryBarrier> memory_barriers = {
-        memory_barrier(VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT)
-    };
+    vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_ray_trace.pipeline->handle());
 
-    std::vector<VkImageMemoryBarrier> image_barriers = {
-        image_memory_barrier(m_ray_trace.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, subresource_range, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT)
-    };
+    const bool ping_pong = m_common_resources->ping_pong;
 
-    pipeline_barrier(cmd_buf, memory_barriers, image_barriers, {}, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+    RayTracePushConstants push_constants;
 
-    vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_ray_trace.pipeline->handle());
+    push_constants.g_buffer               = m_g_buffer->output_bindless_indices();
+    push_constants.prev_g_buffer          = m_g_buffer->history_bindless_indices();
+    push_constants.bias                   = m_ray_trace.bias;
+    push_constants.num_frames             = m_common_resources->num_frames;
+    push_constants.g_buffer_mip           = m_g_buffer_mip;
+    push_constants.sobol_idx              = m_common_resources->blue_noise_sobol_idx;
+    push_constants.scrambling_ranking_idx = m_common_resources->blue_noise_scrambling_ranking_idx[BLUE_NOISE_1SPP];
+    push_constants.history_cache_idx      = m_cache.read_idx[!ping_pong];
+    push_constants.cache_idx              = m_cache.write_idx[ping_pong];
+    push_constants.output_idx             = m_ray_trace.write_idx;
 
-    RayTracePushConstants push_constants;
+    // The cache is rebuilt from scratch on the frame after the light or the TLAS changed, which is when it was invalidated.
+    push_constants.use_cache            = static_cast<uint32_t>(m_cache.enabled && m_cache.valid);
+    push_constants.refresh_fraction     = m_cache.refresh_fraction;
+    push_constants.confident_run_length = float(m_cache.confident_run_length);
 
-    push_constants.bias         = m_ray_trace.bias;
-    push_constants.num_frames   = m_common_resources->num_frames;
-    push_constants.g_buffer_mip = m_g_buffer_mip;
+    m_cache.valid = true;
 
     vkCmdPushConstants(cmd_buf->handle(), m_ray_trace.pipeline_layout->handle(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_constants), &push_constants);
 
@@ -1018,22 +953,14 @@ void RayTracedShadows::ray_trace(dw::vk::CommandBuffer::Ptr cmd_buf)
 
     VkDescriptorSet descriptor_sets[] = {
         m_common_resources->current_scene()->descriptor_set()->handle(),
-        m_ray_trace.write_ds->handle(),
+        m_common_resources->bindless_heap->ds(),
         m_common_resources->per_frame_ds->handle(),
-        m_g_buffer->output_ds()->handle(),
-        m_common_resources->blue_noise_ds[BLUE_NOISE_1SPP]->handle()
+        m_common_resources->gpu_counters->current_ds()->handle()
     };
 
-    vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_ray_trace.pipeline_layout->handle(), 0, 5, descriptor_sets, 1, &dynamic_offset);
+    vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_ray_trace.pipeline_layout->handle(), 0, 4, descriptor_sets, 1, &dynamic_offset);
 
     vkCmdDispatch(cmd_buf->handle(), static_cast<uint32_t>(ceil(float(m_width) / float(RAY_TRACE_NUM_THREADS_X))), static_cast<uint32_t>(ceil(float(m_height) / float(RAY_TRACE_NUM_THREADS_Y))), 1);
-
-    dw::vk::utilities::set_image_layout(
-        cmd_buf->handle(),
-        m_ray_trace.image->handle(),
-        VK_IMAGE_LAYOUT_GENERAL,
-        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-        subresource_range);
 }
 
 // -----------------------------------------------------------------------------------------------------------------------------------
@@ -1042,17 +969,6 @@ void RayTracedShadows::reset_args(dw::vk::CommandBuffer::Ptr cmd_buf)
 {
     DW_SCOPED_SAMPLE("Reset Args", cmd_buf);
 
-    {
-        std::vector<VkBufferMemoryBarrier> buffer_barriers = {
-            buffer_memory_barrier(m_temporal_accumulation.denoise_tile_coords_buffer, 0, VK_WHOLE_SIZE, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT),
-            buffer_memory_barrier(m_temporal_accumulation.denoise_dispatch_args_buffer, 0, VK_WHOLE_SIZE, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT),
-            buffer_memory_barrier(m_temporal_accumulation.shadow_tile_coords_buffer, 0, VK_WHOLE_SIZE, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT),
-            buffer_memory_barrier(m_temporal_accumulation.shadow_dispatch_args_buffer, 0, VK_WHOLE_SIZE, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT)
-        };
-
-        pipeline_barrier(cmd_buf, {}, {}, buffer_barriers, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
-    }
-
     vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_reset_args.pipeline->handle());
 
     VkDescriptorSet descriptor_sets[] = {
@@ -1069,240 +985,102 @@ void RayTracedShadows::reset_args(dw::vk::CommandBuffer::Ptr cmd_buf)
 void RayTracedShadows::temporal_accumulation(dw::vk::CommandBuffer::Ptr cmd_buf)
 {
     DW_SCOPED_SAMPLE("Temporal Accumulation", cmd_buf);
+    GPU_SCOPED_TIMER("Shadows Temporal Accumulation", cmd_buf, m_common_resources->gpu_timer.get());
 
     auto backend = m_backend.lock();
 
-    VkImageSubresourceRange subresource_range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
-
-    {
-        std::vector<VkMemoryBarrier> memory_barriers = {
-            memory_barrier(VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT)
-        };
-
-        std::vector<VkImageMemoryBarrier> image_barriers = {
-            image_memory_barrier(m_temporal_accumulation.current_output_image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, subresource_range, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT),
-            image_memory_barrier(m_temporal_accumulation.current_moments_image[m_common_resources->ping_pong], VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, subresource_range, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT)
-        };
-
-        std::vector<VkBufferMemoryBarrier> buffer_barriers = {
-            buffer_memory_barrier(m_temporal_accumulation.denoise_tile_coords_buffer, 0, VK_WHOLE_SIZE, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_WRITE_BIT),
-            buffer_memory_barrier(m_temporal_accumulation.denoise_dispatch_args_buffer, 0, VK_WHOLE_SIZE, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_WRITE_BIT),
-            buffer_memory_barrier(m_temporal_accumulation.shadow_tile_coords_buffer, 0, VK_WHOLE_SIZE, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_WRITE_BIT),
-            buffer_memory_barrier(m_temporal_accumulation.shadow_dispatch_args_buffer, 0, VK_WHOLE_SIZE, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_WRITE_BIT)
-        };
-
-        pipeline_barrier(cmd_buf, memory_barriers, image_barriers, buffer_barriers, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
-    }
-
     vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_temporal_accumulation.pipeline->handle());
 
+    const bool ping_pong = m_common_resources->ping_pong;
+
     TemporalAccumulationPushConstants push_constants;
 
-    push_constants.alpha         = m_temporal_accumulation.alpha;
-    push_constants.moments_alpha = m_temporal_accumulation.moments_alpha;
-    push_constants.g_buffer_mip  = m_g_buffer_mip;
+    push_constants.g_buffer            = m_g_buffer->output_bindless_indices();
+    push_constants.prev_g_buffer       = m_g_buffer->history_bindless_indices();
+    push_constants.alpha               = m_temporal_accumulation.alpha;
+    push_constants.moments_alpha       = m_temporal_accumulation.moments_alpha;
+    push_constants.g_buffer_mip        = m_g_buffer_mip;
+    push_constants.input_idx           = m_ray_trace.read_idx;
+    push_constants.history_output_idx  = m_temporal_accumulation.prev_read_idx;
+    push_constants.history_moments_idx = m_temporal_accumulation.current_moments_read_idx[!ping_pong];
+    push_constants.output_idx          = m_temporal_accumulation.current_output_write_idx;
+    push_constants.moments_idx         = m_temporal_accumulation.current_moments_write_idx[ping_pong];
 
     vkCmdPushConstants(cmd_buf->handle(), m_temporal_accumulation.pipeline_layout->handle(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_constants), &push_constants);
 
     VkDescriptorSet descriptor_sets[] = {
-        m_temporal_accumulation.current_write_ds[m_common_resources->ping_pong]->handle(),
-        m_g_buffer->output_ds()->handle(),
-        m_g_buffer->history_ds()->handle(),
-        m_ray_trace.read_ds->handle(),
-        m_temporal_accumulation.prev_read_ds[!m_common_resources->ping_pong]->handle(),
+        m_common_resources->bindless_heap->ds(),
         m_common_resources->per_frame_ds->handle(),
         m_temporal_accumulation.indirect_buffer_ds->handle()
     };
 
     const uint32_t dynamic_offset = m_common_resources->ubo_size * backend->current_frame_idx();
 
-    vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_temporal_accumulation.pipeline_layout->handle(), 0, 7, descriptor_sets, 1, &dynamic_offset);
+    vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_temporal_accumulation.pipeline_layout->handle(), 0, 3, descriptor_sets, 1, &dynamic_offset);
 
     vkCmdDispatch(cmd_buf->handle(), static_cast<uint32_t>(ceil(float(m_width) / float(TEMPORAL_ACCUMULATION_NUM_THREADS_X))), static_cast<uint32_t>(ceil(float(m_height) / float(TEMPORAL_ACCUMULATION_NUM_THREADS_Y))), 1);
-
-    {
-        std::vector<VkMemoryBarrier> memory_barriers = {
-            memory_barrier(VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT)
-        };
-
-        std::vector<VkImageMemoryBarrier> image_barriers = {
-            image_memory_barrier(m_temporal_accumulation.current_output_image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, subresource_range, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT),
-            image_memory_barrier(m_temporal_accumulation.current_moments_image[m_common_resources->ping_pong], VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, subresource_range, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT)
-        };
-
-        std::vector<VkBufferMemoryBarrier> buffer_barriers = {
-            buffer_memory_barrier(m_temporal_accumulation.denoise_tile_coords_buffer, 0, VK_WHOLE_SIZE, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT),
-            buffer_memory_barrier(m_temporal_accumulation.denoise_dispatch_args_buffer, 0, VK_WHOLE_SIZE, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT),
-            buffer_memory_barrier(m_temporal_accumulation.shadow_tile_coords_buffer, 0, VK_WHOLE_SIZE, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT),
-            buffer_memory_barrier(m_temporal_accumulation.shadow_dispatch_args_buffer, 0, VK_WHOLE_SIZE, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT)
-        };
-
-        pipeline_barrier(cmd_buf, memory_barriers, image_barriers, buffer_barriers, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT);
-    }
 }
 
 // -----------------------------------------------------------------------------------------------------------------------------------
 
-void RayTracedShadows::a_trous_filter(dw::vk::CommandBuffer::Ptr cmd_buf)
+void RayTracedShadows::a_trous_filter(dw::vk::CommandBuffer::Ptr cmd_buf, uint32_t pass, RenderGraph::ImageHandle input, RenderGraph::ImageHandle output)
 {
-    DW_SCOPED_SAMPLE("A-Trous Filter", cmd_buf);
+    DW_SCOPED_SAMPLE("A-Trous Filter " + std::to_string(pass), cmd_buf);
+    GPU_SCOPED_TIMER("Shadows A-Trous", cmd_buf, m_common_resources->gpu_timer.get());
 
-    VkImageSubresourceRange subresource_range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+    dw::vk::DescriptorSet::Ptr write_ds = output == m_graph_resources.a_trous_output ? m_a_trous.write_ds : m_graph->write_ds(output);
+    dw::vk::DescriptorSet::Ptr read_ds;
 
-    bool    ping_pong = false;
-    int32_t read_idx  = 0;
-    int32_t write_idx = 1;
+    if (input == m_graph_resources.current_output)
+        read_ds = m_temporal_accumulation.output_only_read_ds;
+    else if (input == m_graph_resources.a_trous_output)
+        read_ds = m_a_trous.read_ds;
+    else
+        read_ds = m_graph->read_ds(input);
 
-    for (int i = 0; i < m_a_trous.filter_iterations; i++)
     {
-        read_idx  = (int32_t)ping_pong;
-        write_idx = (int32_t)!ping_pong;
-
-        if (i == 0)
-        {
-            std::vector<VkImageMemoryBarrier> image_barriers = {
-                image_memory_barrier(m_a_trous.image[write_idx], VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, subresource_range, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT)
-            };
-
-            pipeline_barrier(cmd_buf, {}, image_barriers, {}, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT);
-        }
-        else
-        {
-            std::vector<VkImageMemoryBarrier> image_barriers = {
-                image_memory_barrier(m_a_trous.image[read_idx], VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, subresource_range, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT),
-                image_memory_barrier(m_a_trous.image[write_idx], VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, subresource_range, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT)
-            };
-
-            pipeline_barrier(cmd_buf, {}, image_barriers, {}, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT);
-        }
-
-        {
-            VkImageSubresourceRange subresource_range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
-
-            VkClearColorValue color;
-
-            color.float32[0] = 1.0f;
-            color.float32[1] = 1.0f;
-            color.float32[2] = 1.0f;
-            color.float32[3] = 1.0f;
-
-            vkCmdClearColorImage(cmd_buf->handle(), m_a_trous.image[write_idx]->handle(), VK_IMAGE_LAYOUT_GENERAL, &color, 1, &subresource_range);
-
-            std::vector<VkImageMemoryBarrier> image_barriers = {
-                image_memory_barrier(m_a_trous.image[write_idx], VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL, subresource_range, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_WRITE_BIT)
-            };
-
-            pipeline_barrier(cmd_buf, {}, image_barriers, {}, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
-        }
-
-        {
-            DW_SCOPED_SAMPLE("Copy Shadow Tiles", cmd_buf);
-
-            vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_copy_shadow_tiles.pipeline->handle());
-
-            VkDescriptorSet descriptor_sets[] = {
-                m_a_trous.write_ds[write_idx]->handle(),
-                m_temporal_accumulation.indirect_buffer_ds->handle()
-            };
+        DW_SCOPED_SAMPLE("Copy Shadow Tiles", cmd_buf);
 
-            vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_copy_shadow_tiles.pipeline_layout->handle(), 0, 2, descriptor_sets, 0, nullptr);
+        vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_copy_shadow_tiles.pipeline->handle());
 
-            vkCmdDispatchIndirect(cmd_buf->handle(), m_temporal_accumulation.shadow_dispatch_args_buffer->handle(), 0);
-        }
-
-        {
-            DW_SCOPED_SAMPLE("Iteration " + std::to_string(i), cmd_buf);
-
-            vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_a_trous.pipeline->handle());
-
-            ATrousFilterPushConstants push_constants;
-
-            push_constants.radius         = m_a_trous.radius;
-            push_constants.step_size      = 1 << i;
-            push_constants.phi_visibility = m_a_trous.phi_visibility;
-            push_constants.phi_normal     = m_a_trous.phi_normal;
-            push_constants.sigma_depth    = m_a_trous.sigma_depth;
-            push_constants.g_buffer_mip   = m_g_buffer_mip;
-            push_constants.power          = i == (m_a_trous.filter_iterations - 1) ? m_a_trous.power : 0.0f;
-
-            vkCmdPushConstants(cmd_buf->handle(), m_a_trous.pipeline_layout->handle(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_constants), &push_constants);
-
-            VkDescriptorSet descriptor_sets[] = {
-                m_a_trous.write_ds[write_idx]->handle(),
-                i == 0 ? m_temporal_accumulation.output_only_read_ds->handle() : m_a_trous.read_ds[read_idx]->handle(),
-                m_g_buffer->output_ds()->handle(),
-                m_temporal_accumulation.indirect_buffer_ds->handle()
-            };
-
-            vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_a_trous.pipeline_layout->handle(), 0, 4, descriptor_sets, 0, nullptr);
-
-            vkCmdDispatchIndirect(cmd_buf->handle(), m_temporal_accumulation.denoise_dispatch_args_buffer->handle(), 0);
-        }
+        VkDescriptorSet descriptor_sets[] = {
+            write_ds->handle(),
+            m_temporal_accumulation.indirect_buffer_ds->handle(),
+            read_ds->handle()
+        };
 
-        ping_pong = !ping_pong;
+        vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_copy_shadow_tiles.pipeline_layout->handle(), 0, 3, descriptor_sets, 0, nullptr);
 
-        if (m_a_trous.feedback_iteration == i)
-        {
-            dw::vk::utilities::set_image_layout(
-                cmd_buf->handle(),
-                m_a_trous.image[write_idx]->handle(),
-                VK_IMAGE_LAYOUT_GENERAL,
-                VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-                subresource_range);
-
-            dw::vk::utilities::set_image_layout(
-                cmd_buf->handle(),
-                m_temporal_accumulation.prev_image->handle(),
-                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                subresource_range);
-
-            VkImageCopy image_copy_region {};
-            image_copy_region.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-            image_copy_region.srcSubresource.layerCount = 1;
-            image_copy_region.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-            image_copy_region.dstSubresource.layerCount = 1;
-            image_copy_region.extent.width              = m_width;
-            image_copy_region.extent.height             = m_height;
-            image_copy_region.extent.depth              = 1;
-
-            // Issue the copy command
-            vkCmdCopyImage(
-                cmd_buf->handle(),
-                m_a_trous.image[write_idx]->handle(),
-                VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-                m_temporal_accumulation.prev_image->handle(),
-                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                1,
-                &image_copy_region);
-
-            dw::vk::utilities::set_image_layout(
-                cmd_buf->handle(),
-                m_a_trous.image[write_idx]->handle(),
-                VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-                VK_IMAGE_LAYOUT_GENERAL,
-                subresource_range);
-
-            dw::vk::utilities::set_image_layout(
-                cmd_buf->handle(),
-                m_temporal_accumulation.prev_image->handle(),
-                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-                subresource_range);
-        }
+        vkCmdDispatchIndirect(cmd_buf->handle(), m_temporal_accumulation.shadow_dispatch_args_buffer->handle(), 0);
     }
 
-    m_a_trous.read_idx = write_idx;
-
-    std::vector<VkMemoryBarrier> memory_barriers = {
-        memory_barrier(VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT)
-    };
+    m_a_trous.denoiser->filter(cmd_buf, pass, write_ds, read_ds, m_temporal_accumulation.indirect_buffer_ds, m_temporal_accumulation.denoise_dispatch_args_buffer, m_g_buffer_mip);
+}
 
-    std::vector<VkImageMemoryBarrier> image_barriers = {
-        image_memory_barrier(m_a_trous.image[write_idx], VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, subresource_range, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT)
-    };
+// -----------------------------------------------------------------------------------------------------------------------------------
 
-    pipeline_barrier(cmd_buf, memory_barriers, image_barriers, {}, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+void RayTracedShadows::copy_feedback(dw::vk::CommandBuffer::Ptr cmd_buf, RenderGraph::ImageHandle source)
+{
+    DW_SCOPED_SAMPLE("Copy Feedback", cmd_buf);
+
+    VkImageCopy image_copy_region {};
+    image_copy_region.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    image_copy_region.srcSubresource.layerCount = 1;
+    image_copy_region.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    image_copy_region.dstSubresource.layerCount = 1;
+    image_copy_region.extent.width              = m_width;
+    image_copy_region.extent.height             = m_height;
+    image_copy_region.extent.depth              = 1;
+
+    // Issue the copy command
+    vkCmdCopyImage(
+        cmd_buf->handle(),
+        m_graph->image(source)->handle(),
+        VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+        m_temporal_accumulation.prev_image->handle(),
+        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        1,
+        &image_copy_region);
 }
 
 // -----------------------------------------------------------------------------------------------------------------------------------
@@ -1311,42 +1089,34 @@ void RayTracedShadows::upsample(dw::vk::CommandBuffer::Ptr cmd_buf)
 {
     DW_SCOPED_SAMPLE("Upsample", cmd_buf);
 
-    VkImageSubresourceRange subresource_range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
-
-    dw::vk::utilities::set_image_layout(
-        cmd_buf->handle(),
-        m_upsample.image->handle(),
-        VK_IMAGE_LAYOUT_UNDEFINED,
-        VK_IMAGE_LAYOUT_GENERAL,
-        subresource_range);
+    const PermutationKey key = permutation_bit(SHADOWS_UPSAMPLE_CONSTANT_LOW_MEMORY, m_upsample.low_memory);
 
-    vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_upsample.pipeline->handle());
+    vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_upsample.permutations->get(key)->handle());
 
     UpsamplePushConstants push_constants;
 
+    push_constants.g_buffer     = m_g_buffer->output_bindless_indices();
     push_constants.g_buffer_mip = m_g_buffer_mip;
+    push_constants.input_idx    = m_a_trous.read_idx;
+    push_constants.output_idx   = m_upsample.write_idx;
 
     vkCmdPushConstants(cmd_buf->handle(), m_upsample.layout->handle(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_constants), &push_constants);
 
-    VkDescriptorSet descriptor_sets[] = {
-        m_upsample.write_ds->handle(),
-        m_a_trous.read_ds[m_a_trous.read_idx]->handle(),
-        m_g_buffer->output_ds()->handle()
-    };
+    VkDescriptorSet ds = m_common_resources->bindless_heap->ds();
 
-    vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_upsample.layout->handle(), 0, 3, descriptor_sets, 0, nullptr);
+    vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_upsample.layout->handle(), 0, 1, &ds, 0, nullptr);
 
     const int NUM_THREADS_X = 32;
     const int NUM_THREADS_Y = 32;
 
     vkCmdDispatch(cmd_buf->handle(), static_cast<uint32_t>(ceil(float(m_upsample.image->width()) / float(NUM_THREADS_X))), static_cast<uint32_t>(ceil(float(m_upsample.image->height()) / float(NUM_THREADS_Y))), 1);
+}
 
-    dw::vk::utilities::set_image_layout(
-        cmd_buf->handle(),
-        m_upsample.image->handle(),
-        VK_IMAGE_LAYOUT_GENERAL,
-        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-        subresource_range);
+// -----------------------------------------------------------------------------------------------------------------------------------
+void RayTracedShadows::copy_counters(dw::vk::CommandBuffer::Ptr cmd_buf)
+{
+    m_common_resources->gpu_counters->copy(cmd_buf, GPU_COUNTER_SHADOW_DENOISE_TILES, m_temporal_accumulation.denoise_dispatch_args_buffer);
+    m_common_resources->gpu_counters->copy(cmd_buf, GPU_COUNTER_SHADOW_SKIPPED_TILES, m_temporal_accumulation.shadow_dispatch_args_buffer);
 }
 
-// -----------------------------------------------------------------------------------------------------------------------------------
\ No newline at end of file
+// -----------------------------------------------------------------------------------------------------------------------------------
@@ -1,6 +1,8 @@
 #pragma once
 
 #include "common.h"
+#include "render_graph.h"
+#include "pipeline_permutations.h"
 
 class GBuffer;
 
@@ -25,43 +27,71 @@ public:
 
     void                       render(dw::vk::CommandBuffer::Ptr cmd_buf);
     void                       gui();
+    void                       set_scale(RayTraceScale scale);
+    void                       set_precision(RenderTargetPrecision precision);
     dw::vk::DescriptorSet::Ptr output_ds();
+    void                       restart_accumulation();
 
-    inline uint32_t      width() { return m_width; }
-    inline uint32_t      height() { return m_height; }
-    inline RayTraceScale scale() { return m_scale; }
-    inline OutputType    current_output() { return m_current_output; }
-    inline void          set_current_output(OutputType current_output) { m_current_output = current_output; }
+    inline uint32_t              width() { return m_width; }
+    inline uint32_t              height() { return m_height; }
+    inline RayTraceScale         scale() { return m_scale; }
+    inline RenderTargetPrecision precision() { return m_precision; }
+    inline OutputType            current_output() { return m_current_output; }
+    inline QueueType             queue_type() { return m_queue_type; }
+    inline void                  set_queue_type(QueueType queue_type) { m_queue_type = queue_type; }
+    inline RenderGraph*          render_graph() { return m_graph.get(); }
+    inline void                  set_current_output(OutputType current_output) { m_current_output = current_output; }
+    inline void                  invalidate_cache() { m_cache.valid = false; }
 
 private:
-    void create_images();
-    void create_buffers();
-    void create_descriptor_sets();
-    void write_descriptor_sets();
-    void create_pipelines();
-    void clear_images(dw::vk::CommandBuffer::Ptr cmd_buf);
-    void ray_trace(dw::vk::CommandBuffer::Ptr cmd_buf);
-    void reset_args(dw::vk::CommandBuffer::Ptr cmd_buf);
-    void temporal_accumulation(dw::vk::CommandBuffer::Ptr cmd_buf);
-    void a_trous_filter(dw::vk::CommandBuffer::Ptr cmd_buf);
-    void upsample(dw::vk::CommandBuffer::Ptr cmd_buf);
+    void                     update_resolution();
+    void                     create_images();
+    void                     create_buffers();
+    void                     create_descriptor_set_layouts();
+    void                     create_descriptor_sets();
+    void                     write_descriptor_sets();
+    void                     create_pipelines();
+    void                     retire_resources();
+    void                     setup_render_graph();
+    RenderGraph::ImageHandle output_image();
+    void                     ray_trace(dw::vk::CommandBuffer::Ptr cmd_buf);
+    void                     reset_args(dw::vk::CommandBuffer::Ptr cmd_buf);
+    void                     temporal_accumulation(dw::vk::CommandBuffer::Ptr cmd_buf);
+    void                     a_trous_filter(dw::vk::CommandBuffer::Ptr cmd_buf, uint32_t pass, RenderGraph::ImageHandle input, RenderGraph::ImageHandle output);
+    void                     copy_feedback(dw::vk::CommandBuffer::Ptr cmd_buf, RenderGraph::ImageHandle source);
+    void                     upsample(dw::vk::CommandBuffer::Ptr cmd_buf);
+    void                     copy_counters(dw::vk::CommandBuffer::Ptr cmd_buf);
 
 private:
     struct RayTrace
     {
-        float                        bias = 0.5f;
-        dw::vk::ComputePipeline::Ptr pipeline;
-        dw::vk::PipelineLayout::Ptr  pipeline_layout;
-        dw::vk::Image::Ptr           image;
-        dw::vk::ImageView::Ptr       view;
-        dw::vk::DescriptorSet::Ptr   write_ds;
-        dw::vk::DescriptorSet::Ptr   read_ds;
+        float                       bias = 0.5f;
+        CachedComputePipeline::Ptr  pipeline;
+        dw::vk::PipelineLayout::Ptr pipeline_layout;
+        dw::vk::Image::Ptr          image;
+        dw::vk::ImageView::Ptr      view;
+        dw::vk::DescriptorSet::Ptr  read_ds;
+        uint32_t                    write_idx = BINDLESS_INVALID_INDEX;
+        uint32_t                    read_idx  = BINDLESS_INVALID_INDEX;
+    };
+
+    // Per pixel visibility of the previous frame, reused through reprojection while the light and the TLAS stay unchanged.
+    struct Cache
+    {
+        bool                   enabled              = false;
+        bool                   valid                = false;
+        float                  refresh_fraction     = 0.05f;
+        int32_t                confident_run_length = 16;
+        dw::vk::Image::Ptr     image[2];
+        dw::vk::ImageView::Ptr view[2];
+        uint32_t               write_idx[2];
+        uint32_t               read_idx[2];
     };
 
     struct ResetArgs
     {
-        dw::vk::PipelineLayout::Ptr  pipeline_layout;
-        dw::vk::ComputePipeline::Ptr pipeline;
+        dw::vk::PipelineLayout::Ptr pipeline_layout;
+        CachedComputePipeline::Ptr  pipeline;
     };
 
     struct TemporalAccumulation
@@ -72,10 +102,8 @@ private:
         dw::vk::Buffer::Ptr              denoise_dispatch_args_buffer;
         dw::vk::Buffer::Ptr              shadow_tile_coords_buffer;
         dw::vk::Buffer::Ptr              shadow_dispatch_args_buffer;
-        dw::vk::ComputePipeline::Ptr     pipeline;
+        CachedComputePipeline::Ptr       pipeline;
         dw::vk::PipelineLayout::Ptr      pipeline_layout;
-        dw::vk::DescriptorSetLayout::Ptr write_ds_layout;
-        dw::vk::DescriptorSetLayout::Ptr read_ds_layout;
         dw::vk::DescriptorSetLayout::Ptr indirect_buffer_ds_layout;
         dw::vk::Image::Ptr               current_output_image;
         dw::vk::Image::Ptr               current_moments_image[2];
@@ -83,61 +111,75 @@ private:
         dw::vk::ImageView::Ptr           current_output_view;
         dw::vk::ImageView::Ptr           current_moments_view[2];
         dw::vk::ImageView::Ptr           prev_view;
-        dw::vk::DescriptorSet::Ptr       current_write_ds[2];
-        dw::vk::DescriptorSet::Ptr       current_read_ds[2];
         dw::vk::DescriptorSet::Ptr       output_only_read_ds;
-        dw::vk::DescriptorSet::Ptr       prev_read_ds[2];
         dw::vk::DescriptorSet::Ptr       indirect_buffer_ds;
+        uint32_t                         current_output_write_idx = BINDLESS_INVALID_INDEX;
+        uint32_t                         current_moments_write_idx[2];
+        uint32_t                         current_moments_read_idx[2];
+        uint32_t                         prev_read_idx = BINDLESS_INVALID_INDEX;
     };
 
     struct CopyShadowTiles
     {
-        dw::vk::PipelineLayout::Ptr  pipeline_layout;
-        dw::vk::ComputePipeline::Ptr pipeline;
+        dw::vk::PipelineLayout::Ptr pipeline_layout;
+        CachedComputePipeline::Ptr  pipeline;
     };
 
     struct ATrous
     {
-        float                        phi_visibility     = 10.0f;
-        float                        phi_normal         = 32.0f;
-        float                        sigma_depth        = 1.0f;
-        float                        power              = 1.2f;
-        int32_t                      radius             = 1;
-        int32_t                      filter_iterations  = 4;
-        int32_t                      feedback_iteration = 1;
-        int32_t                      read_idx           = 0;
-        dw::vk::ComputePipeline::Ptr pipeline;
-        dw::vk::PipelineLayout::Ptr  pipeline_layout;
-        dw::vk::Image::Ptr           image[2];
-        dw::vk::ImageView::Ptr       view[2];
-        dw::vk::DescriptorSet::Ptr   read_ds[2];
-        dw::vk::DescriptorSet::Ptr   write_ds[2];
+        std::unique_ptr<SVGFDenoiser> denoiser;
+        dw::vk::Image::Ptr            image;
+        dw::vk::ImageView::Ptr        view;
+        dw::vk::DescriptorSet::Ptr    read_ds;
+        dw::vk::DescriptorSet::Ptr    write_ds;
+        uint32_t                      read_idx = BINDLESS_INVALID_INDEX;
     };
 
     struct Upsample
     {
-        dw::vk::PipelineLayout::Ptr  layout;
-        dw::vk::ComputePipeline::Ptr pipeline;
-        dw::vk::Image::Ptr           image;
-        dw::vk::ImageView::Ptr       image_view;
-        dw::vk::DescriptorSet::Ptr   read_ds;
-        dw::vk::DescriptorSet::Ptr   write_ds;
+        bool                                         low_memory = false;
+        dw::vk::PipelineLayout::Ptr                  layout;
+        std::unique_ptr<ComputePipelinePermutations> permutations;
+        dw::vk::Image::Ptr                           image;
+        dw::vk::ImageView::Ptr                       image_view;
+        dw::vk::DescriptorSet::Ptr                   read_ds;
+        uint32_t                                     write_idx = BINDLESS_INVALID_INDEX;
+    };
+
+    struct GraphResources
+    {
+        RenderGraph::ImageHandle  ray_trace;
+        RenderGraph::ImageHandle  cache[2];
+        RenderGraph::ImageHandle  current_output;
+        RenderGraph::ImageHandle  current_moments[2];
+        RenderGraph::ImageHandle  prev_output;
+        RenderGraph::ImageHandle  a_trous_output;
+        RenderGraph::ImageHandle  upsample;
+        RenderGraph::BufferHandle denoise_tile_coords;
+        RenderGraph::BufferHandle denoise_dispatch;
+        RenderGraph::BufferHandle shadow_tile_coords;
+        RenderGraph::BufferHandle shadow_dispatch;
     };
 
     std::weak_ptr<dw::vk::Backend> m_backend;
     CommonResources*               m_common_resources;
     GBuffer*                       m_g_buffer;
     RayTraceScale                  m_scale;
+    RenderTargetPrecision          m_precision      = RENDER_TARGET_PRECISION_FULL;
     OutputType                     m_current_output = OUTPUT_UPSAMPLE;
+    QueueType                      m_queue_type     = QUEUE_TYPE_GRAPHICS;
     uint32_t                       m_g_buffer_mip   = 0;
     uint32_t                       m_width;
     uint32_t                       m_height;
     bool                           m_denoise     = true;
     bool                           m_first_frame = true;
     RayTrace                       m_ray_trace;
+    Cache                          m_cache;
     ResetArgs                      m_reset_args;
     TemporalAccumulation           m_temporal_accumulation;
     CopyShadowTiles                m_copy_shadow_tiles;
     ATrous                         m_a_trous;
     Upsample                       m_upsample;
+    std::unique_ptr<RenderGraph>   m_graph;
+    GraphResources                 m_graph_resources;
 };
\ No newline at end of file
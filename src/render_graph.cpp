@@ -0,0 +1,919 @@
+#include "render_graph.h"
+#include "utilities.h"
+#include <algorithm>
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static VkImageLayout usage_layout(ResourceUsage usage)
+{
+    switch (usage)
+    {
+        case RESOURCE_USAGE_SAMPLED:
+            return VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        case RESOURCE_USAGE_TRANSFER_SRC:
+            return VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        case RESOURCE_USAGE_TRANSFER_DST:
+            return VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        case RESOURCE_USAGE_INDIRECT_ARGUMENTS:
+            return VK_IMAGE_LAYOUT_UNDEFINED;
+        default:
+            return VK_IMAGE_LAYOUT_GENERAL;
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static VkAccessFlags usage_access(ResourceUsage usage)
+{
+    switch (usage)
+    {
+        case RESOURCE_USAGE_SAMPLED:
+        case RESOURCE_USAGE_STORAGE_READ:
+            return VK_ACCESS_SHADER_READ_BIT;
+        case RESOURCE_USAGE_STORAGE_WRITE:
+            return VK_ACCESS_SHADER_WRITE_BIT;
+        case RESOURCE_USAGE_STORAGE_READ_WRITE:
+            return VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        case RESOURCE_USAGE_TRANSFER_SRC:
+            return VK_ACCESS_TRANSFER_READ_BIT;
+        case RESOURCE_USAGE_TRANSFER_DST:
+        case RESOURCE_USAGE_CLEAR:
+            return VK_ACCESS_TRANSFER_WRITE_BIT;
+        case RESOURCE_USAGE_INDIRECT_ARGUMENTS:
+            return VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+        default:
+            return 0;
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static VkPipelineStageFlags usage_stages(ResourceUsage usage, VkPipelineStageFlags shader_stages)
+{
+    switch (usage)
+    {
+        case RESOURCE_USAGE_TRANSFER_SRC:
+        case RESOURCE_USAGE_TRANSFER_DST:
+        case RESOURCE_USAGE_CLEAR:
+            return VK_PIPELINE_STAGE_TRANSFER_BIT;
+        case RESOURCE_USAGE_INDIRECT_ARGUMENTS:
+            return VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT;
+        default:
+            return shader_stages;
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static bool usage_writes(ResourceUsage usage)
+{
+    return usage == RESOURCE_USAGE_STORAGE_WRITE || usage == RESOURCE_USAGE_STORAGE_READ_WRITE || usage == RESOURCE_USAGE_TRANSFER_DST || usage == RESOURCE_USAGE_CLEAR;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static VkPipelineStageFlags queue_stages(QueueType queue_type, VkPipelineStageFlags stages)
+{
+    // The async compute queue can only wait on stages it supports, anything submitted to the graphics queue is ordered through
+    // the semaphores between the two queues instead.
+    if (queue_type == QUEUE_TYPE_ASYNC_COMPUTE)
+        stages &= VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+
+    return stages;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+QueueTransfer::QueueTransfer(std::weak_ptr<dw::vk::Backend> backend)
+{
+    auto vk_backend = backend.lock();
+
+    m_queue_families[QUEUE_TYPE_GRAPHICS]      = static_cast<uint32_t>(vk_backend->queue_infos().graphics_queue_index);
+    m_queue_families[QUEUE_TYPE_ASYNC_COMPUTE] = static_cast<uint32_t>(vk_backend->queue_infos().compute_queue_index);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void QueueTransfer::add_image(dw::vk::Image::Ptr image, VkImageLayout layout)
+{
+    // An image in the undefined layout has no contents to keep, the first queue to use it takes ownership implicitly.
+    if (!enabled() || layout == VK_IMAGE_LAYOUT_UNDEFINED)
+        return;
+
+    for (const auto& entry : m_images)
+    {
+        if (entry.first->handle() == image->handle())
+            return;
+    }
+
+    m_images.push_back({ image, layout });
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void QueueTransfer::add_buffer(dw::vk::Buffer::Ptr buffer)
+{
+    if (!enabled())
+        return;
+
+    for (const auto& entry : m_buffers)
+    {
+        if (entry->handle() == buffer->handle())
+            return;
+    }
+
+    m_buffers.push_back(buffer);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void QueueTransfer::release(dw::vk::CommandBuffer::Ptr cmd_buf, QueueType queue_type)
+{
+    record(cmd_buf, queue_type, true);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void QueueTransfer::acquire(dw::vk::CommandBuffer::Ptr cmd_buf, QueueType queue_type)
+{
+    record(cmd_buf, queue_type == QUEUE_TYPE_GRAPHICS ? QUEUE_TYPE_ASYNC_COMPUTE : QUEUE_TYPE_GRAPHICS, false);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void QueueTransfer::clear()
+{
+    m_images.clear();
+    m_buffers.clear();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void QueueTransfer::record(dw::vk::CommandBuffer::Ptr cmd_buf, QueueType src_queue_type, bool release)
+{
+    if (empty())
+        return;
+
+    const uint32_t src_queue_family = m_queue_families[src_queue_type];
+    const uint32_t dst_queue_family = m_queue_families[src_queue_type == QUEUE_TYPE_GRAPHICS ? QUEUE_TYPE_ASYNC_COMPUTE : QUEUE_TYPE_GRAPHICS];
+
+    // The access mask of the half recorded on the other queue is ignored. The semaphore between the submissions orders the two
+    // halves, so the stages only have to chain onto the work on either side of the transfer on its own queue.
+    const VkAccessFlags src_access = release ? VK_ACCESS_MEMORY_WRITE_BIT : 0;
+    const VkAccessFlags dst_access = release ? 0 : VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+
+    VkImageSubresourceRange subresource_range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, VK_REMAINING_MIP_LEVELS, 0, VK_REMAINING_ARRAY_LAYERS };
+
+    std::vector<VkImageMemoryBarrier>  image_barriers;
+    std::vector<VkBufferMemoryBarrier> buffer_barriers;
+
+    for (const auto& entry : m_images)
+        image_barriers.push_back(image_memory_barrier(entry.first, entry.second, entry.second, subresource_range, src_access, dst_access, src_queue_family, dst_queue_family));
+
+    for (const auto& buffer : m_buffers)
+        buffer_barriers.push_back(buffer_memory_barrier(buffer, 0, VK_WHOLE_SIZE, src_access, dst_access, src_queue_family, dst_queue_family));
+
+    pipeline_barrier(cmd_buf, {}, image_barriers, buffer_barriers, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+TransientImagePool::TransientImagePool(std::weak_ptr<dw::vk::Backend> backend, CommonResources* common_resources) :
+    m_backend(backend), m_common_resources(common_resources)
+{
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+TransientImagePool::~TransientImagePool()
+{
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void TransientImagePool::begin_frame()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_current_frame++;
+
+    m_entries.erase(std::remove_if(m_entries.begin(), m_entries.end(), [this](const std::unique_ptr<Entry>& entry) {
+                        return !entry->in_use && (m_current_frame - entry->last_used_frame) > dw::vk::Backend::kMaxFramesInFlight;
+                    }),
+                    m_entries.end());
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+TransientImagePool::Entry* TransientImagePool::acquire(const TransientImageDesc& desc, QueueType queue_type, VkCommandBuffer cmd_buf)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    for (auto& entry : m_entries)
+    {
+        if (!entry->in_use && compatible(entry.get(), desc, queue_type) && (entry->last_used_frame != m_current_frame || entry->last_cmd_buf == cmd_buf))
+        {
+            entry->in_use          = true;
+            entry->last_used_frame = m_current_frame;
+            entry->last_cmd_buf    = cmd_buf;
+
+            return entry.get();
+        }
+    }
+
+    auto backend = m_backend.lock();
+
+    std::unique_ptr<Entry> entry = std::unique_ptr<Entry>(new Entry());
+
+    const std::string name = "Transient " + desc.name + " " + std::to_string(m_num_created++);
+
+    entry->desc       = desc;
+    entry->queue_type = queue_type;
+
+    entry->image = dw::vk::Image::create(backend, VK_IMAGE_TYPE_2D, desc.width, desc.height, 1, 1, 1, desc.format, VMA_MEMORY_USAGE_GPU_ONLY, desc.usage | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT, VK_SAMPLE_COUNT_1_BIT);
+    entry->image->set_name(name);
+
+    entry->view = dw::vk::ImageView::create(backend, entry->image, VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT);
+    entry->view->set_name(name);
+
+    entry->write_ds = backend->allocate_descriptor_set(m_common_resources->storage_image_ds_layout);
+    entry->write_ds->set_name(name + " Write");
+
+    entry->read_ds = backend->allocate_descriptor_set(m_common_resources->combined_sampler_ds_layout);
+    entry->read_ds->set_name(name + " Read");
+
+    // write
+    {
+        VkDescriptorImageInfo storage_image_info;
+
+        storage_image_info.sampler     = VK_NULL_HANDLE;
+        storage_image_info.imageView   = entry->view->handle();
+        storage_image_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+        VkWriteDescriptorSet write_data;
+
+        DW_ZERO_MEMORY(write_data);
+
+        write_data.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write_data.descriptorCount = 1;
+        write_data.descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        write_data.pImageInfo      = &storage_image_info;
+        write_data.dstBinding      = 0;
+        write_data.dstSet          = entry->write_ds->handle();
+
+        vkUpdateDescriptorSets(backend->device(), 1, &write_data, 0, nullptr);
+    }
+
+    // read
+    {
+        VkDescriptorImageInfo sampler_image_info;
+
+        sampler_image_info.sampler     = backend->nearest_sampler()->handle();
+        sampler_image_info.imageView   = entry->view->handle();
+        sampler_image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+        VkWriteDescriptorSet write_data;
+
+        DW_ZERO_MEMORY(write_data);
+
+        write_data.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write_data.descriptorCount = 1;
+        write_data.descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        write_data.pImageInfo      = &sampler_image_info;
+        write_data.dstBinding      = 0;
+        write_data.dstSet          = entry->read_ds->handle();
+
+        vkUpdateDescriptorSets(backend->device(), 1, &write_data, 0, nullptr);
+    }
+
+    entry->in_use          = true;
+    entry->last_used_frame = m_current_frame;
+    entry->last_cmd_buf    = cmd_buf;
+
+    m_entries.push_back(std::move(entry));
+
+    return m_entries.back().get();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void TransientImagePool::release(Entry* entry)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    entry->in_use = false;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool TransientImagePool::compatible(const Entry* entry, const TransientImageDesc& desc, QueueType queue_type)
+{
+    // Images are never shared between queues since work on the two queues can overlap.
+    return entry->queue_type == queue_type && entry->desc.format == desc.format && entry->desc.width == desc.width && entry->desc.height == desc.height && (entry->desc.usage & desc.usage) == desc.usage;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+RenderGraph::PassBuilder::PassBuilder(RenderGraph* graph, uint32_t pass_idx) :
+    m_graph(graph), m_pass_idx(pass_idx)
+{
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::read(ImageHandle image, ResourceUsage usage, VkPipelineStageFlags stages)
+{
+    m_graph->m_passes[m_pass_idx].images.push_back({ image, usage, stages, false, glm::vec4(0.0f) });
+
+    return *this;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::write(ImageHandle image, ResourceUsage usage, VkPipelineStageFlags stages)
+{
+    m_graph->m_passes[m_pass_idx].images.push_back({ image, usage, stages, false, glm::vec4(0.0f) });
+
+    return *this;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::clear(ImageHandle image, glm::vec4 color, ResourceUsage usage, VkPipelineStageFlags stages)
+{
+    m_graph->m_passes[m_pass_idx].images.push_back({ image, usage, stages, true, color });
+
+    return *this;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::read_buffer(BufferHandle buffer, ResourceUsage usage, VkPipelineStageFlags stages)
+{
+    m_graph->m_passes[m_pass_idx].buffers.push_back({ buffer, usage, stages });
+
+    return *this;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::write_buffer(BufferHandle buffer, ResourceUsage usage, VkPipelineStageFlags stages)
+{
+    m_graph->m_passes[m_pass_idx].buffers.push_back({ buffer, usage, stages });
+
+    return *this;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+RenderGraph::RenderGraph(std::weak_ptr<dw::vk::Backend> backend, TransientImagePool* transient_image_pool) :
+    m_transient_image_pool(transient_image_pool), m_incoming_transfer(backend), m_outgoing_transfer(backend)
+{
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+RenderGraph::~RenderGraph()
+{
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void RenderGraph::begin(QueueType queue_type)
+{
+    m_queue_type = queue_type;
+
+    m_passes.clear();
+    m_images.clear();
+    m_buffers.clear();
+
+    m_incoming_transfer.clear();
+    m_outgoing_transfer.clear();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void RenderGraph::clear_resource_states()
+{
+    m_image_states.clear();
+    m_buffer_states.clear();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+RenderGraph::ImageHandle RenderGraph::import_image(dw::vk::Image::Ptr image)
+{
+    Image resource;
+
+    resource.image = image;
+    resource.state = &m_image_states[image->handle()];
+
+    m_images.push_back(resource);
+
+    return m_images.size() - 1;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+RenderGraph::BufferHandle RenderGraph::import_buffer(dw::vk::Buffer::Ptr buffer)
+{
+    Buffer resource;
+
+    resource.buffer = buffer;
+    resource.state  = &m_buffer_states[buffer->handle()];
+
+    m_buffers.push_back(resource);
+
+    return m_buffers.size() - 1;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+RenderGraph::ImageHandle RenderGraph::create_image(const TransientImageDesc& desc)
+{
+    Image resource;
+
+    resource.transient = true;
+    resource.desc      = desc;
+
+    m_images.push_back(resource);
+
+    return m_images.size() - 1;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+RenderGraph::PassBuilder RenderGraph::add_pass(const std::string& name, ExecuteFunction execute)
+{
+    Pass pass;
+
+    pass.name    = name;
+    pass.execute = execute;
+
+    m_passes.push_back(pass);
+
+    return PassBuilder(this, m_passes.size() - 1);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void RenderGraph::export_image(ImageHandle image, VkPipelineStageFlags stages, ResourceUsage usage)
+{
+    // Transients do not outlive the graph, so there is nothing to hand over to the passes outside of it.
+    if (m_images[image].transient)
+        return;
+
+    m_images[image].exported      = true;
+    m_images[image].export_stages = stages;
+    m_images[image].export_usage  = usage;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void RenderGraph::execute(dw::vk::CommandBuffer::Ptr cmd_buf)
+{
+    if (m_queue_type == QUEUE_TYPE_ASYNC_COMPUTE)
+        transfer_imported_resources(m_incoming_transfer);
+
+    const int32_t num_levels = schedule();
+
+    allocate_transients(cmd_buf);
+
+    m_num_barriers = 0;
+
+    std::vector<uint32_t> order(m_passes.size());
+
+    for (uint32_t i = 0; i < order.size(); i++)
+        order[i] = i;
+
+    std::stable_sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) { return m_passes[a].level < m_passes[b].level; });
+
+    uint32_t pass_idx = 0;
+
+    for (int32_t level = 0; level < num_levels; level++)
+    {
+        const uint32_t level_start = pass_idx;
+
+        while (pass_idx < order.size() && m_passes[order[pass_idx]].level == level)
+            pass_idx++;
+
+        BarrierBatch barriers;
+        BarrierBatch clear_barriers;
+
+        for (uint32_t i = level_start; i < pass_idx; i++)
+        {
+            const Pass& pass = m_passes[order[i]];
+
+            for (const auto& access : pass.images)
+            {
+                const bool discard = m_images[access.image].transient && m_images[access.image].first_pass == order[i];
+
+                if (access.clear)
+                {
+                    transition_image(barriers, access.image, RESOURCE_USAGE_CLEAR, VK_PIPELINE_STAGE_TRANSFER_BIT, true);
+                    transition_image(clear_barriers, access.image, access.usage, access.stages, false);
+                }
+                else
+                    transition_image(barriers, access.image, access.usage, access.stages, discard);
+            }
+
+            for (const auto& access : pass.buffers)
+                transition_buffer(barriers, access.buffer, access.usage, access.stages);
+        }
+
+        flush(cmd_buf, barriers);
+
+        // Every clear of the level is recorded back to back so that they share the barriers on either side of them.
+        if (clear_barriers.image_barriers.size() > 0)
+        {
+            VkImageSubresourceRange subresource_range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, VK_REMAINING_MIP_LEVELS, 0, VK_REMAINING_ARRAY_LAYERS };
+
+            for (uint32_t i = level_start; i < pass_idx; i++)
+            {
+                for (const auto& access : m_passes[order[i]].images)
+                {
+                    if (!access.clear)
+                        continue;
+
+                    VkClearColorValue color;
+
+                    color.float32[0] = access.clear_color.x;
+                    color.float32[1] = access.clear_color.y;
+                    color.float32[2] = access.clear_color.z;
+                    color.float32[3] = access.clear_color.w;
+
+                    vkCmdClearColorImage(cmd_buf->handle(), image(access.image)->handle(), VK_IMAGE_LAYOUT_GENERAL, &color, 1, &subresource_range);
+                }
+            }
+
+            flush(cmd_buf, clear_barriers);
+        }
+
+        for (uint32_t i = level_start; i < pass_idx; i++)
+        {
+            if (m_passes[order[i]].execute)
+                m_passes[order[i]].execute(cmd_buf);
+        }
+    }
+
+    BarrierBatch export_barriers;
+
+    for (uint32_t i = 0; i < m_images.size(); i++)
+    {
+        if (m_images[i].exported)
+            transition_image(export_barriers, i, m_images[i].export_usage, m_images[i].export_stages, false);
+    }
+
+    flush(cmd_buf, export_barriers);
+
+    if (m_queue_type == QUEUE_TYPE_ASYNC_COMPUTE)
+        transfer_imported_resources(m_outgoing_transfer);
+
+    release_transients();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+dw::vk::DescriptorSet::Ptr RenderGraph::write_ds(ImageHandle image)
+{
+    return m_images[image].entry->write_ds;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+dw::vk::DescriptorSet::Ptr RenderGraph::read_ds(ImageHandle image)
+{
+    return m_images[image].entry->read_ds;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+dw::vk::Image::Ptr RenderGraph::image(ImageHandle image)
+{
+    if (m_images[image].transient)
+        return m_images[image].entry->image;
+    else
+        return m_images[image].image;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+int32_t RenderGraph::schedule()
+{
+    struct Tracker
+    {
+        int32_t                                        last_writer = -1;
+        std::vector<std::pair<uint32_t, VkImageLayout>> readers;
+    };
+
+    std::vector<Tracker>               image_trackers(m_images.size());
+    std::vector<Tracker>               buffer_trackers(m_buffers.size());
+    std::vector<std::vector<uint32_t>> dependencies(m_passes.size());
+
+    auto add_dependencies = [](const Tracker& tracker, uint32_t pass_idx, bool write, VkImageLayout layout, std::vector<uint32_t>& pass_dependencies) {
+        if (tracker.last_writer >= 0 && tracker.last_writer != int32_t(pass_idx))
+            pass_dependencies.push_back(tracker.last_writer);
+
+        // Reads only have to be ordered against each other when they need the image in different layouts.
+        for (const auto& reader : tracker.readers)
+        {
+            if (reader.first != pass_idx && (write || reader.second != layout))
+                pass_dependencies.push_back(reader.first);
+        }
+    };
+
+    auto update_tracker = [](Tracker& tracker, uint32_t pass_idx, bool write, VkImageLayout layout) {
+        if (write)
+        {
+            tracker.last_writer = pass_idx;
+            tracker.readers.clear();
+        }
+        else
+            tracker.readers.push_back({ pass_idx, layout });
+    };
+
+    // Build the dependencies in declaration order, which is the order the effects were written against.
+    for (uint32_t i = 0; i < m_passes.size(); i++)
+    {
+        const Pass& pass = m_passes[i];
+
+        for (const auto& access : pass.images)
+            add_dependencies(image_trackers[access.image], i, usage_writes(access.usage) || access.clear, usage_layout(access.usage), dependencies[i]);
+
+        for (const auto& access : pass.buffers)
+            add_dependencies(buffer_trackers[access.buffer], i, usage_writes(access.usage), VK_IMAGE_LAYOUT_UNDEFINED, dependencies[i]);
+
+        for (const auto& access : pass.images)
+            update_tracker(image_trackers[access.image], i, usage_writes(access.usage) || access.clear, usage_layout(access.usage));
+
+        for (const auto& access : pass.buffers)
+            update_tracker(buffer_trackers[access.buffer], i, usage_writes(access.usage), VK_IMAGE_LAYOUT_UNDEFINED);
+    }
+
+    // Schedule every pass as late as possible. Dependencies always point to earlier passes, so walking backwards visits all of a
+    // pass' consumers before the pass itself. Running producers just before their consumers keeps transient lifetimes short.
+    std::vector<int32_t> heights(m_passes.size(), 0);
+    int32_t              max_height = -1;
+
+    for (int32_t i = int32_t(m_passes.size()) - 1; i >= 0; i--)
+    {
+        for (auto dependency : dependencies[i])
+            heights[dependency] = std::max(heights[dependency], heights[i] + 1);
+
+        max_height = std::max(max_height, heights[i]);
+    }
+
+    for (uint32_t i = 0; i < m_passes.size(); i++)
+        m_passes[i].level = max_height - heights[i];
+
+    for (uint32_t i = 0; i < m_passes.size(); i++)
+    {
+        for (const auto& access : m_passes[i].images)
+        {
+            Image& resource = m_images[access.image];
+
+            if (resource.first_level == -1 || m_passes[i].level < resource.first_level || (m_passes[i].level == resource.first_level && int32_t(i) < resource.first_pass))
+            {
+                resource.first_level = m_passes[i].level;
+                resource.first_pass  = i;
+            }
+
+            resource.last_level = std::max(resource.last_level, m_passes[i].level);
+        }
+    }
+
+    return max_height + 1;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void RenderGraph::allocate_transients(dw::vk::CommandBuffer::Ptr cmd_buf)
+{
+    struct Allocation
+    {
+        TransientImagePool::Entry* entry;
+        int32_t                    last_level;
+    };
+
+    std::vector<uint32_t> transients;
+
+    for (uint32_t i = 0; i < m_images.size(); i++)
+    {
+        if (m_images[i].transient && m_images[i].first_level != -1)
+            transients.push_back(i);
+    }
+
+    std::stable_sort(transients.begin(), transients.end(), [this](uint32_t a, uint32_t b) { return m_images[a].first_level < m_images[b].first_level; });
+
+    std::vector<Allocation> allocations;
+
+    for (auto idx : transients)
+    {
+        Image& resource = m_images[idx];
+
+        // Reuse an image whose previous user is done by the time this one is first touched. The barrier in front of the first
+        // use then waits on the previous user and discards its contents.
+        for (auto& allocation : allocations)
+        {
+            if (allocation.last_level < resource.first_level && TransientImagePool::compatible(allocation.entry, resource.desc, m_queue_type))
+            {
+                resource.entry        = allocation.entry;
+                allocation.last_level = resource.last_level;
+                break;
+            }
+        }
+
+        if (!resource.entry)
+        {
+            resource.entry = m_transient_image_pool->acquire(resource.desc, m_queue_type, cmd_buf->handle());
+            allocations.push_back({ resource.entry, resource.last_level });
+        }
+
+        resource.state = &resource.entry->state;
+    }
+
+    m_num_physical_transients = allocations.size();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void RenderGraph::release_transients()
+{
+    for (auto& resource : m_images)
+    {
+        if (resource.transient && resource.entry && resource.entry->in_use)
+            m_transient_image_pool->release(resource.entry);
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void RenderGraph::transition_image(BarrierBatch& batch, ImageHandle handle, ResourceUsage usage, VkPipelineStageFlags stages, bool discard)
+{
+    Image& resource = m_images[handle];
+
+    VkImageLayout        old_layout;
+    VkAccessFlags        src_access;
+    VkPipelineStageFlags src_stages;
+
+    const VkImageLayout        layout     = usage_layout(usage);
+    const VkAccessFlags        dst_access = usage_access(usage);
+    const VkPipelineStageFlags dst_stages = queue_stages(m_queue_type, usage_stages(usage, stages));
+
+    if (!transition(*resource.state, layout, dst_access, dst_stages, usage_writes(usage), discard, old_layout, src_access, src_stages))
+        return;
+
+    batch.src_stages |= queue_stages(m_queue_type, src_stages);
+    batch.dst_stages |= dst_stages;
+
+    dw::vk::Image::Ptr vk_image = image(handle);
+
+    // Merge with a barrier already queued for this image by another pass of the same level.
+    for (auto& barrier : batch.image_barriers)
+    {
+        if (barrier.image == vk_image->handle())
+        {
+            barrier.srcAccessMask |= src_access;
+            barrier.dstAccessMask |= dst_access;
+            return;
+        }
+    }
+
+    VkImageSubresourceRange subresource_range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, VK_REMAINING_MIP_LEVELS, 0, VK_REMAINING_ARRAY_LAYERS };
+
+    batch.image_barriers.push_back(image_memory_barrier(vk_image, old_layout, layout, subresource_range, src_access, dst_access));
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void RenderGraph::transition_buffer(BarrierBatch& batch, BufferHandle handle, ResourceUsage usage, VkPipelineStageFlags stages)
+{
+    Buffer& resource = m_buffers[handle];
+
+    VkImageLayout        old_layout;
+    VkAccessFlags        src_access;
+    VkPipelineStageFlags src_stages;
+
+    const VkAccessFlags        dst_access = usage_access(usage);
+    const VkPipelineStageFlags dst_stages = queue_stages(m_queue_type, usage_stages(usage, stages));
+
+    if (!transition(*resource.state, VK_IMAGE_LAYOUT_UNDEFINED, dst_access, dst_stages, usage_writes(usage), false, old_layout, src_access, src_stages))
+        return;
+
+    batch.src_stages |= queue_stages(m_queue_type, src_stages);
+    batch.dst_stages |= dst_stages;
+
+    for (auto& barrier : batch.buffer_barriers)
+    {
+        if (barrier.buffer == resource.buffer->handle())
+        {
+            barrier.srcAccessMask |= src_access;
+            barrier.dstAccessMask |= dst_access;
+            return;
+        }
+    }
+
+    batch.buffer_barriers.push_back(buffer_memory_barrier(resource.buffer, 0, VK_WHOLE_SIZE, src_access, dst_access));
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void RenderGraph::flush(dw::vk::CommandBuffer::Ptr cmd_buf, BarrierBatch& batch)
+{
+    if (batch.image_barriers.size() == 0 && batch.buffer_barriers.size() == 0)
+        return;
+
+    if (batch.src_stages == 0)
+        batch.src_stages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+
+    if (batch.dst_stages == 0)
+        batch.dst_stages = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+
+    pipeline_barrier(cmd_buf, {}, batch.image_barriers, batch.buffer_barriers, batch.src_stages, batch.dst_stages);
+
+    m_num_barriers++;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void RenderGraph::transfer_imported_resources(QueueTransfer& transfer)
+{
+    if (!transfer.enabled())
+        return;
+
+    for (auto& resource : m_images)
+    {
+        if (resource.transient)
+            continue;
+
+        transfer.add_image(resource.image, resource.state->layout);
+
+        // The transfer makes every earlier access available and visible on the queue that takes the image over.
+        if (resource.state->layout != VK_IMAGE_LAYOUT_UNDEFINED)
+            *resource.state = { resource.state->layout, 0, 0, 0, 0 };
+    }
+
+    for (auto& resource : m_buffers)
+    {
+        transfer.add_buffer(resource.buffer);
+
+        *resource.state = ResourceState();
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool RenderGraph::transition(ResourceState& state, VkImageLayout layout, VkAccessFlags access, VkPipelineStageFlags stages, bool write, bool discard, VkImageLayout& old_layout, VkAccessFlags& src_access, VkPipelineStageFlags& src_stages)
+{
+    const bool layout_change = discard || state.layout != layout;
+
+    if (!write && !layout_change)
+    {
+        // Read-after-read, or a read the last write has already been made visible to.
+        if (state.write_stages == 0 || ((state.read_stages & stages) == stages && (state.read_access & access) == access))
+        {
+            state.read_stages |= stages;
+            state.read_access |= access;
+
+            return false;
+        }
+
+        old_layout = layout;
+        src_access = state.write_access;
+        src_stages = state.write_stages;
+
+        state.read_stages |= stages;
+        state.read_access |= access;
+
+        return true;
+    }
+
+    // Writes and layout transitions have to wait for every access since the last write.
+    old_layout = discard ? VK_IMAGE_LAYOUT_UNDEFINED : state.layout;
+    src_access = discard ? 0 : state.write_access;
+    src_stages = state.write_stages | state.read_stages;
+
+    const bool needed = layout_change || src_stages != 0;
+
+    state.layout = layout;
+
+    if (write)
+    {
+        state.write_access = access;
+        state.write_stages = stages;
+        state.read_access  = 0;
+        state.read_stages  = 0;
+    }
+    else
+    {
+        // The transition itself acts as the write that later reads from other stages have to chain onto.
+        state.write_access = 0;
+        state.write_stages = stages;
+        state.read_access  = access;
+        state.read_stages  = stages;
+    }
+
+    return needed;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
\ No newline at end of file
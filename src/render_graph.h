@@ -0,0 +1,249 @@
+#pragma once
+
+#include "common.h"
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+
+enum ResourceUsage
+{
+    RESOURCE_USAGE_SAMPLED,
+    RESOURCE_USAGE_STORAGE_READ,
+    RESOURCE_USAGE_STORAGE_WRITE,
+    RESOURCE_USAGE_STORAGE_READ_WRITE,
+    RESOURCE_USAGE_TRANSFER_SRC,
+    RESOURCE_USAGE_TRANSFER_DST,
+    RESOURCE_USAGE_CLEAR,
+    RESOURCE_USAGE_INDIRECT_ARGUMENTS
+};
+
+// Last known state of a resource. Reads are tracked since the most recent write so that a later write or layout transition
+// waits on all of them, while a read that the write has already been made visible to does not need another barrier.
+struct ResourceState
+{
+    VkImageLayout        layout       = VK_IMAGE_LAYOUT_UNDEFINED;
+    VkAccessFlags        write_access = 0;
+    VkPipelineStageFlags write_stages = 0;
+    VkAccessFlags        read_access  = 0;
+    VkPipelineStageFlags read_stages  = 0;
+};
+
+// Hands resources over between the graphics and the async compute queue. Every resource is created with exclusive sharing, so
+// when the two queues are in different families one used on both has to be released by the family that used it last and
+// acquired by the next, with the same barrier recorded on either queue. Images are added in the layout they are in at the hand
+// over and keep it. Nothing is added while both queues share a family, ownership then never changes.
+class QueueTransfer
+{
+public:
+    QueueTransfer(std::weak_ptr<dw::vk::Backend> backend);
+
+    void add_image(dw::vk::Image::Ptr image, VkImageLayout layout);
+    void add_buffer(dw::vk::Buffer::Ptr buffer);
+    void release(dw::vk::CommandBuffer::Ptr cmd_buf, QueueType queue_type);
+    void acquire(dw::vk::CommandBuffer::Ptr cmd_buf, QueueType queue_type);
+    void clear();
+
+    inline bool enabled() { return m_queue_families[QUEUE_TYPE_GRAPHICS] != m_queue_families[QUEUE_TYPE_ASYNC_COMPUTE]; }
+    inline bool empty() { return m_images.size() == 0 && m_buffers.size() == 0; }
+
+private:
+    void record(dw::vk::CommandBuffer::Ptr cmd_buf, QueueType src_queue_type, bool release);
+
+private:
+    uint32_t                                                    m_queue_families[2];
+    std::vector<std::pair<dw::vk::Image::Ptr, VkImageLayout>> m_images;
+    std::vector<dw::vk::Buffer::Ptr>                            m_buffers;
+};
+
+struct TransientImageDesc
+{
+    std::string       name;
+    VkFormat          format;
+    uint32_t          width;
+    uint32_t          height;
+    VkImageUsageFlags usage;
+};
+
+// Owns the physical images behind render graph transients. An image is handed out to a single graph at a time and returned
+// once that graph has been recorded, so graphs recorded back to back on the same queue share the memory. Images that have not
+// been requested for more than kMaxFramesInFlight frames are destroyed, which frees the memory of passes that were culled.
+// Graphs may be recorded on several threads, so within a frame an image only goes back to graphs recorded into the command
+// buffer that last used it: their order on the GPU is then known, and the tracked state is that of the last use.
+class TransientImagePool
+{
+public:
+    struct Entry
+    {
+        TransientImageDesc         desc;
+        QueueType                  queue_type;
+        dw::vk::Image::Ptr         image;
+        dw::vk::ImageView::Ptr     view;
+        dw::vk::DescriptorSet::Ptr write_ds;
+        dw::vk::DescriptorSet::Ptr read_ds;
+        ResourceState              state;
+        bool                       in_use          = false;
+        uint64_t                   last_used_frame = 0;
+        VkCommandBuffer            last_cmd_buf    = VK_NULL_HANDLE;
+    };
+
+public:
+    TransientImagePool(std::weak_ptr<dw::vk::Backend> backend, CommonResources* common_resources);
+    ~TransientImagePool();
+
+    void   begin_frame();
+    Entry* acquire(const TransientImageDesc& desc, QueueType queue_type, VkCommandBuffer cmd_buf);
+    void   release(Entry* entry);
+
+    static bool compatible(const Entry* entry, const TransientImageDesc& desc, QueueType queue_type);
+
+    inline size_t num_images() { return m_entries.size(); }
+
+private:
+    std::weak_ptr<dw::vk::Backend>      m_backend;
+    CommonResources*                    m_common_resources;
+    std::vector<std::unique_ptr<Entry>> m_entries;
+    uint64_t                            m_current_frame = 0;
+    uint32_t                            m_num_created   = 0;
+    std::mutex                          m_mutex;
+};
+
+// Records a set of passes whose image and buffer accesses are declared up front. On execute the graph schedules every pass as
+// late as its consumers allow, backs transients whose lifetimes do not overlap with the same pooled image, and issues a single
+// batched barrier in front of each group of independent passes, skipping transitions the tracked resource state makes
+// redundant. Transients only share whole images of the same format and size, memory is never aliased between resources.
+// Transients stay on the queue of their graph, while the imported resources of a graph on the async compute queue are borrowed
+// from the graphics queue, see incoming_transfer() and outgoing_transfer().
+class RenderGraph
+{
+public:
+    using ImageHandle     = uint32_t;
+    using BufferHandle    = uint32_t;
+    using ExecuteFunction = std::function<void(dw::vk::CommandBuffer::Ptr)>;
+
+    class PassBuilder
+    {
+    public:
+        PassBuilder(RenderGraph* graph, uint32_t pass_idx);
+
+        PassBuilder& read(ImageHandle image, ResourceUsage usage = RESOURCE_USAGE_SAMPLED, VkPipelineStageFlags stages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+        PassBuilder& write(ImageHandle image, ResourceUsage usage = RESOURCE_USAGE_STORAGE_WRITE, VkPipelineStageFlags stages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+        PassBuilder& clear(ImageHandle image, glm::vec4 color, ResourceUsage usage = RESOURCE_USAGE_STORAGE_WRITE, VkPipelineStageFlags stages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+        PassBuilder& read_buffer(BufferHandle buffer, ResourceUsage usage = RESOURCE_USAGE_STORAGE_READ, VkPipelineStageFlags stages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+        PassBuilder& write_buffer(BufferHandle buffer, ResourceUsage usage = RESOURCE_USAGE_STORAGE_WRITE, VkPipelineStageFlags stages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+    private:
+        RenderGraph* m_graph;
+        uint32_t     m_pass_idx;
+    };
+
+public:
+    RenderGraph(std::weak_ptr<dw::vk::Backend> backend, TransientImagePool* transient_image_pool);
+    ~RenderGraph();
+
+    void         begin(QueueType queue_type);
+    ImageHandle  import_image(dw::vk::Image::Ptr image);
+    BufferHandle import_buffer(dw::vk::Buffer::Ptr buffer);
+    ImageHandle  create_image(const TransientImageDesc& desc);
+    PassBuilder  add_pass(const std::string& name, ExecuteFunction execute);
+    void         export_image(ImageHandle image, VkPipelineStageFlags stages, ResourceUsage usage = RESOURCE_USAGE_SAMPLED);
+    void         execute(dw::vk::CommandBuffer::Ptr cmd_buf);
+
+    // The imported resources of a graph on the async compute queue, filled in by execute() with the layouts they are in before
+    // and after the graph. The caller hands the incoming ones over from the graphics queue ahead of the submission that contains
+    // the graph and the outgoing ones back once it is done. Later work on the async compute queue, such as another effect of the
+    // same job, can then still read the outputs. Both are empty for graphs on the graphics queue and when the two queues share
+    // a family.
+    inline QueueTransfer& incoming_transfer() { return m_incoming_transfer; }
+    inline QueueTransfer& outgoing_transfer() { return m_outgoing_transfer; }
+
+    // Drops the tracked state of imported resources. Must be called when they are recreated, since the handles of destroyed
+    // objects can be reused by new ones.
+    void clear_resource_states();
+
+    // Only valid for transient images, and only while the graph is executing.
+    dw::vk::DescriptorSet::Ptr write_ds(ImageHandle image);
+    dw::vk::DescriptorSet::Ptr read_ds(ImageHandle image);
+    dw::vk::Image::Ptr         image(ImageHandle image);
+
+    inline uint32_t num_passes() { return m_passes.size(); }
+    inline uint32_t num_barriers() { return m_num_barriers; }
+    inline uint32_t num_physical_transients() { return m_num_physical_transients; }
+
+private:
+    struct ImageAccess
+    {
+        ImageHandle          image;
+        ResourceUsage        usage;
+        VkPipelineStageFlags stages;
+        bool                 clear;
+        glm::vec4            clear_color;
+    };
+
+    struct BufferAccess
+    {
+        BufferHandle         buffer;
+        ResourceUsage        usage;
+        VkPipelineStageFlags stages;
+    };
+
+    struct Pass
+    {
+        std::string               name;
+        ExecuteFunction           execute;
+        std::vector<ImageAccess>  images;
+        std::vector<BufferAccess> buffers;
+        int32_t                   level = 0;
+    };
+
+    struct Image
+    {
+        dw::vk::Image::Ptr         image;
+        ResourceState*             state         = nullptr;
+        bool                       transient     = false;
+        TransientImageDesc         desc;
+        TransientImagePool::Entry* entry         = nullptr;
+        int32_t                    first_level   = -1;
+        int32_t                    last_level    = -1;
+        int32_t                    first_pass    = -1;
+        bool                       exported      = false;
+        VkPipelineStageFlags       export_stages = 0;
+        ResourceUsage              export_usage  = RESOURCE_USAGE_SAMPLED;
+    };
+
+    struct Buffer
+    {
+        dw::vk::Buffer::Ptr buffer;
+        ResourceState*      state = nullptr;
+    };
+
+    struct BarrierBatch
+    {
+        std::vector<VkImageMemoryBarrier>  image_barriers;
+        std::vector<VkBufferMemoryBarrier> buffer_barriers;
+        VkPipelineStageFlags               src_stages = 0;
+        VkPipelineStageFlags               dst_stages = 0;
+    };
+
+    int32_t schedule();
+    void    allocate_transients(dw::vk::CommandBuffer::Ptr cmd_buf);
+    void    release_transients();
+    void    transition_image(BarrierBatch& batch, ImageHandle image, ResourceUsage usage, VkPipelineStageFlags stages, bool discard);
+    void    transition_buffer(BarrierBatch& batch, BufferHandle buffer, ResourceUsage usage, VkPipelineStageFlags stages);
+    void    flush(dw::vk::CommandBuffer::Ptr cmd_buf, BarrierBatch& batch);
+    void    transfer_imported_resources(QueueTransfer& transfer);
+
+    static bool transition(ResourceState& state, VkImageLayout layout, VkAccessFlags access, VkPipelineStageFlags stages, bool write, bool discard, VkImageLayout& old_layout, VkAccessFlags& src_access, VkPipelineStageFlags& src_stages);
+
+private:
+    TransientImagePool*                         m_transient_image_pool;
+    QueueType                                   m_queue_type = QUEUE_TYPE_GRAPHICS;
+    QueueTransfer                               m_incoming_transfer;
+    QueueTransfer                               m_outgoing_transfer;
+    std::vector<Pass>                           m_passes;
+    std::vector<Image>                          m_images;
+    std::vector<Buffer>                         m_buffers;
+    std::unordered_map<VkImage, ResourceState>  m_image_states;
+    std::unordered_map<VkBuffer, ResourceState> m_buffer_states;
+    uint32_t                                    m_num_barriers            = 0;
+    uint32_t                                    m_num_physical_transients = 0;
+};
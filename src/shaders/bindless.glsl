@@ -0,0 +1,31 @@
+#ifndef BINDLESS_GLSL
+#define BINDLESS_GLSL
+
+// ------------------------------------------------------------------------
+
+// Must match bindless_heap.h.
+#define BINDLESS_MAX_SAMPLED_IMAGES 4096
+#define BINDLESS_MAX_STORAGE_IMAGES 1024
+
+// ------------------------------------------------------------------------
+
+// Every image registered with the BindlessHeap, indexed through push constants. The storage images are declared once per format
+// that is accessed through the heap, the declarations alias the same binding. An index that is the same for the whole dispatch
+// needs no nonuniformEXT.
+#if defined(BINDLESS_DESCRIPTOR_SET)
+
+layout(set = BINDLESS_DESCRIPTOR_SET, binding = 0) uniform sampler2D s_BindlessTextures[BINDLESS_MAX_SAMPLED_IMAGES];
+layout(set = BINDLESS_DESCRIPTOR_SET, binding = 0) uniform usampler2D s_BindlessUTextures[BINDLESS_MAX_SAMPLED_IMAGES];
+
+layout(set = BINDLESS_DESCRIPTOR_SET, binding = 1, r32ui) uniform uimage2D i_BindlessImagesR32UI[BINDLESS_MAX_STORAGE_IMAGES];
+layout(set = BINDLESS_DESCRIPTOR_SET, binding = 1, r16f) uniform image2D i_BindlessImagesR16F[BINDLESS_MAX_STORAGE_IMAGES];
+layout(set = BINDLESS_DESCRIPTOR_SET, binding = 1, rg16f) uniform image2D i_BindlessImagesRG16F[BINDLESS_MAX_STORAGE_IMAGES];
+layout(set = BINDLESS_DESCRIPTOR_SET, binding = 1, rgba16f) uniform image2D i_BindlessImagesRGBA16F[BINDLESS_MAX_STORAGE_IMAGES];
+layout(set = BINDLESS_DESCRIPTOR_SET, binding = 1, r8) uniform image2D i_BindlessImagesR8[BINDLESS_MAX_STORAGE_IMAGES];
+layout(set = BINDLESS_DESCRIPTOR_SET, binding = 1, r11f_g11f_b10f) uniform image2D i_BindlessImagesR11G11B10F[BINDLESS_MAX_STORAGE_IMAGES];
+
+#endif
+
+// ------------------------------------------------------------------------
+
+#endif
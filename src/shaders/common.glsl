@@ -27,6 +27,23 @@
 #define MIRROR_REFLECTIONS_ROUGHNESS_THRESHOLD 0.05f
 #define DDGI_REFLECTIONS_ROUGHNESS_THRESHOLD 0.75f
 
+// Default G-Buffer layout, 160 bits per pixel:
+// 1 (RGBA8):   RGB: Albedo, A: Metallic
+// 2 (RGBA16F): RG: Normal, BA: Motion Vector
+// 3 (RGBA16F): R: Roughness, G: Curvature, B: Mesh ID, A: Linear Z
+//
+// Compact G-Buffer layout (GBUFFER_COMPACT), 128 bits per pixel:
+// 1 (RGBA8):   RGB: Albedo, A: Metallic
+// 2 (RGB10A2): RG: Normal, B: Roughness, A: Curvature
+// 3 (RGBA16F): RG: Motion Vector, B: Mesh ID, A: Linear Z
+//
+// Always go through the g_buffer_* helpers below instead of reading the channels directly.
+#if defined(GBUFFER_COMPACT)
+#define G_BUFFER_2_IMAGE_FORMAT rgb10_a2
+#else
+#define G_BUFFER_2_IMAGE_FORMAT rgba16f
+#endif
+
 // ------------------------------------------------------------------------
 
 struct RayPayload
@@ -84,6 +101,23 @@ struct Light
 
 // ------------------------------------------------------------------------
 
+// One submesh of one instance as drawn by the G-Buffer pass, the index of a draw is also its mesh ID.
+struct DrawData
+{
+    mat4 model;
+    vec4 min_extents;
+    vec4 max_extents;
+    uint material_idx;
+    uint index_count;
+    uint base_index;
+    int  base_vertex;
+    uint group;
+    uint group_first_draw;
+    uint padding[2];
+};
+
+// ------------------------------------------------------------------------
+
 vec3 light_direction(in Light light)
 {
     return light.data0.xyz;
@@ -140,6 +174,14 @@ float light_cos_theta_inner(in Light light)
 
 // ------------------------------------------------------------------------
 
+// Only set for the local lights of lights_common.glsl, which fall off to zero at this distance.
+float light_range(in Light light)
+{
+    return light.data2.w;
+}
+
+// ------------------------------------------------------------------------
+
 float luminance(vec3 rgb)
 {
     return max(dot(rgb, vec3(0.299, 0.587, 0.114)), 0.0001);
@@ -157,6 +199,103 @@ vec3 octohedral_to_direction(vec2 e)
 
 // ------------------------------------------------------------------
 
+vec2 direction_to_octohedral(vec3 normal)
+{
+    vec2 p = normal.xy * (1.0f / dot(abs(normal), vec3(1.0f)));
+    return normal.z > 0.0f ? p : (1.0f - abs(p.yx)) * (step(0.0f, p) * 2.0f - vec2(1.0f));
+}
+
+// ------------------------------------------------------------------
+
+void encode_g_buffer(vec3 albedo, float metallic, vec3 normal, vec2 motion_vector, float roughness, float curvature, float mesh_id, float linear_z, out vec4 g_buffer_1, out vec4 g_buffer_2, out vec4 g_buffer_3)
+{
+    g_buffer_1 = vec4(albedo, metallic);
+
+#if defined(GBUFFER_COMPACT)
+    // Curvature is only ever tested against zero, so round it up to keep any curved surface out of the first of the four
+    // levels that fit in two bits.
+    g_buffer_2 = vec4(direction_to_octohedral(normal) * 0.5f + 0.5f, roughness, ceil(clamp(curvature, 0.0f, 1.0f) * 3.0f) / 3.0f);
+    g_buffer_3 = vec4(motion_vector, mesh_id, linear_z);
+#else
+    g_buffer_2 = vec4(direction_to_octohedral(normal), motion_vector);
+    g_buffer_3 = vec4(roughness, curvature, mesh_id, linear_z);
+#endif
+}
+
+// ------------------------------------------------------------------
+
+vec3 g_buffer_albedo(vec4 g_buffer_1)
+{
+    return g_buffer_1.rgb;
+}
+
+// ------------------------------------------------------------------
+
+float g_buffer_metallic(vec4 g_buffer_1)
+{
+    return g_buffer_1.a;
+}
+
+// ------------------------------------------------------------------
+
+vec3 g_buffer_normal(vec4 g_buffer_2)
+{
+#if defined(GBUFFER_COMPACT)
+    return octohedral_to_direction(g_buffer_2.rg * 2.0f - 1.0f);
+#else
+    return octohedral_to_direction(g_buffer_2.rg);
+#endif
+}
+
+// ------------------------------------------------------------------
+
+vec2 g_buffer_motion_vector(vec4 g_buffer_2, vec4 g_buffer_3)
+{
+#if defined(GBUFFER_COMPACT)
+    return g_buffer_3.rg;
+#else
+    return g_buffer_2.ba;
+#endif
+}
+
+// ------------------------------------------------------------------
+
+float g_buffer_roughness(vec4 g_buffer_2, vec4 g_buffer_3)
+{
+#if defined(GBUFFER_COMPACT)
+    return g_buffer_2.b;
+#else
+    return g_buffer_3.r;
+#endif
+}
+
+// ------------------------------------------------------------------
+
+float g_buffer_curvature(vec4 g_buffer_2, vec4 g_buffer_3)
+{
+#if defined(GBUFFER_COMPACT)
+    return g_buffer_2.a;
+#else
+    return g_buffer_3.g;
+#endif
+}
+
+// ------------------------------------------------------------------
+
+float g_buffer_mesh_id(vec4 g_buffer_3)
+{
+    return g_buffer_3.b;
+}
+
+// ------------------------------------------------------------------
+
+float g_buffer_linear_z(vec4 g_buffer_3)
+{
+    return g_buffer_3.a;
+}
+
+// ------------------------------------------------------------------
+
 float gaussian_weight(float offset, float deviation)
 {
     float weight = 1.0 / sqrt(2.0 * M_PI * deviation * deviation);
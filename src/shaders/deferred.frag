@@ -2,8 +2,10 @@
 
 #extension GL_GOOGLE_include_directive : require
 
+#define LIGHTS_DESCRIPTOR_SET 7
 #include "brdf.glsl"
 #include "lighting.glsl"
+#include "lights/lights_common.glsl"
 
 // ------------------------------------------------------------------------
 // INPUTS -----------------------------------------------------------------
@@ -31,9 +33,9 @@ const float IndirectSpecularStrength = 2.0f;
 // DESCRIPTOR SETS --------------------------------------------------------
 // ------------------------------------------------------------------------
 
-layout(set = 0, binding = 0) uniform sampler2D s_GBuffer1; // RGB: Albedo, A: Metallic
-layout(set = 0, binding = 1) uniform sampler2D s_GBuffer2; // RG: Normal, BA: Motion Vector
-layout(set = 0, binding = 2) uniform sampler2D s_GBuffer3; // R: Roughness, G: Curvature, B: Mesh ID, A: Linear Z
+layout(set = 0, binding = 0) uniform sampler2D s_GBuffer1;
+layout(set = 0, binding = 1) uniform sampler2D s_GBuffer2;
+layout(set = 0, binding = 2) uniform sampler2D s_GBuffer3;
 layout(set = 0, binding = 3) uniform sampler2D s_GBufferDepth;
 
 layout(set = 1, binding = 0) uniform sampler2D s_AO;
@@ -61,18 +63,18 @@ layout(set = 6, binding = 1) uniform sampler2D s_IrradianceSH;
 layout(set = 6, binding = 2) uniform samplerCube s_Prefiltered;
 layout(set = 6, binding = 3) uniform sampler2D s_BRDF;
 
+layout(set = 7, binding = 4) uniform sampler2D s_LightReservoirs;
+
 // ------------------------------------------------------------------------
-// PUSH CONSTANTS ---------------------------------------------------------
+// SPECIALIZATION CONSTANTS -----------------------------------------------
 // ------------------------------------------------------------------------
 
-layout(push_constant) uniform PushConstants
-{
-    int shadow;
-    int ao;
-    int reflections;
-    int gi;
-}
-u_PushConstants;
+// Must match the ShadingConstant ids in deferred_shading.cpp.
+layout(constant_id = 0) const bool c_RayTracedShadows     = true;
+layout(constant_id = 1) const bool c_RayTracedAO          = true;
+layout(constant_id = 2) const bool c_RayTracedReflections = true;
+layout(constant_id = 3) const bool c_DDGI                 = true;
+layout(constant_id = 4) const bool c_LocalLights          = false;
 
 // ------------------------------------------------------------------------
 // FUNCTIONS --------------------------------------------------------------
@@ -159,11 +161,11 @@ vec3 indirect_lighting(vec3 N, vec3 diffuse_color, float roughness, float metall
     vec3 kD = 1.0 - kS;
     kD *= 1.0 - metallic;
 
-    vec3 irradiance = u_PushConstants.gi == 1 ? textureLod(s_GI, FS_IN_TexCoord, 0.0f).rgb : evaluate_sh9_irradiance(N);
+    vec3 irradiance = c_DDGI ? textureLod(s_GI, FS_IN_TexCoord, 0.0f).rgb : evaluate_sh9_irradiance(N);
     vec3 diffuse    = irradiance * diffuse_color;
 
     const float MAX_REFLECTION_LOD = 4.0;
-    vec3        prefilteredColor   = u_PushConstants.reflections == 1 ? textureLod(s_Reflections, FS_IN_TexCoord, 0.0f).rgb : textureLod(s_Prefiltered, R, roughness * MAX_REFLECTION_LOD).rgb;
+    vec3        prefilteredColor   = c_RayTracedReflections ? textureLod(s_Reflections, FS_IN_TexCoord, 0.0f).rgb : textureLod(s_Prefiltered, R, roughness * MAX_REFLECTION_LOD).rgb;
     vec2        brdf               = texture(s_BRDF, vec2(max(dot(N, Wo), 0.0), roughness)).rg;
     vec3        specular           = prefilteredColor * (F * brdf.x + brdf.y) * IndirectSpecularStrength;
 
@@ -181,13 +183,13 @@ void main()
     vec4 g_buffer_data_3 = texture(s_GBuffer3, FS_IN_TexCoord);
 
     const vec3  world_pos  = world_position_from_depth(FS_IN_TexCoord, texture(s_GBufferDepth, FS_IN_TexCoord).r, u_GlobalUBO.view_proj_inverse);
-    const vec3  albedo     = g_buffer_data_1.rgb;
-    const float metallic   = g_buffer_data_1.a;
-    const float roughness  = g_buffer_data_3.r;
-    const float visibility = u_PushConstants.shadow == 1 ? texture(s_Shadow, FS_IN_TexCoord).r : 1.0f;
-    const float ao         = u_PushConstants.ao == 1 ? texture(s_AO, FS_IN_TexCoord).r : 1.0f;
+    const vec3  albedo     = g_buffer_albedo(g_buffer_data_1);
+    const float metallic   = g_buffer_metallic(g_buffer_data_1);
+    const float roughness  = g_buffer_roughness(g_buffer_data_2, g_buffer_data_3);
+    const float visibility = c_RayTracedShadows ? texture(s_Shadow, FS_IN_TexCoord).r : 1.0f;
+    const float ao         = c_RayTracedAO ? texture(s_AO, FS_IN_TexCoord).r : 1.0f;
 
-    const vec3 N  = octohedral_to_direction(g_buffer_data_2.rg);
+    const vec3 N  = g_buffer_normal(g_buffer_data_2);
     const vec3 Wo = normalize(u_GlobalUBO.cam_pos.xyz - world_pos);
 
     const vec3 F0        = mix(vec3(0.04f), albedo, metallic);
@@ -198,6 +200,20 @@ void main()
     // Direct Lighting
     Lo += direct_lighting(u_GlobalUBO.light, Wo, N, world_pos, F0, c_diffuse, roughness) * visibility;
 
+    // Local lights, the light picked for this pixel already accounts for its visibility.
+    if (c_LocalLights)
+    {
+        const Reservoir reservoir = unpack_reservoir(texelFetch(s_LightReservoirs, ivec2(FS_IN_TexCoord * vec2(textureSize(s_LightReservoirs, 0))), 0));
+
+        if (reservoir.W > 0.0f)
+        {
+            vec3  Wi;
+            float t_max;
+
+            Lo += local_light_radiance(Lights.data[reservoir.light_idx], world_pos, N, Wo, F0, c_diffuse, roughness, Wi, t_max) * reservoir.W;
+        }
+    }
+
     // Indirect lighting
     Lo += indirect_lighting(N, c_diffuse, roughness, metallic, ao, Wo, F0);
 
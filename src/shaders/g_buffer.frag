@@ -17,14 +17,17 @@ layout(location = 3) in vec3 FS_IN_Tangent;
 layout(location = 4) in vec3 FS_IN_Bitangent;
 layout(location = 5) in vec4 FS_IN_CSPos;
 layout(location = 6) in vec4 FS_IN_PrevCSPos;
+layout(location = 7) flat in uint FS_IN_MaterialIdx;
+layout(location = 8) flat in uint FS_IN_MeshID;
 
 // ------------------------------------------------------------------------
 // OUTPUTS ----------------------------------------------------------------
 // ------------------------------------------------------------------------
 
-layout(location = 0) out vec4 FS_OUT_GBuffer1; // RGB: Albedo, A: Metallic
-layout(location = 1) out vec4 FS_OUT_GBuffer2; // RG: Normal, BA: Motion Vector
-layout(location = 2) out vec4 FS_OUT_GBuffer3; // R: Roughness, G: Curvature, B: Mesh ID, A: Linear Z
+// See common.glsl for the layout of the targets.
+layout(location = 0) out vec4 FS_OUT_GBuffer1;
+layout(location = 1) out vec4 FS_OUT_GBuffer2;
+layout(location = 2) out vec4 FS_OUT_GBuffer3;
 
 // ------------------------------------------------------------------------
 // PUSH CONSTANTS ---------------------------------------------------------
@@ -32,9 +35,6 @@ layout(location = 2) out vec4 FS_OUT_GBuffer3; // R: Roughness, G: Curvature, B:
 
 layout(push_constant) uniform PushConstants
 {
-    mat4  model;
-    uint  material_idx;
-    uint  mesh_id;
     float roughness_multiplier;
 }
 u_PushConstants;
@@ -43,15 +43,6 @@ u_PushConstants;
 // FUNCTIONS --------------------------------------------------------------
 // ------------------------------------------------------------------------
 
-// A simple utility to convert a float to a 2-component octohedral representation
-vec2 direction_to_octohedral(vec3 normal)
-{
-    vec2 p = normal.xy * (1.0f / dot(abs(normal), vec3(1.0f)));
-    return normal.z > 0.0f ? p : (1.0f - abs(p.yx)) * (step(0.0f, p) * 2.0f - vec2(1.0f));
-}
-
-// ------------------------------------------------------------------------
-
 vec2 compute_motion_vector(vec4 prev_pos, vec4 current_pos)
 {
     // Perspective division, covert clip space positions to NDC.
@@ -85,30 +76,22 @@ float compute_curvature(float depth)
 
 void main()
 {
-    const Material material = Materials.data[u_PushConstants.material_idx];
+    const Material material = Materials.data[FS_IN_MaterialIdx];
 
     vec4 albedo = fetch_albedo(material, FS_IN_TexCoord);
 
     if (albedo.a < 0.1)
         discard;
 
-    // G-Buffer 1
-    FS_OUT_GBuffer1.rgb = albedo.rgb;
-    FS_OUT_GBuffer1.a   = fetch_metallic(material, FS_IN_TexCoord);
-
-    // G-Buffer 2
-    vec2 packed_normal = direction_to_octohedral(fetch_normal(material, normalize(FS_IN_Tangent), normalize(FS_IN_Bitangent), normalize(FS_IN_Normal), FS_IN_TexCoord));
-    vec2 motion_vector = compute_motion_vector(FS_IN_PrevCSPos, FS_IN_CSPos);
-
-    FS_OUT_GBuffer2 = vec4(packed_normal, motion_vector);
-
-    // G-Buffer 3
-    float roughness = fetch_roughness(material, FS_IN_TexCoord) * u_PushConstants.roughness_multiplier;
-    float linear_z  = gl_FragCoord.z / gl_FragCoord.w;
-    float curvature = compute_curvature(linear_z);
-    float mesh_id   = float(u_PushConstants.mesh_id);
+    float metallic      = fetch_metallic(material, FS_IN_TexCoord);
+    vec3  normal        = fetch_normal(material, normalize(FS_IN_Tangent), normalize(FS_IN_Bitangent), normalize(FS_IN_Normal), FS_IN_TexCoord);
+    vec2  motion_vector = compute_motion_vector(FS_IN_PrevCSPos, FS_IN_CSPos);
+    float roughness     = fetch_roughness(material, FS_IN_TexCoord) * u_PushConstants.roughness_multiplier;
+    float linear_z      = gl_FragCoord.z / gl_FragCoord.w;
+    float curvature     = compute_curvature(linear_z);
+    float mesh_id       = float(FS_IN_MeshID);
 
-    FS_OUT_GBuffer3 = vec4(roughness, curvature, mesh_id, linear_z);
+    encode_g_buffer(albedo.rgb, metallic, normal, motion_vector, roughness, curvature, mesh_id, linear_z, FS_OUT_GBuffer1, FS_OUT_GBuffer2, FS_OUT_GBuffer3);
 }
 
 // ------------------------------------------------------------------------
\ No newline at end of file
@@ -25,6 +25,8 @@ layout(location = 3) out vec3 FS_IN_Tangent;
 layout(location = 4) out vec3 FS_IN_Bitangent;
 layout(location = 5) out vec4 FS_IN_CSPos;
 layout(location = 6) out vec4 FS_IN_PrevCSPos;
+layout(location = 7) flat out uint FS_IN_MaterialIdx;
+layout(location = 8) flat out uint FS_IN_MeshID;
 
 out gl_PerVertex
 {
@@ -48,18 +50,11 @@ layout(set = 1, binding = 0) uniform PerFrameUBO
 }
 u_GlobalUBO;
 
-// ------------------------------------------------------------------------
-// PUSH CONSTANTS ---------------------------------------------------------
-// ------------------------------------------------------------------------
-
-layout(push_constant) uniform PushConstants
+layout(set = 2, binding = 0, std430) readonly buffer DrawDataBuffer
 {
-    mat4  model;
-    uint  material_idx;
-    uint  mesh_id;
-    float roughness_multiplier;
+    DrawData data[];
 }
-u_PushConstants;
+DrawDatas;
 
 // ------------------------------------------------------------------------
 // MAIN -------------------------------------------------------------------
@@ -67,11 +62,14 @@ u_PushConstants;
 
 void main()
 {
+    // Every draw is issued with a single instance whose index points at its draw data.
+    const DrawData draw = DrawDatas.data[gl_InstanceIndex];
+
     // Transform position into world space
-    vec4 world_pos      = u_PushConstants.model * vec4(VS_IN_Position, 1.0);
+    vec4 world_pos      = draw.model * vec4(VS_IN_Position, 1.0);
 
     // Since this demo has static scenes we can use the current Model matrix as the previous one
-    vec4 prev_world_pos = u_PushConstants.model * vec4(VS_IN_Position, 1.0);
+    vec4 prev_world_pos = draw.model * vec4(VS_IN_Position, 1.0);
 
     // Transform world position into clip space
     gl_Position = u_GlobalUBO.view_proj * world_pos;
@@ -87,11 +85,14 @@ void main()
     FS_IN_Texcoord = VS_IN_Texcoord;
 
     // Transform vertex normal into world space
-    mat3 normal_mat = mat3(u_PushConstants.model);
+    mat3 normal_mat = mat3(draw.model);
 
     FS_IN_Normal    = normal_mat * VS_IN_Normal;
     FS_IN_Tangent   = normal_mat * VS_IN_Tangent;
     FS_IN_Bitangent = normal_mat * VS_IN_Bitangent;
+
+    FS_IN_MaterialIdx = draw.material_idx;
+    FS_IN_MeshID      = uint(gl_InstanceIndex);
 }
 
 // ------------------------------------------------------------------------
\ No newline at end of file
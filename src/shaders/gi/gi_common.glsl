@@ -5,14 +5,30 @@
 #define M_PI 3.14159265359
 #endif
 
+// Rays at the start of every probe that use a fixed, un-rotated distribution. They are only used to classify and relocate
+// the probe, so that its state does not flicker with the random rotation of the rest of the rays.
+#define DDGI_NUM_FIXED_RAYS 32
+
+#define DDGI_PROBE_STATE_ACTIVE 0
+#define DDGI_PROBE_STATE_INACTIVE 1
+// Set for probes that were scrolled into a cascade and have not been traced at their new position yet.
+#define DDGI_PROBE_STATE_UNINITIALIZED 2
+
+#define DDGI_MAX_CASCADES 4
+
 // ------------------------------------------------------------------------
 
+// Cascades are stacked along Z in every probe texture, so a probe index is the index within its cascade plus the cascade
+// times the number of probes per cascade. Within a cascade, the probe at grid coordinate C relative to the grid start is stored
+// at (C + scroll_offset) % probe_counts so that the cascade can follow the camera without moving any probe data.
 struct DDGIUniforms
 {
-    vec3  grid_start_position;
-    vec3  grid_step;
+    vec3  grid_start_position[DDGI_MAX_CASCADES];
+    vec3  grid_step[DDGI_MAX_CASCADES];
+    ivec3 scroll_offset[DDGI_MAX_CASCADES];
+    float max_distance[DDGI_MAX_CASCADES];
     ivec3 probe_counts;
-    float max_distance;
+    int   num_cascades;
     float depth_sharpness;
     float hysteresis;
     float normal_bias;
@@ -25,27 +41,96 @@ struct DDGIUniforms
     int   depth_texture_height;
     int   rays_per_probe;
     int   visibility_test;
+    int   probe_update_offset;
+    int   probe_update_count;
 };
 
 // ------------------------------------------------------------------------
 
-ivec3 base_grid_coord(in DDGIUniforms ddgi, vec3 X) 
+// Shaders that compile the visibility test in or out define DDGI_VISIBILITY_TEST_CONSTANT_ID before including this file, the
+// others branch on the uniform.
+#if defined(DDGI_VISIBILITY_TEST_CONSTANT_ID)
+layout(constant_id = DDGI_VISIBILITY_TEST_CONSTANT_ID) const bool c_DDGIVisibilityTest = true;
+#    define DDGI_VISIBILITY_TEST(ddgi) c_DDGIVisibilityTest
+#else
+#    define DDGI_VISIBILITY_TEST(ddgi) (ddgi.visibility_test == 1)
+#endif
+
+// The low memory tier stores the radiance of a ray as R11G11B10F and only its hit distance, in .r of the direction depth texture,
+// since the direction follows from the ray index. Shaders that write or read the rays define DDGI_LOW_MEMORY_CONSTANT_ID before
+// including this file.
+#if defined(DDGI_LOW_MEMORY_CONSTANT_ID)
+layout(constant_id = DDGI_LOW_MEMORY_CONSTANT_ID) const bool c_DDGILowMemory = false;
+#endif
+
+// ------------------------------------------------------------------------
+
+vec3 spherical_fibonacci(float i, float n)
+{
+    const float PHI = sqrt(5) * 0.5 + 0.5;
+#define madfrac(A, B) ((A) * (B)-floor((A) * (B)))
+    float phi       = 2.0 * M_PI * madfrac(i, PHI - 1);
+    float cos_theta = 1.0 - (2.0 * i + 1.0) * (1.0 / n);
+    float sin_theta = sqrt(clamp(1.0 - cos_theta * cos_theta, 0.0f, 1.0f));
+
+    return vec3(cos(phi) * sin_theta, sin(phi) * sin_theta, cos_theta);
+
+#undef madfrac
+}
+
+// ------------------------------------------------------------------------
+
+// The direction of a ray of every probe for the frame that random_orientation was drawn for, the fixed rays are not rotated.
+vec3 probe_ray_direction(in DDGIUniforms ddgi, int ray_id, mat3 random_orientation)
+{
+    if (ray_id < DDGI_NUM_FIXED_RAYS)
+        return spherical_fibonacci(ray_id, DDGI_NUM_FIXED_RAYS);
+
+    return normalize(random_orientation * spherical_fibonacci(ray_id - DDGI_NUM_FIXED_RAYS, ddgi.rays_per_probe - DDGI_NUM_FIXED_RAYS));
+}
+
+// ------------------------------------------------------------------------
+
+int probes_per_cascade(in DDGIUniforms ddgi)
 {
-    return clamp(ivec3((X - ddgi.grid_start_position) / ddgi.grid_step), ivec3(0, 0, 0), ivec3(ddgi.probe_counts) - ivec3(1, 1, 1));
+    return ddgi.probe_counts.x * ddgi.probe_counts.y * ddgi.probe_counts.z;
 }
 
 // ------------------------------------------------------------------------
 
-vec3 grid_coord_to_position(in DDGIUniforms ddgi, ivec3 c)
+int total_probes(in DDGIUniforms ddgi)
 {
-    return ddgi.grid_step * vec3(c) + ddgi.grid_start_position;
+    return probes_per_cascade(ddgi) * ddgi.num_cascades;
 }
 
 // ------------------------------------------------------------------------
 
-int grid_coord_to_probe_index(in DDGIUniforms ddgi, in ivec3 probe_coords) 
+int probe_cascade(in DDGIUniforms ddgi, int index)
 {
-    return int(probe_coords.x + probe_coords.y * ddgi.probe_counts.x + probe_coords.z * ddgi.probe_counts.x * ddgi.probe_counts.y);
+    return index / probes_per_cascade(ddgi);
+}
+
+// ------------------------------------------------------------------------
+
+ivec3 base_grid_coord(in DDGIUniforms ddgi, int cascade, vec3 X) 
+{
+    return clamp(ivec3((X - ddgi.grid_start_position[cascade]) / ddgi.grid_step[cascade]), ivec3(0, 0, 0), ivec3(ddgi.probe_counts) - ivec3(1, 1, 1));
+}
+
+// ------------------------------------------------------------------------
+
+vec3 grid_coord_to_position(in DDGIUniforms ddgi, int cascade, ivec3 c)
+{
+    return ddgi.grid_step[cascade] * vec3(c) + ddgi.grid_start_position[cascade];
+}
+
+// ------------------------------------------------------------------------
+
+int grid_coord_to_probe_index(in DDGIUniforms ddgi, int cascade, in ivec3 probe_coords) 
+{
+    ivec3 storage_coords = (probe_coords + ddgi.scroll_offset[cascade]) % ddgi.probe_counts;
+
+    return int(storage_coords.x + storage_coords.y * ddgi.probe_counts.x + storage_coords.z * ddgi.probe_counts.x * ddgi.probe_counts.y) + cascade * probes_per_cascade(ddgi);
 }
 
 // ------------------------------------------------------------------------
@@ -54,10 +139,12 @@ ivec3 probe_index_to_grid_coord(in DDGIUniforms ddgi, int index)
 {
     ivec3 i_pos;
 
+    int local_index = index % probes_per_cascade(ddgi);
+
     // Slow, but works for any # of probes
-    i_pos.x = index % ddgi.probe_counts.x;
-    i_pos.y = (index % (ddgi.probe_counts.x * ddgi.probe_counts.y)) / ddgi.probe_counts.x;
-    i_pos.z = index / (ddgi.probe_counts.x * ddgi.probe_counts.y);
+    i_pos.x = local_index % ddgi.probe_counts.x;
+    i_pos.y = (local_index % (ddgi.probe_counts.x * ddgi.probe_counts.y)) / ddgi.probe_counts.x;
+    i_pos.z = local_index / (ddgi.probe_counts.x * ddgi.probe_counts.y);
 
     // Assumes probeCounts are powers of two.
     // Saves ~10ms compared to the divisions above
@@ -66,7 +153,8 @@ ivec3 probe_index_to_grid_coord(in DDGIUniforms ddgi, int index)
     //    i_pos.y = (index & ((ddgi.probe_counts.x * ddgi.probe_counts.y) - 1)) >> findMSB(ddgi.probe_counts.x);
     //    i_pos.z = index >> findMSB(ddgi.probe_counts.x * ddgi.probe_counts.y);
 
-    return i_pos;
+    // Undo the scrolling to get from the storage coordinate to the grid coordinate. The scroll offset is always positive.
+    return (i_pos - ddgi.scroll_offset[probe_cascade(ddgi, index)] + ddgi.probe_counts) % ddgi.probe_counts;
 }
 
 // ------------------------------------------------------------------------
@@ -77,7 +165,47 @@ vec3 probe_location(in DDGIUniforms ddgi, int index)
     ivec3 grid_coord = probe_index_to_grid_coord(ddgi, index);
 
     // Compute probe position from grid coord.
-    return grid_coord_to_position(ddgi, grid_coord);
+    return grid_coord_to_position(ddgi, probe_cascade(ddgi, index), grid_coord);
+}
+
+// ------------------------------------------------------------------------
+
+// The probe data texture holds one texel per probe, laid out like the probes in the irradiance and depth textures. XYZ is the
+// relocation offset in units of the grid step and W is the probe state.
+ivec2 probe_data_coord(in DDGIUniforms ddgi, int index)
+{
+    int probes_per_row = ddgi.probe_counts.x * ddgi.probe_counts.y;
+    return ivec2(index % probes_per_row, index / probes_per_row);
+}
+
+// ------------------------------------------------------------------------
+
+vec3 probe_location(in DDGIUniforms ddgi, int index, sampler2D probe_data_texture)
+{
+    return probe_location(ddgi, index) + texelFetch(probe_data_texture, probe_data_coord(ddgi, index), 0).xyz * ddgi.grid_step[probe_cascade(ddgi, index)];
+}
+
+// ------------------------------------------------------------------------
+
+int probe_state(in DDGIUniforms ddgi, int index, sampler2D probe_data_texture)
+{
+    return int(texelFetch(probe_data_texture, probe_data_coord(ddgi, index), 0).w);
+}
+
+// ------------------------------------------------------------------------
+
+bool is_probe_active(in DDGIUniforms ddgi, int index, sampler2D probe_data_texture)
+{
+    return probe_state(ddgi, index, probe_data_texture) == DDGI_PROBE_STATE_ACTIVE;
+}
+
+// ------------------------------------------------------------------------
+
+// Only a window of probes starting at probe_update_offset is traced every frame, the window wraps around the end of the grid.
+bool is_probe_in_update_window(in DDGIUniforms ddgi, int index)
+{
+    int num_probes = total_probes(ddgi);
+    return ((index - ddgi.probe_update_offset + num_probes) % num_probes) < ddgi.probe_update_count;
 }
 
 // ------------------------------------------------------------------------
@@ -185,16 +313,17 @@ vec2 texture_coord_from_direction(vec3 dir, int probe_index, int full_texture_wi
 
 // ------------------------------------------------------------------------
 
-vec3 sample_irradiance(in DDGIUniforms ddgi, vec3 P, vec3 N, vec3 Wo, sampler2D irradiance_texture, sampler2D depth_texture)
+// Returns the irradiance from a single cascade in RGB, and in A whether any of the surrounding probes contributed.
+vec4 sample_irradiance_cascade(in DDGIUniforms ddgi, int cascade, vec3 P, vec3 N, vec3 Wo, sampler2D irradiance_texture, sampler2D depth_texture, sampler2D probe_data_texture)
 {
-    ivec3 base_grid_coord = base_grid_coord(ddgi, P);
-    vec3 base_probe_pos = grid_coord_to_position(ddgi, base_grid_coord);
+    ivec3 base_grid_coord = base_grid_coord(ddgi, cascade, P);
+    vec3 base_probe_pos = grid_coord_to_position(ddgi, cascade, base_grid_coord);
     
     vec3  sum_irradiance = vec3(0.0f);
     float sum_weight = 0.0f;
 
     // alpha is how far from the floor(currentVertex) position. on [0, 1] for each axis.
-    vec3 alpha = clamp((P - base_probe_pos) / ddgi.grid_step, vec3(0.0f), vec3(1.0f));
+    vec3 alpha = clamp((P - base_probe_pos) / ddgi.grid_step[cascade], vec3(0.0f), vec3(1.0f));
 
     // Iterate over adjacent probe cage
     for (int i = 0; i < 8; ++i) 
@@ -203,12 +332,18 @@ vec3 sample_irradiance(in DDGIUniforms ddgi, vec3 P, vec3 N, vec3 Wo, sampler2D
         // Offset = 0 or 1 along each axis
         ivec3  offset = ivec3(i, i >> 1, i >> 2) & ivec3(1);
         ivec3  probe_grid_coord = clamp(base_grid_coord + offset, ivec3(0), ddgi.probe_counts - ivec3(1));
-        int p = grid_coord_to_probe_index(ddgi, probe_grid_coord);
+        int p = grid_coord_to_probe_index(ddgi, cascade, probe_grid_coord);
+
+        vec4 probe_data = texelFetch(probe_data_texture, probe_data_coord(ddgi, p), 0);
+
+        // Probes inside geometry or far away from any surface have not been updated and would only leak stale light.
+        if (int(probe_data.w) != DDGI_PROBE_STATE_ACTIVE)
+            continue;
 
         // Make cosine falloff in tangent plane with respect to the angle from the surface to the probe so that we never
         // test a probe that is *behind* the surface.
         // It doesn't have to be cosine, but that is efficient to compute and we must clip to the tangent plane.
-        vec3 probe_pos = grid_coord_to_position(ddgi, probe_grid_coord);
+        vec3 probe_pos = grid_coord_to_position(ddgi, cascade, probe_grid_coord) + probe_data.xyz * ddgi.grid_step[cascade];
 
         // Bias the position at which visibility is computed; this
         // avoids performing a shadow test *at* a surface, which is a
@@ -253,7 +388,7 @@ vec3 sample_irradiance(in DDGIUniforms ddgi, vec3 P, vec3 N, vec3 Wo, sampler2D
         }
 
         // Moment visibility test
-        if (ddgi.visibility_test == 1)
+        if (DDGI_VISIBILITY_TEST(ddgi))
         {
             vec2 tex_coord = texture_coord_from_direction(-dir, p, ddgi.depth_texture_width, ddgi.depth_texture_height, ddgi.depth_probe_side_length);
 
@@ -304,6 +439,10 @@ vec3 sample_irradiance(in DDGIUniforms ddgi, vec3 P, vec3 N, vec3 Wo, sampler2D
         sum_weight += weight;
     }
 
+    // All of the surrounding probes can be inactive, which leaves no weight at all.
+    if (sum_weight == 0.0f)
+        return vec4(0.0f);
+
     vec3 net_irradiance = sum_irradiance / sum_weight;
     
     net_irradiance.x = isnan(net_irradiance.x) ? 0.5f : net_irradiance.x;
@@ -316,7 +455,47 @@ vec3 sample_irradiance(in DDGIUniforms ddgi, vec3 P, vec3 N, vec3 Wo, sampler2D
 #   endif
     net_irradiance *= ddgi.energy_preservation;
 
-    return 0.5f * M_PI * net_irradiance;
+    return vec4(0.5f * M_PI * net_irradiance, 1.0f);
+}
+
+// ------------------------------------------------------------------------
+
+// Weight of a cascade at a point, which fades out over the outermost cell of the cascade so that there is no seam where it
+// hands over to the next coarser one.
+float cascade_weight(in DDGIUniforms ddgi, int cascade, vec3 P)
+{
+    vec3 grid_end_position = grid_coord_to_position(ddgi, cascade, ddgi.probe_counts - ivec3(1));
+    vec3 distance_to_edge  = min(P - ddgi.grid_start_position[cascade], grid_end_position - P) / ddgi.grid_step[cascade];
+
+    return clamp(min(distance_to_edge.x, min(distance_to_edge.y, distance_to_edge.z)), 0.0f, 1.0f);
+}
+
+// ------------------------------------------------------------------------
+
+vec3 sample_irradiance(in DDGIUniforms ddgi, vec3 P, vec3 N, vec3 Wo, sampler2D irradiance_texture, sampler2D depth_texture, sampler2D probe_data_texture)
+{
+    vec3  irradiance       = vec3(0.0f);
+    float remaining_weight = 1.0f;
+
+    // Start from the finest cascade and let the coarser ones fill in where it fades out. The coarsest cascade is used as is
+    // outside of its bounds, which is what a single grid did before.
+    for (int cascade = 0; cascade < ddgi.num_cascades && remaining_weight > 0.0f; cascade++)
+    {
+        float weight = cascade == (ddgi.num_cascades - 1) ? 1.0f : cascade_weight(ddgi, cascade, P);
+
+        if (weight > 0.0f)
+        {
+            vec4 cascade_irradiance = sample_irradiance_cascade(ddgi, cascade, P, N, Wo, irradiance_texture, depth_texture, probe_data_texture);
+
+            // Cascades without any active probe around the point defer to the next one.
+            weight *= cascade_irradiance.a;
+
+            irradiance += remaining_weight * weight * cascade_irradiance.rgb;
+            remaining_weight *= 1.0f - weight;
+        }
+    }
+
+    return irradiance;
 }
 
 // ------------------------------------------------------------------------
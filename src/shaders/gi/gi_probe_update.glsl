@@ -37,6 +37,7 @@ layout(set = 1, binding = 2, scalar) uniform DDGIUBO
 {
     DDGIUniforms ddgi; 
 };
+layout(set = 1, binding = 3) uniform sampler2D s_ProbeData;
 
 layout(set = 2, binding = 0) uniform sampler2D s_InputRadiance;
 layout(set = 2, binding = 1) uniform sampler2D s_InputDirectionDepth;
@@ -47,6 +48,7 @@ layout(set = 2, binding = 1) uniform sampler2D s_InputDirectionDepth;
 
 layout(push_constant) uniform PushConstants
 {
+    mat4 random_orientation;
     uint first_frame;
 }
 u_PushConstants;
@@ -76,7 +78,12 @@ void populate_cache(int relative_probe_id, uint offset, uint num_rays)
     {
         ivec2 C = ivec2(offset + uint(gl_LocalInvocationIndex), relative_probe_id);
 
-        g_ray_direction_depth[gl_LocalInvocationIndex] = texelFetch(s_InputDirectionDepth, C, 0);
+        vec4 ray_direction_depth = texelFetch(s_InputDirectionDepth, C, 0);
+
+        if (c_DDGILowMemory)
+            ray_direction_depth = vec4(probe_ray_direction(ddgi, C.x, mat3(u_PushConstants.random_orientation)), ray_direction_depth.r);
+
+        g_ray_direction_depth[gl_LocalInvocationIndex] = ray_direction_depth;
     #if !defined(DEPTH_PROBE_UPDATE) 
         g_ray_hit_radiance[gl_LocalInvocationIndex] = texelFetch(s_InputRadiance, C, 0).xyz;
     #endif 
@@ -85,7 +92,7 @@ void populate_cache(int relative_probe_id, uint offset, uint num_rays)
 
 // ------------------------------------------------------------------
 
-void gather_rays(ivec2 current_coord, uint num_rays, inout vec3 result, inout float total_weight)
+void gather_rays(ivec2 current_coord, uint num_rays, float max_distance, inout vec3 result, inout float total_weight)
 {
     const float energy_conservation = 0.95f;
 
@@ -97,11 +104,12 @@ void gather_rays(ivec2 current_coord, uint num_rays, inout vec3 result, inout fl
         vec3  ray_direction      = ray_direction_depth.xyz;
 
 #if defined(DEPTH_PROBE_UPDATE)            
-        float ray_probe_distance = min(ddgi.max_distance, ray_direction_depth.w - 0.01f);
+        // Backface hits are stored as negative distances.
+        float ray_probe_distance = min(max_distance, abs(ray_direction_depth.w) - 0.01f);
             
         // Detect misses and force depth
         if (ray_probe_distance == -1.0f)
-            ray_probe_distance = ddgi.max_distance;
+            ray_probe_distance = max_distance;
 #else        
         vec3  ray_hit_radiance   = g_ray_hit_radiance[r] * energy_conservation;
 #endif
@@ -138,12 +146,35 @@ void main()
     const ivec2 current_coord = ivec2(gl_GlobalInvocationID.xy) + (ivec2(gl_WorkGroupID.xy) * ivec2(2)) + ivec2(2);
 
     const int   relative_probe_id   = probe_id(current_coord, TEXTURE_WIDTH, PROBE_SIDE_LENGTH);
-    
+
+    vec3 prev_result;
+
+#if defined(DEPTH_PROBE_UPDATE)
+    prev_result = texelFetch(s_InputDepth, current_coord, 0).rgb;
+#else
+    prev_result = texelFetch(s_InputIrradiance, current_coord, 0).rgb;
+#endif
+
+    // Probes that were not traced this frame carry their previous value over, since the output is the other half of the ping pong
+    // pair. The whole work group covers a single probe so the early out does not diverge around the barriers below.
+    const int state = probe_state(ddgi, relative_probe_id, s_ProbeData);
+
+    if (u_PushConstants.first_frame == 0 && (!is_probe_in_update_window(ddgi, relative_probe_id) || state == DDGI_PROBE_STATE_INACTIVE))
+    {
+#if defined(DEPTH_PROBE_UPDATE)
+        imageStore(i_OutputDepth, current_coord, vec4(prev_result, 1.0));
+#else
+        imageStore(i_OutputIrradiance, current_coord, vec4(prev_result, 1.0));
+#endif
+        return;
+    }
+
     vec3  result       = vec3(0.0f);
     float total_weight = 0.0f;
 
-    uint remaining_rays = ddgi.rays_per_probe;
-    uint offset = 0;
+    // The fixed rays are only used for classification and relocation.
+    uint remaining_rays = ddgi.rays_per_probe - DDGI_NUM_FIXED_RAYS;
+    uint offset = DDGI_NUM_FIXED_RAYS;
 
     while (remaining_rays > 0)
     {
@@ -153,7 +184,7 @@ void main()
 
         barrier();
 
-        gather_rays(current_coord, num_rays, result, total_weight);
+        gather_rays(current_coord, num_rays, ddgi.max_distance[probe_cascade(ddgi, relative_probe_id)], result, total_weight);
 
         barrier();
 
@@ -164,16 +195,8 @@ void main()
     if (total_weight > FLT_EPS)
         result /= total_weight;
 
-    // Temporal Accumulation
-    vec3 prev_result;
-
-#if defined(DEPTH_PROBE_UPDATE)
-    prev_result = texelFetch(s_InputDepth, current_coord, 0).rgb;
-#else
-    prev_result = texelFetch(s_InputIrradiance, current_coord, 0).rgb;
-#endif
-            
-    if (u_PushConstants.first_frame == 0)            
+    // Temporal Accumulation, probes that were just scrolled in have no history at their new position.
+    if (u_PushConstants.first_frame == 0 && state != DDGI_PROBE_STATE_UNINITIALIZED)
         result = mix(result, prev_result, ddgi.hysteresis);
 
 #if defined(DEPTH_PROBE_UPDATE)
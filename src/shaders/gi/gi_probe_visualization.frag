@@ -29,6 +29,7 @@ layout(set = 1, binding = 2, scalar) uniform DDGIUBO
 {
     DDGIUniforms ddgi;
 };
+layout(set = 1, binding = 3) uniform sampler2D s_ProbeData;
 
 // ------------------------------------------------------------------------
 // PUSH CONSTANTS ---------------------------------------------------------
@@ -46,6 +47,13 @@ u_PushConstants;
 
 void main()
 {
+    // Inactive probes hold stale irradiance, draw them in a flat color instead.
+    if (!is_probe_active(ddgi, FS_IN_ProbeIdx, s_ProbeData))
+    {
+        FS_OUT_Color = vec4(0.5f, 0.0f, 0.0f, 1.0f);
+        return;
+    }
+
     vec2 probe_coord = texture_coord_from_direction(normalize(FS_IN_Normal),
                                                     FS_IN_ProbeIdx,
                                                     ddgi.irradiance_texture_width,
@@ -50,6 +50,7 @@ layout(set = 1, binding = 2, scalar) uniform DDGIUBO
 {
     DDGIUniforms ddgi;
 };
+layout(set = 1, binding = 3) uniform sampler2D s_ProbeData;
 
 // ------------------------------------------------------------------------
 // PUSH CONSTANTS ---------------------------------------------------------
@@ -67,11 +68,8 @@ u_PushConstants;
 
 void main()
 {
-    // Compute grid coord from instance ID.
-    ivec3 grid_coord = probe_index_to_grid_coord(ddgi, gl_InstanceIndex);
-
-    // Compute probe position from grid coord.
-    vec3 probe_position = grid_coord_to_position(ddgi, grid_coord);
+    // Compute the relocated probe position from the instance ID.
+    vec3 probe_position = probe_location(ddgi, gl_InstanceIndex, s_ProbeData);
 
     // Scale and offset the vertex position.
     gl_Position = u_GlobalUBO.view_proj * vec4((VS_IN_Position * u_PushConstants.scale) + probe_position, 1.0f);
@@ -0,0 +1,79 @@
+#ifndef GI_SHADE_HIT_GLSL
+#define GI_SHADE_HIT_GLSL
+
+// Shading of the closest hit of a probe ray, shared by gi_ray_trace.rchit and gi_ray_trace.comp. The including shader declares
+// the descriptor sets, push constants and c_InfiniteBounces that are read here.
+
+// ------------------------------------------------------------------------
+
+vec3 fresnel_schlick_roughness(float cosTheta, vec3 F0, float roughness)
+{
+    return F0 + (max(vec3(1.0 - roughness), F0) - F0) * pow(max(1.0 - cosTheta, 0.0), 5.0);
+}
+
+// ----------------------------------------------------------------------------
+
+vec3 indirect_lighting(vec3 Wo, vec3 N, vec3 P, vec3 F0, vec3 diffuse_color, float roughness, float metallic)
+{
+    vec3 F = fresnel_schlick_roughness(max(dot(N, Wo), 0.0), F0, roughness);
+
+    vec3 kS = F;
+    vec3 kD = 1.0 - kS;
+    kD *= 1.0 - metallic;
+
+    return u_PushConstants.gi_intensity * kD * diffuse_color * sample_irradiance(ddgi, P, N, Wo, s_Irradiance, s_Depth, s_ProbeData);
+}
+
+// Picks one of a few candidate local lights and traces it, which is plenty for the probes since they are averaged over many rays.
+vec3 local_lighting(vec3 Wo, vec3 N, vec3 P, vec3 F0, vec3 diffuse_color, float roughness, inout RNG rng)
+{
+    const Reservoir reservoir = sample_local_lights(P, N, Wo, F0, diffuse_color, roughness, 4, rng);
+
+    if (reservoir.W == 0.0f)
+        return vec3(0.0f);
+
+    vec3  Wi;
+    float t_max;
+
+    const vec3 radiance = local_light_radiance(Lights.data[reservoir.light_idx], P, N, Wo, F0, diffuse_color, roughness, Wi, t_max);
+
+    return radiance * reservoir.W * query_distance(P + N * 0.1f, Wi, t_max);
+}
+
+// ------------------------------------------------------------------------
+
+vec3 shade_gi_hit(in Instance instance, in HitInfo hit_info, in vec2 hit_attribs, in vec3 Wo, in vec3 T, inout RNG rng)
+{
+    const Triangle triangle = fetch_triangle(instance, hit_info);
+    const Material material = Materials.data[hit_info.mat_idx];
+
+    const vec3 barycentrics = vec3(1.0 - hit_attribs.x - hit_attribs.y, hit_attribs.x, hit_attribs.y);
+
+    Vertex vertex = interpolated_vertex(triangle, barycentrics);
+
+    transform_vertex(instance, vertex);
+
+    const vec3  albedo    = fetch_albedo(material, vertex.tex_coord.xy).rgb;
+    const float roughness = fetch_roughness(material, vertex.tex_coord.xy);
+    const float metallic  = fetch_metallic(material, vertex.tex_coord.xy);
+
+    const vec3 N = fetch_normal(material, vertex.tangent.xyz, vertex.tangent.xyz, vertex.normal.xyz, vertex.tex_coord.xy);
+
+    const vec3 F0        = mix(vec3(0.04f), albedo, metallic);
+    const vec3 c_diffuse = mix(albedo * (vec3(1.0f) - F0), vec3(0.0f), metallic);
+
+    vec3 Lo = vec3(0.0f);
+
+    Lo += direct_lighting(ubo.light, Wo, N, vertex.position.xyz, F0, c_diffuse, roughness, T, next_vec2(rng), s_Cubemap);
+
+    Lo += T * local_lighting(Wo, N, vertex.position.xyz, F0, c_diffuse, roughness, rng);
+
+    if (c_InfiniteBounces)
+        Lo += indirect_lighting(Wo, N, vertex.position.xyz, F0, c_diffuse, roughness, metallic);
+
+    return Lo;
+}
+
+// ------------------------------------------------------------------------
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef GPU_COUNTERS_GLSL
+#define GPU_COUNTERS_GLSL
+
+// ------------------------------------------------------------------------
+
+// Must match gpu_counters.h.
+#define GPU_COUNTER_SHADOW_RAYS 0
+#define GPU_COUNTER_AO_RAYS 1
+#define GPU_COUNTER_REFLECTION_RAYS 2
+#define GPU_COUNTER_GI_RAYS 3
+
+// ------------------------------------------------------------------------
+
+// The counters of the current frame, read back by GPUCounters. Shaders reduce their counts per workgroup or per subgroup before
+// adding them, one atomic per ray would contend on the same few addresses.
+#if defined(GPU_COUNTERS_DESCRIPTOR_SET)
+
+layout(set = GPU_COUNTERS_DESCRIPTOR_SET, binding = 0, std430) buffer GPUCounters_t
+{
+    uint values[];
+}
+GPUCounters;
+
+// ------------------------------------------------------------------------
+
+void gpu_counter_add(uint id, uint value)
+{
+    if (value > 0)
+        atomicAdd(GPUCounters.values[id], value);
+}
+
+// ------------------------------------------------------------------------
+
+// Adds 1 for every active invocation of the subgroup, requires GL_KHR_shader_subgroup_basic and GL_KHR_shader_subgroup_ballot.
+void gpu_counter_add_subgroup(uint id)
+{
+    const uint count = subgroupBallotBitCount(subgroupBallot(true));
+
+    if (subgroupElect())
+        gpu_counter_add(id, count);
+}
+
+#endif
+
+// ------------------------------------------------------------------------
+
+#endif
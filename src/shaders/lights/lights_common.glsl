@@ -0,0 +1,262 @@
+#ifndef LIGHTS_COMMON_GLSL
+#define LIGHTS_COMMON_GLSL
+
+#include "../brdf.glsl"
+
+// ------------------------------------------------------------------------
+
+// Must match many_lights.h.
+#define LIGHT_CLUSTER_GRID_X 16
+#define LIGHT_CLUSTER_GRID_Y 8
+#define LIGHT_CLUSTER_GRID_Z 24
+#define MAX_LIGHTS_PER_CLUSTER 64
+
+// ------------------------------------------------------------------------
+
+// The clusters split the view frustum into screen space tiles and exponentially spaced depth slices.
+struct LightClusterUniforms
+{
+    mat4  view;
+    mat4  view_proj;
+    mat4  proj_inverse;
+    vec4  cluster_params; // x: near plane, y: far plane, z: depth slices per unit of log depth
+    uvec4 light_counts;   // x: number of lights in the light buffer
+};
+
+// ------------------------------------------------------------------------
+
+// The light picked out of the M candidates a reservoir has seen so far. W turns the unshadowed contribution of that light into
+// an estimate of the contribution of all of them and is zero once the light was found to be occluded. Only the light, M and
+// W are stored in between passes, the sum of the weights and the target pdf are only used while the reservoir is built.
+struct Reservoir
+{
+    uint  light_idx;
+    float w_sum;
+    float target_pdf;
+    float M;
+    float W;
+};
+
+// ------------------------------------------------------------------------
+
+#if defined(LIGHTS_DESCRIPTOR_SET)
+
+// The cluster lists are only written by the culling shader.
+#if defined(LIGHTS_WRITE_CLUSTERS)
+#define LIGHTS_CLUSTER_ACCESS
+#else
+#define LIGHTS_CLUSTER_ACCESS readonly
+#endif
+
+layout(set = LIGHTS_DESCRIPTOR_SET, binding = 0) uniform LightClusterUBO
+{
+    LightClusterUniforms light_clusters;
+};
+
+layout(set = LIGHTS_DESCRIPTOR_SET, binding = 1, std430) readonly buffer Lights_t
+{
+    Light data[];
+}
+Lights;
+
+layout(set = LIGHTS_DESCRIPTOR_SET, binding = 2, std430) LIGHTS_CLUSTER_ACCESS buffer ClusterLightCounts_t
+{
+    uint counts[];
+}
+ClusterLightCounts;
+
+layout(set = LIGHTS_DESCRIPTOR_SET, binding = 3, std430) LIGHTS_CLUSTER_ACCESS buffer ClusterLightIndices_t
+{
+    uint indices[];
+}
+ClusterLightIndices;
+
+#endif
+
+// ------------------------------------------------------------------------
+
+Reservoir empty_reservoir()
+{
+    Reservoir r;
+
+    r.light_idx  = 0;
+    r.w_sum      = 0.0f;
+    r.target_pdf = 0.0f;
+    r.M          = 0.0f;
+    r.W          = 0.0f;
+
+    return r;
+}
+
+// ------------------------------------------------------------------------
+
+// Light indices are far below 2^24, so they survive the trip through a float channel.
+vec4 pack_reservoir(Reservoir r)
+{
+    return vec4(float(r.light_idx), r.M, r.W, 0.0f);
+}
+
+// ------------------------------------------------------------------------
+
+Reservoir unpack_reservoir(vec4 packed)
+{
+    Reservoir r = empty_reservoir();
+
+    r.light_idx = uint(packed.x);
+    r.M         = packed.y;
+    r.W         = packed.z;
+
+    return r;
+}
+
+// ------------------------------------------------------------------------
+
+void reservoir_update(inout Reservoir r, uint light_idx, float target_pdf, float w, float M, float rnd)
+{
+    r.w_sum += w;
+    r.M += M;
+
+    if (w > 0.0f && rnd * r.w_sum < w)
+    {
+        r.light_idx  = light_idx;
+        r.target_pdf = target_pdf;
+    }
+}
+
+// ------------------------------------------------------------------------
+
+// Streams all the candidates of another reservoir into this one at once. The target pdf is that of the other reservoir's light
+// at the pixel of this one.
+void reservoir_merge(inout Reservoir r, Reservoir other, float target_pdf, float rnd)
+{
+    reservoir_update(r, other.light_idx, target_pdf, target_pdf * other.W * other.M, other.M, rnd);
+}
+
+// ------------------------------------------------------------------------
+
+void reservoir_finalize(inout Reservoir r)
+{
+    r.W = r.target_pdf > 0.0f ? r.w_sum / (r.M * r.target_pdf) : 0.0f;
+}
+
+// ------------------------------------------------------------------------
+
+// Unshadowed contribution of a point or spot light. The inverse square falloff is windowed so that it reaches zero at the range
+// of the light, which is what the light is culled against.
+vec3 local_light_radiance(in Light light, in vec3 P, in vec3 N, in vec3 Wo, in vec3 F0, in vec3 diffuse_color, in float roughness, out vec3 Wi, out float t_max)
+{
+    const vec3  to_light       = light_position(light) - P;
+    const float light_distance = length(to_light);
+
+    Wi    = to_light / max(light_distance, EPSILON);
+    t_max = light_distance;
+
+    const float NdotL = dot(N, Wi);
+
+    if (NdotL <= 0.0f || light_distance >= light_range(light))
+        return vec3(0.0f);
+
+    const float falloff = light_distance / light_range(light);
+    const float window  = clamp(1.0f - falloff * falloff * falloff * falloff, 0.0f, 1.0f);
+
+    float attenuation = (window * window) / max(light_distance * light_distance, 0.01f);
+
+    if (light_type(light) == LIGHT_TYPE_SPOT)
+        attenuation *= smoothstep(light_cos_theta_outer(light), light_cos_theta_inner(light), dot(Wi, light_direction(light)));
+
+    const vec3 Wh = normalize(Wo + Wi);
+
+    return evaluate_uber_brdf(diffuse_color, roughness, N, F0, Wo, Wh, Wi) * light_color(light) * light_intensity(light) * attenuation * NdotL;
+}
+
+// ------------------------------------------------------------------------
+
+// Lights are resampled by the luminance of their unshadowed contribution. Unlike luminance() this is zero for black, so lights
+// that cannot contribute are never picked.
+float light_target_pdf(vec3 radiance)
+{
+    return max(dot(radiance, vec3(0.299f, 0.587f, 0.114f)), 0.0f);
+}
+
+// ------------------------------------------------------------------------
+
+#if defined(LIGHTS_DESCRIPTOR_SET)
+
+uint light_cluster_slice(float view_z)
+{
+    return uint(clamp(log(view_z / light_clusters.cluster_params.x) * light_clusters.cluster_params.z, 0.0f, float(LIGHT_CLUSTER_GRID_Z - 1)));
+}
+
+// ------------------------------------------------------------------------
+
+// Returns -1 for points outside of the view frustum, which are not covered by any cluster.
+int light_cluster_index(vec3 P)
+{
+    const vec4 clip_pos = light_clusters.view_proj * vec4(P, 1.0f);
+
+    if (clip_pos.w <= 0.0f)
+        return -1;
+
+    const vec2  ndc    = clip_pos.xy / clip_pos.w;
+    const float view_z = -(light_clusters.view * vec4(P, 1.0f)).z;
+
+    if (any(greaterThan(abs(ndc), vec2(1.0f))) || view_z > light_clusters.cluster_params.y)
+        return -1;
+
+    const uvec2 tile = min(uvec2((ndc * 0.5f + 0.5f) * vec2(LIGHT_CLUSTER_GRID_X, LIGHT_CLUSTER_GRID_Y)), uvec2(LIGHT_CLUSTER_GRID_X - 1, LIGHT_CLUSTER_GRID_Y - 1));
+
+    return int((light_cluster_slice(view_z) * LIGHT_CLUSTER_GRID_Y + tile.y) * LIGHT_CLUSTER_GRID_X + tile.x);
+}
+
+// ------------------------------------------------------------------------
+
+// Points outside of the view frustum, which only the DDGI rays hit, pick from every light instead of the lights of a cluster.
+uint num_candidate_lights(int cluster_idx)
+{
+    return cluster_idx >= 0 ? ClusterLightCounts.counts[cluster_idx] : light_clusters.light_counts.x;
+}
+
+// ------------------------------------------------------------------------
+
+uint candidate_light(int cluster_idx, uint i)
+{
+    return cluster_idx >= 0 ? ClusterLightIndices.indices[cluster_idx * MAX_LIGHTS_PER_CLUSTER + i] : i;
+}
+
+// ------------------------------------------------------------------------
+
+// Resampled importance sampling of the lights that can reach P, picked uniformly from the candidate list and resampled by their
+// unshadowed contribution.
+Reservoir sample_local_lights(in vec3 P, in vec3 N, in vec3 Wo, in vec3 F0, in vec3 diffuse_color, in float roughness, in uint num_candidates, inout RNG rng)
+{
+    Reservoir r = empty_reservoir();
+
+    const int  cluster_idx = light_cluster_index(P);
+    const uint num_lights  = num_candidate_lights(cluster_idx);
+
+    if (num_lights == 0)
+        return r;
+
+    for (uint i = 0; i < num_candidates; i++)
+    {
+        const uint light_idx = candidate_light(cluster_idx, min(uint(next_float(rng) * float(num_lights)), num_lights - 1));
+
+        vec3  Wi;
+        float t_max;
+
+        const float target_pdf = light_target_pdf(local_light_radiance(Lights.data[light_idx], P, N, Wo, F0, diffuse_color, roughness, Wi, t_max));
+
+        // The source pdf is uniform over the candidate list.
+        reservoir_update(r, light_idx, target_pdf, target_pdf * float(num_lights), 1.0f, next_float(rng));
+    }
+
+    reservoir_finalize(r);
+
+    return r;
+}
+
+#endif
+
+// ------------------------------------------------------------------------
+
+#endif
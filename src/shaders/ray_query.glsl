@@ -60,4 +60,47 @@ float query_distance(vec3 world_pos, vec3 direction, float t_max)
 
 // ------------------------------------------------------------------------
 
+// What a closest hit shader would have been invoked with, for compute shaders that shade their hits after traversal.
+struct RayQueryHit
+{
+    uint  instance_custom_index;
+    uint  primitive_id;
+    uint  geometry_index;
+    vec2  barycentrics;
+    float t;
+    bool  front_face;
+};
+
+// ------------------------------------------------------------------------
+
+bool query_closest_hit(vec3 world_pos, vec3 direction, float t_min, float t_max, uint ray_flags, out RayQueryHit hit)
+{
+    rayQueryEXT ray_query;
+
+    rayQueryInitializeEXT(ray_query,
+                          u_TopLevelAS,
+                          ray_flags,
+                          0xFF,
+                          world_pos,
+                          t_min,
+                          direction,
+                          t_max);
+
+    while (rayQueryProceedEXT(ray_query)) {}
+
+    if (rayQueryGetIntersectionTypeEXT(ray_query, true) == gl_RayQueryCommittedIntersectionNoneEXT)
+        return false;
+
+    hit.instance_custom_index = rayQueryGetIntersectionInstanceCustomIndexEXT(ray_query, true);
+    hit.primitive_id          = rayQueryGetIntersectionPrimitiveIndexEXT(ray_query, true);
+    hit.geometry_index        = rayQueryGetIntersectionGeometryIndexEXT(ray_query, true);
+    hit.barycentrics          = rayQueryGetIntersectionBarycentricsEXT(ray_query, true);
+    hit.t                     = rayQueryGetIntersectionTEXT(ray_query, true);
+    hit.front_face            = rayQueryGetIntersectionFrontFaceEXT(ray_query, true);
+
+    return true;
+}
+
+// ------------------------------------------------------------------------
+
 #endif
\ No newline at end of file
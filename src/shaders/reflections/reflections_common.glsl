@@ -0,0 +1,107 @@
+#ifndef REFLECTIONS_COMMON_GLSL
+#define REFLECTIONS_COMMON_GLSL
+
+// ------------------------------------------------------------------------
+
+// Written to the alpha channel of the ray trace output instead of a ray length (>= 0) or a miss (-1) for pixels that were not
+// traced this frame. Skipped pixels keep their history, reconstructed pixels are filled in from their traced neighbours.
+#define REFLECTIONS_REUSE_HISTORY -2.0f
+#define REFLECTIONS_RECONSTRUCT -3.0f
+
+// Number of rays per pixel of a tile at each ray rate picked by reflections_classify_tiles.comp.
+#define REFLECTIONS_RAY_RATE_FULL 1
+#define REFLECTIONS_RAY_RATE_QUARTER 2
+
+// Rays of the ray list are binned by the screen region they start in and the octant of their direction, plus one bin for the
+// pixels that are approximated without a ray, so that neighbouring rays of the sorted list traverse the same part of the BVH.
+#define REFLECTIONS_RAY_BIN_REGION_SIZE 64
+#define REFLECTIONS_RAY_BIN_DIRECTIONS 9
+
+// Rays of the ray list traced by each workgroup of reflections_ray_trace.comp.
+#define REFLECTIONS_RAY_QUERY_NUM_THREADS 64
+
+// ------------------------------------------------------------------------
+
+// Coordinates of the pixels that the screen space pass could not resolve. The first four values are the launch size of
+// reflections_ray_trace.rgen, the dispatch size of reflections_ray_trace.comp follows.
+struct ReflectionsRayListArgs
+{
+    uint num_rays;
+    uint height;
+    uint depth;
+    uint num_ssr_hits;
+    uint num_query_groups_x;
+    uint num_query_groups_y;
+    uint num_query_groups_z;
+    uint padding;
+};
+
+// ------------------------------------------------------------------------
+
+uint pack_ray_coord(ivec2 coord)
+{
+    return (uint(coord.y) << 16) | uint(coord.x);
+}
+
+// ------------------------------------------------------------------------
+
+ivec2 unpack_ray_coord(uint packed)
+{
+    return ivec2(packed & 0xFFFF, packed >> 16);
+}
+
+// ------------------------------------------------------------------------
+
+uint ray_bin(ivec2 coord, ivec2 size, vec3 dir, bool traced)
+{
+    const uint num_regions_x = uint(size.x + REFLECTIONS_RAY_BIN_REGION_SIZE - 1) / REFLECTIONS_RAY_BIN_REGION_SIZE;
+    const uvec2 region       = uvec2(coord) / REFLECTIONS_RAY_BIN_REGION_SIZE;
+    const uint  direction    = traced ? (uint(dir.x >= 0.0f) | (uint(dir.y >= 0.0f) << 1) | (uint(dir.z >= 0.0f) << 2)) : 8;
+
+    return (region.y * num_regions_x + region.x) * REFLECTIONS_RAY_BIN_DIRECTIONS + direction;
+}
+
+// ------------------------------------------------------------------------
+
+// The pixel of every 2x2 quad that is traced by a quarter rate tile, rotated every frame so the history sees each of them.
+ivec2 quarter_rate_offset(uint num_frames)
+{
+    const ivec2 offsets[4] = ivec2[](ivec2(0, 0), ivec2(1, 1), ivec2(1, 0), ivec2(0, 1));
+
+    return offsets[num_frames % 4];
+}
+
+// ------------------------------------------------------------------------
+
+vec4 importance_sample_ggx(vec2 E, vec3 N, float Roughness)
+{
+    float a  = Roughness * Roughness;
+    float m2 = a * a;
+
+    float phi      = 2.0f * M_PI * E.x;
+    float cosTheta = sqrt((1.0f - E.y) / (1.0f + (m2 - 1.0f) * E.y));
+    float sinTheta = sqrt(1.0f - cosTheta * cosTheta);
+
+    // from spherical coordinates to cartesian coordinates - halfway vector
+    vec3 H;
+    H.x = cos(phi) * sinTheta;
+    H.y = sin(phi) * sinTheta;
+    H.z = cosTheta;
+
+    float d = (cosTheta * m2 - cosTheta) * cosTheta + 1;
+    float D = m2 / (M_PI * d * d);
+
+    float PDF = D * cosTheta;
+
+    // from tangent-space H vector to world-space sample vector
+    vec3 up        = abs(N.z) < 0.999f ? vec3(0.0f, 0.0f, 1.0f) : vec3(1.0f, 0.0f, 0.0f);
+    vec3 tangent   = normalize(cross(up, N));
+    vec3 bitangent = cross(N, tangent);
+
+    vec3 sampleVec = tangent * H.x + bitangent * H.y + N * H.z;
+    return vec4(normalize(sampleVec), PDF);
+}
+
+// ------------------------------------------------------------------------
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef REFLECTIONS_SHADE_HIT_GLSL
+#define REFLECTIONS_SHADE_HIT_GLSL
+
+// Shading of the closest hit of a reflection ray, shared by reflections_ray_trace.rchit and reflections_ray_trace.comp. The
+// including shader declares the descriptor sets, push constants and c_SampleGI that are read here.
+
+// ------------------------------------------------------------------------
+
+vec3 fresnel_schlick_roughness(float cosTheta, vec3 F0, float roughness)
+{
+    return F0 + (max(vec3(1.0 - roughness), F0) - F0) * pow(max(1.0 - cosTheta, 0.0), 5.0);
+}
+
+// ----------------------------------------------------------------------------
+
+vec3 indirect_lighting(vec3 Wo, vec3 N, vec3 P, vec3 F0, vec3 diffuse_color, float roughness, float metallic)
+{
+    const vec3 R = reflect(-Wo, N);
+
+    vec3 F = fresnel_schlick_roughness(max(dot(N, Wo), 0.0), F0, roughness);
+
+    vec3 kS = F;
+    vec3 kD = 1.0 - kS;
+    kD *= 1.0 - metallic;
+
+#if defined(IBL_INDIRECT_SPECULAR)
+    const float MAX_REFLECTION_LOD = 4.0;
+
+    vec3 prefiltered_color = textureLod(s_Prefiltered, R, roughness * MAX_REFLECTION_LOD).rgb;
+    vec2 brdf              = texture(s_BRDF, vec2(max(dot(N, Wo), 0.0), roughness)).rg;
+
+    vec3 specular = prefiltered_color * (F * brdf.x + brdf.y) * u_PushConstants.ibl_indirect_specular_intensity;
+#else
+    vec3 specular = vec3(0.0f);
+#endif
+
+    vec3 diffuse = u_PushConstants.gi_intensity * diffuse_color * sample_irradiance(ddgi, P, N, Wo, s_Irradiance, s_Depth, s_ProbeData);
+
+    return kD * diffuse + specular;
+}
+
+// ------------------------------------------------------------------------
+
+vec3 shade_reflection_hit(in Instance instance, in HitInfo hit_info, in vec2 hit_attribs, in vec3 Wo)
+{
+    const Triangle triangle = fetch_triangle(instance, hit_info);
+    const Material material = Materials.data[hit_info.mat_idx];
+
+    const vec3 barycentrics = vec3(1.0 - hit_attribs.x - hit_attribs.y, hit_attribs.x, hit_attribs.y);
+
+    Vertex vertex = interpolated_vertex(triangle, barycentrics);
+
+    transform_vertex(instance, vertex);
+
+    const vec3  albedo    = fetch_albedo(material, vertex.tex_coord.xy).rgb;
+    const float roughness = fetch_roughness(material, vertex.tex_coord.xy);
+    const float metallic  = fetch_metallic(material, vertex.tex_coord.xy);
+
+    const vec3 N = fetch_normal(material, vertex.tangent.xyz, vertex.tangent.xyz, vertex.normal.xyz, vertex.tex_coord.xy);
+
+    const vec3 F0        = mix(vec3(0.04f), albedo, metallic);
+    const vec3 c_diffuse = mix(albedo * (vec3(1.0f) - F0), vec3(0.0f), metallic);
+
+    vec3 Lo = vec3(0.0f);
+
+    Lo += direct_lighting(ubo.light, Wo, N, vertex.position.xyz, F0, c_diffuse, roughness);
+
+    if (c_SampleGI)
+        Lo += indirect_lighting(Wo, N, vertex.position.xyz, F0, c_diffuse, roughness, metallic);
+
+    return Lo;
+}
+
+// ------------------------------------------------------------------------
+
+#endif
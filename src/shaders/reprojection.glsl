@@ -151,13 +151,13 @@ bool reproject(in ivec2 frag_coord,
     const vec4 center_g_buffer_2 = texelFetch(sampler_gbuffer_2, frag_coord, g_buffer_mip);
     const vec4 center_g_buffer_3 = texelFetch(sampler_gbuffer_3, frag_coord, g_buffer_mip);
 
-    const vec2  current_motion  = center_g_buffer_2.zw;
-    const vec3  current_normal  = octohedral_to_direction(center_g_buffer_2.xy);
-    const float current_mesh_id = center_g_buffer_3.z;
+    const vec2  current_motion  = g_buffer_motion_vector(center_g_buffer_2, center_g_buffer_3);
+    const vec3  current_normal  = g_buffer_normal(center_g_buffer_2);
+    const float current_mesh_id = g_buffer_mesh_id(center_g_buffer_3);
     const vec3  current_pos     = world_position_from_depth(tex_coord, depth, view_proj_inverse);
 
 #if defined(REPROJECTION_REFLECTIONS)
-    const float curvature = center_g_buffer_3.g;
+    const float curvature = g_buffer_curvature(center_g_buffer_2, center_g_buffer_3);
     const vec2 history_tex_coord = tex_coord + current_motion;
     const vec2 reprojected_coord = compute_history_coord(frag_coord, 
                                                          ivec2(image_dim), 
@@ -199,8 +199,8 @@ bool reproject(in ivec2 frag_coord,
         vec4  sample_g_buffer_3 = texelFetch(sampler_prev_gbuffer_3, loc, g_buffer_mip);
         float sample_depth      = texelFetch(sampler_prev_gbuffer_depth, loc, g_buffer_mip).r;
 
-        vec3  history_normal  = octohedral_to_direction(sample_g_buffer_2.xy);
-        float history_mesh_id = sample_g_buffer_3.z;
+        vec3  history_normal  = g_buffer_normal(sample_g_buffer_2);
+        float history_mesh_id = g_buffer_mesh_id(sample_g_buffer_3);
         vec3  history_pos     = world_position_from_depth(history_tex_coord, sample_depth, view_proj_inverse);
 
         v[sample_idx] = is_reprojection_valid(history_coord, current_pos, history_pos, current_normal, history_normal, current_mesh_id, history_mesh_id, ivec2(image_dim));
@@ -275,8 +275,8 @@ bool reproject(in ivec2 frag_coord,
                 vec4  sample_g_buffer_3 = texelFetch(sampler_prev_gbuffer_3, p, g_buffer_mip);
                 float sample_depth      = texelFetch(sampler_prev_gbuffer_depth, p, g_buffer_mip).r;
 
-                vec3  history_normal  = octohedral_to_direction(sample_g_buffer_2.xy);
-                float history_mesh_id = sample_g_buffer_3.z;
+                vec3  history_normal  = g_buffer_normal(sample_g_buffer_2);
+                float history_mesh_id = g_buffer_mesh_id(sample_g_buffer_3);
                 vec3  history_pos     = world_position_from_depth(history_tex_coord, sample_depth, view_proj_inverse);
 
                 if (is_reprojection_valid(history_coord, current_pos, history_pos, current_normal, history_normal, current_mesh_id, history_mesh_id, ivec2(image_dim)))
@@ -0,0 +1,481 @@
+#ifndef SVGF_ATROUS_GLSL
+#define SVGF_ATROUS_GLSL
+
+// A-Trous filter of the SVGF denoiser, shared by all signal types. The including shader picks the signal with one of:
+//
+// SVGF_SIGNAL_SCALAR   : rg16f, visibility or AO in .r and its variance in .g.
+// SVGF_SIGNAL_RADIANCE : rgba16f, radiance in .rgb and the variance of its luminance in .a.
+//
+// Several iterations can be run by a single dispatch. Every work group then loads its tile of the denoise tile list along with
+// the halo that all of them read into shared memory, runs the iterations back to back on a region that shrinks by the footprint
+// of each iteration, and only writes the center tile out. Iterations whose footprint does not fit the cache are run one per
+// dispatch straight from the input texture.
+
+#include "../common.glsl"
+#define USE_EDGE_STOPPING_NORMAL_WEIGHT
+#define USE_EDGE_STOPPING_LUMA_WEIGHT
+#include "../edge_stopping.glsl"
+
+// ------------------------------------------------------------------
+// DEFINES ----------------------------------------------------------
+// ------------------------------------------------------------------
+
+#define NUM_THREADS_X 8
+#define NUM_THREADS_Y 8
+#define NUM_THREADS (NUM_THREADS_X * NUM_THREADS_Y)
+
+// Must match svgf_denoiser.h.
+#define SVGF_MAX_FUSED_HALO 12
+#define SVGF_CACHE_SIZE (NUM_THREADS_X + 2 * SVGF_MAX_FUSED_HALO)
+#define SVGF_CACHE_TEXELS (SVGF_CACHE_SIZE * SVGF_CACHE_SIZE)
+
+#define SVGF_FLAG_APPROXIMATE_WITH_DDGI 1
+
+const float FLT_MAX = 3.402823466e+38;
+
+#if defined(SVGF_SIGNAL_RADIANCE)
+#define SVGF_VALUE vec4
+#define SVGF_PACKED_VALUE uvec2
+#define SVGF_OUTPUT_FORMAT rgba16f
+#else
+#define SVGF_VALUE vec2
+#define SVGF_PACKED_VALUE uint
+#define SVGF_OUTPUT_FORMAT rg16f
+#endif
+
+// ------------------------------------------------------------------
+// INPUTS -----------------------------------------------------------
+// ------------------------------------------------------------------
+
+layout(local_size_x = NUM_THREADS_X, local_size_y = NUM_THREADS_Y, local_size_z = 1) in;
+
+// ------------------------------------------------------------------
+// DESCRIPTOR SETS --------------------------------------------------
+// ------------------------------------------------------------------
+
+layout(set = 0, binding = 0, SVGF_OUTPUT_FORMAT) uniform writeonly image2D i_Output;
+
+layout(set = 1, binding = 0) uniform sampler2D s_Input;
+
+// Current G-buffer DS
+layout(set = 2, binding = 0) uniform sampler2D s_GBuffer1;
+layout(set = 2, binding = 1) uniform sampler2D s_GBuffer2;
+layout(set = 2, binding = 2) uniform sampler2D s_GBuffer3;
+layout(set = 2, binding = 3) uniform sampler2D s_GBufferDepth;
+
+layout(set = 3, binding = 0, std430) buffer DenoiseTileData_t
+{
+    ivec2 coord[];
+}
+DenoiseTileData;
+
+// ------------------------------------------------------------------
+// PUSH CONSTANTS ---------------------------------------------------
+// ------------------------------------------------------------------
+
+layout(push_constant) uniform PushConstants
+{
+    int   radius;
+    int   first_iteration;
+    int   num_iterations;
+    int   halo;
+    float phi_signal;
+    float phi_normal;
+    float sigma_depth;
+    float power;
+    int   g_buffer_mip;
+    int   flags;
+}
+u_PushConstants;
+
+// ------------------------------------------------------------------
+// SHARED -----------------------------------------------------------
+// ------------------------------------------------------------------
+
+// Two copies of the signal that the iterations ping-pong between, plus the geometry that every iteration reads. Texels outside
+// the image get the largest depth there is so that the edge-stopping weights discard them.
+shared SVGF_PACKED_VALUE g_value[2][SVGF_CACHE_TEXELS];
+shared uint              g_normal[SVGF_CACHE_TEXELS];
+shared float             g_linear_z[SVGF_CACHE_TEXELS];
+shared uint              g_passthrough[SVGF_CACHE_TEXELS / 32];
+
+// Top left corner of the cached region in image space.
+ivec2 g_cache_origin;
+
+// ------------------------------------------------------------------
+// FUNCTIONS --------------------------------------------------------
+// ------------------------------------------------------------------
+
+#if defined(SVGF_SIGNAL_RADIANCE)
+
+SVGF_PACKED_VALUE pack_value(vec4 value)
+{
+    return uvec2(packHalf2x16(value.rg), packHalf2x16(value.ba));
+}
+
+vec4 unpack_value(uvec2 value)
+{
+    return vec4(unpackHalf2x16(value.x), unpackHalf2x16(value.y));
+}
+
+vec4 input_value(ivec2 coord)
+{
+    return texelFetch(s_Input, coord, 0);
+}
+
+vec4 output_value(vec4 value)
+{
+    return value;
+}
+
+float value_luma(vec4 value)
+{
+    return luminance(value.rgb);
+}
+
+float value_variance(vec4 value)
+{
+    return value.a;
+}
+
+// The color is weighted by w, its variance by w * w.
+vec4 value_weights(float w)
+{
+    return vec4(vec3(w), w * w);
+}
+
+vec4 apply_power(vec4 value)
+{
+    return value;
+}
+
+// The sky has no reflections, mirrors and the rough surfaces that DDGI handles are left as they are.
+bool is_passthrough(ivec2 coord, inout vec4 value)
+{
+    const float depth = texelFetch(s_GBufferDepth, coord, u_PushConstants.g_buffer_mip).r;
+
+    if (depth == 1.0f)
+    {
+        value = vec4(0.0f);
+        return true;
+    }
+
+    const float roughness = g_buffer_roughness(texelFetch(s_GBuffer2, coord, u_PushConstants.g_buffer_mip), texelFetch(s_GBuffer3, coord, u_PushConstants.g_buffer_mip));
+
+    return roughness < MIRROR_REFLECTIONS_ROUGHNESS_THRESHOLD || ((u_PushConstants.flags & SVGF_FLAG_APPROXIMATE_WITH_DDGI) != 0 && roughness > DDGI_REFLECTIONS_ROUGHNESS_THRESHOLD);
+}
+
+#else
+
+SVGF_PACKED_VALUE pack_value(vec2 value)
+{
+    return packHalf2x16(value);
+}
+
+vec2 unpack_value(uint value)
+{
+    return unpackHalf2x16(value);
+}
+
+vec2 input_value(ivec2 coord)
+{
+    return texelFetch(s_Input, coord, 0).rg;
+}
+
+vec4 output_value(vec2 value)
+{
+    return vec4(value, 0.0f, 0.0f);
+}
+
+float value_luma(vec2 value)
+{
+    return value.r;
+}
+
+float value_variance(vec2 value)
+{
+    return value.g;
+}
+
+// The signal is weighted by w, its variance by w * w.
+vec2 value_weights(float w)
+{
+    return vec2(w, w * w);
+}
+
+vec2 apply_power(vec2 value)
+{
+    return vec2(pow(value.r, u_PushConstants.power), value.g);
+}
+
+bool is_passthrough(ivec2 coord, inout vec2 value)
+{
+    return g_buffer_linear_z(texelFetch(s_GBuffer3, coord, u_PushConstants.g_buffer_mip)) < 0.0f;
+}
+
+#endif
+
+// ------------------------------------------------------------------
+
+bool is_fused()
+{
+    return u_PushConstants.halo > 0;
+}
+
+// ------------------------------------------------------------------
+
+bool is_inside(ivec2 coord, ivec2 size)
+{
+    return all(greaterThanEqual(coord, ivec2(0, 0))) && all(lessThan(coord, size));
+}
+
+// ------------------------------------------------------------------
+
+int cache_index(ivec2 coord)
+{
+    const ivec2 local_coord = coord - g_cache_origin;
+    return local_coord.y * SVGF_CACHE_SIZE + local_coord.x;
+}
+
+// ------------------------------------------------------------------
+
+void populate_cache(ivec2 size)
+{
+    const int region_size = NUM_THREADS_X + 2 * u_PushConstants.halo;
+
+    if (gl_LocalInvocationIndex < SVGF_CACHE_TEXELS / 32)
+        g_passthrough[gl_LocalInvocationIndex] = 0;
+
+    barrier();
+
+    for (int i = int(gl_LocalInvocationIndex); i < region_size * region_size; i += NUM_THREADS)
+    {
+        const ivec2 coord = g_cache_origin + ivec2(i % region_size, i / region_size);
+        const int   idx   = cache_index(coord);
+
+        if (is_inside(coord, size))
+        {
+            SVGF_VALUE value = input_value(coord);
+
+            if (is_passthrough(coord, value))
+                atomicOr(g_passthrough[idx / 32], 1u << uint(idx % 32));
+
+            const vec4 g_buffer_3 = texelFetch(s_GBuffer3, coord, u_PushConstants.g_buffer_mip);
+
+            g_value[0][idx] = pack_value(value);
+            g_normal[idx]   = packSnorm2x16(direction_to_octohedral(g_buffer_normal(texelFetch(s_GBuffer2, coord, u_PushConstants.g_buffer_mip))));
+            g_linear_z[idx] = g_buffer_linear_z(g_buffer_3);
+        }
+        else
+        {
+            g_value[0][idx] = pack_value(SVGF_VALUE(0.0f));
+            g_normal[idx]   = 0;
+            g_linear_z[idx] = FLT_MAX;
+        }
+    }
+
+    barrier();
+}
+
+// ------------------------------------------------------------------
+
+SVGF_VALUE fetch_value(ivec2 coord, int src)
+{
+    if (is_fused())
+        return unpack_value(g_value[src][cache_index(coord)]);
+    else
+        return input_value(coord);
+}
+
+// ------------------------------------------------------------------
+
+void fetch_geometry(ivec2 coord, ivec2 size, out vec3 normal, out float linear_z)
+{
+    if (is_fused())
+    {
+        const int idx = cache_index(coord);
+
+        normal   = octohedral_to_direction(unpackSnorm2x16(g_normal[idx]));
+        linear_z = g_linear_z[idx];
+    }
+    else if (is_inside(coord, size))
+    {
+        normal   = g_buffer_normal(texelFetch(s_GBuffer2, coord, u_PushConstants.g_buffer_mip));
+        linear_z = g_buffer_linear_z(texelFetch(s_GBuffer3, coord, u_PushConstants.g_buffer_mip));
+    }
+    else
+    {
+        normal   = vec3(0.0f);
+        linear_z = FLT_MAX;
+    }
+}
+
+// ------------------------------------------------------------------
+
+bool fetch_passthrough(ivec2 coord, inout SVGF_VALUE value)
+{
+    if (is_fused())
+    {
+        const int idx = cache_index(coord);
+        return (g_passthrough[idx / 32] & (1u << uint(idx % 32))) != 0;
+    }
+    else
+        return is_passthrough(coord, value);
+}
+
+// ------------------------------------------------------------------
+
+// computes a 3x3 gaussian blur of the variance, centered around
+// the current pixel
+float compute_variance_center(ivec2 coord, int src)
+{
+    float sum = 0.0f;
+
+    const float kernel[2][2] = {
+        { 1.0 / 4.0, 1.0 / 8.0 },
+        { 1.0 / 8.0, 1.0 / 16.0 }
+    };
+
+    const int radius = 1;
+    for (int yy = -radius; yy <= radius; yy++)
+    {
+        for (int xx = -radius; xx <= radius; xx++)
+        {
+            ivec2 p = coord + ivec2(xx, yy);
+
+            float k = kernel[abs(xx)][abs(yy)];
+
+            sum += value_variance(fetch_value(p, src)) * k;
+        }
+    }
+
+    return sum;
+}
+
+// ------------------------------------------------------------------
+
+SVGF_VALUE filter_texel(ivec2 coord, ivec2 size, int src, int step_size, bool last_iteration)
+{
+    const float eps_variance      = 1e-10;
+    const float kernel_weights[3] = { 1.0, 2.0 / 3.0, 1.0 / 6.0 };
+
+    SVGF_VALUE center = fetch_value(coord, src);
+
+    if (fetch_passthrough(coord, center))
+        return center;
+
+    const float center_luma = value_luma(center);
+
+    // variance filtered using 3x3 gaussin blur
+    const float var = compute_variance_center(coord, src);
+
+    vec3  center_normal;
+    float center_depth;
+
+    fetch_geometry(coord, size, center_normal, center_depth);
+
+    const float phi_signal = u_PushConstants.phi_signal * sqrt(max(0.0, eps_variance + var));
+
+    // explicitly store/accumulate center pixel with weight 1 to prevent issues
+    // with the edge-stopping functions
+    float      sum_w     = 1.0;
+    SVGF_VALUE sum_value = center;
+
+    for (int yy = -u_PushConstants.radius; yy <= u_PushConstants.radius; yy++)
+    {
+        for (int xx = -u_PushConstants.radius; xx <= u_PushConstants.radius; xx++)
+        {
+            if (xx == 0 && yy == 0) // skip center pixel, it is already accumulated
+                continue;
+
+            const ivec2 p      = coord + ivec2(xx, yy) * step_size;
+            const float kernel = kernel_weights[abs(xx)] * kernel_weights[abs(yy)];
+
+            vec3  sample_normal;
+            float sample_depth;
+
+            fetch_geometry(p, size, sample_normal, sample_depth);
+
+            const SVGF_VALUE sample_value = fetch_value(p, src);
+
+            // compute the edge-stopping functions
+            const float w = compute_edge_stopping_weight(center_depth,
+                                                         sample_depth,
+                                                         u_PushConstants.sigma_depth,
+                                                         center_normal,
+                                                         sample_normal,
+                                                         u_PushConstants.phi_normal,
+                                                         center_luma,
+                                                         value_luma(sample_value),
+                                                         phi_signal) *
+                            kernel;
+
+            sum_w += w;
+            sum_value += value_weights(w) * sample_value;
+        }
+    }
+
+    // renormalization is different for variance, check paper for the formula
+    SVGF_VALUE out_value = sum_value / value_weights(sum_w);
+
+    if (last_iteration && u_PushConstants.power != 0.0f)
+        out_value = apply_power(out_value);
+
+    return out_value;
+}
+
+// ------------------------------------------------------------------
+// MAIN -------------------------------------------------------------
+// ------------------------------------------------------------------
+
+void main()
+{
+    const ivec2 size       = textureSize(s_GBuffer1, u_PushConstants.g_buffer_mip);
+    const ivec2 tile_coord = DenoiseTileData.coord[gl_WorkGroupID.x];
+    const ivec2 coord      = tile_coord + ivec2(gl_LocalInvocationID.xy);
+
+    if (!is_fused())
+    {
+        imageStore(i_Output, coord, output_value(filter_texel(coord, size, 0, 1 << u_PushConstants.first_iteration, true)));
+        return;
+    }
+
+    g_cache_origin = tile_coord - ivec2(u_PushConstants.halo);
+
+    populate_cache(size);
+
+    // Halo that the iterations after the current one still need around the tile.
+    int halo = u_PushConstants.halo;
+    int src  = 0;
+
+    for (int i = 0; i < u_PushConstants.num_iterations - 1; i++)
+    {
+        const int step_size = 1 << (u_PushConstants.first_iteration + i);
+
+        // The variance prefilter only reads the direct neighbours of the center, which the kernel footprint always covers.
+        halo -= u_PushConstants.radius * step_size;
+
+        const int   region_size   = NUM_THREADS_X + 2 * halo;
+        const ivec2 region_origin = tile_coord - ivec2(halo);
+
+        for (int j = int(gl_LocalInvocationIndex); j < region_size * region_size; j += NUM_THREADS)
+        {
+            const ivec2 p = region_origin + ivec2(j % region_size, j / region_size);
+
+            g_value[1 - src][cache_index(p)] = pack_value(is_inside(p, size) ? filter_texel(p, size, src, step_size, false) : SVGF_VALUE(0.0f));
+        }
+
+        barrier();
+
+        src = 1 - src;
+    }
+
+    // The last iteration only covers the tile itself, one texel per thread.
+    const int step_size = 1 << (u_PushConstants.first_iteration + u_PushConstants.num_iterations - 1);
+
+    imageStore(i_Output, coord, output_value(filter_texel(coord, size, src, step_size, true)));
+}
+
+// ------------------------------------------------------------------
+
+#endif
@@ -0,0 +1,172 @@
+#include "svgf_denoiser.h"
+#include "g_buffer.h"
+#include <profiler.h>
+#include <macros.h>
+#include <imgui.h>
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+struct SVGFFilterPushConstants
+{
+    int32_t radius;
+    int32_t first_iteration;
+    int32_t num_iterations;
+    int32_t halo;
+    float   phi_signal;
+    float   phi_normal;
+    float   sigma_depth;
+    float   power;
+    int32_t g_buffer_mip;
+    int32_t flags;
+};
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+SVGFDenoiser::SVGFDenoiser(std::weak_ptr<dw::vk::Backend> backend, CommonResources* common_resources, GBuffer* g_buffer, SignalType signal_type, dw::vk::DescriptorSetLayout::Ptr tile_ds_layout) :
+    m_backend(backend), m_common_resources(common_resources), m_g_buffer(g_buffer), m_signal_type(signal_type)
+{
+    if (m_signal_type == SIGNAL_TYPE_VISIBILITY)
+    {
+        m_power              = 1.2f;
+        m_feedback_iteration = 1;
+    }
+    else if (m_signal_type == SIGNAL_TYPE_AO)
+    {
+        // AO accumulates the unfiltered signal, so nothing is fed back and the iterations all fit a single pass.
+        m_filter_iterations = 3;
+    }
+    else
+        m_feedback_iteration = 1;
+
+    create_pipeline(tile_ds_layout);
+    plan_passes();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+SVGFDenoiser::~SVGFDenoiser()
+{
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void SVGFDenoiser::filter(dw::vk::CommandBuffer::Ptr cmd_buf, uint32_t pass, dw::vk::DescriptorSet::Ptr write_ds, dw::vk::DescriptorSet::Ptr read_ds, dw::vk::DescriptorSet::Ptr tile_ds, dw::vk::Buffer::Ptr dispatch_args_buffer, int32_t g_buffer_mip, int32_t flags)
+{
+    DW_SCOPED_SAMPLE("SVGF Pass " + std::to_string(pass), cmd_buf);
+
+    vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline->handle());
+
+    SVGFFilterPushConstants push_constants;
+
+    push_constants.radius          = m_radius;
+    push_constants.first_iteration = m_passes[pass].first_iteration;
+    push_constants.num_iterations  = m_passes[pass].num_iterations;
+    push_constants.halo            = m_passes[pass].halo;
+    push_constants.phi_signal      = m_phi_signal;
+    push_constants.phi_normal      = m_phi_normal;
+    push_constants.sigma_depth     = m_sigma_depth;
+    push_constants.power           = pass == (m_passes.size() - 1) ? m_power : 0.0f;
+    push_constants.g_buffer_mip    = g_buffer_mip;
+    push_constants.flags           = flags;
+
+    vkCmdPushConstants(cmd_buf->handle(), m_pipeline_layout->handle(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_constants), &push_constants);
+
+    VkDescriptorSet descriptor_sets[] = {
+        write_ds->handle(),
+        read_ds->handle(),
+        m_g_buffer->output_ds()->handle(),
+        tile_ds->handle()
+    };
+
+    vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline_layout->handle(), 0, 4, descriptor_sets, 0, nullptr);
+
+    vkCmdDispatchIndirect(cmd_buf->handle(), dispatch_args_buffer->handle(), 0);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void SVGFDenoiser::gui()
+{
+    bool changed = false;
+
+    if (m_signal_type == SIGNAL_TYPE_VISIBILITY)
+        ImGui::InputFloat("Phi Visibility", &m_phi_signal);
+    else if (m_signal_type == SIGNAL_TYPE_AO)
+        ImGui::InputFloat("Phi AO", &m_phi_signal);
+    else
+        ImGui::InputFloat("Phi Color", &m_phi_signal);
+
+    ImGui::InputFloat("Phi Normal", &m_phi_normal);
+    ImGui::InputFloat("Sigma Depth", &m_sigma_depth);
+
+    changed |= ImGui::SliderInt("Filter Iterations", &m_filter_iterations, 1, 5);
+    changed |= ImGui::Checkbox("Fuse Iterations", &m_fuse_iterations);
+
+    if (m_signal_type == SIGNAL_TYPE_VISIBILITY)
+        ImGui::SliderFloat("Power", &m_power, 1.0f, 50.0f);
+
+    if (changed)
+        plan_passes();
+
+    ImGui::Text("A-Trous: %d iterations in %u passes", m_filter_iterations, num_passes());
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void SVGFDenoiser::create_pipeline(dw::vk::DescriptorSetLayout::Ptr tile_ds_layout)
+{
+    auto backend = m_backend.lock();
+
+    std::vector<PipelineCache::ComputePipelineDesc> compute_pipelines;
+
+    dw::vk::PipelineLayout::Desc desc;
+
+    desc.add_descriptor_set_layout(m_common_resources->storage_image_ds_layout);
+    desc.add_descriptor_set_layout(m_common_resources->combined_sampler_ds_layout);
+    desc.add_descriptor_set_layout(m_g_buffer->ds_layout());
+    desc.add_descriptor_set_layout(tile_ds_layout);
+
+    desc.add_push_constant_range(VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(SVGFFilterPushConstants));
+
+    m_pipeline_layout = dw::vk::PipelineLayout::create(backend, desc);
+    m_pipeline_layout->set_name("SVGF A-Trous Pipeline Layout");
+
+    if (m_signal_type == SIGNAL_TYPE_RADIANCE)
+        compute_pipelines.push_back({ "shaders/svgf_atrous_radiance.comp.spv", m_pipeline_layout, &m_pipeline });
+    else
+        compute_pipelines.push_back({ "shaders/svgf_atrous_scalar.comp.spv", m_pipeline_layout, &m_pipeline });
+
+    m_common_resources->pipeline_cache->create_compute_pipelines(compute_pipelines);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void SVGFDenoiser::plan_passes()
+{
+    m_passes.clear();
+
+    // Iterations are added to the current pass for as long as the halo they read around the tile fits the shared memory cache.
+    // A pass always ends on the feedback iteration so that its output can be copied into the history.
+    for (int32_t i = 0; i < m_filter_iterations; i++)
+    {
+        const int32_t footprint = m_radius * (1 << i);
+
+        if (m_fuse_iterations && !m_passes.empty())
+        {
+            Pass& current = m_passes.back();
+
+            const bool ends_on_feedback = current.first_iteration + current.num_iterations - 1 == m_feedback_iteration;
+
+            if (current.halo > 0 && !ends_on_feedback && current.halo + footprint <= SVGF_MAX_FUSED_HALO)
+            {
+                current.num_iterations++;
+                current.halo += footprint;
+                continue;
+            }
+        }
+
+        m_passes.push_back({ i, 1, m_fuse_iterations && footprint <= SVGF_MAX_FUSED_HALO ? footprint : 0 });
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
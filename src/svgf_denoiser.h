@@ -0,0 +1,69 @@
+#pragma once
+
+#include "common.h"
+
+// Must match svgf_atrous.glsl.
+#define SVGF_MAX_FUSED_HALO 12
+
+class GBuffer;
+
+// Spatial half of the SVGF denoiser shared by the ray traced effects. Each effect keeps its own temporal reprojection, which also
+// estimates the variance that drives the edge-stopping functions, along with the denoise tile list it builds. The A-Trous
+// iterations are grouped into passes: all the iterations of a pass are run by a single dispatch out of workgroup shared memory,
+// so only the output of a pass goes through memory.
+class SVGFDenoiser
+{
+public:
+    enum SignalType
+    {
+        SIGNAL_TYPE_VISIBILITY,
+        SIGNAL_TYPE_AO,
+        SIGNAL_TYPE_RADIANCE
+    };
+
+    enum Flags
+    {
+        FLAG_APPROXIMATE_WITH_DDGI = 1
+    };
+
+    struct Pass
+    {
+        int32_t first_iteration;
+        int32_t num_iterations;
+        int32_t halo; // Zero when the footprint does not fit the cache and the iteration reads its input directly.
+    };
+
+public:
+    SVGFDenoiser(std::weak_ptr<dw::vk::Backend> backend, CommonResources* common_resources, GBuffer* g_buffer, SignalType signal_type, dw::vk::DescriptorSetLayout::Ptr tile_ds_layout);
+    ~SVGFDenoiser();
+
+    // Runs one pass over the tiles of tile_ds, whose first binding must hold the tile coordinates.
+    void filter(dw::vk::CommandBuffer::Ptr cmd_buf, uint32_t pass, dw::vk::DescriptorSet::Ptr write_ds, dw::vk::DescriptorSet::Ptr read_ds, dw::vk::DescriptorSet::Ptr tile_ds, dw::vk::Buffer::Ptr dispatch_args_buffer, int32_t g_buffer_mip, int32_t flags = 0);
+    void gui();
+
+    inline uint32_t    num_passes() { return static_cast<uint32_t>(m_passes.size()); }
+    inline const Pass& pass(uint32_t idx) { return m_passes[idx]; }
+    inline bool        is_feedback_pass(uint32_t idx) { return m_passes[idx].first_iteration + m_passes[idx].num_iterations - 1 == m_feedback_iteration; }
+    inline SignalType  signal_type() { return m_signal_type; }
+
+private:
+    void create_pipeline(dw::vk::DescriptorSetLayout::Ptr tile_ds_layout);
+    void plan_passes();
+
+private:
+    std::weak_ptr<dw::vk::Backend> m_backend;
+    CommonResources*               m_common_resources;
+    GBuffer*                       m_g_buffer;
+    SignalType                     m_signal_type;
+    float                          m_phi_signal         = 10.0f;
+    float                          m_phi_normal         = 32.0f;
+    float                          m_sigma_depth        = 1.0f;
+    float                          m_power              = 0.0f;
+    int32_t                        m_radius             = 1;
+    int32_t                        m_filter_iterations  = 4;
+    int32_t                        m_feedback_iteration = -1;
+    bool                           m_fuse_iterations    = true;
+    std::vector<Pass>              m_passes;
+    CachedComputePipeline::Ptr     m_pipeline;
+    dw::vk::PipelineLayout::Ptr    m_pipeline_layout;
+};
@@ -19,11 +19,13 @@
 struct TAAPushConstants
 {
     glm::vec4 texel_size;
+    glm::vec4 input_texel_size;
     glm::vec4 current_prev_jitter;
     glm::vec4 time_params;
     float     feedback_min;
     float     feedback_max;
     int       sharpen;
+    int       upscale;
 };
 
 // -----------------------------------------------------------------------------------------------------------------------------------
@@ -72,7 +74,8 @@ void TemporalAA::update()
         uint32_t  sample_idx = m_common_resources->num_frames % (m_jitter_samples.size());
         glm::vec2 halton     = m_jitter_samples[sample_idx];
 
-        m_current_jitter = glm::vec2(halton.x / float(m_width), halton.y / float(m_height));
+        // The jitter covers a pixel of the image being rendered, which is smaller than the output when upscaling.
+        m_current_jitter = glm::vec2(halton.x / float(m_input_width), halton.y / float(m_input_height));
     }
     else
     {
@@ -95,6 +98,7 @@ void TemporalAA::render(dw::vk::CommandBuffer::Ptr cmd_buf,
     if (m_enabled)
     {
         DW_SCOPED_SAMPLE("TAA", cmd_buf);
+        GPU_SCOPED_TIMER("TAA", cmd_buf, m_common_resources->gpu_timer.get());
 
         const uint32_t NUM_THREADS = 32;
         const uint32_t write_idx   = (uint32_t)m_common_resources->ping_pong;
@@ -118,7 +122,10 @@ void TemporalAA::render(dw::vk::CommandBuffer::Ptr cmd_buf,
                                            VK_IMAGE_LAYOUT_UNDEFINED,
                                            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
                                            VK_IMAGE_ASPECT_COLOR_BIT,
-                                           VK_FILTER_NEAREST);
+                                           m_common_resources->upscaling() ? VK_FILTER_LINEAR : VK_FILTER_NEAREST);
+
+            // Seeding the history every frame would leave nothing to accumulate, which an upscaler depends on.
+            m_reset = false;
         }
 
         vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline->handle());
@@ -126,11 +133,13 @@ void TemporalAA::render(dw::vk::CommandBuffer::Ptr cmd_buf,
         TAAPushConstants push_constants;
 
         push_constants.texel_size          = glm::vec4(1.0f / float(m_width), 1.0f / float(m_height), float(m_width), float(m_height));
+        push_constants.input_texel_size    = glm::vec4(1.0f / float(m_input_width), 1.0f / float(m_input_height), float(m_input_width), float(m_input_height));
         push_constants.current_prev_jitter = glm::vec4(m_current_jitter, m_prev_jitter);
         push_constants.time_params         = glm::vec4(static_cast<float>(glfwGetTime()), sinf(static_cast<float>(glfwGetTime())), cosf(static_cast<float>(glfwGetTime())), delta_seconds);
         push_constants.feedback_min        = m_feedback_min;
         push_constants.feedback_max        = m_feedback_max;
         push_constants.sharpen             = static_cast<int>(m_sharpen);
+        push_constants.upscale             = static_cast<int>(m_common_resources->upscaling());
 
         vkCmdPushConstants(cmd_buf->handle(), m_pipeline_layout->handle(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_constants), &push_constants);
 
@@ -190,6 +199,11 @@ void TemporalAA::gui()
     ImGui::Checkbox("Sharpen", &m_sharpen);
     ImGui::SliderFloat("Feedback Min", &m_feedback_min, 0.0f, 1.0f);
     ImGui::SliderFloat("Feedback Max", &m_feedback_max, 0.0f, 1.0f);
+    ImGui::Text("Render Scale: %s (%ux%u -> %ux%u)", constants::render_scales[m_common_resources->render_scale].c_str(), m_input_width, m_input_height, m_width, m_height);
+
+    // Without TAA the tone map pass stretches the internal resolution image over the swap chain.
+    if (m_common_resources->upscaling() && !m_enabled)
+        ImGui::Text("Upscaling falls back to bilinear filtering.");
     ImGui::PopID();
 }
 
@@ -202,17 +216,27 @@ dw::vk::DescriptorSet::Ptr TemporalAA::output_ds()
 
 // -----------------------------------------------------------------------------------------------------------------------------------
 
+dw::vk::Image::Ptr TemporalAA::output_image()
+{
+    return m_image[m_common_resources->ping_pong];
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
 void TemporalAA::create_images()
 {
     auto vk_backend = m_backend.lock();
 
-    m_width  = vk_backend->swap_chain_extents().width;
-    m_height = vk_backend->swap_chain_extents().height;
+    // The history and output stay at the swap chain resolution, the current frame is read at the render resolution.
+    m_width        = vk_backend->swap_chain_extents().width;
+    m_height       = vk_backend->swap_chain_extents().height;
+    m_input_width  = m_common_resources->render_width;
+    m_input_height = m_common_resources->render_height;
 
     // TAA
     for (int i = 0; i < 2; i++)
     {
-        auto image = dw::vk::Image::create(vk_backend, VK_IMAGE_TYPE_2D, m_width, m_height, 1, 1, 1, VK_FORMAT_R16G16B16A16_SFLOAT, VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, VK_SAMPLE_COUNT_1_BIT);
+        auto image = dw::vk::Image::create(vk_backend, VK_IMAGE_TYPE_2D, m_width, m_height, 1, 1, 1, VK_FORMAT_R16G16B16A16_SFLOAT, VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, VK_SAMPLE_COUNT_1_BIT);
         image->set_name("TAA Image " + std::to_string(i));
 
         m_image.push_back(image);
@@ -328,14 +352,7 @@ void TemporalAA::create_pipeline(GBuffer* g_buffer)
 
     m_pipeline_layout = dw::vk::PipelineLayout::create(vk_backend, desc);
 
-    dw::vk::ShaderModule::Ptr module = dw::vk::ShaderModule::create_from_file(vk_backend, "shaders/taa.comp.spv");
-
-    dw::vk::ComputePipeline::Desc comp_desc;
-
-    comp_desc.set_pipeline_layout(m_pipeline_layout);
-    comp_desc.set_shader_stage(module, "main");
-
-    m_pipeline = dw::vk::ComputePipeline::create(vk_backend, comp_desc);
+    m_common_resources->pipeline_cache->create_compute_pipelines({ { "shaders/taa.comp.spv", m_pipeline_layout, &m_pipeline } });
 }
 
 // -----------------------------------------------------------------------------------------------------------------------------------
\ No newline at end of file
@@ -2,6 +2,7 @@
 
 #include <vk.h>
 #include <glm.hpp>
+#include "pipeline_cache.h"
 
 struct CommonResources;
 class GBuffer;
@@ -29,6 +30,7 @@ public:
                                       float                      delta_seconds);
     void                       gui();
     dw::vk::DescriptorSet::Ptr output_ds();
+    dw::vk::Image::Ptr         output_image();
 
     inline bool      enabled() { return m_enabled; }
     inline glm::vec2 current_jitter() { return m_current_jitter; }
@@ -44,11 +46,13 @@ private:
     std::weak_ptr<dw::vk::Backend>          m_backend;
     uint32_t                                m_width;
     uint32_t                                m_height;
+    uint32_t                                m_input_width;
+    uint32_t                                m_input_height;
     CommonResources*                        m_common_resources;
     GBuffer*                                m_g_buffer;
     std::vector<dw::vk::Image::Ptr>         m_image;
     std::vector<dw::vk::ImageView::Ptr>     m_view;
-    dw::vk::ComputePipeline::Ptr            m_pipeline;
+    CachedComputePipeline::Ptr              m_pipeline;
     dw::vk::PipelineLayout::Ptr             m_pipeline_layout;
     std::vector<dw::vk::DescriptorSet::Ptr> m_read_ds;
     std::vector<dw::vk::DescriptorSet::Ptr> m_write_ds;
@@ -51,6 +51,7 @@ void ToneMap::render(dw::vk::CommandBuffer::Ptr                      cmd_buf,
                      std::function<void(dw::vk::CommandBuffer::Ptr)> gui_callback)
 {
     DW_SCOPED_SAMPLE("Tone Map", cmd_buf);
+    GPU_SCOPED_TIMER("Tone Map", cmd_buf, m_common_resources->gpu_timer.get());
 
     auto vk_backend = m_backend.lock();
 
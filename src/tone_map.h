@@ -30,6 +30,8 @@ public:
                 std::function<void(dw::vk::CommandBuffer::Ptr)> gui_callback);
     void gui();
 
+    inline float exposure() { return m_exposure; }
+
 private:
     void create_pipeline();
 
@@ -0,0 +1,40 @@
+#include <assimp/Importer.hpp>
+#include <assimp/Exporter.hpp>
+#include <assimp/scene.h>
+#include <stdio.h>
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Converts a mesh into Assimp's binary scene format, which the application loads in place of the source file when it is
+// present next to it. Only the parsing is done here, the post processing is still applied by dw::Mesh::load at runtime
+// so the cooked scene matches the source exactly.
+int main(int argc, const char* argv[])
+{
+    if (argc != 3)
+    {
+        printf("Usage: HybridRendering_SceneCooker <input> <output>\n");
+        return 1;
+    }
+
+    Assimp::Importer importer;
+
+    const aiScene* scene = importer.ReadFile(argv[1], 0);
+
+    if (!scene)
+    {
+        printf("Failed to load %s: %s\n", argv[1], importer.GetErrorString());
+        return 1;
+    }
+
+    Assimp::Exporter exporter;
+
+    if (exporter.Export(scene, "assbin", argv[2]) != aiReturn_SUCCESS)
+    {
+        printf("Failed to write %s: %s\n", argv[2], exporter.GetErrorString());
+        return 1;
+    }
+
+    return 0;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
@@ -1,5 +1,9 @@
 #include "utilities.h"
 #include <macros.h>
+#include <gtc/packing.hpp>
+#include <algorithm>
+#include <atomic>
+#include <thread>
 
 // -----------------------------------------------------------------------------------------------------------------------------------
 
@@ -30,19 +34,23 @@ VkImageMemoryBarrier image_memory_barrier(dw::vk::Image::Ptr      image,
                                           VkImageLayout           newImageLayout,
                                           VkImageSubresourceRange subresourceRange,
                                           VkAccessFlags           srcAccessFlags,
-                                          VkAccessFlags           dstAccessFlags)
+                                          VkAccessFlags           dstAccessFlags,
+                                          uint32_t                srcQueueFamilyIndex,
+                                          uint32_t                dstQueueFamilyIndex)
 {
     // Create an image barrier object
     VkImageMemoryBarrier memory_barrier;
     DW_ZERO_MEMORY(memory_barrier);
 
-    memory_barrier.sType            = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-    memory_barrier.oldLayout        = oldImageLayout;
-    memory_barrier.newLayout        = newImageLayout;
-    memory_barrier.image            = image->handle();
-    memory_barrier.subresourceRange = subresourceRange;
-    memory_barrier.srcAccessMask    = srcAccessFlags;
-    memory_barrier.dstAccessMask    = dstAccessFlags;
+    memory_barrier.sType               = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    memory_barrier.oldLayout           = oldImageLayout;
+    memory_barrier.newLayout           = newImageLayout;
+    memory_barrier.image               = image->handle();
+    memory_barrier.subresourceRange    = subresourceRange;
+    memory_barrier.srcAccessMask       = srcAccessFlags;
+    memory_barrier.dstAccessMask       = dstAccessFlags;
+    memory_barrier.srcQueueFamilyIndex = srcQueueFamilyIndex;
+    memory_barrier.dstQueueFamilyIndex = dstQueueFamilyIndex;
 
     return memory_barrier;
 }
@@ -53,17 +61,21 @@ VkBufferMemoryBarrier buffer_memory_barrier(dw::vk::Buffer::Ptr buffer,
                                             VkDeviceSize        offset,
                                             VkDeviceSize        size,
                                             VkAccessFlags       srcAccessFlags,
-                                            VkAccessFlags       dstAccessFlags)
+                                            VkAccessFlags       dstAccessFlags,
+                                            uint32_t            srcQueueFamilyIndex,
+                                            uint32_t            dstQueueFamilyIndex)
 {
     VkBufferMemoryBarrier memory_barrier;
     DW_ZERO_MEMORY(memory_barrier);
 
-    memory_barrier.sType         = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
-    memory_barrier.srcAccessMask = srcAccessFlags;
-    memory_barrier.dstAccessMask = dstAccessFlags;
-    memory_barrier.buffer        = buffer->handle();
-    memory_barrier.offset        = offset;
-    memory_barrier.size          = size;
+    memory_barrier.sType               = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    memory_barrier.srcAccessMask       = srcAccessFlags;
+    memory_barrier.dstAccessMask       = dstAccessFlags;
+    memory_barrier.srcQueueFamilyIndex = srcQueueFamilyIndex;
+    memory_barrier.dstQueueFamilyIndex = dstQueueFamilyIndex;
+    memory_barrier.buffer              = buffer->handle();
+    memory_barrier.offset              = offset;
+    memory_barrier.size                = size;
 
     return memory_barrier;
 }
@@ -83,4 +95,97 @@ VkMemoryBarrier memory_barrier(VkAccessFlags srcAccessFlags, VkAccessFlags dstAc
     return memory_barrier;
 }
 
-// -----------------------------------------------------------------------------------------------------------------------------------
\ No newline at end of file
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void parallel_for(uint32_t count, std::function<void(uint32_t)> function)
+{
+    std::atomic<uint32_t>    next_idx(0);
+    std::vector<std::thread> workers;
+
+    const uint32_t num_workers = std::min(std::max(std::thread::hardware_concurrency(), 1u), count);
+
+    for (uint32_t i = 0; i < num_workers; i++)
+    {
+        workers.push_back(std::thread([&]() {
+            for (uint32_t idx = next_idx++; idx < count; idx = next_idx++)
+                function(idx);
+        }));
+    }
+
+    for (auto& worker : workers)
+        worker.join();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+std::vector<glm::vec4> read_back_image(dw::vk::Backend::Ptr backend, dw::vk::Image::Ptr image, VkImageLayout layout)
+{
+    const uint32_t     width  = image->width();
+    const uint32_t     height = image->height();
+    const VkDeviceSize size   = sizeof(uint64_t) * width * height;
+
+    dw::vk::Buffer::Ptr buffer = dw::vk::Buffer::create(backend, VK_BUFFER_USAGE_TRANSFER_DST_BIT, size, VMA_MEMORY_USAGE_GPU_TO_CPU, VMA_ALLOCATION_CREATE_MAPPED_BIT);
+
+    auto cmd_buf = backend->allocate_graphics_command_buffer(true);
+
+    VkImageSubresourceRange subresource_range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+
+    {
+        std::vector<VkImageMemoryBarrier> image_barriers = {
+            image_memory_barrier(image, layout, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, subresource_range, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT)
+        };
+
+        pipeline_barrier(cmd_buf, {}, image_barriers, {}, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+    }
+
+    VkBufferImageCopy region;
+    DW_ZERO_MEMORY(region);
+
+    region.imageSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.mipLevel       = 0;
+    region.imageSubresource.baseArrayLayer = 0;
+    region.imageSubresource.layerCount     = 1;
+    region.imageExtent                     = { width, height, 1 };
+
+    vkCmdCopyImageToBuffer(cmd_buf->handle(), image->handle(), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, buffer->handle(), 1, &region);
+
+    {
+        std::vector<VkImageMemoryBarrier> image_barriers = {
+            image_memory_barrier(image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, layout, subresource_range, VK_ACCESS_TRANSFER_READ_BIT, VK_ACCESS_SHADER_READ_BIT)
+        };
+
+        std::vector<VkBufferMemoryBarrier> buffer_barriers = {
+            buffer_memory_barrier(buffer, 0, size, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_HOST_READ_BIT)
+        };
+
+        pipeline_barrier(cmd_buf, {}, image_barriers, buffer_barriers, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT | VK_PIPELINE_STAGE_HOST_BIT);
+    }
+
+    vkEndCommandBuffer(cmd_buf->handle());
+
+    backend->flush_graphics({ cmd_buf });
+
+    std::vector<glm::vec4> pixels(width * height);
+
+    const uint64_t* data = (const uint64_t*)buffer->mapped_ptr();
+
+    for (uint32_t i = 0; i < width * height; i++)
+        pixels[i] = glm::unpackHalf4x16(data[i]);
+
+    return pixels;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool is_storage_image_format_supported(dw::vk::Backend::Ptr backend, VkFormat format)
+{
+    VkFormatProperties properties;
+
+    vkGetPhysicalDeviceFormatProperties(backend->physical_device(), format, &properties);
+
+    const VkFormatFeatureFlags required = VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT;
+
+    return (properties.optimalTilingFeatures & required) == required;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
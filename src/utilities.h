@@ -1,6 +1,8 @@
 #pragma once
 
 #include <vk.h>
+#include <glm.hpp>
+#include <functional>
 
 extern void                  pipeline_barrier(dw::vk::CommandBuffer::Ptr         cmd_buf,
                                               std::vector<VkMemoryBarrier>       memory_barriers,
@@ -13,10 +15,26 @@ extern VkImageMemoryBarrier  image_memory_barrier(dw::vk::Image::Ptr      image,
                                                   VkImageLayout           newImageLayout,
                                                   VkImageSubresourceRange subresourceRange,
                                                   VkAccessFlags           srcAccessFlags,
-                                                  VkAccessFlags           dstAccessFlags);
+                                                  VkAccessFlags           dstAccessFlags,
+                                                  uint32_t                srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                                                  uint32_t                dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED);
 extern VkBufferMemoryBarrier buffer_memory_barrier(dw::vk::Buffer::Ptr buffer,
                                                    VkDeviceSize        offset,
                                                    VkDeviceSize        size,
                                                    VkAccessFlags       srcAccessFlags,
-                                                   VkAccessFlags       dstAccessFlags);
-extern VkMemoryBarrier       memory_barrier(VkAccessFlags srcAccessFlags, VkAccessFlags dstAccessFlags);
\ No newline at end of file
+                                                   VkAccessFlags       dstAccessFlags,
+                                                   uint32_t            srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                                                   uint32_t            dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED);
+extern VkMemoryBarrier       memory_barrier(VkAccessFlags srcAccessFlags, VkAccessFlags dstAccessFlags);
+
+// Runs function for every index in [0, count) on a set of worker threads and returns once all of them are done. Nothing
+// that records or submits Vulkan commands should be run through this, the command pools and queues are not synchronized.
+extern void parallel_for(uint32_t count, std::function<void(uint32_t)> function);
+
+// Copies the first mip of an RGBA16F image back to the host and returns it as floats. The image is expected in layout and left in
+// it. This submits and waits for the graphics queue, so it is only meant for offline use in between frames.
+extern std::vector<glm::vec4> read_back_image(dw::vk::Backend::Ptr backend, dw::vk::Image::Ptr image, VkImageLayout layout);
+
+// Whether images of a format can be bound as storage images on the device of backend. Storage support for the packed formats is
+// optional in Vulkan.
+extern bool is_storage_image_format_supported(dw::vk::Backend::Ptr backend, VkFormat format);